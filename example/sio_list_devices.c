@@ -108,6 +108,30 @@ static int list_devices(struct SoundIo *soundio) {
     return 0;
 }
 
+static void on_device_changes(struct SoundIo *soundio,
+        const struct SoundIoDeviceChange *changes, int change_count)
+{
+    for (int i = 0; i < change_count; i += 1) {
+        const struct SoundIoDeviceChange *change = &changes[i];
+        const char *aim = (change->aim == SoundIoDeviceAimInput) ? "input" : "output";
+        const char *raw = change->is_raw ? " (raw)" : "";
+        switch (change->type) {
+        case SoundIoDeviceChangeAdded:
+            fprintf(stderr, "added %s device: %s%s\n", aim, change->id, raw);
+            break;
+        case SoundIoDeviceChangeRemoved:
+            fprintf(stderr, "removed %s device: %s%s\n", aim, change->id, raw);
+            break;
+        case SoundIoDeviceChangeUpdated:
+            fprintf(stderr, "updated %s device: %s%s\n", aim, change->id, raw);
+            break;
+        case SoundIoDeviceChangeDefault:
+            fprintf(stderr, "default %s device: %s%s\n", aim, change->id ? change->id : "(none)", raw);
+            break;
+        }
+    }
+}
+
 static void on_devices_change(struct SoundIo *soundio) {
     fprintf(stderr, "devices changed\n");
     list_devices(soundio);
@@ -169,6 +193,7 @@ int main(int argc, char **argv) {
 
     if (watch) {
         soundio->on_devices_change = on_devices_change;
+        soundio->on_device_changes = on_device_changes;
         for (;;) {
             soundio_wait_events(soundio);
         }
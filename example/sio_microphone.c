@@ -13,7 +13,7 @@
 #include <string.h>
 #include <math.h>
 
-struct SoundIoRingBuffer *ring_buffer = NULL;
+struct SoundIoDuplexBridge *bridge = NULL;
 
 static enum SoundIoFormat prioritized_formats[] = {
     SoundIoFormatFloat32NE,
@@ -58,119 +58,19 @@ static void panic(const char *format, ...) {
     abort();
 }
 
-static int min_int(int a, int b) {
-    return (a < b) ? a : b;
-}
-
 static void read_callback(struct SoundIoInStream *instream, int frame_count_min, int frame_count_max) {
-    struct SoundIoChannelArea *areas;
     int err;
-    char *write_ptr = soundio_ring_buffer_write_ptr(ring_buffer);
-    int free_bytes = soundio_ring_buffer_free_count(ring_buffer);
-    int free_count = free_bytes / instream->bytes_per_frame;
-
-    if (frame_count_min > free_count)
-        panic("ring buffer overflow");
-
-    int write_frames = min_int(free_count, frame_count_max);
-    int frames_left = write_frames;
-
-    for (;;) {
-        int frame_count = frames_left;
-
-        if ((err = soundio_instream_begin_read(instream, &areas, &frame_count)))
-            panic("begin read error: %s", soundio_strerror(err));
-
-        if (!frame_count)
-            break;
-
-        if (!areas) {
-            // Due to an overflow there is a hole. Fill the ring buffer with
-            // silence for the size of the hole.
-            memset(write_ptr, 0, frame_count * instream->bytes_per_frame);
-            fprintf(stderr, "Dropped %d frames due to internal overflow\n", frame_count);
-        } else {
-            for (int frame = 0; frame < frame_count; frame += 1) {
-                for (int ch = 0; ch < instream->layout.channel_count; ch += 1) {
-                    memcpy(write_ptr, areas[ch].ptr, instream->bytes_per_sample);
-                    areas[ch].ptr += areas[ch].step;
-                    write_ptr += instream->bytes_per_sample;
-                }
-            }
-        }
-
-        if ((err = soundio_instream_end_read(instream)))
-            panic("end read error: %s", soundio_strerror(err));
-
-        frames_left -= frame_count;
-        if (frames_left <= 0)
-            break;
-    }
-
-    int advance_bytes = write_frames * instream->bytes_per_frame;
-    soundio_ring_buffer_advance_write_ptr(ring_buffer, advance_bytes);
+    if ((err = soundio_duplex_bridge_capture(bridge, frame_count_min, frame_count_max)))
+        panic("read error: %s", soundio_strerror(err));
 }
 
 static void write_callback(struct SoundIoOutStream *outstream, int frame_count_min, int frame_count_max) {
-    struct SoundIoChannelArea *areas;
-    int frames_left;
-    int frame_count;
     int err;
-
-    char *read_ptr = soundio_ring_buffer_read_ptr(ring_buffer);
-    int fill_bytes = soundio_ring_buffer_fill_count(ring_buffer);
-    int fill_count = fill_bytes / outstream->bytes_per_frame;
-
-    if (frame_count_min > fill_count) {
-        // Ring buffer does not have enough data, fill with zeroes.
-        frames_left = frame_count_min;
-        for (;;) {
-            frame_count = frames_left;
-            if (frame_count <= 0)
-              return;
-            if ((err = soundio_outstream_begin_write(outstream, &areas, &frame_count)))
-                panic("begin write error: %s", soundio_strerror(err));
-            if (frame_count <= 0)
-                return;
-            for (int frame = 0; frame < frame_count; frame += 1) {
-                for (int ch = 0; ch < outstream->layout.channel_count; ch += 1) {
-                    memset(areas[ch].ptr, 0, outstream->bytes_per_sample);
-                    areas[ch].ptr += areas[ch].step;
-                }
-            }
-            if ((err = soundio_outstream_end_write(outstream)))
-                panic("end write error: %s", soundio_strerror(err));
-            frames_left -= frame_count;
-        }
+    if ((err = soundio_duplex_bridge_play(bridge, frame_count_min, frame_count_max))) {
+        if (err == SoundIoErrorUnderflow)
+            return;
+        panic("write error: %s", soundio_strerror(err));
     }
-
-    int read_count = min_int(frame_count_max, fill_count);
-    frames_left = read_count;
-
-    while (frames_left > 0) {
-        int frame_count = frames_left;
-
-        if ((err = soundio_outstream_begin_write(outstream, &areas, &frame_count)))
-            panic("begin write error: %s", soundio_strerror(err));
-
-        if (frame_count <= 0)
-            break;
-
-        for (int frame = 0; frame < frame_count; frame += 1) {
-            for (int ch = 0; ch < outstream->layout.channel_count; ch += 1) {
-                memcpy(areas[ch].ptr, read_ptr, outstream->bytes_per_sample);
-                areas[ch].ptr += areas[ch].step;
-                read_ptr += outstream->bytes_per_sample;
-            }
-        }
-
-        if ((err = soundio_outstream_end_write(outstream)))
-            panic("end write error: %s", soundio_strerror(err));
-
-        frames_left -= frame_count;
-    }
-
-    soundio_ring_buffer_advance_read_ptr(ring_buffer, read_count * outstream->bytes_per_frame);
 }
 
 static void underflow_callback(struct SoundIoOutStream *outstream) {
@@ -199,7 +99,7 @@ int main(int argc, char **argv) {
     bool in_raw = false;
     bool out_raw = false;
 
-    double microphone_latency = 0.2; // seconds
+    double microphone_latency = 0.05; // seconds
 
     for (int i = 1; i < argc; i += 1) {
         char *arg = argv[i];
@@ -340,7 +240,7 @@ int main(int argc, char **argv) {
     instream->format = *fmt;
     instream->sample_rate = *sample_rate;
     instream->layout = *layout;
-    instream->software_latency = microphone_latency;
+    instream->software_latency = microphone_latency / 2.0;
     instream->read_callback = read_callback;
 
     if ((err = soundio_instream_open(instream))) {
@@ -354,7 +254,7 @@ int main(int argc, char **argv) {
     outstream->format = *fmt;
     outstream->sample_rate = *sample_rate;
     outstream->layout = *layout;
-    outstream->software_latency = microphone_latency;
+    outstream->software_latency = microphone_latency / 2.0;
     outstream->write_callback = write_callback;
     outstream->underflow_callback = underflow_callback;
 
@@ -363,14 +263,11 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-    int capacity = microphone_latency * 2 * instream->sample_rate * instream->bytes_per_frame;
-    ring_buffer = soundio_ring_buffer_create(soundio, capacity);
-    if (!ring_buffer)
-        panic("unable to create ring buffer: out of memory");
-    char *buf = soundio_ring_buffer_write_ptr(ring_buffer);
-    int fill_count = microphone_latency * outstream->sample_rate * outstream->bytes_per_frame;
-    memset(buf, 0, fill_count);
-    soundio_ring_buffer_advance_write_ptr(ring_buffer, fill_count);
+    // The bridge keeps the latency where it is asked to be however far the
+    // two device clocks drift apart.
+    bridge = soundio_duplex_bridge_create(instream, outstream, microphone_latency);
+    if (!bridge)
+        panic("unable to create duplex bridge: out of memory");
 
     if ((err = soundio_instream_start(instream)))
         panic("unable to start input device: %s", soundio_strerror(err));
@@ -383,6 +280,7 @@ int main(int argc, char **argv) {
 
     soundio_outstream_destroy(outstream);
     soundio_instream_destroy(instream);
+    soundio_duplex_bridge_destroy(bridge);
     soundio_device_unref(in_device);
     soundio_device_unref(out_device);
     soundio_destroy(soundio);
@@ -11,31 +11,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
-#include <errno.h>
+#include <signal.h>
 #include <unistd.h>
 
-struct RecordContext {
-    struct SoundIoRingBuffer *ring_buffer;
-};
-
+// Formats the recorder can store, the first supported one is used.
 static enum SoundIoFormat prioritized_formats[] = {
-    SoundIoFormatFloat32NE,
-    SoundIoFormatFloat32FE,
-    SoundIoFormatS32NE,
-    SoundIoFormatS32FE,
-    SoundIoFormatS24NE,
-    SoundIoFormatS24FE,
-    SoundIoFormatS16NE,
-    SoundIoFormatS16FE,
-    SoundIoFormatFloat64NE,
-    SoundIoFormatFloat64FE,
-    SoundIoFormatU32NE,
-    SoundIoFormatU32FE,
-    SoundIoFormatU24NE,
-    SoundIoFormatU24FE,
-    SoundIoFormatU16NE,
-    SoundIoFormatU16FE,
-    SoundIoFormatS8,
+    SoundIoFormatFloat32LE,
+    SoundIoFormatS32LE,
+    SoundIoFormatS24LE,
+    SoundIoFormatS16LE,
+    SoundIoFormatFloat64LE,
     SoundIoFormatU8,
     SoundIoFormatInvalid,
 };
@@ -48,64 +33,19 @@ static int prioritized_sample_rates[] = {
     0,
 };
 
-static int min_int(int a, int b) {
-    return (a < b) ? a : b;
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_sigint(int signum) {
+    stop_requested = 1;
 }
 
 static void read_callback(struct SoundIoInStream *instream, int frame_count_min, int frame_count_max) {
-    struct RecordContext *rc = instream->userdata;
-    struct SoundIoChannelArea *areas;
+    struct SoundIoRecorder *recorder = instream->userdata;
     int err;
-
-    char *write_ptr = soundio_ring_buffer_write_ptr(rc->ring_buffer);
-    int free_bytes = soundio_ring_buffer_free_count(rc->ring_buffer);
-    int free_count = free_bytes / instream->bytes_per_frame;
-
-    if (free_count < frame_count_min) {
-        fprintf(stderr, "ring buffer overflow\n");
+    if ((err = soundio_recorder_capture(recorder, frame_count_min, frame_count_max))) {
+        fprintf(stderr, "read error: %s\n", soundio_strerror(err));
         exit(1);
     }
-
-    int write_frames = min_int(free_count, frame_count_max);
-    int frames_left = write_frames;
-
-    for (;;) {
-        int frame_count = frames_left;
-
-        if ((err = soundio_instream_begin_read(instream, &areas, &frame_count))) {
-            fprintf(stderr, "begin read error: %s", soundio_strerror(err));
-            exit(1);
-        }
-
-        if (!frame_count)
-            break;
-
-        if (!areas) {
-            // Due to an overflow there is a hole. Fill the ring buffer with
-            // silence for the size of the hole.
-            memset(write_ptr, 0, frame_count * instream->bytes_per_frame);
-        } else {
-            for (int frame = 0; frame < frame_count; frame += 1) {
-                for (int ch = 0; ch < instream->layout.channel_count; ch += 1) {
-                    memcpy(write_ptr, areas[ch].ptr, instream->bytes_per_sample);
-                    areas[ch].ptr += areas[ch].step;
-                    write_ptr += instream->bytes_per_sample;
-                }
-            }
-        }
-
-        if ((err = soundio_instream_end_read(instream))) {
-            fprintf(stderr, "end read error: %s", soundio_strerror(err));
-            exit(1);
-        }
-
-        frames_left -= frame_count;
-        if (frames_left <= 0)
-            break;
-    }
-
-    int advance_bytes = write_frames * instream->bytes_per_frame;
-    soundio_ring_buffer_advance_write_ptr(rc->ring_buffer, advance_bytes);
 }
 
 static void overflow_callback(struct SoundIoInStream *instream) {
@@ -168,8 +108,6 @@ int main(int argc, char **argv) {
     if (!outfile)
         return usage(exe);
 
-    struct RecordContext rc;
-
     struct SoundIo *soundio = soundio_create();
     if (!soundio) {
         fprintf(stderr, "out of memory\n");
@@ -237,14 +175,11 @@ int main(int argc, char **argv) {
             break;
         }
     }
-    if (fmt == SoundIoFormatInvalid)
-        fmt = selected_device->formats[0];
-
-    FILE *out_f = fopen(outfile, "wb");
-    if (!out_f) {
-        fprintf(stderr, "unable to open %s: %s\n", outfile, strerror(errno));
+    if (fmt == SoundIoFormatInvalid) {
+        fprintf(stderr, "The device has no format a WAV file can hold.\n");
         return 1;
     }
+
     struct SoundIoInStream *instream = soundio_instream_create(selected_device);
     if (!instream) {
         fprintf(stderr, "out of memory\n");
@@ -254,7 +189,6 @@ int main(int argc, char **argv) {
     instream->sample_rate = sample_rate;
     instream->read_callback = read_callback;
     instream->overflow_callback = overflow_callback;
-    instream->userdata = &rc;
 
     if ((err = soundio_instream_open(instream))) {
         fprintf(stderr, "unable to open input stream: %s", soundio_strerror(err));
@@ -264,36 +198,42 @@ int main(int argc, char **argv) {
     fprintf(stderr, "%s %dHz %s interleaved\n",
             instream->layout.name, sample_rate, soundio_format_string(fmt));
 
-    const int ring_buffer_duration_seconds = 30;
-    int capacity = ring_buffer_duration_seconds * instream->sample_rate * instream->bytes_per_frame;
-    rc.ring_buffer = soundio_ring_buffer_create(soundio, capacity);
-    if (!rc.ring_buffer) {
-        fprintf(stderr, "out of memory\n");
+    struct SoundIoRecorder *recorder;
+    if ((err = soundio_recorder_create(instream, outfile, 30.0, &recorder))) {
+        fprintf(stderr, "unable to create %s: %s\n", outfile, soundio_strerror(err));
         return 1;
     }
+    instream->userdata = recorder;
 
+    signal(SIGINT, on_sigint);
     if ((err = soundio_instream_start(instream))) {
         fprintf(stderr, "unable to start input device: %s", soundio_strerror(err));
         return 1;
     }
 
-    // Note: in this example, if you send SIGINT (by pressing Ctrl+C for example)
-    // you will lose up to 1 second of recorded audio data. In non-example code,
-    // consider a better shutdown strategy.
-    for (;;) {
+    // Ctrl+C stops recording and completes the file.
+    int64_t dropped = 0;
+    while (!stop_requested) {
         soundio_flush_events(soundio);
         sleep(1);
-        int fill_bytes = soundio_ring_buffer_fill_count(rc.ring_buffer);
-        char *read_buf = soundio_ring_buffer_read_ptr(rc.ring_buffer);
-        size_t amt = fwrite(read_buf, 1, fill_bytes, out_f);
-        if ((int)amt != fill_bytes) {
-            fprintf(stderr, "write error: %s\n", strerror(errno));
+        struct SoundIoRecorderStats stats;
+        soundio_recorder_get_stats(recorder, &stats);
+        if (stats.write_error) {
+            fprintf(stderr, "write error: %s\n", soundio_strerror(stats.write_error));
             return 1;
         }
-        soundio_ring_buffer_advance_read_ptr(rc.ring_buffer, fill_bytes);
+        if (stats.frames_dropped != dropped) {
+            fprintf(stderr, "dropped %ld frames, the disk is too slow\n", (long)(stats.frames_dropped - dropped));
+            dropped = stats.frames_dropped;
+        }
     }
 
     soundio_instream_destroy(instream);
+    if ((err = soundio_recorder_finish(recorder))) {
+        fprintf(stderr, "unable to complete %s: %s\n", outfile, soundio_strerror(err));
+        return 1;
+    }
+    soundio_recorder_destroy(recorder);
     soundio_device_unref(selected_device);
     soundio_destroy(soundio);
     return 0;
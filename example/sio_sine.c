@@ -253,6 +253,9 @@ int main(int argc, char **argv) {
     if (outstream->layout_error)
         fprintf(stderr, "unable to set channel layout: %s\n", soundio_strerror(outstream->layout_error));
 
+    if (outstream->buffer_access == SoundIoBufferAccessCopy)
+        fprintf(stderr, "device cannot be written directly; every period is copied\n");
+
     if ((err = soundio_outstream_start(outstream))) {
         fprintf(stderr, "unable to start device: %s\n", soundio_strerror(err));
         return 1;
@@ -10,6 +10,8 @@
 
 #include "endian.h"
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 /// \cond
 #ifdef __cplusplus
@@ -100,6 +102,10 @@ enum SoundIoError {
     SoundIoErrorUnderflow,
     /// Unable to convert to or from UTF-8 to the native string format.
     SoundIoErrorEncodingString,
+    /// Unable to lock memory into RAM. See SoundIo::lock_memory.
+    SoundIoErrorMemoryLock,
+    /// Unable to create, write or close a file.
+    SoundIoErrorFileIo,
 };
 
 /// Specifies where a channel is physically located.
@@ -230,6 +236,68 @@ enum SoundIoDeviceAim {
     SoundIoDeviceAimOutput, ///< playback
 };
 
+/// Describes where the areas handed out by ::soundio_outstream_begin_write
+/// and ::soundio_instream_begin_read point. This only reports the path the
+/// backend negotiated; libsoundio does not avoid the copy.
+enum SoundIoBufferAccess {
+    /// The backend does not report it.
+    SoundIoBufferAccessUnknown,
+    /// The areas point directly into the device or sound server buffer.
+    SoundIoBufferAccessDirect,
+    /// The areas point into a buffer owned by libsoundio, which is copied to
+    /// or from the device after each write or before each read. This costs
+    /// one extra copy of every period.
+    SoundIoBufferAccessCopy,
+};
+
+/// Filters for resampling, from the least delay and CPU time to the
+/// flattest passband. All of them are linear phase and delay the signal by
+/// half their length.
+enum SoundIoResampleQuality {
+    /// 16 taps, about 50 dB of stopband attenuation, passband up to 82% of
+    /// Nyquist.
+    SoundIoResampleQualityLow,
+    /// 32 taps, about 70 dB, passband up to 86% of Nyquist.
+    SoundIoResampleQualityMedium,
+    /// 64 taps, about 90 dB, passband up to 91% of Nyquist.
+    SoundIoResampleQualityHigh,
+};
+
+/// How the streams of the dummy backend keep time. See SoundIo::dummy_clock.
+enum SoundIoDummyClock {
+    /// Streams are paced by the system clock, like a sound card.
+    SoundIoDummyClockRealTime,
+    /// Streams run as fast as their callbacks allow. Every period the
+    /// virtual clock moves ahead by one period, so a stream plays or records
+    /// exactly as many frames as it would in real time, and underflows and
+    /// overflows happen at the same points in the stream on every run.
+    SoundIoDummyClockFreeRun,
+    /// Time only passes when ::soundio_dummy_advance is called.
+    SoundIoDummyClockManual,
+};
+
+/// Scheduling policies for the threads which run stream callbacks. See
+/// SoundIoThreadSettings.
+enum SoundIoThreadPolicy {
+    /// For a stream, use SoundIo::thread_settings. For SoundIo, the highest
+    /// real time priority available: `SCHED_FIFO` at its maximum priority,
+    /// or on Windows the "Pro Audio" task of MMCSS, falling back to
+    /// `THREAD_PRIORITY_TIME_CRITICAL`.
+    SoundIoThreadPolicyDefault,
+    /// Normal, non real time scheduling.
+    SoundIoThreadPolicyNormal,
+    /// `SCHED_FIFO`. On Windows, `THREAD_PRIORITY_TIME_CRITICAL`.
+    SoundIoThreadPolicyFifo,
+    /// `SCHED_RR`. On Windows, `THREAD_PRIORITY_TIME_CRITICAL`.
+    SoundIoThreadPolicyRoundRobin,
+    /// `SCHED_DEADLINE`. Linux only. Most kernels refuse it for a thread
+    /// which is pinned with SoundIoThreadSettings::cpu_mask.
+    SoundIoThreadPolicyDeadline,
+    /// The "Pro Audio" task of the Multimedia Class Scheduler Service.
+    /// Windows only.
+    SoundIoThreadPolicyMmcss,
+};
+
 /// For your convenience, Native Endian and Foreign Endian constants are defined
 /// which point to the respective SoundIoFormat values.
 enum SoundIoFormat {
@@ -324,6 +392,70 @@ struct SoundIoChannelArea {
     int step;
 };
 
+/// What happened to a device. See SoundIo::on_device_changes.
+enum SoundIoDeviceChangeType {
+    /// The device was not in the previous device list.
+    SoundIoDeviceChangeAdded,
+    /// The device is no longer in the device list.
+    SoundIoDeviceChangeRemoved,
+    /// The device is still in the list, but some of its properties, such
+    /// as its name, formats or current layout, are different.
+    SoundIoDeviceChangeUpdated,
+    /// A different device, or none, is the default for the aim.
+    SoundIoDeviceChangeDefault,
+};
+
+/// One entry of the changes passed to SoundIo::on_device_changes.
+/// The size of this struct is OK to use.
+struct SoundIoDeviceChange {
+    enum SoundIoDeviceChangeType type;
+    enum SoundIoDeviceAim aim;
+    /// The SoundIoDevice::id of the device. Only valid for the duration of
+    /// the callback. `NULL` for #SoundIoDeviceChangeDefault when there no
+    /// longer is a default device.
+    const char *id;
+    bool is_raw;
+    /// For #SoundIoDeviceChangeRemoved, the index the device had in the
+    /// previous list. Otherwise the index for ::soundio_get_input_device or
+    /// ::soundio_get_output_device, or -1 when there no longer is a default
+    /// device.
+    int index;
+};
+
+/// A custom allocator. See SoundIo::device_allocator.
+/// The size of this struct is OK to use.
+struct SoundIoAllocator {
+    /// Returns `size` bytes aligned for any type, or `NULL` when out of
+    /// memory.
+    void *(*alloc)(void *userdata, size_t size);
+    /// Releases memory returned by `alloc`. `size` is the size which was
+    /// passed to `alloc`.
+    void (*free)(void *userdata, void *ptr, size_t size);
+    void *userdata;
+};
+
+#define SOUNDIO_MAX_CPUS 1024
+
+/// How a thread which runs stream callbacks is scheduled. Zero initialized,
+/// it means #SoundIoThreadPolicyDefault on any CPU.
+/// The size of this struct is OK to use.
+struct SoundIoThreadSettings {
+    enum SoundIoThreadPolicy policy;
+    /// For #SoundIoThreadPolicyFifo and #SoundIoThreadPolicyRoundRobin, the
+    /// priority within the policy, clamped to what the OS supports. 0 means
+    /// the maximum. Ignored by the other policies and on Windows.
+    int priority;
+    /// For #SoundIoThreadPolicyDeadline, the CPU time the thread needs and
+    /// the period in which it needs it, in nanoseconds. 0 means half of the
+    /// stream's period and the stream's period.
+    uint64_t deadline_runtime_ns;
+    uint64_t deadline_period_ns;
+    /// The CPUs the thread may run on. CPU `n` is bit `n % 64` of
+    /// `cpu_mask[n / 64]`. All zero means any CPU. Supported on Linux, and
+    /// on Windows for the first 64 CPUs.
+    uint64_t cpu_mask[SOUNDIO_MAX_CPUS / 64];
+};
+
 /// The size of this struct is not part of the API or ABI.
 struct SoundIo {
     /// Optional. Put whatever you want here. Defaults to NULL.
@@ -331,6 +463,15 @@ struct SoundIo {
     /// Optional callback. Called when the list of devices change. Only called
     /// during a call to ::soundio_flush_events or ::soundio_wait_events.
     void (*on_devices_change)(struct SoundIo *);
+    /// Optional callback. Called right before SoundIo::on_devices_change
+    /// with what is different from the previous device list: the removed
+    /// devices first, then the added and updated ones, then the new
+    /// defaults. The first list reports every device as added. Not called
+    /// when nothing is different, nor when there is not enough memory to
+    /// describe the changes; SoundIo::on_devices_change is called either
+    /// way.
+    void (*on_device_changes)(struct SoundIo *,
+            const struct SoundIoDeviceChange *changes, int change_count);
     /// Optional callback. Called when the backend disconnects. For example,
     /// when the JACK server shuts down. When this happens, listing devices
     /// and opening streams will always fail with
@@ -363,6 +504,62 @@ struct SoundIo {
     /// Must not contain a colon (":").
     const char *app_name;
 
+    /// Optional: Path of a file to persist the device list in. `NULL`, the
+    /// default, disables it. When set, backends which support it save the
+    /// devices they found to this file, and on the next ::soundio_connect
+    /// report them right away if the system has not changed, while a fresh
+    /// scan runs in the background. Currently only ALSA supports it.
+    /// Must stay valid while connected.
+    const char *device_cache_path;
+
+    /// Optional: Defer probing device capabilities. By default the backend
+    /// probes every device while enumerating it, which for ALSA means opening
+    /// each PCM. When this is `true`, backends which support it fill in only
+    /// SoundIoDevice::id, SoundIoDevice::name, SoundIoDevice::aim and
+    /// SoundIoDevice::is_raw, and probe a device the first time
+    /// ::soundio_device_probe, one of the `soundio_device_supports_*`
+    /// functions, ::soundio_device_nearest_sample_rate,
+    /// ::soundio_device_sort_channel_layouts, ::soundio_outstream_open or
+    /// ::soundio_instream_open is called on it. Use ::soundio_device_is_probed
+    /// to check before reading the capability fields directly.
+    /// Currently supported by ALSA and the dummy backend.
+    bool lazy_device_probing;
+
+    /// Optional: Where the memory for the device list comes from. Each time
+    /// the backend scans the devices, it takes large blocks from this
+    /// allocator and carves the devices, their names and their capability
+    /// lists out of them. The blocks are released together when the scan has
+    /// been replaced by a newer one and the application has unreferenced
+    /// every device from it. With `alloc` set to `NULL`, the default,
+    /// `malloc` and `free` are used. The callbacks may be called from any
+    /// thread, also at the same time. Must be set before connecting.
+    struct SoundIoAllocator device_allocator;
+
+    /// Optional: The clock the streams of the dummy backend use. Defaults to
+    /// #SoundIoDummyClockRealTime. Must be set before connecting.
+    enum SoundIoDummyClock dummy_clock;
+
+    /// Optional: How the threads which run stream callbacks are scheduled,
+    /// unless the stream sets its own `thread_settings`. Applies to the
+    /// ALSA, WASAPI and dummy backends; the others run callbacks on threads
+    /// owned by the sound server or the OS. If a policy or CPU set cannot be
+    /// applied, the stream still starts with whatever could be applied, and
+    /// ::soundio_outstream_get_thread_settings reports what that was.
+    struct SoundIoThreadSettings thread_settings;
+
+    /// Optional: Lock the memory the stream threads use into RAM, and fault it
+    /// in ahead of time, so that the first callbacks do not take page faults
+    /// and nothing they touch is swapped out. Stream buffers are locked when
+    /// the stream is opened, and the first 128 KiB of the stack of a stream
+    /// thread when it is created. Applies to the threads and buffers
+    /// libsoundio owns: those of the ALSA and dummy backends, and the stream
+    /// thread stacks of WASAPI. Defaults to `false`.
+    ///
+    /// When the memory cannot be locked, opening or starting the stream fails
+    /// with #SoundIoErrorMemoryLock. On Linux, this usually means
+    /// `RLIMIT_MEMLOCK` (`ulimit -l`) is too low.
+    bool lock_memory;
+
     /// Optional: Real time priority warning.
     /// This callback is fired when making thread real-time priority failed. By
     /// default, it will print to stderr only the first time it is called
@@ -493,6 +690,106 @@ struct SoundIoDevice {
     int probe_error;
 };
 
+#define SOUNDIO_STATS_HISTOGRAM_BUCKETS 20
+#define SOUNDIO_STATS_XRUN_HISTORY 8
+
+/// Statistics about the callbacks of a stream, collected from the time it is
+/// opened. See ::soundio_outstream_get_stats and ::soundio_instream_get_stats.
+///
+/// The histograms count durations in power of two buckets of microseconds:
+/// bucket 0 counts durations below 1 microsecond, and bucket `i` counts
+/// durations from `2^(i-1)` up to `2^i` microseconds. The last bucket also
+/// counts everything longer.
+struct SoundIoStreamStats {
+    /// How many times SoundIoOutStream::write_callback or
+    /// SoundIoInStream::read_callback was called.
+    uint64_t callback_count;
+    /// Time spent inside the callback.
+    uint64_t callback_duration_histogram[SOUNDIO_STATS_HISTOGRAM_BUCKETS];
+    /// Longest callback, in seconds.
+    double callback_duration_max;
+    /// Jitter is how much the time between two wakeups of the stream thread
+    /// differs from the time between the two wakeups before them.
+    uint64_t wakeup_jitter_histogram[SOUNDIO_STATS_HISTOGRAM_BUCKETS];
+    /// Largest jitter, in seconds.
+    double wakeup_jitter_max;
+    /// Smallest and largest `frame_count_max` passed to the callback. 0 before
+    /// the first callback.
+    int frame_count_max_min;
+    int frame_count_max_max;
+    /// Total seconds spent inside ::soundio_outstream_begin_write and
+    /// ::soundio_outstream_end_write, or ::soundio_instream_begin_read and
+    /// ::soundio_instream_end_read.
+    double io_time;
+    /// Number of underflows or overflows.
+    uint64_t xrun_count;
+    /// When the most recent xruns happened, in seconds since the stream was
+    /// opened, most recent first. The first
+    /// `min(xrun_count, SOUNDIO_STATS_XRUN_HISTORY)` entries are valid.
+    double xrun_times[SOUNDIO_STATS_XRUN_HISTORY];
+};
+
+/// Where a stream is in its timeline. See ::soundio_outstream_get_position
+/// and ::soundio_instream_get_position.
+struct SoundIoStreamPosition {
+    /// Number of frames the device has played, or captured, since the stream
+    /// started.
+    int64_t frame;
+    /// When the device was at `frame`, in the time of ::soundio_get_time.
+    /// This clock is shared by all streams, so positions of streams on
+    /// different devices can be compared.
+    double time;
+    /// Frames per second of that clock. Where the backend timestamps the
+    /// device this is measured, and differs from the nominal rate by the
+    /// drift between the device's clock and the system's. Elsewhere it is
+    /// the nominal rate.
+    double rate;
+};
+
+/// One file descriptor to wait on for a stream in SoundIoOutStream::poll_mode
+/// or SoundIoInStream::poll_mode. The fields are those of `struct pollfd`.
+/// The size of this struct is OK to use.
+struct SoundIoPollDescriptor {
+    int fd;
+    /// The poll(2) events to wait for.
+    short events;
+    /// What poll(2) returned for `fd`, filled in by the application before
+    /// it calls ::soundio_outstream_process or ::soundio_instream_process.
+    short revents;
+};
+
+/// How an output stream recovers from underflows, in
+/// SoundIoOutStream::xrun_policy. All zero keeps the backend's own recovery.
+/// The size of this struct is not part of the API or ABI.
+struct SoundIoXrunPolicy {
+    /// Seconds of audio to queue before the device restarts after an
+    /// underflow, such as two periods. The stream plays again sooner and at
+    /// a lower latency than after filling its whole buffer, and tops the
+    /// buffer up as it runs. 0 refills the way the stream started.
+    /// ALSA and the dummy backend only.
+    double prefill;
+    /// Seconds by which the latency, the audio which the stream keeps
+    /// queued, grows after SoundIoXrunPolicy::grow_xrun_count underflows
+    /// within SoundIoXrunPolicy::grow_window, and shrinks after
+    /// SoundIoXrunPolicy::shrink_after seconds without one.
+    /// SoundIoOutStream::software_latency is where the latency starts and the
+    /// least it shrinks to. 0 keeps the latency where it is. ALSA with
+    /// SoundIoOutStream::timer_scheduling, and the dummy backend only.
+    double latency_step;
+    /// The most the latency grows to. The stream's buffer is made this large,
+    /// as far as the device allows. 0 is one step above
+    /// SoundIoOutStream::software_latency.
+    double latency_max;
+    /// 0 counts as 1: every underflow grows the latency. At most 16;
+    /// opening the stream fails with #SoundIoErrorInvalid above that.
+    int grow_xrun_count;
+    /// In seconds. Ignored when SoundIoXrunPolicy::grow_xrun_count is at
+    /// most 1.
+    double grow_window;
+    /// In seconds. 0 never shrinks the latency.
+    double shrink_after;
+};
+
 /// The size of this struct is not part of the API or ABI.
 struct SoundIoOutStream {
     /// Populated automatically when you call ::soundio_outstream_create.
@@ -531,11 +828,31 @@ struct SoundIoOutStream {
     /// still set this, but you might not get the value you requested.
     /// For PulseAudio, if you set this value to non-default, it sets
     /// `PA_STREAM_ADJUST_LATENCY` and is the value used for `maxlength` and
-    /// `tlength`.
+    /// `tlength`, with a quarter of it for `minreq`, so that the server asks
+    /// for more in small steps. It is then replaced with the `tlength` the
+    /// server granted.
+    ///
+    /// For WASAPI shared mode, a value below the engine's period,
+    /// SoundIoDevice::software_latency_current, asks Windows 10 and later
+    /// for a smaller one, if the stream's rate is the engine's.
+    ///
+    /// For CoreAudio, this is the size of the device's IO buffer for this
+    /// process, which is one render callback. It is replaced with the size
+    /// the device settled on, which is smaller when another stream of the
+    /// process asked for less. See also SoundIoOutStream::io_cycle_usage.
     ///
     /// For JACK, this value is always equal to
     /// SoundIoDevice::software_latency_current of the device.
     double software_latency;
+
+    /// Optional: How the thread which runs the callbacks is scheduled.
+    /// With #SoundIoThreadPolicyDefault the policy comes from
+    /// SoundIo::thread_settings, and with an empty
+    /// SoundIoThreadSettings::cpu_mask the CPUs do too. See
+    /// ::soundio_outstream_get_thread_settings. CoreAudio calls back on the
+    /// HAL's IO thread, which it schedules itself; on macOS 11 and later
+    /// that thread joins the OS workgroup of the device.
+    struct SoundIoThreadSettings thread_settings;
     /// Core Audio and WASAPI only: current output Audio Unit volume. Float, 0.0-1.0.
     float volume;
     /// Defaults to NULL. Put whatever you want here.
@@ -570,6 +887,14 @@ struct SoundIoOutStream {
     /// a message to stderr and then call `abort`.
     /// This is called from the SoundIoOutStream::write_callback thread context.
     void (*error_callback)(struct SoundIoOutStream *, int err);
+    /// Optional callback. Called with the result of
+    /// ::soundio_outstream_open_async, during a call to
+    /// ::soundio_flush_events or ::soundio_wait_events. `err` is what
+    /// ::soundio_outstream_open would have returned.
+    void (*open_callback)(struct SoundIoOutStream *, int err);
+    /// Optional callback. Like SoundIoOutStream::open_callback, for
+    /// ::soundio_outstream_start_async.
+    void (*start_callback)(struct SoundIoOutStream *, int err);
 
     /// Optional: Name of the stream. Defaults to "SoundIoOutStream"
     /// PulseAudio uses this for the stream name.
@@ -584,6 +909,94 @@ struct SoundIoOutStream {
     /// stream. Defaults to `false`.
     bool non_terminal_hint;
 
+    /// Optional callback. JACK and CoreAudio only. Called instead of
+    /// SoundIoOutStream::write_callback with the port buffers themselves:
+    /// one planar #SoundIoFormatFloat32NE buffer per channel, of which all
+    /// `frame_count` samples must be written. Nothing is converted or copied,
+    /// and ::soundio_outstream_begin_write and ::soundio_outstream_end_write
+    /// are not used. CoreAudio renders from the buffers of the audio unit,
+    /// and only when SoundIoOutStream::format is #SoundIoFormatFloat32NE.
+    /// Other backends, and streams which resample or remix for a
+    /// SoundIoOutStream::write_sample_rate or SoundIoOutStream::write_layout
+    /// of their own, call write_callback.
+    /// The same real-time rules apply.
+    void (*write_planar_callback)(struct SoundIoOutStream *, float *const *buffers, int frame_count);
+    /// Optional callback. JACK only. The server's buffer size changed to
+    /// `frame_count`, which later callbacks get. The stream carries on
+    /// either way; this is for buffers of the application's own sized by it.
+    /// SoundIoOutStream::software_latency is already updated to match.
+    /// Called from a thread of JACK's.
+    void (*buffer_size_callback)(struct SoundIoOutStream *, int frame_count);
+    /// Optional callback. JACK only. The server's sample rate changed to
+    /// `sample_rate`. With this callback the stream carries on at the new
+    /// rate, though SoundIoOutStream::sample_rate keeps its value; without
+    /// it the change is an error. Called from a thread of JACK's.
+    void (*sample_rate_callback)(struct SoundIoOutStream *, int sample_rate);
+
+    /// Optional: ALSA only. Request timer-based scheduling. Instead of waking
+    /// up for every period interrupt, a large hardware buffer with few
+    /// interrupts is configured and the stream thread sleeps on a timer,
+    /// refilling just ahead of the hardware pointer. SoundIoOutStream::software_latency
+    /// is then the amount of audio kept queued, not the buffer size, and it
+    /// grows after each underflow, or as SoundIoOutStream::xrun_policy says
+    /// when it has a SoundIoXrunPolicy::latency_step. Other backends ignore
+    /// it. Defaults to `false`.
+    bool timer_scheduling;
+
+    /// Optional: How the stream recovers from underflows. See
+    /// SoundIoXrunPolicy. Defaults to all zero.
+    struct SoundIoXrunPolicy xrun_policy;
+    /// Optional callback. SoundIoOutStream::xrun_policy changed the latency
+    /// which the stream keeps queued to `latency` seconds. Called from the
+    /// thread which calls SoundIoOutStream::write_callback.
+    void (*latency_callback)(struct SoundIoOutStream *, double latency);
+
+    /// Optional: CoreAudio only. The fraction of each IO cycle, above 0 and
+    /// at most 1, which the HAL leaves for the callback, through
+    /// `kAudioDevicePropertyIOCycleUsage`. Below 1 the HAL calls back later in
+    /// the cycle, closer to when the frames are due, which cuts the latency
+    /// but leaves less time to render them. 0 leaves the device's setting.
+    /// Defaults to 0.
+    float io_cycle_usage;
+
+    /// Optional: ALSA and the dummy backend only. Create no thread for the
+    /// stream; the application runs it from an event loop of its own, which
+    /// may serve many streams with one thread. The loop waits on the
+    /// descriptors of ::soundio_outstream_get_poll_descriptors and calls
+    /// ::soundio_outstream_process when one of them is ready, and once right
+    /// after ::soundio_outstream_start. The callbacks are called from
+    /// ::soundio_outstream_process, so the real-time rules apply to that
+    /// thread. SoundIoOutStream::thread_settings and
+    /// SoundIoOutStream::timer_scheduling are ignored. The dummy backend has
+    /// no descriptors; process it at least once a period. Other backends
+    /// call back on threads of their own, and opening fails with
+    /// #SoundIoErrorIncompatibleBackend. Defaults to `false`.
+    bool poll_mode;
+
+    /// Optional: The rate at which SoundIoOutStream::write_callback supplies
+    /// frames, when the device should run at a different
+    /// SoundIoOutStream::sample_rate. libsoundio then resamples the frames
+    /// before they reach the device, which lets raw devices run at their
+    /// native rate without a sound server's resampler. `frame_count_min`,
+    /// `frame_count_max` and the frame counts of ::soundio_outstream_begin_write
+    /// are at this rate, and the latency includes the delay of the filter.
+    /// Defaults to 0, which ::soundio_outstream_open replaces with
+    /// SoundIoOutStream::sample_rate.
+    int write_sample_rate;
+    /// Optional: The filter used when resampling. Defaults to
+    /// #SoundIoResampleQualityMedium.
+    enum SoundIoResampleQuality resample_quality;
+    /// Optional: The channel layout in which SoundIoOutStream::write_callback
+    /// supplies frames, when the device should be opened with a different
+    /// SoundIoOutStream::layout, such as its native one. libsoundio then
+    /// remixes the frames before they reach the device, the way
+    /// ::soundio_remixer_create describes, which spares a sound server's
+    /// remixing and its latency. The areas of ::soundio_outstream_begin_write
+    /// have a channel for each channel of this layout. Can be combined with
+    /// SoundIoOutStream::write_sample_rate. Defaults to no channels, which
+    /// ::soundio_outstream_open replaces with SoundIoOutStream::layout.
+    struct SoundIoChannelLayout write_layout;
+
 
     /// computed automatically when you call ::soundio_outstream_open
     int bytes_per_frame;
@@ -594,6 +1007,10 @@ struct SoundIoOutStream {
     /// to an error code. Possible error codes are:
     /// * #SoundIoErrorIncompatibleDevice
     int layout_error;
+
+    /// Set by ::soundio_outstream_open to tell whether writing to the
+    /// stream goes directly into the device buffer. Informational only.
+    enum SoundIoBufferAccess buffer_access;
 };
 
 /// The size of this struct is not part of the API or ABI.
@@ -623,10 +1040,22 @@ struct SoundIoInStream {
     /// still set this, but you might not get the value you requested.
     /// For PulseAudio, if you set this value to non-default, it sets
     /// `PA_STREAM_ADJUST_LATENCY` and is the value used for `fragsize`.
+    /// Fragments the server delivers in smaller pieces are then joined, so
+    /// that ::soundio_instream_begin_read returns up to `fragsize` at once.
+    /// The stream is only connected when it starts, so PulseAudio replaces
+    /// this value with the `fragsize` the server granted in
+    /// ::soundio_instream_start rather than in ::soundio_instream_open.
     /// For JACK, this value is always equal to
     /// SoundIoDevice::software_latency_current
     double software_latency;
 
+    /// Optional: How the thread which runs the callbacks is scheduled.
+    /// With #SoundIoThreadPolicyDefault the policy comes from
+    /// SoundIo::thread_settings, and with an empty
+    /// SoundIoThreadSettings::cpu_mask the CPUs do too. See
+    /// ::soundio_instream_get_thread_settings.
+    struct SoundIoThreadSettings thread_settings;
+
     /// Defaults to NULL. Put whatever you want here.
     void *userdata;
     /// In this function call ::soundio_instream_begin_read and
@@ -654,6 +1083,14 @@ struct SoundIoInStream {
     /// a message to stderr and then abort().
     /// This is called from the SoundIoInStream::read_callback thread context.
     void (*error_callback)(struct SoundIoInStream *, int err);
+    /// Optional callback. Called with the result of
+    /// ::soundio_instream_open_async, during a call to
+    /// ::soundio_flush_events or ::soundio_wait_events. `err` is what
+    /// ::soundio_instream_open would have returned.
+    void (*open_callback)(struct SoundIoInStream *, int err);
+    /// Optional callback. Like SoundIoInStream::open_callback, for
+    /// ::soundio_instream_start_async.
+    void (*start_callback)(struct SoundIoInStream *, int err);
 
     /// Optional: Name of the stream. Defaults to "SoundIoInStream";
     /// PulseAudio uses this for the stream name.
@@ -668,6 +1105,25 @@ struct SoundIoInStream {
     /// passed on or made available to another stream. Defaults to `false`.
     bool non_terminal_hint;
 
+    /// Optional callback. JACK and CoreAudio only. Called instead of
+    /// SoundIoInStream::read_callback with the port buffers themselves: one
+    /// planar #SoundIoFormatFloat32NE buffer of `frame_count` samples per
+    /// channel. ::soundio_instream_begin_read and ::soundio_instream_end_read
+    /// are not used. CoreAudio does this only when SoundIoInStream::format is
+    /// #SoundIoFormatFloat32NE. Other backends call read_callback.
+    void (*read_planar_callback)(struct SoundIoInStream *, const float *const *buffers, int frame_count);
+    /// Optional callback. JACK only. See SoundIoOutStream::buffer_size_callback.
+    void (*buffer_size_callback)(struct SoundIoInStream *, int frame_count);
+    /// Optional callback. JACK only. See SoundIoOutStream::sample_rate_callback.
+    void (*sample_rate_callback)(struct SoundIoInStream *, int sample_rate);
+
+    /// Optional: CoreAudio only. See SoundIoOutStream::io_cycle_usage.
+    float io_cycle_usage;
+    /// Optional: ALSA and the dummy backend only. See
+    /// SoundIoOutStream::poll_mode, ::soundio_instream_get_poll_descriptors
+    /// and ::soundio_instream_process.
+    bool poll_mode;
+
     /// computed automatically when you call ::soundio_instream_open
     int bytes_per_frame;
     /// computed automatically when you call ::soundio_instream_open
@@ -676,6 +1132,10 @@ struct SoundIoInStream {
     /// If setting the channel layout fails for some reason, this field is set
     /// to an error code. Possible error codes are: #SoundIoErrorIncompatibleDevice
     int layout_error;
+
+    /// Set by ::soundio_instream_open to tell whether reading from the
+    /// stream comes directly from the device buffer. Informational only.
+    enum SoundIoBufferAccess buffer_access;
 };
 
 /// See also ::soundio_version_major, ::soundio_version_minor, ::soundio_version_patch
@@ -738,7 +1198,10 @@ SOUNDIO_EXPORT bool soundio_have_backend(enum SoundIoBackend backend);
 ///
 /// When you call this, the following callbacks might be called:
 /// * SoundIo::on_devices_change
+/// * SoundIo::on_device_changes
 /// * SoundIo::on_backend_disconnect
+/// * SoundIoOutStream::open_callback and SoundIoOutStream::start_callback
+/// * SoundIoInStream::open_callback and SoundIoInStream::start_callback
 /// This is the only time those callbacks can be called.
 ///
 /// This must be called from the same thread as the thread in which you call
@@ -779,6 +1242,16 @@ SOUNDIO_EXPORT void soundio_wakeup(struct SoundIo *soundio);
 /// SoundIoOutStream::write_callback and SoundIoInStream::read_callback
 SOUNDIO_EXPORT void soundio_force_device_scan(struct SoundIo *soundio);
 
+/// Moves the clock of the dummy backend ahead by `seconds` and returns once
+/// every started dummy stream has processed that time, calling its callbacks
+/// as needed. Only for #SoundIoDummyClockManual. Call it from one thread at a
+/// time, and not from a stream callback.
+///
+/// Possible errors:
+/// * #SoundIoErrorInvalid - not connected to the dummy backend, the clock is
+///   not #SoundIoDummyClockManual, or `seconds` is negative
+SOUNDIO_EXPORT int soundio_dummy_advance(struct SoundIo *soundio, double seconds);
+
 
 // Channel Layouts
 
@@ -844,6 +1317,148 @@ static inline int soundio_get_bytes_per_second(enum SoundIoFormat format,
 /// Returns string representation of `format`.
 SOUNDIO_EXPORT const char * soundio_format_string(enum SoundIoFormat format);
 
+struct SoundIoConverter;
+
+enum SoundIoConvertFlag {
+    SoundIoConvertFlagNone = 0,
+    /// Add triangular dither of one least significant bit when converting
+    /// float to integer formats, or integer formats to fewer bits.
+    SoundIoConvertFlagDither = 1,
+};
+
+/// Creates a sample format converter from `src_format` to `dest_format`.
+/// `flags` is a bitmask of ::SoundIoConvertFlag.
+/// The fastest conversion kernels supported by the CPU are selected here,
+/// at runtime.
+/// Returns `NULL` if either format is invalid or memory could not be
+/// allocated.
+/// See also ::soundio_converter_destroy
+SOUNDIO_EXPORT struct SoundIoConverter *soundio_converter_create(enum SoundIoFormat src_format,
+        enum SoundIoFormat dest_format, int flags);
+SOUNDIO_EXPORT void soundio_converter_destroy(struct SoundIoConverter *converter);
+
+/// Converts `frame_count` frames of `channel_count` channels from
+/// `src_areas` to `dest_areas`. The areas may be interleaved or not; each
+/// channel's `step` is honored. Float values outside [-1.0, 1.0] are clamped
+/// when converting to integer formats.
+/// Copying between planar areas (`step` is the sample size, as JACK provides)
+/// and interleaved areas (`step` is the frame size, as ALSA and WASAPI
+/// provide) of up to 8 channels uses transposing kernels which are fused
+/// with the format conversion. The interleaved side may have more channels
+/// than `channel_count`: areas for consecutive channels of wider frames
+/// fill or extract just those channels and leave the rest alone. To only
+/// interleave or deinterleave, create a converter with the same source and
+/// destination format.
+/// Does not allocate memory or take locks, so it is safe to call from
+/// SoundIoOutStream::write_callback and SoundIoInStream::read_callback.
+/// A converter must not be used from more than one thread at a time.
+SOUNDIO_EXPORT void soundio_converter_convert(struct SoundIoConverter *converter,
+        const struct SoundIoChannelArea *src_areas, const struct SoundIoChannelArea *dest_areas,
+        int channel_count, int frame_count);
+
+/// Returns the name of the kernels the converter uses, for example "avx2",
+/// "sse2", "neon" or "scalar".
+SOUNDIO_EXPORT const char *soundio_converter_kernel_name(struct SoundIoConverter *converter);
+
+struct SoundIoResampler;
+
+/// Creates a sample rate converter from `src_rate` to `dest_rate` for
+/// `channel_count` channels of #SoundIoFormatFloat32NE samples. It is a
+/// polyphase windowed sinc filter. The filter of every phase is computed
+/// here, exactly for ratios which reduce to at most 1024 output frames per
+/// cycle, such as 44100 to 48000, and interpolated for others. The fastest
+/// kernels supported by the CPU are selected at runtime.
+/// Returns `NULL` if a parameter is invalid or memory could not be
+/// allocated.
+/// See also ::soundio_resampler_destroy
+SOUNDIO_EXPORT struct SoundIoResampler *soundio_resampler_create(int channel_count,
+        int src_rate, int dest_rate, enum SoundIoResampleQuality quality);
+SOUNDIO_EXPORT void soundio_resampler_destroy(struct SoundIoResampler *resampler);
+
+/// Takes up to `*src_frame_count` frames from `src_areas` and writes up to
+/// `*dest_frame_count` frames to `dest_areas`, then sets both to how many
+/// frames it took and wrote. Frames are only taken as far as they fit
+/// into the filter history, so pass what was not taken again next time.
+/// Each channel's `step` is honored. Does not allocate memory or take locks.
+SOUNDIO_EXPORT void soundio_resampler_process(struct SoundIoResampler *resampler,
+        const struct SoundIoChannelArea *src_areas, int *src_frame_count,
+        const struct SoundIoChannelArea *dest_areas, int *dest_frame_count);
+
+/// Returns how many frames ::soundio_resampler_process would write if it
+/// were given `src_frame_count` more frames and enough room.
+SOUNDIO_EXPORT int soundio_resampler_dest_frame_count(struct SoundIoResampler *resampler,
+        int src_frame_count);
+/// Returns the fewest frames which ::soundio_resampler_process needs to be
+/// given to write `dest_frame_count` frames. Together with
+/// ::soundio_resampler_dest_frame_count this turns the `frame_count_min`
+/// and `frame_count_max` of a callback at one rate into a range at the other.
+SOUNDIO_EXPORT int soundio_resampler_src_frame_count(struct SoundIoResampler *resampler,
+        int dest_frame_count);
+
+/// Returns the seconds of input which have been taken but have not come out
+/// yet.
+SOUNDIO_EXPORT double soundio_resampler_get_delay(struct SoundIoResampler *resampler);
+/// Forgets the history, as if the resampler had just been created.
+SOUNDIO_EXPORT void soundio_resampler_reset(struct SoundIoResampler *resampler);
+/// Returns the name of the kernels in use, such as "sse2" or "avx2".
+SOUNDIO_EXPORT const char *soundio_resampler_kernel_name(struct SoundIoResampler *resampler);
+
+struct SoundIoRemixer;
+
+enum SoundIoRemixFlag {
+    SoundIoRemixFlagNone = 0,
+    /// Keep the standard gains even where they add up to more than 1.0 in
+    /// one output channel, which can clip. Otherwise all gains are scaled
+    /// down until no output channel can be louder than the loudest input.
+    SoundIoRemixFlagNoNormalize = 1,
+};
+
+/// Creates a channel remixer from `src_layout` to `dest_layout` for
+/// #SoundIoFormatFloat32NE samples. The mixing matrix is computed here from
+/// the SoundIoChannelId of each channel. A channel which both layouts have
+/// is copied. One which the destination lacks is folded into its nearest
+/// neighbours with the usual downmix gains: the center goes to front left
+/// and right at -3 dB, back channels go to the side channels or to the
+/// fronts at -3 dB, height channels go to the channel underneath, and
+/// a single channel goes to both sides of a stereo pair at -3 dB. Channels
+/// with nowhere to go, such as the LFE when the destination has none and the
+/// auxiliary channels, are dropped, and destination channels which nothing
+/// maps to are silent; upmixing does not invent surround content.
+/// `flags` is a bitmask of ::SoundIoRemixFlag.
+/// Returns `NULL` if either layout has no channels or more than
+/// #SOUNDIO_MAX_CHANNELS, or memory could not be allocated.
+/// See also ::soundio_remixer_destroy
+SOUNDIO_EXPORT struct SoundIoRemixer *soundio_remixer_create(const struct SoundIoChannelLayout *src_layout,
+        const struct SoundIoChannelLayout *dest_layout, int flags);
+SOUNDIO_EXPORT void soundio_remixer_destroy(struct SoundIoRemixer *remixer);
+
+/// Remixes `frame_count` frames from `src_areas`, one per channel of the
+/// source layout, into `dest_areas`, one per channel of the destination
+/// layout. Each channel's `step` is honored; the areas must not overlap.
+/// Channels which are copies of one source channel, or silent, are copied
+/// or cleared directly, and only the others are mixed, skipping the zeros
+/// of the matrix. Does not allocate memory or take locks, so it is safe to
+/// call from SoundIoOutStream::write_callback and SoundIoInStream::read_callback.
+SOUNDIO_EXPORT void soundio_remixer_process(struct SoundIoRemixer *remixer,
+        const struct SoundIoChannelArea *src_areas, const struct SoundIoChannelArea *dest_areas,
+        int frame_count);
+
+/// Returns the gain of source channel `src_channel` in destination channel
+/// `dest_channel`, 0.0 for indexes out of range.
+SOUNDIO_EXPORT float soundio_remixer_get_gain(struct SoundIoRemixer *remixer,
+        int dest_channel, int src_channel);
+/// Replaces one gain of the matrix. Must not be called while
+/// ::soundio_remixer_process runs.
+/// Possible errors:
+/// * #SoundIoErrorInvalid - an index is out of range or `gain` is not finite
+SOUNDIO_EXPORT int soundio_remixer_set_gain(struct SoundIoRemixer *remixer,
+        int dest_channel, int src_channel, float gain);
+/// Returns whether the remixer copies every channel to the same index, as it
+/// does between equal layouts.
+SOUNDIO_EXPORT bool soundio_remixer_is_identity(struct SoundIoRemixer *remixer);
+/// Returns the name of the kernels in use, such as "sse2" or "avx2".
+SOUNDIO_EXPORT const char *soundio_remixer_kernel_name(struct SoundIoRemixer *remixer);
+
 
 
 
@@ -896,6 +1511,21 @@ SOUNDIO_EXPORT bool soundio_device_equal(
         const struct SoundIoDevice *a,
         const struct SoundIoDevice *b);
 
+/// Returns whether the capability fields of the device, such as
+/// SoundIoDevice::formats and SoundIoDevice::sample_rates, have been filled
+/// in. Always `true` unless SoundIo::lazy_device_probing is set.
+SOUNDIO_EXPORT bool soundio_device_is_probed(const struct SoundIoDevice *device);
+
+/// Probes the capabilities of a device enumerated with
+/// SoundIo::lazy_device_probing. Does nothing if the device has already been
+/// probed. Returns SoundIoDevice::probe_error.
+/// Possible errors:
+/// * #SoundIoErrorOpeningDevice
+/// * #SoundIoErrorNoMem
+/// * #SoundIoErrorBackendDisconnected - the device was probed after
+///   ::soundio_disconnect
+SOUNDIO_EXPORT int soundio_device_probe(struct SoundIoDevice *device);
+
 /// Sorts channel layouts by channel count, descending.
 SOUNDIO_EXPORT void soundio_device_sort_channel_layouts(struct SoundIoDevice *device);
 
@@ -964,6 +1594,33 @@ SOUNDIO_EXPORT int soundio_outstream_open(struct SoundIoOutStream *outstream);
 /// * #SoundIoErrorBackendDisconnected
 SOUNDIO_EXPORT int soundio_outstream_start(struct SoundIoOutStream *outstream);
 
+/// Like ::soundio_outstream_open, but returns once the stream parameters are
+/// checked, and opens the device on a separate thread. Opening several
+/// streams this way overlaps the time each backend takes to open a device.
+/// When the device is open, SoundIoOutStream::open_callback is called with
+/// the result during a call to ::soundio_flush_events or
+/// ::soundio_wait_events. Until then you may only destroy the stream, which
+/// waits for the open to finish. If SoundIo::lazy_device_probing is on and
+/// the device is not probed yet, the probe happens in this call.
+///
+/// Possible errors, besides those reported to SoundIoOutStream::open_callback:
+/// * #SoundIoErrorInvalid - the same as for ::soundio_outstream_open, or
+///   an asynchronous call on this stream is still in progress
+/// * #SoundIoErrorNoMem
+/// * #SoundIoErrorSystemResources
+SOUNDIO_EXPORT int soundio_outstream_open_async(struct SoundIoOutStream *outstream);
+
+/// Like ::soundio_outstream_start, but starts the stream on a separate
+/// thread and reports the result to SoundIoOutStream::start_callback in the
+/// same way as ::soundio_outstream_open_async.
+///
+/// Possible errors, besides those reported to SoundIoOutStream::start_callback:
+/// * #SoundIoErrorInvalid - an asynchronous call on this stream is still in
+///   progress
+/// * #SoundIoErrorNoMem
+/// * #SoundIoErrorSystemResources
+SOUNDIO_EXPORT int soundio_outstream_start_async(struct SoundIoOutStream *outstream);
+
 /// Call this function when you are ready to begin writing to the device buffer.
 ///  * `outstream` - (in) The output stream you want to write to.
 ///  * `areas` - (out) The memory addresses you can write data to, one per
@@ -1058,9 +1715,78 @@ SOUNDIO_EXPORT int soundio_outstream_pause(struct SoundIoOutStream *outstream, b
 SOUNDIO_EXPORT int soundio_outstream_get_latency(struct SoundIoOutStream *outstream,
         double *out_latency);
 
+/// Obtain which frame the device is playing right now. This is the number of
+/// frames written with ::soundio_outstream_end_write minus the frames which
+/// ::soundio_outstream_get_latency says are yet to become audible, counted at
+/// SoundIoOutStream::write_sample_rate.
+///
+/// ALSA, JACK, CoreAudio, WASAPI and the dummy backend with
+/// #SoundIoDummyClockRealTime timestamp the device at the start of each
+/// callback, from `snd_pcm_htimestamp`, `jack_get_cycle_times`, the
+/// `AudioTimeStamp` of the render callback and `IAudioClock::GetPosition`.
+/// The timestamps are smoothed with a delay-locked loop, and the position is
+/// the smoothed frame and time of the latest one, which costs no call into
+/// the backend. SoundIoStreamPosition::time is then slightly in the past, or
+/// for output in the future, and `frame + (t - time) * rate` is the frame at
+/// time `t`. Elsewhere the position is worked out from the latency and
+/// ::soundio_get_time.
+///
+/// This function must be called only from within SoundIoOutStream::write_callback.
+///
+/// Possible errors:
+/// * #SoundIoErrorStreaming
+SOUNDIO_EXPORT int soundio_outstream_get_position(struct SoundIoOutStream *outstream,
+        struct SoundIoStreamPosition *position);
+
+/// Copies the statistics of the stream to `stats`. May be called from any
+/// thread while the stream exists. It never blocks the thread which runs
+/// the callbacks; the statistics are a consistent snapshot except that the
+/// xrun fields may be a few events ahead of or behind the others.
+SOUNDIO_EXPORT void soundio_outstream_get_stats(struct SoundIoOutStream *outstream,
+        struct SoundIoStreamStats *stats);
+
+/// Copies how the thread which runs the callbacks is actually scheduled to
+/// `settings`, after SoundIoOutStream::thread_settings was applied as far as
+/// the OS allowed. SoundIoThreadSettings::cpu_mask lists the CPUs the thread
+/// may run on, even when it was not pinned.
+///
+/// Possible errors:
+/// * #SoundIoErrorInvalid - the stream has no thread yet. ALSA and dummy
+///   streams create it in ::soundio_outstream_start, WASAPI streams in
+///   ::soundio_outstream_open.
+/// * #SoundIoErrorIncompatibleBackend - the backend runs the callbacks on a
+///   thread it owns
+SOUNDIO_EXPORT int soundio_outstream_get_thread_settings(struct SoundIoOutStream *outstream,
+        struct SoundIoThreadSettings *settings);
+
 SOUNDIO_EXPORT int soundio_outstream_set_volume(struct SoundIoOutStream *outstream,
         double volume);
 
+/// Copies up to `*count` descriptors of a stream in
+/// SoundIoOutStream::poll_mode to `descriptors`, then sets `*count` to how
+/// many the stream has. They stay the same from ::soundio_outstream_open
+/// until the stream is destroyed, so an event loop needs to fetch them once.
+///
+/// Possible errors:
+/// * #SoundIoErrorInvalid - the stream is not open in poll mode
+SOUNDIO_EXPORT int soundio_outstream_get_poll_descriptors(struct SoundIoOutStream *outstream,
+        struct SoundIoPollDescriptor *descriptors, int *count);
+
+/// Runs a started stream in SoundIoOutStream::poll_mode for as long as it
+/// can without waiting, calling SoundIoOutStream::write_callback and the
+/// other callbacks as the stream thread would. `descriptors` are those of
+/// ::soundio_outstream_get_poll_descriptors with `revents` filled in; pass
+/// `NULL` and 0 for the dummy backend. Never blocks on the device, though it
+/// waits out the start deadline of a stream group.
+///
+/// Possible errors:
+/// * #SoundIoErrorInvalid - the stream is not started in poll mode, or
+///   `count` is not the number of descriptors
+/// * #SoundIoErrorStreaming - the stream failed, and
+///   SoundIoOutStream::error_callback has been called
+SOUNDIO_EXPORT int soundio_outstream_process(struct SoundIoOutStream *outstream,
+        const struct SoundIoPollDescriptor *descriptors, int count);
+
 
 
 // Input Streams
@@ -1101,6 +1827,16 @@ SOUNDIO_EXPORT int soundio_instream_open(struct SoundIoInStream *instream);
 /// * #SoundIoErrorSystemResources
 SOUNDIO_EXPORT int soundio_instream_start(struct SoundIoInStream *instream);
 
+/// Like ::soundio_instream_open, but opens the device on a separate thread
+/// and reports the result to SoundIoInStream::open_callback. See
+/// ::soundio_outstream_open_async.
+SOUNDIO_EXPORT int soundio_instream_open_async(struct SoundIoInStream *instream);
+
+/// Like ::soundio_instream_start, but starts the stream on a separate thread
+/// and reports the result to SoundIoInStream::start_callback. See
+/// ::soundio_outstream_open_async.
+SOUNDIO_EXPORT int soundio_instream_start_async(struct SoundIoInStream *instream);
+
 /// Call this function when you are ready to begin reading from the device
 /// buffer.
 /// * `instream` - (in) The input stream you want to read from.
@@ -1166,6 +1902,495 @@ SOUNDIO_EXPORT int soundio_instream_pause(struct SoundIoInStream *instream, bool
 SOUNDIO_EXPORT int soundio_instream_get_latency(struct SoundIoInStream *instream,
         double *out_latency);
 
+/// Obtain which frame the device is capturing right now. This is the number
+/// of frames read with ::soundio_instream_end_read plus the frames which
+/// ::soundio_instream_get_latency says are on their way.
+///
+/// Backends which timestamp the device do it here as well; see
+/// ::soundio_outstream_get_position.
+///
+/// This function must be called only from within SoundIoInStream::read_callback.
+///
+/// Possible errors:
+/// * #SoundIoErrorStreaming
+SOUNDIO_EXPORT int soundio_instream_get_position(struct SoundIoInStream *instream,
+        struct SoundIoStreamPosition *position);
+
+/// See ::soundio_outstream_get_stats.
+SOUNDIO_EXPORT void soundio_instream_get_stats(struct SoundIoInStream *instream,
+        struct SoundIoStreamStats *stats);
+
+/// See ::soundio_outstream_get_thread_settings.
+SOUNDIO_EXPORT int soundio_instream_get_thread_settings(struct SoundIoInStream *instream,
+        struct SoundIoThreadSettings *settings);
+
+/// See ::soundio_outstream_get_poll_descriptors.
+SOUNDIO_EXPORT int soundio_instream_get_poll_descriptors(struct SoundIoInStream *instream,
+        struct SoundIoPollDescriptor *descriptors, int *count);
+/// See ::soundio_outstream_process. Calls SoundIoInStream::read_callback.
+SOUNDIO_EXPORT int soundio_instream_process(struct SoundIoInStream *instream,
+        const struct SoundIoPollDescriptor *descriptors, int count);
+
+// Stream Groups
+
+/// Returns the current time in seconds of the monotonic clock which stream
+/// groups and SoundIoStreamPosition use. Its origin is arbitrary. Valid once
+/// a SoundIo has been created.
+SOUNDIO_EXPORT double soundio_get_time(void);
+
+struct SoundIoStreamGroup;
+
+/// A stream group starts several streams at the same moment, so that they
+/// play and record in step without padding one of them to line them up. The
+/// streams may belong to different SoundIo contexts, for example one
+/// connected to ALSA and one to JACK.
+/// Returns `NULL` if and only if memory could not be allocated.
+/// See also ::soundio_stream_group_destroy
+SOUNDIO_EXPORT struct SoundIoStreamGroup *soundio_stream_group_create(void);
+/// The member streams are left as they are.
+SOUNDIO_EXPORT void soundio_stream_group_destroy(struct SoundIoStreamGroup *group);
+
+/// Adds a stream which has been opened but not started. A stream can be in
+/// one group at a time. Destroying the stream removes it from the group.
+///
+/// Possible errors:
+/// * #SoundIoErrorInvalid - the stream is already in a group, or the group
+///   has been started
+/// * #SoundIoErrorNoMem
+SOUNDIO_EXPORT int soundio_stream_group_add_outstream(struct SoundIoStreamGroup *group,
+        struct SoundIoOutStream *outstream);
+/// See ::soundio_stream_group_add_outstream.
+SOUNDIO_EXPORT int soundio_stream_group_add_instream(struct SoundIoStreamGroup *group,
+        struct SoundIoInStream *instream);
+
+/// Starts every member so that the devices start `delay` seconds from now.
+/// `delay` has to cover the time the members need to get going, which is
+/// usually a few milliseconds; members which take longer start late.
+///
+/// ALSA, WASAPI, JACK and dummy streams are started right away and hold
+/// back the device until the deadline, after their buffers were filled.
+/// JACK streams on the same server begin in the same process cycle. Streams
+/// of the other backends are started one after the other when the deadline
+/// arrives, so this function returns only after `delay`.
+///
+/// A group can be started once. If a member fails to start, the error is
+/// returned and the members started before it keep running.
+///
+/// Possible errors:
+/// * #SoundIoErrorInvalid - the group has been started already, or `delay`
+///   is negative
+/// * any error ::soundio_outstream_start or ::soundio_instream_start return
+SOUNDIO_EXPORT int soundio_stream_group_start(struct SoundIoStreamGroup *group, double delay);
+
+/// Returns the time of ::soundio_get_time at which the members started, or 0
+/// if the group has not been started. The SoundIoStreamPosition::frame of
+/// every member counts from here.
+SOUNDIO_EXPORT double soundio_stream_group_get_start_time(struct SoundIoStreamGroup *group);
+
+/// A duplex stream records and plays in one callback, for processing input
+/// into output with as little latency as the devices allow.
+struct SoundIoDuplexStream {
+    /// Created along with the duplex stream. Configure them like any other
+    /// stream before ::soundio_duplex_stream_open, except for
+    /// SoundIoInStream::read_callback and SoundIoOutStream::write_callback,
+    /// which belong to the duplex stream. Their other callbacks are called
+    /// as usual. Do not open, start or destroy them yourself.
+    /// If SoundIoInStream::sample_rate is 0 it follows the output stream's
+    /// SoundIoOutStream::write_sample_rate, which it has to equal.
+    struct SoundIoInStream *instream;
+    struct SoundIoOutStream *outstream;
+
+    /// Defaults to NULL. Put whatever you want here.
+    void *userdata;
+
+    /// Called from the output stream's thread with `frame_count` frames of
+    /// input in `in_areas` and room for as many frames of output in
+    /// `out_areas`, each in its own stream's format and layout. The output
+    /// stream decides how many frames are written and when, as
+    /// SoundIoOutStream::write_callback does, and the input continues where
+    /// the previous callback left off. Input that is missing, because the
+    /// input has not started yet or fell behind, is silence. The callback may be
+    /// called several times in a row for one write.
+    void (*duplex_callback)(struct SoundIoDuplexStream *duplex,
+            const struct SoundIoChannelArea *in_areas, struct SoundIoChannelArea *out_areas,
+            int frame_count);
+
+    /// Set by ::soundio_duplex_stream_open. When true, the input is read on
+    /// the output's thread right before each callback, so the callback gets
+    /// the period which was just recorded. That is the case for ALSA, JACK
+    /// and dummy devices of the same context; on JACK both streams are ports
+    /// of one client and run in the same process cycle. Otherwise the input
+    /// runs on its own thread and is buffered until the output asks for it,
+    /// which adds up to a period of latency.
+    bool synchronous;
+};
+
+/// Creates a duplex stream recording from `in_device` and playing to
+/// `out_device`. The devices may belong to different SoundIo contexts, in
+/// which case the duplex stream is never SoundIoDuplexStream::synchronous.
+/// Returns `NULL` if and only if memory could not be allocated.
+/// See also ::soundio_duplex_stream_destroy
+SOUNDIO_EXPORT struct SoundIoDuplexStream *soundio_duplex_stream_create(struct SoundIoDevice *in_device,
+        struct SoundIoDevice *out_device);
+/// Also destroys SoundIoDuplexStream::instream and
+/// SoundIoDuplexStream::outstream.
+SOUNDIO_EXPORT void soundio_duplex_stream_destroy(struct SoundIoDuplexStream *duplex);
+
+/// Opens both streams, the output stream first.
+///
+/// Possible errors:
+/// * #SoundIoErrorInvalid - SoundIoDuplexStream::duplex_callback is not set
+/// * #SoundIoErrorIncompatibleDevice - the input stream did not open at the
+///   output stream's SoundIoOutStream::write_sample_rate
+/// * #SoundIoErrorNoMem
+/// * any error ::soundio_outstream_open or ::soundio_instream_open return
+SOUNDIO_EXPORT int soundio_duplex_stream_open(struct SoundIoDuplexStream *duplex);
+
+/// Starts both streams, the input stream first.
+/// Returns any error ::soundio_instream_start or ::soundio_outstream_start
+/// return.
+SOUNDIO_EXPORT int soundio_duplex_stream_start(struct SoundIoDuplexStream *duplex);
+
+/// Pauses or unpauses both streams.
+/// Returns any error ::soundio_instream_pause or ::soundio_outstream_pause
+/// return.
+SOUNDIO_EXPORT int soundio_duplex_stream_pause(struct SoundIoDuplexStream *duplex, bool pause);
+
+struct SoundIoDuplexBridge;
+
+/// A duplex bridge carries what an input stream records to an output stream,
+/// usually on another device. The two device clocks always drift apart a
+/// little, so the bridge resamples what it plays by a ratio which it keeps
+/// adjusting, within half a percent, so that `target_latency` seconds stay
+/// buffered between the streams. Without that the buffer would have to hold
+/// enough to survive hours of drift.
+///
+/// Both streams must be open, and the output stream's
+/// SoundIoOutStream::write_layout must have as many channels as the input.
+/// Their sample rates and formats may differ. The output stream's
+/// SoundIoOutStream::resample_quality picks the filter. Create the bridge
+/// before starting the streams, and call ::soundio_duplex_bridge_capture
+/// from SoundIoInStream::read_callback and ::soundio_duplex_bridge_play
+/// from SoundIoOutStream::write_callback. `target_latency` has to exceed
+/// the longest callback period of either stream. Output is silent until
+/// `target_latency` has been recorded, and again after the input falls
+/// behind until it has caught up.
+/// Returns `NULL` if the channel counts differ, `target_latency` is not
+/// positive, or memory could not be allocated.
+/// See also ::soundio_duplex_bridge_destroy
+SOUNDIO_EXPORT struct SoundIoDuplexBridge *soundio_duplex_bridge_create(
+        struct SoundIoInStream *instream, struct SoundIoOutStream *outstream,
+        double target_latency);
+/// Destroy the bridge only once neither stream calls it any more.
+SOUNDIO_EXPORT void soundio_duplex_bridge_destroy(struct SoundIoDuplexBridge *bridge);
+
+/// Reads all `frame_count_max` frames from the input stream into the
+/// bridge. Call it with the arguments of SoundIoInStream::read_callback.
+/// What does not fit is dropped and counted as an overflow.
+/// Returns any error of ::soundio_instream_begin_read or
+/// ::soundio_instream_end_read.
+SOUNDIO_EXPORT int soundio_duplex_bridge_capture(struct SoundIoDuplexBridge *bridge,
+        int frame_count_min, int frame_count_max);
+/// Writes `frame_count_max` frames to the output stream. Call it with the
+/// arguments of SoundIoOutStream::write_callback. Returns any error of
+/// ::soundio_outstream_begin_write or ::soundio_outstream_end_write.
+SOUNDIO_EXPORT int soundio_duplex_bridge_play(struct SoundIoDuplexBridge *bridge,
+        int frame_count_min, int frame_count_max);
+
+/// Returns the seconds currently buffered between the streams, averaged
+/// over a fraction of a second. Safe to call from any thread.
+SOUNDIO_EXPORT double soundio_duplex_bridge_get_latency(struct SoundIoDuplexBridge *bridge);
+/// Returns how much faster than nominal the bridge consumes input, for
+/// example 1.0001 when the input device runs 100 parts per million fast
+/// relative to the output device. Safe to call from any thread.
+SOUNDIO_EXPORT double soundio_duplex_bridge_get_ratio(struct SoundIoDuplexBridge *bridge);
+/// Returns how many times the input fell behind and the bridge had to play
+/// silence. Safe to call from any thread.
+SOUNDIO_EXPORT int soundio_duplex_bridge_get_underflow_count(struct SoundIoDuplexBridge *bridge);
+/// Returns how many times input was dropped because the bridge was full.
+/// Safe to call from any thread.
+SOUNDIO_EXPORT int soundio_duplex_bridge_get_overflow_count(struct SoundIoDuplexBridge *bridge);
+
+/// A mixer plays any number of voices through one output stream, for
+/// devices which only one stream can use at a time, such as raw ALSA devices
+/// and WASAPI devices in exclusive mode. Each voice has its own callback and
+/// volume; the mixer sums them in 32-bit float and converts the sum to the
+/// output stream's format.
+struct SoundIoMixer {
+    /// Created along with the mixer. Configure it like any other stream
+    /// before ::soundio_mixer_open, except for
+    /// SoundIoOutStream::write_callback, which belongs to the mixer. Its
+    /// other callbacks are called as usual. Do not open, start or destroy it
+    /// yourself.
+    struct SoundIoOutStream *outstream;
+
+    /// Defaults to NULL. Put whatever you want here.
+    void *userdata;
+};
+
+/// One source of sound of a SoundIoMixer.
+struct SoundIoMixerVoice {
+    /// Populated automatically when you call ::soundio_mixer_voice_create.
+    struct SoundIoMixer *mixer;
+
+    /// Defaults to NULL. Put whatever you want here.
+    void *userdata;
+
+    /// Called on the output stream's thread with `frame_count` frames to
+    /// fill, at most a few hundred. `areas` has a channel for each channel
+    /// of the output stream's SoundIoOutStream::write_layout, in
+    /// #SoundIoFormatFloat32NE at its SoundIoOutStream::write_sample_rate.
+    /// Every frame must be written; write silence to say nothing.
+    ///
+    /// Mixing takes no lock, but creating and destroying a voice wait until
+    /// the mixer is done with the voices it has, so do not create or destroy
+    /// voices from here. The other voice functions are fine.
+    void (*write_callback)(struct SoundIoMixerVoice *voice,
+            struct SoundIoChannelArea *areas, int frame_count);
+};
+
+/// Creates a mixer playing to `device`.
+/// Returns `NULL` if and only if memory could not be allocated.
+/// See also ::soundio_mixer_destroy
+SOUNDIO_EXPORT struct SoundIoMixer *soundio_mixer_create(struct SoundIoDevice *device);
+/// Also destroys SoundIoMixer::outstream and all voices which are left.
+SOUNDIO_EXPORT void soundio_mixer_destroy(struct SoundIoMixer *mixer);
+
+/// Opens SoundIoMixer::outstream.
+///
+/// Possible errors:
+/// * #SoundIoErrorNoMem
+/// * any error ::soundio_outstream_open returns
+SOUNDIO_EXPORT int soundio_mixer_open(struct SoundIoMixer *mixer);
+
+/// Starts SoundIoMixer::outstream. Until it starts, and whenever no voice
+/// is playing, the mixer plays silence.
+/// Returns any error ::soundio_outstream_start returns.
+SOUNDIO_EXPORT int soundio_mixer_start(struct SoundIoMixer *mixer);
+
+/// Creates a voice which plays nothing until ::soundio_mixer_voice_start is
+/// called. Its volume is 1.0. Voices may be created, started and destroyed
+/// at any time from any thread except a voice's
+/// SoundIoMixerVoice::write_callback.
+/// Returns `NULL` if and only if memory could not be allocated.
+/// See also ::soundio_mixer_voice_destroy
+SOUNDIO_EXPORT struct SoundIoMixerVoice *soundio_mixer_voice_create(struct SoundIoMixer *mixer);
+/// Once this returns, SoundIoMixerVoice::write_callback is not running and
+/// is not called again.
+SOUNDIO_EXPORT void soundio_mixer_voice_destroy(struct SoundIoMixerVoice *voice);
+
+/// From the next write on, SoundIoMixerVoice::write_callback is called.
+///
+/// Possible errors:
+/// * #SoundIoErrorInvalid - SoundIoMixerVoice::write_callback is not set
+SOUNDIO_EXPORT int soundio_mixer_voice_start(struct SoundIoMixerVoice *voice);
+
+/// A paused voice is not called and adds nothing to the mix.
+/// Safe to call from any thread.
+SOUNDIO_EXPORT void soundio_mixer_voice_pause(struct SoundIoMixerVoice *voice, bool pause);
+
+/// Sets the gain the mixer applies to the voice. It ramps to the new volume
+/// over the next call of SoundIoMixerVoice::write_callback rather than
+/// jumping, which would click.
+/// Safe to call from any thread.
+SOUNDIO_EXPORT void soundio_mixer_voice_set_volume(struct SoundIoMixerVoice *voice, double volume);
+
+/// How many seconds until the first frame of the running
+/// SoundIoMixerVoice::write_callback becomes audible. Voices called later in
+/// one write of the output stream are heard later, so this is the latency of
+/// the output stream plus the frames the mixer wrote before this call.
+///
+/// This function must be called only from within SoundIoMixerVoice::write_callback.
+SOUNDIO_EXPORT double soundio_mixer_voice_get_latency(struct SoundIoMixerVoice *voice);
+
+/// Obtain which frame of the voice is playing right now. This is the number
+/// of frames the voice has written before the running
+/// SoundIoMixerVoice::write_callback minus those which
+/// ::soundio_mixer_voice_get_latency says are yet to become audible. It
+/// counts frames of the voice, not of the output stream, so time spent not
+/// started or paused does not count.
+///
+/// This function must be called only from within SoundIoMixerVoice::write_callback.
+SOUNDIO_EXPORT void soundio_mixer_voice_get_position(struct SoundIoMixerVoice *voice,
+        struct SoundIoStreamPosition *position);
+
+struct SoundIoRecorder;
+
+/// See ::soundio_recorder_get_stats.
+/// The size of this struct is OK to use.
+struct SoundIoRecorderStats {
+    /// Frames passed to the recorder so far, whether or not they were kept.
+    int64_t frames_captured;
+    /// Frames which are in the file. They reach it in chunks of about a
+    /// megabyte.
+    int64_t frames_written;
+    /// Frames which are not in the file and never will be, because the
+    /// buffer was full or writing failed. They are left out rather than
+    /// replaced with silence.
+    int64_t frames_dropped;
+    /// Seconds of audio waiting to be written, now and at most so far. As
+    /// this nears `buffer_duration` the disk is not keeping up.
+    double buffer_fill;
+    double buffer_fill_max;
+    /// What was asked for, rounded up to whole pages of memory.
+    double buffer_duration;
+    /// The first error writing the file, or 0.
+    enum SoundIoError write_error;
+    /// Whether the file is written with direct I/O, bypassing the page
+    /// cache.
+    bool direct_io;
+};
+
+/// A recorder writes what an input stream records to a WAV file, from a
+/// thread of its own with low priority, so that the stream's thread never
+/// waits for the disk. Call ::soundio_recorder_capture from
+/// SoundIoInStream::read_callback.
+///
+/// The file is written in large chunks aligned for direct I/O, which is used
+/// where the OS and file system support it, with disk space reserved ahead
+/// of the writes. Its header is rewritten after every chunk, so a recording
+/// which is cut short still plays up to the last chunk. Recordings of 4 GiB
+/// or more become RF64 files.
+///
+/// `instream` must be open. Its format is what the file holds; supported are
+/// #SoundIoFormatU8, #SoundIoFormatS16LE, #SoundIoFormatS24LE (stored as
+/// 24-bit samples), #SoundIoFormatS32LE, #SoundIoFormatFloat32LE and
+/// #SoundIoFormatFloat64LE. `path` is a UTF-8 string; an existing file is
+/// overwritten. `buffer_duration` is how many seconds of audio may wait for
+/// the disk before frames are dropped.
+///
+/// Possible errors:
+/// * #SoundIoErrorInvalid - the format is not supported, `buffer_duration`
+///   is not positive or too large, or `instream` is not open
+/// * #SoundIoErrorNoMem
+/// * #SoundIoErrorFileIo - the file could not be created or written
+/// * #SoundIoErrorEncodingString - `path` is not valid UTF-8
+/// * #SoundIoErrorSystemResources
+/// See also ::soundio_recorder_finish and ::soundio_recorder_destroy
+SOUNDIO_EXPORT int soundio_recorder_create(struct SoundIoInStream *instream, const char *path,
+        double buffer_duration, struct SoundIoRecorder **out_recorder);
+
+/// Writes whatever is buffered, completes the header and closes the file.
+/// Destroy or pause the input stream first; frames captured afterwards are
+/// dropped. Calling it again returns the same result.
+///
+/// Possible errors:
+/// * #SoundIoErrorFileIo
+SOUNDIO_EXPORT int soundio_recorder_finish(struct SoundIoRecorder *recorder);
+
+/// Calls ::soundio_recorder_finish if that has not been done.
+SOUNDIO_EXPORT void soundio_recorder_destroy(struct SoundIoRecorder *recorder);
+
+/// Reads up to `frame_count_max` frames from the recorder's input stream
+/// into its buffer. Call only from SoundIoInStream::read_callback, with the
+/// arguments it was given. It never blocks. Frames which do not fit are
+/// counted as dropped.
+/// Returns any error ::soundio_instream_begin_read or
+/// ::soundio_instream_end_read return.
+SOUNDIO_EXPORT int soundio_recorder_capture(struct SoundIoRecorder *recorder,
+        int frame_count_min, int frame_count_max);
+
+/// Copies the statistics of the recorder to `stats`. Safe to call from any
+/// thread.
+SOUNDIO_EXPORT void soundio_recorder_get_stats(struct SoundIoRecorder *recorder,
+        struct SoundIoRecorderStats *stats);
+
+/// A file source plays a WAV, RF64 or raw file straight from a memory
+/// mapping of it. A helper thread with low priority keeps the pages ahead of
+/// the play cursor resident, so that the thread which plays the source does
+/// not wait for the disk. Either call ::soundio_file_source_write from
+/// SoundIoOutStream::write_callback, which converts from the mapping to the
+/// stream's areas in one pass and is an exact copy when the formats match,
+/// or read the mapping with ::soundio_file_source_begin_read.
+struct SoundIoFileSource {
+    /// Read-only. How the samples of the file are stored. They are
+    /// interleaved.
+    enum SoundIoFormat format;
+    /// Read-only.
+    int channel_count;
+    /// Read-only.
+    int sample_rate;
+    /// Read-only. The length of the file in frames.
+    int64_t frame_count;
+
+    /// Optional: Whether to start from the beginning again after the end,
+    /// rather than play silence. Set it before playing starts. Defaults to
+    /// `false`.
+    bool loop;
+
+    /// Optional: store arbitrary data here.
+    void *userdata;
+};
+
+/// Maps a WAV or RF64 file. Supported are 8, 16 and 32-bit integer samples,
+/// and 32 and 64-bit float samples; packed 24-bit samples are not, since no
+/// #SoundIoFormat describes them. `path` is a UTF-8 string.
+///
+/// Possible errors:
+/// * #SoundIoErrorInvalid - not a WAV or RF64 file, or one in a format
+///   which is not supported
+/// * #SoundIoErrorNoMem
+/// * #SoundIoErrorFileIo - the file could not be opened or mapped
+/// * #SoundIoErrorEncodingString - `path` is not valid UTF-8
+/// * #SoundIoErrorSystemResources
+/// See also ::soundio_file_source_destroy
+SOUNDIO_EXPORT int soundio_file_source_open(const char *path, struct SoundIoFileSource **out_source);
+
+/// Maps a file of nothing but interleaved samples, in `format`.
+/// Possible errors are those of ::soundio_file_source_open.
+SOUNDIO_EXPORT int soundio_file_source_open_raw(const char *path, enum SoundIoFormat format,
+        int channel_count, int sample_rate, struct SoundIoFileSource **out_source);
+
+/// Unmaps the file. Stop playing the source first.
+SOUNDIO_EXPORT void soundio_file_source_destroy(struct SoundIoFileSource *source);
+
+/// Makes `outstream` the stream which ::soundio_file_source_write fills.
+/// `outstream` must be open, with a SoundIoOutStream::write_layout of as
+/// many channels as the file and a SoundIoOutStream::write_sample_rate of
+/// the file's rate. Set SoundIoOutStream::write_sample_rate to it before
+/// opening the stream to play the file on a device at another rate, and
+/// SoundIoOutStream::write_layout to play it on a device with other
+/// channels. The source is not changed if
+/// this fails.
+///
+/// Possible errors:
+/// * #SoundIoErrorInvalid - the source is attached already, or `outstream`
+///   is not open
+/// * #SoundIoErrorIncompatibleDevice - the channel count or rate differs
+/// * #SoundIoErrorNoMem
+SOUNDIO_EXPORT int soundio_file_source_attach(struct SoundIoFileSource *source,
+        struct SoundIoOutStream *outstream);
+
+/// Writes up to `frame_count_max` frames from the play cursor onwards to the
+/// attached output stream, and silence past the end of a source which does
+/// not loop. Call only from SoundIoOutStream::write_callback, with the
+/// arguments it was given. It never blocks.
+/// Returns #SoundIoErrorInvalid if no stream is attached, or any error
+/// ::soundio_outstream_begin_write or ::soundio_outstream_end_write return.
+SOUNDIO_EXPORT int soundio_file_source_write(struct SoundIoFileSource *source,
+        int frame_count_min, int frame_count_max);
+
+/// Points `areas` at up to `*frame_count` frames of the mapping, from the
+/// play cursor onwards, without copying them. The samples are in
+/// SoundIoFileSource::format and must not be written to. `*frame_count` is
+/// set to how many frames that is, which is 0 at the end of a source which
+/// does not loop; then `areas` is NULL. Call ::soundio_file_source_end_read
+/// to move the cursor past them. Use it either from the one thread which
+/// plays the source, or ::soundio_file_source_write, not both.
+/// Returns #SoundIoErrorInvalid if `*frame_count` is negative.
+SOUNDIO_EXPORT int soundio_file_source_begin_read(struct SoundIoFileSource *source,
+        struct SoundIoChannelArea **areas, int *frame_count);
+/// See ::soundio_file_source_begin_read.
+SOUNDIO_EXPORT void soundio_file_source_end_read(struct SoundIoFileSource *source);
+
+/// Moves the play cursor to `frame`, clamped to the length of the file. It
+/// takes effect the next time the source is played from. Safe to call from
+/// any thread.
+SOUNDIO_EXPORT void soundio_file_source_seek(struct SoundIoFileSource *source, int64_t frame);
+
+/// Returns the frame which plays next, including a seek which has not
+/// taken effect. Safe to call from any thread.
+SOUNDIO_EXPORT int64_t soundio_file_source_get_position(struct SoundIoFileSource *source);
 
 struct SoundIoRingBuffer;
 
@@ -1179,6 +2404,44 @@ struct SoundIoRingBuffer;
 /// be greater for alignment purposes.
 /// See also ::soundio_ring_buffer_destroy
 SOUNDIO_EXPORT struct SoundIoRingBuffer *soundio_ring_buffer_create(struct SoundIo *soundio, int requested_capacity);
+
+/// Flags for ::soundio_ring_buffer_create_ex. Combine with bitwise OR.
+enum SoundIoRingBufferFlag {
+    SoundIoRingBufferFlagNone = 0,
+    /// The writer only calls ::soundio_ring_buffer_write_ptr,
+    /// ::soundio_ring_buffer_advance_write_ptr, ::soundio_ring_buffer_free_count,
+    /// ::soundio_ring_buffer_begin_write, ::soundio_ring_buffer_end_write
+    /// and ::soundio_ring_buffer_clear, and the reader only calls
+    /// ::soundio_ring_buffer_read_ptr, ::soundio_ring_buffer_advance_read_ptr,
+    /// ::soundio_ring_buffer_fill_count, ::soundio_ring_buffer_begin_read
+    /// and ::soundio_ring_buffer_end_read. In exchange for this promise the
+    /// ring buffer uses acquire/release ordering instead of sequentially
+    /// consistent read-modify-write operations, and each side keeps a cached
+    /// copy of the other side's offset. ::soundio_ring_buffer_begin_write and
+    /// ::soundio_ring_buffer_begin_read load the other side's offset, and
+    /// with it the other thread's cache line, only when the cached one does
+    /// not leave room for the request. ::soundio_ring_buffer_fill_count and
+    /// ::soundio_ring_buffer_free_count return exact counts, so they load it
+    /// unless the buffer was last seen full or empty respectively;
+    /// ::soundio_ring_buffer_clear always does. The reader notices a clear
+    /// before it trusts its cached copy again, but a clear must not happen
+    /// while the reader holds a region from ::soundio_ring_buffer_begin_read
+    /// or between its ::soundio_ring_buffer_fill_count and
+    /// ::soundio_ring_buffer_advance_read_ptr.
+    SoundIoRingBufferFlagStrictRoles = 1,
+    /// Back the buffer with huge pages, which saves TLB misses on large
+    /// buffers. Uses reserved huge pages when there are any, and otherwise
+    /// asks for transparent huge pages. The capacity is rounded up to a
+    /// multiple of the huge page size, usually 2 MiB, so this only makes
+    /// sense for large buffers. Linux only; ignored elsewhere.
+    SoundIoRingBufferFlagHugePages = 2,
+};
+
+/// Same as ::soundio_ring_buffer_create but accepts a bitmask of
+/// #SoundIoRingBufferFlag values.
+/// Returns `NULL` if and only if memory could not be allocated.
+SOUNDIO_EXPORT struct SoundIoRingBuffer *soundio_ring_buffer_create_ex(struct SoundIo *soundio,
+        int requested_capacity, int flags);
 SOUNDIO_EXPORT void soundio_ring_buffer_destroy(struct SoundIoRingBuffer *ring_buffer);
 
 /// When you create a ring buffer, capacity might be more than the requested
@@ -1204,4 +2467,87 @@ SOUNDIO_EXPORT int soundio_ring_buffer_free_count(struct SoundIoRingBuffer *ring
 /// Must be called by the writer.
 SOUNDIO_EXPORT void soundio_ring_buffer_clear(struct SoundIoRingBuffer *ring_buffer);
 
+/// Call this when you are ready to write to the ring buffer. This combines
+/// ::soundio_ring_buffer_free_count and ::soundio_ring_buffer_write_ptr into
+/// one call that looks at the offsets once.
+///  * `ring_buffer` - (in) The ring buffer you want to write to.
+///  * `byte_count` - (in/out) Provide the number of bytes you want to write.
+///    Returned will be the number of bytes you can actually write, which is
+///    always less than or equal to the value provided.
+/// Returns the address to write to. The region is always contiguous, even
+/// when it crosses the end of the ring buffer's capacity.
+/// After writing, call ::soundio_ring_buffer_end_write.
+/// Must be called by the writer.
+SOUNDIO_EXPORT char *soundio_ring_buffer_begin_write(struct SoundIoRingBuffer *ring_buffer,
+        int *byte_count);
+/// Commits `byte_count` bytes of the region returned by
+/// ::soundio_ring_buffer_begin_write. `byte_count` may be less than the size
+/// of the region, in which case the rest is left unwritten.
+/// Must be called by the writer.
+SOUNDIO_EXPORT void soundio_ring_buffer_end_write(struct SoundIoRingBuffer *ring_buffer,
+        int byte_count);
+
+/// Call this when you are ready to read from the ring buffer. This combines
+/// ::soundio_ring_buffer_fill_count and ::soundio_ring_buffer_read_ptr into
+/// one call that looks at the offsets once.
+///  * `ring_buffer` - (in) The ring buffer you want to read from.
+///  * `byte_count` - (in/out) Provide the number of bytes you want to read.
+///    Returned will be the number of bytes you can actually read, which is
+///    always less than or equal to the value provided.
+/// Returns the address to read from. The region is always contiguous, even
+/// when it crosses the end of the ring buffer's capacity.
+/// After reading, call ::soundio_ring_buffer_end_read.
+/// Must be called by the reader.
+SOUNDIO_EXPORT char *soundio_ring_buffer_begin_read(struct SoundIoRingBuffer *ring_buffer,
+        int *byte_count);
+/// Releases `byte_count` bytes of the region returned by
+/// ::soundio_ring_buffer_begin_read. `byte_count` may be less than the size
+/// of the region, in which case the rest stays in the ring buffer.
+/// Must be called by the reader.
+SOUNDIO_EXPORT void soundio_ring_buffer_end_read(struct SoundIoRingBuffer *ring_buffer,
+        int byte_count);
+
+
+struct SoundIoBlockQueue;
+
+/// A block queue is a multiple-reader multiple-writer lock-free fixed-size
+/// queue of blocks. Unlike SoundIoRingBuffer, any number of threads may write
+/// to it at the same time, which is useful when several streams feed one
+/// mixing thread. Each block holds up to `block_capacity` bytes.
+/// `block_count` is rounded up to a power of 2.
+/// Returns `NULL` if and only if memory could not be allocated.
+/// See also ::soundio_block_queue_destroy
+SOUNDIO_EXPORT struct SoundIoBlockQueue *soundio_block_queue_create(struct SoundIo *soundio,
+        int block_capacity, int block_count);
+SOUNDIO_EXPORT void soundio_block_queue_destroy(struct SoundIoBlockQueue *block_queue);
+
+/// Returns the maximum number of bytes in one block.
+SOUNDIO_EXPORT int soundio_block_queue_block_capacity(struct SoundIoBlockQueue *block_queue);
+/// Returns the actual number of blocks the queue can hold.
+SOUNDIO_EXPORT int soundio_block_queue_block_count(struct SoundIoBlockQueue *block_queue);
+
+/// Reserves the next block for writing. Returns `NULL` if the queue is full.
+/// Write up to ::soundio_block_queue_block_capacity bytes to the returned
+/// address and then call ::soundio_block_queue_end_write. Blocks are read in
+/// the order in which they were reserved, so do not hold on to a reserved
+/// block for long.
+/// May be called from any number of threads at once.
+SOUNDIO_EXPORT char *soundio_block_queue_begin_write(struct SoundIoBlockQueue *block_queue);
+/// Publishes a block returned by ::soundio_block_queue_begin_write.
+/// `byte_count` is how many bytes of the block were written.
+SOUNDIO_EXPORT void soundio_block_queue_end_write(struct SoundIoBlockQueue *block_queue,
+        char *block, int byte_count);
+
+/// Takes the oldest published block. Returns `NULL` and sets `byte_count` to
+/// 0 if there is none. Otherwise `byte_count` is set to the value passed to
+/// ::soundio_block_queue_end_write. After reading, call
+/// ::soundio_block_queue_end_read.
+/// May be called from any number of threads at once.
+SOUNDIO_EXPORT char *soundio_block_queue_begin_read(struct SoundIoBlockQueue *block_queue,
+        int *byte_count);
+/// Returns a block obtained from ::soundio_block_queue_begin_read to the
+/// writers.
+SOUNDIO_EXPORT void soundio_block_queue_end_read(struct SoundIoBlockQueue *block_queue,
+        char *block);
+
 #endif
@@ -8,11 +8,21 @@
 #define _GNU_SOURCE
 #include "alsa.h"
 #include "soundio_private.h"
+#include "device_cache.h"
 
 #include <sys/inotify.h>
+#include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
 
+// Timer-based scheduling uses a hardware buffer of at least this many
+// seconds, and at least this many times the watermark.
+static const double tsched_min_buffer_seconds = 0.1;
+static const int tsched_buffer_watermark_ratio = 4;
+// After this many seconds without an underflow the watermark shrinks back
+// toward the requested latency.
+static const double tsched_decay_seconds = 10.0;
+
 static snd_pcm_stream_t stream_types[] = {SND_PCM_STREAM_PLAYBACK, SND_PCM_STREAM_CAPTURE};
 
 static snd_pcm_access_t prioritized_access_types[] = {
@@ -24,27 +34,18 @@ static snd_pcm_access_t prioritized_access_types[] = {
 };
 
 SOUNDIO_MAKE_LIST_DEF(struct SoundIoAlsaPendingFile, SoundIoListAlsaPendingFile, SOUNDIO_LIST_STATIC)
+SOUNDIO_MAKE_LIST_DEF(struct SoundIoAlsaCard, SoundIoListAlsaCard, SOUNDIO_LIST_STATIC)
+SOUNDIO_MAKE_LIST_DEF(struct SoundIoAlsaProbeJob, SoundIoListAlsaProbeJob, SOUNDIO_LIST_STATIC)
+SOUNDIO_MAKE_LIST_DEF(struct SoundIoAlsaProbeCacheEntry, SoundIoListAlsaProbeCacheEntry, SOUNDIO_LIST_STATIC)
+
+static void clear_probe_cache(struct SoundIoAlsa *sia);
 
 static void wakeup_device_poll(struct SoundIoAlsa *sia) {
-    ssize_t amt = write(sia->notify_pipe_fd[1], "a", 1);
-    if (amt == -1) {
-        assert(errno != EBADF);
-        assert(errno != EIO);
-        assert(errno != ENOSPC);
-        assert(errno != EPERM);
-        assert(errno != EPIPE);
-    }
+    soundio_os_event_signal(sia->scan_event);
 }
 
 static void wakeup_outstream_poll(struct SoundIoOutStreamAlsa *osa) {
-    ssize_t amt = write(osa->poll_exit_pipe_fd[1], "a", 1);
-    if (amt == -1) {
-        assert(errno != EBADF);
-        assert(errno != EIO);
-        assert(errno != ENOSPC);
-        assert(errno != EPERM);
-        assert(errno != EPIPE);
-    }
+    soundio_os_event_signal(osa->poll_exit_event);
 }
 
 static void destroy_alsa(struct SoundIoPrivate *si) {
@@ -56,20 +57,14 @@ static void destroy_alsa(struct SoundIoPrivate *si) {
         soundio_os_thread_destroy(sia->thread);
     }
 
-    SoundIoListAlsaPendingFile_deinit(&sia->pending_files);
-
-    if (sia->cond)
-        soundio_os_cond_destroy(sia->cond);
-
-    if (sia->mutex)
-        soundio_os_mutex_destroy(sia->mutex);
-
-    soundio_destroy_devices_info(sia->ready_devices_info);
-
+    soundio_os_event_destroy(sia->scan_event);
 
+    SoundIoListAlsaPendingFile_deinit(&sia->pending_files);
+    clear_probe_cache(sia);
+    SoundIoListAlsaProbeCacheEntry_deinit(&sia->probe_cache);
+    SoundIoListAlsaProbeJob_deinit(&sia->probe_jobs);
+    SoundIoListAlsaCard_deinit(&sia->scan_cards);
 
-    close(sia->notify_pipe_fd[0]);
-    close(sia->notify_pipe_fd[1]);
     close(sia->notify_fd);
 }
 
@@ -204,7 +199,8 @@ static int handle_channel_maps(struct SoundIoDevice *device, snd_pcm_chmap_query
     // one iteration to count
     int layout_count = 0;
     for (p = maps; (v = *p) && layout_count < SOUNDIO_MAX_CHANNELS; p += 1, layout_count += 1) { }
-    device->layouts = ALLOCATE(struct SoundIoChannelLayout, layout_count);
+    device->layouts = DEVICE_ALLOCATE((struct SoundIoDevicePrivate *)device,
+            struct SoundIoChannelLayout, layout_count);
     if (!device->layouts) {
         snd_pcm_free_chmaps(maps);
         return SoundIoErrorNoMem;
@@ -260,6 +256,10 @@ static void test_fmt_mask(struct SoundIoDevice *device, const snd_pcm_format_mas
     }
 }
 
+static bool is_rw_access(snd_pcm_access_t access) {
+    return access == SND_PCM_ACCESS_RW_INTERLEAVED || access == SND_PCM_ACCESS_RW_NONINTERLEAVED;
+}
+
 static int set_access(snd_pcm_t *handle, snd_pcm_hw_params_t *hwparams, snd_pcm_access_t *out_access) {
     for (int i = 0; i < ARRAY_LENGTH(prioritized_access_types); i += 1) {
         snd_pcm_access_t access = prioritized_access_types[i];
@@ -364,7 +364,7 @@ static int probe_open_device(struct SoundIoDevice *device, snd_pcm_t *handle, in
 
     if (!device->formats) {
         snd_pcm_hw_params_get_format_mask(hwparams, fmt_mask);
-        device->formats = ALLOCATE(enum SoundIoFormat, 18);
+        device->formats = DEVICE_ALLOCATE(dev, enum SoundIoFormat, 18);
         if (!device->formats)
             return SoundIoErrorNoMem;
 
@@ -423,7 +423,8 @@ static int probe_device(struct SoundIoDevice *device, snd_pcm_chmap_query_t **ma
                 }
             }
             device->layout_count = layout_count;
-            device->layouts = ALLOCATE(struct SoundIoChannelLayout, device->layout_count);
+            device->layouts = DEVICE_ALLOCATE((struct SoundIoDevicePrivate *)device,
+                    struct SoundIoChannelLayout, device->layout_count);
             if (!device->layouts) {
                 snd_pcm_close(handle);
                 return SoundIoErrorNoMem;
@@ -471,6 +472,344 @@ static inline bool str_has_prefix(const char *big_str, const char *prefix) {
     return strncmp(big_str, prefix, strlen(prefix)) == 0;
 }
 
+static uint64_t fnv1a_str(uint64_t hash, const char *str) {
+    // include the terminator so that "ab", "c" hashes differently than "a", "bc"
+    if (!str)
+        str = "";
+    return soundio_fnv1a(hash, str, strlen(str) + 1);
+}
+
+static uint64_t fnv1a_file(uint64_t hash, const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return hash;
+    char buf[256];
+    ssize_t len;
+    while ((len = read(fd, buf, sizeof(buf))) > 0)
+        hash = soundio_fnv1a(hash, buf, len);
+    close(fd);
+    return hash;
+}
+
+// The fingerprint covers what identifies the card and its PCMs. Live state
+// such as /proc/asound/cardN/stream0 is left out so that a running stream
+// does not count as a change. `pcm_info` is scratch space.
+static uint64_t card_fingerprint(snd_ctl_t *handle, int card_index, snd_ctl_card_info_t *card_info,
+        snd_pcm_info_t *pcm_info)
+{
+    uint64_t fingerprint = SOUNDIO_FNV1A_INIT;
+    fingerprint = fnv1a_str(fingerprint, snd_ctl_card_info_get_id(card_info));
+    fingerprint = fnv1a_str(fingerprint, snd_ctl_card_info_get_longname(card_info));
+    fingerprint = fnv1a_str(fingerprint, snd_ctl_card_info_get_mixername(card_info));
+    fingerprint = fnv1a_str(fingerprint, snd_ctl_card_info_get_components(card_info));
+
+    char proc_path[64];
+    snprintf(proc_path, sizeof(proc_path), "/proc/asound/card%d/usbid", card_index);
+    fingerprint = fnv1a_file(fingerprint, proc_path);
+
+    int device_index = -1;
+    while (snd_ctl_pcm_next_device(handle, &device_index) >= 0 && device_index >= 0) {
+        snd_pcm_info_set_device(pcm_info, device_index);
+        snd_pcm_info_set_subdevice(pcm_info, 0);
+        for (int stream_type_i = 0; stream_type_i < ARRAY_LENGTH(stream_types); stream_type_i += 1) {
+            snd_pcm_stream_t stream = stream_types[stream_type_i];
+            snd_pcm_info_set_stream(pcm_info, stream);
+            if (snd_ctl_pcm_info(handle, pcm_info) < 0)
+                continue;
+            fingerprint = soundio_fnv1a(fingerprint, &device_index, sizeof(device_index));
+            fingerprint = soundio_fnv1a(fingerprint, &stream, sizeof(stream));
+            fingerprint = fnv1a_str(fingerprint, snd_pcm_info_get_name(pcm_info));
+        }
+    }
+    return fingerprint;
+}
+
+// Configuration files decide which PCMs the name hints list.
+static uint64_t config_fingerprint(uint64_t fingerprint) {
+    char *home_asoundrc = NULL;
+    const char *home = getenv("HOME");
+    if (home)
+        home_asoundrc = soundio_alloc_sprintf(NULL, "%s/.asoundrc", home);
+    const char *paths[] = {"/etc/asound.conf", home_asoundrc};
+    for (int i = 0; i < ARRAY_LENGTH(paths); i += 1) {
+        struct stat st;
+        if (!paths[i] || stat(paths[i], &st))
+            continue;
+        fingerprint = soundio_fnv1a(fingerprint, &st.st_mtime, sizeof(st.st_mtime));
+        fingerprint = soundio_fnv1a(fingerprint, &st.st_size, sizeof(st.st_size));
+    }
+    free(home_asoundrc);
+    return fingerprint;
+}
+
+// Key of the persisted device cache: every card's fingerprint, in order,
+// and the configuration files.
+static uint64_t system_fingerprint_from_cards(const struct SoundIoListAlsaCard *cards) {
+    uint64_t fingerprint = SOUNDIO_FNV1A_INIT;
+    for (int i = 0; i < cards->length; i += 1)
+        fingerprint = soundio_fnv1a(fingerprint, &cards->items[i].fingerprint, sizeof(uint64_t));
+    return config_fingerprint(fingerprint);
+}
+
+// Computes the same key as system_fingerprint_from_cards without probing
+// or listing name hints, which is fast enough to do before the first scan.
+static int system_fingerprint(uint64_t *out_fingerprint) {
+    snd_ctl_card_info_t *card_info;
+    snd_ctl_card_info_alloca(&card_info);
+    snd_pcm_info_t *pcm_info;
+    snd_pcm_info_alloca(&pcm_info);
+
+    uint64_t fingerprint = SOUNDIO_FNV1A_INIT;
+    int card_index = -1;
+    if (snd_card_next(&card_index) < 0)
+        return SoundIoErrorSystemResources;
+    while (card_index >= 0) {
+        snd_ctl_t *handle;
+        char name[32];
+        sprintf(name, "hw:%d", card_index);
+        int err;
+        if ((err = snd_ctl_open(&handle, name, 0)) < 0) {
+            if (err == -ENOENT)
+                break;
+            return SoundIoErrorOpeningDevice;
+        }
+        if (snd_ctl_card_info(handle, card_info) < 0) {
+            snd_ctl_close(handle);
+            return SoundIoErrorSystemResources;
+        }
+        uint64_t card = card_fingerprint(handle, card_index, card_info, pcm_info);
+        fingerprint = soundio_fnv1a(fingerprint, &card, sizeof(card));
+        snd_ctl_close(handle);
+        if (snd_card_next(&card_index) < 0)
+            return SoundIoErrorSystemResources;
+    }
+    *out_fingerprint = config_fingerprint(fingerprint);
+    return 0;
+}
+
+// Finds the value of CARD= in names such as "sysdefault:CARD=PCH" or
+// "hdmi:CARD=HDMI,DEV=0". Leaves `card_id` empty if there is none.
+static void card_id_from_name(const char *name, char *card_id) {
+    card_id[0] = 0;
+    const char *start = strstr(name, "CARD=");
+    if (!start)
+        return;
+    start += strlen("CARD=");
+    size_t len = strcspn(start, ",");
+    if (len >= SOUNDIO_MAX_ALSA_CARD_ID_LEN)
+        return;
+    memcpy(card_id, start, len);
+    card_id[len] = 0;
+}
+
+// Copies what probe_device found from `src` to `dest`.
+static int copy_probe_result(struct SoundIoDevice *dest, const struct SoundIoDevice *src) {
+    struct SoundIoDevicePrivate *dest_dev = (struct SoundIoDevicePrivate *)dest;
+
+    if (src->format_count > 0) {
+        dest->formats = DEVICE_ALLOCATE(dest_dev, enum SoundIoFormat, src->format_count);
+        if (!dest->formats)
+            return SoundIoErrorNoMem;
+        memcpy(dest->formats, src->formats, src->format_count * sizeof(enum SoundIoFormat));
+    }
+    dest->format_count = src->format_count;
+    dest->current_format = src->current_format;
+
+    if (src->layout_count > 0) {
+        dest->layouts = DEVICE_ALLOCATE(dest_dev, struct SoundIoChannelLayout, src->layout_count);
+        if (!dest->layouts)
+            return SoundIoErrorNoMem;
+        memcpy(dest->layouts, src->layouts, src->layout_count * sizeof(struct SoundIoChannelLayout));
+    }
+    dest->layout_count = src->layout_count;
+    dest->current_layout = src->current_layout;
+
+    // probe_open_device reports one range, in prealloc_sample_rate_range
+    assert(src->sample_rate_count <= 1);
+    if (src->sample_rate_count == 1) {
+        dest_dev->prealloc_sample_rate_range = src->sample_rates[0];
+        dest->sample_rates = &dest_dev->prealloc_sample_rate_range;
+    }
+    dest->sample_rate_count = src->sample_rate_count;
+    dest->sample_rate_current = src->sample_rate_current;
+
+    dest->software_latency_min = src->software_latency_min;
+    dest->software_latency_max = src->software_latency_max;
+    dest->software_latency_current = src->software_latency_current;
+
+    dest->probe_error = src->probe_error;
+    return 0;
+}
+
+// The cache keeps its own copies because devices handed to the
+// application are reference counted on the application's thread.
+static struct SoundIoDevice *clone_probed_device(const struct SoundIoDevice *src) {
+    struct SoundIoDevicePrivate *dev = soundio_device_create(NULL);
+    if (!dev)
+        return NULL;
+    struct SoundIoDevice *device = &dev->pub;
+    device->soundio = src->soundio;
+    device->aim = src->aim;
+    device->is_raw = src->is_raw;
+    device->id = soundio_device_strdup(dev, src->id);
+    if (!device->id || copy_probe_result(device, src)) {
+        soundio_device_unref(device);
+        return NULL;
+    }
+    return device;
+}
+
+static void clear_probe_cache(struct SoundIoAlsa *sia) {
+    for (int i = 0; i < sia->probe_cache.length; i += 1) {
+        struct SoundIoAlsaProbeCacheEntry *entry = SoundIoListAlsaProbeCacheEntry_ptr_at(&sia->probe_cache, i);
+        soundio_device_unref(entry->device);
+    }
+    SoundIoListAlsaProbeCacheEntry_clear(&sia->probe_cache);
+}
+
+static struct SoundIoDevice *find_cached_probe(struct SoundIoAlsa *sia,
+        const struct SoundIoAlsaCard *card, const struct SoundIoDevice *device)
+{
+    for (int i = 0; i < sia->probe_cache.length; i += 1) {
+        struct SoundIoAlsaProbeCacheEntry *entry = SoundIoListAlsaProbeCacheEntry_ptr_at(&sia->probe_cache, i);
+        if (entry->fingerprint == card->fingerprint &&
+            strcmp(entry->card_id, card->id) == 0 &&
+            entry->device->aim == device->aim &&
+            entry->device->is_raw == device->is_raw &&
+            strcmp(entry->device->id, device->id) == 0)
+        {
+            return entry->device;
+        }
+    }
+    return NULL;
+}
+
+static int device_probe_alsa(struct SoundIoPrivate *si, struct SoundIoDevicePrivate *dev) {
+    struct SoundIoDeviceAlsa *dev_alsa = &dev->backend_data.alsa;
+    snd_pcm_chmap_query_t **maps = NULL;
+    if (dev_alsa->hw_card >= 0) {
+        maps = snd_pcm_query_chmaps_from_hw(dev_alsa->hw_card, dev_alsa->hw_device, -1,
+                aim_to_stream(dev->pub.aim));
+    }
+    return probe_device(&dev->pub, maps);
+}
+
+static void probe_job(struct SoundIoAlsaProbeJob *job) {
+    snd_pcm_chmap_query_t **maps = NULL;
+    if (job->hw_card >= 0) {
+        maps = snd_pcm_query_chmaps_from_hw(job->hw_card, job->hw_device, -1,
+                aim_to_stream(job->device->aim));
+    }
+    job->device->probe_error = probe_device(job->device, maps);
+}
+
+// Takes one card at a time and probes all of its PCMs in order. They are
+// not probed in parallel with each other because a hw device cannot be
+// opened while a plug or dmix device on top of it is open.
+static void probe_thread_run(void *arg) {
+    struct SoundIoAlsa *sia = (struct SoundIoAlsa *)arg;
+    for (;;) {
+        int scan_card = SOUNDIO_ATOMIC_FETCH_ADD(sia->probe_next_card, 1);
+        if (scan_card >= sia->scan_cards.length)
+            return;
+        for (int i = 0; i < sia->probe_jobs.length; i += 1) {
+            struct SoundIoAlsaProbeJob *job = SoundIoListAlsaProbeJob_ptr_at(&sia->probe_jobs, i);
+            if (job->needs_probe && job->scan_card == scan_card)
+                probe_job(job);
+        }
+    }
+}
+
+static int probe_devices(struct SoundIoAlsa *sia) {
+    int err;
+
+    int pending_card_count = 0;
+    for (int c = 0; c < sia->scan_cards.length; c += 1) {
+        struct SoundIoAlsaCard *card = SoundIoListAlsaCard_ptr_at(&sia->scan_cards, c);
+        bool card_pending = false;
+        for (int i = 0; i < sia->probe_jobs.length; i += 1) {
+            struct SoundIoAlsaProbeJob *job = SoundIoListAlsaProbeJob_ptr_at(&sia->probe_jobs, i);
+            if (strcmp(job->card_id, card->id) != 0)
+                continue;
+            job->scan_card = c;
+            struct SoundIoDevice *cached = find_cached_probe(sia, card, job->device);
+            if (cached) {
+                if ((err = copy_probe_result(job->device, cached)))
+                    return err;
+                job->needs_probe = false;
+            } else {
+                card_pending = true;
+            }
+        }
+        if (card_pending)
+            pending_card_count += 1;
+    }
+
+    // PCMs which do not belong to one card, such as "default" or "pulse",
+    // may open any card, so they are probed first, one at a time.
+    for (int i = 0; i < sia->probe_jobs.length; i += 1) {
+        struct SoundIoAlsaProbeJob *job = SoundIoListAlsaProbeJob_ptr_at(&sia->probe_jobs, i);
+        if (job->scan_card == -1)
+            probe_job(job);
+    }
+
+    // The cards are independent of each other, so they are probed in
+    // parallel. This thread is one of the workers.
+    SOUNDIO_ATOMIC_STORE(sia->probe_next_card, 0);
+    struct SoundIoOsThread *threads[SOUNDIO_MAX_ALSA_PROBE_THREADS];
+    int thread_count = 0;
+    int wanted_thread_count = soundio_int_min(pending_card_count, SOUNDIO_MAX_ALSA_PROBE_THREADS) - 1;
+    for (int i = 0; i < wanted_thread_count; i += 1) {
+        // if a thread cannot be created, the others pick up its cards
+        if (soundio_os_thread_create(probe_thread_run, sia, NULL, false, NULL, &threads[thread_count]))
+            break;
+        thread_count += 1;
+    }
+    probe_thread_run(sia);
+    for (int i = 0; i < thread_count; i += 1)
+        soundio_os_thread_destroy(threads[i]);
+
+    // Remember the successful probes. Failures are not cached because they
+    // are often temporary, for example when another program has the device
+    // open.
+    clear_probe_cache(sia);
+    for (int i = 0; i < sia->probe_jobs.length; i += 1) {
+        struct SoundIoAlsaProbeJob *job = SoundIoListAlsaProbeJob_ptr_at(&sia->probe_jobs, i);
+        if (job->scan_card == -1 || job->device->probe_error)
+            continue;
+        struct SoundIoAlsaCard *card = SoundIoListAlsaCard_ptr_at(&sia->scan_cards, job->scan_card);
+        struct SoundIoAlsaProbeCacheEntry entry;
+        memcpy(entry.card_id, card->id, SOUNDIO_MAX_ALSA_CARD_ID_LEN);
+        entry.fingerprint = card->fingerprint;
+        entry.device = clone_probed_device(job->device);
+        if (!entry.device)
+            return SoundIoErrorNoMem;
+        if (SoundIoListAlsaProbeCacheEntry_append(&sia->probe_cache, entry)) {
+            soundio_device_unref(entry.device);
+            return SoundIoErrorNoMem;
+        }
+    }
+
+    return 0;
+}
+
+static int add_probe_job(struct SoundIoAlsa *sia, struct SoundIoDevice *device,
+        const char *card_id, int hw_card, int hw_device)
+{
+    struct SoundIoDevicePrivate *dev = (struct SoundIoDevicePrivate *)device;
+    dev->backend_data.alsa.hw_card = hw_card;
+    dev->backend_data.alsa.hw_device = hw_device;
+
+    struct SoundIoAlsaProbeJob job;
+    job.device = device;
+    snprintf(job.card_id, SOUNDIO_MAX_ALSA_CARD_ID_LEN, "%s", card_id);
+    job.scan_card = -1;
+    job.hw_card = hw_card;
+    job.hw_device = hw_device;
+    job.needs_probe = true;
+    return SoundIoListAlsaProbeJob_append(&sia->probe_jobs, job);
+}
+
 static int refresh_devices(struct SoundIoPrivate *si) {
     struct SoundIo *soundio = &si->pub;
     struct SoundIoAlsa *sia = &si->backend_data.alsa;
@@ -481,7 +820,12 @@ static int refresh_devices(struct SoundIoPrivate *si) {
     if ((err = snd_config_update()) < 0)
         return SoundIoErrorSystemResources;
 
-    struct SoundIoDevicesInfo *devices_info = ALLOCATE(struct SoundIoDevicesInfo, 1);
+    if (!SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(sia->keep_probe_cache))
+        clear_probe_cache(sia);
+    SoundIoListAlsaCard_clear(&sia->scan_cards);
+    SoundIoListAlsaProbeJob_clear(&sia->probe_jobs);
+
+    struct SoundIoDevicesInfo *devices_info = soundio_devices_info_create(soundio);
     if (!devices_info)
         return SoundIoErrorNoMem;
     devices_info->default_output_index = -1;
@@ -562,7 +906,7 @@ static int refresh_devices(struct SoundIoPrivate *si) {
             }
 
 
-            struct SoundIoDevicePrivate *dev = ALLOCATE(struct SoundIoDevicePrivate, 1);
+            struct SoundIoDevicePrivate *dev = soundio_device_create(devices_info);
             if (!dev) {
                 free(name);
                 free(descr);
@@ -571,16 +915,15 @@ static int refresh_devices(struct SoundIoPrivate *si) {
                 return SoundIoErrorNoMem;
             }
             struct SoundIoDevice *device = &dev->pub;
-            device->ref_count = 1;
             device->soundio = soundio;
             device->is_raw = false;
-            device->id = strdup(name);
+            device->id = soundio_device_strdup(dev, name);
             if (descr1) {
-                device->name = soundio_alloc_sprintf(NULL, "%s: %s", descr, descr1);
+                device->name = soundio_device_sprintf(dev, "%s: %s", descr, descr1);
             } else if (descr) {
-                device->name = strdup(descr);
+                device->name = soundio_device_strdup(dev, descr);
             } else {
-                device->name = strdup(name);
+                device->name = soundio_device_strdup(dev, name);
             }
 
             if (!device->id || !device->name) {
@@ -617,9 +960,11 @@ static int refresh_devices(struct SoundIoPrivate *si) {
                     devices_info->default_input_index = device_list->length;
             }
 
-            device->probe_error = probe_device(device, NULL);
-
-            if (SoundIoListDevicePtr_append(device_list, device)) {
+            char card_id[SOUNDIO_MAX_ALSA_CARD_ID_LEN];
+            card_id_from_name(name, card_id);
+            if (add_probe_job(sia, device, card_id, -1, -1) ||
+                SoundIoListDevicePtr_append(device_list, device))
+            {
                 soundio_device_unref(device);
                 free(name);
                 free(descr);
@@ -678,6 +1023,18 @@ static int refresh_devices(struct SoundIoPrivate *si) {
             return SoundIoErrorSystemResources;
         }
         const char *card_name = snd_ctl_card_info_get_name(card_info);
+        const char *card_id = snd_ctl_card_info_get_id(card_info);
+
+        if ((err = SoundIoListAlsaCard_add_one(&sia->scan_cards))) {
+            snd_ctl_close(handle);
+            soundio_destroy_devices_info(devices_info);
+            return err;
+        }
+        int scan_card = sia->scan_cards.length - 1;
+        snprintf(SoundIoListAlsaCard_ptr_at(&sia->scan_cards, scan_card)->id,
+                SOUNDIO_MAX_ALSA_CARD_ID_LEN, "%s", card_id);
+        SoundIoListAlsaCard_ptr_at(&sia->scan_cards, scan_card)->fingerprint =
+            card_fingerprint(handle, card_index, card_info, pcm_info);
 
         int device_index = -1;
         for (;;) {
@@ -708,17 +1065,16 @@ static int refresh_devices(struct SoundIoPrivate *si) {
 
                 const char *device_name = snd_pcm_info_get_name(pcm_info);
 
-                struct SoundIoDevicePrivate *dev = ALLOCATE(struct SoundIoDevicePrivate, 1);
+                struct SoundIoDevicePrivate *dev = soundio_device_create(devices_info);
                 if (!dev) {
                     snd_ctl_close(handle);
                     soundio_destroy_devices_info(devices_info);
                     return SoundIoErrorNoMem;
                 }
                 struct SoundIoDevice *device = &dev->pub;
-                device->ref_count = 1;
                 device->soundio = soundio;
-                device->id = soundio_alloc_sprintf(NULL, "hw:%d,%d", card_index, device_index);
-                device->name = soundio_alloc_sprintf(NULL, "%s %s", card_name, device_name);
+                device->id = soundio_device_sprintf(dev, "hw:%d,%d", card_index, device_index);
+                device->name = soundio_device_sprintf(dev, "%s %s", card_name, device_name);
                 device->is_raw = true;
 
                 if (!device->id || !device->name) {
@@ -738,10 +1094,9 @@ static int refresh_devices(struct SoundIoPrivate *si) {
                     device_list = &devices_info->input_devices;
                 }
 
-                snd_pcm_chmap_query_t **maps = snd_pcm_query_chmaps_from_hw(card_index, device_index, -1, stream);
-                device->probe_error = probe_device(device, maps);
-
-                if (SoundIoListDevicePtr_append(device_list, device)) {
+                if (add_probe_job(sia, device, card_id, card_index, device_index) ||
+                    SoundIoListDevicePtr_append(device_list, device))
+                {
                     soundio_device_unref(device);
                     soundio_destroy_devices_info(devices_info);
                     return SoundIoErrorNoMem;
@@ -755,24 +1110,29 @@ static int refresh_devices(struct SoundIoPrivate *si) {
         }
     }
 
-    soundio_os_mutex_lock(sia->mutex);
-    soundio_destroy_devices_info(sia->ready_devices_info);
-    sia->ready_devices_info = devices_info;
-    sia->have_devices_flag = true;
-    soundio_os_cond_signal(sia->cond, sia->mutex);
-    soundio->on_events_signal(soundio);
-    soundio_os_mutex_unlock(sia->mutex);
+    if (soundio->lazy_device_probing) {
+        for (int i = 0; i < sia->probe_jobs.length; i += 1) {
+            struct SoundIoAlsaProbeJob *job = SoundIoListAlsaProbeJob_ptr_at(&sia->probe_jobs, i);
+            ((struct SoundIoDevicePrivate *)job->device)->needs_probe = true;
+        }
+    } else if ((err = probe_devices(sia))) {
+        soundio_destroy_devices_info(devices_info);
+        return err;
+    }
+
+    // The cache is an optimization, so failing to write it is not an error.
+    // Lazily probed devices have nothing worth saving yet.
+    if (soundio->device_cache_path && !soundio->lazy_device_probing) {
+        soundio_device_cache_save(soundio->device_cache_path, SoundIoBackendAlsa,
+                system_fingerprint_from_cards(&sia->scan_cards), devices_info);
+    }
+
+    soundio_events_post_devices_info(si, devices_info);
     return 0;
 }
 
 static void shutdown_backend(struct SoundIoPrivate *si, int err) {
-    struct SoundIo *soundio = &si->pub;
-    struct SoundIoAlsa *sia = &si->backend_data.alsa;
-    soundio_os_mutex_lock(sia->mutex);
-    sia->shutdown_err = err;
-    soundio_os_cond_signal(sia->cond, sia->mutex);
-    soundio->on_events_signal(soundio);
-    soundio_os_mutex_unlock(sia->mutex);
+    soundio_events_post_error(si, err);
 }
 
 static bool copy_str(char *dest, const char *src, int buf_len) {
@@ -806,7 +1166,7 @@ static void device_thread_run(void *arg) {
     fds[0].fd = sia->notify_fd;
     fds[0].events = POLLIN;
 
-    fds[1].fd = sia->notify_pipe_fd[0];
+    fds[1].fd = soundio_os_event_fd(sia->scan_event);
     fds[1].events = POLLIN;
 
     int err;
@@ -898,25 +1258,9 @@ static void device_thread_run(void *arg) {
             }
         }
         if (fds[1].revents & POLLIN) {
+            // any number of rescan requests since the last scan take one
+            soundio_os_event_reset(sia->scan_event);
             got_rescan_event = true;
-            for (;;) {
-                ssize_t len = read(sia->notify_pipe_fd[0], buf, sizeof(buf));
-                if (len == -1) {
-                    assert(errno != EBADF);
-                    assert(errno != EFAULT);
-                    assert(errno != EINVAL);
-                    assert(errno != EIO);
-                    assert(errno != EISDIR);
-                    if (errno == EBADF || errno == EFAULT || errno == EINVAL ||
-                        errno == EIO || errno == EISDIR)
-                    {
-                        shutdown_backend(si, SoundIoErrorSystemResources);
-                        return;
-                    }
-                }
-                if (len <= 0)
-                    break;
-            }
         }
         if (got_rescan_event) {
             if ((err = refresh_devices(si))) {
@@ -927,60 +1271,10 @@ static void device_thread_run(void *arg) {
     }
 }
 
-static void my_flush_events(struct SoundIoPrivate *si, bool wait) {
-    struct SoundIo *soundio = &si->pub;
-    struct SoundIoAlsa *sia = &si->backend_data.alsa;
-
-    bool change = false;
-    bool cb_shutdown = false;
-    struct SoundIoDevicesInfo *old_devices_info = NULL;
-
-    soundio_os_mutex_lock(sia->mutex);
-
-    // block until have devices
-    while (wait || (!sia->have_devices_flag && !sia->shutdown_err)) {
-        soundio_os_cond_wait(sia->cond, sia->mutex);
-        wait = false;
-    }
-
-    if (sia->shutdown_err && !sia->emitted_shutdown_cb) {
-        sia->emitted_shutdown_cb = true;
-        cb_shutdown = true;
-    } else if (sia->ready_devices_info) {
-        old_devices_info = si->safe_devices_info;
-        si->safe_devices_info = sia->ready_devices_info;
-        sia->ready_devices_info = NULL;
-        change = true;
-    }
-
-    soundio_os_mutex_unlock(sia->mutex);
-
-    if (cb_shutdown)
-        soundio->on_backend_disconnect(soundio, sia->shutdown_err);
-    else if (change)
-        soundio->on_devices_change(soundio);
-
-    soundio_destroy_devices_info(old_devices_info);
-}
-
-static void flush_events_alsa(struct SoundIoPrivate *si) {
-    my_flush_events(si, false);
-}
-
-static void wait_events_alsa(struct SoundIoPrivate *si) {
-    my_flush_events(si, false);
-    my_flush_events(si, true);
-}
-
-static void wakeup_alsa(struct SoundIoPrivate *si) {
-    struct SoundIoAlsa *sia = &si->backend_data.alsa;
-    soundio_os_mutex_lock(sia->mutex);
-    soundio_os_cond_signal(sia->cond, sia->mutex);
-    soundio_os_mutex_unlock(sia->mutex);
-}
-
 static void force_device_scan_alsa(struct SoundIoPrivate *si) {
     struct SoundIoAlsa *sia = &si->backend_data.alsa;
+    // an explicit rescan probes everything again
+    SOUNDIO_ATOMIC_FLAG_CLEAR(sia->keep_probe_cache);
     wakeup_device_poll(sia);
 }
 
@@ -994,6 +1288,9 @@ static void outstream_destroy_alsa(struct SoundIoPrivate *si, struct SoundIoOutS
         osa->thread = NULL;
     }
 
+    soundio_os_event_destroy(osa->poll_exit_event);
+    osa->poll_exit_event = NULL;
+
     if (osa->handle) {
         snd_pcm_close(osa->handle);
         osa->handle = NULL;
@@ -1005,37 +1302,80 @@ static void outstream_destroy_alsa(struct SoundIoPrivate *si, struct SoundIoOutS
     free(osa->chmap);
     osa->chmap = NULL;
 
-    free(osa->sample_buffer);
+    soundio_os_free_pages(osa->sample_buffer, osa->sample_buffer_size);
     osa->sample_buffer = NULL;
 }
 
+// With a latency step in SoundIoOutStream::xrun_policy the policy sets the
+// watermark. Otherwise it grows by half after each underflow and decays by an
+// eighth after tsched_decay_seconds without one.
+static void tsched_policy_watermark(struct SoundIoOutStreamPrivate *os) {
+    struct SoundIoOutStreamAlsa *osa = &os->backend_data.alsa;
+    int watermark = ceil_dbl_to_int(os->xrun_tracker.latency * os->pub.sample_rate);
+    osa->tsched_watermark = soundio_int_min(watermark, osa->buffer_size_frames / 2);
+}
+
+static void tsched_raise_watermark(struct SoundIoOutStreamPrivate *os) {
+    struct SoundIoOutStreamAlsa *osa = &os->backend_data.alsa;
+    if (os->xrun_tracker.adaptive) {
+        soundio_outstream_xrun_policy_xrun(os, soundio_os_get_time());
+        tsched_policy_watermark(os);
+        return;
+    }
+    int max_watermark = osa->buffer_size_frames / 2;
+    osa->tsched_watermark = soundio_int_min(osa->tsched_watermark + osa->tsched_watermark / 2, max_watermark);
+    osa->tsched_adjust_time = soundio_os_get_time();
+}
+
+static void tsched_decay_watermark(struct SoundIoOutStreamPrivate *os) {
+    struct SoundIoOutStreamAlsa *osa = &os->backend_data.alsa;
+    if (os->xrun_tracker.adaptive) {
+        soundio_outstream_xrun_policy_tick(os, soundio_os_get_time());
+        tsched_policy_watermark(os);
+        return;
+    }
+    if (osa->tsched_watermark <= osa->tsched_min_watermark)
+        return;
+    double now = soundio_os_get_time();
+    if (now - osa->tsched_adjust_time < tsched_decay_seconds)
+        return;
+    osa->tsched_watermark = soundio_int_max(osa->tsched_watermark - osa->tsched_watermark / 8,
+            osa->tsched_min_watermark);
+    osa->tsched_adjust_time = now;
+}
+
 static int outstream_xrun_recovery(struct SoundIoOutStreamPrivate *os, int err) {
-    struct SoundIoOutStream *outstream = &os->pub;
     struct SoundIoOutStreamAlsa *osa = &os->backend_data.alsa;
     if (err == -EPIPE) {
+        if (osa->tsched)
+            tsched_raise_watermark(os);
         err = snd_pcm_prepare(osa->handle);
-        if (err >= 0)
-            outstream->underflow_callback(outstream);
+        if (err >= 0) {
+            osa->xrun_prefill = true;
+            soundio_outstream_run_underflow_callback(os);
+        }
     } else if (err == -ESTRPIPE) {
         while ((err = snd_pcm_resume(osa->handle)) == -EAGAIN) {
             // wait until suspend flag is released
             poll(NULL, 0, 1);
         }
-        if (err < 0)
+        if (err < 0) {
             err = snd_pcm_prepare(osa->handle);
+            if (err >= 0)
+                osa->xrun_prefill = true;
+        }
         if (err >= 0)
-            outstream->underflow_callback(outstream);
+            soundio_outstream_run_underflow_callback(os);
     }
     return err;
 }
 
 static int instream_xrun_recovery(struct SoundIoInStreamPrivate *is, int err) {
-    struct SoundIoInStream *instream = &is->pub;
     struct SoundIoInStreamAlsa *isa = &is->backend_data.alsa;
     if (err == -EPIPE) {
         err = snd_pcm_prepare(isa->handle);
         if (err >= 0)
-            instream->overflow_callback(instream);
+            soundio_instream_run_overflow_callback(is);
     } else if (err == -ESTRPIPE) {
         while ((err = snd_pcm_resume(isa->handle)) == -EAGAIN) {
             // wait until suspend flag is released
@@ -1044,7 +1384,7 @@ static int instream_xrun_recovery(struct SoundIoInStreamPrivate *is, int err) {
         if (err < 0)
             err = snd_pcm_prepare(isa->handle);
         if (err >= 0)
-            instream->overflow_callback(instream);
+            soundio_instream_run_overflow_callback(is);
     }
     return err;
 }
@@ -1072,6 +1412,83 @@ static int outstream_wait_for_poll(struct SoundIoOutStreamPrivate *os) {
     }
 }
 
+// Asks for the hardware pointer to be timestamped in the clock of
+// soundio_os_get_time. The timestamps are optional, so this only returns
+// whether the PCM will give them.
+static bool enable_htimestamps(snd_pcm_t *handle, snd_pcm_sw_params_t *swparams) {
+#if SND_LIB_VERSION >= 0x01001d
+    if (snd_pcm_sw_params_set_tstamp_mode(handle, swparams, SND_PCM_TSTAMP_ENABLE) < 0)
+        return false;
+    return snd_pcm_sw_params_set_tstamp_type(handle, swparams, SND_PCM_TSTAMP_TYPE_MONOTONIC) >= 0;
+#else
+    return false;
+#endif
+}
+
+// Reads when the hardware pointer was where the last snd_pcm_avail or
+// snd_pcm_avail_update found it, and how many frames were available then.
+static bool get_htimestamp(snd_pcm_t *handle, double *out_time, snd_pcm_uframes_t *out_avail) {
+    snd_htimestamp_t tstamp;
+    if (snd_pcm_htimestamp(handle, out_avail, &tstamp) < 0)
+        return false;
+    // drivers which cannot timestamp leave it zero
+    if (tstamp.tv_sec == 0 && tstamp.tv_nsec == 0)
+        return false;
+    *out_time = (double)tstamp.tv_sec + tstamp.tv_nsec / 1000000000.0;
+    return true;
+}
+
+static void outstream_report_htimestamp(struct SoundIoOutStreamPrivate *os) {
+    struct SoundIoOutStream *outstream = &os->pub;
+    struct SoundIoOutStreamAlsa *osa = &os->backend_data.alsa;
+    double time;
+    snd_pcm_uframes_t avail;
+    if (!osa->htimestamps || !get_htimestamp(osa->handle, &time, &avail))
+        return;
+    double fill = (double)osa->buffer_size_frames - (double)avail;
+    soundio_outstream_report_timestamp(os, time, fill / outstream->sample_rate);
+}
+
+static void instream_report_htimestamp(struct SoundIoInStreamPrivate *is) {
+    struct SoundIoInStream *instream = &is->pub;
+    struct SoundIoInStreamAlsa *isa = &is->backend_data.alsa;
+    double time;
+    snd_pcm_uframes_t avail;
+    if (!isa->htimestamps || !get_htimestamp(isa->handle, &time, &avail))
+        return;
+    soundio_instream_report_timestamp(is, time, avail / (double)instream->sample_rate);
+}
+
+// Sleeps until half of the watermark is left in the buffer. Only the exit
+// pipe is polled; ALSA period interrupts are ignored.
+static int outstream_wait_for_timer(struct SoundIoOutStreamPrivate *os) {
+    struct SoundIoOutStream *outstream = &os->pub;
+    struct SoundIoOutStreamAlsa *osa = &os->backend_data.alsa;
+
+    int frames_until_wake = osa->tsched_watermark / 2;
+    if (snd_pcm_state(osa->handle) == SND_PCM_STATE_RUNNING) {
+        snd_pcm_sframes_t avail = snd_pcm_avail(osa->handle);
+        if (avail < 0)
+            return 0; // the caller sees the same error and recovers
+        int fill = (int)osa->buffer_size_frames - (int)avail;
+        frames_until_wake = fill - osa->tsched_watermark / 2;
+        if (frames_until_wake <= 0)
+            return 0;
+    }
+
+    double seconds = frames_until_wake / (double)outstream->sample_rate;
+    struct timespec timeout;
+    timeout.tv_sec = (time_t)seconds;
+    timeout.tv_nsec = (long)((seconds - (double)timeout.tv_sec) * 1000000000.0);
+
+    struct pollfd *exit_fd = &osa->poll_fds[osa->poll_fd_count];
+    if (ppoll(exit_fd, 1, &timeout, NULL) < 0 && errno != EINTR)
+        return SoundIoErrorStreaming;
+    if (!SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(osa->thread_exit_flag))
+        return SoundIoErrorInterrupted;
+    return 0;
+}
+
 static int instream_wait_for_poll(struct SoundIoInStreamPrivate *is) {
     struct SoundIoInStreamAlsa *isa = &is->backend_data.alsa;
     int err;
@@ -1093,8 +1510,57 @@ static int instream_wait_for_poll(struct SoundIoInStreamPrivate *is) {
     }
 }
 
-static void outstream_thread_run(void *arg) {
-    struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate *) arg;
+// Reads the input of a synchronous duplex stream on the output's thread,
+// right before the output is written. The capture device is started here
+// too, so that both devices start together without being linked. Returns a
+// negative error code when the capture device cannot be recovered.
+static int outstream_capture_duplex(struct SoundIoInStreamPrivate *is) {
+    struct SoundIoInStreamAlsa *isa = &is->backend_data.alsa;
+    int err;
+    switch (snd_pcm_state(isa->handle)) {
+        case SND_PCM_STATE_SETUP:
+            if ((err = snd_pcm_prepare(isa->handle)) < 0)
+                return err;
+            return snd_pcm_start(isa->handle);
+        case SND_PCM_STATE_PREPARED:
+            return snd_pcm_start(isa->handle);
+        case SND_PCM_STATE_RUNNING:
+        {
+            // no capture interrupt woke this thread, so sync the pointer
+            snd_pcm_sframes_t avail = snd_pcm_avail(isa->handle);
+            if (avail < 0) {
+                if ((err = instream_xrun_recovery(is, avail)) < 0)
+                    return err;
+                return snd_pcm_start(isa->handle);
+            }
+            if (avail > 0) {
+                instream_report_htimestamp(is);
+                soundio_instream_run_read_callback(is, 0, avail);
+            }
+            return 0;
+        }
+        case SND_PCM_STATE_PAUSED:
+            return 0;
+        case SND_PCM_STATE_XRUN:
+            if ((err = instream_xrun_recovery(is, -EPIPE)) < 0)
+                return err;
+            return snd_pcm_start(isa->handle);
+        case SND_PCM_STATE_SUSPENDED:
+            if ((err = instream_xrun_recovery(is, -ESTRPIPE)) < 0)
+                return err;
+            return snd_pcm_start(isa->handle);
+        default:
+            return -EBADFD;
+    }
+}
+
+// Runs the stream until it has to wait for the device. The stream thread
+// passes NULL for ready and waits itself, so this only returns once the stream
+// stops. In poll mode ready says whether the descriptors have signalled; the
+// stream must not block then, so this returns 0 as soon as it would have to
+// wait. Errors have been reported to the error callback by the time they are
+// returned.
+static int outstream_run(struct SoundIoOutStreamPrivate *os, bool *ready) {
     struct SoundIoOutStream *outstream = &os->pub;
     struct SoundIoOutStreamAlsa *osa = &os->backend_data.alsa;
 
@@ -1107,7 +1573,7 @@ static void outstream_thread_run(void *arg) {
             {
                 if ((err = snd_pcm_prepare(osa->handle)) < 0) {
                     outstream->error_callback(outstream, SoundIoErrorStreaming);
-                    return;
+                    return SoundIoErrorStreaming;
                 }
                 continue;
             }
@@ -1116,37 +1582,63 @@ static void outstream_thread_run(void *arg) {
                 snd_pcm_sframes_t avail = snd_pcm_avail(osa->handle);
                 if (avail < 0) {
                     outstream->error_callback(outstream, SoundIoErrorStreaming);
-                    return;
+                    return SoundIoErrorStreaming;
                 }
 
                 if ((snd_pcm_uframes_t)avail == osa->buffer_size_frames) {
-                    outstream->write_callback(outstream, 0, avail);
+                    // with timer scheduling only the watermark is queued
+                    // before starting, not the whole buffer
+                    if (osa->tsched)
+                        avail = osa->tsched_watermark;
+                    // after an underflow only SoundIoXrunPolicy::prefill,
+                    // so that the device plays again sooner
+                    double prefill = outstream->xrun_policy.prefill;
+                    if (osa->xrun_prefill && prefill > 0.0) {
+                        int prefill_frames = ceil_dbl_to_int(prefill * outstream->sample_rate);
+                        avail = soundio_int_min(avail, prefill_frames);
+                    }
+                    soundio_outstream_run_write_callback(os, 0, avail);
                     if (!SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(osa->thread_exit_flag))
-                        return;
+                        return SoundIoErrorInterrupted;
                     continue;
                 }
 
+                // the buffer is filled by now; a stream group may want the
+                // device to start a moment later
+                soundio_os_sleep_until(os->start_deadline);
+                if (os->duplex_input && (err = outstream_capture_duplex(os->duplex_input)) < 0) {
+                    os->duplex_input->pub.error_callback(&os->duplex_input->pub, SoundIoErrorStreaming);
+                    return SoundIoErrorStreaming;
+                }
+                osa->xrun_prefill = false;
                 if ((err = snd_pcm_start(osa->handle)) < 0) {
                     outstream->error_callback(outstream, SoundIoErrorStreaming);
-                    return;
+                    return SoundIoErrorStreaming;
                 }
                 continue;
             }
             case SND_PCM_STATE_RUNNING:
             case SND_PCM_STATE_PAUSED:
             {
-                if ((err = outstream_wait_for_poll(os))) {
-                    if (err == SoundIoErrorInterrupted)
-                        return;
-                    outstream->error_callback(outstream, err);
-                    return;
+                if (ready) {
+                    if (!*ready)
+                        return 0;
+                    *ready = false;
+                } else {
+                    err = osa->tsched ? outstream_wait_for_timer(os) : outstream_wait_for_poll(os);
+                    if (err) {
+                        if (err == SoundIoErrorInterrupted)
+                            return SoundIoErrorInterrupted;
+                        outstream->error_callback(outstream, err);
+                        return err;
+                    }
                 }
                 if (!SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(osa->thread_exit_flag))
-                    return;
+                    return SoundIoErrorInterrupted;
                 if (!SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(osa->clear_buffer_flag)) {
                     if ((err = snd_pcm_drop(osa->handle)) < 0) {
                         outstream->error_callback(outstream, SoundIoErrorStreaming);
-                        return;
+                        return SoundIoErrorStreaming;
                     }
                     if ((err = snd_pcm_reset(osa->handle)) < 0) {
                         if (err == -EBADFD) {
@@ -1155,50 +1647,73 @@ static void outstream_thread_run(void *arg) {
                             // did not work.
                         } else {
                             outstream->error_callback(outstream, SoundIoErrorStreaming);
-                            return;
+                            return SoundIoErrorStreaming;
                         }
                     }
                     continue;
                 }
 
-                snd_pcm_sframes_t avail = snd_pcm_avail_update(osa->handle);
+                // With timer scheduling the hardware pointer must be synced
+                // because no interrupt has updated it.
+                snd_pcm_sframes_t avail = osa->tsched ?
+                    snd_pcm_avail(osa->handle) : snd_pcm_avail_update(osa->handle);
                 if (avail < 0) {
                     if ((err = outstream_xrun_recovery(os, avail)) < 0) {
                         outstream->error_callback(outstream, SoundIoErrorStreaming);
-                        return;
+                        return SoundIoErrorStreaming;
                     }
                     continue;
                 }
 
-                if (avail > 0)
-                    outstream->write_callback(outstream, 0, avail);
+                if (osa->tsched) {
+                    if (state == SND_PCM_STATE_PAUSED)
+                        continue;
+                    tsched_decay_watermark(os);
+                    // refill up to the watermark rather than the whole buffer
+                    int fill = (int)osa->buffer_size_frames - (int)avail;
+                    avail = soundio_int_max(0, osa->tsched_watermark - fill);
+                }
+
+                if (os->duplex_input && (err = outstream_capture_duplex(os->duplex_input)) < 0) {
+                    os->duplex_input->pub.error_callback(&os->duplex_input->pub, SoundIoErrorStreaming);
+                    return SoundIoErrorStreaming;
+                }
+                if (avail > 0) {
+                    outstream_report_htimestamp(os);
+                    soundio_outstream_run_write_callback(os, 0, avail);
+                }
                 continue;
             }
             case SND_PCM_STATE_XRUN:
                 if ((err = outstream_xrun_recovery(os, -EPIPE)) < 0) {
                     outstream->error_callback(outstream, SoundIoErrorStreaming);
-                    return;
+                    return SoundIoErrorStreaming;
                 }
                 continue;
             case SND_PCM_STATE_SUSPENDED:
                 if ((err = outstream_xrun_recovery(os, -ESTRPIPE)) < 0) {
                     outstream->error_callback(outstream, SoundIoErrorStreaming);
-                    return;
+                    return SoundIoErrorStreaming;
                 }
                 continue;
             case SND_PCM_STATE_OPEN:
             case SND_PCM_STATE_DRAINING:
             case SND_PCM_STATE_DISCONNECTED:
                 outstream->error_callback(outstream, SoundIoErrorStreaming);
-                return;
+                return SoundIoErrorStreaming;
             default:
                 continue;
         }
     }
 }
 
-static void instream_thread_run(void *arg) {
-    struct SoundIoInStreamPrivate *is = (struct SoundIoInStreamPrivate *) arg;
+static void outstream_thread_run(void *arg) {
+    struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate *) arg;
+    outstream_run(os, NULL);
+}
+
+// Like outstream_run, for capture.
+static int instream_run(struct SoundIoInStreamPrivate *is, bool *ready) {
     struct SoundIoInStream *instream = &is->pub;
     struct SoundIoInStreamAlsa *isa = &is->backend_data.alsa;
 
@@ -1210,64 +1725,76 @@ static void instream_thread_run(void *arg) {
             case SND_PCM_STATE_SETUP:
                 if ((err = snd_pcm_prepare(isa->handle)) < 0) {
                     instream->error_callback(instream, SoundIoErrorStreaming);
-                    return;
+                    return SoundIoErrorStreaming;
                 }
                 continue;
             case SND_PCM_STATE_PREPARED:
+                soundio_os_sleep_until(is->start_deadline);
                 if ((err = snd_pcm_start(isa->handle)) < 0) {
                     instream->error_callback(instream, SoundIoErrorStreaming);
-                    return;
+                    return SoundIoErrorStreaming;
                 }
                 continue;
             case SND_PCM_STATE_RUNNING:
             case SND_PCM_STATE_PAUSED:
             {
-                if ((err = instream_wait_for_poll(is)) < 0) {
+                if (ready) {
+                    if (!*ready)
+                        return 0;
+                    *ready = false;
+                } else if ((err = instream_wait_for_poll(is)) < 0) {
                     if (!SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(isa->thread_exit_flag))
-                        return;
+                        return SoundIoErrorInterrupted;
                     instream->error_callback(instream, SoundIoErrorStreaming);
-                    return;
+                    return SoundIoErrorStreaming;
                 }
                 if (!SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(isa->thread_exit_flag))
-                    return;
+                    return SoundIoErrorInterrupted;
 
                 snd_pcm_sframes_t avail = snd_pcm_avail_update(isa->handle);
 
                 if (avail < 0) {
                     if ((err = instream_xrun_recovery(is, avail)) < 0) {
                         instream->error_callback(instream, SoundIoErrorStreaming);
-                        return;
+                        return SoundIoErrorStreaming;
                     }
                     continue;
                 }
 
-                if (avail > 0)
-                    instream->read_callback(instream, 0, avail);
+                if (avail > 0) {
+                    instream_report_htimestamp(is);
+                    soundio_instream_run_read_callback(is, 0, avail);
+                }
                 continue;
             }
             case SND_PCM_STATE_XRUN:
                 if ((err = instream_xrun_recovery(is, -EPIPE)) < 0) {
                     instream->error_callback(instream, SoundIoErrorStreaming);
-                    return;
+                    return SoundIoErrorStreaming;
                 }
                 continue;
             case SND_PCM_STATE_SUSPENDED:
                 if ((err = instream_xrun_recovery(is, -ESTRPIPE)) < 0) {
                     instream->error_callback(instream, SoundIoErrorStreaming);
-                    return;
+                    return SoundIoErrorStreaming;
                 }
                 continue;
             case SND_PCM_STATE_OPEN:
             case SND_PCM_STATE_DRAINING:
             case SND_PCM_STATE_DISCONNECTED:
                 instream->error_callback(instream, SoundIoErrorStreaming);
-                return;
+                return SoundIoErrorStreaming;
             default:
                 continue;
         }
     }
 }
 
+static void instream_thread_run(void *arg) {
+    struct SoundIoInStreamPrivate *is = (struct SoundIoInStreamPrivate *) arg;
+    instream_run(is, NULL);
+}
+
 static int outstream_open_alsa(struct SoundIoPrivate *si, struct SoundIoOutStreamPrivate *os) {
     struct SoundIoOutStreamAlsa *osa = &os->backend_data.alsa;
     struct SoundIoOutStream *outstream = &os->pub;
@@ -1338,12 +1865,39 @@ static int outstream_open_alsa(struct SoundIoPrivate *si, struct SoundIoOutStrea
         return SoundIoErrorOpeningDevice;
     }
 
-    osa->buffer_size_frames = outstream->software_latency * outstream->sample_rate;
+    // the application's event loop waits on the period interrupts in poll mode
+    osa->tsched = outstream->timer_scheduling && !outstream->poll_mode;
+    if (osa->tsched) {
+        // The requested latency becomes the watermark, and the hardware
+        // buffer is made large so that the device interrupts rarely.
+        osa->tsched_min_watermark = ceil_dbl_to_int(outstream->software_latency * outstream->sample_rate);
+        double buffer_seconds = soundio_double_max(tsched_min_buffer_seconds,
+                tsched_buffer_watermark_ratio * outstream->software_latency);
+        // the watermark grows to at most half the buffer
+        buffer_seconds = soundio_double_max(buffer_seconds, 2.0 * outstream->xrun_policy.latency_max);
+        osa->buffer_size_frames = ceil_dbl_to_uframes(buffer_seconds * outstream->sample_rate);
+    } else {
+        osa->buffer_size_frames = outstream->software_latency * outstream->sample_rate;
+    }
     if ((err = snd_pcm_hw_params_set_buffer_size_near(osa->handle, hwparams, &osa->buffer_size_frames)) < 0) {
         outstream_destroy_alsa(si, os);
         return SoundIoErrorOpeningDevice;
     }
-    outstream->software_latency = ((double)osa->buffer_size_frames) / (double)outstream->sample_rate;
+    if (osa->tsched) {
+        // Two periods per buffer is the fewest interrupts most devices
+        // allow. It is only a preference; the thread does not rely on them.
+        unsigned int periods = 2;
+        snd_pcm_hw_params_set_periods_near(osa->handle, hwparams, &periods, NULL);
+
+        osa->tsched_min_watermark = soundio_int_min(osa->tsched_min_watermark, osa->buffer_size_frames / 2);
+        osa->tsched_watermark = osa->tsched_min_watermark;
+        osa->tsched_adjust_time = soundio_os_get_time();
+        outstream->software_latency = ((double)osa->tsched_watermark) / (double)outstream->sample_rate;
+        soundio_outstream_xrun_policy_start(os, outstream->software_latency,
+                (osa->buffer_size_frames / 2) / (double)outstream->sample_rate, osa->tsched_adjust_time);
+    } else {
+        outstream->software_latency = ((double)osa->buffer_size_frames) / (double)outstream->sample_rate;
+    }
 
     // write the hardware parameters to device
     if ((err = snd_pcm_hw_params(osa->handle, hwparams)) < 0) {
@@ -1384,19 +1938,33 @@ static int outstream_open_alsa(struct SoundIoPrivate *si, struct SoundIoOutStrea
         return SoundIoErrorOpeningDevice;
     }
 
+    osa->htimestamps = enable_htimestamps(osa->handle, swparams);
+
     // write the software parameters to device
     if ((err = snd_pcm_sw_params(osa->handle, swparams)) < 0) {
         outstream_destroy_alsa(si, os);
         return (err == -EINVAL) ? SoundIoErrorIncompatibleDevice : SoundIoErrorOpeningDevice;
     }
 
-    if (osa->access == SND_PCM_ACCESS_RW_INTERLEAVED || osa->access == SND_PCM_ACCESS_RW_NONINTERLEAVED) {
-        osa->sample_buffer_size = ch_count * osa->period_size * phys_bytes_per_sample;
-        osa->sample_buffer = ALLOCATE_NONZERO(char, osa->sample_buffer_size);
+    if (is_rw_access(osa->access)) {
+        // The device cannot be mapped, so snd_pcm_writei/writen copy from
+        // sample_buffer into the kernel after every write.
+        outstream->buffer_access = SoundIoBufferAccessCopy;
+        osa->sample_buffer_frames = osa->period_size;
+        osa->sample_buffer_size = ch_count * osa->sample_buffer_frames * phys_bytes_per_sample;
+        osa->sample_buffer = (char *)soundio_os_alloc_pages(osa->sample_buffer_size);
         if (!osa->sample_buffer) {
             outstream_destroy_alsa(si, os);
             return SoundIoErrorNoMem;
         }
+        if (si->pub.lock_memory &&
+            (err = soundio_os_lock_memory(osa->sample_buffer, osa->sample_buffer_size)))
+        {
+            outstream_destroy_alsa(si, os);
+            return err;
+        }
+    } else {
+        outstream->buffer_access = SoundIoBufferAccessDirect;
     }
 
     osa->poll_fd_count = snd_pcm_poll_descriptors_count(osa->handle);
@@ -1418,14 +1986,12 @@ static int outstream_open_alsa(struct SoundIoPrivate *si, struct SoundIoOutStrea
     }
 
     struct pollfd *extra_fd = &osa->poll_fds[osa->poll_fd_count];
-    if (pipe2(osa->poll_exit_pipe_fd, O_NONBLOCK)) {
-        assert(errno != EFAULT);
-        assert(errno != EINVAL);
-        assert(errno == EMFILE || errno == ENFILE);
+    osa->poll_exit_event = soundio_os_event_create();
+    if (!osa->poll_exit_event) {
         outstream_destroy_alsa(si, os);
         return SoundIoErrorSystemResources;
     }
-    extra_fd->fd = osa->poll_exit_pipe_fd[0];
+    extra_fd->fd = soundio_os_event_fd(osa->poll_exit_event);
     extra_fd->events = POLLIN;
 
     return 0;
@@ -1433,18 +1999,69 @@ static int outstream_open_alsa(struct SoundIoPrivate *si, struct SoundIoOutStrea
 
 static int outstream_start_alsa(struct SoundIoPrivate *si, struct SoundIoOutStreamPrivate *os) {
     struct SoundIoOutStreamAlsa *osa = &os->backend_data.alsa;
-    struct SoundIo *soundio = &si->pub;
 
     assert(!osa->thread);
 
     int err;
     SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(osa->thread_exit_flag);
-    if ((err = soundio_os_thread_create(outstream_thread_run, os, soundio->emit_rtprio_warning, &osa->thread)))
+    if (os->pub.poll_mode) {
+        osa->poll_started = true;
+        osa->poll_failed = false;
+        return 0;
+    }
+    if ((err = soundio_outstream_thread_create(os, outstream_thread_run,
+                    osa->period_size / (double)os->pub.sample_rate, &osa->thread)))
         return err;
 
     return 0;
 }
 
+// The exit pipe only wakes the stream thread and is left out.
+static int outstream_get_poll_descriptors_alsa(struct SoundIoPrivate *si, struct SoundIoOutStreamPrivate *os,
+        struct SoundIoPollDescriptor *descriptors, int *count)
+{
+    struct SoundIoOutStreamAlsa *osa = &os->backend_data.alsa;
+    if (!osa->handle)
+        return SoundIoErrorInvalid;
+    int n = soundio_int_min(*count, osa->poll_fd_count);
+    for (int i = 0; i < n; i += 1) {
+        descriptors[i].fd = osa->poll_fds[i].fd;
+        descriptors[i].events = osa->poll_fds[i].events;
+        descriptors[i].revents = 0;
+    }
+    *count = osa->poll_fd_count;
+    return 0;
+}
+
+static int outstream_process_alsa(struct SoundIoPrivate *si, struct SoundIoOutStreamPrivate *os,
+        const struct SoundIoPollDescriptor *descriptors, int count)
+{
+    struct SoundIoOutStreamAlsa *osa = &os->backend_data.alsa;
+    if (!osa->poll_started || count != osa->poll_fd_count)
+        return SoundIoErrorInvalid;
+    if (osa->poll_failed)
+        return SoundIoErrorStreaming;
+
+    for (int i = 0; i < count; i += 1)
+        osa->poll_fds[i].revents = descriptors[i].revents;
+    unsigned short revents = 0;
+    if (count > 0 && snd_pcm_poll_descriptors_revents(osa->handle,
+                osa->poll_fds, osa->poll_fd_count, &revents) < 0)
+    {
+        osa->poll_failed = true;
+        os->pub.error_callback(&os->pub, SoundIoErrorStreaming);
+        return SoundIoErrorStreaming;
+    }
+    bool ready = (revents & (POLLOUT|POLLERR|POLLNVAL|POLLHUP)) != 0;
+
+    int err;
+    if ((err = outstream_run(os, &ready))) {
+        osa->poll_failed = true;
+        return SoundIoErrorStreaming;
+    }
+    return 0;
+}
+
 static int outstream_begin_write_alsa(struct SoundIoPrivate *si, struct SoundIoOutStreamPrivate *os,
         struct SoundIoChannelArea **out_areas, int *frame_count)
 {
@@ -1458,15 +2075,15 @@ static int outstream_begin_write_alsa(struct SoundIoPrivate *si, struct SoundIoO
             osa->areas[ch].step = outstream->bytes_per_frame;
         }
 
-        osa->write_frame_count = soundio_int_min(*frame_count, osa->period_size);
+        osa->write_frame_count = soundio_int_min(*frame_count, osa->sample_buffer_frames);
         *frame_count = osa->write_frame_count;
     } else if (osa->access == SND_PCM_ACCESS_RW_NONINTERLEAVED) {
         for (int ch = 0; ch < outstream->layout.channel_count; ch += 1) {
-            osa->areas[ch].ptr = osa->sample_buffer + ch * outstream->bytes_per_sample * osa->period_size;
+            osa->areas[ch].ptr = osa->sample_buffer + ch * outstream->bytes_per_sample * osa->sample_buffer_frames;
             osa->areas[ch].step = outstream->bytes_per_sample;
         }
 
-        osa->write_frame_count = soundio_int_min(*frame_count, osa->period_size);
+        osa->write_frame_count = soundio_int_min(*frame_count, osa->sample_buffer_frames);
         *frame_count = osa->write_frame_count;
     } else {
         const snd_pcm_channel_area_t *areas;
@@ -1506,7 +2123,7 @@ static int outstream_end_write_alsa(struct SoundIoPrivate *si, struct SoundIoOut
     } else if (osa->access == SND_PCM_ACCESS_RW_NONINTERLEAVED) {
         char *ptrs[SOUNDIO_MAX_CHANNELS];
         for (int ch = 0; ch < outstream->layout.channel_count; ch += 1) {
-            ptrs[ch] = osa->sample_buffer + ch * outstream->bytes_per_sample * osa->period_size;
+            ptrs[ch] = osa->sample_buffer + ch * outstream->bytes_per_sample * osa->sample_buffer_frames;
         }
         commitres = snd_pcm_writen(osa->handle, (void**)ptrs, osa->write_frame_count);
     } else {
@@ -1588,7 +2205,7 @@ static void instream_destroy_alsa(struct SoundIoPrivate *si, struct SoundIoInStr
     free(isa->chmap);
     isa->chmap = NULL;
 
-    free(isa->sample_buffer);
+    soundio_os_free_pages(isa->sample_buffer, isa->sample_buffer_size);
     isa->sample_buffer = NULL;
 }
 
@@ -1698,19 +2315,33 @@ static int instream_open_alsa(struct SoundIoPrivate *si, struct SoundIoInStreamP
         return SoundIoErrorOpeningDevice;
     }
 
+    isa->htimestamps = enable_htimestamps(isa->handle, swparams);
+
     // write the software parameters to device
     if ((err = snd_pcm_sw_params(isa->handle, swparams)) < 0) {
         instream_destroy_alsa(si, is);
         return (err == -EINVAL) ? SoundIoErrorIncompatibleDevice : SoundIoErrorOpeningDevice;
     }
 
-    if (isa->access == SND_PCM_ACCESS_RW_INTERLEAVED || isa->access == SND_PCM_ACCESS_RW_NONINTERLEAVED) {
-        isa->sample_buffer_size = ch_count * isa->period_size * phys_bytes_per_sample;
-        isa->sample_buffer = ALLOCATE_NONZERO(char, isa->sample_buffer_size);
+    if (is_rw_access(isa->access)) {
+        // The device cannot be mapped, so snd_pcm_readi/readn copy into
+        // sample_buffer before every read.
+        instream->buffer_access = SoundIoBufferAccessCopy;
+        isa->sample_buffer_frames = isa->period_size;
+        isa->sample_buffer_size = ch_count * isa->sample_buffer_frames * phys_bytes_per_sample;
+        isa->sample_buffer = (char *)soundio_os_alloc_pages(isa->sample_buffer_size);
         if (!isa->sample_buffer) {
             instream_destroy_alsa(si, is);
             return SoundIoErrorNoMem;
         }
+        if (si->pub.lock_memory &&
+            (err = soundio_os_lock_memory(isa->sample_buffer, isa->sample_buffer_size)))
+        {
+            instream_destroy_alsa(si, is);
+            return err;
+        }
+    } else {
+        instream->buffer_access = SoundIoBufferAccessDirect;
     }
 
     isa->poll_fd_count = snd_pcm_poll_descriptors_count(isa->handle);
@@ -1735,13 +2366,22 @@ static int instream_open_alsa(struct SoundIoPrivate *si, struct SoundIoInStreamP
 
 static int instream_start_alsa(struct SoundIoPrivate *si, struct SoundIoInStreamPrivate *is) {
     struct SoundIoInStreamAlsa *isa = &is->backend_data.alsa;
-    struct SoundIo *soundio = &si->pub;
 
     assert(!isa->thread);
 
+    // the output's thread reads and starts the input of a duplex stream
+    if (is->duplex_output)
+        return 0;
+
     SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(isa->thread_exit_flag);
+    if (is->pub.poll_mode) {
+        isa->poll_started = true;
+        isa->poll_failed = false;
+        return 0;
+    }
     int err;
-    if ((err = soundio_os_thread_create(instream_thread_run, is, soundio->emit_rtprio_warning, &isa->thread))) {
+    if ((err = soundio_instream_thread_create(is, instream_thread_run,
+                    isa->period_size / (double)is->pub.sample_rate, &isa->thread))) {
         instream_destroy_alsa(si, is);
         return err;
     }
@@ -1749,6 +2389,55 @@ static int instream_start_alsa(struct SoundIoPrivate *si, struct SoundIoInStream
     return 0;
 }
 
+static int instream_get_poll_descriptors_alsa(struct SoundIoPrivate *si, struct SoundIoInStreamPrivate *is,
+        struct SoundIoPollDescriptor *descriptors, int *count)
+{
+    struct SoundIoInStreamAlsa *isa = &is->backend_data.alsa;
+    if (!isa->handle)
+        return SoundIoErrorInvalid;
+    // the output drives the input of a duplex stream
+    int total = is->duplex_output ? 0 : isa->poll_fd_count;
+    int n = soundio_int_min(*count, total);
+    for (int i = 0; i < n; i += 1) {
+        descriptors[i].fd = isa->poll_fds[i].fd;
+        descriptors[i].events = isa->poll_fds[i].events;
+        descriptors[i].revents = 0;
+    }
+    *count = total;
+    return 0;
+}
+
+static int instream_process_alsa(struct SoundIoPrivate *si, struct SoundIoInStreamPrivate *is,
+        const struct SoundIoPollDescriptor *descriptors, int count)
+{
+    struct SoundIoInStreamAlsa *isa = &is->backend_data.alsa;
+    if (is->duplex_output)
+        return 0;
+    if (!isa->poll_started || count != isa->poll_fd_count)
+        return SoundIoErrorInvalid;
+    if (isa->poll_failed)
+        return SoundIoErrorStreaming;
+
+    for (int i = 0; i < count; i += 1)
+        isa->poll_fds[i].revents = descriptors[i].revents;
+    unsigned short revents = 0;
+    if (count > 0 && snd_pcm_poll_descriptors_revents(isa->handle,
+                isa->poll_fds, isa->poll_fd_count, &revents) < 0)
+    {
+        isa->poll_failed = true;
+        is->pub.error_callback(&is->pub, SoundIoErrorStreaming);
+        return SoundIoErrorStreaming;
+    }
+    bool ready = (revents & (POLLIN|POLLERR|POLLNVAL|POLLHUP)) != 0;
+
+    int err;
+    if ((err = instream_run(is, &ready))) {
+        isa->poll_failed = true;
+        return SoundIoErrorStreaming;
+    }
+    return 0;
+}
+
 static int instream_begin_read_alsa(struct SoundIoPrivate *si,
         struct SoundIoInStreamPrivate *is, struct SoundIoChannelArea **out_areas, int *frame_count)
 {
@@ -1762,7 +2451,7 @@ static int instream_begin_read_alsa(struct SoundIoPrivate *si,
             isa->areas[ch].step = instream->bytes_per_frame;
         }
 
-        isa->read_frame_count = soundio_int_min(*frame_count, isa->period_size);
+        isa->read_frame_count = soundio_int_min(*frame_count, isa->sample_buffer_frames);
         *frame_count = isa->read_frame_count;
 
         snd_pcm_sframes_t commitres = snd_pcm_readi(isa->handle, isa->sample_buffer, isa->read_frame_count);
@@ -1774,12 +2463,12 @@ static int instream_begin_read_alsa(struct SoundIoPrivate *si,
     } else if (isa->access == SND_PCM_ACCESS_RW_NONINTERLEAVED) {
         char *ptrs[SOUNDIO_MAX_CHANNELS];
         for (int ch = 0; ch < instream->layout.channel_count; ch += 1) {
-            isa->areas[ch].ptr = isa->sample_buffer + ch * instream->bytes_per_sample * isa->period_size;
+            isa->areas[ch].ptr = isa->sample_buffer + ch * instream->bytes_per_sample * isa->sample_buffer_frames;
             isa->areas[ch].step = instream->bytes_per_sample;
             ptrs[ch] = isa->areas[ch].ptr;
         }
 
-        isa->read_frame_count = soundio_int_min(*frame_count, isa->period_size);
+        isa->read_frame_count = soundio_int_min(*frame_count, isa->sample_buffer_frames);
         *frame_count = isa->read_frame_count;
 
         snd_pcm_sframes_t commitres = snd_pcm_readn(isa->handle, (void**)ptrs, isa->read_frame_count);
@@ -1870,19 +2559,7 @@ int soundio_alsa_init(struct SoundIoPrivate *si) {
     sia->notify_fd = -1;
     sia->notify_wd = -1;
     SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(sia->abort_flag);
-
-    sia->mutex = soundio_os_mutex_create();
-    if (!sia->mutex) {
-        destroy_alsa(si);
-        return SoundIoErrorNoMem;
-    }
-
-    sia->cond = soundio_os_cond_create();
-    if (!sia->cond) {
-        destroy_alsa(si);
-        return SoundIoErrorNoMem;
-    }
-
+    SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(sia->keep_probe_cache);
 
     // set up inotify to watch /dev/snd for devices added or removed
     sia->notify_fd = inotify_init1(IN_NONBLOCK);
@@ -1917,25 +2594,37 @@ int soundio_alsa_init(struct SoundIoPrivate *si) {
         }
     }
 
-    if (pipe2(sia->notify_pipe_fd, O_NONBLOCK)) {
-        assert(errno != EFAULT);
-        assert(errno != EINVAL);
-        assert(errno == EMFILE || errno == ENFILE);
+    sia->scan_event = soundio_os_event_create();
+    if (!sia->scan_event) {
+        destroy_alsa(si);
         return SoundIoErrorSystemResources;
     }
 
+    // Start with the devices of the previous run if nothing changed since.
+    // The device thread scans anyway and replaces them.
+    uint64_t fingerprint;
+    if (si->pub.device_cache_path && !system_fingerprint(&fingerprint)) {
+        struct SoundIoDevicesInfo *devices_info = soundio_device_cache_load(&si->pub,
+                si->pub.device_cache_path, SoundIoBackendAlsa, fingerprint);
+        if (devices_info)
+            soundio_events_post_devices_info(si, devices_info);
+    }
+
     wakeup_device_poll(sia);
 
-    if ((err = soundio_os_thread_create(device_thread_run, si, NULL, &sia->thread))) {
+    if ((err = soundio_os_thread_create(device_thread_run, si, NULL, false, NULL, &sia->thread))) {
         destroy_alsa(si);
         return err;
     }
 
     si->destroy = destroy_alsa;
-    si->flush_events = flush_events_alsa;
-    si->wait_events = wait_events_alsa;
-    si->wakeup = wakeup_alsa;
+    si->flush_events = soundio_events_flush;
+    si->wait_events = soundio_events_wait;
+    si->wakeup = soundio_events_wakeup;
     si->force_device_scan = force_device_scan_alsa;
+    si->device_probe = device_probe_alsa;
+    si->waits_for_start_deadline = true;
+    si->drives_duplex_input = true;
 
     si->outstream_open = outstream_open_alsa;
     si->outstream_destroy = outstream_destroy_alsa;
@@ -1945,6 +2634,8 @@ int soundio_alsa_init(struct SoundIoPrivate *si) {
     si->outstream_clear_buffer = outstream_clear_buffer_alsa;
     si->outstream_pause = outstream_pause_alsa;
     si->outstream_get_latency = outstream_get_latency_alsa;
+    si->outstream_get_poll_descriptors = outstream_get_poll_descriptors_alsa;
+    si->outstream_process = outstream_process_alsa;
 
     si->instream_open = instream_open_alsa;
     si->instream_destroy = instream_destroy_alsa;
@@ -1953,6 +2644,8 @@ int soundio_alsa_init(struct SoundIoPrivate *si) {
     si->instream_end_read = instream_end_read_alsa;
     si->instream_pause = instream_pause_alsa;
     si->instream_get_latency = instream_get_latency_alsa;
+    si->instream_get_poll_descriptors = instream_get_poll_descriptors_alsa;
+    si->instream_process = instream_process_alsa;
 
     return 0;
 }
@@ -14,11 +14,17 @@
 #include "atomics.h"
 
 #include <alsa/asoundlib.h>
+#include <stdint.h>
 
 struct SoundIoPrivate;
 int soundio_alsa_init(struct SoundIoPrivate *si);
 
-struct SoundIoDeviceAlsa { int make_the_struct_not_empty; };
+struct SoundIoDeviceAlsa {
+    // Card and device number of hw PCMs, used to query their channel maps.
+    // -1 for other PCMs.
+    int hw_card;
+    int hw_device;
+};
 
 #define SOUNDIO_MAX_ALSA_SND_FILE_LEN 16
 struct SoundIoAlsaPendingFile {
@@ -27,23 +33,58 @@ struct SoundIoAlsaPendingFile {
 
 SOUNDIO_MAKE_LIST_STRUCT(struct SoundIoAlsaPendingFile, SoundIoListAlsaPendingFile, SOUNDIO_LIST_STATIC)
 
-struct SoundIoAlsa {
-    struct SoundIoOsMutex *mutex;
-    struct SoundIoOsCond *cond;
+#define SOUNDIO_MAX_ALSA_CARD_ID_LEN 32
+#define SOUNDIO_MAX_ALSA_PROBE_THREADS 4
+
+// A sound card seen during a device scan. The fingerprint changes when
+// the card's identity or its set of PCMs changes.
+struct SoundIoAlsaCard {
+    char id[SOUNDIO_MAX_ALSA_CARD_ID_LEN];
+    uint64_t fingerprint;
+};
+
+SOUNDIO_MAKE_LIST_STRUCT(struct SoundIoAlsaCard, SoundIoListAlsaCard, SOUNDIO_LIST_STATIC)
+
+struct SoundIoAlsaProbeJob {
+    struct SoundIoDevice *device;
+    // Empty if the PCM does not belong to one card, like "default".
+    char card_id[SOUNDIO_MAX_ALSA_CARD_ID_LEN];
+    // Index into SoundIoAlsa::scan_cards, or -1.
+    int scan_card;
+    // Card and device numbers for hw devices, otherwise -1.
+    int hw_card;
+    int hw_device;
+    bool needs_probe;
+};
 
+SOUNDIO_MAKE_LIST_STRUCT(struct SoundIoAlsaProbeJob, SoundIoListAlsaProbeJob, SOUNDIO_LIST_STATIC)
+
+struct SoundIoAlsaProbeCacheEntry {
+    char card_id[SOUNDIO_MAX_ALSA_CARD_ID_LEN];
+    uint64_t fingerprint;
+    // Owned by the cache. Only the id, aim, is_raw and probe results are set.
+    struct SoundIoDevice *device;
+};
+
+SOUNDIO_MAKE_LIST_STRUCT(struct SoundIoAlsaProbeCacheEntry, SoundIoListAlsaProbeCacheEntry, SOUNDIO_LIST_STATIC)
+
+struct SoundIoAlsa {
     struct SoundIoOsThread *thread;
     struct SoundIoAtomicFlag abort_flag;
     int notify_fd;
     int notify_wd;
-    bool have_devices_flag;
-    int notify_pipe_fd[2];
+    // Wakes the device thread to scan again, or to exit.
+    struct SoundIoOsEvent *scan_event;
     struct SoundIoListAlsaPendingFile pending_files;
 
-    // this one is ready to be read with flush_events. protected by mutex
-    struct SoundIoDevicesInfo *ready_devices_info;
-
-    int shutdown_err;
-    bool emitted_shutdown_cb;
+    // The rest is only used by the device thread during refresh_devices.
+    struct SoundIoListAlsaCard scan_cards;
+    struct SoundIoListAlsaProbeJob probe_jobs;
+    struct SoundIoAtomicInt probe_next_card;
+    // Probe results of the previous scan, reused for unchanged cards.
+    struct SoundIoListAlsaProbeCacheEntry probe_cache;
+    // Cleared by force_device_scan to drop the cache.
+    struct SoundIoAtomicFlag keep_probe_cache;
 };
 
 struct SoundIoOutStreamAlsa {
@@ -53,19 +94,37 @@ struct SoundIoOutStreamAlsa {
     snd_pcm_uframes_t offset;
     snd_pcm_access_t access;
     snd_pcm_uframes_t buffer_size_frames;
+    // RW access only. Frames per channel in sample_buffer, one period.
+    int sample_buffer_frames;
     int sample_buffer_size;
     char *sample_buffer;
     int poll_fd_count;
     int poll_fd_count_with_extra;
     struct pollfd *poll_fds;
-    int poll_exit_pipe_fd[2];
+    struct SoundIoOsEvent *poll_exit_event;
     struct SoundIoOsThread *thread;
     struct SoundIoAtomicFlag thread_exit_flag;
     snd_pcm_uframes_t period_size;
     int write_frame_count;
     bool is_paused;
+    // Poll mode: started without a thread, or stopped by an error which the
+    // error callback has already reported.
+    bool poll_started;
+    bool poll_failed;
+    // The PCM was prepared again after an underflow, so only
+    // SoundIoXrunPolicy::prefill is written before it starts.
+    bool xrun_prefill;
+    // The PCM timestamps its pointer in CLOCK_MONOTONIC.
+    bool htimestamps;
     struct SoundIoAtomicFlag clear_buffer_flag;
     struct SoundIoChannelArea areas[SOUNDIO_MAX_CHANNELS];
+
+    // Timer-based scheduling. The thread keeps tsched_watermark frames
+    // queued and wakes when half of them have played.
+    bool tsched;
+    int tsched_watermark;
+    int tsched_min_watermark;
+    double tsched_adjust_time;
 };
 
 struct SoundIoInStreamAlsa {
@@ -74,6 +133,8 @@ struct SoundIoInStreamAlsa {
     int chmap_size;
     snd_pcm_uframes_t offset;
     snd_pcm_access_t access;
+    // RW access only. Frames per channel in sample_buffer.
+    int sample_buffer_frames;
     int sample_buffer_size;
     char *sample_buffer;
     int poll_fd_count;
@@ -83,6 +144,9 @@ struct SoundIoInStreamAlsa {
     int period_size;
     int read_frame_count;
     bool is_paused;
+    bool poll_started;
+    bool poll_failed;
+    bool htimestamps;
     struct SoundIoChannelArea areas[SOUNDIO_MAX_CHANNELS];
 };
 
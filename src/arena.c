@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "arena.h"
+#include "atomics.h"
+#include "util.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Enough for any fundamental type.
+#define ARENA_ALIGNMENT 16
+
+struct SoundIoArenaBlock {
+    struct SoundIoArenaBlock *next;
+    size_t size;
+    size_t used;
+};
+
+struct SoundIoArena {
+    struct SoundIoAllocator allocator;
+    struct SoundIoAtomicInt ref_count;
+    // Guards blocks. Allocations are short and rarely contended, for
+    // example by the ALSA probe threads.
+    struct SoundIoAtomicFlag lock;
+    struct SoundIoArenaBlock *blocks;
+};
+
+static size_t align_up(size_t size) {
+    return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+static void *allocator_alloc(const struct SoundIoAllocator *allocator, size_t size) {
+    if (allocator->alloc)
+        return allocator->alloc(allocator->userdata, size);
+    return malloc(size);
+}
+
+static void allocator_free(const struct SoundIoAllocator *allocator, void *ptr, size_t size) {
+    if (allocator->free)
+        allocator->free(allocator->userdata, ptr, size);
+    else
+        free(ptr);
+}
+
+struct SoundIoArena *soundio_arena_create(const struct SoundIoAllocator *allocator) {
+    struct SoundIoAllocator default_allocator = {NULL, NULL, NULL};
+    if (!allocator || !allocator->alloc)
+        allocator = &default_allocator;
+
+    struct SoundIoArena *arena = (struct SoundIoArena *)allocator_alloc(allocator, sizeof(struct SoundIoArena));
+    if (!arena)
+        return NULL;
+    memset(arena, 0, sizeof(struct SoundIoArena));
+    arena->allocator = *allocator;
+    SOUNDIO_ATOMIC_STORE(arena->ref_count, 1);
+    SOUNDIO_ATOMIC_FLAG_CLEAR(arena->lock);
+    return arena;
+}
+
+void soundio_arena_ref(struct SoundIoArena *arena) {
+    SOUNDIO_ATOMIC_FETCH_ADD(arena->ref_count, 1);
+}
+
+void soundio_arena_unref(struct SoundIoArena *arena) {
+    if (!arena)
+        return;
+    int old_count = SOUNDIO_ATOMIC_FETCH_ADD(arena->ref_count, -1);
+    assert(old_count > 0);
+    if (old_count != 1)
+        return;
+
+    struct SoundIoArenaBlock *block = arena->blocks;
+    while (block) {
+        struct SoundIoArenaBlock *next = block->next;
+        allocator_free(&arena->allocator, block, block->size);
+        block = next;
+    }
+    struct SoundIoAllocator allocator = arena->allocator;
+    allocator_free(&allocator, arena, sizeof(struct SoundIoArena));
+}
+
+void *soundio_arena_alloc(struct SoundIoArena *arena, size_t size) {
+    size = align_up(size ? size : 1);
+    const size_t header_size = align_up(sizeof(struct SoundIoArenaBlock));
+
+    while (SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(arena->lock)) {}
+
+    struct SoundIoArenaBlock *block = arena->blocks;
+    if (!block || block->size - block->used < size) {
+        size_t block_size = header_size + size;
+        if (block_size < SOUNDIO_ARENA_BLOCK_SIZE)
+            block_size = SOUNDIO_ARENA_BLOCK_SIZE;
+        block = (struct SoundIoArenaBlock *)allocator_alloc(&arena->allocator, block_size);
+        if (!block) {
+            SOUNDIO_ATOMIC_FLAG_CLEAR(arena->lock);
+            return NULL;
+        }
+        block->size = block_size;
+        block->used = header_size;
+        // An oversized block goes behind the current one so that the space
+        // left in the current one can still be used.
+        if (arena->blocks && block_size > SOUNDIO_ARENA_BLOCK_SIZE) {
+            block->next = arena->blocks->next;
+            arena->blocks->next = block;
+        } else {
+            block->next = arena->blocks;
+            arena->blocks = block;
+        }
+    }
+    char *ptr = (char *)block + block->used;
+    block->used += size;
+
+    SOUNDIO_ATOMIC_FLAG_CLEAR(arena->lock);
+    memset(ptr, 0, size);
+    return ptr;
+}
@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#ifndef SOUNDIO_ARENA_H
+#define SOUNDIO_ARENA_H
+
+#include "soundio_internal.h"
+
+#include <stddef.h>
+
+// Allocations are carved out of blocks of at least this many bytes.
+#define SOUNDIO_ARENA_BLOCK_SIZE (16 * 1024)
+
+// A bump allocator whose memory is all released at once, when the last
+// reference is dropped. Allocating and releasing references are safe from
+// any thread.
+struct SoundIoArena;
+
+// `allocator` may be NULL, or have NULL callbacks, for malloc and free.
+// Returns NULL when out of memory. The arena starts with one reference.
+struct SoundIoArena *soundio_arena_create(const struct SoundIoAllocator *allocator);
+void soundio_arena_ref(struct SoundIoArena *arena);
+void soundio_arena_unref(struct SoundIoArena *arena);
+
+// Zero initialized and aligned for any type. Returns NULL when out of memory.
+void *soundio_arena_alloc(struct SoundIoArena *arena, size_t size);
+
+#endif
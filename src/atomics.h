@@ -14,6 +14,7 @@
 #ifdef __cplusplus
 
 #include <atomic>
+#include <cstdint>
 
 struct SoundIoAtomicLong {
     std::atomic<long> x;
@@ -35,6 +36,14 @@ struct SoundIoAtomicULong {
     std::atomic<unsigned long> x;
 };
 
+struct SoundIoAtomicUInt64 {
+    std::atomic<uint_least64_t> x;
+};
+
+struct SoundIoAtomicPtr {
+    std::atomic<void *> x;
+};
+
 #define SOUNDIO_ATOMIC_LOAD(a) (a.x.load())
 #define SOUNDIO_ATOMIC_FETCH_ADD(a, delta) (a.x.fetch_add(delta))
 #define SOUNDIO_ATOMIC_STORE(a, value) (a.x.store(value))
@@ -43,6 +52,17 @@ struct SoundIoAtomicULong {
 #define SOUNDIO_ATOMIC_FLAG_CLEAR(a) (a.x.clear())
 #define SOUNDIO_ATOMIC_FLAG_INIT ATOMIC_FLAG_INIT
 
+#define SOUNDIO_MEMORY_ORDER_RELAXED std::memory_order_relaxed
+#define SOUNDIO_MEMORY_ORDER_ACQUIRE std::memory_order_acquire
+#define SOUNDIO_MEMORY_ORDER_RELEASE std::memory_order_release
+#define SOUNDIO_MEMORY_ORDER_ACQ_REL std::memory_order_acq_rel
+
+#define SOUNDIO_ATOMIC_LOAD_EXPLICIT(a, order) (a.x.load(order))
+#define SOUNDIO_ATOMIC_STORE_EXPLICIT(a, value, order) (a.x.store(value, order))
+#define SOUNDIO_ATOMIC_COMPARE_EXCHANGE_WEAK_EXPLICIT(a, expected_ptr, desired, success, failure) \
+    (a.x.compare_exchange_weak(*(expected_ptr), desired, success, failure))
+#define SOUNDIO_ATOMIC_THREAD_FENCE(order) std::atomic_thread_fence(order)
+
 #else
 
 #include <stdatomic.h>
@@ -67,6 +87,14 @@ struct SoundIoAtomicULong {
     atomic_ulong x;
 };
 
+struct SoundIoAtomicUInt64 {
+    atomic_uint_least64_t x;
+};
+
+struct SoundIoAtomicPtr {
+    _Atomic(void *) x;
+};
+
 #define SOUNDIO_ATOMIC_LOAD(a) atomic_load(&a.x)
 #define SOUNDIO_ATOMIC_FETCH_ADD(a, delta) atomic_fetch_add(&a.x, delta)
 #define SOUNDIO_ATOMIC_STORE(a, value) atomic_store(&a.x, value)
@@ -75,6 +103,25 @@ struct SoundIoAtomicULong {
 #define SOUNDIO_ATOMIC_FLAG_CLEAR(a) atomic_flag_clear(&a.x)
 #define SOUNDIO_ATOMIC_FLAG_INIT ATOMIC_FLAG_INIT
 
+#define SOUNDIO_MEMORY_ORDER_RELAXED memory_order_relaxed
+#define SOUNDIO_MEMORY_ORDER_ACQUIRE memory_order_acquire
+#define SOUNDIO_MEMORY_ORDER_RELEASE memory_order_release
+#define SOUNDIO_MEMORY_ORDER_ACQ_REL memory_order_acq_rel
+
+#define SOUNDIO_ATOMIC_LOAD_EXPLICIT(a, order) atomic_load_explicit(&a.x, order)
+#define SOUNDIO_ATOMIC_STORE_EXPLICIT(a, value, order) atomic_store_explicit(&a.x, value, order)
+#define SOUNDIO_ATOMIC_COMPARE_EXCHANGE_WEAK_EXPLICIT(a, expected_ptr, desired, success, failure) \
+    atomic_compare_exchange_weak_explicit(&a.x, expected_ptr, desired, success, failure)
+#define SOUNDIO_ATOMIC_THREAD_FENCE(order) atomic_thread_fence(order)
+
+#endif
+
+// Used to keep values which are written by different threads on different
+// cache lines. Apple Silicon uses 128 byte lines.
+#if defined(__APPLE__) && defined(__aarch64__)
+#define SOUNDIO_CACHE_LINE_SIZE 128
+#else
+#define SOUNDIO_CACHE_LINE_SIZE 64
 #endif
 
 #endif
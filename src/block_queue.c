@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "block_queue.h"
+#include "soundio_private.h"
+#include "util.h"
+
+#include <stdlib.h>
+
+// The payload of a slot starts on the cache line after its header, so that
+// a producer filling one block does not share a line with the sequence
+// number of the next slot.
+static const int slot_header_size = SOUNDIO_CACHE_LINE_SIZE;
+
+static inline struct SoundIoBlockQueueSlot *get_slot(struct SoundIoBlockQueue *queue,
+        unsigned long pos)
+{
+    return (struct SoundIoBlockQueueSlot *)(queue->mem.address +
+            (pos & queue->slot_mask) * queue->slot_stride);
+}
+
+static inline char *slot_payload(struct SoundIoBlockQueueSlot *slot) {
+    return ((char *)slot) + slot_header_size;
+}
+
+static inline struct SoundIoBlockQueueSlot *payload_slot(char *block) {
+    return (struct SoundIoBlockQueueSlot *)(block - slot_header_size);
+}
+
+struct SoundIoBlockQueue *soundio_block_queue_create(struct SoundIo *soundio,
+        int block_capacity, int block_count)
+{
+    struct SoundIoBlockQueue *queue = ALLOCATE(struct SoundIoBlockQueue, 1);
+
+    assert(block_capacity > 0);
+    assert(block_count > 0);
+
+    if (!queue) {
+        soundio_block_queue_destroy(queue);
+        return NULL;
+    }
+
+    if (soundio_block_queue_init(queue, block_capacity, block_count)) {
+        soundio_block_queue_destroy(queue);
+        return NULL;
+    }
+
+    return queue;
+}
+
+void soundio_block_queue_destroy(struct SoundIoBlockQueue *queue) {
+    if (!queue)
+        return;
+
+    soundio_block_queue_deinit(queue);
+
+    free(queue);
+}
+
+int soundio_block_queue_block_capacity(struct SoundIoBlockQueue *queue) {
+    return queue->block_capacity;
+}
+
+int soundio_block_queue_block_count(struct SoundIoBlockQueue *queue) {
+    return queue->slot_count;
+}
+
+char *soundio_block_queue_begin_write(struct SoundIoBlockQueue *queue) {
+    unsigned long pos = SOUNDIO_ATOMIC_LOAD_EXPLICIT(queue->enqueue_pos, SOUNDIO_MEMORY_ORDER_RELAXED);
+    for (;;) {
+        struct SoundIoBlockQueueSlot *slot = get_slot(queue, pos);
+        unsigned long seq = SOUNDIO_ATOMIC_LOAD_EXPLICIT(slot->sequence, SOUNDIO_MEMORY_ORDER_ACQUIRE);
+        long diff = (long)(seq - pos);
+        if (diff == 0) {
+            if (SOUNDIO_ATOMIC_COMPARE_EXCHANGE_WEAK_EXPLICIT(queue->enqueue_pos, &pos, pos + 1,
+                        SOUNDIO_MEMORY_ORDER_RELAXED, SOUNDIO_MEMORY_ORDER_RELAXED))
+            {
+                slot->byte_count = 0;
+                return slot_payload(slot);
+            }
+            // pos was reloaded by the failed exchange
+        } else if (diff < 0) {
+            // The consumer has not released this slot yet; the queue is full.
+            return NULL;
+        } else {
+            // Another producer got this position first.
+            pos = SOUNDIO_ATOMIC_LOAD_EXPLICIT(queue->enqueue_pos, SOUNDIO_MEMORY_ORDER_RELAXED);
+        }
+    }
+}
+
+void soundio_block_queue_end_write(struct SoundIoBlockQueue *queue, char *block, int byte_count) {
+    assert(byte_count >= 0);
+    assert(byte_count <= queue->block_capacity);
+    struct SoundIoBlockQueueSlot *slot = payload_slot(block);
+    slot->byte_count = byte_count;
+    unsigned long pos = SOUNDIO_ATOMIC_LOAD_EXPLICIT(slot->sequence, SOUNDIO_MEMORY_ORDER_RELAXED);
+    SOUNDIO_ATOMIC_STORE_EXPLICIT(slot->sequence, pos + 1, SOUNDIO_MEMORY_ORDER_RELEASE);
+}
+
+char *soundio_block_queue_begin_read(struct SoundIoBlockQueue *queue, int *byte_count) {
+    unsigned long pos = SOUNDIO_ATOMIC_LOAD_EXPLICIT(queue->dequeue_pos, SOUNDIO_MEMORY_ORDER_RELAXED);
+    for (;;) {
+        struct SoundIoBlockQueueSlot *slot = get_slot(queue, pos);
+        unsigned long seq = SOUNDIO_ATOMIC_LOAD_EXPLICIT(slot->sequence, SOUNDIO_MEMORY_ORDER_ACQUIRE);
+        long diff = (long)(seq - (pos + 1));
+        if (diff == 0) {
+            if (SOUNDIO_ATOMIC_COMPARE_EXCHANGE_WEAK_EXPLICIT(queue->dequeue_pos, &pos, pos + 1,
+                        SOUNDIO_MEMORY_ORDER_RELAXED, SOUNDIO_MEMORY_ORDER_RELAXED))
+            {
+                *byte_count = slot->byte_count;
+                return slot_payload(slot);
+            }
+        } else if (diff < 0) {
+            // The next block has not been committed yet; the queue is empty.
+            *byte_count = 0;
+            return NULL;
+        } else {
+            pos = SOUNDIO_ATOMIC_LOAD_EXPLICIT(queue->dequeue_pos, SOUNDIO_MEMORY_ORDER_RELAXED);
+        }
+    }
+}
+
+void soundio_block_queue_end_read(struct SoundIoBlockQueue *queue, char *block) {
+    struct SoundIoBlockQueueSlot *slot = payload_slot(block);
+    // sequence is pos + 1 here; hand the slot to the producer which will
+    // reserve pos + slot_count.
+    unsigned long seq = SOUNDIO_ATOMIC_LOAD_EXPLICIT(slot->sequence, SOUNDIO_MEMORY_ORDER_RELAXED);
+    SOUNDIO_ATOMIC_STORE_EXPLICIT(slot->sequence, seq - 1 + queue->slot_count,
+            SOUNDIO_MEMORY_ORDER_RELEASE);
+}
+
+int soundio_block_queue_init(struct SoundIoBlockQueue *queue, int block_capacity, int block_count) {
+    int slot_count = 1;
+    while (slot_count < block_count)
+        slot_count *= 2;
+
+    int payload_size = ceil_dbl_to_int(block_capacity / (double)SOUNDIO_CACHE_LINE_SIZE) *
+        SOUNDIO_CACHE_LINE_SIZE;
+    queue->slot_stride = slot_header_size + payload_size;
+    queue->slot_count = slot_count;
+    queue->slot_mask = slot_count - 1;
+    queue->block_capacity = block_capacity;
+
+    int err;
+    if ((err = soundio_os_init_mirrored_memory(&queue->mem, (size_t)queue->slot_stride * slot_count)))
+        return err;
+
+    for (int i = 0; i < slot_count; i += 1) {
+        struct SoundIoBlockQueueSlot *slot = get_slot(queue, i);
+        SOUNDIO_ATOMIC_STORE(slot->sequence, i);
+        slot->byte_count = 0;
+    }
+    SOUNDIO_ATOMIC_STORE(queue->enqueue_pos, 0);
+    SOUNDIO_ATOMIC_STORE(queue->dequeue_pos, 0);
+
+    return 0;
+}
+
+void soundio_block_queue_deinit(struct SoundIoBlockQueue *queue) {
+    soundio_os_deinit_mirrored_memory(&queue->mem);
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#ifndef SOUNDIO_BLOCK_QUEUE_H
+#define SOUNDIO_BLOCK_QUEUE_H
+
+#include "os.h"
+#include "atomics.h"
+
+// Lives at the start of every slot, on its own cache line.
+struct SoundIoBlockQueueSlot {
+    // Equal to the position when the slot is free for the producer which
+    // reserves that position; position + 1 once the block is committed.
+    struct SoundIoAtomicULong sequence;
+    int byte_count;
+};
+
+struct SoundIoBlockQueue {
+    struct SoundIoOsMirroredMemory mem;
+    int block_capacity;
+    int slot_count;
+    unsigned long slot_mask;
+    int slot_stride;
+    char pad0[SOUNDIO_CACHE_LINE_SIZE];
+
+    struct SoundIoAtomicULong enqueue_pos;
+    char pad1[SOUNDIO_CACHE_LINE_SIZE];
+
+    struct SoundIoAtomicULong dequeue_pos;
+    char pad2[SOUNDIO_CACHE_LINE_SIZE];
+};
+
+int soundio_block_queue_init(struct SoundIoBlockQueue *queue, int block_capacity, int block_count);
+void soundio_block_queue_deinit(struct SoundIoBlockQueue *queue);
+
+#endif
@@ -0,0 +1,595 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "convert.h"
+#include "interleave.h"
+#include "os.h"
+#include "util.h"
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOUNDIO_CONVERT_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SOUNDIO_CONVERT_AVX2
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define SOUNDIO_CONVERT_NEON
+#include <arm_neon.h>
+#endif
+
+bool soundio_get_format_info(enum SoundIoFormat format, struct SoundIoFormatInfo *info) {
+    memset(info, 0, sizeof(struct SoundIoFormatInfo));
+    info->bytes = soundio_get_bytes_per_sample(format);
+    switch (format) {
+    case SoundIoFormatS8:
+        info->bits = 8; info->is_signed = true; info->is_native_endian = true;
+        return true;
+    case SoundIoFormatU8:
+        info->bits = 8; info->is_native_endian = true;
+        return true;
+    case SoundIoFormatS16NE:
+    case SoundIoFormatS16FE:
+        info->bits = 16; info->is_signed = true;
+        info->is_native_endian = (format == SoundIoFormatS16NE);
+        return true;
+    case SoundIoFormatU16NE:
+    case SoundIoFormatU16FE:
+        info->bits = 16;
+        info->is_native_endian = (format == SoundIoFormatU16NE);
+        return true;
+    case SoundIoFormatS24NE:
+    case SoundIoFormatS24FE:
+        info->bits = 24; info->is_signed = true;
+        info->is_native_endian = (format == SoundIoFormatS24NE);
+        return true;
+    case SoundIoFormatU24NE:
+    case SoundIoFormatU24FE:
+        info->bits = 24;
+        info->is_native_endian = (format == SoundIoFormatU24NE);
+        return true;
+    case SoundIoFormatS32NE:
+    case SoundIoFormatS32FE:
+        info->bits = 32; info->is_signed = true;
+        info->is_native_endian = (format == SoundIoFormatS32NE);
+        return true;
+    case SoundIoFormatU32NE:
+    case SoundIoFormatU32FE:
+        info->bits = 32;
+        info->is_native_endian = (format == SoundIoFormatU32NE);
+        return true;
+    case SoundIoFormatFloat32NE:
+    case SoundIoFormatFloat32FE:
+        info->is_float = true; info->is_signed = true;
+        info->is_native_endian = (format == SoundIoFormatFloat32NE);
+        return true;
+    case SoundIoFormatFloat64NE:
+    case SoundIoFormatFloat64FE:
+        info->is_float = true; info->is_signed = true;
+        info->is_native_endian = (format == SoundIoFormatFloat64NE);
+        return true;
+    case SoundIoFormatInvalid:
+        return false;
+    }
+    return false;
+}
+
+static inline uint16_t bswap16(uint16_t x) {
+    return (uint16_t)((x >> 8) | (x << 8));
+}
+
+static inline uint32_t bswap32(uint32_t x) {
+    return (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+}
+
+static inline uint64_t bswap64(uint64_t x) {
+    return ((uint64_t)bswap32((uint32_t)x) << 32) | bswap32((uint32_t)(x >> 32));
+}
+
+// Scalar kernels
+
+static void quantize_scalar(const float *src, int32_t *dest, int count,
+        float scale, float min_value, float max_value)
+{
+    for (int i = 0; i < count; i += 1) {
+        float x = src[i] * scale;
+        if (x < min_value)
+            x = min_value;
+        else if (x > max_value)
+            x = max_value;
+        dest[i] = (int32_t)(x + ((x >= 0.0f) ? 0.5f : -0.5f));
+    }
+}
+
+static void dequantize_scalar(const int32_t *src, float *dest, int count, float scale) {
+    for (int i = 0; i < count; i += 1)
+        dest[i] = (float)src[i] * scale;
+}
+
+#if defined(SOUNDIO_CONVERT_SSE2)
+static void quantize_sse2(const float *src, int32_t *dest, int count,
+        float scale, float min_value, float max_value)
+{
+    const __m128 vscale = _mm_set1_ps(scale);
+    const __m128 vmin = _mm_set1_ps(min_value);
+    const __m128 vmax = _mm_set1_ps(max_value);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 x = _mm_mul_ps(_mm_loadu_ps(src + i), vscale);
+        x = _mm_min_ps(_mm_max_ps(x, vmin), vmax);
+        _mm_storeu_si128((__m128i *)(dest + i), _mm_cvtps_epi32(x));
+    }
+    quantize_scalar(src + i, dest + i, count - i, scale, min_value, max_value);
+}
+
+static void dequantize_sse2(const int32_t *src, float *dest, int count, float scale) {
+    const __m128 vscale = _mm_set1_ps(scale);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_ps(dest + i, _mm_mul_ps(_mm_cvtepi32_ps(x), vscale));
+    }
+    dequantize_scalar(src + i, dest + i, count - i, scale);
+}
+#endif
+
+#if defined(SOUNDIO_CONVERT_AVX2)
+__attribute__((target("avx2")))
+static void quantize_avx2(const float *src, int32_t *dest, int count,
+        float scale, float min_value, float max_value)
+{
+    const __m256 vscale = _mm256_set1_ps(scale);
+    const __m256 vmin = _mm256_set1_ps(min_value);
+    const __m256 vmax = _mm256_set1_ps(max_value);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 x = _mm256_mul_ps(_mm256_loadu_ps(src + i), vscale);
+        x = _mm256_min_ps(_mm256_max_ps(x, vmin), vmax);
+        _mm256_storeu_si256((__m256i *)(dest + i), _mm256_cvtps_epi32(x));
+    }
+    quantize_scalar(src + i, dest + i, count - i, scale, min_value, max_value);
+}
+
+__attribute__((target("avx2")))
+static void dequantize_avx2(const int32_t *src, float *dest, int count, float scale) {
+    const __m256 vscale = _mm256_set1_ps(scale);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_storeu_ps(dest + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x), vscale));
+    }
+    dequantize_scalar(src + i, dest + i, count - i, scale);
+}
+#endif
+
+#if defined(SOUNDIO_CONVERT_NEON)
+static void quantize_neon(const float *src, int32_t *dest, int count,
+        float scale, float min_value, float max_value)
+{
+    const float32x4_t vmin = vdupq_n_f32(min_value);
+    const float32x4_t vmax = vdupq_n_f32(max_value);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t x = vmulq_n_f32(vld1q_f32(src + i), scale);
+        x = vminq_f32(vmaxq_f32(x, vmin), vmax);
+        vst1q_s32(dest + i, vcvtnq_s32_f32(x));
+    }
+    quantize_scalar(src + i, dest + i, count - i, scale, min_value, max_value);
+}
+
+static void dequantize_neon(const int32_t *src, float *dest, int count, float scale) {
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+        vst1q_f32(dest + i, vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(src + i)), scale));
+    dequantize_scalar(src + i, dest + i, count - i, scale);
+}
+#endif
+
+static void select_kernels(struct SoundIoConverter *converter) {
+    converter->kernel_name = "scalar";
+    converter->quantize = quantize_scalar;
+    converter->dequantize = dequantize_scalar;
+#if defined(SOUNDIO_CONVERT_SSE2)
+    converter->kernel_name = "sse2";
+    converter->quantize = quantize_sse2;
+    converter->dequantize = dequantize_sse2;
+#endif
+#if defined(SOUNDIO_CONVERT_AVX2)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        converter->kernel_name = "avx2";
+        converter->quantize = quantize_avx2;
+        converter->dequantize = dequantize_avx2;
+    }
+#endif
+#if defined(SOUNDIO_CONVERT_NEON)
+    converter->kernel_name = "neon";
+    converter->quantize = quantize_neon;
+    converter->dequantize = dequantize_neon;
+#endif
+}
+
+// Integer packing. Values in int32 are in the range of the format's bit
+// depth, signed.
+
+static void unpack_int(const char *src, int step, int32_t *dest, int count,
+        const struct SoundIoFormatInfo *info)
+{
+    const int shift = 32 - info->bits;
+    const uint32_t offset = (uint32_t)1 << (info->bits - 1);
+    for (int i = 0; i < count; i += 1, src += step) {
+        uint32_t u;
+        if (info->bytes == 1) {
+            u = *(const uint8_t *)src;
+        } else if (info->bytes == 2) {
+            uint16_t x;
+            memcpy(&x, src, 2);
+            u = info->is_native_endian ? x : bswap16(x);
+        } else {
+            uint32_t x;
+            memcpy(&x, src, 4);
+            u = info->is_native_endian ? x : bswap32(x);
+        }
+        if (!info->is_signed)
+            u -= offset;
+        // sign extend from the significant bits
+        dest[i] = ((int32_t)(u << shift)) >> shift;
+    }
+}
+
+static void pack_int(const int32_t *src, char *dest, int step, int count,
+        const struct SoundIoFormatInfo *info)
+{
+    const uint32_t offset = (uint32_t)1 << (info->bits - 1);
+    const uint32_t mask = (info->bits == 32) ? 0xffffffff : ((uint32_t)1 << info->bits) - 1;
+    for (int i = 0; i < count; i += 1, dest += step) {
+        uint32_t u = (uint32_t)src[i];
+        if (!info->is_signed)
+            u = (u + offset) & mask;
+        if (info->bytes == 1) {
+            *(uint8_t *)dest = (uint8_t)u;
+        } else if (info->bytes == 2) {
+            uint16_t x = info->is_native_endian ? (uint16_t)u : bswap16((uint16_t)u);
+            memcpy(dest, &x, 2);
+        } else {
+            uint32_t x = info->is_native_endian ? u : bswap32(u);
+            memcpy(dest, &x, 4);
+        }
+    }
+}
+
+static void get_int_range(int bits, float *scale, float *min_value, float *max_value) {
+    double full_scale = (double)((uint32_t)1 << (bits - 1));
+    *scale = (float)full_scale;
+    *min_value = (float)-full_scale;
+    // 2^31 - 1 is not representable as float, so take the largest float
+    // below it.
+    *max_value = (bits == 32) ? 2147483520.0f : (float)(full_scale - 1.0);
+}
+
+static inline float random_unit(uint32_t *state) {
+    // xorshift32
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+// Returns a pointer to `count` float32 native endian samples which are
+// stored at `src` or in converter->float_buf.
+static const float *load_float(struct SoundIoConverter *converter,
+        const char *src, int step, int count)
+{
+    const struct SoundIoFormatInfo *info = &converter->src_info;
+    float *buf = converter->float_buf;
+    if (!info->is_float) {
+        float scale, min_value, max_value;
+        get_int_range(info->bits, &scale, &min_value, &max_value);
+        unpack_int(src, step, converter->int_buf, count, info);
+        converter->dequantize(converter->int_buf, buf, count, 1.0f / scale);
+        return buf;
+    }
+    if (info->bytes == 4) {
+        if (info->is_native_endian && step == 4)
+            return (const float *)src;
+        for (int i = 0; i < count; i += 1, src += step) {
+            uint32_t x;
+            memcpy(&x, src, 4);
+            if (!info->is_native_endian)
+                x = bswap32(x);
+            memcpy(&buf[i], &x, 4);
+        }
+        return buf;
+    }
+    for (int i = 0; i < count; i += 1, src += step) {
+        uint64_t x;
+        double d;
+        memcpy(&x, src, 8);
+        if (!info->is_native_endian)
+            x = bswap64(x);
+        memcpy(&d, &x, 8);
+        buf[i] = (float)d;
+    }
+    return buf;
+}
+
+static void store_float(struct SoundIoConverter *converter,
+        const float *src, char *dest, int step, int count)
+{
+    const struct SoundIoFormatInfo *info = &converter->dest_info;
+    if (!info->is_float) {
+        float scale, min_value, max_value;
+        get_int_range(info->bits, &scale, &min_value, &max_value);
+        if (converter->flags & SoundIoConvertFlagDither) {
+            // triangular probability density function dither of 1 LSB
+            float *buf = converter->float_buf;
+            float lsb = 1.0f / scale;
+            for (int i = 0; i < count; i += 1) {
+                float r = random_unit(&converter->dither_state) - random_unit(&converter->dither_state);
+                buf[i] = src[i] + r * lsb;
+            }
+            src = buf;
+        }
+        converter->quantize(src, converter->int_buf, count, scale, min_value, max_value);
+        pack_int(converter->int_buf, dest, step, count, info);
+        return;
+    }
+    if (info->bytes == 4) {
+        if (info->is_native_endian && step == 4) {
+            memcpy(dest, src, count * 4);
+            return;
+        }
+        for (int i = 0; i < count; i += 1, dest += step) {
+            uint32_t x;
+            memcpy(&x, &src[i], 4);
+            if (!info->is_native_endian)
+                x = bswap32(x);
+            memcpy(dest, &x, 4);
+        }
+        return;
+    }
+    for (int i = 0; i < count; i += 1, dest += step) {
+        double d = src[i];
+        uint64_t x;
+        memcpy(&x, &d, 8);
+        if (!info->is_native_endian)
+            x = bswap64(x);
+        memcpy(dest, &x, 8);
+    }
+}
+
+static void copy_samples(const char *src, int src_step, char *dest, int dest_step,
+        int count, int bytes)
+{
+    if (src_step == bytes && dest_step == bytes) {
+        memcpy(dest, src, count * bytes);
+        return;
+    }
+    for (int i = 0; i < count; i += 1, src += src_step, dest += dest_step)
+        memcpy(dest, src, bytes);
+}
+
+static void swap_samples64(const char *src, int src_step, char *dest, int dest_step, int count) {
+    for (int i = 0; i < count; i += 1, src += src_step, dest += dest_step) {
+        uint64_t x;
+        memcpy(&x, src, 8);
+        x = bswap64(x);
+        memcpy(dest, &x, 8);
+    }
+}
+
+// Integer to integer conversion is done by shifting, which is exact and
+// does not lose the low bits of 32-bit formats through a float.
+static void convert_int_to_int(struct SoundIoConverter *converter,
+        const char *src, int src_step, char *dest, int dest_step, int count)
+{
+    const struct SoundIoFormatInfo *src_info = &converter->src_info;
+    const struct SoundIoFormatInfo *dest_info = &converter->dest_info;
+    int32_t *buf = converter->int_buf;
+    unpack_int(src, src_step, buf, count, src_info);
+    int shift = dest_info->bits - src_info->bits;
+    if (shift > 0) {
+        for (int i = 0; i < count; i += 1)
+            buf[i] = (int32_t)((uint32_t)buf[i] << shift);
+    } else if (shift < 0) {
+        for (int i = 0; i < count; i += 1)
+            buf[i] >>= -shift;
+    }
+    pack_int(buf, dest, dest_step, count, dest_info);
+}
+
+void soundio_converter_convert_channel(struct SoundIoConverter *converter,
+        const char *src, int src_step, char *dest, int dest_step, int count)
+{
+    const struct SoundIoFormatInfo *src_info = &converter->src_info;
+    const struct SoundIoFormatInfo *dest_info = &converter->dest_info;
+
+    if (converter->src_format == converter->dest_format) {
+        copy_samples(src, src_step, dest, dest_step, count, src_info->bytes);
+        return;
+    }
+    if (src_info->is_float && dest_info->is_float && src_info->bytes == 8 && dest_info->bytes == 8) {
+        swap_samples64(src, src_step, dest, dest_step, count);
+        return;
+    }
+
+    while (count > 0) {
+        int chunk = soundio_int_min(count, SOUNDIO_CONVERT_CHUNK_SIZE);
+        if (!src_info->is_float && !dest_info->is_float &&
+            !(converter->flags & SoundIoConvertFlagDither && dest_info->bits < src_info->bits))
+        {
+            convert_int_to_int(converter, src, src_step, dest, dest_step, chunk);
+        } else {
+            const float *samples = load_float(converter, src, src_step, chunk);
+            store_float(converter, samples, dest, dest_step, chunk);
+        }
+        src += src_step * chunk;
+        dest += dest_step * chunk;
+        count -= chunk;
+    }
+}
+
+struct SoundIoConverter *soundio_converter_create(enum SoundIoFormat src_format,
+        enum SoundIoFormat dest_format, int flags)
+{
+    struct SoundIoFormatInfo src_info;
+    struct SoundIoFormatInfo dest_info;
+    if (!soundio_get_format_info(src_format, &src_info))
+        return NULL;
+    if (!soundio_get_format_info(dest_format, &dest_info))
+        return NULL;
+
+    // pages of its own, so that it can be locked when it runs on a
+    // real-time thread
+    struct SoundIoConverter *converter = soundio_os_alloc_pages(sizeof(struct SoundIoConverter));
+    if (!converter)
+        return NULL;
+
+    converter->src_format = src_format;
+    converter->dest_format = dest_format;
+    converter->src_info = src_info;
+    converter->dest_info = dest_info;
+    converter->flags = flags;
+    converter->dither_state = 0x9e3779b9;
+    select_kernels(converter);
+
+    return converter;
+}
+
+void soundio_converter_destroy(struct SoundIoConverter *converter) {
+    soundio_os_free_pages(converter, sizeof(struct SoundIoConverter));
+}
+
+int soundio_converter_lock_memory(struct SoundIoConverter *converter) {
+    return soundio_os_lock_memory(converter, sizeof(struct SoundIoConverter));
+}
+
+void soundio_converter_unlock_memory(struct SoundIoConverter *converter) {
+    soundio_os_unlock_memory(converter, sizeof(struct SoundIoConverter));
+}
+
+const char *soundio_converter_kernel_name(struct SoundIoConverter *converter) {
+    return converter->kernel_name;
+}
+
+static bool areas_are_planar(const struct SoundIoChannelArea *areas, int channel_count, int bytes) {
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        if (areas[ch].step != bytes)
+            return false;
+    }
+    return true;
+}
+
+// Returns how many channels wide the frames are when the areas are
+// consecutive channels of one interleaved buffer, which may have more
+// channels than the areas; otherwise 0.
+static int interleaved_frame_channel_count(const struct SoundIoChannelArea *areas,
+        int channel_count, int bytes)
+{
+    int step = areas[0].step;
+    if (step % bytes || step / bytes < channel_count)
+        return 0;
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        if (areas[ch].step != step || areas[ch].ptr != areas[0].ptr + ch * bytes)
+            return 0;
+    }
+    return step / bytes;
+}
+
+static void convert_interleave(struct SoundIoConverter *converter,
+        const struct SoundIoChannelArea *src_areas, const struct SoundIoChannelArea *dest_areas,
+        int channel_count, int frame_channel_count, int frame_count)
+{
+    const int src_bytes = converter->src_info.bytes;
+    const int dest_bytes = converter->dest_info.bytes;
+    const bool same_format = (converter->src_format == converter->dest_format);
+    const char *planar[SOUNDIO_CONVERT_MAX_PLANAR_CHANNELS];
+    char *dest = dest_areas[0].ptr;
+
+    for (int offset = 0; offset < frame_count; offset += SOUNDIO_CONVERT_CHUNK_SIZE) {
+        int chunk = soundio_int_min(frame_count - offset, SOUNDIO_CONVERT_CHUNK_SIZE);
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            const char *src = src_areas[ch].ptr + offset * src_bytes;
+            if (same_format) {
+                planar[ch] = src;
+            } else {
+                char *buf = converter->planar_buf + ch * SOUNDIO_CONVERT_CHUNK_SIZE * dest_bytes;
+                soundio_converter_convert_channel(converter, src, src_bytes, buf, dest_bytes, chunk);
+                planar[ch] = buf;
+            }
+        }
+        soundio_interleave(planar, dest + offset * dest_areas[0].step,
+                channel_count, frame_channel_count, dest_bytes, chunk);
+    }
+}
+
+static void convert_deinterleave(struct SoundIoConverter *converter,
+        const struct SoundIoChannelArea *src_areas, const struct SoundIoChannelArea *dest_areas,
+        int channel_count, int frame_channel_count, int frame_count)
+{
+    const int src_bytes = converter->src_info.bytes;
+    const int dest_bytes = converter->dest_info.bytes;
+    const bool same_format = (converter->src_format == converter->dest_format);
+    char *planar[SOUNDIO_CONVERT_MAX_PLANAR_CHANNELS];
+    const char *src = src_areas[0].ptr;
+
+    for (int offset = 0; offset < frame_count; offset += SOUNDIO_CONVERT_CHUNK_SIZE) {
+        int chunk = soundio_int_min(frame_count - offset, SOUNDIO_CONVERT_CHUNK_SIZE);
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            if (same_format)
+                planar[ch] = dest_areas[ch].ptr + offset * dest_bytes;
+            else
+                planar[ch] = converter->planar_buf + ch * SOUNDIO_CONVERT_CHUNK_SIZE * src_bytes;
+        }
+        soundio_deinterleave(src + offset * src_areas[0].step, planar,
+                channel_count, frame_channel_count, src_bytes, chunk);
+        if (same_format)
+            continue;
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            soundio_converter_convert_channel(converter, planar[ch], src_bytes,
+                    dest_areas[ch].ptr + offset * dest_bytes, dest_bytes, chunk);
+        }
+    }
+}
+
+void soundio_converter_convert(struct SoundIoConverter *converter,
+        const struct SoundIoChannelArea *src_areas, const struct SoundIoChannelArea *dest_areas,
+        int channel_count, int frame_count)
+{
+    const int src_bytes = converter->src_info.bytes;
+    const int dest_bytes = converter->dest_info.bytes;
+
+    if (channel_count > 1 && channel_count <= SOUNDIO_CONVERT_MAX_PLANAR_CHANNELS) {
+        int frame_channel_count;
+        if (areas_are_planar(src_areas, channel_count, src_bytes) &&
+            (frame_channel_count = interleaved_frame_channel_count(dest_areas, channel_count, dest_bytes)))
+        {
+            convert_interleave(converter, src_areas, dest_areas, channel_count,
+                    frame_channel_count, frame_count);
+            return;
+        }
+        if ((frame_channel_count = interleaved_frame_channel_count(src_areas, channel_count, src_bytes)) &&
+            areas_are_planar(dest_areas, channel_count, dest_bytes))
+        {
+            convert_deinterleave(converter, src_areas, dest_areas, channel_count,
+                    frame_channel_count, frame_count);
+            return;
+        }
+    }
+
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        soundio_converter_convert_channel(converter, src_areas[ch].ptr, src_areas[ch].step,
+                dest_areas[ch].ptr, dest_areas[ch].step, frame_count);
+    }
+}
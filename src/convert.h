@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#ifndef SOUNDIO_CONVERT_H
+#define SOUNDIO_CONVERT_H
+
+#include "soundio_internal.h"
+
+#include <stdint.h>
+
+// Samples are converted in chunks of this many samples per channel, through
+// a float32 intermediate buffer.
+#define SOUNDIO_CONVERT_CHUNK_SIZE 256
+
+// Planar <-> interleaved conversions of up to this many channels transpose
+// through SoundIoConverter::planar_buf instead of striding one channel at a
+// time.
+#define SOUNDIO_CONVERT_MAX_PLANAR_CHANNELS 8
+
+struct SoundIoFormatInfo {
+    int bytes;
+    // Significant bits for integer formats. 0 for float formats.
+    int bits;
+    bool is_float;
+    bool is_signed;
+    bool is_native_endian;
+};
+
+// float -> int32, with scaling, clamping, and rounding to nearest.
+typedef void (*SoundIoQuantizeFn)(const float *src, int32_t *dest, int count,
+        float scale, float min_value, float max_value);
+// int32 -> float, with scaling.
+typedef void (*SoundIoDequantizeFn)(const int32_t *src, float *dest, int count, float scale);
+
+struct SoundIoConverter {
+    enum SoundIoFormat src_format;
+    enum SoundIoFormat dest_format;
+    struct SoundIoFormatInfo src_info;
+    struct SoundIoFormatInfo dest_info;
+    int flags;
+    const char *kernel_name;
+    SoundIoQuantizeFn quantize;
+    SoundIoDequantizeFn dequantize;
+    uint32_t dither_state;
+
+    float float_buf[SOUNDIO_CONVERT_CHUNK_SIZE];
+    int32_t int_buf[SOUNDIO_CONVERT_CHUNK_SIZE];
+    // Large enough for one chunk of every channel in the widest format.
+    char planar_buf[SOUNDIO_CONVERT_MAX_PLANAR_CHANNELS * SOUNDIO_CONVERT_CHUNK_SIZE * 8];
+};
+
+bool soundio_get_format_info(enum SoundIoFormat format, struct SoundIoFormatInfo *info);
+
+// Converts `count` samples of one channel. Used by the area converters and
+// by other modules which work on one channel at a time.
+void soundio_converter_convert_channel(struct SoundIoConverter *converter,
+        const char *src, int src_step, char *dest, int dest_step, int count);
+
+// A converter has pages of its own, so these lock and unlock nothing else.
+int soundio_converter_lock_memory(struct SoundIoConverter *converter);
+void soundio_converter_unlock_memory(struct SoundIoConverter *converter);
+
+#endif
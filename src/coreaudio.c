@@ -9,6 +9,7 @@
 #include "soundio_private.h"
 
 #include <assert.h>
+#include <stddef.h>
 
 #include "AvailabilityMacros.h"
 #ifndef MAC_OS_VERSION_12_0
@@ -110,7 +111,7 @@ static OSStatus on_devices_changed(AudioObjectID in_object_id, UInt32 in_number_
     struct SoundIoCoreAudio *sica = &si->backend_data.coreaudio;
 
     SOUNDIO_ATOMIC_STORE(sica->device_scan_queued, true);
-    soundio_os_cond_signal(sica->scan_devices_cond, NULL);
+    soundio_os_event_signal(sica->scan_event);
 
     return noErr;
 }
@@ -122,7 +123,7 @@ static OSStatus on_service_restarted(AudioObjectID in_object_id, UInt32 in_numbe
     struct SoundIoCoreAudio *sica = &si->backend_data.coreaudio;
 
     SOUNDIO_ATOMIC_STORE(sica->service_restarted, true);
-    soundio_os_cond_signal(sica->scan_devices_cond, NULL);
+    soundio_os_event_signal(sica->scan_event);
 
     return noErr;
 }
@@ -158,23 +159,11 @@ static void destroy_ca(struct SoundIoPrivate *si) {
 
     if (sica->thread) {
         SOUNDIO_ATOMIC_FLAG_CLEAR(sica->abort_flag);
-        soundio_os_cond_signal(sica->scan_devices_cond, NULL);
+        soundio_os_event_signal(sica->scan_event);
         soundio_os_thread_destroy(sica->thread);
     }
 
-    if (sica->cond)
-        soundio_os_cond_destroy(sica->cond);
-
-    if (sica->have_devices_cond)
-        soundio_os_cond_destroy(sica->have_devices_cond);
-
-    if (sica->scan_devices_cond)
-        soundio_os_cond_destroy(sica->scan_devices_cond);
-
-    if (sica->mutex)
-        soundio_os_mutex_destroy(sica->mutex);
-
-    soundio_destroy_devices_info(sica->ready_devices_info);
+    soundio_os_event_destroy(sica->scan_event);
 }
 
 // Possible errors:
@@ -431,7 +420,7 @@ static int refresh_devices(struct SoundIoPrivate *si) {
     struct RefreshDevices rd = {0};
     rd.si = si;
 
-    if (!(rd.devices_info = ALLOCATE(struct SoundIoDevicesInfo, 1))) {
+    if (!(rd.devices_info = soundio_devices_info_create(soundio))) {
         deinit_refresh_devices(&rd);
         return SoundIoErrorNoMem;
     }
@@ -585,7 +574,7 @@ static int refresh_devices(struct SoundIoPrivate *si) {
             if (channel_count <= 0)
                 continue;
 
-            struct SoundIoDevicePrivate *dev = ALLOCATE(struct SoundIoDevicePrivate, 1);
+            struct SoundIoDevicePrivate *dev = soundio_device_create(rd.devices_info);
             if (!dev) {
                 deinit_refresh_devices(&rd);
                 return SoundIoErrorNoMem;
@@ -594,12 +583,11 @@ static int refresh_devices(struct SoundIoPrivate *si) {
             dca->device_id = device_id;
             assert(!rd.device);
             rd.device = &dev->pub;
-            rd.device->ref_count = 1;
             rd.device->soundio = soundio;
             rd.device->is_raw = false;
             rd.device->aim = aim;
-            rd.device->id = soundio_str_dupe(rd.device_uid, rd.device_uid_len);
-            rd.device->name = soundio_str_dupe(rd.device_name, rd.device_name_len);
+            rd.device->id = soundio_device_str_dupe(dev, rd.device_uid, rd.device_uid_len);
+            rd.device->name = soundio_device_str_dupe(dev, rd.device_name, rd.device_name_len);
 
             if (!rd.device->id || !rd.device->name) {
                 deinit_refresh_devices(&rd);
@@ -638,7 +626,7 @@ static int refresh_devices(struct SoundIoPrivate *si) {
             rd.device->layouts = &rd.device->current_layout;
 
             rd.device->format_count = 4;
-            rd.device->formats = ALLOCATE(enum SoundIoFormat, rd.device->format_count);
+            rd.device->formats = DEVICE_ALLOCATE(dev, enum SoundIoFormat, rd.device->format_count);
             if (!rd.device->formats)
                 return SoundIoErrorNoMem;
             rd.device->formats[0] = SoundIoFormatS16LE;
@@ -703,7 +691,8 @@ static int refresh_devices(struct SoundIoPrivate *si) {
                     rd.device->sample_rates[0].max = (int)(rd.avr_array[0].mMaximum);
                 } else {
                     rd.device->sample_rate_count = avr_array_len;
-                    rd.device->sample_rates = ALLOCATE(struct SoundIoSampleRateRange, avr_array_len);
+                    rd.device->sample_rates = DEVICE_ALLOCATE(dev,
+                            struct SoundIoSampleRateRange, avr_array_len);
                     if (!rd.device->sample_rates) {
                         deinit_refresh_devices(&rd);
                         return SoundIoErrorNoMem;
@@ -777,10 +766,7 @@ static int refresh_devices(struct SoundIoPrivate *si) {
         }
     }
 
-    soundio_os_mutex_lock(sica->mutex);
-    soundio_destroy_devices_info(sica->ready_devices_info);
-    sica->ready_devices_info = rd.devices_info;
-    soundio_os_mutex_unlock(sica->mutex);
+    soundio_events_post_devices_info(si, rd.devices_info);
 
     rd.devices_info = NULL;
     rd.ok = true;
@@ -790,71 +776,17 @@ static int refresh_devices(struct SoundIoPrivate *si) {
 }
 
 static void shutdown_backend(struct SoundIoPrivate *si, int err) {
-    struct SoundIo *soundio = &si->pub;
-    struct SoundIoCoreAudio *sica = &si->backend_data.coreaudio;
-    soundio_os_mutex_lock(sica->mutex);
-    sica->shutdown_err = err;
-    SOUNDIO_ATOMIC_STORE(sica->have_devices_flag, true);
-    soundio_os_mutex_unlock(sica->mutex);
-    soundio_os_cond_signal(sica->cond, NULL);
-    soundio_os_cond_signal(sica->have_devices_cond, NULL);
-    soundio->on_events_signal(soundio);
-}
-
-static void flush_events_ca(struct SoundIoPrivate *si) {
-    struct SoundIo *soundio = &si->pub;
-    struct SoundIoCoreAudio *sica = &si->backend_data.coreaudio;
-
-    // block until have devices
-    while (!SOUNDIO_ATOMIC_LOAD(sica->have_devices_flag))
-        soundio_os_cond_wait(sica->have_devices_cond, NULL);
-
-    bool change = false;
-    bool cb_shutdown = false;
-    struct SoundIoDevicesInfo *old_devices_info = NULL;
-
-    soundio_os_mutex_lock(sica->mutex);
-
-    if (sica->shutdown_err && !sica->emitted_shutdown_cb) {
-        sica->emitted_shutdown_cb = true;
-        cb_shutdown = true;
-    } else if (sica->ready_devices_info) {
-        old_devices_info = si->safe_devices_info;
-        si->safe_devices_info = sica->ready_devices_info;
-        sica->ready_devices_info = NULL;
-        change = true;
-    }
-
-    soundio_os_mutex_unlock(sica->mutex);
-
-    if (cb_shutdown)
-        soundio->on_backend_disconnect(soundio, sica->shutdown_err);
-    else if (change)
-        soundio->on_devices_change(soundio);
-
-    soundio_destroy_devices_info(old_devices_info);
-}
-
-static void wait_events_ca(struct SoundIoPrivate *si) {
-    struct SoundIoCoreAudio *sica = &si->backend_data.coreaudio;
-    flush_events_ca(si);
-    soundio_os_cond_wait(sica->cond, NULL);
-}
-
-static void wakeup_ca(struct SoundIoPrivate *si) {
-    struct SoundIoCoreAudio *sica = &si->backend_data.coreaudio;
-    soundio_os_cond_signal(sica->cond, NULL);
+    soundio_events_post_error(si, err);
 }
 
 static void force_device_scan_ca(struct SoundIoPrivate *si) {
     struct SoundIoCoreAudio *sica = &si->backend_data.coreaudio;
     SOUNDIO_ATOMIC_STORE(sica->device_scan_queued, true);
-    soundio_os_cond_signal(sica->scan_devices_cond, NULL);
+    soundio_os_event_signal(sica->scan_event);
 }
 
 static void device_thread_run(void *arg) {
     struct SoundIoPrivate *si = (struct SoundIoPrivate *)arg;
-    struct SoundIo *soundio = &si->pub;
     struct SoundIoCoreAudio *sica = &si->backend_data.coreaudio;
     int err;
 
@@ -871,21 +803,268 @@ static void device_thread_run(void *arg) {
                 shutdown_backend(si, err);
                 return;
             }
-            if (!SOUNDIO_ATOMIC_EXCHANGE(sica->have_devices_flag, true))
-                soundio_os_cond_signal(sica->have_devices_cond, NULL);
-            soundio_os_cond_signal(sica->cond, NULL);
-            soundio->on_events_signal(soundio);
         }
-        soundio_os_cond_wait(sica->scan_devices_cond, NULL);
+        soundio_os_event_wait(sica->scan_event);
+    }
+}
+
+#ifdef SOUNDIO_HAVE_OS_WORKGROUP
+static os_workgroup_t get_workgroup(AudioDeviceID device_id) {
+    AudioObjectPropertyAddress prop_address = {
+        kAudioDevicePropertyIOThreadOSWorkgroup,
+        kAudioObjectPropertyScopeGlobal,
+        kAudioObjectPropertyElementMain
+    };
+    UInt32 io_size = sizeof(os_workgroup_t);
+    os_workgroup_t workgroup;
+    // The stream works without one, only not as well.
+    if (AudioObjectGetPropertyData(device_id, &prop_address, 0, NULL, &io_size, &workgroup))
+        return NULL;
+    return workgroup;
+}
+
+static void release_workgroup(void *workgroup) {
+    if (workgroup)
+        os_release((os_workgroup_t)workgroup);
+}
+
+static OSStatus on_workgroup_changed(AudioObjectID in_object_id, UInt32 in_number_addresses,
+    const AudioObjectPropertyAddress in_addresses[], void *in_client_data)
+{
+    struct SoundIoCoreAudioWorkgroup *wg = (struct SoundIoCoreAudioWorkgroup *)in_client_data;
+    if (__builtin_available(macOS 11.0, *)) {
+        // the render callback is done with the one it retired
+        release_workgroup(SOUNDIO_ATOMIC_EXCHANGE(wg->retired, NULL));
+        release_workgroup(SOUNDIO_ATOMIC_EXCHANGE(wg->pending, get_workgroup(wg->device_id)));
+    }
+    return noErr;
+}
+
+static const AudioObjectPropertyAddress workgroup_prop_address = {
+    kAudioDevicePropertyIOThreadOSWorkgroup,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMain
+};
+#endif
+
+static void workgroup_init(struct SoundIoCoreAudioWorkgroup *wg, AudioDeviceID device_id) {
+    wg->device_id = device_id;
+#ifdef SOUNDIO_HAVE_OS_WORKGROUP
+    wg->workgroup = NULL;
+    if (__builtin_available(macOS 11.0, *)) {
+        wg->workgroup = get_workgroup(device_id);
+        wg->listening = !AudioObjectAddPropertyListener(device_id, &workgroup_prop_address,
+                on_workgroup_changed, wg);
+    }
+#endif
+}
+
+// Only once the unit has stopped. A member left is one whose thread the HAL
+// no longer runs the IO proc on, so it cannot be made to leave; its
+// membership goes with the thread.
+static void workgroup_deinit(struct SoundIoCoreAudioWorkgroup *wg) {
+#ifdef SOUNDIO_HAVE_OS_WORKGROUP
+    if (wg->listening) {
+        AudioObjectRemovePropertyListener(wg->device_id, &workgroup_prop_address,
+                on_workgroup_changed, wg);
+        wg->listening = false;
+    }
+    for (int i = 0; i < SOUNDIO_COREAUDIO_WORKGROUP_MEMBERS; i += 1) {
+        release_workgroup(wg->members[i].workgroup);
+        wg->members[i].workgroup = NULL;
+    }
+    release_workgroup(SOUNDIO_ATOMIC_EXCHANGE(wg->pending, NULL));
+    release_workgroup(SOUNDIO_ATOMIC_EXCHANGE(wg->retired, NULL));
+    release_workgroup(wg->workgroup);
+    wg->workgroup = NULL;
+#endif
+    SOUNDIO_ATOMIC_STORE(wg->member_count, 0);
+}
+
+#ifdef SOUNDIO_HAVE_OS_WORKGROUP
+static void workgroup_leave_member(struct SoundIoCoreAudioWorkgroup *wg,
+        struct SoundIoCoreAudioWorkgroupMember *member)
+{
+    os_workgroup_leave(member->workgroup, &member->join_token);
+    os_release(member->workgroup);
+    member->workgroup = NULL;
+    SOUNDIO_ATOMIC_FETCH_ADD(wg->member_count, -1);
+}
+#endif
+
+// Called at the start of every render callback. A thread joins once, and
+// leaves before joining a new workgroup or when leave_requested is set.
+static void workgroup_join(struct SoundIoCoreAudioWorkgroup *wg) {
+#ifdef SOUNDIO_HAVE_OS_WORKGROUP
+    if (__builtin_available(macOS 11.0, *)) {
+        os_workgroup_t workgroup = (os_workgroup_t)SOUNDIO_ATOMIC_EXCHANGE(wg->pending, NULL);
+        if (workgroup) {
+            // the listener releases it; there is at most one in flight
+            release_workgroup(SOUNDIO_ATOMIC_EXCHANGE(wg->retired, wg->workgroup));
+            wg->workgroup = workgroup;
+        }
+
+        pthread_t self = pthread_self();
+        struct SoundIoCoreAudioWorkgroupMember *member = NULL;
+        struct SoundIoCoreAudioWorkgroupMember *free_member = NULL;
+        for (int i = 0; i < SOUNDIO_COREAUDIO_WORKGROUP_MEMBERS; i += 1) {
+            struct SoundIoCoreAudioWorkgroupMember *m = &wg->members[i];
+            if (!m->workgroup) {
+                if (!free_member)
+                    free_member = m;
+            } else if (pthread_equal(m->thread, self)) {
+                member = m;
+            }
+        }
+
+        if (SOUNDIO_ATOMIC_LOAD(wg->leave_requested)) {
+            if (member)
+                workgroup_leave_member(wg, member);
+            return;
+        }
+        if (member) {
+            if (member->workgroup == wg->workgroup)
+                return;
+            workgroup_leave_member(wg, member);
+            free_member = member;
+        }
+        // EALREADY means that the HAL made the thread a member itself, and
+        // there is no token to leave with.
+        if (!wg->workgroup || !free_member)
+            return;
+        if (os_workgroup_join(wg->workgroup, &free_member->join_token))
+            return;
+        os_retain(wg->workgroup);
+        free_member->workgroup = wg->workgroup;
+        free_member->thread = self;
+        SOUNDIO_ATOMIC_FETCH_ADD(wg->member_count, 1);
+    }
+#endif
+}
+
+// Call while the unit still runs, right before stopping it. Waits a little
+// for the render callback to leave on the threads which joined.
+static void workgroup_leave(struct SoundIoCoreAudioWorkgroup *wg) {
+    if (!SOUNDIO_ATOMIC_LOAD(wg->member_count))
+        return;
+    SOUNDIO_ATOMIC_STORE(wg->leave_requested, true);
+    double deadline = soundio_os_get_time() + 0.1;
+    while (SOUNDIO_ATOMIC_LOAD(wg->member_count) > 0 && soundio_os_get_time() < deadline)
+        soundio_os_sleep_until(soundio_os_get_time() + 0.001);
+}
+
+// Call once the unit has stopped, so that it joins again when it restarts.
+static void workgroup_rejoin(struct SoundIoCoreAudioWorkgroup *wg) {
+    SOUNDIO_ATOMIC_STORE(wg->leave_requested, false);
+}
+
+// Asks the device for an IO buffer of `software_latency` seconds, which the
+// caller has clamped to the range of the device, and for `io_cycle_usage`
+// unless that is 0. The buffer size is per process, and the HAL renders one
+// buffer per callback. Returns the size the device settled on, in frames at
+// the device's rate like the range.
+static int set_io_buffer(struct SoundIoDevice *device, AudioObjectPropertyScope scope,
+        AudioObjectPropertyElement element, double software_latency, float io_cycle_usage,
+        UInt32 *out_buffer_frame_size)
+{
+    struct SoundIoDevicePrivate *dev = (struct SoundIoDevicePrivate *)device;
+    struct SoundIoDeviceCoreAudio *dca = &dev->backend_data.coreaudio;
+    OSStatus os_err;
+
+    AudioObjectPropertyAddress prop_address = {
+        kAudioDevicePropertyBufferFrameSize,
+        scope,
+        element
+    };
+    UInt32 buffer_frame_size = (UInt32)(software_latency * device->sample_rate_current + 0.5);
+    if ((os_err = AudioObjectSetPropertyData(dca->device_id, &prop_address,
+        0, NULL, sizeof(UInt32), &buffer_frame_size)))
+    {
+        return SoundIoErrorOpeningDevice;
+    }
+
+    if (io_cycle_usage > 0.0f) {
+        AudioObjectPropertyAddress usage_address = {
+            kAudioDevicePropertyIOCycleUsage,
+            kAudioObjectPropertyScopeGlobal,
+            kAudioObjectPropertyElementMain
+        };
+        Float32 usage = (io_cycle_usage < 1.0f) ? io_cycle_usage : 1.0f;
+        if ((os_err = AudioObjectSetPropertyData(dca->device_id, &usage_address,
+            0, NULL, sizeof(Float32), &usage)))
+        {
+            return SoundIoErrorOpeningDevice;
+        }
+    }
+
+    // The HAL uses the smallest size any client in the process asked for.
+    UInt32 io_size = sizeof(UInt32);
+    if ((os_err = AudioObjectGetPropertyData(dca->device_id, &prop_address,
+        0, NULL, &io_size, &buffer_frame_size)))
+    {
+        return SoundIoErrorOpeningDevice;
+    }
+    *out_buffer_frame_size = buffer_frame_size;
+    return 0;
+}
+
+// Unless told otherwise the audio unit allocates for more frames per render
+// than a low latency stream ever sees. When it does not convert the rate it
+// renders one IO buffer at a time, so that is all it needs. Must be set
+// before the unit is initialized.
+static int set_maximum_frames_per_slice(AudioComponentInstance instance, struct SoundIoDevice *device,
+        int sample_rate, UInt32 buffer_frame_size)
+{
+    if (sample_rate != device->sample_rate_current)
+        return 0;
+    OSStatus os_err;
+    if ((os_err = AudioUnitSetProperty(instance, kAudioUnitProperty_MaximumFramesPerSlice,
+        kAudioUnitScope_Global, 0, &buffer_frame_size, sizeof(UInt32))))
+    {
+        return SoundIoErrorOpeningDevice;
+    }
+    return 0;
+}
+
+// Points `areas` at the buffers the audio unit renders to or from: one
+// interleaved buffer, or one per channel when the stream format is
+// non-interleaved.
+static void set_buffer_list_areas(const AudioBufferList *buffer_list, struct SoundIoChannelArea *areas,
+        int channel_count, int bytes_per_sample)
+{
+    if (buffer_list->mNumberBuffers == 1) {
+        const AudioBuffer *audio_buffer = &buffer_list->mBuffers[0];
+        assert(audio_buffer->mNumberChannels == channel_count);
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            areas[ch].ptr = ((char*)audio_buffer->mData) + (bytes_per_sample * ch);
+            areas[ch].step = bytes_per_sample * channel_count;
+        }
+    } else {
+        assert(buffer_list->mNumberBuffers == channel_count);
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            areas[ch].ptr = (char*)buffer_list->mBuffers[ch].mData;
+            areas[ch].step = bytes_per_sample;
+        }
     }
 }
 
+// The host time of a render callback's time stamp, in soundio_os_get_time.
+// For output it is when the first frame reaches the device, for input when
+// it left it, so the hardware latency is what is left to add.
+static bool get_host_time(const AudioTimeStamp *time_stamp, double *out_time) {
+    if (!(time_stamp->mFlags & kAudioTimeStampHostTimeValid))
+        return false;
+    double stamp_time = AudioConvertHostTimeToNanos(time_stamp->mHostTime) / 1000000000.0;
+    double host_now = AudioConvertHostTimeToNanos(AudioGetCurrentHostTime()) / 1000000000.0;
+    *out_time = soundio_os_get_time() + (stamp_time - host_now);
+    return true;
+}
+
 static OSStatus on_outstream_device_overload(AudioObjectID in_object_id, UInt32 in_number_addresses,
     const AudioObjectPropertyAddress in_addresses[], void *in_client_data)
 {
     struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate *)in_client_data;
-    struct SoundIoOutStream *outstream = &os->pub;
-    outstream->underflow_callback(outstream);
+    soundio_outstream_run_underflow_callback(os);
     return noErr;
 }
 
@@ -904,10 +1083,13 @@ static void outstream_destroy_ca(struct SoundIoPrivate *si, struct SoundIoOutStr
     AudioObjectRemovePropertyListener(dca->device_id, &prop_address, on_outstream_device_overload, os);
 
     if (osca->instance) {
+        workgroup_leave(&osca->workgroup);
         AudioOutputUnitStop(osca->instance);
         AudioComponentInstanceDispose(osca->instance);
         osca->instance = NULL;
     }
+
+    workgroup_deinit(&osca->workgroup);
 }
 
 static OSStatus write_callback_ca(void *userdata, AudioUnitRenderActionFlags *io_action_flags,
@@ -918,11 +1100,26 @@ static OSStatus write_callback_ca(void *userdata, AudioUnitRenderActionFlags *io
     struct SoundIoOutStream *outstream = &os->pub;
     struct SoundIoOutStreamCoreAudio *osca = &os->backend_data.coreaudio;
 
-    osca->io_data = io_data;
-    osca->buffer_index = 0;
+    workgroup_join(&osca->workgroup);
+
+    double time;
+    if (get_host_time(in_time_stamp, &time))
+        soundio_outstream_report_timestamp(os, time, osca->hardware_latency);
+
+    if (osca->planar) {
+        assert(io_data->mNumberBuffers == outstream->layout.channel_count);
+        float *buffers[SOUNDIO_MAX_CHANNELS];
+        for (int ch = 0; ch < outstream->layout.channel_count; ch += 1)
+            buffers[ch] = (float *)io_data->mBuffers[ch].mData;
+        soundio_outstream_run_write_planar_callback(os, buffers, in_number_frames);
+        return noErr;
+    }
+
+    set_buffer_list_areas(io_data, osca->areas, outstream->layout.channel_count,
+            outstream->bytes_per_sample);
     osca->frames_left = in_number_frames;
-    outstream->write_callback(outstream, osca->frames_left, osca->frames_left);
-    osca->io_data = NULL;
+    soundio_outstream_run_write_callback(os, osca->frames_left, osca->frames_left);
+    osca->frames_left = 0;
 
     return noErr;
 }
@@ -970,6 +1167,9 @@ static int outstream_open_ca(struct SoundIoPrivate *si, struct SoundIoOutStreamP
             outstream->software_latency,
             device->software_latency_max);
 
+    osca->planar = outstream->write_planar_callback && !os->resample &&
+        outstream->format == SoundIoFormatFloat32NE;
+
     AudioComponentDescription desc = {0};
     desc.componentType = kAudioUnitType_Output;
     desc.componentSubType = kAudioUnitSubType_HALOutput;
@@ -987,11 +1187,6 @@ static int outstream_open_ca(struct SoundIoPrivate *si, struct SoundIoOutStreamP
         return SoundIoErrorOpeningDevice;
     }
 
-    if ((os_err = AudioUnitInitialize(osca->instance))) {
-        outstream_destroy_ca(si, os);
-        return SoundIoErrorOpeningDevice;
-    }
-
     AudioStreamBasicDescription format = {0};
     format.mSampleRate = outstream->sample_rate;
     format.mFormatID = kAudioFormatLinearPCM;
@@ -1000,9 +1195,15 @@ static int outstream_open_ca(struct SoundIoPrivate *si, struct SoundIoOutStreamP
         outstream_destroy_ca(si, os);
         return err;
     }
-    format.mBytesPerPacket = outstream->bytes_per_frame;
+    // For non-interleaved formats the sizes are those of one channel.
+    int format_frame_size = outstream->bytes_per_frame;
+    if (osca->planar) {
+        format.mFormatFlags |= kAudioFormatFlagIsNonInterleaved;
+        format_frame_size = outstream->bytes_per_sample;
+    }
+    format.mBytesPerPacket = format_frame_size;
     format.mFramesPerPacket = 1;
-    format.mBytesPerFrame = outstream->bytes_per_frame;
+    format.mBytesPerFrame = format_frame_size;
     format.mChannelsPerFrame = outstream->layout.channel_count;
 
     if ((os_err = AudioUnitSetProperty(osca->instance, kAudioOutputUnitProperty_CurrentDevice,
@@ -1027,22 +1228,34 @@ static int outstream_open_ca(struct SoundIoPrivate *si, struct SoundIoOutStreamP
         return SoundIoErrorOpeningDevice;
     }
 
-    AudioObjectPropertyAddress prop_address = {
-        kAudioDevicePropertyBufferFrameSize,
-        kAudioObjectPropertyScopeInput,
-        OUTPUT_ELEMENT
-    };
-    UInt32 buffer_frame_size = outstream->software_latency * outstream->sample_rate;
-    if ((os_err = AudioObjectSetPropertyData(dca->device_id, &prop_address,
-        0, NULL, sizeof(UInt32), &buffer_frame_size)))
+    UInt32 buffer_frame_size;
+    if ((err = set_io_buffer(device, kAudioObjectPropertyScopeInput, OUTPUT_ELEMENT,
+        outstream->software_latency, outstream->io_cycle_usage, &buffer_frame_size)))
+    {
+        outstream_destroy_ca(si, os);
+        return err;
+    }
+    outstream->software_latency = buffer_frame_size / (double)device->sample_rate_current;
+
+    if ((err = set_maximum_frames_per_slice(osca->instance, device, outstream->sample_rate,
+        buffer_frame_size)))
     {
+        outstream_destroy_ca(si, os);
+        return err;
+    }
+
+    if ((os_err = AudioUnitInitialize(osca->instance))) {
         outstream_destroy_ca(si, os);
         return SoundIoErrorOpeningDevice;
     }
 
-    prop_address.mSelector = kAudioDeviceProcessorOverload;
-    prop_address.mScope = kAudioObjectPropertyScopeGlobal;
-    prop_address.mElement = OUTPUT_ELEMENT;
+    workgroup_init(&osca->workgroup, dca->device_id);
+
+    AudioObjectPropertyAddress prop_address = {
+        kAudioDeviceProcessorOverload,
+        kAudioObjectPropertyScopeGlobal,
+        OUTPUT_ELEMENT
+    };
     if ((os_err = AudioObjectAddPropertyListener(dca->device_id, &prop_address,
         on_outstream_device_overload, os)))
     {
@@ -1064,9 +1277,11 @@ static int outstream_pause_ca(struct SoundIoPrivate *si, struct SoundIoOutStream
     struct SoundIoOutStreamCoreAudio *osca = &os->backend_data.coreaudio;
     OSStatus os_err;
     if (pause) {
-        if ((os_err = AudioOutputUnitStop(osca->instance))) {
+        workgroup_leave(&osca->workgroup);
+        os_err = AudioOutputUnitStop(osca->instance);
+        workgroup_rejoin(&osca->workgroup);
+        if (os_err)
             return SoundIoErrorStreaming;
-        }
     } else {
         if ((os_err = AudioOutputUnitStart(osca->instance))) {
             return SoundIoErrorStreaming;
@@ -1083,31 +1298,24 @@ static int outstream_start_ca(struct SoundIoPrivate *si, struct SoundIoOutStream
 static int outstream_begin_write_ca(struct SoundIoPrivate *si, struct SoundIoOutStreamPrivate *os,
         struct SoundIoChannelArea **out_areas, int *frame_count)
 {
-    struct SoundIoOutStream *outstream = &os->pub;
     struct SoundIoOutStreamCoreAudio *osca = &os->backend_data.coreaudio;
 
-    if (osca->buffer_index >= osca->io_data->mNumberBuffers)
-        return SoundIoErrorInvalid;
-
-    if (*frame_count != osca->frames_left)
+    // The callback may write its frames in several steps, straight into the
+    // buffers the audio unit renders from.
+    if (*frame_count <= 0 || osca->frames_left <= 0)
         return SoundIoErrorInvalid;
 
-    AudioBuffer *audio_buffer = &osca->io_data->mBuffers[osca->buffer_index];
-    assert(audio_buffer->mNumberChannels == outstream->layout.channel_count);
-    osca->write_frame_count = audio_buffer->mDataByteSize / outstream->bytes_per_frame;
+    osca->write_frame_count = soundio_int_min(*frame_count, osca->frames_left);
     *frame_count = osca->write_frame_count;
-    assert((audio_buffer->mDataByteSize % outstream->bytes_per_frame) == 0);
-    for (int ch = 0; ch < outstream->layout.channel_count; ch += 1) {
-        osca->areas[ch].ptr = ((char*)audio_buffer->mData) + outstream->bytes_per_sample * ch;
-        osca->areas[ch].step = outstream->bytes_per_frame;
-    }
     *out_areas = osca->areas;
     return 0;
 }
 
 static int outstream_end_write_ca(struct SoundIoPrivate *si, struct SoundIoOutStreamPrivate *os) {
+    struct SoundIoOutStream *outstream = &os->pub;
     struct SoundIoOutStreamCoreAudio *osca = &os->backend_data.coreaudio;
-    osca->buffer_index += 1;
+    for (int ch = 0; ch < outstream->layout.channel_count; ch += 1)
+        osca->areas[ch].ptr += osca->areas[ch].step * osca->write_frame_count;
     osca->frames_left -= osca->write_frame_count;
     assert(osca->frames_left >= 0);
     return 0;
@@ -1140,9 +1348,8 @@ static int outstream_set_volume_ca(struct SoundIoPrivate *si, struct SoundIoOutS
 static OSStatus on_instream_device_overload(AudioObjectID in_object_id, UInt32 in_number_addresses,
     const AudioObjectPropertyAddress in_addresses[], void *in_client_data)
 {
-    struct SoundIoInStreamPrivate *os = (struct SoundIoInStreamPrivate *)in_client_data;
-    struct SoundIoInStream *instream = &os->pub;
-    instream->overflow_callback(instream);
+    struct SoundIoInStreamPrivate *is = (struct SoundIoInStreamPrivate *)in_client_data;
+    soundio_instream_run_overflow_callback(is);
     return noErr;
 }
 
@@ -1161,6 +1368,7 @@ static void instream_destroy_ca(struct SoundIoPrivate *si, struct SoundIoInStrea
     AudioObjectRemovePropertyListener(dca->device_id, &prop_address, on_instream_device_overload, is);
 
     if (isca->instance) {
+        workgroup_leave(&isca->workgroup);
         AudioOutputUnitStop(isca->instance);
         AudioComponentInstanceDispose(isca->instance);
         isca->instance = NULL;
@@ -1168,6 +1376,8 @@ static void instream_destroy_ca(struct SoundIoPrivate *si, struct SoundIoInStrea
 
     free(isca->buffer_list);
     isca->buffer_list = NULL;
+
+    workgroup_deinit(&isca->workgroup);
 }
 
 static OSStatus read_callback_ca(void *userdata, AudioUnitRenderActionFlags *io_action_flags,
@@ -1178,6 +1388,8 @@ static OSStatus read_callback_ca(void *userdata, AudioUnitRenderActionFlags *io_
     struct SoundIoInStream *instream = &is->pub;
     struct SoundIoInStreamCoreAudio *isca = &is->backend_data.coreaudio;
 
+    workgroup_join(&isca->workgroup);
+
     for (int i = 0; i < isca->buffer_list->mNumberBuffers; i += 1) {
         isca->buffer_list->mBuffers[i].mData = NULL;
     }
@@ -1190,26 +1402,22 @@ static OSStatus read_callback_ca(void *userdata, AudioUnitRenderActionFlags *io_
         return noErr;
     }
 
-    if (isca->buffer_list->mNumberBuffers == 1) {
-        AudioBuffer *audio_buffer = &isca->buffer_list->mBuffers[0];
-        assert(audio_buffer->mNumberChannels == instream->layout.channel_count);
-        assert(audio_buffer->mDataByteSize == in_number_frames * instream->bytes_per_frame);
-        for (int ch = 0; ch < instream->layout.channel_count; ch += 1) {
-            isca->areas[ch].ptr = ((char*)audio_buffer->mData) + (instream->bytes_per_sample * ch);
-            isca->areas[ch].step = instream->bytes_per_frame;
-        }
-    } else {
-        assert(isca->buffer_list->mNumberBuffers == instream->layout.channel_count);
-        for (int ch = 0; ch < instream->layout.channel_count; ch += 1) {
-            AudioBuffer *audio_buffer = &isca->buffer_list->mBuffers[ch];
-            assert(audio_buffer->mDataByteSize == in_number_frames * instream->bytes_per_sample);
-            isca->areas[ch].ptr = (char*)audio_buffer->mData;
-            isca->areas[ch].step = instream->bytes_per_sample;
-        }
+    double time;
+    if (get_host_time(in_time_stamp, &time))
+        soundio_instream_report_timestamp(is, time, isca->hardware_latency);
+
+    if (isca->planar) {
+        const float *buffers[SOUNDIO_MAX_CHANNELS];
+        for (int ch = 0; ch < instream->layout.channel_count; ch += 1)
+            buffers[ch] = (const float *)isca->buffer_list->mBuffers[ch].mData;
+        soundio_instream_run_read_planar_callback(is, buffers, in_number_frames);
+        return noErr;
     }
 
+    set_buffer_list_areas(isca->buffer_list, isca->areas, instream->layout.channel_count,
+            instream->bytes_per_sample);
     isca->frames_left = in_number_frames;
-    instream->read_callback(instream, isca->frames_left, isca->frames_left);
+    soundio_instream_run_read_callback(is, isca->frames_left, isca->frames_left);
 
     return noErr;
 }
@@ -1231,31 +1439,20 @@ static int instream_open_ca(struct SoundIoPrivate *si, struct SoundIoInStreamPri
             instream->software_latency,
             device->software_latency_max);
 
+    isca->planar = instream->read_planar_callback && instream->format == SoundIoFormatFloat32NE;
 
-    AudioObjectPropertyAddress prop_address;
-    prop_address.mSelector = kAudioDevicePropertyStreamConfiguration;
-    prop_address.mScope = kAudioObjectPropertyScopeInput;
-    prop_address.mElement = kAudioObjectPropertyElementMain;
-    io_size = 0;
-    if ((os_err = AudioObjectGetPropertyDataSize(dca->device_id, &prop_address,
-        0, NULL, &io_size)))
-    {
-        instream_destroy_ca(si, is);
-        return SoundIoErrorOpeningDevice;
-    }
-
-    isca->buffer_list = (AudioBufferList*)ALLOCATE_NONZERO(char, io_size);
+    // The audio unit renders into buffers of its own, as many as the stream
+    // format has: one, or one per channel when it is non-interleaved.
+    int buffer_count = isca->planar ? instream->layout.channel_count : 1;
+    io_size = offsetof(AudioBufferList, mBuffers) + buffer_count * sizeof(AudioBuffer);
+    isca->buffer_list = (AudioBufferList*)ALLOCATE(char, io_size);
     if (!isca->buffer_list) {
         instream_destroy_ca(si, is);
         return SoundIoErrorNoMem;
     }
-
-    if ((os_err = AudioObjectGetPropertyData(dca->device_id, &prop_address,
-        0, NULL, &io_size, isca->buffer_list)))
-    {
-        instream_destroy_ca(si, is);
-        return SoundIoErrorOpeningDevice;
-    }
+    isca->buffer_list->mNumberBuffers = buffer_count;
+    for (int i = 0; i < buffer_count; i += 1)
+        isca->buffer_list->mBuffers[i].mNumberChannels = isca->planar ? 1 : instream->layout.channel_count;
 
 
     AudioComponentDescription desc = {0};
@@ -1274,11 +1471,6 @@ static int instream_open_ca(struct SoundIoPrivate *si, struct SoundIoInStreamPri
         return SoundIoErrorOpeningDevice;
     }
 
-    if ((os_err = AudioUnitInitialize(isca->instance))) {
-        instream_destroy_ca(si, is);
-        return SoundIoErrorOpeningDevice;
-    }
-
     UInt32 enable_io = 1;
     if ((os_err = AudioUnitSetProperty(isca->instance, kAudioOutputUnitProperty_EnableIO,
         kAudioUnitScope_Input, INPUT_ELEMENT, &enable_io, sizeof(UInt32))))
@@ -1306,9 +1498,7 @@ static int instream_open_ca(struct SoundIoPrivate *si, struct SoundIoInStreamPri
     AudioStreamBasicDescription format = {0};
     format.mSampleRate = instream->sample_rate;
     format.mFormatID = kAudioFormatLinearPCM;
-    format.mBytesPerPacket = instream->bytes_per_frame;
     format.mFramesPerPacket = 1;
-    format.mBytesPerFrame = instream->bytes_per_frame;
     format.mChannelsPerFrame = instream->layout.channel_count;
 
     int err;
@@ -1316,6 +1506,13 @@ static int instream_open_ca(struct SoundIoPrivate *si, struct SoundIoInStreamPri
         instream_destroy_ca(si, is);
         return err;
     }
+    int format_frame_size = instream->bytes_per_frame;
+    if (isca->planar) {
+        format.mFormatFlags |= kAudioFormatFlagIsNonInterleaved;
+        format_frame_size = instream->bytes_per_sample;
+    }
+    format.mBytesPerPacket = format_frame_size;
+    format.mBytesPerFrame = format_frame_size;
 
     if ((os_err = AudioUnitSetProperty(isca->instance, kAudioUnitProperty_StreamFormat,
         kAudioUnitScope_Output, INPUT_ELEMENT, &format, sizeof(AudioStreamBasicDescription))))
@@ -1333,19 +1530,34 @@ static int instream_open_ca(struct SoundIoPrivate *si, struct SoundIoInStreamPri
     }
 
 
-    prop_address.mSelector = kAudioDevicePropertyBufferFrameSize;
-    prop_address.mScope = kAudioObjectPropertyScopeOutput;
-    prop_address.mElement = INPUT_ELEMENT;
-    UInt32 buffer_frame_size = instream->software_latency * instream->sample_rate;
-    if ((os_err = AudioObjectSetPropertyData(dca->device_id, &prop_address,
-        0, NULL, sizeof(UInt32), &buffer_frame_size)))
+    UInt32 buffer_frame_size;
+    if ((err = set_io_buffer(device, kAudioObjectPropertyScopeOutput, INPUT_ELEMENT,
+        instream->software_latency, instream->io_cycle_usage, &buffer_frame_size)))
+    {
+        instream_destroy_ca(si, is);
+        return err;
+    }
+    instream->software_latency = buffer_frame_size / (double)device->sample_rate_current;
+
+    if ((err = set_maximum_frames_per_slice(isca->instance, device, instream->sample_rate,
+        buffer_frame_size)))
     {
+        instream_destroy_ca(si, is);
+        return err;
+    }
+
+    if ((os_err = AudioUnitInitialize(isca->instance))) {
         instream_destroy_ca(si, is);
         return SoundIoErrorOpeningDevice;
     }
 
-    prop_address.mSelector = kAudioDeviceProcessorOverload;
-    prop_address.mScope = kAudioObjectPropertyScopeGlobal;
+    workgroup_init(&isca->workgroup, dca->device_id);
+
+    AudioObjectPropertyAddress prop_address = {
+        kAudioDeviceProcessorOverload,
+        kAudioObjectPropertyScopeGlobal,
+        kAudioObjectPropertyElementMain
+    };
     if ((os_err = AudioObjectAddPropertyListener(dca->device_id, &prop_address,
         on_instream_device_overload, is)))
     {
@@ -1362,9 +1574,11 @@ static int instream_pause_ca(struct SoundIoPrivate *si, struct SoundIoInStreamPr
     struct SoundIoInStreamCoreAudio *isca = &is->backend_data.coreaudio;
     OSStatus os_err;
     if (pause) {
-        if ((os_err = AudioOutputUnitStop(isca->instance))) {
+        workgroup_leave(&isca->workgroup);
+        os_err = AudioOutputUnitStop(isca->instance);
+        workgroup_rejoin(&isca->workgroup);
+        if (os_err)
             return SoundIoErrorStreaming;
-        }
     } else {
         if ((os_err = AudioOutputUnitStart(isca->instance))) {
             return SoundIoErrorStreaming;
@@ -1410,31 +1624,12 @@ int soundio_coreaudio_init(struct SoundIoPrivate *si) {
     struct SoundIoCoreAudio *sica = &si->backend_data.coreaudio;
     int err;
 
-    SOUNDIO_ATOMIC_STORE(sica->have_devices_flag, false);
     SOUNDIO_ATOMIC_STORE(sica->device_scan_queued, true);
     SOUNDIO_ATOMIC_STORE(sica->service_restarted, false);
     SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(sica->abort_flag);
 
-    sica->mutex = soundio_os_mutex_create();
-    if (!sica->mutex) {
-        destroy_ca(si);
-        return SoundIoErrorNoMem;
-    }
-
-    sica->cond = soundio_os_cond_create();
-    if (!sica->cond) {
-        destroy_ca(si);
-        return SoundIoErrorNoMem;
-    }
-
-    sica->have_devices_cond = soundio_os_cond_create();
-    if (!sica->have_devices_cond) {
-        destroy_ca(si);
-        return SoundIoErrorNoMem;
-    }
-
-    sica->scan_devices_cond = soundio_os_cond_create();
-    if (!sica->scan_devices_cond) {
+    sica->scan_event = soundio_os_event_create();
+    if (!sica->scan_event) {
         destroy_ca(si);
         return SoundIoErrorNoMem;
     }
@@ -1459,15 +1654,15 @@ int soundio_coreaudio_init(struct SoundIoPrivate *si) {
         return SoundIoErrorSystemResources;
     }
 
-    if ((err = soundio_os_thread_create(device_thread_run, si, NULL, &sica->thread))) {
+    if ((err = soundio_os_thread_create(device_thread_run, si, NULL, false, NULL, &sica->thread))) {
         destroy_ca(si);
         return err;
     }
 
     si->destroy = destroy_ca;
-    si->flush_events = flush_events_ca;
-    si->wait_events = wait_events_ca;
-    si->wakeup = wakeup_ca;
+    si->flush_events = soundio_events_flush;
+    si->wait_events = soundio_events_wait;
+    si->wakeup = soundio_events_wakeup;
     si->force_device_scan = force_device_scan_ca;
 
     si->outstream_open = outstream_open_ca;
@@ -15,6 +15,13 @@
 
 #include <CoreAudio/CoreAudio.h>
 #include <AudioUnit/AudioUnit.h>
+#include <AvailabilityMacros.h>
+#include <pthread.h>
+
+#ifdef MAC_OS_VERSION_11_0
+#include <os/workgroup.h>
+#define SOUNDIO_HAVE_OS_WORKGROUP
+#endif
 
 struct SoundIoPrivate;
 int soundio_coreaudio_init(struct SoundIoPrivate *si);
@@ -27,32 +34,63 @@ struct SoundIoDeviceCoreAudio {
 SOUNDIO_MAKE_LIST_STRUCT(AudioDeviceID, SoundIoListAudioDeviceID, SOUNDIO_LIST_STATIC)
 
 struct SoundIoCoreAudio {
-    struct SoundIoOsMutex *mutex;
-    struct SoundIoOsCond *cond;
     struct SoundIoOsThread *thread;
     struct SoundIoAtomicFlag abort_flag;
-
-    // this one is ready to be read with flush_events. protected by mutex
-    struct SoundIoDevicesInfo *ready_devices_info;
-    struct SoundIoAtomicBool have_devices_flag;
-    struct SoundIoOsCond *have_devices_cond;
-    struct SoundIoOsCond *scan_devices_cond;
+    // Wakes the device thread to look at the flags below, or to exit.
+    struct SoundIoOsEvent *scan_event;
     struct SoundIoListAudioDeviceID registered_listeners;
 
     struct SoundIoAtomicBool device_scan_queued;
     struct SoundIoAtomicBool service_restarted;
-    int shutdown_err;
-    bool emitted_shutdown_cb;
+};
+
+// The HAL may move the IO proc to another thread after the device restarts.
+#define SOUNDIO_COREAUDIO_WORKGROUP_MEMBERS 4
+
+// A thread which the render callback made join the workgroup. Leaving takes
+// its token, on that thread.
+struct SoundIoCoreAudioWorkgroupMember {
+    pthread_t thread;
+#ifdef SOUNDIO_HAVE_OS_WORKGROUP
+    // Holds a reference; NULL for a free slot.
+    os_workgroup_t workgroup;
+    os_workgroup_join_token_s join_token;
+#endif
+};
+
+// The OS workgroup of a device's IO thread. The render callback joins it
+// so that the scheduler treats the thread as real time audio work, and keeps
+// it off the efficiency cores. macOS 11 and later; NULL before that.
+struct SoundIoCoreAudioWorkgroup {
+    AudioDeviceID device_id;
+    bool listening;
+#ifdef SOUNDIO_HAVE_OS_WORKGROUP
+    // Owned by the render callback while the stream runs.
+    os_workgroup_t workgroup;
+    struct SoundIoCoreAudioWorkgroupMember members[SOUNDIO_COREAUDIO_WORKGROUP_MEMBERS];
+    // A new workgroup from the property listener for the render callback to
+    // switch to, and the one it switched from for the listener to release.
+    struct SoundIoAtomicPtr pending;
+    struct SoundIoAtomicPtr retired;
+#endif
+    // Set before the unit stops, so that the render callback leaves while
+    // it still runs on the joined thread.
+    struct SoundIoAtomicBool leave_requested;
+    struct SoundIoAtomicInt member_count;
 };
 
 struct SoundIoOutStreamCoreAudio {
     AudioComponentInstance instance;
-    AudioBufferList *io_data;
-    int buffer_index;
+    // The areas point into the buffer list of the current render callback,
+    // at the first frame not written yet.
     int frames_left;
     int write_frame_count;
     double hardware_latency;
     float volume;
+    // The stream format is non-interleaved and the render callback passes
+    // its buffers to SoundIoOutStream::write_planar_callback.
+    bool planar;
+    struct SoundIoCoreAudioWorkgroup workgroup;
     struct SoundIoChannelArea areas[SOUNDIO_MAX_CHANNELS];
 };
 
@@ -61,6 +99,9 @@ struct SoundIoInStreamCoreAudio {
     AudioBufferList *buffer_list;
     int frames_left;
     double hardware_latency;
+    // See SoundIoOutStreamCoreAudio.
+    bool planar;
+    struct SoundIoCoreAudioWorkgroup workgroup;
     struct SoundIoChannelArea areas[SOUNDIO_MAX_CHANNELS];
 };
 
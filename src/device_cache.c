@@ -0,0 +1,391 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "device_cache.h"
+#include "util.h"
+
+#include <stdio.h>
+
+// File layout, all integers native endian:
+//
+//     char     magic[4]   "SIOC"
+//     uint32   version    SOUNDIO_DEVICE_CACHE_VERSION
+//     uint32   backend
+//     uint64   key
+//     uint64   payload_hash, FNV-1a of the payload
+//     uint32   payload_size
+//     payload:
+//         int32    default_input_index
+//         int32    default_output_index
+//         uint32   device_count
+//         device_count devices
+//
+// A file written on a machine of the other endianness fails the version
+// check and is ignored.
+
+static const char cache_magic[4] = {'S', 'I', 'O', 'C'};
+#define CACHE_HEADER_SIZE (4 + 4 + 4 + 8 + 8 + 4)
+
+struct CacheWriter {
+    char *buf;
+    size_t len;
+    size_t capacity;
+    bool oom;
+};
+
+struct CacheReader {
+    const char *ptr;
+    const char *end;
+    bool error;
+};
+
+static void write_bytes(struct CacheWriter *w, const void *data, size_t len) {
+    if (w->oom)
+        return;
+    if (w->len + len > w->capacity) {
+        size_t new_capacity = soundio_int_max(4096, (int)w->capacity);
+        while (new_capacity < w->len + len)
+            new_capacity *= 2;
+        char *new_buf = REALLOCATE_NONZERO(char, w->buf, new_capacity);
+        if (!new_buf) {
+            w->oom = true;
+            return;
+        }
+        w->buf = new_buf;
+        w->capacity = new_capacity;
+    }
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+}
+
+static void write_u32(struct CacheWriter *w, uint32_t x) {
+    write_bytes(w, &x, sizeof(x));
+}
+
+static void write_i32(struct CacheWriter *w, int32_t x) {
+    write_bytes(w, &x, sizeof(x));
+}
+
+static void write_f64(struct CacheWriter *w, double x) {
+    write_bytes(w, &x, sizeof(x));
+}
+
+static void write_str(struct CacheWriter *w, const char *str) {
+    uint32_t len = str ? strlen(str) : 0;
+    write_u32(w, len);
+    write_bytes(w, str, len);
+}
+
+static void write_layout(struct CacheWriter *w, const struct SoundIoChannelLayout *layout) {
+    write_i32(w, layout->channel_count);
+    for (int i = 0; i < layout->channel_count; i += 1)
+        write_i32(w, layout->channels[i]);
+}
+
+static void write_device(struct CacheWriter *w, const struct SoundIoDevice *device) {
+    write_str(w, device->id);
+    write_str(w, device->name);
+    write_i32(w, device->aim);
+    write_i32(w, device->is_raw);
+    write_i32(w, device->probe_error);
+
+    write_i32(w, device->layout_count);
+    for (int i = 0; i < device->layout_count; i += 1)
+        write_layout(w, &device->layouts[i]);
+    write_layout(w, &device->current_layout);
+
+    write_i32(w, device->format_count);
+    for (int i = 0; i < device->format_count; i += 1)
+        write_i32(w, device->formats[i]);
+    write_i32(w, device->current_format);
+
+    write_i32(w, device->sample_rate_count);
+    for (int i = 0; i < device->sample_rate_count; i += 1) {
+        write_i32(w, device->sample_rates[i].min);
+        write_i32(w, device->sample_rates[i].max);
+    }
+    write_i32(w, device->sample_rate_current);
+
+    write_f64(w, device->software_latency_min);
+    write_f64(w, device->software_latency_max);
+    write_f64(w, device->software_latency_current);
+}
+
+static void read_bytes(struct CacheReader *r, void *data, size_t len) {
+    if (r->error || (size_t)(r->end - r->ptr) < len) {
+        r->error = true;
+        memset(data, 0, len);
+        return;
+    }
+    memcpy(data, r->ptr, len);
+    r->ptr += len;
+}
+
+static uint32_t read_u32(struct CacheReader *r) {
+    uint32_t x;
+    read_bytes(r, &x, sizeof(x));
+    return x;
+}
+
+static int32_t read_i32(struct CacheReader *r) {
+    int32_t x;
+    read_bytes(r, &x, sizeof(x));
+    return x;
+}
+
+static double read_f64(struct CacheReader *r) {
+    double x;
+    read_bytes(r, &x, sizeof(x));
+    return x;
+}
+
+// Reads a count which is followed by at least `count * min_item_size` bytes.
+static int read_count(struct CacheReader *r, int max_count, size_t min_item_size) {
+    int32_t count = read_i32(r);
+    if (count < 0 || count > max_count ||
+        (size_t)count * min_item_size > (size_t)(r->end - r->ptr))
+    {
+        r->error = true;
+        return 0;
+    }
+    return count;
+}
+
+static char *read_str(struct CacheReader *r, struct SoundIoDevicePrivate *dev) {
+    uint32_t len = read_u32(r);
+    if (r->error || len > (size_t)(r->end - r->ptr)) {
+        r->error = true;
+        return NULL;
+    }
+    char *str = DEVICE_ALLOCATE(dev, char, len + 1);
+    if (!str) {
+        r->error = true;
+        return NULL;
+    }
+    read_bytes(r, str, len);
+    str[len] = 0;
+    return str;
+}
+
+static void read_layout(struct CacheReader *r, struct SoundIoChannelLayout *layout) {
+    layout->channel_count = read_count(r, SOUNDIO_MAX_CHANNELS, 4);
+    for (int i = 0; i < layout->channel_count; i += 1)
+        layout->channels[i] = (enum SoundIoChannelId)read_i32(r);
+    soundio_channel_layout_detect_builtin(layout);
+}
+
+static struct SoundIoDevice *read_device(struct CacheReader *r, struct SoundIo *soundio,
+        struct SoundIoDevicesInfo *devices_info)
+{
+    struct SoundIoDevicePrivate *dev = soundio_device_create(devices_info);
+    if (!dev) {
+        r->error = true;
+        return NULL;
+    }
+    struct SoundIoDevice *device = &dev->pub;
+    device->soundio = soundio;
+
+    device->id = read_str(r, dev);
+    device->name = read_str(r, dev);
+    device->aim = (enum SoundIoDeviceAim)read_i32(r);
+    device->is_raw = read_i32(r);
+    device->probe_error = read_i32(r);
+
+    device->layout_count = read_count(r, 1024, 4);
+    if (device->layout_count > 0) {
+        device->layouts = DEVICE_ALLOCATE(dev, struct SoundIoChannelLayout, device->layout_count);
+        if (!device->layouts)
+            r->error = true;
+        for (int i = 0; i < device->layout_count && !r->error; i += 1)
+            read_layout(r, &device->layouts[i]);
+    }
+    read_layout(r, &device->current_layout);
+
+    device->format_count = read_count(r, 1024, 4);
+    if (device->format_count > 0) {
+        device->formats = DEVICE_ALLOCATE(dev, enum SoundIoFormat, device->format_count);
+        if (!device->formats)
+            r->error = true;
+        for (int i = 0; i < device->format_count && !r->error; i += 1)
+            device->formats[i] = (enum SoundIoFormat)read_i32(r);
+    }
+    device->current_format = (enum SoundIoFormat)read_i32(r);
+
+    device->sample_rate_count = read_count(r, 1024, 8);
+    if (device->sample_rate_count == 1) {
+        device->sample_rates = &dev->prealloc_sample_rate_range;
+    } else if (device->sample_rate_count > 1) {
+        device->sample_rates = DEVICE_ALLOCATE(dev, struct SoundIoSampleRateRange, device->sample_rate_count);
+        if (!device->sample_rates)
+            r->error = true;
+    }
+    for (int i = 0; i < device->sample_rate_count && !r->error; i += 1) {
+        device->sample_rates[i].min = read_i32(r);
+        device->sample_rates[i].max = read_i32(r);
+    }
+    device->sample_rate_current = read_i32(r);
+
+    device->software_latency_min = read_f64(r);
+    device->software_latency_max = read_f64(r);
+    device->software_latency_current = read_f64(r);
+
+    if (r->error || !device->id || !device->name ||
+        (device->aim != SoundIoDeviceAimInput && device->aim != SoundIoDeviceAimOutput))
+    {
+        r->error = true;
+        soundio_device_unref(device);
+        return NULL;
+    }
+    return device;
+}
+
+int soundio_device_cache_save(const char *path, enum SoundIoBackend backend, uint64_t key,
+        const struct SoundIoDevicesInfo *devices_info)
+{
+    struct CacheWriter w = {0};
+
+    // header, filled in below when the payload is known
+    char header[CACHE_HEADER_SIZE] = {0};
+    write_bytes(&w, header, sizeof(header));
+
+    write_i32(&w, devices_info->default_input_index);
+    write_i32(&w, devices_info->default_output_index);
+    write_u32(&w, devices_info->input_devices.length + devices_info->output_devices.length);
+    for (int i = 0; i < devices_info->input_devices.length; i += 1)
+        write_device(&w, devices_info->input_devices.items[i]);
+    for (int i = 0; i < devices_info->output_devices.length; i += 1)
+        write_device(&w, devices_info->output_devices.items[i]);
+
+    if (w.oom) {
+        free(w.buf);
+        return SoundIoErrorNoMem;
+    }
+
+    uint32_t version = SOUNDIO_DEVICE_CACHE_VERSION;
+    uint32_t backend_u32 = backend;
+    uint32_t payload_size = w.len - CACHE_HEADER_SIZE;
+    uint64_t payload_hash = soundio_fnv1a(SOUNDIO_FNV1A_INIT, w.buf + CACHE_HEADER_SIZE, payload_size);
+    char *h = w.buf;
+    memcpy(h, cache_magic, 4); h += 4;
+    memcpy(h, &version, 4); h += 4;
+    memcpy(h, &backend_u32, 4); h += 4;
+    memcpy(h, &key, 8); h += 8;
+    memcpy(h, &payload_hash, 8); h += 8;
+    memcpy(h, &payload_size, 4);
+
+    // Another process may read the file at any time, so it is replaced in
+    // one step. If two processes save at once, the hash rejects a mixed up
+    // file on the next load.
+    char *tmp_path = soundio_alloc_sprintf(NULL, "%s.tmp", path);
+    if (!tmp_path) {
+        free(w.buf);
+        return SoundIoErrorNoMem;
+    }
+
+    int err = 0;
+    FILE *f = fopen(tmp_path, "wb");
+    if (!f) {
+        err = SoundIoErrorSystemResources;
+    } else {
+        if (fwrite(w.buf, 1, w.len, f) != w.len)
+            err = SoundIoErrorSystemResources;
+        if (fclose(f))
+            err = SoundIoErrorSystemResources;
+#if defined(_WIN32)
+        if (!err)
+            remove(path);
+#endif
+        if (!err && rename(tmp_path, path))
+            err = SoundIoErrorSystemResources;
+        if (err)
+            remove(tmp_path);
+    }
+
+    free(tmp_path);
+    free(w.buf);
+    return err;
+}
+
+struct SoundIoDevicesInfo *soundio_device_cache_load(struct SoundIo *soundio, const char *path,
+        enum SoundIoBackend backend, uint64_t key)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+
+    char header[CACHE_HEADER_SIZE];
+    if (fread(header, 1, CACHE_HEADER_SIZE, f) != CACHE_HEADER_SIZE) {
+        fclose(f);
+        return NULL;
+    }
+
+    uint32_t version;
+    uint32_t file_backend;
+    uint64_t file_key;
+    uint64_t payload_hash;
+    uint32_t payload_size;
+    const char *h = header + 4;
+    memcpy(&version, h, 4); h += 4;
+    memcpy(&file_backend, h, 4); h += 4;
+    memcpy(&file_key, h, 8); h += 8;
+    memcpy(&payload_hash, h, 8); h += 8;
+    memcpy(&payload_size, h, 4);
+
+    if (memcmp(header, cache_magic, 4) != 0 || version != SOUNDIO_DEVICE_CACHE_VERSION ||
+        file_backend != (uint32_t)backend || file_key != key)
+    {
+        fclose(f);
+        return NULL;
+    }
+
+    char *payload = ALLOCATE_NONZERO(char, payload_size);
+    if (!payload) {
+        fclose(f);
+        return NULL;
+    }
+    size_t amt_read = fread(payload, 1, payload_size, f);
+    fclose(f);
+    if (amt_read != payload_size ||
+        soundio_fnv1a(SOUNDIO_FNV1A_INIT, payload, payload_size) != payload_hash)
+    {
+        free(payload);
+        return NULL;
+    }
+
+    struct SoundIoDevicesInfo *devices_info = soundio_devices_info_create(soundio);
+    if (!devices_info) {
+        free(payload);
+        return NULL;
+    }
+
+    struct CacheReader r = {payload, payload + payload_size, false};
+    devices_info->default_input_index = read_i32(&r);
+    devices_info->default_output_index = read_i32(&r);
+    uint32_t device_count = read_u32(&r);
+    for (uint32_t i = 0; i < device_count && !r.error; i += 1) {
+        struct SoundIoDevice *device = read_device(&r, soundio, devices_info);
+        if (!device)
+            break;
+        struct SoundIoListDevicePtr *device_list = (device->aim == SoundIoDeviceAimInput) ?
+            &devices_info->input_devices : &devices_info->output_devices;
+        if (SoundIoListDevicePtr_append(device_list, device)) {
+            soundio_device_unref(device);
+            r.error = true;
+        }
+    }
+    free(payload);
+
+    if (r.error ||
+        devices_info->default_input_index >= devices_info->input_devices.length ||
+        devices_info->default_output_index >= devices_info->output_devices.length)
+    {
+        soundio_destroy_devices_info(devices_info);
+        return NULL;
+    }
+
+    return devices_info;
+}
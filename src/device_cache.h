@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#ifndef SOUNDIO_DEVICE_CACHE_H
+#define SOUNDIO_DEVICE_CACHE_H
+
+#include "soundio_private.h"
+
+#include <stdint.h>
+
+// Bump when the file layout changes. Files of other versions are ignored.
+#define SOUNDIO_DEVICE_CACHE_VERSION 1
+
+// Writes the devices and their capabilities to `path`. `key` identifies the
+// system state the devices were probed in, for example a hash of the sound
+// cards present. The file is written to a temporary name and then renamed
+// over `path`.
+int soundio_device_cache_save(const char *path, enum SoundIoBackend backend, uint64_t key,
+        const struct SoundIoDevicesInfo *devices_info);
+
+// Returns NULL if the file is missing, damaged, from another version or
+// backend, or was saved with a different `key`. Backend data of the
+// returned devices is zeroed, so only backends which open devices by
+// SoundIoDevice::id can use them.
+struct SoundIoDevicesInfo *soundio_device_cache_load(struct SoundIo *soundio, const char *path,
+        enum SoundIoBackend backend, uint64_t key);
+
+#endif
@@ -11,146 +11,411 @@
 #include <stdio.h>
 #include <string.h>
 
-static void playback_thread_run(void *arg) {
-    struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate *)arg;
+SOUNDIO_MAKE_LIST_DEF(struct SoundIoDummyClockStream *, SoundIoListDummyClockStreamPtr, SOUNDIO_LIST_STATIC)
+
+// With the real time clock streams are paced by the system clock. With the
+// virtual clocks each stream keeps its own time: the free running clock adds
+// one period per iteration without waiting, and the manual clock follows
+// SoundIoDummy::clock_time, which only ::soundio_dummy_advance moves.
+
+static double clock_now(struct SoundIoPrivate *si, struct SoundIoDummyClockStream *clock) {
+    if (si->pub.dummy_clock == SoundIoDummyClockRealTime)
+        return soundio_os_get_time();
+    return clock->time;
+}
+
+// Waits until the stream should process its next period. Returns false when
+// the stream is being destroyed while waiting on the manual clock; the other
+// clocks rely on the caller checking its abort flag.
+static bool clock_wait(struct SoundIoPrivate *si, struct SoundIoDummyClockStream *clock,
+        struct SoundIoOsCond *cond, double start_time, double period_duration, bool paused)
+{
+    struct SoundIoDummy *sid = &si->backend_data.dummy;
+    switch (si->pub.dummy_clock) {
+    case SoundIoDummyClockRealTime: {
+        double now = soundio_os_get_time();
+        double time_passed = now - start_time;
+        double next_period = start_time + ceil_dbl(time_passed / period_duration) * period_duration;
+        soundio_os_cond_timed_wait(cond, NULL, next_period - now);
+        return true;
+    }
+    case SoundIoDummyClockFreeRun:
+        // nothing happens while paused, so don't spin
+        if (paused)
+            soundio_os_cond_timed_wait(cond, NULL, period_duration);
+        clock->time += period_duration;
+        return true;
+    case SoundIoDummyClockManual: {
+        soundio_os_mutex_lock(sid->clock_mutex);
+        clock->waiting = true;
+        soundio_os_cond_signal(sid->clock_done_cond, sid->clock_mutex);
+        while (!clock->aborted && sid->clock_time <= clock->time)
+            soundio_os_cond_wait(clock->cond, sid->clock_mutex);
+        clock->waiting = false;
+        // one period at a time, as if the time had passed in real time
+        clock->time = soundio_double_min(clock->time + period_duration, sid->clock_time);
+        bool aborted = clock->aborted;
+        soundio_os_mutex_unlock(sid->clock_mutex);
+        return !aborted;
+    }
+    }
+    return true;
+}
+
+// A stream in poll mode is not waited for by ::soundio_dummy_advance, which
+// would otherwise block until the application processes it.
+static int clock_stream_start(struct SoundIoPrivate *si, struct SoundIoDummyClockStream *clock, bool poll_mode) {
+    struct SoundIoDummy *sid = &si->backend_data.dummy;
+    clock->time = 0.0;
+    clock->waiting = false;
+    clock->aborted = false;
+    if (si->pub.dummy_clock != SoundIoDummyClockManual)
+        return 0;
+
+    if (poll_mode) {
+        soundio_os_mutex_lock(sid->clock_mutex);
+        clock->time = sid->clock_time;
+        soundio_os_mutex_unlock(sid->clock_mutex);
+        return 0;
+    }
+
+    clock->cond = soundio_os_cond_create();
+    if (!clock->cond)
+        return SoundIoErrorNoMem;
+    soundio_os_mutex_lock(sid->clock_mutex);
+    clock->time = sid->clock_time;
+    int err = SoundIoListDummyClockStreamPtr_append(&sid->clock_streams, clock);
+    soundio_os_mutex_unlock(sid->clock_mutex);
+    if (err) {
+        soundio_os_cond_destroy(clock->cond);
+        clock->cond = NULL;
+        return SoundIoErrorNoMem;
+    }
+    return 0;
+}
+
+// Wakes the stream thread if it is waiting on the manual clock. Call before
+// joining the thread.
+static void clock_stream_abort(struct SoundIoPrivate *si, struct SoundIoDummyClockStream *clock) {
+    struct SoundIoDummy *sid = &si->backend_data.dummy;
+    if (!clock->cond)
+        return;
+    soundio_os_mutex_lock(sid->clock_mutex);
+    clock->aborted = true;
+    soundio_os_cond_signal(clock->cond, sid->clock_mutex);
+    soundio_os_mutex_unlock(sid->clock_mutex);
+}
+
+// Call after the stream thread has exited.
+static void clock_stream_remove(struct SoundIoPrivate *si, struct SoundIoDummyClockStream *clock) {
+    struct SoundIoDummy *sid = &si->backend_data.dummy;
+    if (!clock->cond)
+        return;
+    soundio_os_mutex_lock(sid->clock_mutex);
+    for (int i = 0; i < sid->clock_streams.length; i += 1) {
+        if (SoundIoListDummyClockStreamPtr_val_at(&sid->clock_streams, i) == clock) {
+            SoundIoListDummyClockStreamPtr_swap_remove(&sid->clock_streams, i);
+            break;
+        }
+    }
+    soundio_os_cond_signal(sid->clock_done_cond, sid->clock_mutex);
+    soundio_os_mutex_unlock(sid->clock_mutex);
+    soundio_os_cond_destroy(clock->cond);
+    clock->cond = NULL;
+}
+
+// The poll mode counterpart of clock_wait, which moves the clock of the stream
+// without waiting. The manual clock catches up with SoundIoDummy::clock_time
+// at once rather than a period at a time.
+static void clock_poll(struct SoundIoPrivate *si, struct SoundIoDummyClockStream *clock,
+        double period_duration)
+{
+    struct SoundIoDummy *sid = &si->backend_data.dummy;
+    switch (si->pub.dummy_clock) {
+    case SoundIoDummyClockRealTime:
+        break;
+    case SoundIoDummyClockFreeRun:
+        clock->time += period_duration;
+        break;
+    case SoundIoDummyClockManual:
+        soundio_os_mutex_lock(sid->clock_mutex);
+        clock->time = sid->clock_time;
+        soundio_os_mutex_unlock(sid->clock_mutex);
+        break;
+    }
+}
+
+int soundio_dummy_advance(struct SoundIo *soundio, double seconds) {
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)soundio;
+    struct SoundIoDummy *sid = &si->backend_data.dummy;
+    if (soundio->current_backend != SoundIoBackendDummy ||
+        soundio->dummy_clock != SoundIoDummyClockManual || seconds < 0.0)
+    {
+        return SoundIoErrorInvalid;
+    }
+
+    soundio_os_mutex_lock(sid->clock_mutex);
+    sid->clock_time += seconds;
+    for (int i = 0; i < sid->clock_streams.length; i += 1) {
+        struct SoundIoDummyClockStream *clock = SoundIoListDummyClockStreamPtr_val_at(&sid->clock_streams, i);
+        soundio_os_cond_signal(clock->cond, sid->clock_mutex);
+    }
+    for (;;) {
+        bool done = true;
+        for (int i = 0; i < sid->clock_streams.length; i += 1) {
+            struct SoundIoDummyClockStream *clock = SoundIoListDummyClockStreamPtr_val_at(&sid->clock_streams, i);
+            if (!clock->waiting || clock->time < sid->clock_time) {
+                done = false;
+                break;
+            }
+        }
+        if (done)
+            break;
+        soundio_os_cond_wait(sid->clock_done_cond, sid->clock_mutex);
+    }
+    soundio_os_mutex_unlock(sid->clock_mutex);
+    return 0;
+}
+
+// The input of a synchronous duplex stream records as much as its output
+// plays, on the output's thread, right before the output is written.
+static void capture_for_duplex(struct SoundIoInStreamPrivate *is, int frame_count) {
+    struct SoundIoInStream *instream = &is->pub;
+    struct SoundIoInStreamDummy *isd = &is->backend_data.dummy;
+    if (SOUNDIO_ATOMIC_LOAD(isd->pause_requested))
+        return;
+
+    int fill_bytes = soundio_ring_buffer_fill_count(&isd->ring_buffer);
+    int free_bytes = soundio_ring_buffer_capacity(&isd->ring_buffer) - fill_bytes;
+    int free_frames = free_bytes / instream->bytes_per_frame;
+    int write_count = soundio_int_min(frame_count, free_frames);
+    soundio_ring_buffer_advance_write_ptr(&isd->ring_buffer, write_count * instream->bytes_per_frame);
+    if (frame_count > free_frames)
+        soundio_instream_run_overflow_callback(is);
+
+    int fill_frames = fill_bytes / instream->bytes_per_frame + write_count;
+    if (fill_frames > 0) {
+        isd->frames_left = fill_frames;
+        soundio_instream_run_read_callback(is, 0, fill_frames);
+    }
+}
+
+// How many frames to write with `fill_frames` in the buffer. With a latency
+// step in SoundIoOutStream::xrun_policy only the policy's latency is kept
+// queued; otherwise the whole buffer.
+static int playback_free_frames(struct SoundIoOutStreamPrivate *os, int fill_frames) {
     struct SoundIoOutStream *outstream = &os->pub;
     struct SoundIoOutStreamDummy *osd = &os->backend_data.dummy;
+    int target_frames = osd->buffer_frame_count;
+    if (os->xrun_tracker.adaptive) {
+        int latency_frames = ceil_dbl_to_int(os->xrun_tracker.latency * outstream->sample_rate);
+        target_frames = soundio_int_min(latency_frames, target_frames);
+    }
+    return soundio_int_max(0, target_frames - fill_frames);
+}
+
+// Fills the buffer before the stream plays.
+static void playback_begin(struct SoundIoOutStreamPrivate *os) {
+    struct SoundIoOutStream *outstream = &os->pub;
+    struct SoundIoOutStreamDummy *osd = &os->backend_data.dummy;
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)outstream->device->soundio;
+
+    soundio_outstream_xrun_policy_start(os, outstream->software_latency,
+            osd->buffer_frame_count / (double)outstream->sample_rate, clock_now(si, &osd->clock));
 
     int fill_bytes = soundio_ring_buffer_fill_count(&osd->ring_buffer);
-    int free_bytes = soundio_ring_buffer_capacity(&osd->ring_buffer) - fill_bytes;
-    int free_frames = free_bytes / outstream->bytes_per_frame;
+    int free_frames = playback_free_frames(os, fill_bytes / outstream->bytes_per_frame);
     osd->frames_left = free_frames;
     if (free_frames > 0)
-        outstream->write_callback(outstream, 0, free_frames);
-    double start_time = soundio_os_get_time();
-    long frames_consumed = 0;
+        soundio_outstream_run_write_callback(os, 0, free_frames);
+    // the virtual clocks have nothing to do with the deadline of a stream group
+    if (si->pub.dummy_clock == SoundIoDummyClockRealTime)
+        soundio_os_sleep_until(os->start_deadline);
+    osd->start_time = clock_now(si, &osd->clock);
+    osd->frames_consumed = 0;
+}
 
-    while (SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(osd->abort_flag)) {
-        double now = soundio_os_get_time();
-        double time_passed = now - start_time;
-        double next_period = start_time +
-            ceil_dbl(time_passed / osd->period_duration) * osd->period_duration;
-        double relative_time = next_period - now;
-        soundio_os_cond_timed_wait(osd->cond, NULL, relative_time);
-        if (!SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(osd->clear_buffer_flag)) {
-            soundio_ring_buffer_clear(&osd->ring_buffer);
-            int free_bytes = soundio_ring_buffer_capacity(&osd->ring_buffer);
-            int free_frames = free_bytes / outstream->bytes_per_frame;
-            osd->frames_left = free_frames;
-            if (free_frames > 0)
-                outstream->write_callback(outstream, 0, free_frames);
-            frames_consumed = 0;
-            start_time = soundio_os_get_time();
-            continue;
+// Plays the frames that are due by the stream's clock and refills the buffer.
+static void playback_step(struct SoundIoOutStreamPrivate *os) {
+    struct SoundIoOutStream *outstream = &os->pub;
+    struct SoundIoOutStreamDummy *osd = &os->backend_data.dummy;
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)outstream->device->soundio;
+
+    double now = clock_now(si, &osd->clock);
+    if (!SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(osd->clear_buffer_flag)) {
+        soundio_ring_buffer_clear(&osd->ring_buffer);
+        int free_frames = playback_free_frames(os, 0);
+        osd->frames_left = free_frames;
+        if (free_frames > 0)
+            soundio_outstream_run_write_callback(os, 0, free_frames);
+        osd->frames_consumed = 0;
+        osd->start_time = clock_now(si, &osd->clock);
+        return;
+    }
+
+    if (SOUNDIO_ATOMIC_LOAD(osd->pause_requested)) {
+        osd->start_time = now;
+        osd->frames_consumed = 0;
+        return;
+    }
+
+    int fill_bytes = soundio_ring_buffer_fill_count(&osd->ring_buffer);
+    int fill_frames = fill_bytes / outstream->bytes_per_frame;
+    int free_frames = playback_free_frames(os, fill_frames);
+
+    double total_time = clock_now(si, &osd->clock) - osd->start_time;
+    long total_frames = total_time * outstream->sample_rate;
+    int frames_to_kill = total_frames - osd->frames_consumed;
+    int read_count = soundio_int_min(frames_to_kill, fill_frames);
+    int byte_count = read_count * outstream->bytes_per_frame;
+    soundio_ring_buffer_advance_read_ptr(&osd->ring_buffer, byte_count);
+    osd->frames_consumed += read_count;
+    if (os->duplex_input && frames_to_kill > 0)
+        capture_for_duplex(os->duplex_input, frames_to_kill);
+
+    if (frames_to_kill > fill_frames) {
+        soundio_outstream_run_underflow_callback(os);
+        soundio_outstream_xrun_policy_xrun(os, now);
+        int refill_frames = free_frames;
+        if (outstream->xrun_policy.prefill > 0.0) {
+            int prefill_frames = ceil_dbl_to_int(outstream->xrun_policy.prefill * outstream->sample_rate);
+            refill_frames = soundio_int_min(refill_frames, prefill_frames);
         }
+        osd->frames_left = refill_frames;
+        if (refill_frames > 0)
+            soundio_outstream_run_write_callback(os, 0, refill_frames);
+        osd->frames_consumed = 0;
+        osd->start_time = clock_now(si, &osd->clock);
+        return;
+    }
 
-        if (SOUNDIO_ATOMIC_LOAD(osd->pause_requested)) {
-            start_time = now;
-            frames_consumed = 0;
-            continue;
+    soundio_outstream_xrun_policy_tick(os, now);
+    if (free_frames > 0) {
+        // The device played its frames_consumed-th frame right on time.
+        if (si->pub.dummy_clock == SoundIoDummyClockRealTime) {
+            soundio_outstream_report_timestamp(os,
+                    osd->start_time + osd->frames_consumed / (double)outstream->sample_rate,
+                    (fill_frames - read_count) / (double)outstream->sample_rate);
         }
+        osd->frames_left = free_frames;
+        soundio_outstream_run_write_callback(os, 0, free_frames);
+    }
+}
+
+static void playback_thread_run(void *arg) {
+    struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate *)arg;
+    struct SoundIoOutStreamDummy *osd = &os->backend_data.dummy;
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)os->pub.device->soundio;
 
-        int fill_bytes = soundio_ring_buffer_fill_count(&osd->ring_buffer);
-        int fill_frames = fill_bytes / outstream->bytes_per_frame;
-        int free_bytes = soundio_ring_buffer_capacity(&osd->ring_buffer) - fill_bytes;
-        int free_frames = free_bytes / outstream->bytes_per_frame;
-
-        double total_time = soundio_os_get_time() - start_time;
-        long total_frames = total_time * outstream->sample_rate;
-        int frames_to_kill = total_frames - frames_consumed;
-        int read_count = soundio_int_min(frames_to_kill, fill_frames);
-        int byte_count = read_count * outstream->bytes_per_frame;
-        soundio_ring_buffer_advance_read_ptr(&osd->ring_buffer, byte_count);
-        frames_consumed += read_count;
-
-        if (frames_to_kill > fill_frames) {
-            outstream->underflow_callback(outstream);
-            osd->frames_left = free_frames;
-            if (free_frames > 0)
-                outstream->write_callback(outstream, 0, free_frames);
-            frames_consumed = 0;
-            start_time = soundio_os_get_time();
-        } else if (free_frames > 0) {
-            osd->frames_left = free_frames;
-            outstream->write_callback(outstream, 0, free_frames);
+    playback_begin(os);
+    while (SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(osd->abort_flag)) {
+        if (!clock_wait(si, &osd->clock, osd->cond, osd->start_time, osd->period_duration,
+                    SOUNDIO_ATOMIC_LOAD(osd->pause_requested)))
+        {
+            break;
         }
+        playback_step(os);
+    }
+}
+
+// Records the frames that are due by the stream's clock and hands them out.
+static void capture_step(struct SoundIoInStreamPrivate *is) {
+    struct SoundIoInStream *instream = &is->pub;
+    struct SoundIoInStreamDummy *isd = &is->backend_data.dummy;
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)instream->device->soundio;
+
+    double now = clock_now(si, &isd->clock);
+
+    if (SOUNDIO_ATOMIC_LOAD(isd->pause_requested)) {
+        isd->start_time = now;
+        isd->frames_consumed = 0;
+        return;
+    }
+
+    int fill_bytes = soundio_ring_buffer_fill_count(&isd->ring_buffer);
+    int free_bytes = soundio_ring_buffer_capacity(&isd->ring_buffer) - fill_bytes;
+    int fill_frames = fill_bytes / instream->bytes_per_frame;
+    int free_frames = free_bytes / instream->bytes_per_frame;
+
+    double total_time = clock_now(si, &isd->clock) - isd->start_time;
+    long total_frames = total_time * instream->sample_rate;
+    int frames_to_kill = total_frames - isd->frames_consumed;
+    int write_count = soundio_int_min(frames_to_kill, free_frames);
+    int byte_count = write_count * instream->bytes_per_frame;
+    soundio_ring_buffer_advance_write_ptr(&isd->ring_buffer, byte_count);
+    isd->frames_consumed += write_count;
+
+    if (frames_to_kill > free_frames) {
+        soundio_instream_run_overflow_callback(is);
+        isd->frames_consumed = 0;
+        isd->start_time = clock_now(si, &isd->clock);
+    } else if (si->pub.dummy_clock == SoundIoDummyClockRealTime) {
+        soundio_instream_report_timestamp(is,
+                isd->start_time + isd->frames_consumed / (double)instream->sample_rate,
+                (fill_frames + write_count) / (double)instream->sample_rate);
+    }
+    if (fill_frames > 0) {
+        isd->frames_left = fill_frames;
+        soundio_instream_run_read_callback(is, 0, fill_frames);
     }
 }
 
+static void capture_begin(struct SoundIoInStreamPrivate *is) {
+    struct SoundIoInStreamDummy *isd = &is->backend_data.dummy;
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)is->pub.device->soundio;
+
+    if (si->pub.dummy_clock == SoundIoDummyClockRealTime)
+        soundio_os_sleep_until(is->start_deadline);
+    isd->frames_consumed = 0;
+    isd->start_time = clock_now(si, &isd->clock);
+}
+
 static void capture_thread_run(void *arg) {
     struct SoundIoInStreamPrivate *is = (struct SoundIoInStreamPrivate *)arg;
-    struct SoundIoInStream *instream = &is->pub;
     struct SoundIoInStreamDummy *isd = &is->backend_data.dummy;
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)is->pub.device->soundio;
 
-    long frames_consumed = 0;
-    double start_time = soundio_os_get_time();
+    capture_begin(is);
     while (SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(isd->abort_flag)) {
-        double now = soundio_os_get_time();
-        double time_passed = now - start_time;
-        double next_period = start_time +
-            ceil_dbl(time_passed / isd->period_duration) * isd->period_duration;
-        double relative_time = next_period - now;
-        soundio_os_cond_timed_wait(isd->cond, NULL, relative_time);
-
-        if (SOUNDIO_ATOMIC_LOAD(isd->pause_requested)) {
-            start_time = now;
-            frames_consumed = 0;
-            continue;
-        }
-
-        int fill_bytes = soundio_ring_buffer_fill_count(&isd->ring_buffer);
-        int free_bytes = soundio_ring_buffer_capacity(&isd->ring_buffer) - fill_bytes;
-        int fill_frames = fill_bytes / instream->bytes_per_frame;
-        int free_frames = free_bytes / instream->bytes_per_frame;
-
-        double total_time = soundio_os_get_time() - start_time;
-        long total_frames = total_time * instream->sample_rate;
-        int frames_to_kill = total_frames - frames_consumed;
-        int write_count = soundio_int_min(frames_to_kill, free_frames);
-        int byte_count = write_count * instream->bytes_per_frame;
-        soundio_ring_buffer_advance_write_ptr(&isd->ring_buffer, byte_count);
-        frames_consumed += write_count;
-
-        if (frames_to_kill > free_frames) {
-            instream->overflow_callback(instream);
-            frames_consumed = 0;
-            start_time = soundio_os_get_time();
-        }
-        if (fill_frames > 0) {
-            isd->frames_left = fill_frames;
-            instream->read_callback(instream, 0, fill_frames);
+        if (!clock_wait(si, &isd->clock, isd->cond, isd->start_time, isd->period_duration,
+                    SOUNDIO_ATOMIC_LOAD(isd->pause_requested)))
+        {
+            break;
         }
+        capture_step(is);
     }
 }
 
 static void destroy_dummy(struct SoundIoPrivate *si) {
     struct SoundIoDummy *sid = &si->backend_data.dummy;
 
-    if (sid->cond)
-        soundio_os_cond_destroy(sid->cond);
+    if (sid->clock_done_cond)
+        soundio_os_cond_destroy(sid->clock_done_cond);
+
+    if (sid->clock_mutex)
+        soundio_os_mutex_destroy(sid->clock_mutex);
 
-    if (sid->mutex)
-        soundio_os_mutex_destroy(sid->mutex);
+    SoundIoListDummyClockStreamPtr_deinit(&sid->clock_streams);
 }
 
-static void flush_events_dummy(struct SoundIoPrivate *si) {
-    struct SoundIo *soundio = &si->pub;
+// The devices are there from the start, and nothing is ever posted but
+// wakeups.
+static void emit_devices_dummy(struct SoundIoPrivate *si) {
     struct SoundIoDummy *sid = &si->backend_data.dummy;
     if (sid->devices_emitted)
         return;
     sid->devices_emitted = true;
-    soundio->on_devices_change(soundio);
+    soundio_emit_devices_change(si, NULL);
 }
 
-static void wait_events_dummy(struct SoundIoPrivate *si) {
-    struct SoundIoDummy *sid = &si->backend_data.dummy;
-    flush_events_dummy(si);
-    soundio_os_cond_wait(sid->cond, NULL);
+static void flush_events_dummy(struct SoundIoPrivate *si) {
+    emit_devices_dummy(si);
+    soundio_events_flush(si);
 }
 
-static void wakeup_dummy(struct SoundIoPrivate *si) {
-    struct SoundIoDummy *sid = &si->backend_data.dummy;
-    soundio_os_cond_signal(sid->cond, NULL);
+static void wait_events_dummy(struct SoundIoPrivate *si) {
+    emit_devices_dummy(si);
+    soundio_events_wait(si);
 }
 
 static void force_device_scan_dummy(struct SoundIoPrivate *si) {
@@ -163,8 +428,10 @@ static void outstream_destroy_dummy(struct SoundIoPrivate *si, struct SoundIoOut
     if (osd->thread) {
         SOUNDIO_ATOMIC_FLAG_CLEAR(osd->abort_flag);
         soundio_os_cond_signal(osd->cond, NULL);
+        clock_stream_abort(si, &osd->clock);
         soundio_os_thread_destroy(osd->thread);
         osd->thread = NULL;
+        clock_stream_remove(si, &osd->clock);
     }
     soundio_os_cond_destroy(osd->cond);
     osd->cond = NULL;
@@ -179,6 +446,7 @@ static int outstream_open_dummy(struct SoundIoPrivate *si, struct SoundIoOutStre
 
     SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(osd->clear_buffer_flag);
     SOUNDIO_ATOMIC_STORE(osd->pause_requested, false);
+    outstream->buffer_access = SoundIoBufferAccessDirect;
 
     if (outstream->software_latency == 0.0) {
         outstream->software_latency = soundio_double_clamp(
@@ -187,15 +455,31 @@ static int outstream_open_dummy(struct SoundIoPrivate *si, struct SoundIoOutStre
 
     osd->period_duration = outstream->software_latency / 2.0;
 
+    // with a latency step the buffer holds the most the latency grows to,
+    // and software_latency stays what is queued at first
+    const struct SoundIoXrunPolicy *policy = &outstream->xrun_policy;
+    double buffer_duration = outstream->software_latency;
+    bool adaptive = policy->latency_step > 0.0;
+    if (adaptive) {
+        double latency_max = (policy->latency_max > 0.0) ? policy->latency_max :
+            outstream->software_latency + policy->latency_step;
+        buffer_duration = soundio_double_max(buffer_duration, latency_max);
+    }
+
     int err;
-    int buffer_size = outstream->bytes_per_frame * outstream->sample_rate * outstream->software_latency;
+    int buffer_size = outstream->bytes_per_frame * outstream->sample_rate * buffer_duration;
     if ((err = soundio_ring_buffer_init(&osd->ring_buffer, buffer_size))) {
         outstream_destroy_dummy(si, os);
         return err;
     }
+    if (si->pub.lock_memory && (err = soundio_os_lock_mirrored_memory(&osd->ring_buffer.mem))) {
+        outstream_destroy_dummy(si, os);
+        return err;
+    }
     int actual_capacity = soundio_ring_buffer_capacity(&osd->ring_buffer);
     osd->buffer_frame_count = actual_capacity / outstream->bytes_per_frame;
-    outstream->software_latency = osd->buffer_frame_count / (double) outstream->sample_rate;
+    if (!adaptive)
+        outstream->software_latency = osd->buffer_frame_count / (double) outstream->sample_rate;
 
     osd->cond = soundio_os_cond_create();
     if (!osd->cond) {
@@ -214,18 +498,50 @@ static int outstream_pause_dummy(struct SoundIoPrivate *si, struct SoundIoOutStr
 
 static int outstream_start_dummy(struct SoundIoPrivate *si, struct SoundIoOutStreamPrivate *os) {
     struct SoundIoOutStreamDummy *osd = &os->backend_data.dummy;
-    struct SoundIo *soundio = &si->pub;
     assert(!osd->thread);
     SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(osd->abort_flag);
     int err;
-    if ((err = soundio_os_thread_create(playback_thread_run, os,
-                    soundio->emit_rtprio_warning, &osd->thread)))
+    if ((err = clock_stream_start(si, &osd->clock, os->pub.poll_mode)))
+        return err;
+    if (os->pub.poll_mode) {
+        osd->poll_started = true;
+        osd->poll_begun = false;
+        return 0;
+    }
+    if ((err = soundio_outstream_thread_create(os, playback_thread_run,
+                    osd->period_duration, &osd->thread)))
     {
+        clock_stream_remove(si, &osd->clock);
         return err;
     }
     return 0;
 }
 
+// There is nothing to wait on; the application processes the stream at
+// least once a period instead.
+static int outstream_get_poll_descriptors_dummy(struct SoundIoPrivate *si, struct SoundIoOutStreamPrivate *os,
+        struct SoundIoPollDescriptor *descriptors, int *count)
+{
+    *count = 0;
+    return 0;
+}
+
+static int outstream_process_dummy(struct SoundIoPrivate *si, struct SoundIoOutStreamPrivate *os,
+        const struct SoundIoPollDescriptor *descriptors, int count)
+{
+    struct SoundIoOutStreamDummy *osd = &os->backend_data.dummy;
+    if (!osd->poll_started || count != 0)
+        return SoundIoErrorInvalid;
+    clock_poll(si, &osd->clock, osd->period_duration);
+    if (!osd->poll_begun) {
+        osd->poll_begun = true;
+        playback_begin(os);
+        return 0;
+    }
+    playback_step(os);
+    return 0;
+}
+
 static int outstream_begin_write_dummy(struct SoundIoPrivate *si,
         struct SoundIoOutStreamPrivate *os, struct SoundIoChannelArea **out_areas, int *frame_count)
 {
@@ -277,8 +593,10 @@ static void instream_destroy_dummy(struct SoundIoPrivate *si, struct SoundIoInSt
     if (isd->thread) {
         SOUNDIO_ATOMIC_FLAG_CLEAR(isd->abort_flag);
         soundio_os_cond_signal(isd->cond, NULL);
+        clock_stream_abort(si, &isd->clock);
         soundio_os_thread_destroy(isd->thread);
         isd->thread = NULL;
+        clock_stream_remove(si, &isd->clock);
     }
     soundio_os_cond_destroy(isd->cond);
     isd->cond = NULL;
@@ -292,6 +610,7 @@ static int instream_open_dummy(struct SoundIoPrivate *si, struct SoundIoInStream
     struct SoundIoDevice *device = instream->device;
 
     SOUNDIO_ATOMIC_STORE(isd->pause_requested, false);
+    instream->buffer_access = SoundIoBufferAccessDirect;
 
     if (instream->software_latency == 0.0) {
         instream->software_latency = soundio_double_clamp(
@@ -308,6 +627,10 @@ static int instream_open_dummy(struct SoundIoPrivate *si, struct SoundIoInStream
         instream_destroy_dummy(si, is);
         return err;
     }
+    if (si->pub.lock_memory && (err = soundio_os_lock_mirrored_memory(&isd->ring_buffer.mem))) {
+        instream_destroy_dummy(si, is);
+        return err;
+    }
 
     int actual_capacity = soundio_ring_buffer_capacity(&isd->ring_buffer);
     isd->buffer_frame_count = actual_capacity / instream->bytes_per_frame;
@@ -329,18 +652,54 @@ static int instream_pause_dummy(struct SoundIoPrivate *si, struct SoundIoInStrea
 
 static int instream_start_dummy(struct SoundIoPrivate *si, struct SoundIoInStreamPrivate *is) {
     struct SoundIoInStreamDummy *isd = &is->backend_data.dummy;
-    struct SoundIo *soundio = &si->pub;
     assert(!isd->thread);
+    // the output of the duplex stream drives it
+    if (is->duplex_output)
+        return 0;
     SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(isd->abort_flag);
     int err;
-    if ((err = soundio_os_thread_create(capture_thread_run, is,
-                    soundio->emit_rtprio_warning, &isd->thread)))
+    if ((err = clock_stream_start(si, &isd->clock, is->pub.poll_mode)))
+        return err;
+    if (is->pub.poll_mode) {
+        isd->poll_started = true;
+        isd->poll_begun = false;
+        return 0;
+    }
+    if ((err = soundio_instream_thread_create(is, capture_thread_run,
+                    isd->period_duration, &isd->thread)))
     {
+        clock_stream_remove(si, &isd->clock);
         return err;
     }
     return 0;
 }
 
+static int instream_get_poll_descriptors_dummy(struct SoundIoPrivate *si, struct SoundIoInStreamPrivate *is,
+        struct SoundIoPollDescriptor *descriptors, int *count)
+{
+    *count = 0;
+    return 0;
+}
+
+static int instream_process_dummy(struct SoundIoPrivate *si, struct SoundIoInStreamPrivate *is,
+        const struct SoundIoPollDescriptor *descriptors, int count)
+{
+    struct SoundIoInStreamDummy *isd = &is->backend_data.dummy;
+    // the output drives the input of a duplex stream
+    if (is->duplex_output)
+        return 0;
+    if (!isd->poll_started || count != 0)
+        return SoundIoErrorInvalid;
+    clock_poll(si, &isd->clock, isd->period_duration);
+    if (!isd->poll_begun) {
+        isd->poll_begun = true;
+        capture_begin(is);
+        return 0;
+    }
+    capture_step(is);
+    return 0;
+}
+
 static int instream_begin_read_dummy(struct SoundIoPrivate *si,
         struct SoundIoInStreamPrivate *is, struct SoundIoChannelArea **out_areas, int *frame_count)
 {
@@ -380,8 +739,9 @@ static int instream_get_latency_dummy(struct SoundIoPrivate *si, struct SoundIoI
 }
 
 static int set_all_device_formats(struct SoundIoDevice *device) {
+    struct SoundIoDevicePrivate *dev = (struct SoundIoDevicePrivate *)device;
     device->format_count = 18;
-    device->formats = ALLOCATE(enum SoundIoFormat, device->format_count);
+    device->formats = DEVICE_ALLOCATE(dev, enum SoundIoFormat, device->format_count);
     if (!device->formats)
         return SoundIoErrorNoMem;
 
@@ -416,8 +776,9 @@ static void set_all_device_sample_rates(struct SoundIoDevice *device) {
 }
 
 static int set_all_device_channel_layouts(struct SoundIoDevice *device) {
+    struct SoundIoDevicePrivate *dev = (struct SoundIoDevicePrivate *)device;
     device->layout_count = soundio_channel_layout_builtin_count();
-    device->layouts = ALLOCATE(struct SoundIoChannelLayout, device->layout_count);
+    device->layouts = DEVICE_ALLOCATE(dev, struct SoundIoChannelLayout, device->layout_count);
     if (!device->layouts)
         return SoundIoErrorNoMem;
     for (int i = 0; i < device->layout_count; i += 1)
@@ -425,24 +786,45 @@ static int set_all_device_channel_layouts(struct SoundIoDevice *device) {
     return 0;
 }
 
+static int probe_device_dummy(struct SoundIoDevice *device) {
+    int err;
+    if ((err = set_all_device_channel_layouts(device)))
+        return err;
+    if ((err = set_all_device_formats(device)))
+        return err;
+    set_all_device_sample_rates(device);
+
+    device->software_latency_current = 0.1;
+    device->software_latency_min = 0.01;
+    device->software_latency_max = 4.0;
+
+    device->sample_rate_current = 48000;
+    return 0;
+}
+
+static int device_probe_dummy(struct SoundIoPrivate *si, struct SoundIoDevicePrivate *dev) {
+    return probe_device_dummy(&dev->pub);
+}
+
 int soundio_dummy_init(struct SoundIoPrivate *si) {
     struct SoundIo *soundio = &si->pub;
     struct SoundIoDummy *sid = &si->backend_data.dummy;
 
-    sid->mutex = soundio_os_mutex_create();
-    if (!sid->mutex) {
+    sid->clock_mutex = soundio_os_mutex_create();
+    if (!sid->clock_mutex) {
         destroy_dummy(si);
         return SoundIoErrorNoMem;
     }
 
-    sid->cond = soundio_os_cond_create();
-    if (!sid->cond) {
+    sid->clock_done_cond = soundio_os_cond_create();
+    if (!sid->clock_done_cond) {
         destroy_dummy(si);
         return SoundIoErrorNoMem;
     }
+    sid->clock_time = 0.0;
 
     assert(!si->safe_devices_info);
-    si->safe_devices_info = ALLOCATE(struct SoundIoDevicesInfo, 1);
+    si->safe_devices_info = soundio_devices_info_create(soundio);
     if (!si->safe_devices_info) {
         destroy_dummy(si);
         return SoundIoErrorNoMem;
@@ -453,42 +835,32 @@ int soundio_dummy_init(struct SoundIoPrivate *si) {
 
     // create output device
     {
-        struct SoundIoDevicePrivate *dev = ALLOCATE(struct SoundIoDevicePrivate, 1);
+        struct SoundIoDevicePrivate *dev = soundio_device_create(si->safe_devices_info);
         if (!dev) {
             destroy_dummy(si);
             return SoundIoErrorNoMem;
         }
         struct SoundIoDevice *device = &dev->pub;
 
-        device->ref_count = 1;
         device->soundio = soundio;
-        device->id = strdup("dummy-out");
-        device->name = strdup("Dummy Output Device");
+        device->id = soundio_device_strdup(dev, "dummy-out");
+        device->name = soundio_device_strdup(dev, "Dummy Output Device");
         if (!device->id || !device->name) {
             soundio_device_unref(device);
             destroy_dummy(si);
             return SoundIoErrorNoMem;
         }
 
+        device->aim = SoundIoDeviceAimOutput;
+
         int err;
-        if ((err = set_all_device_channel_layouts(device))) {
+        if (soundio->lazy_device_probing) {
+            dev->needs_probe = true;
+        } else if ((err = probe_device_dummy(device))) {
             soundio_device_unref(device);
             destroy_dummy(si);
             return err;
         }
-        if ((err = set_all_device_formats(device))) {
-            soundio_device_unref(device);
-            destroy_dummy(si);
-            return err;
-        }
-        set_all_device_sample_rates(device);
-
-        device->software_latency_current = 0.1;
-        device->software_latency_min = 0.01;
-        device->software_latency_max = 4.0;
-
-        device->sample_rate_current = 48000;
-        device->aim = SoundIoDeviceAimOutput;
 
         if (SoundIoListDevicePtr_append(&si->safe_devices_info->output_devices, device)) {
             soundio_device_unref(device);
@@ -499,41 +871,32 @@ int soundio_dummy_init(struct SoundIoPrivate *si) {
 
     // create input device
     {
-        struct SoundIoDevicePrivate *dev = ALLOCATE(struct SoundIoDevicePrivate, 1);
+        struct SoundIoDevicePrivate *dev = soundio_device_create(si->safe_devices_info);
         if (!dev) {
             destroy_dummy(si);
             return SoundIoErrorNoMem;
         }
         struct SoundIoDevice *device = &dev->pub;
 
-        device->ref_count = 1;
         device->soundio = soundio;
-        device->id = strdup("dummy-in");
-        device->name = strdup("Dummy Input Device");
+        device->id = soundio_device_strdup(dev, "dummy-in");
+        device->name = soundio_device_strdup(dev, "Dummy Input Device");
         if (!device->id || !device->name) {
             soundio_device_unref(device);
             destroy_dummy(si);
             return SoundIoErrorNoMem;
         }
 
-        int err;
-        if ((err = set_all_device_channel_layouts(device))) {
-            soundio_device_unref(device);
-            destroy_dummy(si);
-            return err;
-        }
+        device->aim = SoundIoDeviceAimInput;
 
-        if ((err = set_all_device_formats(device))) {
+        int err;
+        if (soundio->lazy_device_probing) {
+            dev->needs_probe = true;
+        } else if ((err = probe_device_dummy(device))) {
             soundio_device_unref(device);
             destroy_dummy(si);
             return err;
         }
-        set_all_device_sample_rates(device);
-        device->software_latency_current = 0.1;
-        device->software_latency_min = 0.01;
-        device->software_latency_max = 4.0;
-        device->sample_rate_current = 48000;
-        device->aim = SoundIoDeviceAimInput;
 
         if (SoundIoListDevicePtr_append(&si->safe_devices_info->input_devices, device)) {
             soundio_device_unref(device);
@@ -541,13 +904,16 @@ int soundio_dummy_init(struct SoundIoPrivate *si) {
             return SoundIoErrorNoMem;
         }
     }
-
+    si->have_devices = true;
 
     si->destroy = destroy_dummy;
     si->flush_events = flush_events_dummy;
     si->wait_events = wait_events_dummy;
-    si->wakeup = wakeup_dummy;
+    si->wakeup = soundio_events_wakeup;
     si->force_device_scan = force_device_scan_dummy;
+    si->device_probe = device_probe_dummy;
+    si->waits_for_start_deadline = true;
+    si->drives_duplex_input = true;
 
     si->outstream_open = outstream_open_dummy;
     si->outstream_destroy = outstream_destroy_dummy;
@@ -557,6 +923,8 @@ int soundio_dummy_init(struct SoundIoPrivate *si) {
     si->outstream_clear_buffer = outstream_clear_buffer_dummy;
     si->outstream_pause = outstream_pause_dummy;
     si->outstream_get_latency = outstream_get_latency_dummy;
+    si->outstream_get_poll_descriptors = outstream_get_poll_descriptors_dummy;
+    si->outstream_process = outstream_process_dummy;
 
     si->instream_open = instream_open_dummy;
     si->instream_destroy = instream_destroy_dummy;
@@ -565,6 +933,8 @@ int soundio_dummy_init(struct SoundIoPrivate *si) {
     si->instream_end_read = instream_end_read_dummy;
     si->instream_pause = instream_pause_dummy;
     si->instream_get_latency = instream_get_latency_dummy;
+    si->instream_get_poll_descriptors = instream_get_poll_descriptors_dummy;
+    si->instream_process = instream_process_dummy;
 
     return 0;
 }
@@ -12,14 +12,34 @@
 #include "os.h"
 #include "ring_buffer.h"
 #include "atomics.h"
+#include "list.h"
 
 struct SoundIoPrivate;
 int soundio_dummy_init(struct SoundIoPrivate *si);
 
-struct SoundIoDummy {
-    struct SoundIoOsMutex *mutex;
+// The virtual clock of one stream, for SoundIoDummyClockFreeRun and
+// SoundIoDummyClockManual. With the manual clock the fields are protected
+// by SoundIoDummy::clock_mutex.
+struct SoundIoDummyClockStream {
+    double time;
+    // Signaled when SoundIoDummy::clock_time moves or the stream is destroyed.
     struct SoundIoOsCond *cond;
+    // The stream has processed everything up to `time` and is waiting.
+    bool waiting;
+    bool aborted;
+};
+
+SOUNDIO_MAKE_LIST_STRUCT(struct SoundIoDummyClockStream *, SoundIoListDummyClockStreamPtr, SOUNDIO_LIST_STATIC)
+
+struct SoundIoDummy {
     bool devices_emitted;
+
+    // For SoundIoDummyClockManual.
+    struct SoundIoOsMutex *clock_mutex;
+    // Signaled when a stream starts waiting or goes away.
+    struct SoundIoOsCond *clock_done_cond;
+    double clock_time;
+    struct SoundIoListDummyClockStreamPtr clock_streams;
 };
 
 struct SoundIoDeviceDummy { int make_the_struct_not_empty; };
@@ -33,10 +53,15 @@ struct SoundIoOutStreamDummy {
     int frames_left;
     int write_frame_count;
     struct SoundIoRingBuffer ring_buffer;
-    double playback_start_time;
+    double start_time;
+    long frames_consumed;
+    // Poll mode: started, and filled before the first period.
+    bool poll_started;
+    bool poll_begun;
     struct SoundIoAtomicFlag clear_buffer_flag;
     struct SoundIoAtomicBool pause_requested;
     struct SoundIoChannelArea areas[SOUNDIO_MAX_CHANNELS];
+    struct SoundIoDummyClockStream clock;
 };
 
 struct SoundIoInStreamDummy {
@@ -48,8 +73,13 @@ struct SoundIoInStreamDummy {
     int read_frame_count;
     int buffer_frame_count;
     struct SoundIoRingBuffer ring_buffer;
+    double start_time;
+    long frames_consumed;
+    bool poll_started;
+    bool poll_begun;
     struct SoundIoAtomicBool pause_requested;
     struct SoundIoChannelArea areas[SOUNDIO_MAX_CHANNELS];
+    struct SoundIoDummyClockStream clock;
 };
 
 #endif
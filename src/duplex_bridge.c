@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "duplex_bridge.h"
+#include "util.h"
+
+#include <string.h>
+
+// The controller turns the error between the buffered and the target
+// latency, in seconds, into how much faster than nominal to consume input.
+// With these gains it settles within a few seconds and follows drift well
+// under the half percent it may correct.
+static const double bridge_kp = 0.5;
+static const double bridge_ki = 0.06;
+static const double bridge_max_adjust = 0.005;
+// The fill level jumps by a period whenever either side runs, so the
+// controller sees it averaged over this many seconds.
+static const double bridge_smoothing = 0.25;
+
+struct SoundIoDuplexBridge *soundio_duplex_bridge_create(struct SoundIoInStream *instream,
+        struct SoundIoOutStream *outstream, double target_latency)
+{
+    if (instream->layout.channel_count != outstream->write_layout.channel_count || !(target_latency > 0.0))
+        return NULL;
+
+    struct SoundIoDuplexBridge *bridge = ALLOCATE(struct SoundIoDuplexBridge, 1);
+    if (!bridge)
+        return NULL;
+
+    bridge->instream = instream;
+    bridge->outstream = outstream;
+    bridge->channel_count = instream->layout.channel_count;
+    bridge->target_latency = target_latency;
+    bridge->target_frames = ceil_dbl_to_int(target_latency * instream->sample_rate);
+    bridge->frame_size = bridge->channel_count * sizeof(float);
+    SOUNDIO_ATOMIC_STORE(bridge->overflowed, false);
+    SOUNDIO_ATOMIC_STORE(bridge->latency_ns, 0);
+    SOUNDIO_ATOMIC_STORE(bridge->adjust_ppb, 0);
+    SOUNDIO_ATOMIC_STORE(bridge->underflow_count, 0);
+    SOUNDIO_ATOMIC_STORE(bridge->overflow_count, 0);
+
+    // room for the target plus a buffer's worth arriving on either side
+    double seconds = 2.0 * target_latency + instream->software_latency + outstream->software_latency;
+    int capacity = ceil_dbl_to_int(seconds * instream->sample_rate) + 2 * SOUNDIO_RESAMPLE_CHUNK_SIZE;
+    if (soundio_ring_buffer_init_ex(&bridge->ring_buffer, capacity * bridge->frame_size,
+                SoundIoRingBufferFlagStrictRoles))
+    {
+        soundio_duplex_bridge_destroy(bridge);
+        return NULL;
+    }
+
+    bridge->to_float = soundio_converter_create(instream->format, SoundIoFormatFloat32NE, 0);
+    bridge->from_float = soundio_converter_create(SoundIoFormatFloat32NE, outstream->format, 0);
+    bridge->resampler = soundio_resampler_create_adjustable(bridge->channel_count,
+            instream->sample_rate, outstream->sample_rate, outstream->resample_quality);
+    if (!bridge->to_float || !bridge->from_float || !bridge->resampler) {
+        soundio_duplex_bridge_destroy(bridge);
+        return NULL;
+    }
+
+    return bridge;
+}
+
+void soundio_duplex_bridge_destroy(struct SoundIoDuplexBridge *bridge) {
+    if (!bridge)
+        return;
+    soundio_ring_buffer_deinit(&bridge->ring_buffer);
+    soundio_converter_destroy(bridge->to_float);
+    soundio_converter_destroy(bridge->from_float);
+    soundio_resampler_destroy(bridge->resampler);
+    free(bridge);
+}
+
+static void set_interleaved_areas(struct SoundIoChannelArea *areas, char *ptr, int channel_count) {
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        areas[ch].ptr = ptr + ch * sizeof(float);
+        areas[ch].step = channel_count * sizeof(float);
+    }
+}
+
+static void set_planar_areas(struct SoundIoChannelArea *areas, float *buf, int channel_count) {
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        areas[ch].ptr = (char *)(buf + ch * SOUNDIO_RESAMPLE_CHUNK_SIZE);
+        areas[ch].step = sizeof(float);
+    }
+}
+
+static void offset_areas(struct SoundIoChannelArea *dest, const struct SoundIoChannelArea *src,
+        int channel_count, int offset)
+{
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        dest[ch].ptr = src[ch].ptr + offset * src[ch].step;
+        dest[ch].step = src[ch].step;
+    }
+}
+
+int soundio_duplex_bridge_push(struct SoundIoDuplexBridge *bridge,
+        const struct SoundIoChannelArea *areas, int frame_count)
+{
+    struct SoundIoRingBuffer *rb = &bridge->ring_buffer;
+    int free_frames = soundio_ring_buffer_free_count(rb) / bridge->frame_size;
+    int count = soundio_int_min(frame_count, free_frames);
+    if (count < frame_count) {
+        SOUNDIO_ATOMIC_FETCH_ADD(bridge->overflow_count, 1);
+        SOUNDIO_ATOMIC_STORE(bridge->overflowed, true);
+    }
+
+    char *ptr = soundio_ring_buffer_write_ptr(rb);
+    if (areas) {
+        struct SoundIoChannelArea dest[SOUNDIO_MAX_CHANNELS];
+        set_interleaved_areas(dest, ptr, bridge->channel_count);
+        soundio_converter_convert(bridge->to_float, areas, dest, bridge->channel_count, count);
+    } else {
+        memset(ptr, 0, count * bridge->frame_size);
+    }
+    soundio_ring_buffer_advance_write_ptr(rb, count * bridge->frame_size);
+    return count;
+}
+
+// Writes `out_buf`, `count` frames of it, to `areas` in the output format.
+static void write_out_buf(struct SoundIoDuplexBridge *bridge, const struct SoundIoChannelArea *areas,
+        int offset, int count)
+{
+    struct SoundIoChannelArea src[SOUNDIO_MAX_CHANNELS];
+    struct SoundIoChannelArea dest[SOUNDIO_MAX_CHANNELS];
+    set_planar_areas(src, bridge->out_buf, bridge->channel_count);
+    offset_areas(dest, areas, bridge->channel_count, offset);
+    soundio_converter_convert(bridge->from_float, src, dest, bridge->channel_count, count);
+}
+
+static void write_silence(struct SoundIoDuplexBridge *bridge, const struct SoundIoChannelArea *areas,
+        int offset, int frame_count)
+{
+    memset(bridge->out_buf, 0, sizeof(bridge->out_buf));
+    while (offset < frame_count) {
+        int count = soundio_int_min(frame_count - offset, SOUNDIO_RESAMPLE_CHUNK_SIZE);
+        write_out_buf(bridge, areas, offset, count);
+        offset += count;
+    }
+}
+
+static void update_controller(struct SoundIoDuplexBridge *bridge, int fill_frames, int frame_count) {
+    double dt = frame_count / (double)bridge->outstream->sample_rate;
+    double latency = fill_frames / (double)bridge->instream->sample_rate +
+        soundio_resampler_get_delay(bridge->resampler);
+    bridge->latency += (latency - bridge->latency) * dt / (dt + bridge_smoothing);
+
+    double error = bridge->latency - bridge->target_latency;
+    bridge->integral = soundio_double_clamp(-bridge_max_adjust,
+            bridge->integral + bridge_ki * error * dt, bridge_max_adjust);
+    double adjust = soundio_double_clamp(-bridge_max_adjust,
+            bridge_kp * error + bridge->integral, bridge_max_adjust);
+    soundio_resampler_set_adjust(bridge->resampler, 1.0 + adjust);
+
+    SOUNDIO_ATOMIC_STORE(bridge->latency_ns, (uint64_t)(bridge->latency * 1e9));
+    SOUNDIO_ATOMIC_STORE(bridge->adjust_ppb, (long)(adjust * 1e9));
+}
+
+void soundio_duplex_bridge_pull(struct SoundIoDuplexBridge *bridge,
+        const struct SoundIoChannelArea *areas, int frame_count)
+{
+    struct SoundIoRingBuffer *rb = &bridge->ring_buffer;
+    int fill_frames = soundio_ring_buffer_fill_count(rb) / bridge->frame_size;
+
+    if (SOUNDIO_ATOMIC_EXCHANGE(bridge->overflowed, false))
+        bridge->primed = false;
+    if (!bridge->primed) {
+        if (fill_frames < bridge->target_frames) {
+            write_silence(bridge, areas, 0, frame_count);
+            return;
+        }
+        // start from exactly the target, whatever piled up while waiting
+        int excess = fill_frames - bridge->target_frames;
+        soundio_ring_buffer_advance_read_ptr(rb, excess * bridge->frame_size);
+        fill_frames = bridge->target_frames;
+        soundio_resampler_reset(bridge->resampler);
+        bridge->latency = bridge->target_latency;
+        bridge->primed = true;
+    }
+
+    update_controller(bridge, fill_frames, frame_count);
+
+    int done = 0;
+    while (done < frame_count) {
+        struct SoundIoChannelArea src[SOUNDIO_MAX_CHANNELS];
+        struct SoundIoChannelArea dest[SOUNDIO_MAX_CHANNELS];
+        set_interleaved_areas(src, soundio_ring_buffer_read_ptr(rb), bridge->channel_count);
+        set_planar_areas(dest, bridge->out_buf, bridge->channel_count);
+        int in_count = soundio_ring_buffer_fill_count(rb) / bridge->frame_size;
+        int want = soundio_int_min(frame_count - done, SOUNDIO_RESAMPLE_CHUNK_SIZE);
+        int out_count = want;
+        soundio_resampler_process(bridge->resampler, src, &in_count, dest, &out_count);
+        soundio_ring_buffer_advance_read_ptr(rb, in_count * bridge->frame_size);
+        write_out_buf(bridge, areas, done, out_count);
+        done += out_count;
+
+        if (out_count < want) {
+            // the input fell behind; wait for the target to build up again
+            write_silence(bridge, areas, done, frame_count);
+            SOUNDIO_ATOMIC_FETCH_ADD(bridge->underflow_count, 1);
+            bridge->primed = false;
+            return;
+        }
+    }
+}
+
+int soundio_duplex_bridge_capture(struct SoundIoDuplexBridge *bridge,
+        int frame_count_min, int frame_count_max)
+{
+    struct SoundIoInStream *instream = bridge->instream;
+    int frames_left = frame_count_max;
+    while (frames_left > 0) {
+        struct SoundIoChannelArea *areas;
+        int frame_count = frames_left;
+        int err;
+        if ((err = soundio_instream_begin_read(instream, &areas, &frame_count)))
+            return err;
+        if (!frame_count)
+            break;
+        // a NULL area is a hole left by an overflow, which is silence
+        soundio_duplex_bridge_push(bridge, areas, frame_count);
+        if ((err = soundio_instream_end_read(instream)))
+            return err;
+        frames_left -= frame_count;
+    }
+    return 0;
+}
+
+int soundio_duplex_bridge_play(struct SoundIoDuplexBridge *bridge,
+        int frame_count_min, int frame_count_max)
+{
+    struct SoundIoOutStream *outstream = bridge->outstream;
+    int frames_left = frame_count_max;
+    while (frames_left > 0) {
+        struct SoundIoChannelArea *areas;
+        int frame_count = frames_left;
+        int err;
+        if ((err = soundio_outstream_begin_write(outstream, &areas, &frame_count)))
+            return err;
+        if (!frame_count)
+            break;
+        soundio_duplex_bridge_pull(bridge, areas, frame_count);
+        if ((err = soundio_outstream_end_write(outstream)))
+            return err;
+        frames_left -= frame_count;
+    }
+    return 0;
+}
+
+double soundio_duplex_bridge_get_latency(struct SoundIoDuplexBridge *bridge) {
+    return SOUNDIO_ATOMIC_LOAD(bridge->latency_ns) / 1e9;
+}
+
+double soundio_duplex_bridge_get_ratio(struct SoundIoDuplexBridge *bridge) {
+    return 1.0 + SOUNDIO_ATOMIC_LOAD(bridge->adjust_ppb) / 1e9;
+}
+
+int soundio_duplex_bridge_get_underflow_count(struct SoundIoDuplexBridge *bridge) {
+    return SOUNDIO_ATOMIC_LOAD(bridge->underflow_count);
+}
+
+int soundio_duplex_bridge_get_overflow_count(struct SoundIoDuplexBridge *bridge) {
+    return SOUNDIO_ATOMIC_LOAD(bridge->overflow_count);
+}
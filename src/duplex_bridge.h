@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#ifndef SOUNDIO_DUPLEX_BRIDGE_H
+#define SOUNDIO_DUPLEX_BRIDGE_H
+
+#include "soundio_internal.h"
+#include "ring_buffer.h"
+#include "resample.h"
+#include "atomics.h"
+
+struct SoundIoDuplexBridge {
+    struct SoundIoInStream *instream;
+    struct SoundIoOutStream *outstream;
+    int channel_count;
+    double target_latency;
+    // target_latency in input frames.
+    int target_frames;
+
+    // Interleaved float frames at the input rate. The capture side writes
+    // and the play side reads.
+    struct SoundIoRingBuffer ring_buffer;
+    int frame_size;
+
+    // Only used by the capture side.
+    struct SoundIoConverter *to_float;
+
+    // Only used by the play side.
+    struct SoundIoResampler *resampler;
+    struct SoundIoConverter *from_float;
+    float out_buf[SOUNDIO_MAX_CHANNELS * SOUNDIO_RESAMPLE_CHUNK_SIZE];
+    // false while waiting for target_latency to be recorded
+    bool primed;
+    double latency;
+    double integral;
+
+    // Set by the capture side when it drops input, so that the play side
+    // starts over from the target instead of slowly draining the excess.
+    struct SoundIoAtomicBool overflowed;
+    // For the getters, in nanoseconds and parts per billion.
+    struct SoundIoAtomicUInt64 latency_ns;
+    struct SoundIoAtomicLong adjust_ppb;
+    struct SoundIoAtomicInt underflow_count;
+    struct SoundIoAtomicInt overflow_count;
+};
+
+// The halves of capture and play which do not touch the streams. `areas`
+// hold frames in the input stream's format; NULL pushes silence. Returns how
+// many frames fit.
+int soundio_duplex_bridge_push(struct SoundIoDuplexBridge *bridge,
+        const struct SoundIoChannelArea *areas, int frame_count);
+// Writes exactly `frame_count` frames in the output stream's format.
+void soundio_duplex_bridge_pull(struct SoundIoDuplexBridge *bridge,
+        const struct SoundIoChannelArea *areas, int frame_count);
+
+#endif
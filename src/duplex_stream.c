@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "duplex_stream.h"
+#include "convert.h"
+#include "util.h"
+
+#include <string.h>
+
+#define SILENCE_CHUNK_SIZE 256
+
+static const float zeros[SOUNDIO_MAX_CHANNELS * SILENCE_CHUNK_SIZE];
+
+static void set_interleaved_areas(struct SoundIoChannelArea *areas, char *ptr,
+        const struct SoundIoInStream *instream)
+{
+    for (int ch = 0; ch < instream->layout.channel_count; ch += 1) {
+        areas[ch].ptr = ptr + ch * instream->bytes_per_sample;
+        areas[ch].step = instream->bytes_per_frame;
+    }
+}
+
+// Writes `frame_count` frames of silence in the input format to `ptr`. Zero
+// bytes are not silence for the unsigned formats, so it is converted.
+static void write_silence(struct SoundIoDuplexStreamPrivate *dsp, char *ptr, int frame_count) {
+    struct SoundIoInStream *instream = dsp->pub.instream;
+    const int channel_count = instream->layout.channel_count;
+    struct SoundIoChannelArea src[SOUNDIO_MAX_CHANNELS];
+    struct SoundIoChannelArea dest[SOUNDIO_MAX_CHANNELS];
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        src[ch].ptr = (char *)(zeros + ch * SILENCE_CHUNK_SIZE);
+        src[ch].step = sizeof(float);
+    }
+    while (frame_count > 0) {
+        int count = soundio_int_min(frame_count, SILENCE_CHUNK_SIZE);
+        set_interleaved_areas(dest, ptr, instream);
+        soundio_converter_convert(dsp->silence, src, dest, channel_count, count);
+        ptr += count * instream->bytes_per_frame;
+        frame_count -= count;
+    }
+}
+
+static void duplex_read_callback(struct SoundIoInStream *instream, int frame_count_min, int frame_count_max) {
+    struct SoundIoInStreamPrivate *is = (struct SoundIoInStreamPrivate *)instream;
+    struct SoundIoDuplexStreamPrivate *dsp = is->duplex;
+    struct SoundIoRingBuffer *rb = &dsp->ring_buffer;
+    const int bytes_per_frame = instream->bytes_per_frame;
+
+    int frames_left = frame_count_max;
+    while (frames_left > 0) {
+        struct SoundIoChannelArea *areas;
+        int frame_count = frames_left;
+        int err;
+        if ((err = soundio_instream_begin_read(instream, &areas, &frame_count))) {
+            instream->error_callback(instream, err);
+            return;
+        }
+        if (!frame_count)
+            break;
+
+        int count = soundio_int_min(frame_count, soundio_ring_buffer_free_count(rb) / bytes_per_frame);
+        char *ptr = soundio_ring_buffer_write_ptr(rb);
+        if (areas) {
+            struct SoundIoChannelArea dest[SOUNDIO_MAX_CHANNELS];
+            set_interleaved_areas(dest, ptr, instream);
+            soundio_converter_convert(dsp->interleave, areas, dest, instream->layout.channel_count, count);
+        } else {
+            // a hole left by an overflow
+            write_silence(dsp, ptr, count);
+        }
+        soundio_ring_buffer_advance_write_ptr(rb, count * bytes_per_frame);
+        if (count < frame_count)
+            soundio_instream_run_overflow_callback(is);
+
+        if ((err = soundio_instream_end_read(instream))) {
+            instream->error_callback(instream, err);
+            return;
+        }
+        frames_left -= frame_count;
+    }
+    if (frames_left < frame_count_max)
+        SOUNDIO_ATOMIC_STORE(dsp->input_started, true);
+}
+
+static void duplex_write_callback(struct SoundIoOutStream *outstream, int frame_count_min, int frame_count_max) {
+    struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate *)outstream;
+    struct SoundIoDuplexStreamPrivate *dsp = os->duplex;
+    struct SoundIoDuplexStream *duplex = &dsp->pub;
+    struct SoundIoInStream *instream = duplex->instream;
+    struct SoundIoRingBuffer *rb = &dsp->ring_buffer;
+    const int bytes_per_frame = instream->bytes_per_frame;
+
+    int fill_frames = soundio_ring_buffer_fill_count(rb) / bytes_per_frame;
+    int total = SOUNDIO_ATOMIC_LOAD(dsp->input_started) ?
+        soundio_int_clamp(frame_count_min, fill_frames, frame_count_max) : frame_count_max;
+    while (total > 0) {
+        struct SoundIoChannelArea *out_areas;
+        int frame_count = soundio_int_min(total, dsp->pad_frame_count);
+        int err;
+        if ((err = soundio_outstream_begin_write(outstream, &out_areas, &frame_count))) {
+            if (err != SoundIoErrorUnderflow)
+                outstream->error_callback(outstream, err);
+            return;
+        }
+        if (!frame_count)
+            break;
+
+        char *in_ptr = soundio_ring_buffer_read_ptr(rb);
+        int in_count = soundio_int_min(frame_count, soundio_ring_buffer_fill_count(rb) / bytes_per_frame);
+        if (in_count < frame_count) {
+            memcpy(dsp->pad_buf, in_ptr, in_count * bytes_per_frame);
+            write_silence(dsp, dsp->pad_buf + in_count * bytes_per_frame, frame_count - in_count);
+            in_ptr = dsp->pad_buf;
+        }
+        struct SoundIoChannelArea in_areas[SOUNDIO_MAX_CHANNELS];
+        set_interleaved_areas(in_areas, in_ptr, instream);
+        duplex->duplex_callback(duplex, in_areas, out_areas, frame_count);
+        soundio_ring_buffer_advance_read_ptr(rb, in_count * bytes_per_frame);
+
+        if ((err = soundio_outstream_end_write(outstream))) {
+            if (err != SoundIoErrorUnderflow)
+                outstream->error_callback(outstream, err);
+            return;
+        }
+        total -= frame_count;
+    }
+}
+
+// Only a synchronous duplex stream can be resized, since nothing else runs
+// while its one thread is in the backend's callback. Otherwise a stream
+// whose period may grow is counted at the largest it can be.
+static double latency_for(struct SoundIoDuplexStream *duplex, struct SoundIoDevice *device,
+        double software_latency, int sample_rate)
+{
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)device->soundio;
+    if (duplex->synchronous || !si->max_period_frame_count)
+        return software_latency;
+    return soundio_double_max(software_latency, si->max_period_frame_count / (double)sample_rate);
+}
+
+// enough for both buffers to be full at once, twice over
+static int pad_frame_count_for(struct SoundIoDuplexStream *duplex) {
+    struct SoundIoInStream *instream = duplex->instream;
+    struct SoundIoOutStream *outstream = duplex->outstream;
+    double seconds = 2.0 * (
+        latency_for(duplex, instream->device, instream->software_latency, instream->sample_rate) +
+        latency_for(duplex, outstream->device, outstream->software_latency, outstream->sample_rate));
+    return ceil_dbl_to_int(seconds * instream->sample_rate) + SILENCE_CHUNK_SIZE;
+}
+
+struct SoundIoDuplexStream *soundio_duplex_stream_create(struct SoundIoDevice *in_device,
+        struct SoundIoDevice *out_device)
+{
+    struct SoundIoDuplexStreamPrivate *dsp = ALLOCATE(struct SoundIoDuplexStreamPrivate, 1);
+    if (!dsp)
+        return NULL;
+    struct SoundIoDuplexStream *duplex = &dsp->pub;
+    SOUNDIO_ATOMIC_STORE(dsp->input_started, false);
+
+    duplex->instream = soundio_instream_create(in_device);
+    duplex->outstream = soundio_outstream_create(out_device);
+    if (!duplex->instream || !duplex->outstream) {
+        soundio_duplex_stream_destroy(duplex);
+        return NULL;
+    }
+    ((struct SoundIoInStreamPrivate *)duplex->instream)->duplex = dsp;
+    ((struct SoundIoOutStreamPrivate *)duplex->outstream)->duplex = dsp;
+    return duplex;
+}
+
+void soundio_duplex_stream_destroy(struct SoundIoDuplexStream *duplex) {
+    if (!duplex)
+        return;
+    struct SoundIoDuplexStreamPrivate *dsp = (struct SoundIoDuplexStreamPrivate *)duplex;
+    // the output's thread may be reading the input, so it goes first
+    soundio_outstream_destroy(duplex->outstream);
+    soundio_instream_destroy(duplex->instream);
+    soundio_ring_buffer_deinit(&dsp->ring_buffer);
+    soundio_converter_destroy(dsp->interleave);
+    soundio_converter_destroy(dsp->silence);
+    free(dsp->pad_buf);
+    free(dsp);
+}
+
+int soundio_duplex_stream_open(struct SoundIoDuplexStream *duplex) {
+    struct SoundIoDuplexStreamPrivate *dsp = (struct SoundIoDuplexStreamPrivate *)duplex;
+    struct SoundIoInStream *instream = duplex->instream;
+    struct SoundIoOutStream *outstream = duplex->outstream;
+    struct SoundIoInStreamPrivate *is = (struct SoundIoInStreamPrivate *)instream;
+    struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate *)outstream;
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)outstream->device->soundio;
+
+    if (!duplex->duplex_callback)
+        return SoundIoErrorInvalid;
+    instream->read_callback = duplex_read_callback;
+    outstream->write_callback = duplex_write_callback;
+
+    // The backend can only read the input in step with the output when both
+    // run at the device rate of one context.
+    duplex->synchronous = si->drives_duplex_input &&
+        instream->device->soundio == outstream->device->soundio &&
+        (!outstream->write_sample_rate || outstream->write_sample_rate == outstream->sample_rate);
+    if (duplex->synchronous) {
+        os->duplex_input = is;
+        is->duplex_output = os;
+    }
+
+    int err;
+    if ((err = soundio_outstream_open(outstream)))
+        return err;
+    if (!instream->sample_rate)
+        instream->sample_rate = outstream->write_sample_rate;
+    if ((err = soundio_instream_open(instream)))
+        return err;
+    if (instream->sample_rate != outstream->write_sample_rate)
+        return SoundIoErrorIncompatibleDevice;
+
+    dsp->pad_frame_count = pad_frame_count_for(duplex);
+    int capacity = dsp->pad_frame_count * instream->bytes_per_frame;
+    if ((err = soundio_ring_buffer_init_ex(&dsp->ring_buffer, capacity, SoundIoRingBufferFlagStrictRoles)))
+        return err;
+    dsp->pad_buf = ALLOCATE_NONZERO(char, capacity);
+    dsp->interleave = soundio_converter_create(instream->format, instream->format, 0);
+    dsp->silence = soundio_converter_create(SoundIoFormatFloat32NE, instream->format, 0);
+    if (!dsp->pad_buf || !dsp->interleave || !dsp->silence)
+        return SoundIoErrorNoMem;
+    return 0;
+}
+
+int soundio_duplex_stream_resize(struct SoundIoDuplexStreamPrivate *dsp) {
+    struct SoundIoDuplexStream *duplex = &dsp->pub;
+    // not opened yet, or not all the way; or the other side runs on a
+    // thread of its own, and the buffers are already as large as they need
+    if (!dsp->pad_buf || !duplex->synchronous)
+        return 0;
+    int frame_count = pad_frame_count_for(duplex);
+    if (frame_count <= dsp->pad_frame_count)
+        return 0;
+    int capacity = frame_count * duplex->instream->bytes_per_frame;
+    struct SoundIoRingBuffer ring_buffer;
+    int err;
+    if ((err = soundio_ring_buffer_init_ex(&ring_buffer, capacity, SoundIoRingBufferFlagStrictRoles)))
+        return err;
+    char *pad_buf = ALLOCATE_NONZERO(char, capacity);
+    if (!pad_buf) {
+        soundio_ring_buffer_deinit(&ring_buffer);
+        return SoundIoErrorNoMem;
+    }
+    soundio_ring_buffer_deinit(&dsp->ring_buffer);
+    dsp->ring_buffer = ring_buffer;
+    free(dsp->pad_buf);
+    dsp->pad_buf = pad_buf;
+    dsp->pad_frame_count = frame_count;
+    return 0;
+}
+
+int soundio_duplex_stream_start(struct SoundIoDuplexStream *duplex) {
+    int err;
+    if ((err = soundio_instream_start(duplex->instream)))
+        return err;
+    return soundio_outstream_start(duplex->outstream);
+}
+
+int soundio_duplex_stream_pause(struct SoundIoDuplexStream *duplex, bool pause) {
+    int err;
+    if ((err = soundio_instream_pause(duplex->instream, pause)))
+        return err;
+    return soundio_outstream_pause(duplex->outstream, pause);
+}
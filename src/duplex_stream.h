@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#ifndef SOUNDIO_DUPLEX_STREAM_H
+#define SOUNDIO_DUPLEX_STREAM_H
+
+#include "soundio_private.h"
+#include "ring_buffer.h"
+#include "atomics.h"
+
+struct SoundIoDuplexStreamPrivate {
+    struct SoundIoDuplexStream pub;
+
+    // Input frames, interleaved in the input format, from the read callback
+    // to the write callback. With a synchronous duplex stream both run on
+    // the output's thread.
+    struct SoundIoRingBuffer ring_buffer;
+    struct SoundIoConverter *interleave;
+    struct SoundIoConverter *silence;
+    // Input for a callback which asks for more than was recorded, with
+    // silence after what there is.
+    char *pad_buf;
+    int pad_frame_count;
+    // Until the input delivers, the output is filled as far as it asks.
+    struct SoundIoAtomicBool input_started;
+};
+
+// Grows the ring buffer and the pad to fit the software latencies of the two
+// streams once the backend has raised either of them. Neither callback may
+// run meanwhile. Input still in the ring buffer is dropped. Does nothing
+// unless the duplex stream is synchronous; otherwise both were sized for
+// SoundIoPrivate::max_period_frame_count when the stream was opened.
+int soundio_duplex_stream_resize(struct SoundIoDuplexStreamPrivate *dsp);
+
+#endif
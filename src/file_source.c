@@ -0,0 +1,408 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "file_source.h"
+#include "convert.h"
+#include "util.h"
+
+#include <string.h>
+
+// How often the helper thread looks at the play cursor. A small fraction of
+// the prefetch window.
+static const double prefetch_wake_period = 0.05;
+
+static const uint64_t no_seek = UINT64_MAX;
+
+enum {
+    WaveFormatPcm = 0x0001,
+    WaveFormatIeeeFloat = 0x0003,
+    WaveFormatExtensible = 0xfffe,
+};
+
+static uint16_t get_u16(const char *p) {
+    const unsigned char *u = (const unsigned char *)p;
+    return (uint16_t)(u[0] | (u[1] << 8));
+}
+
+static uint32_t get_u32(const char *p) {
+    return get_u16(p) | ((uint32_t)get_u16(p + 2) << 16);
+}
+
+static uint64_t get_u64(const char *p) {
+    return get_u32(p) | ((uint64_t)get_u32(p + 4) << 32);
+}
+
+static bool wav_format(int format_tag, int bits, enum SoundIoFormat *format) {
+    if (format_tag == WaveFormatPcm) {
+        switch (bits) {
+        case 8: *format = SoundIoFormatU8; return true;
+        case 16: *format = SoundIoFormatS16LE; return true;
+        // 24-bit samples in 32-bit containers are aligned to the top
+        case 32: *format = SoundIoFormatS32LE; return true;
+        }
+    } else if (format_tag == WaveFormatIeeeFloat) {
+        switch (bits) {
+        case 32: *format = SoundIoFormatFloat32LE; return true;
+        case 64: *format = SoundIoFormatFloat64LE; return true;
+        }
+    }
+    // this includes packed 24-bit samples, which no SoundIoFormat describes
+    return false;
+}
+
+static int set_layout(struct SoundIoFileSourcePrivate *fsp, enum SoundIoFormat format,
+        int channel_count, int sample_rate)
+{
+    struct SoundIoFileSource *source = &fsp->pub;
+    int bytes_per_sample = soundio_get_bytes_per_sample(format);
+    if (bytes_per_sample <= 0 || channel_count <= 0 || channel_count > SOUNDIO_MAX_CHANNELS ||
+            sample_rate <= 0)
+    {
+        return SoundIoErrorInvalid;
+    }
+    source->format = format;
+    source->channel_count = channel_count;
+    source->sample_rate = sample_rate;
+    fsp->bytes_per_sample = bytes_per_sample;
+    fsp->bytes_per_frame = bytes_per_sample * channel_count;
+    return 0;
+}
+
+int soundio_file_source_parse_wav(struct SoundIoFileSourcePrivate *fsp, const char *file, int64_t size) {
+    if (size < 12 || memcmp(file + 8, "WAVE", 4))
+        return SoundIoErrorInvalid;
+    bool rf64 = !memcmp(file, "RF64", 4);
+    if (!rf64 && memcmp(file, "RIFF", 4))
+        return SoundIoErrorInvalid;
+
+    bool have_fmt = false;
+    int format_tag = 0;
+    int channel_count = 0;
+    int sample_rate = 0;
+    int block_align = 0;
+    int bits = 0;
+    int64_t ds64_data_bytes = -1;
+    int64_t pos = 12;
+    while (pos + 8 <= size) {
+        const char *chunk = file + pos;
+        const char *body = chunk + 8;
+        int64_t chunk_size = get_u32(chunk + 4);
+        int64_t body_size = soundio_int64_min(chunk_size, size - pos - 8);
+        if (!memcmp(chunk, "ds64", 4) && body_size >= 24) {
+            ds64_data_bytes = (int64_t)(get_u64(body + 8) & INT64_MAX);
+        } else if (!memcmp(chunk, "fmt ", 4) && body_size >= 16) {
+            have_fmt = true;
+            format_tag = get_u16(body);
+            channel_count = get_u16(body + 2);
+            sample_rate = (int)(get_u32(body + 4) & INT32_MAX);
+            block_align = get_u16(body + 12);
+            bits = get_u16(body + 14);
+            // the real tag leads the sub format GUID
+            if (format_tag == WaveFormatExtensible && body_size >= 40)
+                format_tag = get_u16(body + 24);
+        } else if (!memcmp(chunk, "data", 4)) {
+            enum SoundIoFormat format;
+            if (!have_fmt || !wav_format(format_tag, bits, &format))
+                return SoundIoErrorInvalid;
+            int err;
+            if ((err = set_layout(fsp, format, channel_count, sample_rate)))
+                return err;
+            if (block_align != fsp->bytes_per_frame)
+                return SoundIoErrorInvalid;
+            int64_t data_bytes = chunk_size;
+            if (rf64 && chunk_size == UINT32_MAX) {
+                if (ds64_data_bytes < 0)
+                    return SoundIoErrorInvalid;
+                data_bytes = ds64_data_bytes;
+            }
+            // a file which was cut short plays up to where it ends
+            data_bytes = soundio_int64_min(data_bytes, size - pos - 8);
+            fsp->data = body;
+            fsp->pub.frame_count = data_bytes / fsp->bytes_per_frame;
+            return 0;
+        }
+        pos += 8 + chunk_size + (chunk_size & 1);
+    }
+    return SoundIoErrorInvalid;
+}
+
+// Reads a byte of every page of the range, so that the audio thread finds
+// them mapped and resident.
+static void touch_range(struct SoundIoFileSourcePrivate *fsp, int64_t begin, int64_t end) {
+    const int64_t data_bytes = fsp->pub.frame_count * fsp->bytes_per_frame;
+    end = soundio_int64_min(end, data_bytes);
+    if (begin >= end)
+        return;
+    const int page_size = soundio_os_page_size();
+    const char *data = fsp->data;
+    for (int64_t offset = begin; offset < end; offset += page_size)
+        (void)*(volatile const char *)(data + offset);
+    (void)*(volatile const char *)(data + end - 1);
+}
+
+static void advise_range(struct SoundIoFileSourcePrivate *fsp, int64_t begin, int64_t end) {
+    const int64_t data_bytes = fsp->pub.frame_count * fsp->bytes_per_frame;
+    end = soundio_int64_min(end, data_bytes);
+    if (begin < end)
+        soundio_os_prefetch(fsp->data + begin, (size_t)(end - begin));
+}
+
+static void prefetch(struct SoundIoFileSourcePrivate *fsp) {
+    const int64_t data_bytes = fsp->pub.frame_count * fsp->bytes_per_frame;
+    uint64_t request = SOUNDIO_ATOMIC_LOAD(fsp->seek_request);
+    int64_t frame = (int64_t)(request != no_seek ? request : SOUNDIO_ATOMIC_LOAD(fsp->cursor));
+    int64_t pos = frame * fsp->bytes_per_frame;
+    int64_t window = fsp->prefetch_bytes;
+    // Whatever is resident already costs a read per page, which is far
+    // cheaper than keeping track of what the OS may have evicted since.
+    advise_range(fsp, pos + window, pos + 2 * window);
+    touch_range(fsp, pos, pos + window);
+    if (fsp->pub.loop && pos + window > data_bytes) {
+        // what plays after the end is the start again
+        int64_t wrapped = pos + window - data_bytes;
+        advise_range(fsp, wrapped, wrapped + window);
+        touch_range(fsp, 0, wrapped);
+    }
+}
+
+static void prefetch_thread_run(void *arg) {
+    struct SoundIoFileSourcePrivate *fsp = (struct SoundIoFileSourcePrivate *)arg;
+    soundio_os_lower_thread_priority();
+    while (SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(fsp->run_flag)) {
+        prefetch(fsp);
+        soundio_os_cond_timed_wait(fsp->cond, NULL, prefetch_wake_period);
+    }
+}
+
+static int finish_open(struct SoundIoFileSourcePrivate *fsp, struct SoundIoFileSource **out_source) {
+    struct SoundIoFileSource *source = &fsp->pub;
+    double prefetch_bytes = SOUNDIO_FILE_SOURCE_PREFETCH_SECONDS * source->sample_rate * fsp->bytes_per_frame;
+    fsp->prefetch_bytes = soundio_int64_max((int64_t)prefetch_bytes, SOUNDIO_FILE_SOURCE_PREFETCH_MIN_BYTES);
+    SOUNDIO_ATOMIC_STORE(fsp->cursor, 0);
+    SOUNDIO_ATOMIC_STORE(fsp->seek_request, no_seek);
+
+    // the start is needed first, before the thread gets going
+    touch_range(fsp, 0, fsp->prefetch_bytes);
+
+    fsp->cond = soundio_os_cond_create();
+    if (!fsp->cond) {
+        soundio_file_source_destroy(source);
+        return SoundIoErrorNoMem;
+    }
+    SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(fsp->run_flag);
+    int err;
+    if ((err = soundio_os_thread_create(prefetch_thread_run, fsp, NULL, false, NULL, &fsp->thread))) {
+        soundio_file_source_destroy(source);
+        return err;
+    }
+    *out_source = source;
+    return 0;
+}
+
+int soundio_file_source_open(const char *path, struct SoundIoFileSource **out_source) {
+    *out_source = NULL;
+    struct SoundIoFileSourcePrivate *fsp = ALLOCATE(struct SoundIoFileSourcePrivate, 1);
+    if (!fsp)
+        return SoundIoErrorNoMem;
+    int err;
+    if ((err = soundio_os_map_file(path, &fsp->mapping)) ||
+        (err = soundio_file_source_parse_wav(fsp, (const char *)fsp->mapping.address, fsp->mapping.size)))
+    {
+        soundio_file_source_destroy(&fsp->pub);
+        return err;
+    }
+    return finish_open(fsp, out_source);
+}
+
+int soundio_file_source_open_raw(const char *path, enum SoundIoFormat format,
+        int channel_count, int sample_rate, struct SoundIoFileSource **out_source)
+{
+    *out_source = NULL;
+    struct SoundIoFileSourcePrivate *fsp = ALLOCATE(struct SoundIoFileSourcePrivate, 1);
+    if (!fsp)
+        return SoundIoErrorNoMem;
+    int err;
+    if ((err = set_layout(fsp, format, channel_count, sample_rate)) ||
+        (err = soundio_os_map_file(path, &fsp->mapping)))
+    {
+        soundio_file_source_destroy(&fsp->pub);
+        return err;
+    }
+    fsp->data = (const char *)fsp->mapping.address;
+    fsp->pub.frame_count = fsp->mapping.size / fsp->bytes_per_frame;
+    return finish_open(fsp, out_source);
+}
+
+void soundio_file_source_destroy(struct SoundIoFileSource *source) {
+    if (!source)
+        return;
+    struct SoundIoFileSourcePrivate *fsp = (struct SoundIoFileSourcePrivate *)source;
+    if (fsp->thread) {
+        SOUNDIO_ATOMIC_FLAG_CLEAR(fsp->run_flag);
+        soundio_os_cond_signal(fsp->cond, NULL);
+        soundio_os_thread_destroy(fsp->thread);
+    }
+    if (fsp->cond)
+        soundio_os_cond_destroy(fsp->cond);
+    soundio_converter_destroy(fsp->from_file);
+    soundio_converter_destroy(fsp->from_float);
+    soundio_os_unmap_file(&fsp->mapping);
+    free(fsp);
+}
+
+int soundio_file_source_attach(struct SoundIoFileSource *source, struct SoundIoOutStream *outstream) {
+    struct SoundIoFileSourcePrivate *fsp = (struct SoundIoFileSourcePrivate *)source;
+    if (fsp->outstream || outstream->bytes_per_frame <= 0)
+        return SoundIoErrorInvalid;
+    if (outstream->write_layout.channel_count != source->channel_count ||
+            outstream->write_sample_rate != source->sample_rate)
+    {
+        return SoundIoErrorIncompatibleDevice;
+    }
+    fsp->from_file = soundio_converter_create(source->format, outstream->format, 0);
+    fsp->from_float = soundio_converter_create(SoundIoFormatFloat32NE, outstream->format, 0);
+    if (!fsp->from_file || !fsp->from_float) {
+        soundio_converter_destroy(fsp->from_file);
+        soundio_converter_destroy(fsp->from_float);
+        fsp->from_file = NULL;
+        fsp->from_float = NULL;
+        return SoundIoErrorNoMem;
+    }
+    fsp->outstream = outstream;
+    return 0;
+}
+
+void soundio_file_source_seek(struct SoundIoFileSource *source, int64_t frame) {
+    struct SoundIoFileSourcePrivate *fsp = (struct SoundIoFileSourcePrivate *)source;
+    frame = soundio_int64_max(0, soundio_int64_min(frame, source->frame_count));
+    SOUNDIO_ATOMIC_STORE(fsp->seek_request, (uint64_t)frame);
+    // get the new position in before playback reaches it
+    soundio_os_cond_signal(fsp->cond, NULL);
+}
+
+int64_t soundio_file_source_get_position(struct SoundIoFileSource *source) {
+    struct SoundIoFileSourcePrivate *fsp = (struct SoundIoFileSourcePrivate *)source;
+    uint64_t request = SOUNDIO_ATOMIC_LOAD(fsp->seek_request);
+    return (int64_t)(request != no_seek ? request : SOUNDIO_ATOMIC_LOAD(fsp->cursor));
+}
+
+// Applies a pending seek and wraps a looping source around. Returns the play
+// cursor.
+static int64_t take_cursor(struct SoundIoFileSourcePrivate *fsp) {
+    uint64_t request = SOUNDIO_ATOMIC_EXCHANGE(fsp->seek_request, no_seek);
+    int64_t cursor = (int64_t)(request != no_seek ? request : SOUNDIO_ATOMIC_LOAD(fsp->cursor));
+    if (cursor >= fsp->pub.frame_count && fsp->pub.loop)
+        cursor = 0;
+    SOUNDIO_ATOMIC_STORE(fsp->cursor, (uint64_t)cursor);
+    return cursor;
+}
+
+static void set_file_areas(struct SoundIoFileSourcePrivate *fsp, struct SoundIoChannelArea *areas,
+        int64_t frame)
+{
+    const char *ptr = fsp->data + frame * fsp->bytes_per_frame;
+    for (int ch = 0; ch < fsp->pub.channel_count; ch += 1) {
+        // the areas of a stream are writable, these are not
+        areas[ch].ptr = (char *)(ptr + ch * fsp->bytes_per_sample);
+        areas[ch].step = fsp->bytes_per_frame;
+    }
+}
+
+int soundio_file_source_begin_read(struct SoundIoFileSource *source,
+        struct SoundIoChannelArea **areas, int *frame_count)
+{
+    struct SoundIoFileSourcePrivate *fsp = (struct SoundIoFileSourcePrivate *)source;
+    if (*frame_count < 0)
+        return SoundIoErrorInvalid;
+    int64_t cursor = take_cursor(fsp);
+    int count = (int)soundio_int64_min(*frame_count, source->frame_count - cursor);
+    set_file_areas(fsp, fsp->read_areas, cursor);
+    fsp->read_frame_count = count;
+    *areas = count ? fsp->read_areas : NULL;
+    *frame_count = count;
+    return 0;
+}
+
+void soundio_file_source_end_read(struct SoundIoFileSource *source) {
+    struct SoundIoFileSourcePrivate *fsp = (struct SoundIoFileSourcePrivate *)source;
+    // a seek since begin_read wins
+    if (SOUNDIO_ATOMIC_LOAD(fsp->seek_request) == no_seek)
+        SOUNDIO_ATOMIC_FETCH_ADD(fsp->cursor, (uint64_t)fsp->read_frame_count);
+    fsp->read_frame_count = 0;
+}
+
+static void offset_areas(struct SoundIoChannelArea *dest, const struct SoundIoChannelArea *areas,
+        int channel_count, int offset)
+{
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        dest[ch].ptr = areas[ch].ptr + offset * areas[ch].step;
+        dest[ch].step = areas[ch].step;
+    }
+}
+
+static void write_silence(struct SoundIoFileSourcePrivate *fsp, const struct SoundIoChannelArea *areas,
+        int offset, int frame_count)
+{
+    const int channel_count = fsp->pub.channel_count;
+    struct SoundIoChannelArea src[SOUNDIO_MAX_CHANNELS];
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        src[ch].ptr = (char *)&fsp->silence_buf[ch * SOUNDIO_FILE_SOURCE_CHUNK_SIZE];
+        src[ch].step = sizeof(float);
+    }
+    while (offset < frame_count) {
+        struct SoundIoChannelArea dest[SOUNDIO_MAX_CHANNELS];
+        int count = soundio_int_min(frame_count - offset, SOUNDIO_FILE_SOURCE_CHUNK_SIZE);
+        offset_areas(dest, areas, channel_count, offset);
+        soundio_converter_convert(fsp->from_float, src, dest, channel_count, count);
+        offset += count;
+    }
+}
+
+void soundio_file_source_pull(struct SoundIoFileSourcePrivate *fsp,
+        const struct SoundIoChannelArea *areas, int frame_count)
+{
+    struct SoundIoFileSource *source = &fsp->pub;
+    int done = 0;
+    while (done < frame_count) {
+        int64_t cursor = take_cursor(fsp);
+        int count = (int)soundio_int64_min(frame_count - done, source->frame_count - cursor);
+        if (count <= 0) {
+            write_silence(fsp, areas, done, frame_count);
+            return;
+        }
+        struct SoundIoChannelArea src[SOUNDIO_MAX_CHANNELS];
+        struct SoundIoChannelArea dest[SOUNDIO_MAX_CHANNELS];
+        set_file_areas(fsp, src, cursor);
+        offset_areas(dest, areas, source->channel_count, done);
+        // an exact copy when the formats match
+        soundio_converter_convert(fsp->from_file, src, dest, source->channel_count, count);
+        SOUNDIO_ATOMIC_STORE(fsp->cursor, (uint64_t)(cursor + count));
+        done += count;
+    }
+}
+
+int soundio_file_source_write(struct SoundIoFileSource *source, int frame_count_min, int frame_count_max) {
+    struct SoundIoFileSourcePrivate *fsp = (struct SoundIoFileSourcePrivate *)source;
+    struct SoundIoOutStream *outstream = fsp->outstream;
+    if (!outstream)
+        return SoundIoErrorInvalid;
+    int frames_left = frame_count_max;
+    while (frames_left > 0) {
+        struct SoundIoChannelArea *areas;
+        int frame_count = frames_left;
+        int err;
+        if ((err = soundio_outstream_begin_write(outstream, &areas, &frame_count)))
+            return err;
+        if (!frame_count)
+            break;
+        soundio_file_source_pull(fsp, areas, frame_count);
+        if ((err = soundio_outstream_end_write(outstream)))
+            return err;
+        frames_left -= frame_count;
+    }
+    return 0;
+}
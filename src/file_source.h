@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#ifndef SOUNDIO_FILE_SOURCE_H
+#define SOUNDIO_FILE_SOURCE_H
+
+#include "soundio_internal.h"
+#include "atomics.h"
+#include "os.h"
+
+// Silence is converted to the output format this many frames at a time.
+#define SOUNDIO_FILE_SOURCE_CHUNK_SIZE 256
+// The helper thread keeps this much audio ahead of the play cursor resident,
+// and asks the OS to start reading in as much again beyond that.
+#define SOUNDIO_FILE_SOURCE_PREFETCH_SECONDS 2.0
+// But never less than this many bytes.
+#define SOUNDIO_FILE_SOURCE_PREFETCH_MIN_BYTES (1024 * 1024)
+
+struct SoundIoFileSourcePrivate {
+    struct SoundIoFileSource pub;
+
+    struct SoundIoOsFileMapping mapping;
+    // The interleaved frames, inside the mapping.
+    const char *data;
+    int bytes_per_sample;
+    int bytes_per_frame;
+    int64_t prefetch_bytes;
+
+    // Written only by whoever plays the source. A pending seek is
+    // UINT64_MAX when there is none.
+    struct SoundIoAtomicUInt64 cursor;
+    struct SoundIoAtomicUInt64 seek_request;
+    // The areas handed out by soundio_file_source_begin_read, and how many
+    // frames they cover.
+    struct SoundIoChannelArea read_areas[SOUNDIO_MAX_CHANNELS];
+    int read_frame_count;
+
+    // Set by soundio_file_source_attach.
+    struct SoundIoOutStream *outstream;
+    struct SoundIoConverter *from_file;
+    struct SoundIoConverter *from_float;
+    float silence_buf[SOUNDIO_MAX_CHANNELS * SOUNDIO_FILE_SOURCE_CHUNK_SIZE];
+
+    struct SoundIoOsThread *thread;
+    struct SoundIoOsCond *cond;
+    struct SoundIoAtomicFlag run_flag;
+};
+
+// Locates the samples of a WAV or RF64 file which is `size` bytes long and
+// fills in the format of the public struct. Returns SoundIoErrorInvalid if
+// it is not such a file or its sample format is not supported.
+int soundio_file_source_parse_wav(struct SoundIoFileSourcePrivate *fsp, const char *file, int64_t size);
+
+// Writes `frame_count` frames, from the cursor onwards, into `areas`, which
+// are in the attached output stream's format. This is
+// soundio_file_source_write minus the stream.
+void soundio_file_source_pull(struct SoundIoFileSourcePrivate *fsp,
+        const struct SoundIoChannelArea *areas, int frame_count);
+
+#endif
@@ -0,0 +1,299 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "interleave.h"
+
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOUNDIO_INTERLEAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define SOUNDIO_INTERLEAVE_NEON
+#include <arm_neon.h>
+#endif
+
+// When inlined with constant `channel_count` and `bytes` the compiler turns
+// the inner loop and the memcpy into plain moves.
+static inline void interleave_fixed(const char *const *planar, char *interleaved,
+        int start, int channel_count, int frame_channel_count, int bytes, int frame_count)
+{
+    char *frame = interleaved + start * frame_channel_count * bytes;
+    for (int i = start; i < frame_count; i += 1) {
+        char *dest = frame;
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            memcpy(dest, planar[ch] + i * bytes, bytes);
+            dest += bytes;
+        }
+        frame += frame_channel_count * bytes;
+    }
+}
+
+static inline void deinterleave_fixed(const char *interleaved, char *const *planar,
+        int start, int channel_count, int frame_channel_count, int bytes, int frame_count)
+{
+    const char *frame = interleaved + start * frame_channel_count * bytes;
+    for (int i = start; i < frame_count; i += 1) {
+        const char *src = frame;
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            memcpy(planar[ch] + i * bytes, src, bytes);
+            src += bytes;
+        }
+        frame += frame_channel_count * bytes;
+    }
+}
+
+// Vector kernels for 32-bit samples. They only move bits around, so they
+// work for integer samples as well as float. Each returns the number of
+// frames it handled; the caller finishes the remainder.
+
+#if defined(SOUNDIO_INTERLEAVE_SSE2)
+static int interleave32_simd(const char *const *planar, char *interleaved,
+        int channel_count, int frame_count)
+{
+    float *dest = (float *)interleaved;
+    int i = 0;
+    switch (channel_count) {
+    case 2:
+        for (; i + 4 <= frame_count; i += 4) {
+            __m128 a = _mm_loadu_ps((const float *)planar[0] + i);
+            __m128 b = _mm_loadu_ps((const float *)planar[1] + i);
+            _mm_storeu_ps(dest + i * 2, _mm_unpacklo_ps(a, b));
+            _mm_storeu_ps(dest + i * 2 + 4, _mm_unpackhi_ps(a, b));
+        }
+        return i;
+    case 4:
+    case 8:
+        for (; i + 4 <= frame_count; i += 4) {
+            for (int ch = 0; ch < channel_count; ch += 4) {
+                __m128 r0 = _mm_loadu_ps((const float *)planar[ch + 0] + i);
+                __m128 r1 = _mm_loadu_ps((const float *)planar[ch + 1] + i);
+                __m128 r2 = _mm_loadu_ps((const float *)planar[ch + 2] + i);
+                __m128 r3 = _mm_loadu_ps((const float *)planar[ch + 3] + i);
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                float *frame = dest + i * channel_count + ch;
+                _mm_storeu_ps(frame, r0);
+                _mm_storeu_ps(frame + channel_count, r1);
+                _mm_storeu_ps(frame + channel_count * 2, r2);
+                _mm_storeu_ps(frame + channel_count * 3, r3);
+            }
+        }
+        return i;
+    }
+    return 0;
+}
+
+static int deinterleave32_simd(const char *interleaved, char *const *planar,
+        int channel_count, int frame_count)
+{
+    const float *src = (const float *)interleaved;
+    int i = 0;
+    switch (channel_count) {
+    case 2:
+        for (; i + 4 <= frame_count; i += 4) {
+            __m128 x = _mm_loadu_ps(src + i * 2);
+            __m128 y = _mm_loadu_ps(src + i * 2 + 4);
+            _mm_storeu_ps((float *)planar[0] + i, _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps((float *)planar[1] + i, _mm_shuffle_ps(x, y, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+        return i;
+    case 4:
+    case 8:
+        for (; i + 4 <= frame_count; i += 4) {
+            for (int ch = 0; ch < channel_count; ch += 4) {
+                const float *frame = src + i * channel_count + ch;
+                __m128 r0 = _mm_loadu_ps(frame);
+                __m128 r1 = _mm_loadu_ps(frame + channel_count);
+                __m128 r2 = _mm_loadu_ps(frame + channel_count * 2);
+                __m128 r3 = _mm_loadu_ps(frame + channel_count * 3);
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                _mm_storeu_ps((float *)planar[ch + 0] + i, r0);
+                _mm_storeu_ps((float *)planar[ch + 1] + i, r1);
+                _mm_storeu_ps((float *)planar[ch + 2] + i, r2);
+                _mm_storeu_ps((float *)planar[ch + 3] + i, r3);
+            }
+        }
+        return i;
+    }
+    return 0;
+}
+#elif defined(SOUNDIO_INTERLEAVE_NEON)
+static int interleave32_simd(const char *const *planar, char *interleaved,
+        int channel_count, int frame_count)
+{
+    uint32_t *dest = (uint32_t *)interleaved;
+    int i = 0;
+    switch (channel_count) {
+    case 2:
+        for (; i + 4 <= frame_count; i += 4) {
+            uint32x4x2_t v;
+            v.val[0] = vld1q_u32((const uint32_t *)planar[0] + i);
+            v.val[1] = vld1q_u32((const uint32_t *)planar[1] + i);
+            vst2q_u32(dest + i * 2, v);
+        }
+        return i;
+    case 4:
+        for (; i + 4 <= frame_count; i += 4) {
+            uint32x4x4_t v;
+            v.val[0] = vld1q_u32((const uint32_t *)planar[0] + i);
+            v.val[1] = vld1q_u32((const uint32_t *)planar[1] + i);
+            v.val[2] = vld1q_u32((const uint32_t *)planar[2] + i);
+            v.val[3] = vld1q_u32((const uint32_t *)planar[3] + i);
+            vst4q_u32(dest + i * 4, v);
+        }
+        return i;
+    }
+    return 0;
+}
+
+static int deinterleave32_simd(const char *interleaved, char *const *planar,
+        int channel_count, int frame_count)
+{
+    const uint32_t *src = (const uint32_t *)interleaved;
+    int i = 0;
+    switch (channel_count) {
+    case 2:
+        for (; i + 4 <= frame_count; i += 4) {
+            uint32x4x2_t v = vld2q_u32(src + i * 2);
+            vst1q_u32((uint32_t *)planar[0] + i, v.val[0]);
+            vst1q_u32((uint32_t *)planar[1] + i, v.val[1]);
+        }
+        return i;
+    case 4:
+        for (; i + 4 <= frame_count; i += 4) {
+            uint32x4x4_t v = vld4q_u32(src + i * 4);
+            vst1q_u32((uint32_t *)planar[0] + i, v.val[0]);
+            vst1q_u32((uint32_t *)planar[1] + i, v.val[1]);
+            vst1q_u32((uint32_t *)planar[2] + i, v.val[2]);
+            vst1q_u32((uint32_t *)planar[3] + i, v.val[3]);
+        }
+        return i;
+    }
+    return 0;
+}
+#else
+static int interleave32_simd(const char *const *planar, char *interleaved,
+        int channel_count, int frame_count)
+{
+    return 0;
+}
+
+static int deinterleave32_simd(const char *interleaved, char *const *planar,
+        int channel_count, int frame_count)
+{
+    return 0;
+}
+#endif
+
+#define SOUNDIO_INTERLEAVE_CASE(CHANNELS, BYTES) \
+    case CHANNELS: \
+        interleave_fixed(planar, interleaved, start, CHANNELS, CHANNELS, BYTES, frame_count); \
+        return;
+
+#define SOUNDIO_DEINTERLEAVE_CASE(CHANNELS, BYTES) \
+    case CHANNELS: \
+        deinterleave_fixed(interleaved, planar, start, CHANNELS, CHANNELS, BYTES, frame_count); \
+        return;
+
+// A subset of the channels of each frame. Only the sample width is made
+// constant.
+static void interleave_subset(const char *const *planar, char *interleaved,
+        int channel_count, int frame_channel_count, int bytes_per_sample, int frame_count)
+{
+    switch (bytes_per_sample) {
+    case 2:
+        interleave_fixed(planar, interleaved, 0, channel_count, frame_channel_count, 2, frame_count);
+        return;
+    case 4:
+        interleave_fixed(planar, interleaved, 0, channel_count, frame_channel_count, 4, frame_count);
+        return;
+    }
+    interleave_fixed(planar, interleaved, 0, channel_count, frame_channel_count,
+            bytes_per_sample, frame_count);
+}
+
+static void deinterleave_subset(const char *interleaved, char *const *planar,
+        int channel_count, int frame_channel_count, int bytes_per_sample, int frame_count)
+{
+    switch (bytes_per_sample) {
+    case 2:
+        deinterleave_fixed(interleaved, planar, 0, channel_count, frame_channel_count, 2, frame_count);
+        return;
+    case 4:
+        deinterleave_fixed(interleaved, planar, 0, channel_count, frame_channel_count, 4, frame_count);
+        return;
+    }
+    deinterleave_fixed(interleaved, planar, 0, channel_count, frame_channel_count,
+            bytes_per_sample, frame_count);
+}
+
+void soundio_interleave(const char *const *planar, char *interleaved,
+        int channel_count, int frame_channel_count, int bytes_per_sample, int frame_count)
+{
+    if (frame_channel_count != channel_count) {
+        interleave_subset(planar, interleaved, channel_count, frame_channel_count,
+                bytes_per_sample, frame_count);
+        return;
+    }
+    int start = 0;
+    switch (bytes_per_sample) {
+    case 2:
+        switch (channel_count) {
+            SOUNDIO_INTERLEAVE_CASE(2, 2)
+            SOUNDIO_INTERLEAVE_CASE(4, 2)
+            SOUNDIO_INTERLEAVE_CASE(6, 2)
+            SOUNDIO_INTERLEAVE_CASE(8, 2)
+        }
+        break;
+    case 4:
+        start = interleave32_simd(planar, interleaved, channel_count, frame_count);
+        switch (channel_count) {
+            SOUNDIO_INTERLEAVE_CASE(2, 4)
+            SOUNDIO_INTERLEAVE_CASE(4, 4)
+            SOUNDIO_INTERLEAVE_CASE(6, 4)
+            SOUNDIO_INTERLEAVE_CASE(8, 4)
+        }
+        break;
+    }
+    interleave_fixed(planar, interleaved, start, channel_count, channel_count,
+            bytes_per_sample, frame_count);
+}
+
+void soundio_deinterleave(const char *interleaved, char *const *planar,
+        int channel_count, int frame_channel_count, int bytes_per_sample, int frame_count)
+{
+    if (frame_channel_count != channel_count) {
+        deinterleave_subset(interleaved, planar, channel_count, frame_channel_count,
+                bytes_per_sample, frame_count);
+        return;
+    }
+    int start = 0;
+    switch (bytes_per_sample) {
+    case 2:
+        switch (channel_count) {
+            SOUNDIO_DEINTERLEAVE_CASE(2, 2)
+            SOUNDIO_DEINTERLEAVE_CASE(4, 2)
+            SOUNDIO_DEINTERLEAVE_CASE(6, 2)
+            SOUNDIO_DEINTERLEAVE_CASE(8, 2)
+        }
+        break;
+    case 4:
+        start = deinterleave32_simd(interleaved, planar, channel_count, frame_count);
+        switch (channel_count) {
+            SOUNDIO_DEINTERLEAVE_CASE(2, 4)
+            SOUNDIO_DEINTERLEAVE_CASE(4, 4)
+            SOUNDIO_DEINTERLEAVE_CASE(6, 4)
+            SOUNDIO_DEINTERLEAVE_CASE(8, 4)
+        }
+        break;
+    }
+    deinterleave_fixed(interleaved, planar, start, channel_count, channel_count,
+            bytes_per_sample, frame_count);
+}
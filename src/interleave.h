@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#ifndef SOUNDIO_INTERLEAVE_H
+#define SOUNDIO_INTERLEAVE_H
+
+// Copies `frame_count` frames from `channel_count` contiguous planar buffers
+// to one interleaved buffer of samples which are `bytes_per_sample` wide.
+// Its frames are `frame_channel_count` samples apart, at least
+// `channel_count`, so that the planar channels can fill consecutive
+// channels of a wider frame. The other channels are left alone.
+// Frames which are exactly 2, 4, 6 or 8 channels wide use specialized
+// kernels; wider frames use a generic one.
+void soundio_interleave(const char *const *planar, char *interleaved,
+        int channel_count, int frame_channel_count, int bytes_per_sample, int frame_count);
+
+// The reverse of soundio_interleave, which extracts `channel_count`
+// consecutive channels of frames `frame_channel_count` channels wide.
+void soundio_deinterleave(const char *interleaved, char *const *planar,
+        int channel_count, int frame_channel_count, int bytes_per_sample, int frame_count);
+
+#endif
@@ -7,9 +7,11 @@
 
 #include "jack.h"
 #include "soundio_private.h"
+#include "duplex_stream.h"
 #include "list.h"
 
 #include <stdio.h>
+#include <string.h>
 
 static struct SoundIoAtomicFlag global_msg_callback_flag = SOUNDIO_ATOMIC_FLAG_INIT;
 
@@ -82,15 +84,156 @@ static void destruct_device(struct SoundIoDevicePrivate *dp) {
     free(dj->ports);
 }
 
-static int refresh_devices_bare(struct SoundIoPrivate *si) {
+static int create_device(struct SoundIoPrivate *si, struct SoundIoDevicesInfo *devices_info,
+        const struct SoundIoJackClient *client, struct SoundIoDevice **out_device)
+{
+    struct SoundIo *soundio = &si->pub;
+    struct SoundIoJack *sij = &si->backend_data.jack;
+
+    struct SoundIoDevicePrivate *dev = soundio_device_create(devices_info);
+    if (!dev)
+        return SoundIoErrorNoMem;
+    struct SoundIoDevice *device = &dev->pub;
+    struct SoundIoDeviceJack *dj = &dev->backend_data.jack;
+    int description_len = client->name_len + 3 + 2 * client->port_count;
+    for (int port_index = 0; port_index < client->port_count; port_index += 1) {
+        const struct SoundIoJackPort *port = &client->ports[port_index];
+
+        description_len += port->name_len;
+    }
+
+    dev->destruct = destruct_device;
+
+    device->soundio = soundio;
+    device->is_raw = false;
+    device->aim = client->aim;
+    device->id = soundio_device_str_dupe(dev, client->name, client->name_len);
+    device->name = DEVICE_ALLOCATE(dev, char, description_len);
+    device->current_format = SoundIoFormatFloat32NE;
+    device->sample_rate_count = 1;
+    device->sample_rates = &dev->prealloc_sample_rate_range;
+    device->sample_rates[0].min = sij->sample_rate;
+    device->sample_rates[0].max = sij->sample_rate;
+    device->sample_rate_current = sij->sample_rate;
+
+    device->software_latency_current = sij->period_size / (double) sij->sample_rate;
+    device->software_latency_min = sij->period_size / (double) sij->sample_rate;
+    device->software_latency_max = sij->period_size / (double) sij->sample_rate;
+
+    dj->port_count = client->port_count;
+    dj->ports = ALLOCATE(struct SoundIoDeviceJackPort, dj->port_count);
+
+    if (!device->id || !device->name || !dj->ports) {
+        soundio_device_unref(device);
+        return SoundIoErrorNoMem;
+    }
+
+    for (int port_index = 0; port_index < client->port_count; port_index += 1) {
+        const struct SoundIoJackPort *port = &client->ports[port_index];
+        struct SoundIoDeviceJackPort *djp = &dj->ports[port_index];
+        djp->full_name = soundio_str_dupe(port->full_name, port->full_name_len);
+        djp->full_name_len = port->full_name_len;
+        djp->channel_id = port->channel_id;
+        djp->latency_range = port->latency_range;
+
+        if (!djp->full_name) {
+            soundio_device_unref(device);
+            return SoundIoErrorNoMem;
+        }
+    }
+
+    memcpy(device->name, client->name, client->name_len);
+    memcpy(&device->name[client->name_len], ": ", 2);
+    int index = client->name_len + 2;
+    for (int port_index = 0; port_index < client->port_count; port_index += 1) {
+        const struct SoundIoJackPort *port = &client->ports[port_index];
+        memcpy(&device->name[index], port->name, port->name_len);
+        index += port->name_len;
+        if (port_index + 1 < client->port_count) {
+            memcpy(&device->name[index], ", ", 2);
+            index += 2;
+        }
+    }
+
+    device->current_layout.channel_count = client->port_count;
+    bool any_invalid = false;
+    for (int port_index = 0; port_index < client->port_count; port_index += 1) {
+        const struct SoundIoJackPort *port = &client->ports[port_index];
+        device->current_layout.channels[port_index] = port->channel_id;
+        any_invalid = any_invalid || (port->channel_id == SoundIoChannelIdInvalid);
+    }
+    if (any_invalid) {
+        const struct SoundIoChannelLayout *layout = soundio_channel_layout_get_default(client->port_count);
+        if (layout)
+            device->current_layout = *layout;
+    } else {
+        soundio_channel_layout_detect_builtin(&device->current_layout);
+    }
+
+    device->layout_count = 1;
+    device->layouts = &device->current_layout;
+    device->format_count = 1;
+    device->formats = &dev->prealloc_format;
+    device->formats[0] = device->current_format;
+
+    *out_device = device;
+    return 0;
+}
+
+// A device from the previous scan which describes `client` exactly as
+// create_device would. Carrying it over saves rebuilding every device each
+// time a single port comes or goes.
+static struct SoundIoDevice *find_unchanged_device(struct SoundIoJack *sij,
+        struct SoundIoDevicesInfo *old_devices_info, const struct SoundIoJackClient *client)
+{
+    if (!old_devices_info)
+        return NULL;
+    struct SoundIoListDevicePtr *device_list = (client->aim == SoundIoDeviceAimOutput) ?
+        &old_devices_info->output_devices : &old_devices_info->input_devices;
+    double latency = sij->period_size / (double) sij->sample_rate;
+    for (int i = 0; i < device_list->length; i += 1) {
+        struct SoundIoDevice *device = SoundIoListDevicePtr_val_at(device_list, i);
+        struct SoundIoDevicePrivate *dev = (struct SoundIoDevicePrivate *)device;
+        struct SoundIoDeviceJack *dj = &dev->backend_data.jack;
+        if (dj->port_count != client->port_count ||
+            device->sample_rate_current != sij->sample_rate ||
+            device->software_latency_current != latency ||
+            !soundio_streql(device->id, strlen(device->id), client->name, client->name_len))
+        {
+            continue;
+        }
+        bool same_ports = true;
+        for (int port_index = 0; port_index < client->port_count; port_index += 1) {
+            const struct SoundIoJackPort *port = &client->ports[port_index];
+            struct SoundIoDeviceJackPort *djp = &dj->ports[port_index];
+            if (djp->channel_id != port->channel_id ||
+                djp->latency_range.min != port->latency_range.min ||
+                djp->latency_range.max != port->latency_range.max ||
+                !soundio_streql(djp->full_name, djp->full_name_len, port->full_name, port->full_name_len))
+            {
+                same_ports = false;
+                break;
+            }
+        }
+        if (same_ports)
+            return device;
+    }
+    return NULL;
+}
+
+// Replaces si->safe_devices_info. The caller destroys the previous one.
+static int refresh_devices_bare(struct SoundIoPrivate *si,
+        struct SoundIoDevicesInfo **out_old_devices_info)
+{
     struct SoundIo *soundio = &si->pub;
     struct SoundIoJack *sij = &si->backend_data.jack;
+    int err;
 
     if (sij->is_shutdown)
         return SoundIoErrorBackendDisconnected;
 
 
-    struct SoundIoDevicesInfo *devices_info = ALLOCATE(struct SoundIoDevicesInfo, 1);
+    struct SoundIoDevicesInfo *devices_info = soundio_devices_info_create(soundio);
     if (!devices_info)
         return SoundIoErrorNoMem;
 
@@ -165,100 +308,16 @@ static int refresh_devices_bare(struct SoundIoPrivate *si) {
         if (client->port_count <= 0)
             continue;
 
-        struct SoundIoDevicePrivate *dev = ALLOCATE(struct SoundIoDevicePrivate, 1);
-        if (!dev) {
+        struct SoundIoDevice *device = find_unchanged_device(sij, si->safe_devices_info, client);
+        if (device) {
+            soundio_device_ref(device);
+        } else if ((err = create_device(si, devices_info, client, &device))) {
             jack_free(port_names);
+            SoundIoListJackClient_deinit(&clients);
             soundio_destroy_devices_info(devices_info);
-            return SoundIoErrorNoMem;
-        }
-        struct SoundIoDevice *device = &dev->pub;
-        struct SoundIoDeviceJack *dj = &dev->backend_data.jack;
-        int description_len = client->name_len + 3 + 2 * client->port_count;
-        for (int port_index = 0; port_index < client->port_count; port_index += 1) {
-            struct SoundIoJackPort *port = &client->ports[port_index];
-
-            description_len += port->name_len;
+            return err;
         }
 
-        dev->destruct = destruct_device;
-
-        device->ref_count = 1;
-        device->soundio = soundio;
-        device->is_raw = false;
-        device->aim = client->aim;
-        device->id = soundio_str_dupe(client->name, client->name_len);
-        device->name = ALLOCATE(char, description_len);
-        device->current_format = SoundIoFormatFloat32NE;
-        device->sample_rate_count = 1;
-        device->sample_rates = &dev->prealloc_sample_rate_range;
-        device->sample_rates[0].min = sij->sample_rate;
-        device->sample_rates[0].max = sij->sample_rate;
-        device->sample_rate_current = sij->sample_rate;
-
-        device->software_latency_current = sij->period_size / (double) sij->sample_rate;
-        device->software_latency_min = sij->period_size / (double) sij->sample_rate;
-        device->software_latency_max = sij->period_size / (double) sij->sample_rate;
-
-        dj->port_count = client->port_count;
-        dj->ports = ALLOCATE(struct SoundIoDeviceJackPort, dj->port_count);
-
-        if (!device->id || !device->name || !dj->ports) {
-            jack_free(port_names);
-            soundio_device_unref(device);
-            soundio_destroy_devices_info(devices_info);
-            return SoundIoErrorNoMem;
-        }
-
-        for (int port_index = 0; port_index < client->port_count; port_index += 1) {
-            struct SoundIoJackPort *port = &client->ports[port_index];
-            struct SoundIoDeviceJackPort *djp = &dj->ports[port_index];
-            djp->full_name = soundio_str_dupe(port->full_name, port->full_name_len);
-            djp->full_name_len = port->full_name_len;
-            djp->channel_id = port->channel_id;
-            djp->latency_range = port->latency_range;
-
-            if (!djp->full_name) {
-                jack_free(port_names);
-                soundio_device_unref(device);
-                soundio_destroy_devices_info(devices_info);
-                return SoundIoErrorNoMem;
-            }
-        }
-
-        memcpy(device->name, client->name, client->name_len);
-        memcpy(&device->name[client->name_len], ": ", 2);
-        int index = client->name_len + 2;
-        for (int port_index = 0; port_index < client->port_count; port_index += 1) {
-            struct SoundIoJackPort *port = &client->ports[port_index];
-            memcpy(&device->name[index], port->name, port->name_len);
-            index += port->name_len;
-            if (port_index + 1 < client->port_count) {
-                memcpy(&device->name[index], ", ", 2);
-                index += 2;
-            }
-        }
-
-        device->current_layout.channel_count = client->port_count;
-        bool any_invalid = false;
-        for (int port_index = 0; port_index < client->port_count; port_index += 1) {
-            struct SoundIoJackPort *port = &client->ports[port_index];
-            device->current_layout.channels[port_index] = port->channel_id;
-            any_invalid = any_invalid || (port->channel_id == SoundIoChannelIdInvalid);
-        }
-        if (any_invalid) {
-            const struct SoundIoChannelLayout *layout = soundio_channel_layout_get_default(client->port_count);
-            if (layout)
-                device->current_layout = *layout;
-        } else {
-            soundio_channel_layout_detect_builtin(&device->current_layout);
-        }
-
-        device->layout_count = 1;
-        device->layouts = &device->current_layout;
-        device->format_count = 1;
-        device->formats = &dev->prealloc_format;
-        device->formats[0] = device->current_format;
-
         struct SoundIoListDevicePtr *device_list;
         if (device->aim == SoundIoDeviceAimOutput) {
             device_list = &devices_info->output_devices;
@@ -273,23 +332,25 @@ static int refresh_devices_bare(struct SoundIoPrivate *si) {
 
         if (SoundIoListDevicePtr_append(device_list, device)) {
             soundio_device_unref(device);
+            jack_free(port_names);
+            SoundIoListJackClient_deinit(&clients);
             soundio_destroy_devices_info(devices_info);
             return SoundIoErrorNoMem;
         }
-
     }
     jack_free(port_names);
+    SoundIoListJackClient_deinit(&clients);
 
-    soundio_destroy_devices_info(si->safe_devices_info);
+    *out_old_devices_info = si->safe_devices_info;
     si->safe_devices_info = devices_info;
 
     return 0;
 }
 
-static int refresh_devices(struct SoundIoPrivate *si) {
+static int refresh_devices(struct SoundIoPrivate *si, struct SoundIoDevicesInfo **out_old_devices_info) {
     int err = SoundIoErrorInterrupted;
     while (err == SoundIoErrorInterrupted)
-        err = refresh_devices_bare(si);
+        err = refresh_devices_bare(si, out_old_devices_info);
     return err;
 }
 
@@ -316,10 +377,12 @@ static void my_flush_events(struct SoundIoPrivate *si, bool wait) {
         soundio->on_backend_disconnect(soundio, SoundIoErrorBackendDisconnected);
     } else {
         if (!SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(sij->refresh_devices_flag)) {
-            if ((err = refresh_devices(si))) {
+            struct SoundIoDevicesInfo *old_devices_info = NULL;
+            if ((err = refresh_devices(si, &old_devices_info))) {
                 SOUNDIO_ATOMIC_FLAG_CLEAR(sij->refresh_devices_flag);
             } else {
-                soundio->on_devices_change(soundio);
+                soundio_emit_devices_change(si, old_devices_info);
+                soundio_destroy_devices_info(old_devices_info);
             }
         }
     }
@@ -351,17 +414,75 @@ static void force_device_scan_jack(struct SoundIoPrivate *si) {
     soundio_os_mutex_unlock(sij->mutex);
 }
 
+// Converts the start deadline of a stream to the frame time of the server,
+// which all of its clients share.
+static void set_start_frame(jack_client_t *client, double start_deadline, int sample_rate,
+        bool *waiting_for_start, jack_nframes_t *start_frame)
+{
+    double wait = start_deadline - soundio_os_get_time();
+    *waiting_for_start = wait > 0.0;
+    if (*waiting_for_start)
+        *start_frame = jack_frame_time(client) + (jack_nframes_t)(wait * sample_rate);
+}
+
+// Whether the cycle of `nframes` which just began ends before `start_frame`.
+// Frame times wrap around, hence the signed difference.
+static bool cycle_before_start(jack_client_t *client, jack_nframes_t nframes,
+        jack_nframes_t start_frame)
+{
+    jack_nframes_t cycle_end = jack_last_frame_time(client) + nframes;
+    return (int32_t)(start_frame - cycle_end) >= 0;
+}
+
+// When the current cycle started, in soundio_os_get_time. This is JACK's
+// own filtered estimate, converted from its clock, which need not be ours.
+static bool get_cycle_start_time(jack_client_t *client, double *out_time) {
+    jack_nframes_t current_frames;
+    jack_time_t current_usecs;
+    jack_time_t next_usecs;
+    float period_usecs;
+    if (jack_get_cycle_times(client, &current_frames, &current_usecs, &next_usecs, &period_usecs))
+        return false;
+    double jack_now = jack_get_time() / 1000000.0;
+    *out_time = soundio_os_get_time() - (jack_now - current_usecs / 1000000.0);
+    return true;
+}
+
+static int instream_process_callback(jack_nframes_t nframes, void *arg);
+static int instream_connect_ports(struct SoundIoInStreamPrivate *is);
+
 static int outstream_process_callback(jack_nframes_t nframes, void *arg) {
     struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate *)arg;
     struct SoundIoOutStreamJack *osj = &os->backend_data.jack;
     struct SoundIoOutStream *outstream = &os->pub;
+    const int channel_count = outstream->layout.channel_count;
     osj->frames_left = nframes;
-    for (int ch = 0; ch < outstream->layout.channel_count; ch += 1) {
-        struct SoundIoOutStreamJackPort *osjp = &osj->ports[ch];
-        osj->areas[ch].ptr = (char*)jack_port_get_buffer(osjp->source_port, nframes);
-        osj->areas[ch].step = outstream->bytes_per_sample;
+    // the buffers may move from one cycle to the next
+    for (int ch = 0; ch < channel_count; ch += 1)
+        osj->buffers[ch] = (float *)jack_port_get_buffer(osj->ports[ch].source_port, nframes);
+    for (int ch = 0; ch < channel_count; ch += 1)
+        osj->areas[ch].ptr = (char *)osj->buffers[ch];
+    // the input of a duplex stream is read in the same cycle, first
+    if (os->duplex_input)
+        instream_process_callback(nframes, os->duplex_input);
+    if (osj->waiting_for_start) {
+        if (cycle_before_start(osj->client, nframes, osj->start_frame)) {
+            for (int ch = 0; ch < channel_count; ch += 1)
+                memset(osj->buffers[ch], 0, nframes * sizeof(float));
+            return 0;
+        }
+        osj->waiting_for_start = false;
+    }
+    double cycle_start;
+    if (get_cycle_start_time(osj->client, &cycle_start))
+        soundio_outstream_report_timestamp(os, cycle_start, osj->hardware_latency);
+    // the ports are what the planar callback wants, unless resampling
+    if (outstream->write_planar_callback && !os->resample) {
+        soundio_outstream_run_write_planar_callback(os, osj->buffers, osj->frames_left);
+        osj->frames_left = 0;
+        return 0;
     }
-    outstream->write_callback(outstream, osj->frames_left, osj->frames_left);
+    soundio_outstream_run_write_callback(os, osj->frames_left, osj->frames_left);
     return 0;
 }
 
@@ -387,28 +508,51 @@ static struct SoundIoDeviceJackPort *find_port_matching_channel(struct SoundIoDe
 
 static int outstream_xrun_callback(void *arg) {
     struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate *)arg;
-    struct SoundIoOutStream *outstream = &os->pub;
-    outstream->underflow_callback(outstream);
+    soundio_outstream_run_underflow_callback(os);
     return 0;
 }
 
+static int instream_buffer_size_changed(struct SoundIoInStreamPrivate *is, jack_nframes_t nframes);
+static int instream_sample_rate_changed(struct SoundIoInStreamPrivate *is, jack_nframes_t nframes);
+
+// Every cycle asks for a whole buffer, whatever its size, so the stream
+// carries on through a change. JACK calls this while no process callback
+// runs, so the buffers sized by the period can be reallocated here.
 static int outstream_buffer_size_callback(jack_nframes_t nframes, void *arg) {
     struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate *)arg;
     struct SoundIoOutStreamJack *osj = &os->backend_data.jack;
     struct SoundIoOutStream *outstream = &os->pub;
-    if ((jack_nframes_t)osj->period_size == nframes) {
-        return 0;
-    } else {
-        outstream->error_callback(outstream, SoundIoErrorStreaming);
+    int err;
+    if ((jack_nframes_t)osj->period_size != nframes) {
+        osj->period_size = nframes;
+        outstream->software_latency = nframes / (double)outstream->sample_rate;
+        if ((err = soundio_outstream_resample_resize(os))) {
+            outstream->error_callback(outstream, err);
+            return -1;
+        }
+        if (outstream->buffer_size_callback)
+            outstream->buffer_size_callback(outstream, nframes);
+    }
+    // a shared client has this callback only
+    if (os->duplex_input && instream_buffer_size_changed(os->duplex_input, nframes))
+        return -1;
+    if (os->duplex && (err = soundio_duplex_stream_resize(os->duplex))) {
+        outstream->error_callback(outstream, err);
         return -1;
     }
+    return 0;
 }
 
 static int outstream_sample_rate_callback(jack_nframes_t nframes, void *arg) {
     struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate *)arg;
     struct SoundIoOutStream *outstream = &os->pub;
+    if (os->duplex_input && instream_sample_rate_changed(os->duplex_input, nframes))
+        return -1;
     if (nframes == (jack_nframes_t)outstream->sample_rate) {
         return 0;
+    } else if (outstream->sample_rate_callback) {
+        outstream->sample_rate_callback(outstream, nframes);
+        return 0;
     } else {
         outstream->error_callback(outstream, SoundIoErrorStreaming);
         return -1;
@@ -491,6 +635,7 @@ static int outstream_open_jack(struct SoundIoPrivate *si, struct SoundIoOutStrea
         }
         struct SoundIoOutStreamJackPort *osjp = &osj->ports[ch];
         osjp->source_port = jport;
+        osj->areas[ch].step = outstream->bytes_per_sample;
         // figure out which dest port this connects to
         struct SoundIoDeviceJackPort *djp = find_port_matching_channel(device, my_channel_id);
         if (djp) {
@@ -539,6 +684,8 @@ static int outstream_start_jack(struct SoundIoPrivate *si, struct SoundIoOutStre
     if (sij->is_shutdown)
         return SoundIoErrorBackendDisconnected;
 
+    set_start_frame(osj->client, os->start_deadline, outstream->sample_rate,
+            &osj->waiting_for_start, &osj->start_frame);
     if ((err = jack_activate(osj->client)))
         return SoundIoErrorStreaming;
 
@@ -552,6 +699,8 @@ static int outstream_start_jack(struct SoundIoPrivate *si, struct SoundIoOutStre
         if ((err = jack_connect(osj->client, source_port_name, dest_port_name)))
             return SoundIoErrorStreaming;
     }
+    if (os->duplex_input)
+        return instream_connect_ports(os->duplex_input);
 
     return 0;
 }
@@ -591,58 +740,116 @@ static int outstream_get_latency_jack(struct SoundIoPrivate *si, struct SoundIoO
 static void instream_destroy_jack(struct SoundIoPrivate *si, struct SoundIoInStreamPrivate *is) {
     struct SoundIoInStreamJack *isj = &is->backend_data.jack;
 
-    jack_client_close(isj->client);
+    if (!isj->shares_client)
+        jack_client_close(isj->client);
     isj->client = NULL;
 }
 
 static int instream_xrun_callback(void *arg) {
     struct SoundIoInStreamPrivate *is = (struct SoundIoInStreamPrivate *)arg;
-    struct SoundIoInStream *instream = &is->pub;
-    instream->overflow_callback(instream);
+    soundio_instream_run_overflow_callback(is);
     return 0;
 }
 
-static int instream_buffer_size_callback(jack_nframes_t nframes, void *arg) {
-    struct SoundIoInStreamPrivate *is = (struct SoundIoInStreamPrivate *)arg;
+// Returns nonzero when the buffers could not be resized.
+static int instream_buffer_size_changed(struct SoundIoInStreamPrivate *is, jack_nframes_t nframes) {
     struct SoundIoInStreamJack *isj = &is->backend_data.jack;
     struct SoundIoInStream *instream = &is->pub;
-
-    if ((jack_nframes_t)isj->period_size == nframes) {
+    if ((jack_nframes_t)isj->period_size == nframes)
         return 0;
-    } else {
-        instream->error_callback(instream, SoundIoErrorStreaming);
+    isj->period_size = nframes;
+    instream->software_latency = nframes / (double)instream->sample_rate;
+    int err;
+    if (is->duplex && (err = soundio_duplex_stream_resize(is->duplex))) {
+        instream->error_callback(instream, err);
         return -1;
     }
+    if (instream->buffer_size_callback)
+        instream->buffer_size_callback(instream, nframes);
+    return 0;
 }
 
-static int instream_sample_rate_callback(jack_nframes_t nframes, void *arg) {
-    struct SoundIoInStreamPrivate *is = (struct SoundIoInStreamPrivate *)arg;
+// Returns nonzero when the change is an error.
+static int instream_sample_rate_changed(struct SoundIoInStreamPrivate *is, jack_nframes_t nframes) {
     struct SoundIoInStream *instream = &is->pub;
     if (nframes == (jack_nframes_t)instream->sample_rate) {
         return 0;
+    } else if (instream->sample_rate_callback) {
+        instream->sample_rate_callback(instream, nframes);
+        return 0;
     } else {
         instream->error_callback(instream, SoundIoErrorStreaming);
         return -1;
     }
 }
 
+static int instream_buffer_size_callback(jack_nframes_t nframes, void *arg) {
+    return instream_buffer_size_changed((struct SoundIoInStreamPrivate *)arg, nframes);
+}
+
+static int instream_sample_rate_callback(jack_nframes_t nframes, void *arg) {
+    return instream_sample_rate_changed((struct SoundIoInStreamPrivate *)arg, nframes);
+}
+
 static void instream_shutdown_callback(void *arg) {
     struct SoundIoInStreamPrivate *is = (struct SoundIoInStreamPrivate *)arg;
     struct SoundIoInStream *instream = &is->pub;
     instream->error_callback(instream, SoundIoErrorStreaming);
 }
 
+// Opens the client of a stream that has one of its own.
+static int instream_open_client(struct SoundIoPrivate *si, struct SoundIoInStreamPrivate *is) {
+    struct SoundIoInStream *instream = &is->pub;
+    struct SoundIoInStreamJack *isj = &is->backend_data.jack;
+
+    jack_status_t status;
+    isj->client = jack_client_open(instream->name, JackNoStartServer, &status);
+    if (!isj->client) {
+        assert(!(status & JackInvalidOption));
+        if (status & JackShmFailure)
+            return SoundIoErrorSystemResources;
+        if (status & JackNoSuchClient)
+            return SoundIoErrorNoSuchClient;
+        return SoundIoErrorOpeningDevice;
+    }
+
+    int err;
+    if ((err = jack_set_process_callback(isj->client, instream_process_callback, is)))
+        return SoundIoErrorOpeningDevice;
+    if ((err = jack_set_buffer_size_callback(isj->client, instream_buffer_size_callback, is)))
+        return SoundIoErrorOpeningDevice;
+    if ((err = jack_set_sample_rate_callback(isj->client, instream_sample_rate_callback, is)))
+        return SoundIoErrorOpeningDevice;
+    if ((err = jack_set_xrun_callback(isj->client, instream_xrun_callback, is)))
+        return SoundIoErrorOpeningDevice;
+    jack_on_shutdown(isj->client, instream_shutdown_callback, is);
+    return 0;
+}
+
 static int instream_process_callback(jack_nframes_t nframes, void *arg) {
     struct SoundIoInStreamPrivate *is = (struct SoundIoInStreamPrivate *)arg;
     struct SoundIoInStream *instream = &is->pub;
     struct SoundIoInStreamJack *isj = &is->backend_data.jack;
+    const int channel_count = instream->layout.channel_count;
     isj->frames_left = nframes;
-    for (int ch = 0; ch < instream->layout.channel_count; ch += 1) {
-        struct SoundIoInStreamJackPort *isjp = &isj->ports[ch];
-        isj->areas[ch].ptr = (char*)jack_port_get_buffer(isjp->dest_port, nframes);
-        isj->areas[ch].step = instream->bytes_per_sample;
+    for (int ch = 0; ch < channel_count; ch += 1)
+        isj->buffers[ch] = (const float *)jack_port_get_buffer(isj->ports[ch].dest_port, nframes);
+    for (int ch = 0; ch < channel_count; ch += 1)
+        isj->areas[ch].ptr = (char *)isj->buffers[ch];
+    if (isj->waiting_for_start) {
+        if (cycle_before_start(isj->client, nframes, isj->start_frame))
+            return 0;
+        isj->waiting_for_start = false;
+    }
+    double cycle_start;
+    if (get_cycle_start_time(isj->client, &cycle_start))
+        soundio_instream_report_timestamp(is, cycle_start, isj->hardware_latency);
+    if (instream->read_planar_callback) {
+        soundio_instream_run_read_planar_callback(is, isj->buffers, isj->frames_left);
+        isj->frames_left = 0;
+        return 0;
     }
-    instream->read_callback(instream, isj->frames_left, isj->frames_left);
+    soundio_instream_run_read_callback(is, isj->frames_left, isj->frames_left);
     return 0;
 }
 
@@ -663,36 +870,16 @@ static int instream_open_jack(struct SoundIoPrivate *si, struct SoundIoInStreamP
     instream->software_latency = device->software_latency_current;
     isj->period_size = sij->period_size;
 
-    jack_status_t status;
-    isj->client = jack_client_open(instream->name, JackNoStartServer, &status);
-    if (!isj->client) {
-        instream_destroy_jack(si, is);
-        assert(!(status & JackInvalidOption));
-        if (status & JackShmFailure)
-            return SoundIoErrorSystemResources;
-        if (status & JackNoSuchClient)
-            return SoundIoErrorNoSuchClient;
-        return SoundIoErrorOpeningDevice;
-    }
-
     int err;
-    if ((err = jack_set_process_callback(isj->client, instream_process_callback, is))) {
-        instream_destroy_jack(si, is);
-        return SoundIoErrorOpeningDevice;
-    }
-    if ((err = jack_set_buffer_size_callback(isj->client, instream_buffer_size_callback, is))) {
+    if (is->duplex_output) {
+        // one client runs both streams of a duplex stream in one process
+        // callback, that of the output
+        isj->client = is->duplex_output->backend_data.jack.client;
+        isj->shares_client = true;
+    } else if ((err = instream_open_client(si, is))) {
         instream_destroy_jack(si, is);
-        return SoundIoErrorOpeningDevice;
-    }
-    if ((err = jack_set_sample_rate_callback(isj->client, instream_sample_rate_callback, is))) {
-        instream_destroy_jack(si, is);
-        return SoundIoErrorOpeningDevice;
-    }
-    if ((err = jack_set_xrun_callback(isj->client, instream_xrun_callback, is))) {
-        instream_destroy_jack(si, is);
-        return SoundIoErrorOpeningDevice;
+        return err;
     }
-    jack_on_shutdown(isj->client, instream_shutdown_callback, is);
 
     jack_nframes_t max_port_latency = 0;
 
@@ -701,6 +888,12 @@ static int instream_open_jack(struct SoundIoPrivate *si, struct SoundIoInStreamP
     for (int ch = 0; ch < instream->layout.channel_count; ch += 1) {
         enum SoundIoChannelId my_channel_id = instream->layout.channels[ch];
         const char *channel_name = soundio_get_channel_name(my_channel_id);
+        // the output's ports already have the plain channel names
+        char shared_name[64];
+        if (isj->shares_client) {
+            snprintf(shared_name, sizeof(shared_name), "%s in", channel_name);
+            channel_name = shared_name;
+        }
         unsigned long flags = JackPortIsInput;
         if (!instream->non_terminal_hint)
             flags |= JackPortIsTerminal;
@@ -711,6 +904,7 @@ static int instream_open_jack(struct SoundIoPrivate *si, struct SoundIoInStreamP
         }
         struct SoundIoInStreamJackPort *isjp = &isj->ports[ch];
         isjp->dest_port = jport;
+        isj->areas[ch].step = instream->bytes_per_sample;
         // figure out which source port this connects to
         struct SoundIoDeviceJackPort *djp = find_port_matching_channel(device, my_channel_id);
         if (djp) {
@@ -750,18 +944,10 @@ static int instream_pause_jack(struct SoundIoPrivate *si, struct SoundIoInStream
     return SoundIoErrorIncompatibleBackend;
 }
 
-static int instream_start_jack(struct SoundIoPrivate *si, struct SoundIoInStreamPrivate *is) {
+static int instream_connect_ports(struct SoundIoInStreamPrivate *is) {
     struct SoundIoInStreamJack *isj = &is->backend_data.jack;
     struct SoundIoInStream *instream = &is->pub;
-    struct SoundIoJack *sij = &si->backend_data.jack;
     int err;
-
-    if (sij->is_shutdown)
-        return SoundIoErrorBackendDisconnected;
-
-    if ((err = jack_activate(isj->client)))
-        return SoundIoErrorStreaming;
-
     for (int ch = 0; ch < instream->layout.channel_count; ch += 1) {
         struct SoundIoInStreamJackPort *isjp = &isj->ports[ch];
         const char *source_port_name = isjp->source_port_name;
@@ -772,10 +958,29 @@ static int instream_start_jack(struct SoundIoPrivate *si, struct SoundIoInStream
         if ((err = jack_connect(isj->client, source_port_name, dest_port_name)))
             return SoundIoErrorStreaming;
     }
-
     return 0;
 }
 
+static int instream_start_jack(struct SoundIoPrivate *si, struct SoundIoInStreamPrivate *is) {
+    struct SoundIoInStreamJack *isj = &is->backend_data.jack;
+    struct SoundIoInStream *instream = &is->pub;
+    struct SoundIoJack *sij = &si->backend_data.jack;
+    int err;
+
+    if (sij->is_shutdown)
+        return SoundIoErrorBackendDisconnected;
+
+    set_start_frame(isj->client, is->start_deadline, instream->sample_rate,
+            &isj->waiting_for_start, &isj->start_frame);
+    // the output activates a shared client and connects these ports then
+    if (isj->shares_client)
+        return 0;
+    if ((err = jack_activate(isj->client)))
+        return SoundIoErrorStreaming;
+
+    return instream_connect_ports(is);
+}
+
 static int instream_begin_read_jack(struct SoundIoPrivate *si, struct SoundIoInStreamPrivate *is,
         struct SoundIoChannelArea **out_areas, int *frame_count)
 {
@@ -932,16 +1137,22 @@ int soundio_jack_init(struct SoundIoPrivate *si) {
         return SoundIoErrorInitAudioBackend;
     }
 
-    if ((err = refresh_devices(si))) {
+    struct SoundIoDevicesInfo *old_devices_info = NULL;
+    if ((err = refresh_devices(si, &old_devices_info))) {
         destroy_jack(si);
         return err;
     }
+    assert(!old_devices_info);
 
     si->destroy = destroy_jack;
     si->flush_events = flush_events_jack;
     si->wait_events = wait_events_jack;
     si->wakeup = wakeup_jack;
     si->force_device_scan = force_device_scan_jack;
+    si->waits_for_start_deadline = true;
+    si->drives_duplex_input = true;
+    // the largest buffer size a JACK server accepts
+    si->max_period_frame_count = 8192;
 
     si->outstream_open = outstream_open_jack;
     si->outstream_destroy = outstream_destroy_jack;
@@ -56,8 +56,15 @@ struct SoundIoOutStreamJack {
     int period_size;
     int frames_left;
     double hardware_latency;
+    // Until the cycle which contains start_frame the stream is silent, so
+    // that the members of a stream group begin in the same process cycle.
+    bool waiting_for_start;
+    jack_nframes_t start_frame;
+    // The port buffers of the current cycle, fetched together at its start.
+    // The steps of the areas never change.
     struct SoundIoOutStreamJackPort ports[SOUNDIO_MAX_CHANNELS];
     struct SoundIoChannelArea areas[SOUNDIO_MAX_CHANNELS];
+    float *buffers[SOUNDIO_MAX_CHANNELS];
 };
 
 struct SoundIoInStreamJackPort {
@@ -71,9 +78,16 @@ struct SoundIoInStreamJack {
     int period_size;
     int frames_left;
     double hardware_latency;
+    // See SoundIoOutStreamJack.
+    bool waiting_for_start;
+    jack_nframes_t start_frame;
+    // The input of a synchronous duplex stream registers its ports with the
+    // client of the output, which closes it.
+    bool shares_client;
+    // See SoundIoOutStreamJack.
     struct SoundIoInStreamJackPort ports[SOUNDIO_MAX_CHANNELS];
     struct SoundIoChannelArea areas[SOUNDIO_MAX_CHANNELS];
-    char *buf_ptrs[SOUNDIO_MAX_CHANNELS];
+    const float *buffers[SOUNDIO_MAX_CHANNELS];
 };
 
 #endif
@@ -0,0 +1,399 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "mixer.h"
+#include "convert.h"
+#include "os.h"
+#include "util.h"
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOUNDIO_MIXER_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SOUNDIO_MIXER_AVX2
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define SOUNDIO_MIXER_NEON
+#include <arm_neon.h>
+#endif
+
+SOUNDIO_MAKE_LIST_DEF(struct SoundIoMixerVoicePrivate *, SoundIoListMixerVoicePtr, SOUNDIO_LIST_STATIC)
+
+// Kernels which add one channel of a voice to the mix with a linear gain
+// ramp. The vector loops leave any remainder to the scalar tail.
+
+static void mix_add_tail(float *dest, const float *src, float gain, float gain_step,
+        int start, int count)
+{
+    for (int i = start; i < count; i += 1)
+        dest[i] += src[i] * (gain + i * gain_step);
+}
+
+static void mix_add_scalar(float *dest, const float *src, float gain, float gain_step, int count) {
+    mix_add_tail(dest, src, gain, gain_step, 0, count);
+}
+
+#if defined(SOUNDIO_MIXER_SSE2)
+static void mix_add_sse2(float *dest, const float *src, float gain, float gain_step, int count) {
+    __m128 g = _mm_add_ps(_mm_set1_ps(gain),
+            _mm_mul_ps(_mm_set1_ps(gain_step), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f)));
+    const __m128 g_step = _mm_set1_ps(4.0f * gain_step);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 d = _mm_loadu_ps(dest + i);
+        d = _mm_add_ps(d, _mm_mul_ps(_mm_loadu_ps(src + i), g));
+        _mm_storeu_ps(dest + i, d);
+        g = _mm_add_ps(g, g_step);
+    }
+    mix_add_tail(dest, src, gain, gain_step, i, count);
+}
+#endif
+
+#if defined(SOUNDIO_MIXER_AVX2)
+__attribute__((target("avx2")))
+static void mix_add_avx2(float *dest, const float *src, float gain, float gain_step, int count) {
+    __m256 g = _mm256_add_ps(_mm256_set1_ps(gain), _mm256_mul_ps(_mm256_set1_ps(gain_step),
+                _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f)));
+    const __m256 g_step = _mm256_set1_ps(8.0f * gain_step);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 d = _mm256_loadu_ps(dest + i);
+        d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_loadu_ps(src + i), g));
+        _mm256_storeu_ps(dest + i, d);
+        g = _mm256_add_ps(g, g_step);
+    }
+    mix_add_tail(dest, src, gain, gain_step, i, count);
+}
+#endif
+
+#if defined(SOUNDIO_MIXER_NEON)
+static void mix_add_neon(float *dest, const float *src, float gain, float gain_step, int count) {
+    static const float lanes[4] = {0.0f, 1.0f, 2.0f, 3.0f};
+    float32x4_t g = vmlaq_n_f32(vdupq_n_f32(gain), vld1q_f32(lanes), gain_step);
+    const float32x4_t g_step = vdupq_n_f32(4.0f * gain_step);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        vst1q_f32(dest + i, vfmaq_f32(vld1q_f32(dest + i), vld1q_f32(src + i), g));
+        g = vaddq_f32(g, g_step);
+    }
+    mix_add_tail(dest, src, gain, gain_step, i, count);
+}
+#endif
+
+static void select_kernels(struct SoundIoMixerPrivate *mp) {
+    mp->kernel_name = "scalar";
+    mp->mix_add = mix_add_scalar;
+#if defined(SOUNDIO_MIXER_SSE2)
+    mp->kernel_name = "sse2";
+    mp->mix_add = mix_add_sse2;
+#endif
+#if defined(SOUNDIO_MIXER_AVX2)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        mp->kernel_name = "avx2";
+        mp->mix_add = mix_add_avx2;
+    }
+#endif
+#if defined(SOUNDIO_MIXER_NEON)
+    mp->kernel_name = "neon";
+    mp->mix_add = mix_add_neon;
+#endif
+}
+
+static void set_planar_areas(struct SoundIoChannelArea *areas, float *buf, int channel_count) {
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        areas[ch].ptr = (char *)(buf + ch * SOUNDIO_MIXER_CHUNK_SIZE);
+        areas[ch].step = sizeof(float);
+    }
+}
+
+static double load_volume(struct SoundIoMixerVoicePrivate *voice) {
+    uint64_t bits = SOUNDIO_ATOMIC_LOAD(voice->volume_bits);
+    double volume;
+    memcpy(&volume, &bits, sizeof(volume));
+    return volume;
+}
+
+static void mix_voice(struct SoundIoMixerPrivate *mp, struct SoundIoMixerVoicePrivate *voice,
+        int channel_count, int frame_count)
+{
+    struct SoundIoChannelArea areas[SOUNDIO_MAX_CHANNELS];
+    set_planar_areas(areas, mp->voice_buf, channel_count);
+    voice->pub.write_callback(&voice->pub, areas, frame_count);
+
+    float volume = (float)load_volume(voice);
+    float gain_step = (volume - voice->gain) / frame_count;
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        mp->mix_add(mp->mix_buf + ch * SOUNDIO_MIXER_CHUNK_SIZE,
+                mp->voice_buf + ch * SOUNDIO_MIXER_CHUNK_SIZE, voice->gain, gain_step, frame_count);
+    }
+    voice->gain = volume;
+    voice->frames_mixed += frame_count;
+}
+
+// The set stays claimed until mixing_set is cleared. Claiming it and then
+// finding it still current means that publish_voice_set has yet to swap it
+// out, and will see the claim once it does.
+static struct SoundIoMixerVoiceSet *claim_voice_set(struct SoundIoMixerPrivate *mp) {
+    for (;;) {
+        void *set = SOUNDIO_ATOMIC_LOAD(mp->voice_set);
+        SOUNDIO_ATOMIC_STORE(mp->mixing_set, set);
+        if (SOUNDIO_ATOMIC_LOAD(mp->voice_set) == set)
+            return (struct SoundIoMixerVoiceSet *)set;
+    }
+}
+
+void soundio_mixer_mix(struct SoundIoMixerPrivate *mp, const struct SoundIoChannelArea *areas,
+        int frame_count)
+{
+    struct SoundIoOutStream *outstream = mp->pub.outstream;
+    const int channel_count = outstream->write_layout.channel_count;
+    struct SoundIoChannelArea src[SOUNDIO_MAX_CHANNELS];
+    struct SoundIoChannelArea dest[SOUNDIO_MAX_CHANNELS];
+    set_planar_areas(src, mp->mix_buf, channel_count);
+
+    struct SoundIoMixerVoiceSet *set = claim_voice_set(mp);
+    for (int offset = 0; offset < frame_count; offset += SOUNDIO_MIXER_CHUNK_SIZE) {
+        int count = soundio_int_min(frame_count - offset, SOUNDIO_MIXER_CHUNK_SIZE);
+        memset(mp->mix_buf, 0, channel_count * SOUNDIO_MIXER_CHUNK_SIZE * sizeof(float));
+        mp->chunk_latency = mp->write_latency + offset / (double)outstream->write_sample_rate;
+        for (int i = 0; i < set->count; i += 1) {
+            struct SoundIoMixerVoicePrivate *voice = set->voices[i];
+            if (SOUNDIO_ATOMIC_LOAD(voice->started) && !SOUNDIO_ATOMIC_LOAD(voice->paused))
+                mix_voice(mp, voice, channel_count, count);
+        }
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            dest[ch].ptr = areas[ch].ptr + offset * areas[ch].step;
+            dest[ch].step = areas[ch].step;
+        }
+        soundio_converter_convert(mp->from_float, src, dest, channel_count, count);
+    }
+    SOUNDIO_ATOMIC_STORE(mp->mixing_set, NULL);
+}
+
+// Only called on a set which the thread which mixes cannot have claimed.
+static int reserve_voice_set(struct SoundIoMixerVoiceSet *set, int capacity) {
+    if (set->capacity >= capacity)
+        return 0;
+    struct SoundIoMixerVoicePrivate **voices = ALLOCATE_NONZERO(struct SoundIoMixerVoicePrivate *, capacity);
+    if (!voices)
+        return SoundIoErrorNoMem;
+    free(set->voices);
+    set->voices = voices;
+    set->capacity = capacity;
+    return 0;
+}
+
+static struct SoundIoMixerVoiceSet *spare_voice_set(struct SoundIoMixerPrivate *mp) {
+    void *current = SOUNDIO_ATOMIC_LOAD(mp->voice_set);
+    return (current == &mp->voice_sets[0]) ? &mp->voice_sets[1] : &mp->voice_sets[0];
+}
+
+// Called with the mutex held, once the spare set can hold every voice. Once
+// this returns, the thread which mixes is done with the set it replaced,
+// which becomes the spare.
+static void publish_voice_set(struct SoundIoMixerPrivate *mp) {
+    struct SoundIoMixerVoiceSet *set = spare_voice_set(mp);
+    assert(set->capacity >= mp->voices.length);
+    for (int i = 0; i < mp->voices.length; i += 1)
+        set->voices[i] = SoundIoListMixerVoicePtr_val_at(&mp->voices, i);
+    set->count = mp->voices.length;
+
+    void *old = SOUNDIO_ATOMIC_EXCHANGE(mp->voice_set, set);
+    // a write is a few hundred frames at most, and is not waited on unless
+    // it started before the swap
+    while (SOUNDIO_ATOMIC_LOAD(mp->mixing_set) == old)
+        soundio_os_sleep_until(soundio_os_get_time() + 0.0005);
+}
+
+static void mixer_write_callback(struct SoundIoOutStream *outstream, int frame_count_min, int frame_count_max) {
+    struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate *)outstream;
+    struct SoundIoMixerPrivate *mp = os->mixer;
+
+    // what is written now is heard once everything before it is, so the
+    // latency of each voice only needs the offset of its chunk on top
+    if (soundio_outstream_get_latency(outstream, &mp->write_latency))
+        mp->write_latency = outstream->software_latency;
+
+    int frames_left = frame_count_max;
+    while (frames_left > 0) {
+        struct SoundIoChannelArea *areas;
+        int frame_count = frames_left;
+        int err;
+        if ((err = soundio_outstream_begin_write(outstream, &areas, &frame_count))) {
+            if (err != SoundIoErrorUnderflow)
+                outstream->error_callback(outstream, err);
+            return;
+        }
+        if (!frame_count)
+            break;
+        soundio_mixer_mix(mp, areas, frame_count);
+        if ((err = soundio_outstream_end_write(outstream))) {
+            if (err != SoundIoErrorUnderflow)
+                outstream->error_callback(outstream, err);
+            return;
+        }
+        mp->write_latency += frame_count / (double)outstream->write_sample_rate;
+        frames_left -= frame_count;
+    }
+}
+
+struct SoundIoMixer *soundio_mixer_create(struct SoundIoDevice *device) {
+    struct SoundIoMixerPrivate *mp = ALLOCATE(struct SoundIoMixerPrivate, 1);
+    if (!mp)
+        return NULL;
+    struct SoundIoMixer *mixer = &mp->pub;
+    select_kernels(mp);
+
+    mp->mutex = soundio_os_mutex_create();
+    mixer->outstream = soundio_outstream_create(device);
+    if (!mp->mutex || !mixer->outstream) {
+        soundio_mixer_destroy(mixer);
+        return NULL;
+    }
+    ((struct SoundIoOutStreamPrivate *)mixer->outstream)->mixer = mp;
+    SOUNDIO_ATOMIC_STORE(mp->voice_set, &mp->voice_sets[0]);
+    SOUNDIO_ATOMIC_STORE(mp->mixing_set, NULL);
+    return mixer;
+}
+
+void soundio_mixer_destroy(struct SoundIoMixer *mixer) {
+    if (!mixer)
+        return;
+    struct SoundIoMixerPrivate *mp = (struct SoundIoMixerPrivate *)mixer;
+    // stops the thread which mixes
+    soundio_outstream_destroy(mixer->outstream);
+    for (int i = 0; i < mp->voices.length; i += 1)
+        free(SoundIoListMixerVoicePtr_val_at(&mp->voices, i));
+    SoundIoListMixerVoicePtr_deinit(&mp->voices);
+    free(mp->voice_sets[0].voices);
+    free(mp->voice_sets[1].voices);
+    soundio_converter_destroy(mp->from_float);
+    if (mp->mutex)
+        soundio_os_mutex_destroy(mp->mutex);
+    free(mp);
+}
+
+int soundio_mixer_open(struct SoundIoMixer *mixer) {
+    struct SoundIoMixerPrivate *mp = (struct SoundIoMixerPrivate *)mixer;
+    struct SoundIoOutStream *outstream = mixer->outstream;
+
+    outstream->write_callback = mixer_write_callback;
+    int err;
+    if ((err = soundio_outstream_open(outstream)))
+        return err;
+    mp->from_float = soundio_converter_create(SoundIoFormatFloat32NE, outstream->format, 0);
+    if (!mp->from_float)
+        return SoundIoErrorNoMem;
+    return 0;
+}
+
+int soundio_mixer_start(struct SoundIoMixer *mixer) {
+    return soundio_outstream_start(mixer->outstream);
+}
+
+struct SoundIoMixerVoice *soundio_mixer_voice_create(struct SoundIoMixer *mixer) {
+    struct SoundIoMixerPrivate *mp = (struct SoundIoMixerPrivate *)mixer;
+    struct SoundIoMixerVoicePrivate *voice = ALLOCATE(struct SoundIoMixerVoicePrivate, 1);
+    if (!voice)
+        return NULL;
+    voice->pub.mixer = mixer;
+    soundio_mixer_voice_set_volume(&voice->pub, 1.0);
+    SOUNDIO_ATOMIC_STORE(voice->started, false);
+    SOUNDIO_ATOMIC_STORE(voice->paused, false);
+    voice->gain = 1.0f;
+
+    soundio_os_mutex_lock(mp->mutex);
+    int capacity = mp->voices.length + 1;
+    int err;
+    if ((err = reserve_voice_set(spare_voice_set(mp), capacity)) ||
+        (err = SoundIoListMixerVoicePtr_append(&mp->voices, voice)))
+    {
+        soundio_os_mutex_unlock(mp->mutex);
+        free(voice);
+        return NULL;
+    }
+    publish_voice_set(mp);
+    // the set which was replaced has to hold every voice too
+    if ((err = reserve_voice_set(spare_voice_set(mp), capacity))) {
+        SoundIoListMixerVoicePtr_pop(&mp->voices);
+        publish_voice_set(mp);
+        soundio_os_mutex_unlock(mp->mutex);
+        free(voice);
+        return NULL;
+    }
+    soundio_os_mutex_unlock(mp->mutex);
+    return &voice->pub;
+}
+
+void soundio_mixer_voice_destroy(struct SoundIoMixerVoice *voice) {
+    if (!voice)
+        return;
+    struct SoundIoMixerPrivate *mp = (struct SoundIoMixerPrivate *)voice->mixer;
+    soundio_os_mutex_lock(mp->mutex);
+    for (int i = 0; i < mp->voices.length; i += 1) {
+        if (&SoundIoListMixerVoicePtr_val_at(&mp->voices, i)->pub == voice) {
+            SoundIoListMixerVoicePtr_swap_remove(&mp->voices, i);
+            break;
+        }
+    }
+    publish_voice_set(mp);
+    soundio_os_mutex_unlock(mp->mutex);
+    // the mixer is done with it once the set which held it is replaced
+    free(voice);
+}
+
+int soundio_mixer_voice_start(struct SoundIoMixerVoice *voice) {
+    struct SoundIoMixerPrivate *mp = (struct SoundIoMixerPrivate *)voice->mixer;
+    struct SoundIoMixerVoicePrivate *vp = (struct SoundIoMixerVoicePrivate *)voice;
+    if (!voice->write_callback)
+        return SoundIoErrorInvalid;
+    soundio_os_mutex_lock(mp->mutex);
+    // no ramp from whatever the volume was before; the gain is the mixing
+    // thread's as soon as the voice is started
+    if (!SOUNDIO_ATOMIC_LOAD(vp->started)) {
+        vp->gain = (float)load_volume(vp);
+        SOUNDIO_ATOMIC_STORE(vp->started, true);
+    }
+    soundio_os_mutex_unlock(mp->mutex);
+    return 0;
+}
+
+void soundio_mixer_voice_pause(struct SoundIoMixerVoice *voice, bool pause) {
+    struct SoundIoMixerVoicePrivate *vp = (struct SoundIoMixerVoicePrivate *)voice;
+    SOUNDIO_ATOMIC_STORE(vp->paused, pause);
+}
+
+void soundio_mixer_voice_set_volume(struct SoundIoMixerVoice *voice, double volume) {
+    struct SoundIoMixerVoicePrivate *vp = (struct SoundIoMixerVoicePrivate *)voice;
+    uint64_t bits;
+    memcpy(&bits, &volume, sizeof(bits));
+    SOUNDIO_ATOMIC_STORE(vp->volume_bits, bits);
+}
+
+double soundio_mixer_voice_get_latency(struct SoundIoMixerVoice *voice) {
+    struct SoundIoMixerPrivate *mp = (struct SoundIoMixerPrivate *)voice->mixer;
+    return mp->chunk_latency;
+}
+
+void soundio_mixer_voice_get_position(struct SoundIoMixerVoice *voice,
+        struct SoundIoStreamPosition *position)
+{
+    struct SoundIoMixerPrivate *mp = (struct SoundIoMixerPrivate *)voice->mixer;
+    struct SoundIoMixerVoicePrivate *vp = (struct SoundIoMixerVoicePrivate *)voice;
+    int64_t latency_frames = (int64_t)(mp->chunk_latency * mp->pub.outstream->write_sample_rate + 0.5);
+    int64_t frame = vp->frames_mixed - latency_frames;
+    position->frame = frame > 0 ? frame : 0;
+    position->time = soundio_os_get_time();
+    position->rate = mp->pub.outstream->write_sample_rate;
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#ifndef SOUNDIO_MIXER_H
+#define SOUNDIO_MIXER_H
+
+#include "soundio_private.h"
+#include "atomics.h"
+#include "list.h"
+
+// Voices are mixed this many frames at a time.
+#define SOUNDIO_MIXER_CHUNK_SIZE 256
+
+struct SoundIoMixerVoicePrivate {
+    struct SoundIoMixerVoice pub;
+    // Set under the mixer's mutex, read while mixing.
+    struct SoundIoAtomicBool started;
+    // The bits of a double, so that the volume may be set from any thread.
+    struct SoundIoAtomicUInt64 volume_bits;
+    struct SoundIoAtomicBool paused;
+    // Only used while mixing. The gain reached at the end of the last chunk,
+    // which ramps towards the volume over a chunk when that changes.
+    float gain;
+    int64_t frames_mixed;
+};
+
+SOUNDIO_MAKE_LIST_STRUCT(struct SoundIoMixerVoicePrivate *, SoundIoListMixerVoicePtr, SOUNDIO_LIST_STATIC)
+
+// A copy of the mixer's voices for the thread which mixes.
+struct SoundIoMixerVoiceSet {
+    struct SoundIoMixerVoicePrivate **voices;
+    int count;
+    int capacity;
+};
+
+struct SoundIoMixerPrivate {
+    struct SoundIoMixer pub;
+
+    // Held while voices are added, started or removed. Never taken while
+    // mixing.
+    struct SoundIoOsMutex *mutex;
+    // Every voice which has not been destroyed, started or not.
+    struct SoundIoListMixerVoicePtr voices;
+
+    // The thread which mixes reads one of these sets while the other is
+    // refilled from `voices`, then the two swap. Both can hold every voice
+    // in `voices`, so that removing a voice never allocates.
+    struct SoundIoMixerVoiceSet voice_sets[2];
+    // Which of voice_sets is current, and which one the thread which mixes
+    // has claimed, or NULL between writes. A set is refilled only once it is
+    // neither.
+    struct SoundIoAtomicPtr voice_set;
+    struct SoundIoAtomicPtr mixing_set;
+
+    struct SoundIoConverter *from_float;
+    const char *kernel_name;
+    // dest[i] += src[i] * (gain + i * gain_step)
+    void (*mix_add)(float *dest, const float *src, float gain, float gain_step, int count);
+
+    // Set by the write callback: how long until the first frame it writes
+    // is heard. While a voice is called, how long until its first frame is.
+    double write_latency;
+    double chunk_latency;
+
+    // Planar, SOUNDIO_MIXER_CHUNK_SIZE frames per channel.
+    float mix_buf[SOUNDIO_MAX_CHANNELS * SOUNDIO_MIXER_CHUNK_SIZE];
+    float voice_buf[SOUNDIO_MAX_CHANNELS * SOUNDIO_MIXER_CHUNK_SIZE];
+};
+
+// Mixes `frame_count` frames of all playing voices into `areas`, which are in
+// the output stream's format. This is the write callback minus the stream.
+void soundio_mixer_mix(struct SoundIoMixerPrivate *mp, const struct SoundIoChannelArea *areas,
+        int frame_count);
+
+#endif
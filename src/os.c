@@ -15,6 +15,7 @@
 #include "os.h"
 #include "soundio_internal.h"
 #include "util.h"
+#include "atomics.h"
 
 #include <stdlib.h>
 #include <time.h>
@@ -54,16 +55,40 @@
 #include <windows.h>
 #include <mmsystem.h>
 #include <objbase.h>
+#include <avrt.h>
 
 #else
 
 #include <pthread.h>
+#include <sched.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
 #define MAP_ANONYMOUS MAP_ANON
 #endif
 
+#if defined(__linux__)
+#include <stdio.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#if !defined(SCHED_DEADLINE)
+#define SCHED_DEADLINE 6
+#endif
+#if defined(SYS_memfd_create)
+#define SOUNDIO_OS_MEMFD
+#if !defined(MFD_CLOEXEC)
+#define MFD_CLOEXEC 0x0001U
+#endif
+#if !defined(MFD_HUGETLB)
+#define MFD_HUGETLB 0x0004U
+#endif
+#endif
+#endif
+
 #endif
 
 #if defined(__FreeBSD__) || defined(__MACH__)
@@ -82,15 +107,25 @@ struct SoundIoOsThread {
 #if defined(SOUNDIO_OS_WINDOWS)
     HANDLE handle;
     DWORD id;
+    HANDLE mmcss_handle;
 #else
-    pthread_attr_t attr;
-    bool attr_init;
-
     pthread_t id;
     bool running;
 #endif
     void *arg;
     void (*run)(void *arg);
+
+    // Only set while soundio_os_thread_create waits for the new thread to
+    // apply its settings.
+    const struct SoundIoThreadSettings *requested;
+    struct SoundIoOsMutex *start_mutex;
+    struct SoundIoOsCond *start_cond;
+    bool started;
+
+    struct SoundIoThreadSettings applied;
+    bool rtprio_failed;
+    bool lock_stack;
+    int start_err;
 };
 
 struct SoundIoOsMutex {
@@ -125,6 +160,19 @@ struct SoundIoOsCond {
 };
 #endif
 
+struct SoundIoOsEvent {
+    // Set by the signal which makes the event readable, cleared by the wait
+    // which takes it; signals in between have nothing to do.
+    struct SoundIoAtomicBool pending;
+#if defined(__linux__)
+    int fd;
+#else
+    struct SoundIoOsMutex *mutex;
+    struct SoundIoOsCond *cond;
+    bool signaled;
+#endif
+};
+
 #if defined(SOUNDIO_OS_WINDOWS)
 static INIT_ONCE win32_init_once = INIT_ONCE_STATIC_INIT;
 static double win32_time_resolution;
@@ -138,6 +186,9 @@ static clock_serv_t cclock;
 #endif
 
 static int page_size;
+#if defined(SOUNDIO_OS_MEMFD)
+static size_t huge_page_size;
+#endif
 
 double soundio_os_get_time(void) {
 #if defined(SOUNDIO_OS_WINDOWS)
@@ -163,12 +214,241 @@ double soundio_os_get_time(void) {
 #endif
 }
 
+void soundio_os_sleep_until(double time) {
+    for (;;) {
+        double remaining = time - soundio_os_get_time();
+        if (remaining <= 0.0)
+            return;
+#if defined(SOUNDIO_OS_WINDOWS)
+        // Sleep only has the granularity of the system timer, so spin
+        // through the last couple of milliseconds.
+        if (remaining > 0.002)
+            Sleep((DWORD)((remaining - 0.002) * 1000.0));
+#else
+        struct timespec tms;
+        tms.tv_sec = (time_t)remaining;
+        tms.tv_nsec = (long)((remaining - (double)tms.tv_sec) * 1000000000.0);
+        nanosleep(&tms, NULL);
+#endif
+    }
+}
+
+#if defined(SOUNDIO_OS_WINDOWS)
+// Runs on the new thread. Fills in thread->applied with what took effect.
+static void apply_thread_settings(struct SoundIoOsThread *thread) {
+    const struct SoundIoThreadSettings *requested = thread->requested;
+    struct SoundIoThreadSettings *applied = &thread->applied;
+    HANDLE handle = GetCurrentThread();
+
+    DWORD_PTR process_mask, system_mask;
+    if (requested->cpu_mask[0] && SetThreadAffinityMask(handle, (DWORD_PTR)requested->cpu_mask[0]))
+        applied->cpu_mask[0] = (DWORD_PTR)requested->cpu_mask[0];
+    else if (GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask))
+        applied->cpu_mask[0] = process_mask;
+
+    applied->policy = SoundIoThreadPolicyNormal;
+    switch (requested->policy) {
+    case SoundIoThreadPolicyNormal:
+        return;
+    case SoundIoThreadPolicyDefault: {
+        // MMCSS also keeps the thread from being starved by the rest of the
+        // system, which a priority alone does not
+        DWORD task_index = 0;
+        thread->mmcss_handle = AvSetMmThreadCharacteristicsW(L"Pro Audio", &task_index);
+        if (thread->mmcss_handle) {
+            applied->policy = SoundIoThreadPolicyMmcss;
+            return;
+        }
+        if (SetThreadPriority(handle, THREAD_PRIORITY_TIME_CRITICAL)) {
+            applied->policy = SoundIoThreadPolicyFifo;
+            return;
+        }
+        break;
+    }
+    case SoundIoThreadPolicyFifo:
+    case SoundIoThreadPolicyRoundRobin:
+        if (SetThreadPriority(handle, THREAD_PRIORITY_TIME_CRITICAL)) {
+            applied->policy = (requested->policy == SoundIoThreadPolicyRoundRobin) ?
+                SoundIoThreadPolicyRoundRobin : SoundIoThreadPolicyFifo;
+            return;
+        }
+        break;
+    case SoundIoThreadPolicyMmcss: {
+        DWORD task_index = 0;
+        thread->mmcss_handle = AvSetMmThreadCharacteristicsW(L"Pro Audio", &task_index);
+        if (thread->mmcss_handle) {
+            applied->policy = SoundIoThreadPolicyMmcss;
+            return;
+        }
+        break;
+    }
+    case SoundIoThreadPolicyDeadline:
+        break;
+    }
+    thread->rtprio_failed = true;
+}
+#else
+static enum SoundIoThreadPolicy from_sched_policy(int sched_policy) {
+    switch (sched_policy) {
+    case SCHED_FIFO: return SoundIoThreadPolicyFifo;
+    case SCHED_RR: return SoundIoThreadPolicyRoundRobin;
+#if defined(__linux__)
+    case SCHED_DEADLINE: return SoundIoThreadPolicyDeadline;
+#endif
+    default: return SoundIoThreadPolicyNormal;
+    }
+}
+
+static bool set_sched_priority(int sched_policy, int priority) {
+    int min_priority = sched_get_priority_min(sched_policy);
+    int max_priority = sched_get_priority_max(sched_policy);
+    if (min_priority == -1 || max_priority == -1)
+        return false;
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority ? soundio_int_clamp(min_priority, priority, max_priority) : max_priority;
+    return !pthread_setschedparam(pthread_self(), sched_policy, &param);
+}
+
+#if defined(__linux__)
+static bool cpu_mask_is_empty(const struct SoundIoThreadSettings *settings) {
+    for (int i = 0; i < ARRAY_LENGTH(settings->cpu_mask); i += 1) {
+        if (settings->cpu_mask[i])
+            return false;
+    }
+    return true;
+}
+
+// glibc does not wrap sched_setattr.
+struct SoundIoSchedAttr {
+    uint32_t size;
+    uint32_t sched_policy;
+    uint64_t sched_flags;
+    int32_t sched_nice;
+    uint32_t sched_priority;
+    uint64_t sched_runtime;
+    uint64_t sched_deadline;
+    uint64_t sched_period;
+};
+#endif
+
+static bool set_sched_deadline(const struct SoundIoThreadSettings *requested) {
+#if defined(__linux__) && defined(SYS_sched_setattr)
+    if (!requested->deadline_runtime_ns || !requested->deadline_period_ns)
+        return false;
+    struct SoundIoSchedAttr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.sched_policy = SCHED_DEADLINE;
+    attr.sched_runtime = requested->deadline_runtime_ns;
+    attr.sched_deadline = requested->deadline_period_ns;
+    attr.sched_period = requested->deadline_period_ns;
+    return !syscall(SYS_sched_setattr, 0, &attr, 0);
+#else
+    return false;
+#endif
+}
+
+// Runs on the new thread. Fills in thread->applied with what took effect.
+static void apply_thread_settings(struct SoundIoOsThread *thread) {
+    const struct SoundIoThreadSettings *requested = thread->requested;
+    struct SoundIoThreadSettings *applied = &thread->applied;
+
+#if defined(__linux__)
+    // Before the policy, because SCHED_DEADLINE checks the affinity.
+    cpu_set_t cpu_set;
+    if (!cpu_mask_is_empty(requested)) {
+        CPU_ZERO(&cpu_set);
+        for (int cpu = 0; cpu < SOUNDIO_MAX_CPUS && cpu < CPU_SETSIZE; cpu += 1) {
+            if (requested->cpu_mask[cpu / 64] & (UINT64_C(1) << (cpu % 64)))
+                CPU_SET(cpu, &cpu_set);
+        }
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    }
+    if (!pthread_getaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set)) {
+        for (int cpu = 0; cpu < SOUNDIO_MAX_CPUS && cpu < CPU_SETSIZE; cpu += 1) {
+            if (CPU_ISSET(cpu, &cpu_set))
+                applied->cpu_mask[cpu / 64] |= UINT64_C(1) << (cpu % 64);
+        }
+    }
+#endif
+
+    bool ok;
+    switch (requested->policy) {
+    case SoundIoThreadPolicyNormal:
+        ok = true;
+        break;
+    case SoundIoThreadPolicyDefault:
+        ok = set_sched_priority(SCHED_FIFO, 0);
+        break;
+    case SoundIoThreadPolicyFifo:
+        ok = set_sched_priority(SCHED_FIFO, requested->priority);
+        break;
+    case SoundIoThreadPolicyRoundRobin:
+        ok = set_sched_priority(SCHED_RR, requested->priority);
+        break;
+    case SoundIoThreadPolicyDeadline:
+        ok = set_sched_deadline(requested);
+        break;
+    default:
+        ok = false;
+        break;
+    }
+    thread->rtprio_failed = !ok;
+
+    int sched_policy;
+    struct sched_param param;
+    if (pthread_getschedparam(pthread_self(), &sched_policy, &param)) {
+        applied->policy = SoundIoThreadPolicyNormal;
+        return;
+    }
+    applied->policy = from_sched_policy(sched_policy);
+    if (applied->policy == SoundIoThreadPolicyFifo || applied->policy == SoundIoThreadPolicyRoundRobin)
+        applied->priority = param.sched_priority;
+    if (applied->policy == SoundIoThreadPolicyDeadline) {
+        applied->deadline_runtime_ns = requested->deadline_runtime_ns;
+        applied->deadline_period_ns = requested->deadline_period_ns;
+    }
+}
+#endif
+
+#if defined(_MSC_VER)
+#define SOUNDIO_NOINLINE __declspec(noinline)
+#else
+#define SOUNDIO_NOINLINE __attribute__((noinline))
+#endif
+
+// Not inlined, so that the array covers the stack which thread->run will use.
+static SOUNDIO_NOINLINE int lock_stack(void) {
+    volatile char stack[SOUNDIO_OS_LOCKED_STACK_SIZE];
+    stack[0] = 0;
+    return soundio_os_lock_memory((void *)stack, sizeof(stack));
+}
+
+// Runs on the new thread before anything else. Returns false if the thread
+// must exit without calling thread->run.
+static bool thread_start(struct SoundIoOsThread *thread) {
+    if (!thread->requested)
+        return true;
+    apply_thread_settings(thread);
+    int err = thread->lock_stack ? lock_stack() : 0;
+    soundio_os_mutex_lock(thread->start_mutex);
+    thread->start_err = err;
+    thread->started = true;
+    soundio_os_cond_signal(thread->start_cond, thread->start_mutex);
+    soundio_os_mutex_unlock(thread->start_mutex);
+    return !err;
+}
+
 #if defined(SOUNDIO_OS_WINDOWS)
 static DWORD WINAPI run_win32_thread(LPVOID userdata) {
     struct SoundIoOsThread *thread = (struct SoundIoOsThread *)userdata;
     HRESULT err = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
     assert(err == S_OK);
-    thread->run(thread->arg);
+    if (thread_start(thread))
+        thread->run(thread->arg);
+    if (thread->mmcss_handle)
+        AvRevertMmThreadCharacteristics(thread->mmcss_handle);
     CoUninitialize();
     return 0;
 }
@@ -179,17 +459,20 @@ static void assert_no_err(int err) {
 
 static void *run_pthread(void *userdata) {
     struct SoundIoOsThread *thread = (struct SoundIoOsThread *)userdata;
-    thread->run(thread->arg);
+    if (thread_start(thread))
+        thread->run(thread->arg);
     return NULL;
 }
 #endif
 
 int soundio_os_thread_create(
         void (*run)(void *arg), void *arg,
+        const struct SoundIoThreadSettings *settings, bool lock_stack,
         void (*emit_rtprio_warning)(void),
         struct SoundIoOsThread ** out_thread)
 {
     *out_thread = NULL;
+    assert(settings || !lock_stack);
 
     struct SoundIoOsThread *thread = ALLOCATE(struct SoundIoOsThread, 1);
     if (!thread) {
@@ -200,63 +483,61 @@ int soundio_os_thread_create(
     thread->run = run;
     thread->arg = arg;
 
+    if (settings) {
+        thread->start_mutex = soundio_os_mutex_create();
+        thread->start_cond = soundio_os_cond_create();
+        if (!thread->start_mutex || !thread->start_cond) {
+            soundio_os_thread_destroy(thread);
+            return SoundIoErrorNoMem;
+        }
+        thread->requested = settings;
+        thread->lock_stack = lock_stack;
+    }
+
 #if defined(SOUNDIO_OS_WINDOWS)
     thread->handle = CreateThread(NULL, 0, run_win32_thread, thread, 0, &thread->id);
     if (!thread->handle) {
         soundio_os_thread_destroy(thread);
         return SoundIoErrorSystemResources;
     }
-    if (emit_rtprio_warning) {
-        if (!SetThreadPriority(thread->handle, THREAD_PRIORITY_TIME_CRITICAL)) {
-            emit_rtprio_warning();
-        }
-    }
 #else
     int err;
-    if ((err = pthread_attr_init(&thread->attr))) {
+    if ((err = pthread_create(&thread->id, NULL, run_pthread, thread))) {
         soundio_os_thread_destroy(thread);
         return SoundIoErrorNoMem;
     }
-    thread->attr_init = true;
-    
-    if (emit_rtprio_warning) {
-        int max_priority = sched_get_priority_max(SCHED_FIFO);
-        if (max_priority == -1) {
-            soundio_os_thread_destroy(thread);
-            return SoundIoErrorSystemResources;
-        }
-
-        if ((err = pthread_attr_setschedpolicy(&thread->attr, SCHED_FIFO))) {
-            soundio_os_thread_destroy(thread);
-            return SoundIoErrorSystemResources;
-        }
+    thread->running = true;
+#endif
 
-        struct sched_param param;
-        param.sched_priority = max_priority;
-        if ((err = pthread_attr_setschedparam(&thread->attr, &param))) {
+    if (settings) {
+        soundio_os_mutex_lock(thread->start_mutex);
+        while (!thread->started)
+            soundio_os_cond_wait(thread->start_cond, thread->start_mutex);
+        soundio_os_mutex_unlock(thread->start_mutex);
+        soundio_os_cond_destroy(thread->start_cond);
+        soundio_os_mutex_destroy(thread->start_mutex);
+        thread->start_cond = NULL;
+        thread->start_mutex = NULL;
+        thread->requested = NULL;
+        if (thread->start_err) {
+            int err = thread->start_err;
             soundio_os_thread_destroy(thread);
-            return SoundIoErrorSystemResources;
+            return err;
         }
-
-    }
-
-    if ((err = pthread_create(&thread->id, &thread->attr, run_pthread, thread))) {
-        if (err == EPERM && emit_rtprio_warning) {
+        if (thread->rtprio_failed && emit_rtprio_warning)
             emit_rtprio_warning();
-            err = pthread_create(&thread->id, NULL, run_pthread, thread);
-        }
-        if (err) {
-            soundio_os_thread_destroy(thread);
-            return SoundIoErrorNoMem;
-        }
     }
-    thread->running = true;
-#endif
 
     *out_thread = thread;
     return 0;
 }
 
+void soundio_os_thread_get_settings(struct SoundIoOsThread *thread,
+        struct SoundIoThreadSettings *settings)
+{
+    *settings = thread->applied;
+}
+
 void soundio_os_thread_destroy(struct SoundIoOsThread *thread) {
     if (!thread)
         return;
@@ -273,12 +554,11 @@ void soundio_os_thread_destroy(struct SoundIoOsThread *thread) {
     if (thread->running) {
         assert_no_err(pthread_join(thread->id, NULL));
     }
-
-    if (thread->attr_init) {
-        assert_no_err(pthread_attr_destroy(&thread->attr));
-    }
 #endif
 
+    soundio_os_cond_destroy(thread->start_cond);
+    soundio_os_mutex_destroy(thread->start_mutex);
+
     free(thread);
 }
 
@@ -554,6 +834,126 @@ void soundio_os_cond_wait(struct SoundIoOsCond *cond,
 #endif
 }
 
+struct SoundIoOsEvent *soundio_os_event_create(void) {
+    struct SoundIoOsEvent *event = ALLOCATE(struct SoundIoOsEvent, 1);
+    if (!event)
+        return NULL;
+    SOUNDIO_ATOMIC_STORE(event->pending, false);
+#if defined(__linux__)
+    event->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (event->fd == -1) {
+        free(event);
+        return NULL;
+    }
+#else
+    event->mutex = soundio_os_mutex_create();
+    event->cond = soundio_os_cond_create();
+    if (!event->mutex || !event->cond) {
+        soundio_os_event_destroy(event);
+        return NULL;
+    }
+#endif
+    return event;
+}
+
+void soundio_os_event_destroy(struct SoundIoOsEvent *event) {
+    if (!event)
+        return;
+#if defined(__linux__)
+    close(event->fd);
+#else
+    if (event->cond)
+        soundio_os_cond_destroy(event->cond);
+    if (event->mutex)
+        soundio_os_mutex_destroy(event->mutex);
+#endif
+    free(event);
+}
+
+void soundio_os_event_signal(struct SoundIoOsEvent *event) {
+    if (SOUNDIO_ATOMIC_EXCHANGE(event->pending, true))
+        return;
+#if defined(__linux__)
+    uint64_t one = 1;
+    ssize_t amt = write(event->fd, &one, sizeof(one));
+    // the counter cannot overflow with one write per signal
+    assert(amt == sizeof(one));
+    (void)amt;
+#else
+    soundio_os_mutex_lock(event->mutex);
+    event->signaled = true;
+    soundio_os_cond_signal(event->cond, event->mutex);
+    soundio_os_mutex_unlock(event->mutex);
+#endif
+}
+
+void soundio_os_event_reset(struct SoundIoOsEvent *event) {
+#if defined(__linux__)
+    uint64_t count;
+    if (read(event->fd, &count, sizeof(count)) != sizeof(count))
+        return;
+#else
+    soundio_os_mutex_lock(event->mutex);
+    bool signaled = event->signaled;
+    event->signaled = false;
+    soundio_os_mutex_unlock(event->mutex);
+    if (!signaled)
+        return;
+#endif
+    SOUNDIO_ATOMIC_STORE(event->pending, false);
+}
+
+void soundio_os_event_wait(struct SoundIoOsEvent *event) {
+#if defined(__linux__)
+    struct pollfd pfd;
+    pfd.fd = event->fd;
+    pfd.events = POLLIN;
+    for (;;) {
+        uint64_t count;
+        if (read(event->fd, &count, sizeof(count)) == sizeof(count))
+            break;
+        assert(errno == EAGAIN || errno == EINTR);
+        if (poll(&pfd, 1, -1) < 0)
+            assert(errno == EINTR);
+    }
+#else
+    soundio_os_mutex_lock(event->mutex);
+    while (!event->signaled)
+        soundio_os_cond_wait(event->cond, event->mutex);
+    event->signaled = false;
+    soundio_os_mutex_unlock(event->mutex);
+#endif
+    SOUNDIO_ATOMIC_STORE(event->pending, false);
+}
+
+int soundio_os_event_fd(struct SoundIoOsEvent *event) {
+#if defined(__linux__)
+    return event->fd;
+#else
+    return -1;
+#endif
+}
+
+#if defined(SOUNDIO_OS_MEMFD)
+// The default huge page size, which is what MFD_HUGETLB uses.
+static size_t read_huge_page_size(void) {
+    size_t size = 2 * 1024 * 1024;
+    FILE *f = fopen("/proc/meminfo", "r");
+    if (!f)
+        return size;
+    char line[128];
+    unsigned long kib;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "Hugepagesize: %lu kB", &kib) == 1) {
+            size = kib * 1024;
+            break;
+        }
+    }
+    fclose(f);
+    return size;
+}
+#endif
+
 static int internal_init(void) {
 #if defined(SOUNDIO_OS_WINDOWS)
     unsigned __int64 frequency;
@@ -566,6 +966,9 @@ static int internal_init(void) {
     page_size = win32_system_info.dwAllocationGranularity;
 #else
     page_size = sysconf(_SC_PAGESIZE);
+#if defined(SOUNDIO_OS_MEMFD)
+    huge_page_size = read_huge_page_size();
+#endif
 #if defined(__MACH__)
     host_get_clock_service(mach_host_self(), SYSTEM_CLOCK, &cclock);
 #endif
@@ -614,8 +1017,90 @@ static inline size_t ceil_dbl_to_size_t(double x) {
     return truncation + (truncation < x);
 }
 
+#if !defined(SOUNDIO_OS_WINDOWS)
+// An unlinked temporary file, preferably in tmpfs. Returns -1 on failure.
+static int open_temporary_file(void) {
+    char shm_path[] = "/dev/shm/soundio-XXXXXX";
+    char tmp_path[] = "/tmp/soundio-XXXXXX";
+    char *chosen_path;
+
+    int fd = mkstemp(shm_path);
+    if (fd < 0) {
+        fd = mkstemp(tmp_path);
+        if (fd < 0) {
+            return -1;
+        } else {
+            chosen_path = tmp_path;
+        }
+    } else {
+        chosen_path = shm_path;
+    }
+
+    if (unlink(chosen_path)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Maps the first capacity bytes of fd twice, back to back, at an address
+// which is a multiple of alignment. Returns NULL on failure.
+static char *map_mirrored(int fd, size_t capacity, size_t alignment) {
+    if (ftruncate(fd, capacity))
+        return NULL;
+
+    size_t reserve_size = 2 * capacity + (alignment > (size_t)page_size ? alignment : 0);
+    char *reserved = (char*)mmap(NULL, reserve_size, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (reserved == MAP_FAILED)
+        return NULL;
+    char *address = (char*)(((uintptr_t)reserved + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    size_t head_size = address - reserved;
+    size_t tail_size = reserve_size - head_size - 2 * capacity;
+    if (head_size)
+        munmap(reserved, head_size);
+    if (tail_size)
+        munmap(address + 2 * capacity, tail_size);
+
+    char *other_address = (char*)mmap(address, capacity, PROT_READ|PROT_WRITE,
+            MAP_FIXED|MAP_SHARED, fd, 0);
+    if (other_address != address) {
+        munmap(address, 2 * capacity);
+        return NULL;
+    }
+
+    other_address = (char*)mmap(address + capacity, capacity,
+            PROT_READ|PROT_WRITE, MAP_FIXED|MAP_SHARED, fd, 0);
+    if (other_address != address + capacity) {
+        munmap(address, 2 * capacity);
+        return NULL;
+    }
+
+    return address;
+}
+
+#if defined(SOUNDIO_OS_MEMFD)
+static char *map_mirrored_memfd(size_t capacity, size_t alignment, unsigned int memfd_flags) {
+    int fd = syscall(SYS_memfd_create, "soundio", MFD_CLOEXEC | memfd_flags);
+    if (fd < 0)
+        return NULL;
+    char *address = map_mirrored(fd, capacity, alignment);
+    close(fd);
+    return address;
+}
+#endif
+#endif
+
 int soundio_os_init_mirrored_memory(struct SoundIoOsMirroredMemory *mem, size_t requested_capacity) {
+    return soundio_os_init_mirrored_memory_ex(mem, requested_capacity, SoundIoOsMirroredMemoryFlagNone);
+}
+
+int soundio_os_init_mirrored_memory_ex(struct SoundIoOsMirroredMemory *mem,
+        size_t requested_capacity, int flags)
+{
     size_t actual_capacity = ceil_dbl_to_size_t(requested_capacity / (double)page_size) * page_size;
+#if !defined(SOUNDIO_OS_MEMFD)
+    (void)flags;
+#endif
 
 #if defined(SOUNDIO_OS_WINDOWS)
     BOOL ok;
@@ -670,58 +1155,43 @@ int soundio_os_init_mirrored_memory(struct SoundIoOsMirroredMemory *mem, size_t
         break;
     }
 #else
-    char shm_path[] = "/dev/shm/soundio-XXXXXX";
-    char tmp_path[] = "/tmp/soundio-XXXXXX";
-    char *chosen_path;
+    char *address = NULL;
 
-    int fd = mkstemp(shm_path);
-    if (fd < 0) {
-        fd = mkstemp(tmp_path);
-        if (fd < 0) {
-            return SoundIoErrorSystemResources;
-        } else {
-            chosen_path = tmp_path;
+#if defined(SOUNDIO_OS_MEMFD)
+    // memfd needs neither a file system nor room in /dev/shm.
+    if (flags & SoundIoOsMirroredMemoryFlagHugePages) {
+        size_t huge_capacity = ceil_dbl_to_size_t(requested_capacity / (double)huge_page_size) * huge_page_size;
+        address = map_mirrored_memfd(huge_capacity, huge_page_size, MFD_HUGETLB);
+        if (!address) {
+            // No huge pages reserved. Ask for transparent ones instead.
+            address = map_mirrored_memfd(huge_capacity, huge_page_size, 0);
+#if defined(MADV_HUGEPAGE)
+            if (address)
+                madvise(address, 2 * huge_capacity, MADV_HUGEPAGE);
+#endif
         }
-    } else {
-        chosen_path = shm_path;
-    }
-
-    if (unlink(chosen_path)) {
-        close(fd);
-        return SoundIoErrorSystemResources;
-    }
-
-    if (ftruncate(fd, actual_capacity)) {
-        close(fd);
-        return SoundIoErrorSystemResources;
-    }
-
-    char *address = (char*)mmap(NULL, actual_capacity * 2, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-    if (address == MAP_FAILED) {
-        close(fd);
-        return SoundIoErrorNoMem;
-    }
-
-    char *other_address = (char*)mmap(address, actual_capacity, PROT_READ|PROT_WRITE,
-            MAP_FIXED|MAP_SHARED, fd, 0);
-    if (other_address != address) {
-        munmap(address, 2 * actual_capacity);
-        close(fd);
-        return SoundIoErrorNoMem;
+        if (address)
+            actual_capacity = huge_capacity;
     }
+    if (!address)
+        address = map_mirrored_memfd(actual_capacity, page_size, 0);
+#endif
 
-    other_address = (char*)mmap(address + actual_capacity, actual_capacity,
-            PROT_READ|PROT_WRITE, MAP_FIXED|MAP_SHARED, fd, 0);
-    if (other_address != address + actual_capacity) {
-        munmap(address, 2 * actual_capacity);
-        close(fd);
-        return SoundIoErrorNoMem;
+    if (!address) {
+        int fd = open_temporary_file();
+        if (fd < 0)
+            return SoundIoErrorSystemResources;
+        address = map_mirrored(fd, actual_capacity, page_size);
+        if (close(fd)) {
+            if (address)
+                munmap(address, 2 * actual_capacity);
+            return SoundIoErrorSystemResources;
+        }
+        if (!address)
+            return SoundIoErrorNoMem;
     }
 
     mem->address = address;
-
-    if (close(fd))
-        return SoundIoErrorSystemResources;
 #endif
 
     mem->capacity = actual_capacity;
@@ -745,3 +1215,362 @@ void soundio_os_deinit_mirrored_memory(struct SoundIoOsMirroredMemory *mem) {
 #endif
     mem->address = NULL;
 }
+
+// Every page is at least this big.
+static const size_t min_page_size = 4096;
+
+int soundio_os_lock_memory(void *address, size_t size) {
+    if (!size)
+        return 0;
+#if defined(SOUNDIO_OS_WINDOWS)
+    if (!VirtualLock(address, size)) {
+        if (GetLastError() != ERROR_WORKING_SET_QUOTA)
+            return SoundIoErrorMemoryLock;
+        // locked pages count against the minimum working set
+        SIZE_T min_size, max_size;
+        HANDLE process = GetCurrentProcess();
+        if (!GetProcessWorkingSetSize(process, &min_size, &max_size) ||
+            !SetProcessWorkingSetSize(process, min_size + size, max_size + size) ||
+            !VirtualLock(address, size))
+        {
+            return SoundIoErrorMemoryLock;
+        }
+    }
+#else
+    if (mlock(address, size))
+        return SoundIoErrorMemoryLock;
+#endif
+    // Locking brings the pages in, but write once to each so that copy on
+    // write and zero pages are resolved too.
+    volatile char *bytes = (volatile char *)address;
+    for (size_t offset = 0; offset < size; offset += min_page_size)
+        bytes[offset] = bytes[offset];
+    bytes[size - 1] = bytes[size - 1];
+    return 0;
+}
+
+void soundio_os_unlock_memory(void *address, size_t size) {
+    if (!size)
+        return;
+#if defined(SOUNDIO_OS_WINDOWS)
+    VirtualUnlock(address, size);
+#else
+    munlock(address, size);
+#endif
+}
+
+int soundio_os_lock_mirrored_memory(struct SoundIoOsMirroredMemory *mem) {
+    // Both views, so that neither faults on its page table entries.
+    return soundio_os_lock_memory(mem->address, 2 * mem->capacity);
+}
+
+void *soundio_os_alloc_pages(size_t size) {
+#if defined(SOUNDIO_OS_WINDOWS)
+    return VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+    void *address = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    return (address == MAP_FAILED) ? NULL : address;
+#endif
+}
+
+void soundio_os_free_pages(void *address, size_t size) {
+    if (!address)
+        return;
+#if defined(SOUNDIO_OS_WINDOWS)
+    BOOL ok = VirtualFree(address, 0, MEM_RELEASE);
+    assert(ok);
+#else
+    int err = munmap(address, size);
+    assert(!err);
+#endif
+}
+
+struct SoundIoOsFile {
+#if defined(SOUNDIO_OS_WINDOWS)
+    HANDLE handle;
+#else
+    int fd;
+#endif
+    bool direct;
+};
+
+#if defined(SOUNDIO_OS_WINDOWS)
+static HANDLE create_file_utf8(const char *path, DWORD flags, int *err) {
+    int w_len = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, path, -1, NULL, 0);
+    if (w_len <= 0) {
+        *err = SoundIoErrorEncodingString;
+        return INVALID_HANDLE_VALUE;
+    }
+    wchar_t *w_path = ALLOCATE_NONZERO(wchar_t, w_len);
+    if (!w_path) {
+        *err = SoundIoErrorNoMem;
+        return INVALID_HANDLE_VALUE;
+    }
+    HANDLE handle = INVALID_HANDLE_VALUE;
+    *err = SoundIoErrorEncodingString;
+    if (MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, path, -1, w_path, w_len) == w_len) {
+        handle = CreateFileW(w_path, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+                FILE_ATTRIBUTE_NORMAL | flags, NULL);
+        *err = (handle == INVALID_HANDLE_VALUE) ? SoundIoErrorFileIo : 0;
+    }
+    free(w_path);
+    return handle;
+}
+#endif
+
+int soundio_os_file_create(const char *path, bool direct, struct SoundIoOsFile **out_file) {
+    *out_file = NULL;
+    struct SoundIoOsFile *file = ALLOCATE(struct SoundIoOsFile, 1);
+    if (!file)
+        return SoundIoErrorNoMem;
+
+#if defined(SOUNDIO_OS_WINDOWS)
+    int err;
+    file->handle = INVALID_HANDLE_VALUE;
+    if (direct)
+        file->handle = create_file_utf8(path, FILE_FLAG_NO_BUFFERING, &err);
+    file->direct = (file->handle != INVALID_HANDLE_VALUE);
+    if (!file->direct)
+        file->handle = create_file_utf8(path, 0, &err);
+    if (file->handle == INVALID_HANDLE_VALUE) {
+        free(file);
+        return err;
+    }
+#else
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    file->fd = -1;
+#if defined(O_DIRECT)
+    // some file systems, tmpfs for one, refuse O_DIRECT
+    if (direct)
+        file->fd = open(path, flags | O_DIRECT, 0666);
+    file->direct = (file->fd >= 0);
+#endif
+    if (file->fd < 0)
+        file->fd = open(path, flags, 0666);
+    if (file->fd < 0) {
+        free(file);
+        return SoundIoErrorFileIo;
+    }
+#if defined(F_NOCACHE)
+    // no alignment rules, but it helps to follow them anyway
+    if (direct)
+        file->direct = (fcntl(file->fd, F_NOCACHE, 1) != -1);
+#endif
+#endif
+
+    *out_file = file;
+    return 0;
+}
+
+bool soundio_os_file_is_direct(struct SoundIoOsFile *file) {
+    return file->direct;
+}
+
+int soundio_os_file_end_direct(struct SoundIoOsFile *file) {
+    if (!file->direct)
+        return 0;
+#if defined(SOUNDIO_OS_WINDOWS)
+    HANDLE handle = ReOpenFile(file->handle, GENERIC_WRITE, FILE_SHARE_READ, FILE_ATTRIBUTE_NORMAL);
+    if (handle == INVALID_HANDLE_VALUE)
+        return SoundIoErrorFileIo;
+    CloseHandle(file->handle);
+    file->handle = handle;
+#elif defined(O_DIRECT)
+    int flags = fcntl(file->fd, F_GETFL);
+    if (flags == -1 || fcntl(file->fd, F_SETFL, flags & ~O_DIRECT) == -1)
+        return SoundIoErrorFileIo;
+#elif defined(F_NOCACHE)
+    if (fcntl(file->fd, F_NOCACHE, 0) == -1)
+        return SoundIoErrorFileIo;
+#endif
+    file->direct = false;
+    return 0;
+}
+
+int soundio_os_file_write_at(struct SoundIoOsFile *file, const void *buf, size_t size, int64_t offset) {
+    const char *ptr = (const char *)buf;
+    while (size > 0) {
+#if defined(SOUNDIO_OS_WINDOWS)
+        OVERLAPPED overlapped;
+        memset(&overlapped, 0, sizeof(overlapped));
+        overlapped.Offset = (DWORD)offset;
+        overlapped.OffsetHigh = (DWORD)(offset >> 32);
+        DWORD amount = (DWORD)(size < (1 << 30) ? size : (1 << 30));
+        DWORD written;
+        if (!WriteFile(file->handle, ptr, amount, &written, &overlapped))
+            return SoundIoErrorFileIo;
+#else
+        ssize_t written = pwrite(file->fd, ptr, size, offset);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return SoundIoErrorFileIo;
+        }
+#endif
+        if (written == 0)
+            return SoundIoErrorFileIo;
+        ptr += written;
+        size -= written;
+        offset += written;
+    }
+    return 0;
+}
+
+void soundio_os_file_preallocate(struct SoundIoOsFile *file, int64_t offset, int64_t size) {
+#if defined(SOUNDIO_OS_WINDOWS)
+    FILE_ALLOCATION_INFO info;
+    info.AllocationSize.QuadPart = offset + size;
+    SetFileInformationByHandle(file->handle, FileAllocationInfo, &info, sizeof(info));
+#elif defined(__linux__)
+    // without changing the size, so that readers never see the zeros
+    fallocate(file->fd, FALLOC_FL_KEEP_SIZE, offset, size);
+#elif defined(F_PREALLOCATE)
+    fstore_t store;
+    memset(&store, 0, sizeof(store));
+    store.fst_flags = F_ALLOCATECONTIG;
+    store.fst_posmode = F_PEOFPOSMODE;
+    store.fst_length = size;
+    if (fcntl(file->fd, F_PREALLOCATE, &store) == -1) {
+        store.fst_flags = F_ALLOCATEALL;
+        fcntl(file->fd, F_PREALLOCATE, &store);
+    }
+#endif
+}
+
+int soundio_os_file_set_size(struct SoundIoOsFile *file, int64_t size) {
+#if defined(SOUNDIO_OS_WINDOWS)
+    LARGE_INTEGER distance;
+    distance.QuadPart = size;
+    if (!SetFilePointerEx(file->handle, distance, NULL, FILE_BEGIN) || !SetEndOfFile(file->handle))
+        return SoundIoErrorFileIo;
+#else
+    if (ftruncate(file->fd, size))
+        return SoundIoErrorFileIo;
+#endif
+    return 0;
+}
+
+int soundio_os_file_close(struct SoundIoOsFile *file) {
+    if (!file)
+        return 0;
+    int err = 0;
+#if defined(SOUNDIO_OS_WINDOWS)
+    if (!CloseHandle(file->handle))
+        err = SoundIoErrorFileIo;
+#else
+    if (close(file->fd))
+        err = SoundIoErrorFileIo;
+#endif
+    free(file);
+    return err;
+}
+
+void soundio_os_lower_thread_priority(void) {
+#if defined(SOUNDIO_OS_WINDOWS)
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#elif defined(__linux__)
+    // a nice value applies to the calling thread only on Linux
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 10);
+#elif defined(__APPLE__)
+    pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+#endif
+}
+
+#if defined(SOUNDIO_OS_WINDOWS)
+// PrefetchVirtualMemory is Windows 8 and later, and declared only when
+// building for it.
+struct SoundIoWin32MemoryRange {
+    PVOID VirtualAddress;
+    SIZE_T NumberOfBytes;
+};
+typedef BOOL (WINAPI *SoundIoPrefetchVirtualMemoryFn)(HANDLE process, ULONG_PTR count,
+        struct SoundIoWin32MemoryRange *ranges, ULONG flags);
+#endif
+
+int soundio_os_map_file(const char *path, struct SoundIoOsFileMapping *mapping) {
+    memset(mapping, 0, sizeof(struct SoundIoOsFileMapping));
+#if defined(SOUNDIO_OS_WINDOWS)
+    int w_len = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, path, -1, NULL, 0);
+    if (w_len <= 0)
+        return SoundIoErrorEncodingString;
+    wchar_t *w_path = ALLOCATE_NONZERO(wchar_t, w_len);
+    if (!w_path)
+        return SoundIoErrorNoMem;
+    if (MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, path, -1, w_path, w_len) != w_len) {
+        free(w_path);
+        return SoundIoErrorEncodingString;
+    }
+    HANDLE file = CreateFileW(w_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    free(w_path);
+    if (file == INVALID_HANDLE_VALUE)
+        return SoundIoErrorFileIo;
+    LARGE_INTEGER size;
+    HANDLE section = NULL;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+        section = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!section)
+        return SoundIoErrorFileIo;
+    void *address = MapViewOfFile(section, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(section);
+    if (!address)
+        return SoundIoErrorFileIo;
+    mapping->address = address;
+    mapping->size = size.QuadPart;
+#else
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return SoundIoErrorFileIo;
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size <= 0 || (uint64_t)st.st_size > SIZE_MAX) {
+        close(fd);
+        return SoundIoErrorFileIo;
+    }
+    void *address = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping keeps the file open
+    close(fd);
+    if (address == MAP_FAILED)
+        return SoundIoErrorFileIo;
+    madvise(address, (size_t)st.st_size, MADV_SEQUENTIAL);
+    mapping->address = address;
+    mapping->size = st.st_size;
+#endif
+    return 0;
+}
+
+void soundio_os_unmap_file(struct SoundIoOsFileMapping *mapping) {
+    if (!mapping->address)
+        return;
+#if defined(SOUNDIO_OS_WINDOWS)
+    UnmapViewOfFile(mapping->address);
+#else
+    munmap(mapping->address, (size_t)mapping->size);
+#endif
+    mapping->address = NULL;
+    mapping->size = 0;
+}
+
+void soundio_os_prefetch(const void *address, size_t size) {
+    if (!size)
+        return;
+#if defined(SOUNDIO_OS_WINDOWS)
+    static SoundIoPrefetchVirtualMemoryFn prefetch;
+    static bool looked_up;
+    if (!looked_up) {
+        HMODULE kernel32 = GetModuleHandleW(L"kernel32.dll");
+        if (kernel32)
+            prefetch = (SoundIoPrefetchVirtualMemoryFn)GetProcAddress(kernel32, "PrefetchVirtualMemory");
+        looked_up = true;
+    }
+    if (prefetch) {
+        struct SoundIoWin32MemoryRange range = {(PVOID)address, size};
+        prefetch(GetCurrentProcess(), 1, &range, 0);
+    }
+#else
+    // madvise wants a page aligned start
+    uintptr_t page_mask = (uintptr_t)soundio_os_page_size() - 1;
+    uintptr_t start = (uintptr_t)address & ~page_mask;
+    madvise((void *)start, size + ((uintptr_t)address - start), MADV_WILLNEED);
+#endif
+}
@@ -10,6 +10,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 // safe to call from any thread(s) multiple times, but
 // must be called at least once before calling any other os functions
@@ -17,13 +18,30 @@
 int soundio_os_init(void);
 
 double soundio_os_get_time(void);
+// Returns once soundio_os_get_time reaches `time`; right away if it already has.
+void soundio_os_sleep_until(double time);
 
+struct SoundIoThreadSettings;
 struct SoundIoOsThread;
+// The part of the stack soundio_os_thread_create locks with lock_stack.
+#define SOUNDIO_OS_LOCKED_STACK_SIZE (128 * 1024)
+
+// If settings is not NULL, the new thread applies them as far as the OS
+// allows before run is called, and emit_rtprio_warning is called if it did
+// not get the requested policy. Otherwise the thread is scheduled normally.
+// lock_stack requires settings; if the stack cannot be locked, run is never
+// called and the error is returned.
 int soundio_os_thread_create(
         void (*run)(void *arg), void *arg,
+        const struct SoundIoThreadSettings *settings, bool lock_stack,
         void (*emit_rtprio_warning)(void),
         struct SoundIoOsThread ** out_thread);
 
+// The settings thread runs with. Only meaningful if it was created with
+// settings.
+void soundio_os_thread_get_settings(struct SoundIoOsThread *thread,
+        struct SoundIoThreadSettings *settings);
+
 void soundio_os_thread_destroy(struct SoundIoOsThread *thread);
 
 
@@ -49,6 +67,24 @@ void soundio_os_cond_timed_wait(struct SoundIoOsCond *cond,
 void soundio_os_cond_wait(struct SoundIoOsCond *cond,
         struct SoundIoOsMutex *locked_mutex);
 
+// Wakes one thread which waits for it. Signals are coalesced: while one is
+// pending, signaling again is an atomic exchange, with no lock and no system
+// call. On Linux the event is an eventfd, which a thread can poll along with
+// other descriptors.
+struct SoundIoOsEvent;
+struct SoundIoOsEvent *soundio_os_event_create(void);
+void soundio_os_event_destroy(struct SoundIoOsEvent *event);
+void soundio_os_event_signal(struct SoundIoOsEvent *event);
+// Returns once the event has been signaled and takes the signal. Look for
+// what it was about afterwards; a signal which arrives meanwhile wakes the
+// next wait.
+void soundio_os_event_wait(struct SoundIoOsEvent *event);
+// Takes a pending signal, if any, without waiting. For threads which poll
+// soundio_os_event_fd themselves.
+void soundio_os_event_reset(struct SoundIoOsEvent *event);
+// Linux only. Readable while a signal is pending; -1 on other systems.
+int soundio_os_event_fd(struct SoundIoOsEvent *event);
+
 
 int soundio_os_page_size(void);
 
@@ -59,9 +95,71 @@ struct SoundIoOsMirroredMemory {
     void *priv;
 };
 
+enum SoundIoOsMirroredMemoryFlag {
+    SoundIoOsMirroredMemoryFlagNone = 0,
+    // Linux only. Use huge pages if any are reserved, otherwise ask for
+    // transparent huge pages. The capacity is rounded up to a multiple of
+    // the huge page size.
+    SoundIoOsMirroredMemoryFlagHugePages = 1,
+};
+
 // returned capacity might be increased from capacity to be a multiple of the
 // system page size
 int soundio_os_init_mirrored_memory(struct SoundIoOsMirroredMemory *mem, size_t capacity);
+// flags is a bitmask of SoundIoOsMirroredMemoryFlag values.
+int soundio_os_init_mirrored_memory_ex(struct SoundIoOsMirroredMemory *mem,
+        size_t capacity, int flags);
 void soundio_os_deinit_mirrored_memory(struct SoundIoOsMirroredMemory *mem);
+int soundio_os_lock_mirrored_memory(struct SoundIoOsMirroredMemory *mem);
+
+// Locks the pages of the range into RAM and faults them in, so that the
+// stream threads neither wait for them to be swapped in nor take page faults
+// on first touch. They stay locked until unlocked or unmapped.
+// Returns SoundIoErrorMemoryLock if that is not allowed, for example because
+// of RLIMIT_MEMLOCK.
+int soundio_os_lock_memory(void *address, size_t size);
+void soundio_os_unlock_memory(void *address, size_t size);
+
+// Zero initialized and page aligned, so that locking it does not lock
+// anything else. Returns NULL when out of memory.
+void *soundio_os_alloc_pages(size_t size);
+void soundio_os_free_pages(void *address, size_t size);
+
+// A file for long sequential writes. With direct I/O, which bypasses the page
+// cache where the OS and file system allow it, every write must start at an
+// offset and address aligned to SOUNDIO_OS_FILE_ALIGNMENT and be a multiple
+// of it in size. soundio_os_file_end_direct lifts that, for the tail.
+#define SOUNDIO_OS_FILE_ALIGNMENT 4096
+struct SoundIoOsFile;
+// Creates or truncates the file at `path`, a UTF-8 string. `direct` asks for
+// direct I/O; whether it was granted is soundio_os_file_is_direct.
+// Returns SoundIoErrorFileIo if the file cannot be created.
+int soundio_os_file_create(const char *path, bool direct, struct SoundIoOsFile **out_file);
+bool soundio_os_file_is_direct(struct SoundIoOsFile *file);
+int soundio_os_file_end_direct(struct SoundIoOsFile *file);
+int soundio_os_file_write_at(struct SoundIoOsFile *file, const void *buf, size_t size, int64_t offset);
+// Best effort. Reserves disk space without changing the size of the file
+// where the OS can, so that writes do not stall on allocating it.
+void soundio_os_file_preallocate(struct SoundIoOsFile *file, int64_t offset, int64_t size);
+int soundio_os_file_set_size(struct SoundIoOsFile *file, int64_t size);
+int soundio_os_file_close(struct SoundIoOsFile *file);
+
+// A read-only mapping of a whole file. The file is not kept open otherwise,
+// and may not be empty.
+struct SoundIoOsFileMapping {
+    void *address;
+    int64_t size;
+};
+// Returns SoundIoErrorFileIo if the file cannot be opened or mapped.
+int soundio_os_map_file(const char *path, struct SoundIoOsFileMapping *mapping);
+// Safe on a mapping which failed.
+void soundio_os_unmap_file(struct SoundIoOsFileMapping *mapping);
+// Best effort. Starts reading the range of a mapping in, without waiting for
+// it.
+void soundio_os_prefetch(const void *address, size_t size);
+
+// Best effort. Lets the calling thread yield to everything of normal
+// priority, for threads which only do background I/O.
+void soundio_os_lower_thread_priority(void);
 
 #endif
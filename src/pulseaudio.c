@@ -12,12 +12,43 @@
 #include <stdio.h>
 
 
+static void queue_device_event(struct SoundIoPulseAudio *sipa,
+        pa_subscription_event_type_t facility, uint32_t index, bool removed)
+{
+    for (int i = 0; i < sipa->device_event_count; i += 1) {
+        struct SoundIoPulseAudioDeviceEvent *event = &sipa->device_events[i];
+        if (event->facility == facility && event->index == index) {
+            event->removed = removed;
+            return;
+        }
+    }
+    if (sipa->device_event_count >= SOUNDIO_PULSEAUDIO_MAX_DEVICE_EVENTS) {
+        sipa->full_scan_queued = true;
+        return;
+    }
+    struct SoundIoPulseAudioDeviceEvent *event = &sipa->device_events[sipa->device_event_count];
+    sipa->device_event_count += 1;
+    event->facility = facility;
+    event->index = index;
+    event->removed = removed;
+}
+
 static void subscribe_callback(pa_context *context,
         pa_subscription_event_type_t event_bits, uint32_t index, void *userdata)
 {
     struct SoundIoPrivate *si = (struct SoundIoPrivate *)userdata;
     struct SoundIo *soundio = &si->pub;
     struct SoundIoPulseAudio *sipa = &si->backend_data.pulseaudio;
+    pa_subscription_event_type_t facility = (pa_subscription_event_type_t)
+        (event_bits & PA_SUBSCRIPTION_EVENT_FACILITY_MASK);
+    pa_subscription_event_type_t type = (pa_subscription_event_type_t)
+        (event_bits & PA_SUBSCRIPTION_EVENT_TYPE_MASK);
+    if (facility == PA_SUBSCRIPTION_EVENT_SINK || facility == PA_SUBSCRIPTION_EVENT_SOURCE) {
+        queue_device_event(sipa, facility, index, type == PA_SUBSCRIPTION_EVENT_REMOVE);
+    } else {
+        // the default sink or source may have changed
+        sipa->server_info_queued = true;
+    }
     sipa->device_scan_queued = true;
     pa_threaded_mainloop_signal(sipa->main_loop, 0);
     soundio->on_events_signal(soundio);
@@ -174,7 +205,8 @@ static void set_from_pulseaudio_channel_map(pa_channel_map channel_map, struct S
 
 static int set_all_device_channel_layouts(struct SoundIoDevice *device) {
     device->layout_count = soundio_channel_layout_builtin_count();
-    device->layouts = ALLOCATE(struct SoundIoChannelLayout, device->layout_count);
+    device->layouts = DEVICE_ALLOCATE((struct SoundIoDevicePrivate *)device,
+            struct SoundIoChannelLayout, device->layout_count);
     if (!device->layouts)
         return SoundIoErrorNoMem;
     for (int i = 0; i < device->layout_count; i += 1)
@@ -184,7 +216,8 @@ static int set_all_device_channel_layouts(struct SoundIoDevice *device) {
 
 static int set_all_device_formats(struct SoundIoDevice *device) {
     device->format_count = 9;
-    device->formats = ALLOCATE(enum SoundIoFormat, device->format_count);
+    device->formats = DEVICE_ALLOCATE((struct SoundIoDevicePrivate *)device,
+            enum SoundIoFormat, device->format_count);
     if (!device->formats)
         return SoundIoErrorNoMem;
     device->formats[0] = SoundIoFormatU8;
@@ -230,17 +263,17 @@ static void sink_info_callback(pa_context *pulse_context, const pa_sink_info *in
     if (sipa->device_query_err)
         return;
 
-    struct SoundIoDevicePrivate *dev = ALLOCATE(struct SoundIoDevicePrivate, 1);
+    struct SoundIoDevicePrivate *dev = soundio_device_create(sipa->current_devices_info);
     if (!dev) {
         sipa->device_query_err = SoundIoErrorNoMem;
         return;
     }
     struct SoundIoDevice *device = &dev->pub;
 
-    device->ref_count = 1;
+    dev->backend_data.pulseaudio.index = info->index;
     device->soundio = soundio;
-    device->id = strdup(info->name);
-    device->name = strdup(info->description);
+    device->id = soundio_device_strdup(dev, info->name);
+    device->name = soundio_device_strdup(dev, info->description);
     if (!device->id || !device->name) {
         soundio_device_unref(device);
         sipa->device_query_err = SoundIoErrorNoMem;
@@ -294,17 +327,17 @@ static void source_info_callback(pa_context *pulse_context, const pa_source_info
     if (sipa->device_query_err)
         return;
 
-    struct SoundIoDevicePrivate *dev = ALLOCATE(struct SoundIoDevicePrivate, 1);
+    struct SoundIoDevicePrivate *dev = soundio_device_create(sipa->current_devices_info);
     if (!dev) {
         sipa->device_query_err = SoundIoErrorNoMem;
         return;
     }
     struct SoundIoDevice *device = &dev->pub;
 
-    device->ref_count = 1;
+    dev->backend_data.pulseaudio.index = info->index;
     device->soundio = soundio;
-    device->id = strdup(info->name);
-    device->name = strdup(info->description);
+    device->id = soundio_device_strdup(dev, info->name);
+    device->name = soundio_device_strdup(dev, info->description);
     if (!device->id || !device->name) {
         soundio_device_unref(device);
         sipa->device_query_err = SoundIoErrorNoMem;
@@ -368,12 +401,68 @@ static void cleanup_refresh_devices(struct SoundIoPrivate *si) {
 
     soundio_destroy_devices_info(sipa->current_devices_info);
     sipa->current_devices_info = NULL;
+}
 
-    free(sipa->default_sink_name);
-    sipa->default_sink_name = NULL;
+// Whether a sink or source event since the last scan concerns the device.
+static bool device_has_event(struct SoundIoPulseAudio *sipa, struct SoundIoDevice *device) {
+    struct SoundIoDevicePrivate *dev = (struct SoundIoDevicePrivate *)device;
+    pa_subscription_event_type_t facility = (device->aim == SoundIoDeviceAimOutput) ?
+        PA_SUBSCRIPTION_EVENT_SINK : PA_SUBSCRIPTION_EVENT_SOURCE;
+    for (int i = 0; i < sipa->scan_event_count; i += 1) {
+        struct SoundIoPulseAudioDeviceEvent *event = &sipa->scan_events[i];
+        if (event->facility == facility && event->index == dev->backend_data.pulseaudio.index)
+            return true;
+    }
+    return false;
+}
 
-    free(sipa->default_source_name);
-    sipa->default_source_name = NULL;
+// The devices of the previous scan which no event concerns are carried over
+// as they are.
+static int keep_unchanged_devices(struct SoundIoPulseAudio *sipa,
+        struct SoundIoListDevicePtr *devices, struct SoundIoListDevicePtr *dest)
+{
+    for (int i = 0; i < devices->length; i += 1) {
+        struct SoundIoDevice *device = SoundIoListDevicePtr_val_at(devices, i);
+        if (device_has_event(sipa, device))
+            continue;
+        if (SoundIoListDevicePtr_append(dest, device))
+            return SoundIoErrorNoMem;
+        soundio_device_ref(device);
+    }
+    return 0;
+}
+
+// Queries only the sinks and sources which were added or changed since the
+// previous scan.
+static int refresh_changed_devices(struct SoundIoPrivate *si,
+        struct SoundIoDevicesInfo *prev_devices_info)
+{
+    struct SoundIoPulseAudio *sipa = &si->backend_data.pulseaudio;
+    int err;
+
+    if ((err = keep_unchanged_devices(sipa, &prev_devices_info->output_devices,
+                    &sipa->current_devices_info->output_devices)))
+    {
+        return err;
+    }
+    if ((err = keep_unchanged_devices(sipa, &prev_devices_info->input_devices,
+                    &sipa->current_devices_info->input_devices)))
+    {
+        return err;
+    }
+
+    for (int i = 0; i < sipa->scan_event_count; i += 1) {
+        struct SoundIoPulseAudioDeviceEvent *event = &sipa->scan_events[i];
+        if (event->removed)
+            continue;
+        // a device which is gone by now is simply not reported
+        pa_operation *op = (event->facility == PA_SUBSCRIPTION_EVENT_SINK) ?
+            pa_context_get_sink_info_by_index(sipa->pulse_context, event->index, sink_info_callback, si) :
+            pa_context_get_source_info_by_index(sipa->pulse_context, event->index, source_info_callback, si);
+        if ((err = perform_operation(si, op)))
+            return err;
+    }
+    return 0;
 }
 
 // call this while holding the main loop lock
@@ -381,23 +470,48 @@ static int refresh_devices(struct SoundIoPrivate *si) {
     struct SoundIo *soundio = &si->pub;
     struct SoundIoPulseAudio *sipa = &si->backend_data.pulseaudio;
 
+    // the newest list, which the application may not have picked up yet
+    struct SoundIoDevicesInfo *prev_devices_info = sipa->ready_devices_info ?
+        sipa->ready_devices_info : si->safe_devices_info;
+    bool full_scan = sipa->full_scan_queued || !prev_devices_info;
+    bool query_server_info = full_scan || sipa->server_info_queued || !sipa->default_sink_name;
+    sipa->full_scan_queued = false;
+    sipa->server_info_queued = false;
+    // events queued from here on are for the next scan
+    memcpy(sipa->scan_events, sipa->device_events,
+            sipa->device_event_count * sizeof(struct SoundIoPulseAudioDeviceEvent));
+    sipa->scan_event_count = sipa->device_event_count;
+    sipa->device_event_count = 0;
+
     assert(!sipa->current_devices_info);
-    sipa->current_devices_info = ALLOCATE(struct SoundIoDevicesInfo, 1);
+    sipa->current_devices_info = soundio_devices_info_create(soundio);
     if (!sipa->current_devices_info)
         return SoundIoErrorNoMem;
 
-    pa_operation *list_sink_op = pa_context_get_sink_info_list(sipa->pulse_context, sink_info_callback, si);
-    pa_operation *list_source_op = pa_context_get_source_info_list(sipa->pulse_context, source_info_callback, si);
-    pa_operation *server_info_op = pa_context_get_server_info(sipa->pulse_context, server_info_callback, si);
+    pa_operation *server_info_op = NULL;
+    if (query_server_info) {
+        free(sipa->default_sink_name);
+        sipa->default_sink_name = NULL;
+        free(sipa->default_source_name);
+        sipa->default_source_name = NULL;
+        server_info_op = pa_context_get_server_info(sipa->pulse_context, server_info_callback, si);
+    }
 
     int err;
-    if ((err = perform_operation(si, list_sink_op))) {
-        return err;
-    }
-    if ((err = perform_operation(si, list_source_op))) {
+    if (full_scan) {
+        pa_operation *list_sink_op = pa_context_get_sink_info_list(sipa->pulse_context, sink_info_callback, si);
+        pa_operation *list_source_op = pa_context_get_source_info_list(sipa->pulse_context, source_info_callback, si);
+        if ((err = perform_operation(si, list_sink_op))) {
+            return err;
+        }
+        if ((err = perform_operation(si, list_source_op))) {
+            return err;
+        }
+    } else if ((err = refresh_changed_devices(si, prev_devices_info))) {
         return err;
     }
-    if ((err = perform_operation(si, server_info_op))) {
+
+    if (query_server_info && (err = perform_operation(si, server_info_op))) {
         return err;
     }
 
@@ -480,7 +594,7 @@ static void my_flush_events(struct SoundIoPrivate *si, bool wait) {
     if (cb_shutdown)
         soundio->on_backend_disconnect(soundio, sipa->connection_err);
     else if (change)
-        soundio->on_devices_change(soundio);
+        soundio_emit_devices_change(si, old_devices_info);
 
     soundio_destroy_devices_info(old_devices_info);
 }
@@ -506,6 +620,7 @@ static void force_device_scan_pa(struct SoundIoPrivate *si) {
     struct SoundIoPulseAudio *sipa = &si->backend_data.pulseaudio;
     pa_threaded_mainloop_lock(sipa->main_loop);
     sipa->device_scan_queued = true;
+    sipa->full_scan_queued = true;
     pa_threaded_mainloop_signal(sipa->main_loop, 0);
     soundio->on_events_signal(soundio);
     pa_threaded_mainloop_unlock(sipa->main_loop);
@@ -616,15 +731,15 @@ static void playback_stream_state_callback(pa_stream *stream, void *userdata) {
 }
 
 static void playback_stream_underflow_callback(pa_stream *stream, void *userdata) {
-    struct SoundIoOutStream *outstream = (struct SoundIoOutStream*)userdata;
-    outstream->underflow_callback(outstream);
+    struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate*)userdata;
+    soundio_outstream_run_underflow_callback(os);
 }
 
 static void playback_stream_write_callback(pa_stream *stream, size_t nbytes, void *userdata) {
     struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate*)(userdata);
     struct SoundIoOutStream *outstream = &os->pub;
     int frame_count = nbytes / outstream->bytes_per_frame;
-    outstream->write_callback(outstream, 0, frame_count);
+    soundio_outstream_run_write_callback(os, 0, frame_count);
 }
 
 static void outstream_destroy_pa(struct SoundIoPrivate *si, struct SoundIoOutStreamPrivate *os) {
@@ -701,6 +816,9 @@ static int outstream_open_pa(struct SoundIoPrivate *si, struct SoundIoOutStreamP
 
         ospa->buffer_attr.maxlength = buffer_length;
         ospa->buffer_attr.tlength = buffer_length;
+        int period_frames = soundio_int_max(1, buffer_length / outstream->bytes_per_frame /
+                SOUNDIO_PULSEAUDIO_PERIOD_COUNT);
+        ospa->buffer_attr.minreq = period_frames * outstream->bytes_per_frame;
     }
 
     pa_stream_flags_t flags = (pa_stream_flags_t)(PA_STREAM_START_CORKED | PA_STREAM_AUTO_TIMING_UPDATE |
@@ -723,8 +841,15 @@ static int outstream_open_pa(struct SoundIoPrivate *si, struct SoundIoOutStreamP
         return err;
     }
 
-    size_t writable_size = pa_stream_writable_size(ospa->stream);
-    outstream->software_latency = ((double)writable_size) / (double)bytes_per_second;
+    // what the server settled on, which may be more than was asked for
+    const pa_buffer_attr *attr = pa_stream_get_buffer_attr(ospa->stream);
+    if (attr) {
+        ospa->buffer_attr = *attr;
+        outstream->software_latency = attr->tlength / (double)bytes_per_second;
+    } else {
+        size_t writable_size = pa_stream_writable_size(ospa->stream);
+        outstream->software_latency = ((double)writable_size) / (double)bytes_per_second;
+    }
 
     pa_threaded_mainloop_unlock(sipa->main_loop);
 
@@ -740,7 +865,7 @@ static int outstream_start_pa(struct SoundIoPrivate *si, struct SoundIoOutStream
 
     ospa->write_byte_count = pa_stream_writable_size(ospa->stream);
     int frame_count = ospa->write_byte_count / outstream->bytes_per_frame;
-    outstream->write_callback(outstream, 0, frame_count);
+    soundio_outstream_run_write_callback(os, 0, frame_count);
 
     pa_operation *op = pa_stream_cork(ospa->stream, false, NULL, NULL);
     if (!op) {
@@ -863,7 +988,7 @@ static void recording_stream_read_callback(pa_stream *stream, size_t nbytes, voi
     assert(nbytes % instream->bytes_per_frame == 0);
     assert(nbytes > 0);
     int available_frame_count = nbytes / instream->bytes_per_frame;
-    instream->read_callback(instream, 0, available_frame_count);
+    soundio_instream_run_read_callback(is, 0, available_frame_count);
 }
 
 static void instream_destroy_pa(struct SoundIoPrivate *si, struct SoundIoInStreamPrivate *is) {
@@ -882,6 +1007,8 @@ static void instream_destroy_pa(struct SoundIoPrivate *si, struct SoundIoInStrea
 
         ispa->stream = NULL;
     }
+    free(ispa->coalesce_buf);
+    ispa->coalesce_buf = NULL;
 }
 
 static int instream_open_pa(struct SoundIoPrivate *si, struct SoundIoInStreamPrivate *is) {
@@ -960,42 +1087,131 @@ static int instream_start_pa(struct SoundIoPrivate *si, struct SoundIoInStreamPr
         return err;
     }
 
+    // what the server settled on, which may be more than was asked for
+    bool latency_requested = instream->software_latency > 0.0;
+    const pa_buffer_attr *attr = pa_stream_get_buffer_attr(ispa->stream);
+    if (attr) {
+        ispa->buffer_attr = *attr;
+        if (attr->fragsize != UINT32_MAX) {
+            int bytes_per_second = instream->bytes_per_frame * instream->sample_rate;
+            instream->software_latency = attr->fragsize / (double)bytes_per_second;
+        }
+    }
+    // without a requested latency fragments are large enough as they are
+    if (latency_requested && !ispa->coalesce_buf) {
+        size_t capacity = ispa->buffer_attr.fragsize - ispa->buffer_attr.fragsize % instream->bytes_per_frame;
+        if (capacity > 0) {
+            ispa->coalesce_buf = ALLOCATE_NONZERO(char, capacity);
+            if (!ispa->coalesce_buf) {
+                pa_threaded_mainloop_unlock(sipa->main_loop);
+                return SoundIoErrorNoMem;
+            }
+            ispa->coalesce_capacity = capacity;
+        }
+    }
 
     pa_threaded_mainloop_unlock(sipa->main_loop);
     return 0;
 }
 
+static int peek(struct SoundIoInStreamPulseAudio *ispa) {
+    if (pa_stream_peek(ispa->stream, (const void **)&ispa->peek_buf, &ispa->peek_buf_size))
+        return SoundIoErrorStreaming;
+    // nothing at all is neither data nor a hole, and must not be dropped
+    ispa->peeked = ispa->peek_buf_size > 0;
+    ispa->peek_buf_index = 0;
+    return 0;
+}
+
+static int drop(struct SoundIoInStreamPulseAudio *ispa) {
+    ispa->peeked = false;
+    ispa->peek_buf = NULL;
+    if (pa_stream_drop(ispa->stream))
+        return SoundIoErrorStreaming;
+    return 0;
+}
+
+// Copies the fragment which was just peeked, and as many after it as fit
+// and are not holes, to the coalesce buffer. A fragment which does not fit
+// stays peeked for the next read.
+static int coalesce(struct SoundIoInStreamPulseAudio *ispa, size_t want_bytes) {
+    ispa->coalesce_index = 0;
+    ispa->coalesce_size = 0;
+    int err;
+    for (;;) {
+        memcpy(ispa->coalesce_buf + ispa->coalesce_size, ispa->peek_buf, ispa->peek_buf_size);
+        ispa->coalesce_size += ispa->peek_buf_size;
+        if ((err = drop(ispa)))
+            return err;
+
+        size_t readable = pa_stream_readable_size(ispa->stream);
+        if (ispa->coalesce_size >= want_bytes || readable == 0 || readable == (size_t)-1)
+            return 0;
+        if ((err = peek(ispa)))
+            return err;
+        if (!ispa->peek_buf || ispa->coalesce_size + ispa->peek_buf_size > ispa->coalesce_capacity)
+            return 0;
+    }
+}
+
+static void set_read_areas(struct SoundIoInStream *instream, struct SoundIoInStreamPulseAudio *ispa,
+        char *ptr)
+{
+    for (int ch = 0; ch < instream->layout.channel_count; ch += 1) {
+        ispa->areas[ch].ptr = ptr + instream->bytes_per_sample * ch;
+        ispa->areas[ch].step = instream->bytes_per_frame;
+    }
+}
+
 static int instream_begin_read_pa(struct SoundIoPrivate *si,
         struct SoundIoInStreamPrivate *is, struct SoundIoChannelArea **out_areas, int *frame_count)
 {
     struct SoundIoInStream *instream = &is->pub;
     struct SoundIoInStreamPulseAudio *ispa = &is->backend_data.pulseaudio;
-    pa_stream *stream = ispa->stream;
+    const int bytes_per_frame = instream->bytes_per_frame;
+    int err;
 
     assert(SOUNDIO_ATOMIC_LOAD(ispa->stream_ready));
 
-    if (!ispa->peek_buf) {
-        if (pa_stream_peek(stream, (const void **)&ispa->peek_buf, &ispa->peek_buf_size))
-            return SoundIoErrorStreaming;
+    if (ispa->coalesce_index >= ispa->coalesce_size) {
+        if (!ispa->peeked && (err = peek(ispa)))
+            return err;
 
-        ispa->peek_buf_frames_left = ispa->peek_buf_size / instream->bytes_per_frame;
-        ispa->peek_buf_index = 0;
+        if (!ispa->peeked) {
+            ispa->read_source = SoundIoPulseAudioReadNone;
+            *frame_count = 0;
+            *out_areas = NULL;
+            return 0;
+        }
 
-        // hole
         if (!ispa->peek_buf) {
-            *frame_count = ispa->peek_buf_frames_left;
+            ispa->read_source = SoundIoPulseAudioReadHole;
+            *frame_count = ispa->peek_buf_size / bytes_per_frame;
             *out_areas = NULL;
             return 0;
         }
+
+        size_t want_bytes = soundio_int_min(*frame_count, (int)(ispa->coalesce_capacity / bytes_per_frame)) *
+            (size_t)bytes_per_frame;
+        if (ispa->peek_buf_index == 0 && ispa->peek_buf_size < want_bytes) {
+            if ((err = coalesce(ispa, want_bytes)))
+                return err;
+        }
     }
 
-    ispa->read_frame_count = soundio_int_min(*frame_count, ispa->peek_buf_frames_left);
-    *frame_count = ispa->read_frame_count;
-    for (int ch = 0; ch < instream->layout.channel_count; ch += 1) {
-        ispa->areas[ch].ptr = ispa->peek_buf + ispa->peek_buf_index + instream->bytes_per_sample * ch;
-        ispa->areas[ch].step = instream->bytes_per_frame;
+    if (ispa->coalesce_index < ispa->coalesce_size) {
+        ispa->read_source = SoundIoPulseAudioReadCoalesced;
+        int frames_left = (ispa->coalesce_size - ispa->coalesce_index) / bytes_per_frame;
+        ispa->read_frame_count = soundio_int_min(*frame_count, frames_left);
+        set_read_areas(instream, ispa, ispa->coalesce_buf + ispa->coalesce_index);
+    } else {
+        ispa->read_source = SoundIoPulseAudioReadPeek;
+        int frames_left = (ispa->peek_buf_size - ispa->peek_buf_index) / bytes_per_frame;
+        ispa->read_frame_count = soundio_int_min(*frame_count, frames_left);
+        set_read_areas(instream, ispa, ispa->peek_buf + ispa->peek_buf_index);
     }
 
+    *frame_count = ispa->read_frame_count;
     *out_areas = ispa->areas;
 
     return 0;
@@ -1004,24 +1220,28 @@ static int instream_begin_read_pa(struct SoundIoPrivate *si,
 static int instream_end_read_pa(struct SoundIoPrivate *si, struct SoundIoInStreamPrivate *is) {
     struct SoundIoInStream *instream = &is->pub;
     struct SoundIoInStreamPulseAudio *ispa = &is->backend_data.pulseaudio;
-    pa_stream *stream = ispa->stream;
-
-    // hole
-    if (!ispa->peek_buf) {
-        if (pa_stream_drop(stream))
-            return SoundIoErrorStreaming;
-        return 0;
-    }
-
     size_t advance_bytes = ispa->read_frame_count * instream->bytes_per_frame;
-    ispa->peek_buf_index += advance_bytes;
-    ispa->peek_buf_frames_left -= ispa->read_frame_count;
 
-    if (ispa->peek_buf_index >= ispa->peek_buf_size) {
-        if (pa_stream_drop(stream))
-            return SoundIoErrorStreaming;
-        ispa->peek_buf = NULL;
+    switch (ispa->read_source) {
+    case SoundIoPulseAudioReadNone:
+        break;
+    case SoundIoPulseAudioReadHole:
+        return drop(ispa);
+    case SoundIoPulseAudioReadPeek:
+        ispa->peek_buf_index += advance_bytes;
+        if (ispa->peek_buf_index >= ispa->peek_buf_size)
+            return drop(ispa);
+        break;
+    case SoundIoPulseAudioReadCoalesced:
+        ispa->coalesce_index += advance_bytes;
+        if (ispa->coalesce_index >= ispa->coalesce_size) {
+            ispa->coalesce_index = 0;
+            ispa->coalesce_size = 0;
+        }
+        break;
     }
+    ispa->read_source = SoundIoPulseAudioReadNone;
+    ispa->read_frame_count = 0;
 
     return 0;
 }
@@ -16,7 +16,21 @@
 struct SoundIoPrivate;
 int soundio_pulseaudio_init(struct SoundIoPrivate *si);
 
-struct SoundIoDevicePulseAudio { int make_the_struct_not_empty; };
+struct SoundIoDevicePulseAudio {
+    // The index of the sink or source.
+    uint32_t index;
+};
+
+// Sink and source events beyond this many, between two scans, cause a full
+// scan instead of querying the changed devices one by one.
+#define SOUNDIO_PULSEAUDIO_MAX_DEVICE_EVENTS 64
+
+// A sink or source which was added, removed or changed since the last scan.
+struct SoundIoPulseAudioDeviceEvent {
+    pa_subscription_event_type_t facility;
+    uint32_t index;
+    bool removed;
+};
 
 struct SoundIoPulseAudio {
     int device_query_err;
@@ -25,9 +39,21 @@ struct SoundIoPulseAudio {
 
     pa_context *pulse_context;
     bool device_scan_queued;
+    // The next scan queries every device instead of only those in
+    // device_events.
+    bool full_scan_queued;
+    bool server_info_queued;
+    struct SoundIoPulseAudioDeviceEvent device_events[SOUNDIO_PULSEAUDIO_MAX_DEVICE_EVENTS];
+    int device_event_count;
+    // The events the scan in progress works from. They are taken from
+    // device_events before the first query, since waiting for a query
+    // releases the main loop lock and lets subscribe_callback queue more.
+    struct SoundIoPulseAudioDeviceEvent scan_events[SOUNDIO_PULSEAUDIO_MAX_DEVICE_EVENTS];
+    int scan_event_count;
 
     // the one that we're working on building
     struct SoundIoDevicesInfo *current_devices_info;
+    // kept from one scan to the next
     char *default_sink_name;
     char *default_source_name;
 
@@ -40,6 +66,11 @@ struct SoundIoPulseAudio {
     pa_proplist *props;
 };
 
+// With a requested software latency, the server asks for a refill each time
+// this fraction of the buffer has played, rather than at its default, which
+// is often a large part of a small buffer.
+#define SOUNDIO_PULSEAUDIO_PERIOD_COUNT 4
+
 struct SoundIoOutStreamPulseAudio {
     pa_stream *stream;
     struct SoundIoAtomicBool stream_ready;
@@ -50,14 +81,32 @@ struct SoundIoOutStreamPulseAudio {
     struct SoundIoChannelArea areas[SOUNDIO_MAX_CHANNELS];
 };
 
+enum SoundIoPulseAudioRead {
+    SoundIoPulseAudioReadNone,
+    SoundIoPulseAudioReadHole,
+    SoundIoPulseAudioReadPeek,
+    SoundIoPulseAudioReadCoalesced,
+};
+
 struct SoundIoInStreamPulseAudio {
     pa_stream *stream;
     struct SoundIoAtomicBool stream_ready;
     pa_buffer_attr buffer_attr;
+    // The fragment from pa_stream_peek which is being read, until it is
+    // dropped. A NULL peek_buf while peeked is a hole.
+    bool peeked;
     char *peek_buf;
     size_t peek_buf_index;
     size_t peek_buf_size;
-    int peek_buf_frames_left;
+    // Fragments smaller than a read asks for are copied together here, up
+    // to fragsize bytes, so that a read callback sees a whole fragsize at
+    // once instead of several small pieces.
+    char *coalesce_buf;
+    size_t coalesce_capacity;
+    size_t coalesce_index;
+    size_t coalesce_size;
+    // What the last soundio_instream_begin_read handed out.
+    enum SoundIoPulseAudioRead read_source;
     int read_frame_count;
     struct SoundIoChannelArea areas[SOUNDIO_MAX_CHANNELS];
 };
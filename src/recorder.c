@@ -0,0 +1,425 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "recorder.h"
+#include "convert.h"
+#include "util.h"
+
+#include <string.h>
+#include <math.h>
+
+// How often the writer thread looks for samples. Far less than any
+// reasonable buffer_duration, and long enough for a chunk to fill at common
+// rates and channel counts.
+static const double writer_wake_period = 0.05;
+
+enum {
+    WaveFormatPcm = 0x0001,
+    WaveFormatIeeeFloat = 0x0003,
+    WaveFormatExtensible = 0xfffe,
+};
+
+static void put_u16(char *p, uint16_t x) {
+    p[0] = (char)(x & 0xff);
+    p[1] = (char)(x >> 8);
+}
+
+static void put_u32(char *p, uint32_t x) {
+    put_u16(p, (uint16_t)(x & 0xffff));
+    put_u16(p + 2, (uint16_t)(x >> 16));
+}
+
+static void put_u64(char *p, uint64_t x) {
+    put_u32(p, (uint32_t)(x & 0xffffffff));
+    put_u32(p + 4, (uint32_t)(x >> 32));
+}
+
+// The speaker bits of WAVE_FORMAT_EXTENSIBLE are in the order of the first
+// SoundIoChannelId values. A layout which does not use them in that order
+// has no mask, which means the channels have no assigned position.
+static uint32_t channel_mask(const struct SoundIoChannelLayout *layout) {
+    uint32_t mask = 0;
+    int last_bit = -1;
+    for (int ch = 0; ch < layout->channel_count; ch += 1) {
+        enum SoundIoChannelId id = layout->channels[ch];
+        int bit = (int)id - (int)SoundIoChannelIdFrontLeft;
+        if (id < SoundIoChannelIdFrontLeft || id > SoundIoChannelIdTopBackRight || bit <= last_bit)
+            return 0;
+        mask |= (uint32_t)1 << bit;
+        last_bit = bit;
+    }
+    return mask;
+}
+
+static bool set_file_format(struct SoundIoRecorder *recorder, enum SoundIoFormat format) {
+    recorder->silence = 0;
+    recorder->pack_s24 = false;
+    switch (format) {
+    case SoundIoFormatU8:
+        recorder->format_tag = WaveFormatPcm;
+        recorder->file_sample_size = 1;
+        recorder->silence = 0x80;
+        break;
+    case SoundIoFormatS16LE:
+        recorder->format_tag = WaveFormatPcm;
+        recorder->file_sample_size = 2;
+        break;
+    case SoundIoFormatS24LE:
+        recorder->format_tag = WaveFormatPcm;
+        recorder->file_sample_size = 3;
+        recorder->pack_s24 = true;
+        break;
+    case SoundIoFormatS32LE:
+        recorder->format_tag = WaveFormatPcm;
+        recorder->file_sample_size = 4;
+        break;
+    case SoundIoFormatFloat32LE:
+        recorder->format_tag = WaveFormatIeeeFloat;
+        recorder->file_sample_size = 4;
+        break;
+    case SoundIoFormatFloat64LE:
+        recorder->format_tag = WaveFormatIeeeFloat;
+        recorder->file_sample_size = 8;
+        break;
+    default:
+        return false;
+    }
+    recorder->valid_bits = recorder->file_sample_size * 8;
+    return true;
+}
+
+void soundio_recorder_write_header(struct SoundIoRecorder *recorder, char *header, int64_t data_bytes) {
+    const int channel_count = recorder->channel_count;
+    // chunks are padded to an even size
+    int64_t riff_bytes = SOUNDIO_RECORDER_HEADER_SIZE - 8 + data_bytes + (data_bytes & 1);
+    bool rf64 = riff_bytes > UINT32_MAX;
+
+    memset(header, 0, SOUNDIO_RECORDER_HEADER_SIZE);
+    char *p = header;
+    memcpy(p, rf64 ? "RF64" : "RIFF", 4);
+    put_u32(p + 4, rf64 ? UINT32_MAX : (uint32_t)riff_bytes);
+    memcpy(p + 8, "WAVE", 4);
+    p += 12;
+
+    // A JUNK chunk holds the place of the ds64 chunk, which it turns into
+    // once the sizes no longer fit.
+    memcpy(p, rf64 ? "ds64" : "JUNK", 4);
+    put_u32(p + 4, 28);
+    if (rf64) {
+        put_u64(p + 8, (uint64_t)riff_bytes);
+        put_u64(p + 16, (uint64_t)data_bytes);
+        put_u64(p + 24, (uint64_t)(data_bytes / recorder->file_frame_size));
+        put_u32(p + 32, 0);
+    }
+    p += 36;
+
+    memcpy(p, "fmt ", 4);
+    put_u32(p + 4, 40);
+    put_u16(p + 8, WaveFormatExtensible);
+    put_u16(p + 10, (uint16_t)channel_count);
+    put_u32(p + 12, (uint32_t)recorder->sample_rate);
+    put_u32(p + 16, (uint32_t)(recorder->sample_rate * recorder->file_frame_size));
+    put_u16(p + 20, (uint16_t)recorder->file_frame_size);
+    put_u16(p + 22, (uint16_t)(recorder->file_sample_size * 8));
+    put_u16(p + 24, 22);
+    put_u16(p + 26, (uint16_t)recorder->valid_bits);
+    put_u32(p + 28, recorder->channel_mask);
+    // the sub format GUID is the format tag followed by a fixed suffix
+    static const unsigned char guid_suffix[14] = {
+        0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71,
+    };
+    put_u16(p + 32, (uint16_t)recorder->format_tag);
+    memcpy(p + 34, guid_suffix, sizeof(guid_suffix));
+    p += 48;
+
+    // padding, so that the samples start aligned
+    char *data = header + SOUNDIO_RECORDER_HEADER_SIZE - 8;
+    memcpy(p, "JUNK", 4);
+    put_u32(p + 4, (uint32_t)(data - p - 8));
+
+    memcpy(data, "data", 4);
+    put_u32(data + 4, rf64 ? UINT32_MAX : (uint32_t)data_bytes);
+}
+
+static void set_write_error(struct SoundIoRecorder *recorder, int err) {
+    if (!SOUNDIO_ATOMIC_LOAD(recorder->write_error))
+        SOUNDIO_ATOMIC_STORE(recorder->write_error, err);
+}
+
+static int write_header(struct SoundIoRecorder *recorder) {
+    soundio_recorder_write_header(recorder, recorder->header, recorder->data_bytes);
+    return soundio_os_file_write_at(recorder->file, recorder->header, SOUNDIO_RECORDER_HEADER_SIZE, 0);
+}
+
+static void write_chunk(struct SoundIoRecorder *recorder) {
+    int64_t offset = SOUNDIO_RECORDER_HEADER_SIZE + recorder->data_bytes;
+    if (offset + SOUNDIO_RECORDER_CHUNK_SIZE > recorder->preallocated) {
+        soundio_os_file_preallocate(recorder->file, recorder->preallocated, SOUNDIO_RECORDER_PREALLOCATE_SIZE);
+        recorder->preallocated += SOUNDIO_RECORDER_PREALLOCATE_SIZE;
+    }
+    int err;
+    if ((err = soundio_os_file_write_at(recorder->file, recorder->chunk, SOUNDIO_RECORDER_CHUNK_SIZE, offset))) {
+        set_write_error(recorder, err);
+        return;
+    }
+    recorder->data_bytes += SOUNDIO_RECORDER_CHUNK_SIZE;
+    recorder->chunk_fill -= SOUNDIO_RECORDER_CHUNK_SIZE;
+    memmove(recorder->chunk, recorder->chunk + SOUNDIO_RECORDER_CHUNK_SIZE, recorder->chunk_fill);
+    SOUNDIO_ATOMIC_STORE(recorder->frames_written, recorder->data_bytes / recorder->file_frame_size);
+
+    // so that a file cut short by a crash still plays up to here
+    if ((err = write_header(recorder)))
+        set_write_error(recorder, err);
+}
+
+static void copy_to_chunk(struct SoundIoRecorder *recorder, const char *src, int frame_count) {
+    char *dest = recorder->chunk + recorder->chunk_fill;
+    if (recorder->pack_s24) {
+        int sample_count = frame_count * recorder->channel_count;
+        for (int i = 0; i < sample_count; i += 1) {
+            memcpy(dest, src, 3);
+            dest += 3;
+            src += 4;
+        }
+    } else {
+        memcpy(dest, src, frame_count * recorder->in_frame_size);
+    }
+    recorder->chunk_fill += frame_count * recorder->file_frame_size;
+}
+
+// Moves everything from the ring buffer to the file, but for the last
+// partial chunk.
+static void drain(struct SoundIoRecorder *recorder) {
+    struct SoundIoRingBuffer *rb = &recorder->ring_buffer;
+    for (;;) {
+        int fill_frames = soundio_ring_buffer_fill_count(rb) / recorder->in_frame_size;
+        if (!fill_frames)
+            return;
+        if (SOUNDIO_ATOMIC_LOAD(recorder->write_error)) {
+            // nowhere to put them
+            soundio_ring_buffer_advance_read_ptr(rb, fill_frames * recorder->in_frame_size);
+            SOUNDIO_ATOMIC_FETCH_ADD(recorder->bytes_drained, fill_frames * recorder->in_frame_size);
+            SOUNDIO_ATOMIC_FETCH_ADD(recorder->frames_dropped, fill_frames);
+            continue;
+        }
+        // the last frame may cross the end of the chunk
+        int room = SOUNDIO_RECORDER_CHUNK_SIZE - recorder->chunk_fill;
+        int room_frames = (room + recorder->file_frame_size - 1) / recorder->file_frame_size;
+        int count = soundio_int_min(fill_frames, room_frames);
+        copy_to_chunk(recorder, soundio_ring_buffer_read_ptr(rb), count);
+        soundio_ring_buffer_advance_read_ptr(rb, count * recorder->in_frame_size);
+        SOUNDIO_ATOMIC_FETCH_ADD(recorder->bytes_drained, count * recorder->in_frame_size);
+        if (recorder->chunk_fill >= SOUNDIO_RECORDER_CHUNK_SIZE)
+            write_chunk(recorder);
+    }
+}
+
+static void writer_thread_run(void *arg) {
+    struct SoundIoRecorder *recorder = (struct SoundIoRecorder *)arg;
+    soundio_os_lower_thread_priority();
+    while (SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(recorder->run_flag)) {
+        drain(recorder);
+        soundio_os_cond_timed_wait(recorder->cond, NULL, writer_wake_period);
+    }
+}
+
+int soundio_recorder_create(struct SoundIoInStream *instream, const char *path,
+        double buffer_duration, struct SoundIoRecorder **out_recorder)
+{
+    *out_recorder = NULL;
+    if (!(buffer_duration > 0.0) || instream->bytes_per_frame <= 0)
+        return SoundIoErrorInvalid;
+    double capacity = ceil(buffer_duration * instream->sample_rate) * instream->bytes_per_frame;
+    if (capacity > INT32_MAX / 2)
+        return SoundIoErrorInvalid;
+
+    struct SoundIoRecorder *recorder = ALLOCATE(struct SoundIoRecorder, 1);
+    if (!recorder)
+        return SoundIoErrorNoMem;
+    recorder->instream = instream;
+    recorder->channel_count = instream->layout.channel_count;
+    recorder->sample_rate = instream->sample_rate;
+    recorder->buffer_duration = buffer_duration;
+    if (!set_file_format(recorder, instream->format)) {
+        soundio_recorder_destroy(recorder);
+        return SoundIoErrorInvalid;
+    }
+    recorder->in_frame_size = instream->bytes_per_frame;
+    recorder->file_frame_size = recorder->file_sample_size * instream->layout.channel_count;
+    recorder->channel_mask = channel_mask(&instream->layout);
+    SOUNDIO_ATOMIC_STORE(recorder->frames_captured, 0);
+    SOUNDIO_ATOMIC_STORE(recorder->frames_written, 0);
+    SOUNDIO_ATOMIC_STORE(recorder->frames_dropped, 0);
+    SOUNDIO_ATOMIC_STORE(recorder->max_fill_bytes, 0);
+    SOUNDIO_ATOMIC_STORE(recorder->write_error, 0);
+    SOUNDIO_ATOMIC_STORE(recorder->bytes_pushed, 0);
+    SOUNDIO_ATOMIC_STORE(recorder->bytes_drained, 0);
+
+    int err;
+    if ((err = soundio_ring_buffer_init_ex(&recorder->ring_buffer, (int)capacity,
+                    SoundIoRingBufferFlagStrictRoles)))
+    {
+        soundio_recorder_destroy(recorder);
+        return err;
+    }
+    // rounded up to whole pages
+    recorder->buffer_duration = soundio_ring_buffer_capacity(&recorder->ring_buffer) /
+        ((double)instream->bytes_per_frame * instream->sample_rate);
+    recorder->interleave = soundio_converter_create(instream->format, instream->format, 0);
+    recorder->chunk = (char *)soundio_os_alloc_pages(SOUNDIO_RECORDER_CHUNK_SIZE + SOUNDIO_OS_FILE_ALIGNMENT);
+    recorder->header = (char *)soundio_os_alloc_pages(SOUNDIO_RECORDER_HEADER_SIZE);
+    recorder->cond = soundio_os_cond_create();
+    if (!recorder->interleave || !recorder->chunk || !recorder->header || !recorder->cond) {
+        soundio_recorder_destroy(recorder);
+        return SoundIoErrorNoMem;
+    }
+
+    if ((err = soundio_os_file_create(path, true, &recorder->file))) {
+        soundio_recorder_destroy(recorder);
+        return err;
+    }
+    recorder->direct_io = soundio_os_file_is_direct(recorder->file);
+    if ((err = write_header(recorder))) {
+        soundio_recorder_destroy(recorder);
+        return err;
+    }
+
+    SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(recorder->run_flag);
+    if ((err = soundio_os_thread_create(writer_thread_run, recorder, NULL, false, NULL, &recorder->thread))) {
+        soundio_recorder_destroy(recorder);
+        return err;
+    }
+
+    *out_recorder = recorder;
+    return 0;
+}
+
+static void stop_writer(struct SoundIoRecorder *recorder) {
+    if (!recorder->thread)
+        return;
+    SOUNDIO_ATOMIC_FLAG_CLEAR(recorder->run_flag);
+    soundio_os_cond_signal(recorder->cond, NULL);
+    soundio_os_thread_destroy(recorder->thread);
+    recorder->thread = NULL;
+}
+
+int soundio_recorder_finish(struct SoundIoRecorder *recorder) {
+    if (recorder->finished)
+        return recorder->finish_err;
+    recorder->finished = true;
+    stop_writer(recorder);
+    drain(recorder);
+
+    int err = SOUNDIO_ATOMIC_LOAD(recorder->write_error);
+    if (!err && recorder->chunk_fill > 0) {
+        // the tail is not a whole chunk, which direct I/O cannot write
+        int64_t offset = SOUNDIO_RECORDER_HEADER_SIZE + recorder->data_bytes;
+        if (!(err = soundio_os_file_end_direct(recorder->file)))
+            err = soundio_os_file_write_at(recorder->file, recorder->chunk, recorder->chunk_fill, offset);
+        if (!err) {
+            recorder->data_bytes += recorder->chunk_fill;
+            recorder->chunk_fill = 0;
+            SOUNDIO_ATOMIC_STORE(recorder->frames_written, recorder->data_bytes / recorder->file_frame_size);
+        }
+    }
+    if (!err) {
+        int64_t size = SOUNDIO_RECORDER_HEADER_SIZE + recorder->data_bytes + (recorder->data_bytes & 1);
+        if (!(err = write_header(recorder)))
+            err = soundio_os_file_set_size(recorder->file, size);
+    }
+    int close_err = soundio_os_file_close(recorder->file);
+    recorder->file = NULL;
+    if (!err)
+        err = close_err;
+    if (err)
+        set_write_error(recorder, err);
+    recorder->finish_err = err;
+    return err;
+}
+
+void soundio_recorder_destroy(struct SoundIoRecorder *recorder) {
+    if (!recorder)
+        return;
+    if (recorder->file)
+        soundio_recorder_finish(recorder);
+    stop_writer(recorder);
+    soundio_ring_buffer_deinit(&recorder->ring_buffer);
+    soundio_converter_destroy(recorder->interleave);
+    soundio_os_free_pages(recorder->chunk, SOUNDIO_RECORDER_CHUNK_SIZE + SOUNDIO_OS_FILE_ALIGNMENT);
+    soundio_os_free_pages(recorder->header, SOUNDIO_RECORDER_HEADER_SIZE);
+    if (recorder->cond)
+        soundio_os_cond_destroy(recorder->cond);
+    free(recorder);
+}
+
+int soundio_recorder_push(struct SoundIoRecorder *recorder,
+        const struct SoundIoChannelArea *areas, int frame_count)
+{
+    struct SoundIoInStream *instream = recorder->instream;
+    struct SoundIoRingBuffer *rb = &recorder->ring_buffer;
+    int free_frames = soundio_ring_buffer_free_count(rb) / recorder->in_frame_size;
+    int count = soundio_int_min(frame_count, free_frames);
+
+    char *ptr = soundio_ring_buffer_write_ptr(rb);
+    if (areas) {
+        struct SoundIoChannelArea dest[SOUNDIO_MAX_CHANNELS];
+        for (int ch = 0; ch < instream->layout.channel_count; ch += 1) {
+            dest[ch].ptr = ptr + ch * instream->bytes_per_sample;
+            dest[ch].step = recorder->in_frame_size;
+        }
+        soundio_converter_convert(recorder->interleave, areas, dest, instream->layout.channel_count, count);
+    } else {
+        memset(ptr, recorder->silence, count * recorder->in_frame_size);
+    }
+    soundio_ring_buffer_advance_write_ptr(rb, count * recorder->in_frame_size);
+
+    SOUNDIO_ATOMIC_FETCH_ADD(recorder->frames_captured, frame_count);
+    if (count < frame_count)
+        SOUNDIO_ATOMIC_FETCH_ADD(recorder->frames_dropped, frame_count - count);
+    SOUNDIO_ATOMIC_FETCH_ADD(recorder->bytes_pushed, count * recorder->in_frame_size);
+    // only this side raises it
+    int fill_bytes = soundio_ring_buffer_capacity(rb) - soundio_ring_buffer_free_count(rb);
+    if (fill_bytes > SOUNDIO_ATOMIC_LOAD(recorder->max_fill_bytes))
+        SOUNDIO_ATOMIC_STORE(recorder->max_fill_bytes, fill_bytes);
+    return count;
+}
+
+int soundio_recorder_capture(struct SoundIoRecorder *recorder, int frame_count_min, int frame_count_max) {
+    struct SoundIoInStream *instream = recorder->instream;
+    int frames_left = frame_count_max;
+    while (frames_left > 0) {
+        struct SoundIoChannelArea *areas;
+        int frame_count = frames_left;
+        int err;
+        if ((err = soundio_instream_begin_read(instream, &areas, &frame_count)))
+            return err;
+        if (!frame_count)
+            break;
+        // a NULL area is a hole left by an overflow, which is silence
+        soundio_recorder_push(recorder, areas, frame_count);
+        if ((err = soundio_instream_end_read(instream)))
+            return err;
+        frames_left -= frame_count;
+    }
+    return 0;
+}
+
+void soundio_recorder_get_stats(struct SoundIoRecorder *recorder, struct SoundIoRecorderStats *stats) {
+    const double bytes_per_second = (double)recorder->in_frame_size * recorder->sample_rate;
+    stats->frames_captured = SOUNDIO_ATOMIC_LOAD(recorder->frames_captured);
+    stats->frames_written = SOUNDIO_ATOMIC_LOAD(recorder->frames_written);
+    stats->frames_dropped = SOUNDIO_ATOMIC_LOAD(recorder->frames_dropped);
+    // What was drained was pushed before, so loading it first keeps the
+    // difference from going negative.
+    uint64_t bytes_drained = SOUNDIO_ATOMIC_LOAD(recorder->bytes_drained);
+    uint64_t bytes_pushed = SOUNDIO_ATOMIC_LOAD(recorder->bytes_pushed);
+    stats->buffer_fill = (double)(bytes_pushed - bytes_drained) / bytes_per_second;
+    stats->buffer_fill_max = SOUNDIO_ATOMIC_LOAD(recorder->max_fill_bytes) / bytes_per_second;
+    stats->buffer_duration = recorder->buffer_duration;
+    stats->write_error = SOUNDIO_ATOMIC_LOAD(recorder->write_error);
+    stats->direct_io = recorder->direct_io;
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#ifndef SOUNDIO_RECORDER_H
+#define SOUNDIO_RECORDER_H
+
+#include "soundio_internal.h"
+#include "ring_buffer.h"
+#include "atomics.h"
+#include "os.h"
+
+// The writer thread writes the file in chunks of this many bytes, each at an
+// offset aligned for direct I/O.
+#define SOUNDIO_RECORDER_CHUNK_SIZE (1024 * 1024)
+// The header is padded so that the samples start aligned as well.
+#define SOUNDIO_RECORDER_HEADER_SIZE SOUNDIO_OS_FILE_ALIGNMENT
+// Disk space is reserved this far ahead of the writes.
+#define SOUNDIO_RECORDER_PREALLOCATE_SIZE (64 * 1024 * 1024)
+
+struct SoundIoRecorder {
+    // Only used while capturing; the stream may be gone by the time the
+    // recording is finished, which uses the copies below.
+    struct SoundIoInStream *instream;
+    int channel_count;
+    int sample_rate;
+    double buffer_duration;
+
+    // How the input format is stored in the WAV file. S24LE loses the
+    // padding byte of each sample; everything else is copied as it is.
+    int in_frame_size;
+    int file_sample_size;
+    int file_frame_size;
+    bool pack_s24;
+    int format_tag;
+    int valid_bits;
+    uint32_t channel_mask;
+    // Byte value of silence in the input format.
+    int silence;
+
+    // Interleaved frames in the input format, from the capture side to the
+    // writer thread.
+    struct SoundIoRingBuffer ring_buffer;
+    struct SoundIoConverter *interleave;
+
+    // Only used by the writer thread, or by soundio_recorder_finish once it
+    // has stopped.
+    struct SoundIoOsThread *thread;
+    struct SoundIoOsCond *cond;
+    struct SoundIoAtomicFlag run_flag;
+    struct SoundIoOsFile *file;
+    bool direct_io;
+    // SOUNDIO_RECORDER_CHUNK_SIZE plus room for the frame which crosses its
+    // end, and the header, both page aligned.
+    char *chunk;
+    int chunk_fill;
+    char *header;
+    int64_t data_bytes;
+    int64_t preallocated;
+
+    bool finished;
+    int finish_err;
+
+    struct SoundIoAtomicUInt64 frames_captured;
+    struct SoundIoAtomicUInt64 frames_written;
+    struct SoundIoAtomicUInt64 frames_dropped;
+    struct SoundIoAtomicInt max_fill_bytes;
+    struct SoundIoAtomicInt write_error;
+    // Bytes through the ring buffer, so that soundio_recorder_get_stats can
+    // tell its fill from any thread. Each is stored by one side only: the
+    // ring buffer's counts may only be asked for by the side they belong to.
+    struct SoundIoAtomicUInt64 bytes_pushed;
+    struct SoundIoAtomicUInt64 bytes_drained;
+};
+
+// The half of capture which does not touch the stream. `areas` hold frames
+// in the input stream's format; NULL pushes silence. Returns how many frames
+// fit; the rest are dropped.
+int soundio_recorder_push(struct SoundIoRecorder *recorder,
+        const struct SoundIoChannelArea *areas, int frame_count);
+
+// Fills the SOUNDIO_RECORDER_HEADER_SIZE bytes of `header` with a WAV header
+// for `data_bytes` bytes of samples, or an RF64 header when that is too much
+// for WAV.
+void soundio_recorder_write_header(struct SoundIoRecorder *recorder, char *header, int64_t data_bytes);
+
+#endif
@@ -0,0 +1,501 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "remix.h"
+#include "os.h"
+#include "util.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOUNDIO_REMIX_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SOUNDIO_REMIX_AVX2
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define SOUNDIO_REMIX_NEON
+#include <arm_neon.h>
+#endif
+
+// The usual gain of a channel folded into two neighbours, -3 dB.
+#define MINUS_3DB 0.70710678f
+
+// Where a channel goes when the output does not have it: into one or two
+// other channels, each with a gain. The first route whose channels the
+// output has is taken, and if there is none, the first route whose channels
+// have somewhere to go themselves.
+struct SoundIoRemixRoute {
+    enum SoundIoChannelId targets[2];
+    float gains[2];
+};
+
+struct SoundIoRemixFallback {
+    struct SoundIoRemixRoute routes[2];
+};
+
+// Channels which are not listed, such as the LFE without a counterpart and
+// the auxiliary channels, are dropped.
+static const struct SoundIoRemixFallback fallbacks[] = {
+    [SoundIoChannelIdFrontLeft] = {{{{SoundIoChannelIdFrontCenter}, {MINUS_3DB}}}},
+    [SoundIoChannelIdFrontRight] = {{{{SoundIoChannelIdFrontCenter}, {MINUS_3DB}}}},
+    [SoundIoChannelIdFrontCenter] = {{
+        {{SoundIoChannelIdFrontLeft, SoundIoChannelIdFrontRight}, {MINUS_3DB, MINUS_3DB}},
+    }},
+    [SoundIoChannelIdBackLeft] = {{
+        {{SoundIoChannelIdSideLeft}, {1.0f}},
+        {{SoundIoChannelIdFrontLeft}, {MINUS_3DB}},
+    }},
+    [SoundIoChannelIdBackRight] = {{
+        {{SoundIoChannelIdSideRight}, {1.0f}},
+        {{SoundIoChannelIdFrontRight}, {MINUS_3DB}},
+    }},
+    [SoundIoChannelIdFrontLeftCenter] = {{{{SoundIoChannelIdFrontLeft}, {1.0f}}}},
+    [SoundIoChannelIdFrontRightCenter] = {{{{SoundIoChannelIdFrontRight}, {1.0f}}}},
+    [SoundIoChannelIdBackCenter] = {{
+        {{SoundIoChannelIdBackLeft, SoundIoChannelIdBackRight}, {MINUS_3DB, MINUS_3DB}},
+        {{SoundIoChannelIdSideLeft, SoundIoChannelIdSideRight}, {MINUS_3DB, MINUS_3DB}},
+    }},
+    [SoundIoChannelIdSideLeft] = {{
+        {{SoundIoChannelIdBackLeft}, {1.0f}},
+        {{SoundIoChannelIdFrontLeft}, {MINUS_3DB}},
+    }},
+    [SoundIoChannelIdSideRight] = {{
+        {{SoundIoChannelIdBackRight}, {1.0f}},
+        {{SoundIoChannelIdFrontRight}, {MINUS_3DB}},
+    }},
+    [SoundIoChannelIdTopCenter] = {{
+        {{SoundIoChannelIdFrontLeft, SoundIoChannelIdFrontRight}, {MINUS_3DB, MINUS_3DB}},
+    }},
+    // Height channels fold into the channel underneath.
+    [SoundIoChannelIdTopFrontLeft] = {{{{SoundIoChannelIdFrontLeft}, {1.0f}}}},
+    [SoundIoChannelIdTopFrontCenter] = {{{{SoundIoChannelIdFrontCenter}, {1.0f}}}},
+    [SoundIoChannelIdTopFrontRight] = {{{{SoundIoChannelIdFrontRight}, {1.0f}}}},
+    [SoundIoChannelIdTopBackLeft] = {{{{SoundIoChannelIdBackLeft}, {1.0f}}}},
+    [SoundIoChannelIdTopBackCenter] = {{{{SoundIoChannelIdBackCenter}, {1.0f}}}},
+    [SoundIoChannelIdTopBackRight] = {{{{SoundIoChannelIdBackRight}, {1.0f}}}},
+    [SoundIoChannelIdBackLeftCenter] = {{{{SoundIoChannelIdBackLeft}, {1.0f}}}},
+    [SoundIoChannelIdBackRightCenter] = {{{{SoundIoChannelIdBackRight}, {1.0f}}}},
+    [SoundIoChannelIdFrontLeftWide] = {{{{SoundIoChannelIdFrontLeft}, {1.0f}}}},
+    [SoundIoChannelIdFrontRightWide] = {{{{SoundIoChannelIdFrontRight}, {1.0f}}}},
+    [SoundIoChannelIdFrontLeftHigh] = {{{{SoundIoChannelIdFrontLeft}, {1.0f}}}},
+    [SoundIoChannelIdFrontCenterHigh] = {{{{SoundIoChannelIdFrontCenter}, {1.0f}}}},
+    [SoundIoChannelIdFrontRightHigh] = {{{{SoundIoChannelIdFrontRight}, {1.0f}}}},
+    [SoundIoChannelIdTopFrontLeftCenter] = {{{{SoundIoChannelIdFrontLeftCenter}, {1.0f}}}},
+    [SoundIoChannelIdTopFrontRightCenter] = {{{{SoundIoChannelIdFrontRightCenter}, {1.0f}}}},
+    [SoundIoChannelIdTopSideLeft] = {{{{SoundIoChannelIdSideLeft}, {1.0f}}}},
+    [SoundIoChannelIdTopSideRight] = {{{{SoundIoChannelIdSideRight}, {1.0f}}}},
+    [SoundIoChannelIdLeftLfe] = {{{{SoundIoChannelIdLfe}, {1.0f}}}},
+    [SoundIoChannelIdRightLfe] = {{{{SoundIoChannelIdLfe}, {1.0f}}}},
+    [SoundIoChannelIdLfe2] = {{{{SoundIoChannelIdLfe}, {1.0f}}}},
+    [SoundIoChannelIdBottomCenter] = {{{{SoundIoChannelIdFrontCenter}, {1.0f}}}},
+    [SoundIoChannelIdBottomLeftCenter] = {{{{SoundIoChannelIdFrontLeftCenter}, {1.0f}}}},
+    [SoundIoChannelIdBottomRightCenter] = {{{{SoundIoChannelIdFrontRightCenter}, {1.0f}}}},
+    // Mid/side decodes to left = mid + side and right = mid - side.
+    [SoundIoChannelIdMsMid] = {{{{SoundIoChannelIdFrontCenter}, {1.0f}}}},
+    [SoundIoChannelIdMsSide] = {{
+        {{SoundIoChannelIdFrontLeft, SoundIoChannelIdFrontRight}, {MINUS_3DB, -MINUS_3DB}},
+    }},
+    [SoundIoChannelIdAmbisonicW] = {{{{SoundIoChannelIdFrontCenter}, {1.0f}}}},
+    [SoundIoChannelIdXyX] = {{{{SoundIoChannelIdFrontLeft}, {1.0f}}}},
+    [SoundIoChannelIdXyY] = {{{{SoundIoChannelIdFrontRight}, {1.0f}}}},
+    [SoundIoChannelIdHeadphonesLeft] = {{{{SoundIoChannelIdFrontLeft}, {1.0f}}}},
+    [SoundIoChannelIdHeadphonesRight] = {{{{SoundIoChannelIdFrontRight}, {1.0f}}}},
+    [SoundIoChannelIdDialogCentricMix] = {{{{SoundIoChannelIdFrontCenter}, {1.0f}}}},
+};
+
+// Kernels which scale one source channel into an output channel, or add it.
+// The vector loops leave any remainder to the scalar tail.
+
+static void mul_tail(float *dest, const float *src, float gain, int start, int count) {
+    for (int i = start; i < count; i += 1)
+        dest[i] = src[i] * gain;
+}
+
+static void mul_add_tail(float *dest, const float *src, float gain, int start, int count) {
+    for (int i = start; i < count; i += 1)
+        dest[i] += src[i] * gain;
+}
+
+static void mul_scalar(float *dest, const float *src, float gain, int count) {
+    mul_tail(dest, src, gain, 0, count);
+}
+
+static void mul_add_scalar(float *dest, const float *src, float gain, int count) {
+    mul_add_tail(dest, src, gain, 0, count);
+}
+
+#if defined(SOUNDIO_REMIX_SSE2)
+static void mul_sse2(float *dest, const float *src, float gain, int count) {
+    const __m128 g = _mm_set1_ps(gain);
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_ps(dest + i, _mm_mul_ps(_mm_loadu_ps(src + i), g));
+    mul_tail(dest, src, gain, i, count);
+}
+
+static void mul_add_sse2(float *dest, const float *src, float gain, int count) {
+    const __m128 g = _mm_set1_ps(gain);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 d = _mm_loadu_ps(dest + i);
+        _mm_storeu_ps(dest + i, _mm_add_ps(d, _mm_mul_ps(_mm_loadu_ps(src + i), g)));
+    }
+    mul_add_tail(dest, src, gain, i, count);
+}
+#endif
+
+#if defined(SOUNDIO_REMIX_AVX2)
+__attribute__((target("avx2")))
+static void mul_avx2(float *dest, const float *src, float gain, int count) {
+    const __m256 g = _mm256_set1_ps(gain);
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+        _mm256_storeu_ps(dest + i, _mm256_mul_ps(_mm256_loadu_ps(src + i), g));
+    mul_tail(dest, src, gain, i, count);
+}
+
+__attribute__((target("avx2")))
+static void mul_add_avx2(float *dest, const float *src, float gain, int count) {
+    const __m256 g = _mm256_set1_ps(gain);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 d = _mm256_loadu_ps(dest + i);
+        _mm256_storeu_ps(dest + i, _mm256_add_ps(d, _mm256_mul_ps(_mm256_loadu_ps(src + i), g)));
+    }
+    mul_add_tail(dest, src, gain, i, count);
+}
+#endif
+
+#if defined(SOUNDIO_REMIX_NEON)
+static void mul_neon(float *dest, const float *src, float gain, int count) {
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+        vst1q_f32(dest + i, vmulq_n_f32(vld1q_f32(src + i), gain));
+    mul_tail(dest, src, gain, i, count);
+}
+
+static void mul_add_neon(float *dest, const float *src, float gain, int count) {
+    const float32x4_t g = vdupq_n_f32(gain);
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+        vst1q_f32(dest + i, vfmaq_f32(vld1q_f32(dest + i), vld1q_f32(src + i), g));
+    mul_add_tail(dest, src, gain, i, count);
+}
+#endif
+
+static void select_kernels(struct SoundIoRemixer *remixer) {
+    remixer->kernel_name = "scalar";
+    remixer->mul = mul_scalar;
+    remixer->mul_add = mul_add_scalar;
+#if defined(SOUNDIO_REMIX_SSE2)
+    remixer->kernel_name = "sse2";
+    remixer->mul = mul_sse2;
+    remixer->mul_add = mul_add_sse2;
+#endif
+#if defined(SOUNDIO_REMIX_AVX2)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        remixer->kernel_name = "avx2";
+        remixer->mul = mul_avx2;
+        remixer->mul_add = mul_add_avx2;
+    }
+#endif
+#if defined(SOUNDIO_REMIX_NEON)
+    remixer->kernel_name = "neon";
+    remixer->mul = mul_neon;
+    remixer->mul_add = mul_add_neon;
+#endif
+}
+
+static const struct SoundIoRemixFallback *get_fallback(enum SoundIoChannelId id) {
+    if (id <= SoundIoChannelIdInvalid || id >= ARRAY_LENGTH(fallbacks))
+        return NULL;
+    return &fallbacks[id];
+}
+
+static bool can_route(const struct SoundIoChannelLayout *dest_layout, enum SoundIoChannelId id,
+        bool *visited);
+
+// Whether one of the channels of `route` is in the output, directly or, when
+// `direct` is false, through its own fallbacks.
+static bool route_usable(const struct SoundIoChannelLayout *dest_layout,
+        const struct SoundIoRemixRoute *route, bool direct, bool *visited)
+{
+    for (int i = 0; i < 2 && route->targets[i] != SoundIoChannelIdInvalid; i += 1) {
+        if (soundio_channel_layout_find_channel(dest_layout, route->targets[i]) >= 0)
+            return true;
+        if (!direct && can_route(dest_layout, route->targets[i], visited))
+            return true;
+    }
+    return false;
+}
+
+// `visited` marks the channels being routed already, so that channels which
+// fall back on each other do not go round in circles.
+static const struct SoundIoRemixRoute *pick_route(const struct SoundIoChannelLayout *dest_layout,
+        enum SoundIoChannelId id, bool *visited)
+{
+    const struct SoundIoRemixFallback *fallback = get_fallback(id);
+    if (!fallback || visited[id])
+        return NULL;
+    visited[id] = true;
+    const struct SoundIoRemixRoute *picked = NULL;
+    for (int pass = 0; pass < 2 && !picked; pass += 1) {
+        for (int i = 0; i < 2 && !picked; i += 1) {
+            const struct SoundIoRemixRoute *route = &fallback->routes[i];
+            if (route->targets[0] != SoundIoChannelIdInvalid &&
+                    route_usable(dest_layout, route, pass == 0, visited))
+            {
+                picked = route;
+            }
+        }
+    }
+    visited[id] = false;
+    return picked;
+}
+
+static bool can_route(const struct SoundIoChannelLayout *dest_layout, enum SoundIoChannelId id,
+        bool *visited)
+{
+    return pick_route(dest_layout, id, visited) != NULL;
+}
+
+// Adds source channel `src`, heard as channel `id` with `gain`, to the matrix.
+static void route_channel(struct SoundIoRemixer *remixer, const struct SoundIoChannelLayout *dest_layout,
+        int src, enum SoundIoChannelId id, float gain, bool *visited)
+{
+    int dest = soundio_channel_layout_find_channel(dest_layout, id);
+    if (dest >= 0) {
+        remixer->matrix[dest * remixer->src_channel_count + src] += gain;
+        return;
+    }
+    const struct SoundIoRemixRoute *route = pick_route(dest_layout, id, visited);
+    if (!route)
+        return;
+    visited[id] = true;
+    for (int i = 0; i < 2 && route->targets[i] != SoundIoChannelIdInvalid; i += 1) {
+        enum SoundIoChannelId target = route->targets[i];
+        if (soundio_channel_layout_find_channel(dest_layout, target) >= 0 ||
+                can_route(dest_layout, target, visited))
+        {
+            route_channel(remixer, dest_layout, src, target, gain * route->gains[i], visited);
+        }
+    }
+    visited[id] = false;
+}
+
+// Sorts the rows of the matrix into silence, copies and mixes.
+static void build_rows(struct SoundIoRemixer *remixer) {
+    const int src_count = remixer->src_channel_count;
+    int term_count = 0;
+    remixer->has_mix = false;
+    memset(remixer->src_used, 0, sizeof(remixer->src_used));
+    for (int dest = 0; dest < remixer->dest_channel_count; dest += 1) {
+        const float *row = &remixer->matrix[dest * src_count];
+        remixer->term_index[dest] = term_count;
+        for (int src = 0; src < src_count; src += 1) {
+            if (row[src] != 0.0f) {
+                remixer->terms[term_count].src = src;
+                remixer->terms[term_count].gain = row[src];
+                term_count += 1;
+            }
+        }
+        int count = term_count - remixer->term_index[dest];
+        remixer->term_count[dest] = count;
+        if (count == 0) {
+            remixer->row_kind[dest] = SoundIoRemixRowSilence;
+        } else if (count == 1 && remixer->terms[remixer->term_index[dest]].gain == 1.0f) {
+            remixer->row_kind[dest] = SoundIoRemixRowCopy;
+        } else {
+            remixer->row_kind[dest] = SoundIoRemixRowMix;
+            remixer->has_mix = true;
+            for (int i = 0; i < count; i += 1)
+                remixer->src_used[remixer->terms[remixer->term_index[dest] + i].src] = true;
+        }
+    }
+}
+
+struct SoundIoRemixer *soundio_remixer_create(const struct SoundIoChannelLayout *src_layout,
+        const struct SoundIoChannelLayout *dest_layout, int flags)
+{
+    if (src_layout->channel_count <= 0 || src_layout->channel_count > SOUNDIO_MAX_CHANNELS ||
+        dest_layout->channel_count <= 0 || dest_layout->channel_count > SOUNDIO_MAX_CHANNELS)
+    {
+        return NULL;
+    }
+
+    struct SoundIoRemixer *remixer = soundio_os_alloc_pages(sizeof(struct SoundIoRemixer));
+    if (!remixer)
+        return NULL;
+    remixer->src_channel_count = src_layout->channel_count;
+    remixer->dest_channel_count = dest_layout->channel_count;
+
+    bool visited[ARRAY_LENGTH(fallbacks)];
+    memset(visited, 0, sizeof(visited));
+    for (int src = 0; src < src_layout->channel_count; src += 1) {
+        enum SoundIoChannelId id = src_layout->channels[src];
+        // a channel named twice is only heard once
+        if (soundio_channel_layout_find_channel(src_layout, id) == src)
+            route_channel(remixer, dest_layout, src, id, 1.0f, visited);
+    }
+
+    // Scale everything down so that no output channel can be louder than
+    // the loudest input channel.
+    if (!(flags & SoundIoRemixFlagNoNormalize)) {
+        float max_sum = 0.0f;
+        for (int dest = 0; dest < remixer->dest_channel_count; dest += 1) {
+            float sum = 0.0f;
+            for (int src = 0; src < remixer->src_channel_count; src += 1)
+                sum += fabsf(remixer->matrix[dest * remixer->src_channel_count + src]);
+            if (sum > max_sum)
+                max_sum = sum;
+        }
+        if (max_sum > 1.0f) {
+            for (int i = 0; i < remixer->dest_channel_count * remixer->src_channel_count; i += 1)
+                remixer->matrix[i] /= max_sum;
+        }
+    }
+
+    build_rows(remixer);
+    select_kernels(remixer);
+    return remixer;
+}
+
+void soundio_remixer_destroy(struct SoundIoRemixer *remixer) {
+    soundio_os_free_pages(remixer, sizeof(struct SoundIoRemixer));
+}
+
+int soundio_remixer_lock_memory(struct SoundIoRemixer *remixer) {
+    return soundio_os_lock_memory(remixer, sizeof(struct SoundIoRemixer));
+}
+
+void soundio_remixer_unlock_memory(struct SoundIoRemixer *remixer) {
+    soundio_os_unlock_memory(remixer, sizeof(struct SoundIoRemixer));
+}
+
+float soundio_remixer_get_gain(struct SoundIoRemixer *remixer, int dest_channel, int src_channel) {
+    if (dest_channel < 0 || dest_channel >= remixer->dest_channel_count ||
+        src_channel < 0 || src_channel >= remixer->src_channel_count)
+    {
+        return 0.0f;
+    }
+    return remixer->matrix[dest_channel * remixer->src_channel_count + src_channel];
+}
+
+int soundio_remixer_set_gain(struct SoundIoRemixer *remixer, int dest_channel, int src_channel,
+        float gain)
+{
+    if (dest_channel < 0 || dest_channel >= remixer->dest_channel_count ||
+        src_channel < 0 || src_channel >= remixer->src_channel_count || !isfinite(gain))
+    {
+        return SoundIoErrorInvalid;
+    }
+    remixer->matrix[dest_channel * remixer->src_channel_count + src_channel] = gain;
+    build_rows(remixer);
+    return 0;
+}
+
+bool soundio_remixer_is_identity(struct SoundIoRemixer *remixer) {
+    if (remixer->src_channel_count != remixer->dest_channel_count)
+        return false;
+    for (int dest = 0; dest < remixer->dest_channel_count; dest += 1) {
+        if (remixer->row_kind[dest] != SoundIoRemixRowCopy ||
+            remixer->terms[remixer->term_index[dest]].src != dest)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+const char *soundio_remixer_kernel_name(struct SoundIoRemixer *remixer) {
+    return remixer->kernel_name;
+}
+
+static void copy_channel(const struct SoundIoChannelArea *src, const struct SoundIoChannelArea *dest,
+        int frame_count)
+{
+    if (src->step == sizeof(float) && dest->step == sizeof(float)) {
+        memcpy(dest->ptr, src->ptr, frame_count * sizeof(float));
+        return;
+    }
+    const char *s = src->ptr;
+    char *d = dest->ptr;
+    for (int i = 0; i < frame_count; i += 1, s += src->step, d += dest->step)
+        memcpy(d, s, sizeof(float));
+}
+
+static void zero_channel(const struct SoundIoChannelArea *dest, int frame_count) {
+    if (dest->step == sizeof(float)) {
+        memset(dest->ptr, 0, frame_count * sizeof(float));
+        return;
+    }
+    const float zero = 0.0f;
+    char *d = dest->ptr;
+    for (int i = 0; i < frame_count; i += 1, d += dest->step)
+        memcpy(d, &zero, sizeof(float));
+}
+
+void soundio_remixer_process(struct SoundIoRemixer *remixer,
+        const struct SoundIoChannelArea *src_areas, const struct SoundIoChannelArea *dest_areas,
+        int frame_count)
+{
+    for (int dest = 0; dest < remixer->dest_channel_count; dest += 1) {
+        if (remixer->row_kind[dest] == SoundIoRemixRowSilence) {
+            zero_channel(&dest_areas[dest], frame_count);
+        } else if (remixer->row_kind[dest] == SoundIoRemixRowCopy) {
+            const struct SoundIoRemixTerm *term = &remixer->terms[remixer->term_index[dest]];
+            copy_channel(&src_areas[term->src], &dest_areas[dest], frame_count);
+        }
+    }
+    if (!remixer->has_mix)
+        return;
+
+    // Planar channels are mixed where they are, the others through
+    // src_buf and dest_buf.
+    const float *src_ptrs[SOUNDIO_MAX_CHANNELS];
+    for (int offset = 0; offset < frame_count; offset += SOUNDIO_REMIX_CHUNK_SIZE) {
+        int count = soundio_int_min(frame_count - offset, SOUNDIO_REMIX_CHUNK_SIZE);
+        for (int src = 0; src < remixer->src_channel_count; src += 1) {
+            if (!remixer->src_used[src])
+                continue;
+            const struct SoundIoChannelArea *area = &src_areas[src];
+            if (area->step == sizeof(float)) {
+                src_ptrs[src] = (const float *)area->ptr + offset;
+                continue;
+            }
+            float *buf = &remixer->src_buf[src * SOUNDIO_REMIX_CHUNK_SIZE];
+            const char *s = area->ptr + offset * area->step;
+            for (int i = 0; i < count; i += 1, s += area->step)
+                memcpy(&buf[i], s, sizeof(float));
+            src_ptrs[src] = buf;
+        }
+
+        for (int dest = 0; dest < remixer->dest_channel_count; dest += 1) {
+            if (remixer->row_kind[dest] != SoundIoRemixRowMix)
+                continue;
+            const struct SoundIoChannelArea *area = &dest_areas[dest];
+            bool planar = (area->step == sizeof(float));
+            float *out = planar ? (float *)area->ptr + offset : remixer->dest_buf;
+            const struct SoundIoRemixTerm *terms = &remixer->terms[remixer->term_index[dest]];
+            remixer->mul(out, src_ptrs[terms[0].src], terms[0].gain, count);
+            for (int i = 1; i < remixer->term_count[dest]; i += 1)
+                remixer->mul_add(out, src_ptrs[terms[i].src], terms[i].gain, count);
+            if (!planar) {
+                char *d = area->ptr + offset * area->step;
+                for (int i = 0; i < count; i += 1, d += area->step)
+                    memcpy(d, &out[i], sizeof(float));
+            }
+        }
+    }
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#ifndef SOUNDIO_REMIX_H
+#define SOUNDIO_REMIX_H
+
+#include "soundio_internal.h"
+
+// Channels which have to be mixed, rather than copied, go through planar
+// buffers this many frames at a time.
+#define SOUNDIO_REMIX_CHUNK_SIZE 256
+
+// dest[i] = src[i] * gain, and dest[i] += src[i] * gain.
+typedef void (*SoundIoRemixFn)(float *dest, const float *src, float gain, int count);
+
+// One source channel of an output channel.
+struct SoundIoRemixTerm {
+    int src;
+    float gain;
+};
+
+// The output channels are computed in one of three ways: silence, a copy of
+// one source channel, or the sum of `term_count` terms starting at
+// `term_index`.
+enum SoundIoRemixRow {
+    SoundIoRemixRowSilence,
+    SoundIoRemixRowCopy,
+    SoundIoRemixRowMix,
+};
+
+struct SoundIoRemixer {
+    int src_channel_count;
+    int dest_channel_count;
+    // dest_channel_count rows of src_channel_count gains.
+    float matrix[SOUNDIO_MAX_CHANNELS * SOUNDIO_MAX_CHANNELS];
+
+    // The nonzero gains of each row, row after row.
+    enum SoundIoRemixRow row_kind[SOUNDIO_MAX_CHANNELS];
+    int term_index[SOUNDIO_MAX_CHANNELS];
+    int term_count[SOUNDIO_MAX_CHANNELS];
+    struct SoundIoRemixTerm terms[SOUNDIO_MAX_CHANNELS * SOUNDIO_MAX_CHANNELS];
+    // Whether a mixed row uses the source channel, which is then gathered
+    // into src_buf when it is not planar already.
+    bool src_used[SOUNDIO_MAX_CHANNELS];
+    bool has_mix;
+
+    const char *kernel_name;
+    SoundIoRemixFn mul;
+    SoundIoRemixFn mul_add;
+
+    float src_buf[SOUNDIO_MAX_CHANNELS * SOUNDIO_REMIX_CHUNK_SIZE];
+    float dest_buf[SOUNDIO_REMIX_CHUNK_SIZE];
+};
+
+// A remixer has pages of its own, so these lock and unlock nothing else.
+int soundio_remixer_lock_memory(struct SoundIoRemixer *remixer);
+void soundio_remixer_unlock_memory(struct SoundIoRemixer *remixer);
+
+#endif
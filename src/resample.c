@@ -0,0 +1,703 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "resample.h"
+#include "soundio_private.h"
+#include "os.h"
+#include "util.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOUNDIO_RESAMPLE_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SOUNDIO_RESAMPLE_AVX2
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define SOUNDIO_RESAMPLE_NEON
+#include <arm_neon.h>
+#endif
+
+struct SoundIoResamplePreset {
+    // A multiple of 16, so that the kernels need no tail loop.
+    int taps;
+    // Cutoff as a fraction of the lower Nyquist frequency. Each preset puts
+    // the end of its transition band close to Nyquist.
+    double passband;
+    double kaiser_beta;
+};
+
+static const struct SoundIoResamplePreset presets[] = {
+    [SoundIoResampleQualityLow] = {16, 0.82, 5.0},
+    [SoundIoResampleQualityMedium] = {32, 0.86, 7.0},
+    [SoundIoResampleQualityHigh] = {64, 0.91, 9.0},
+};
+
+// Kernels for the dot product of a window of history with one filter phase.
+// `count` is a multiple of 16.
+
+static float dot_scalar(const float *a, const float *b, int count) {
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+    for (int i = 0; i < count; i += 4) {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+#if defined(SOUNDIO_RESAMPLE_SSE2)
+static float dot_sse2(const float *a, const float *b, int count) {
+    __m128 s0 = _mm_setzero_ps();
+    __m128 s1 = _mm_setzero_ps();
+    for (int i = 0; i < count; i += 8) {
+        s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(s0, s1));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+#endif
+
+#if defined(SOUNDIO_RESAMPLE_AVX2)
+__attribute__((target("avx2")))
+static float dot_avx2(const float *a, const float *b, int count) {
+    __m256 s0 = _mm256_setzero_ps();
+    __m256 s1 = _mm256_setzero_ps();
+    for (int i = 0; i < count; i += 16) {
+        s0 = _mm256_add_ps(s0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+        s1 = _mm256_add_ps(s1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+    }
+    __m256 s = _mm256_add_ps(s0, s1);
+    __m128 x = _mm_add_ps(_mm256_castps256_ps128(s), _mm256_extractf128_ps(s, 1));
+    float lanes[4];
+    _mm_storeu_ps(lanes, x);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+#endif
+
+#if defined(SOUNDIO_RESAMPLE_NEON)
+static float dot_neon(const float *a, const float *b, int count) {
+    float32x4_t s0 = vdupq_n_f32(0.0f);
+    float32x4_t s1 = vdupq_n_f32(0.0f);
+    for (int i = 0; i < count; i += 8) {
+        s0 = vfmaq_f32(s0, vld1q_f32(a + i), vld1q_f32(b + i));
+        s1 = vfmaq_f32(s1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    return vaddvq_f32(vaddq_f32(s0, s1));
+}
+#endif
+
+static void select_kernels(struct SoundIoResampler *resampler) {
+    resampler->kernel_name = "scalar";
+    resampler->dot = dot_scalar;
+#if defined(SOUNDIO_RESAMPLE_SSE2)
+    resampler->kernel_name = "sse2";
+    resampler->dot = dot_sse2;
+#endif
+#if defined(SOUNDIO_RESAMPLE_AVX2)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        resampler->kernel_name = "avx2";
+        resampler->dot = dot_avx2;
+    }
+#endif
+#if defined(SOUNDIO_RESAMPLE_NEON)
+    resampler->kernel_name = "neon";
+    resampler->dot = dot_neon;
+#endif
+}
+
+static int gcd(int a, int b) {
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static double bessel_i0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    double half = x / 2.0;
+    for (int k = 1; k < 64; k += 1) {
+        term *= (half / k) * (half / k);
+        sum += term;
+        if (term < sum * 1e-12)
+            break;
+    }
+    return sum;
+}
+
+// Kaiser windowed sinc for an output frame `frac` input frames after the
+// center tap, normalized to unity gain at DC. `cutoff` is in cycles per
+// input frame.
+static void design_phase(float *row, int taps, double frac, double cutoff, double beta) {
+    const double pi = 3.14159265358979323846;
+    double half = taps / 2.0;
+    double center = half - 1.0 + frac;
+    double i0_beta = bessel_i0(beta);
+    double h[64];
+    double sum = 0.0;
+    for (int k = 0; k < taps; k += 1) {
+        double t = k - center;
+        double x = 2.0 * cutoff * t;
+        double sinc = fabs(x) < 1e-9 ? 1.0 : sin(pi * x) / (pi * x);
+        double w = t / half;
+        double window = w * w < 1.0 ? bessel_i0(beta * sqrt(1.0 - w * w)) / i0_beta : 0.0;
+        h[k] = sinc * window;
+        sum += h[k];
+    }
+    for (int k = 0; k < taps; k += 1)
+        row[k] = (float)(h[k] / sum);
+}
+
+static struct SoundIoResampler *resampler_create(int channel_count, int src_rate, int dest_rate,
+        enum SoundIoResampleQuality quality, bool adjustable)
+{
+    if (channel_count <= 0 || channel_count > SOUNDIO_MAX_CHANNELS || src_rate <= 0 || dest_rate <= 0)
+        return NULL;
+    if ((int)quality < 0 || (int)quality >= (int)ARRAY_LENGTH(presets))
+        return NULL;
+    const struct SoundIoResamplePreset *preset = &presets[quality];
+
+    struct SoundIoResampler *resampler = soundio_os_alloc_pages(sizeof(struct SoundIoResampler));
+    if (!resampler)
+        return NULL;
+
+    resampler->channel_count = channel_count;
+    resampler->src_rate = src_rate;
+    resampler->dest_rate = dest_rate;
+    resampler->taps = preset->taps;
+    int divisor = gcd(src_rate, dest_rate);
+    resampler->phase_count = dest_rate / divisor;
+    resampler->phase_step = src_rate / divisor;
+    if (adjustable) {
+        // subdivide the phases until a step of one is a tiny fraction of
+        // the whole step, without letting positions overflow
+        int scale = soundio_int_max(1, soundio_int_min(
+                    SOUNDIO_RESAMPLE_ADJUST_RESOLUTION / resampler->phase_step,
+                    (INT32_MAX / 2) / soundio_int_max(resampler->phase_count, resampler->phase_step)));
+        resampler->phase_count *= scale;
+        resampler->phase_step *= scale;
+    }
+    resampler->base_phase_step = resampler->phase_step;
+    resampler->interpolate = resampler->phase_count > SOUNDIO_RESAMPLE_MAX_PHASES;
+
+    int row_count = resampler->interpolate ? SOUNDIO_RESAMPLE_MAX_PHASES + 1 : resampler->phase_count;
+    resampler->table_size = row_count * resampler->taps * sizeof(float);
+    resampler->table = soundio_os_alloc_pages(resampler->table_size);
+    resampler->history_capacity = resampler->taps + SOUNDIO_RESAMPLE_CHUNK_SIZE;
+    resampler->history_size = channel_count * resampler->history_capacity * sizeof(float);
+    resampler->history = soundio_os_alloc_pages(resampler->history_size);
+    if (!resampler->table || !resampler->history) {
+        soundio_resampler_destroy(resampler);
+        return NULL;
+    }
+
+    // when downsampling, the cutoff follows the output's Nyquist frequency
+    double ratio = soundio_double_min(1.0, dest_rate / (double)src_rate);
+    double cutoff = 0.5 * preset->passband * ratio;
+    int row_divisor = resampler->interpolate ? SOUNDIO_RESAMPLE_MAX_PHASES : resampler->phase_count;
+    for (int row = 0; row < row_count; row += 1) {
+        design_phase(resampler->table + row * resampler->taps, resampler->taps,
+                row / (double)row_divisor, cutoff, preset->kaiser_beta);
+    }
+
+    select_kernels(resampler);
+    soundio_resampler_reset(resampler);
+    return resampler;
+}
+
+struct SoundIoResampler *soundio_resampler_create(int channel_count, int src_rate, int dest_rate,
+        enum SoundIoResampleQuality quality)
+{
+    return resampler_create(channel_count, src_rate, dest_rate, quality, false);
+}
+
+struct SoundIoResampler *soundio_resampler_create_adjustable(int channel_count, int src_rate,
+        int dest_rate, enum SoundIoResampleQuality quality)
+{
+    return resampler_create(channel_count, src_rate, dest_rate, quality, true);
+}
+
+void soundio_resampler_set_adjust(struct SoundIoResampler *resampler, double adjust) {
+    double step = resampler->base_phase_step * adjust;
+    resampler->phase_step = (int)soundio_double_clamp(1.0, step + 0.5, INT32_MAX / 2);
+}
+
+void soundio_resampler_destroy(struct SoundIoResampler *resampler) {
+    if (!resampler)
+        return;
+    soundio_os_free_pages(resampler->table, resampler->table_size);
+    soundio_os_free_pages(resampler->history, resampler->history_size);
+    soundio_os_free_pages(resampler, sizeof(struct SoundIoResampler));
+}
+
+int soundio_resampler_lock_memory(struct SoundIoResampler *resampler) {
+    int err;
+    if ((err = soundio_os_lock_memory(resampler, sizeof(struct SoundIoResampler))))
+        return err;
+    if ((err = soundio_os_lock_memory(resampler->table, resampler->table_size))) {
+        soundio_os_unlock_memory(resampler, sizeof(struct SoundIoResampler));
+        return err;
+    }
+    if ((err = soundio_os_lock_memory(resampler->history, resampler->history_size))) {
+        soundio_os_unlock_memory(resampler->table, resampler->table_size);
+        soundio_os_unlock_memory(resampler, sizeof(struct SoundIoResampler));
+        return err;
+    }
+    return 0;
+}
+
+void soundio_resampler_unlock_memory(struct SoundIoResampler *resampler) {
+    soundio_os_unlock_memory(resampler->history, resampler->history_size);
+    soundio_os_unlock_memory(resampler->table, resampler->table_size);
+    soundio_os_unlock_memory(resampler, sizeof(struct SoundIoResampler));
+}
+
+void soundio_resampler_reset(struct SoundIoResampler *resampler) {
+    memset(resampler->history, 0,
+            resampler->channel_count * resampler->history_capacity * sizeof(float));
+    // zeros before the first frame, so that the first output frame is
+    // centered on it
+    resampler->history_len = resampler->taps / 2 - 1;
+    resampler->pos = 0;
+    resampler->phase = 0;
+}
+
+const char *soundio_resampler_kernel_name(struct SoundIoResampler *resampler) {
+    return resampler->kernel_name;
+}
+
+static inline float filter(struct SoundIoResampler *resampler, const float *x, int phase) {
+    const int taps = resampler->taps;
+    if (!resampler->interpolate)
+        return resampler->dot(x, resampler->table + phase * taps, taps);
+    int64_t scaled = (int64_t)phase * SOUNDIO_RESAMPLE_MAX_PHASES;
+    int row = (int)(scaled / resampler->phase_count);
+    float t = (scaled % resampler->phase_count) / (float)resampler->phase_count;
+    const float *coefs = resampler->table + row * taps;
+    float y0 = resampler->dot(x, coefs, taps);
+    float y1 = resampler->dot(x, coefs + taps, taps);
+    return y0 + (y1 - y0) * t;
+}
+
+// Writes as many output frames as the history allows, up to `max`, at
+// `offset` into `dest_areas`.
+static int generate(struct SoundIoResampler *resampler,
+        const struct SoundIoChannelArea *dest_areas, int offset, int max)
+{
+    if (max <= 0)
+        return 0;
+    int count = 0;
+    int pos = resampler->pos;
+    int phase = resampler->phase;
+    for (int ch = 0; ch < resampler->channel_count; ch += 1) {
+        const float *history = resampler->history + ch * resampler->history_capacity;
+        char *dest = dest_areas[ch].ptr + offset * dest_areas[ch].step;
+        pos = resampler->pos;
+        phase = resampler->phase;
+        count = 0;
+        while (count < max && pos + resampler->taps <= resampler->history_len) {
+            float y = filter(resampler, history + pos, phase);
+            memcpy(dest, &y, sizeof(float));
+            dest += dest_areas[ch].step;
+            count += 1;
+            phase += resampler->phase_step;
+            pos += phase / resampler->phase_count;
+            phase %= resampler->phase_count;
+        }
+    }
+    resampler->pos = pos;
+    resampler->phase = phase;
+    return count;
+}
+
+void soundio_resampler_process(struct SoundIoResampler *resampler,
+        const struct SoundIoChannelArea *src_areas, int *src_frame_count,
+        const struct SoundIoChannelArea *dest_areas, int *dest_frame_count)
+{
+    int src_done = 0;
+    int dest_done = 0;
+    for (;;) {
+        // drop what no later output frame needs; when downsampling by a lot
+        // that can include frames which have not arrived yet
+        int drop = soundio_int_min(resampler->pos, resampler->history_len);
+        if (drop > 0) {
+            int keep = resampler->history_len - drop;
+            for (int ch = 0; ch < resampler->channel_count; ch += 1) {
+                float *history = resampler->history + ch * resampler->history_capacity;
+                memmove(history, history + drop, keep * sizeof(float));
+            }
+            resampler->history_len = keep;
+            resampler->pos -= drop;
+        }
+
+        int take = soundio_int_min(*src_frame_count - src_done,
+                resampler->history_capacity - resampler->history_len);
+        for (int ch = 0; ch < resampler->channel_count; ch += 1) {
+            float *history = resampler->history + ch * resampler->history_capacity + resampler->history_len;
+            const char *src = src_areas[ch].ptr + src_done * src_areas[ch].step;
+            for (int i = 0; i < take; i += 1, src += src_areas[ch].step)
+                memcpy(&history[i], src, sizeof(float));
+        }
+        resampler->history_len += take;
+        src_done += take;
+
+        int produced = generate(resampler, dest_areas, dest_done, *dest_frame_count - dest_done);
+        dest_done += produced;
+        if (take == 0 && produced == 0)
+            break;
+    }
+    *src_frame_count = src_done;
+    *dest_frame_count = dest_done;
+}
+
+int soundio_resampler_dest_frame_count(struct SoundIoResampler *resampler, int src_frame_count) {
+    int64_t room = (int64_t)resampler->history_len + src_frame_count - resampler->taps - resampler->pos;
+    if (room < 0)
+        return 0;
+    // output m fits while pos + (phase + m * phase_step) / phase_count <= room
+    int64_t count = ((room + 1) * resampler->phase_count - resampler->phase + resampler->phase_step - 1) /
+        resampler->phase_step;
+    return count > INT32_MAX ? INT32_MAX : (int)count;
+}
+
+int soundio_resampler_src_frame_count(struct SoundIoResampler *resampler, int dest_frame_count) {
+    if (dest_frame_count <= 0)
+        return 0;
+    int64_t last = ((int64_t)resampler->phase + (int64_t)(dest_frame_count - 1) * resampler->phase_step) /
+        resampler->phase_count;
+    int64_t count = resampler->pos + last + resampler->taps - resampler->history_len;
+    if (count < 0)
+        return 0;
+    return count > INT32_MAX ? INT32_MAX : (int)count;
+}
+
+double soundio_resampler_get_delay(struct SoundIoResampler *resampler) {
+    double center = resampler->pos + resampler->taps / 2 - 1 +
+        resampler->phase / (double)resampler->phase_count;
+    return soundio_double_max(0.0, resampler->history_len - center) / resampler->src_rate;
+}
+
+// Backends ask for up to a buffer's worth of frames at a time; leave room
+// for the filter to hold some back.
+static int buf_frame_count_for(struct SoundIoOutStreamPrivate *os) {
+    struct SoundIoOutStream *outstream = &os->pub;
+    struct SoundIoOutStreamResample *rs = os->resample;
+    return ceil_dbl_to_int(2.0 * outstream->software_latency * outstream->write_sample_rate) +
+        (rs->resampler ? 2 * rs->resampler->taps : 0) + SOUNDIO_RESAMPLE_CHUNK_SIZE;
+}
+
+static size_t buf_size(struct SoundIoOutStreamResample *rs) {
+    return rs->buf_frame_count * rs->write_bytes_per_frame;
+}
+
+// Everything but rs->buf and rs itself may be NULL. Each has pages of its
+// own, so unlocking one that was never locked is harmless.
+static void unlock_memory(struct SoundIoOutStreamResample *rs) {
+    if (rs->resampler)
+        soundio_resampler_unlock_memory(rs->resampler);
+    if (rs->remixer)
+        soundio_remixer_unlock_memory(rs->remixer);
+    soundio_converter_unlock_memory(rs->to_float);
+    soundio_converter_unlock_memory(rs->from_float);
+    soundio_os_unlock_memory(rs->buf, buf_size(rs));
+    soundio_os_unlock_memory(rs, sizeof(struct SoundIoOutStreamResample));
+}
+
+// All that the real-time thread touches.
+static int lock_memory(struct SoundIoOutStreamResample *rs) {
+    int err;
+    if ((err = soundio_os_lock_memory(rs, sizeof(struct SoundIoOutStreamResample))) ||
+        (err = soundio_os_lock_memory(rs->buf, buf_size(rs))) ||
+        (err = soundio_converter_lock_memory(rs->to_float)) ||
+        (err = soundio_converter_lock_memory(rs->from_float)) ||
+        (rs->remixer && (err = soundio_remixer_lock_memory(rs->remixer))) ||
+        (rs->resampler && (err = soundio_resampler_lock_memory(rs->resampler))))
+    {
+        unlock_memory(rs);
+        return err;
+    }
+    rs->locked = true;
+    return 0;
+}
+
+int soundio_outstream_resample_init(struct SoundIoOutStreamPrivate *os) {
+    struct SoundIoOutStream *outstream = &os->pub;
+    struct SoundIo *soundio = outstream->device->soundio;
+    struct SoundIoOutStreamResample *rs = soundio_os_alloc_pages(sizeof(struct SoundIoOutStreamResample));
+    if (!rs)
+        return SoundIoErrorNoMem;
+    os->resample = rs;
+
+    const int channel_count = outstream->layout.channel_count;
+    if (outstream->write_sample_rate != outstream->sample_rate) {
+        rs->resampler = soundio_resampler_create(channel_count, outstream->write_sample_rate,
+                outstream->sample_rate, outstream->resample_quality);
+        if (!rs->resampler)
+            return SoundIoErrorNoMem;
+    }
+    if (!soundio_channel_layout_equal(&outstream->write_layout, &outstream->layout)) {
+        rs->remixer = soundio_remixer_create(&outstream->write_layout, &outstream->layout, 0);
+        if (!rs->remixer)
+            return SoundIoErrorNoMem;
+    }
+    rs->to_float = soundio_converter_create(outstream->format, SoundIoFormatFloat32NE, 0);
+    rs->from_float = soundio_converter_create(SoundIoFormatFloat32NE, outstream->format, 0);
+    if (!rs->to_float || !rs->from_float)
+        return SoundIoErrorNoMem;
+
+    rs->write_channel_count = outstream->write_layout.channel_count;
+    rs->write_bytes_per_frame = outstream->bytes_per_sample * rs->write_channel_count;
+    rs->buf_frame_count = buf_frame_count_for(os);
+    rs->buf = soundio_os_alloc_pages(buf_size(rs));
+    if (!rs->buf)
+        return SoundIoErrorNoMem;
+
+    if (soundio->lock_memory) {
+        int err;
+        if ((err = lock_memory(rs)))
+            return err;
+    }
+
+    outstream->buffer_access = SoundIoBufferAccessCopy;
+    return 0;
+}
+
+void soundio_outstream_resample_destroy(struct SoundIoOutStreamPrivate *os) {
+    struct SoundIoOutStreamResample *rs = os->resample;
+    if (!rs)
+        return;
+    if (rs->locked)
+        unlock_memory(rs);
+    soundio_resampler_destroy(rs->resampler);
+    soundio_remixer_destroy(rs->remixer);
+    soundio_converter_destroy(rs->to_float);
+    soundio_converter_destroy(rs->from_float);
+    soundio_os_free_pages(rs->buf, buf_size(rs));
+    soundio_os_free_pages(rs, sizeof(struct SoundIoOutStreamResample));
+    os->resample = NULL;
+}
+
+int soundio_outstream_resample_resize(struct SoundIoOutStreamPrivate *os) {
+    struct SoundIoOutStreamResample *rs = os->resample;
+    if (!rs)
+        return 0;
+    int frame_count = buf_frame_count_for(os);
+    if (frame_count <= rs->buf_frame_count)
+        return 0;
+    // nothing is left in `buf` between callbacks
+    size_t size = frame_count * rs->write_bytes_per_frame;
+    char *buf = soundio_os_alloc_pages(size);
+    if (!buf)
+        return SoundIoErrorNoMem;
+    if (rs->locked) {
+        int err;
+        if ((err = soundio_os_lock_memory(buf, size))) {
+            soundio_os_free_pages(buf, size);
+            return err;
+        }
+        soundio_os_unlock_memory(rs->buf, buf_size(rs));
+    }
+    soundio_os_free_pages(rs->buf, buf_size(rs));
+    rs->buf = buf;
+    rs->buf_frame_count = frame_count;
+    return 0;
+}
+
+int soundio_outstream_resample_begin_write(struct SoundIoOutStreamPrivate *os,
+        struct SoundIoChannelArea **out_areas, int *frame_count)
+{
+    struct SoundIoOutStream *outstream = &os->pub;
+    struct SoundIoOutStreamResample *rs = os->resample;
+    if (*frame_count > rs->frames_left)
+        return SoundIoErrorInvalid;
+
+    char *ptr = rs->buf + rs->frame_count * rs->write_bytes_per_frame;
+    for (int ch = 0; ch < rs->write_channel_count; ch += 1) {
+        rs->areas[ch].ptr = ptr + ch * outstream->bytes_per_sample;
+        rs->areas[ch].step = rs->write_bytes_per_frame;
+    }
+    rs->write_frame_count = *frame_count;
+    *out_areas = rs->areas;
+    return 0;
+}
+
+int soundio_outstream_resample_end_write(struct SoundIoOutStreamPrivate *os) {
+    struct SoundIoOutStreamResample *rs = os->resample;
+    rs->frame_count += rs->write_frame_count;
+    rs->frames_left -= rs->write_frame_count;
+    rs->write_frame_count = 0;
+    return 0;
+}
+
+double soundio_outstream_resample_get_delay(struct SoundIoOutStreamPrivate *os) {
+    struct SoundIoOutStreamResample *rs = os->resample;
+    double delay = rs->frame_count / (double)os->pub.write_sample_rate;
+    if (rs->resampler)
+        delay += soundio_resampler_get_delay(rs->resampler);
+    return delay;
+}
+
+static void set_planar_areas(struct SoundIoChannelArea *areas, float *buf, int offset, int channel_count) {
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        areas[ch].ptr = (char *)(buf + ch * SOUNDIO_RESAMPLE_CHUNK_SIZE + offset);
+        areas[ch].step = sizeof(float);
+    }
+}
+
+// Converts the next chunk of what the callback wrote to float and remixes it,
+// once the resampler has taken the previous one.
+static void convert_chunk(struct SoundIoOutStreamPrivate *os, int *buf_offset) {
+    struct SoundIoOutStream *outstream = &os->pub;
+    struct SoundIoOutStreamResample *rs = os->resample;
+    const int channel_count = rs->write_channel_count;
+    if (rs->in_count > 0 || *buf_offset >= rs->frame_count)
+        return;
+
+    struct SoundIoChannelArea src[SOUNDIO_MAX_CHANNELS];
+    struct SoundIoChannelArea dest[SOUNDIO_MAX_CHANNELS];
+    int chunk = soundio_int_min(rs->frame_count - *buf_offset, SOUNDIO_RESAMPLE_CHUNK_SIZE);
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        src[ch].ptr = rs->buf + *buf_offset * rs->write_bytes_per_frame + ch * outstream->bytes_per_sample;
+        src[ch].step = rs->write_bytes_per_frame;
+    }
+    set_planar_areas(dest, rs->remixer ? rs->remix_buf : rs->in_buf, 0, channel_count);
+    soundio_converter_convert(rs->to_float, src, dest, channel_count, chunk);
+    if (rs->remixer) {
+        struct SoundIoChannelArea remixed[SOUNDIO_MAX_CHANNELS];
+        set_planar_areas(remixed, rs->in_buf, 0, outstream->layout.channel_count);
+        soundio_remixer_process(rs->remixer, dest, remixed, chunk);
+    }
+    *buf_offset += chunk;
+    rs->in_offset = 0;
+    rs->in_count = chunk;
+}
+
+// Hands converted input to the resampler and takes up to `frame_count`
+// frames of output into `out`, which points into `out_buf`, or straight into
+// `in_buf` when there is no resampler. Returns how many frames came out.
+static int resample_chunk(struct SoundIoOutStreamPrivate *os, int frame_count, bool *stuck,
+        struct SoundIoChannelArea *out)
+{
+    struct SoundIoOutStreamResample *rs = os->resample;
+    const int channel_count = os->pub.layout.channel_count;
+    if (!rs->resampler) {
+        int count = soundio_int_min(frame_count, rs->in_count);
+        set_planar_areas(out, rs->in_buf, rs->in_offset, channel_count);
+        rs->in_offset += count;
+        rs->in_count -= count;
+        *stuck = (count == 0);
+        return count;
+    }
+
+    struct SoundIoChannelArea src[SOUNDIO_MAX_CHANNELS];
+    set_planar_areas(src, rs->in_buf, rs->in_offset, channel_count);
+    set_planar_areas(out, rs->out_buf, 0, channel_count);
+    int in_count = rs->in_count;
+    int out_count = soundio_int_min(frame_count, SOUNDIO_RESAMPLE_CHUNK_SIZE);
+    soundio_resampler_process(rs->resampler, src, &in_count, out, &out_count);
+    rs->in_offset += in_count;
+    rs->in_count -= in_count;
+    *stuck = (in_count == 0 && out_count == 0);
+    return out_count;
+}
+
+// Produces `frame_count` frames into `dest_areas`, converting more of `buf`
+// as the resampler needs it. Returns how many it could.
+static int resample_into(struct SoundIoOutStreamPrivate *os, struct SoundIoChannelArea *dest_areas,
+        int frame_count, int *buf_offset)
+{
+    struct SoundIoOutStream *outstream = &os->pub;
+    struct SoundIoOutStreamResample *rs = os->resample;
+    const int channel_count = outstream->layout.channel_count;
+    struct SoundIoChannelArea src[SOUNDIO_MAX_CHANNELS];
+    struct SoundIoChannelArea dest[SOUNDIO_MAX_CHANNELS];
+
+    int done = 0;
+    while (done < frame_count) {
+        convert_chunk(os, buf_offset);
+        bool stuck;
+        int out_count = resample_chunk(os, frame_count - done, &stuck, src);
+        if (stuck)
+            break;
+
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            dest[ch].ptr = dest_areas[ch].ptr + done * dest_areas[ch].step;
+            dest[ch].step = dest_areas[ch].step;
+        }
+        soundio_converter_convert(rs->from_float, src, dest, channel_count, out_count);
+        done += out_count;
+    }
+    return done;
+}
+
+void soundio_outstream_resample_write_callback(struct SoundIoOutStreamPrivate *os,
+        int frame_count_min, int frame_count_max)
+{
+    struct SoundIoOutStream *outstream = &os->pub;
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)outstream->device->soundio;
+    struct SoundIoOutStreamResample *rs = os->resample;
+    struct SoundIoResampler *resampler = rs->resampler;
+
+    // The callback may write any amount which leaves the device with
+    // between frame_count_min and frame_count_max frames.
+    int max = resampler ? soundio_resampler_src_frame_count(resampler, frame_count_max + 1) - 1 :
+        frame_count_max;
+    max = soundio_int_min(max, rs->buf_frame_count);
+    int min = resampler ? soundio_resampler_src_frame_count(resampler, frame_count_min) : frame_count_min;
+    min = soundio_int_min(min, max);
+    rs->frame_count = 0;
+    rs->frames_left = max;
+    outstream->write_callback(outstream, min, max);
+
+    int total = resampler ? soundio_resampler_dest_frame_count(resampler, rs->frame_count) :
+        rs->frame_count;
+    int buf_offset = 0;
+    rs->in_offset = 0;
+    rs->in_count = 0;
+    while (total > 0) {
+        struct SoundIoChannelArea *areas;
+        int frame_count = total;
+        int err = si->outstream_begin_write(si, os, &areas, &frame_count);
+        if (!err) {
+            frame_count = resample_into(os, areas, frame_count, &buf_offset);
+            err = si->outstream_end_write(si, os);
+        }
+        if (err) {
+            rs->frame_count = 0;
+            // the underflow callback has told the application already
+            if (err != SoundIoErrorUnderflow)
+                outstream->error_callback(outstream, err);
+            return;
+        }
+        total -= frame_count;
+    }
+
+    // what is left is too little for another frame and only fills the
+    // filter history
+    while (resampler) {
+        struct SoundIoChannelArea out[SOUNDIO_MAX_CHANNELS];
+        convert_chunk(os, &buf_offset);
+        bool stuck;
+        resample_chunk(os, 0, &stuck, out);
+        if (stuck)
+            break;
+    }
+    rs->frame_count = 0;
+}
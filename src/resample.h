@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#ifndef SOUNDIO_RESAMPLE_H
+#define SOUNDIO_RESAMPLE_H
+
+#include "soundio_internal.h"
+#include "convert.h"
+#include "remix.h"
+
+#include <stdint.h>
+
+// Input is taken into the history of each channel this many frames at a
+// time, and the stream stage converts this many frames at a time.
+#define SOUNDIO_RESAMPLE_CHUNK_SIZE 256
+
+// Ratios which reduce to at most this many output frames per cycle get one
+// exact filter per phase. Other ratios interpolate between this many.
+#define SOUNDIO_RESAMPLE_MAX_PHASES 1024
+
+// An adjustable resampler can change its ratio in steps this fine, relative
+// to the whole step.
+#define SOUNDIO_RESAMPLE_ADJUST_RESOLUTION (1 << 24)
+
+typedef float (*SoundIoDotFn)(const float *a, const float *b, int count);
+
+// Output frame n lies at input time n * phase_step / phase_count, kept as
+// an integer position into the history plus a phase in [0, phase_count).
+struct SoundIoResampler {
+    int channel_count;
+    int src_rate;
+    int dest_rate;
+    int taps;
+    int phase_count;
+    int phase_step;
+    // phase_step before soundio_resampler_set_adjust.
+    int base_phase_step;
+    // phase_count rows of `taps` coefficients when exact, otherwise
+    // SOUNDIO_RESAMPLE_MAX_PHASES + 1 rows to interpolate between.
+    bool interpolate;
+    float *table;
+    // In bytes. The struct, `table` and `history` each have pages of their
+    // own, so that they can be locked when the resampler runs on a
+    // real-time thread.
+    size_t table_size;
+    const char *kernel_name;
+    SoundIoDotFn dot;
+
+    // channel_count histories of history_capacity samples. Only `history_len`
+    // samples of each are valid, and the next output frame is computed from
+    // the `taps` samples starting at `pos`.
+    float *history;
+    size_t history_size;
+    int history_capacity;
+    int history_len;
+    int pos;
+    int phase;
+};
+
+// Like soundio_resampler_create, but with enough phases that
+// soundio_resampler_set_adjust can change the ratio by parts per million.
+// Always interpolates between filter phases.
+struct SoundIoResampler *soundio_resampler_create_adjustable(int channel_count, int src_rate,
+        int dest_rate, enum SoundIoResampleQuality quality);
+// Takes input `adjust` times as fast as the nominal ratio. The filter stays
+// designed for the nominal ratio, so keep `adjust` close to 1.0.
+void soundio_resampler_set_adjust(struct SoundIoResampler *resampler, double adjust);
+
+int soundio_resampler_lock_memory(struct SoundIoResampler *resampler);
+void soundio_resampler_unlock_memory(struct SoundIoResampler *resampler);
+
+struct SoundIoOutStreamPrivate;
+
+// Resamples what SoundIoOutStream::write_callback writes at
+// SoundIoOutStream::write_sample_rate to SoundIoOutStream::sample_rate, and
+// remixes it from SoundIoOutStream::write_layout to SoundIoOutStream::layout.
+// The callback writes to `buf` at the write rate and layout; once it
+// returns, everything is remixed, resampled and written to the device buffer.
+struct SoundIoOutStreamResample {
+    // Either may be NULL when the rates or the layouts are the same.
+    struct SoundIoResampler *resampler;
+    struct SoundIoRemixer *remixer;
+    struct SoundIoConverter *to_float;
+    struct SoundIoConverter *from_float;
+
+    char *buf;
+    int buf_frame_count;
+    // Whether everything above, `buf` and this struct are locked in memory.
+    bool locked;
+    // Of `buf`, which has a channel for each channel of the write layout.
+    int write_channel_count;
+    int write_bytes_per_frame;
+    struct SoundIoChannelArea areas[SOUNDIO_MAX_CHANNELS];
+    // Frames written to `buf` during this callback, how many more may be,
+    // and the count from the last begin_write.
+    int frame_count;
+    int frames_left;
+    int write_frame_count;
+
+    // Converted input not yet taken by the resampler, and output on its way
+    // to the device, one channel after another. in_buf is remixed already;
+    // remix_buf holds a chunk before that.
+    float remix_buf[SOUNDIO_MAX_CHANNELS * SOUNDIO_RESAMPLE_CHUNK_SIZE];
+    float in_buf[SOUNDIO_MAX_CHANNELS * SOUNDIO_RESAMPLE_CHUNK_SIZE];
+    float out_buf[SOUNDIO_MAX_CHANNELS * SOUNDIO_RESAMPLE_CHUNK_SIZE];
+    int in_offset;
+    int in_count;
+};
+
+// Called after the backend has opened the stream.
+int soundio_outstream_resample_init(struct SoundIoOutStreamPrivate *os);
+void soundio_outstream_resample_destroy(struct SoundIoOutStreamPrivate *os);
+// Grows `buf` to fit SoundIoOutStream::software_latency once the backend has
+// raised it. Not to be called while the write callback may run.
+int soundio_outstream_resample_resize(struct SoundIoOutStreamPrivate *os);
+// Runs SoundIoOutStream::write_callback at the write rate, then writes the
+// result to the device.
+void soundio_outstream_resample_write_callback(struct SoundIoOutStreamPrivate *os,
+        int frame_count_min, int frame_count_max);
+int soundio_outstream_resample_begin_write(struct SoundIoOutStreamPrivate *os,
+        struct SoundIoChannelArea **out_areas, int *frame_count);
+int soundio_outstream_resample_end_write(struct SoundIoOutStreamPrivate *os);
+// Seconds between the frames passed to end_write and the device buffer.
+double soundio_outstream_resample_get_delay(struct SoundIoOutStreamPrivate *os);
+
+#endif
@@ -11,7 +11,27 @@
 
 #include <stdlib.h>
 
+static inline bool strict_roles(struct SoundIoRingBuffer *rb) {
+    return rb->flags & SoundIoRingBufferFlagStrictRoles;
+}
+
+// Called by the reader in strict roles mode before it uses
+// cached_write_offset, which a clear leaves ahead of write_offset.
+static inline void check_clear(struct SoundIoRingBuffer *rb) {
+    unsigned long clear_count = SOUNDIO_ATOMIC_LOAD_EXPLICIT(rb->clear_count, SOUNDIO_MEMORY_ORDER_ACQUIRE);
+    if (clear_count == rb->cached_clear_count)
+        return;
+    rb->cached_clear_count = clear_count;
+    rb->cached_write_offset = SOUNDIO_ATOMIC_LOAD_EXPLICIT(rb->write_offset, SOUNDIO_MEMORY_ORDER_ACQUIRE);
+}
+
 struct SoundIoRingBuffer *soundio_ring_buffer_create(struct SoundIo *soundio, int requested_capacity) {
+    return soundio_ring_buffer_create_ex(soundio, requested_capacity, SoundIoRingBufferFlagNone);
+}
+
+struct SoundIoRingBuffer *soundio_ring_buffer_create_ex(struct SoundIo *soundio,
+        int requested_capacity, int flags)
+{
     struct SoundIoRingBuffer *rb = ALLOCATE(struct SoundIoRingBuffer, 1);
 
     assert(requested_capacity > 0);
@@ -21,7 +41,7 @@ struct SoundIoRingBuffer *soundio_ring_buffer_create(struct SoundIo *soundio, in
         return NULL;
     }
 
-    if (soundio_ring_buffer_init(rb, requested_capacity)) {
+    if (soundio_ring_buffer_init_ex(rb, requested_capacity, flags)) {
         soundio_ring_buffer_destroy(rb);
         return NULL;
     }
@@ -43,26 +63,65 @@ int soundio_ring_buffer_capacity(struct SoundIoRingBuffer *rb) {
 }
 
 char *soundio_ring_buffer_write_ptr(struct SoundIoRingBuffer *rb) {
-    unsigned long write_offset = SOUNDIO_ATOMIC_LOAD(rb->write_offset);
+    unsigned long write_offset = strict_roles(rb) ?
+        SOUNDIO_ATOMIC_LOAD_EXPLICIT(rb->write_offset, SOUNDIO_MEMORY_ORDER_RELAXED) :
+        SOUNDIO_ATOMIC_LOAD(rb->write_offset);
     return rb->mem.address + (write_offset % rb->capacity);
 }
 
 void soundio_ring_buffer_advance_write_ptr(struct SoundIoRingBuffer *rb, int count) {
+    if (strict_roles(rb)) {
+        // We are the only thread that modifies write_offset, so a plain
+        // store is enough; no read-modify-write is needed.
+        unsigned long write_offset = SOUNDIO_ATOMIC_LOAD_EXPLICIT(rb->write_offset,
+                SOUNDIO_MEMORY_ORDER_RELAXED) + count;
+        SOUNDIO_ATOMIC_STORE_EXPLICIT(rb->write_offset, write_offset, SOUNDIO_MEMORY_ORDER_RELEASE);
+        assert(write_offset - SOUNDIO_ATOMIC_LOAD_EXPLICIT(rb->read_offset,
+                    SOUNDIO_MEMORY_ORDER_ACQUIRE) <= (unsigned long)rb->capacity);
+        return;
+    }
     SOUNDIO_ATOMIC_FETCH_ADD(rb->write_offset, count);
     assert(soundio_ring_buffer_fill_count(rb) >= 0);
 }
 
 char *soundio_ring_buffer_read_ptr(struct SoundIoRingBuffer *rb) {
-    unsigned long read_offset = SOUNDIO_ATOMIC_LOAD(rb->read_offset);
+    unsigned long read_offset = strict_roles(rb) ?
+        SOUNDIO_ATOMIC_LOAD_EXPLICIT(rb->read_offset, SOUNDIO_MEMORY_ORDER_RELAXED) :
+        SOUNDIO_ATOMIC_LOAD(rb->read_offset);
     return rb->mem.address + (read_offset % rb->capacity);
 }
 
 void soundio_ring_buffer_advance_read_ptr(struct SoundIoRingBuffer *rb, int count) {
+    if (strict_roles(rb)) {
+        unsigned long read_offset = SOUNDIO_ATOMIC_LOAD_EXPLICIT(rb->read_offset,
+                SOUNDIO_MEMORY_ORDER_RELAXED) + count;
+        // The reader never gets ahead of the last write_offset it observed.
+        assert(rb->cached_write_offset - read_offset <= (unsigned long)rb->capacity);
+        SOUNDIO_ATOMIC_STORE_EXPLICIT(rb->read_offset, read_offset, SOUNDIO_MEMORY_ORDER_RELEASE);
+        return;
+    }
     SOUNDIO_ATOMIC_FETCH_ADD(rb->read_offset, count);
     assert(soundio_ring_buffer_fill_count(rb) >= 0);
 }
 
 int soundio_ring_buffer_fill_count(struct SoundIoRingBuffer *rb) {
+    if (strict_roles(rb)) {
+        // Called by the reader, which owns read_offset. The count has to be
+        // exact, so the writer's offset is loaded unless the cached one
+        // already shows a full buffer, which only the reader can change.
+        unsigned long read_offset = SOUNDIO_ATOMIC_LOAD_EXPLICIT(rb->read_offset,
+                SOUNDIO_MEMORY_ORDER_RELAXED);
+        check_clear(rb);
+        if ((int)(rb->cached_write_offset - read_offset) == rb->capacity)
+            return rb->capacity;
+        unsigned long write_offset = SOUNDIO_ATOMIC_LOAD_EXPLICIT(rb->write_offset,
+                SOUNDIO_MEMORY_ORDER_ACQUIRE);
+        rb->cached_write_offset = write_offset;
+        int count = write_offset - read_offset;
+        assert(count >= 0);
+        assert(count <= rb->capacity);
+        return count;
+    }
     // Whichever offset we load first might have a smaller value. So we load
     // the read_offset first.
     unsigned long read_offset = SOUNDIO_ATOMIC_LOAD(rb->read_offset);
@@ -74,21 +133,133 @@ int soundio_ring_buffer_fill_count(struct SoundIoRingBuffer *rb) {
 }
 
 int soundio_ring_buffer_free_count(struct SoundIoRingBuffer *rb) {
+    if (strict_roles(rb)) {
+        // Called by the writer, which owns write_offset. Likewise an empty
+        // buffer stays empty until the writer writes.
+        unsigned long write_offset = SOUNDIO_ATOMIC_LOAD_EXPLICIT(rb->write_offset,
+                SOUNDIO_MEMORY_ORDER_RELAXED);
+        if (write_offset == rb->cached_read_offset)
+            return rb->capacity;
+        unsigned long read_offset = SOUNDIO_ATOMIC_LOAD_EXPLICIT(rb->read_offset,
+                SOUNDIO_MEMORY_ORDER_ACQUIRE);
+        rb->cached_read_offset = read_offset;
+        int count = write_offset - read_offset;
+        assert(count >= 0);
+        assert(count <= rb->capacity);
+        return rb->capacity - count;
+    }
     return rb->capacity - soundio_ring_buffer_fill_count(rb);
 }
 
+char *soundio_ring_buffer_begin_write(struct SoundIoRingBuffer *rb, int *byte_count) {
+    assert(*byte_count >= 0);
+    unsigned long write_offset;
+    int free_count;
+    if (strict_roles(rb)) {
+        write_offset = SOUNDIO_ATOMIC_LOAD_EXPLICIT(rb->write_offset, SOUNDIO_MEMORY_ORDER_RELAXED);
+        free_count = rb->capacity - (int)(write_offset - rb->cached_read_offset);
+        // Only look at the reader's offset if the last one we saw does not
+        // leave enough room.
+        if (free_count < *byte_count) {
+            rb->cached_read_offset = SOUNDIO_ATOMIC_LOAD_EXPLICIT(rb->read_offset,
+                    SOUNDIO_MEMORY_ORDER_ACQUIRE);
+            free_count = rb->capacity - (int)(write_offset - rb->cached_read_offset);
+        }
+    } else {
+        write_offset = SOUNDIO_ATOMIC_LOAD(rb->write_offset);
+        unsigned long read_offset = SOUNDIO_ATOMIC_LOAD(rb->read_offset);
+        free_count = rb->capacity - (int)(write_offset - read_offset);
+    }
+    assert(free_count >= 0);
+    assert(free_count <= rb->capacity);
+    *byte_count = soundio_int_min(*byte_count, free_count);
+    rb->write_region_size = *byte_count;
+    return rb->mem.address + (write_offset % rb->capacity);
+}
+
+void soundio_ring_buffer_end_write(struct SoundIoRingBuffer *rb, int byte_count) {
+    assert(byte_count >= 0);
+    assert(byte_count <= rb->write_region_size);
+    rb->write_region_size = 0;
+    if (byte_count > 0)
+        soundio_ring_buffer_advance_write_ptr(rb, byte_count);
+}
+
+char *soundio_ring_buffer_begin_read(struct SoundIoRingBuffer *rb, int *byte_count) {
+    assert(*byte_count >= 0);
+    unsigned long read_offset;
+    int fill_count;
+    if (strict_roles(rb)) {
+        read_offset = SOUNDIO_ATOMIC_LOAD_EXPLICIT(rb->read_offset, SOUNDIO_MEMORY_ORDER_RELAXED);
+        // discarded bytes are not handed out
+        check_clear(rb);
+        fill_count = rb->cached_write_offset - read_offset;
+        // Only look at the writer's offset if the last one we saw does not
+        // have enough data.
+        if (fill_count < *byte_count) {
+            rb->cached_write_offset = SOUNDIO_ATOMIC_LOAD_EXPLICIT(rb->write_offset,
+                    SOUNDIO_MEMORY_ORDER_ACQUIRE);
+            fill_count = rb->cached_write_offset - read_offset;
+        }
+    } else {
+        read_offset = SOUNDIO_ATOMIC_LOAD(rb->read_offset);
+        unsigned long write_offset = SOUNDIO_ATOMIC_LOAD(rb->write_offset);
+        fill_count = write_offset - read_offset;
+    }
+    assert(fill_count >= 0);
+    assert(fill_count <= rb->capacity);
+    *byte_count = soundio_int_min(*byte_count, fill_count);
+    rb->read_region_size = *byte_count;
+    return rb->mem.address + (read_offset % rb->capacity);
+}
+
+void soundio_ring_buffer_end_read(struct SoundIoRingBuffer *rb, int byte_count) {
+    assert(byte_count >= 0);
+    assert(byte_count <= rb->read_region_size);
+    rb->read_region_size = 0;
+    if (byte_count > 0)
+        soundio_ring_buffer_advance_read_ptr(rb, byte_count);
+}
+
 void soundio_ring_buffer_clear(struct SoundIoRingBuffer *rb) {
+    if (strict_roles(rb)) {
+        // The cached offset may be behind, which would put the write offset
+        // behind the reader, so this one has to look.
+        unsigned long read_offset = SOUNDIO_ATOMIC_LOAD_EXPLICIT(rb->read_offset,
+                SOUNDIO_MEMORY_ORDER_ACQUIRE);
+        rb->cached_read_offset = read_offset;
+        SOUNDIO_ATOMIC_STORE_EXPLICIT(rb->write_offset, read_offset, SOUNDIO_MEMORY_ORDER_RELEASE);
+        // after the store, so that a reader which sees the new count sees
+        // the new write offset too
+        unsigned long clear_count = SOUNDIO_ATOMIC_LOAD_EXPLICIT(rb->clear_count,
+                SOUNDIO_MEMORY_ORDER_RELAXED) + 1;
+        SOUNDIO_ATOMIC_STORE_EXPLICIT(rb->clear_count, clear_count, SOUNDIO_MEMORY_ORDER_RELEASE);
+        return;
+    }
     unsigned long read_offset = SOUNDIO_ATOMIC_LOAD(rb->read_offset);
     SOUNDIO_ATOMIC_STORE(rb->write_offset, read_offset);
 }
 
 int soundio_ring_buffer_init(struct SoundIoRingBuffer *rb, int requested_capacity) {
+    return soundio_ring_buffer_init_ex(rb, requested_capacity, SoundIoRingBufferFlagNone);
+}
+
+int soundio_ring_buffer_init_ex(struct SoundIoRingBuffer *rb, int requested_capacity, int flags) {
     int err;
-    if ((err = soundio_os_init_mirrored_memory(&rb->mem, requested_capacity)))
+    int mem_flags = (flags & SoundIoRingBufferFlagHugePages) ?
+        SoundIoOsMirroredMemoryFlagHugePages : SoundIoOsMirroredMemoryFlagNone;
+    if ((err = soundio_os_init_mirrored_memory_ex(&rb->mem, requested_capacity, mem_flags)))
         return err;
     SOUNDIO_ATOMIC_STORE(rb->write_offset, 0);
     SOUNDIO_ATOMIC_STORE(rb->read_offset, 0);
+    rb->cached_write_offset = 0;
+    rb->cached_read_offset = 0;
+    SOUNDIO_ATOMIC_STORE(rb->clear_count, 0);
+    rb->cached_clear_count = 0;
+    rb->write_region_size = 0;
+    rb->read_region_size = 0;
     rb->capacity = rb->mem.capacity;
+    rb->flags = flags;
 
     return 0;
 }
@@ -13,12 +13,42 @@
 
 struct SoundIoRingBuffer {
     struct SoundIoOsMirroredMemory mem;
+    int capacity;
+    // See ::SoundIoRingBufferFlag
+    int flags;
+    char pad0[SOUNDIO_CACHE_LINE_SIZE];
+
+    // Only modified by the writer.
     struct SoundIoAtomicULong write_offset;
+    // Writer's last observed value of read_offset. Only used with
+    // SoundIoRingBufferFlagStrictRoles.
+    unsigned long cached_read_offset;
+    // Size of the region handed out by soundio_ring_buffer_begin_write.
+    int write_region_size;
+    char pad1[SOUNDIO_CACHE_LINE_SIZE];
+
+    // Only modified by the reader.
     struct SoundIoAtomicULong read_offset;
-    int capacity;
+    // Reader's last observed value of write_offset. Only used with
+    // SoundIoRingBufferFlagStrictRoles.
+    unsigned long cached_write_offset;
+    // Size of the region handed out by soundio_ring_buffer_begin_read.
+    int read_region_size;
+    // Reader's last observed value of clear_count. Only used with
+    // SoundIoRingBufferFlagStrictRoles.
+    unsigned long cached_clear_count;
+    char pad2[SOUNDIO_CACHE_LINE_SIZE];
+
+    // Only modified by the writer, once per soundio_ring_buffer_clear, which
+    // moves write_offset back. The reader checks it before trusting
+    // cached_write_offset. On a line of its own, so that it stays shared
+    // in the reader's cache until a clear.
+    struct SoundIoAtomicULong clear_count;
+    char pad3[SOUNDIO_CACHE_LINE_SIZE];
 };
 
 int soundio_ring_buffer_init(struct SoundIoRingBuffer *rb, int requested_capacity);
+int soundio_ring_buffer_init_ex(struct SoundIoRingBuffer *rb, int requested_capacity, int flags);
 void soundio_ring_buffer_deinit(struct SoundIoRingBuffer *rb);
 
 #endif
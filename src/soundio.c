@@ -6,12 +6,14 @@
  */
 
 #include "soundio_private.h"
+#include "stream_group.h"
 #include "util.h"
 #include "os.h"
 #include "config.h"
 
 #include <string.h>
 #include <assert.h>
+#include <stdarg.h>
 #include <stdio.h>
 
 static const enum SoundIoBackend available_backends[] = {
@@ -72,6 +74,8 @@ static backend_init_t backend_init_fns[] = {
 
 SOUNDIO_MAKE_LIST_DEF(struct SoundIoDevice*, SoundIoListDevicePtr, SOUNDIO_LIST_NOT_STATIC)
 SOUNDIO_MAKE_LIST_DEF(struct SoundIoSampleRateRange, SoundIoListSampleRateRange, SOUNDIO_LIST_NOT_STATIC)
+SOUNDIO_MAKE_LIST_DEF(struct SoundIoDeviceChange, SoundIoListDeviceChange, SOUNDIO_LIST_STATIC)
+SOUNDIO_MAKE_LIST_DEF(struct SoundIoAsyncCall *, SoundIoListAsyncCallPtr, SOUNDIO_LIST_STATIC)
 
 const char *soundio_strerror(int error) {
     switch ((enum SoundIoError)error) {
@@ -91,6 +95,8 @@ const char *soundio_strerror(int error) {
         case SoundIoErrorInterrupted: return "interrupted; try again";
         case SoundIoErrorUnderflow: return "buffer underflow";
         case SoundIoErrorEncodingString: return "failed to encode string";
+        case SoundIoErrorMemoryLock: return "unable to lock memory";
+        case SoundIoErrorFileIo: return "file I/O error";
     }
     return "(invalid error)";
 }
@@ -167,6 +173,8 @@ void soundio_destroy(struct SoundIo *soundio) {
 
     soundio_disconnect(soundio);
 
+    if (si)
+        soundio_os_event_destroy(si->events_event);
     free(si);
 }
 
@@ -193,6 +201,11 @@ struct SoundIo *soundio_create(void) {
     struct SoundIoPrivate *si = ALLOCATE(struct SoundIoPrivate, 1);
     if (!si)
         return NULL;
+    si->events_event = soundio_os_event_create();
+    if (!si->events_event) {
+        free(si);
+        return NULL;
+    }
     struct SoundIo *soundio = &si->pub;
     soundio->on_devices_change = do_nothing_cb;
     soundio->on_backend_disconnect = default_backend_disconnect_cb;
@@ -257,12 +270,29 @@ void soundio_disconnect(struct SoundIo *soundio) {
 
     soundio_destroy_devices_info(si->safe_devices_info);
     si->safe_devices_info = NULL;
+    SoundIoListDeviceChange_deinit(&si->device_changes);
+    memset(&si->device_changes, 0, sizeof(struct SoundIoListDeviceChange));
+    si->devices_change_emitted = false;
+    // streams, and with them their calls, are destroyed before disconnecting
+    assert(si->async_calls.length == 0);
+    SoundIoListAsyncCallPtr_deinit(&si->async_calls);
+    memset(&si->async_calls, 0, sizeof(struct SoundIoListAsyncCallPtr));
+    soundio_destroy_devices_info((struct SoundIoDevicesInfo *)
+            SOUNDIO_ATOMIC_EXCHANGE(si->posted_devices_info, NULL));
+    SOUNDIO_ATOMIC_STORE(si->posted_error, 0);
+    soundio_os_event_reset(si->events_event);
+    si->have_devices = false;
+    si->emitted_disconnect = false;
 
     si->destroy = NULL;
     si->flush_events = NULL;
     si->wait_events = NULL;
     si->wakeup = NULL;
     si->force_device_scan = NULL;
+    si->device_probe = NULL;
+    si->waits_for_start_deadline = false;
+    si->drives_duplex_input = false;
+    si->max_period_frame_count = 0;
 
     si->outstream_open = NULL;
     si->outstream_destroy = NULL;
@@ -273,6 +303,8 @@ void soundio_disconnect(struct SoundIo *soundio) {
     si->outstream_pause = NULL;
     si->outstream_get_latency = NULL;
     si->outstream_set_volume = NULL;
+    si->outstream_get_poll_descriptors = NULL;
+    si->outstream_process = NULL;
 
     si->instream_open = NULL;
     si->instream_destroy = NULL;
@@ -281,12 +313,119 @@ void soundio_disconnect(struct SoundIo *soundio) {
     si->instream_end_read = NULL;
     si->instream_pause = NULL;
     si->instream_get_latency = NULL;
+    si->instream_get_poll_descriptors = NULL;
+    si->instream_process = NULL;
+}
+
+static int outstream_open_backend(struct SoundIoPrivate *si, struct SoundIoOutStreamPrivate *os) {
+    int err;
+    if ((err = si->outstream_open(si, os)))
+        return err;
+    if (os->pub.write_sample_rate != os->pub.sample_rate ||
+        !soundio_channel_layout_equal(&os->pub.write_layout, &os->pub.layout))
+    {
+        return soundio_outstream_resample_init(os);
+    }
+    return 0;
+}
+
+static void async_call_run(void *arg) {
+    struct SoundIoAsyncCall *call = (struct SoundIoAsyncCall *)arg;
+    struct SoundIo *soundio = call->os ? call->os->pub.device->soundio : call->is->pub.device->soundio;
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)soundio;
+
+    switch (call->op) {
+    case SoundIoAsyncOpOpen:
+        call->err = call->os ? outstream_open_backend(si, call->os) : si->instream_open(si, call->is);
+        break;
+    case SoundIoAsyncOpStart:
+        call->err = call->os ? si->outstream_start(si, call->os) : si->instream_start(si, call->is);
+        break;
+    case SoundIoAsyncOpNone:
+        soundio_panic("invalid async call");
+    }
+
+    SOUNDIO_ATOMIC_STORE(call->done, true);
+    soundio_wakeup(soundio);
+    soundio->on_events_signal(soundio);
+}
+
+static int async_call_begin(struct SoundIoPrivate *si, struct SoundIoAsyncCall *call,
+        enum SoundIoAsyncOp op)
+{
+    if (call->op != SoundIoAsyncOpNone)
+        return SoundIoErrorInvalid;
+
+    int err;
+    if ((err = SoundIoListAsyncCallPtr_append(&si->async_calls, call)))
+        return err;
+
+    call->op = op;
+    call->err = 0;
+    SOUNDIO_ATOMIC_STORE(call->done, false);
+    if ((err = soundio_os_thread_create(async_call_run, call, NULL, false, NULL, &call->thread))) {
+        SoundIoListAsyncCallPtr_pop(&si->async_calls);
+        call->op = SoundIoAsyncOpNone;
+        return err;
+    }
+    return 0;
+}
+
+static void async_call_forget(struct SoundIoPrivate *si, struct SoundIoAsyncCall *call) {
+    for (int i = 0; i < si->async_calls.length; i += 1) {
+        if (SoundIoListAsyncCallPtr_val_at(&si->async_calls, i) == call) {
+            SoundIoListAsyncCallPtr_swap_remove(&si->async_calls, i);
+            break;
+        }
+    }
+    soundio_os_thread_destroy(call->thread);
+    call->thread = NULL;
+    call->op = SoundIoAsyncOpNone;
+}
+
+// Waits for a call in progress, without reporting its result.
+static void async_call_cancel(struct SoundIoPrivate *si, struct SoundIoAsyncCall *call) {
+    if (call->op != SoundIoAsyncOpNone)
+        async_call_forget(si, call);
+}
+
+static struct SoundIoAsyncCall *find_finished_async_call(struct SoundIoPrivate *si) {
+    for (int i = 0; i < si->async_calls.length; i += 1) {
+        struct SoundIoAsyncCall *call = SoundIoListAsyncCallPtr_val_at(&si->async_calls, i);
+        if (SOUNDIO_ATOMIC_LOAD(call->done))
+            return call;
+    }
+    return NULL;
+}
+
+static void dispatch_async_calls(struct SoundIoPrivate *si) {
+    // A callback may destroy streams or make new calls, so look for the next
+    // finished call from the start each time.
+    struct SoundIoAsyncCall *call;
+    while ((call = find_finished_async_call(si))) {
+        enum SoundIoAsyncOp op = call->op;
+        async_call_forget(si, call);
+        if (call->os) {
+            struct SoundIoOutStream *outstream = &call->os->pub;
+            void (*callback)(struct SoundIoOutStream *, int) = (op == SoundIoAsyncOpOpen) ?
+                outstream->open_callback : outstream->start_callback;
+            if (callback)
+                callback(outstream, call->err);
+        } else {
+            struct SoundIoInStream *instream = &call->is->pub;
+            void (*callback)(struct SoundIoInStream *, int) = (op == SoundIoAsyncOpOpen) ?
+                instream->open_callback : instream->start_callback;
+            if (callback)
+                callback(instream, call->err);
+        }
+    }
 }
 
 void soundio_flush_events(struct SoundIo *soundio) {
     assert(soundio->current_backend != SoundIoBackendNone);
     struct SoundIoPrivate *si = (struct SoundIoPrivate *)soundio;
     si->flush_events(si);
+    dispatch_async_calls(si);
 }
 
 int soundio_input_device_count(struct SoundIo *soundio) {
@@ -398,6 +537,13 @@ void soundio_device_unref(struct SoundIoDevice *device) {
         struct SoundIoDevicePrivate *dev = (struct SoundIoDevicePrivate *)device;
         if (dev->destruct)
             dev->destruct(dev);
+        SoundIoListSampleRateRange_deinit(&dev->sample_rates);
+
+        if (dev->arena) {
+            // everything else is released with the arena
+            soundio_arena_unref(dev->arena);
+            return;
+        }
 
         free(device->id);
         free(device->name);
@@ -407,7 +553,6 @@ void soundio_device_unref(struct SoundIoDevice *device) {
         {
             free(device->sample_rates);
         }
-        SoundIoListSampleRateRange_deinit(&dev->sample_rates);
 
         if (device->formats != &dev->prealloc_format)
             free(device->formats);
@@ -426,7 +571,12 @@ void soundio_device_ref(struct SoundIoDevice *device) {
 
 void soundio_wait_events(struct SoundIo *soundio) {
     struct SoundIoPrivate *si = (struct SoundIoPrivate *)soundio;
-    si->wait_events(si);
+    // a call which finished before now has nothing left to wake us up
+    if (find_finished_async_call(si))
+        si->flush_events(si);
+    else
+        si->wait_events(si);
+    dispatch_async_calls(si);
 }
 
 void soundio_wakeup(struct SoundIo *soundio) {
@@ -447,14 +597,95 @@ int soundio_outstream_begin_write(struct SoundIoOutStream *outstream,
     struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate *)outstream;
     if (*frame_count <= 0)
         return SoundIoErrorInvalid;
-    return si->outstream_begin_write(si, os, areas, frame_count);
+    soundio_stream_stats_io_begin(&os->stats);
+    int err = os->resample ? soundio_outstream_resample_begin_write(os, areas, frame_count) :
+        si->outstream_begin_write(si, os, areas, frame_count);
+    soundio_stream_stats_io_end(&os->stats);
+    os->write_frame_count = err ? 0 : *frame_count;
+    return err;
 }
 
 int soundio_outstream_end_write(struct SoundIoOutStream *outstream) {
     struct SoundIo *soundio = outstream->device->soundio;
     struct SoundIoPrivate *si = (struct SoundIoPrivate *)soundio;
     struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate *)outstream;
-    return si->outstream_end_write(si, os);
+    soundio_stream_stats_io_begin(&os->stats);
+    int err = os->resample ? soundio_outstream_resample_end_write(os) : si->outstream_end_write(si, os);
+    soundio_stream_stats_io_end(&os->stats);
+    if (!err)
+        os->frames_committed += os->write_frame_count;
+    os->write_frame_count = 0;
+    return err;
+}
+
+// Fills in what the stream leaves at the default from SoundIo::thread_settings.
+static void resolve_thread_settings(struct SoundIo *soundio,
+        const struct SoundIoThreadSettings *stream_settings, double period,
+        struct SoundIoThreadSettings *settings)
+{
+    *settings = *stream_settings;
+    if (settings->policy == SoundIoThreadPolicyDefault) {
+        settings->policy = soundio->thread_settings.policy;
+        settings->priority = soundio->thread_settings.priority;
+        settings->deadline_runtime_ns = soundio->thread_settings.deadline_runtime_ns;
+        settings->deadline_period_ns = soundio->thread_settings.deadline_period_ns;
+    }
+    bool any_cpu = true;
+    for (int i = 0; i < ARRAY_LENGTH(settings->cpu_mask); i += 1)
+        any_cpu = any_cpu && !settings->cpu_mask[i];
+    if (any_cpu)
+        memcpy(settings->cpu_mask, soundio->thread_settings.cpu_mask, sizeof(settings->cpu_mask));
+
+    if (settings->policy == SoundIoThreadPolicyDeadline) {
+        if (!settings->deadline_period_ns)
+            settings->deadline_period_ns = (uint64_t)(period * 1000000000.0);
+        if (!settings->deadline_runtime_ns)
+            settings->deadline_runtime_ns = settings->deadline_period_ns / 2;
+    }
+}
+
+int soundio_outstream_thread_create(struct SoundIoOutStreamPrivate *os,
+        void (*run)(void *arg), double period, struct SoundIoOsThread **out_thread)
+{
+    struct SoundIo *soundio = os->pub.device->soundio;
+    struct SoundIoThreadSettings settings;
+    resolve_thread_settings(soundio, &os->pub.thread_settings, period, &settings);
+    int err;
+    if ((err = soundio_os_thread_create(run, os, &settings, soundio->lock_memory,
+                    soundio->emit_rtprio_warning, out_thread)))
+        return err;
+    soundio_os_thread_get_settings(*out_thread, &os->thread_settings);
+    os->has_thread = true;
+    return 0;
+}
+
+static int get_thread_settings(struct SoundIo *soundio, bool has_thread,
+        const struct SoundIoThreadSettings *applied, struct SoundIoThreadSettings *settings)
+{
+    if (!has_thread) {
+        switch (soundio->current_backend) {
+        case SoundIoBackendAlsa:
+        case SoundIoBackendWasapi:
+        case SoundIoBackendDummy:
+            return SoundIoErrorInvalid;
+        default:
+            return SoundIoErrorIncompatibleBackend;
+        }
+    }
+    *settings = *applied;
+    return 0;
+}
+
+int soundio_outstream_get_thread_settings(struct SoundIoOutStream *outstream,
+        struct SoundIoThreadSettings *settings)
+{
+    struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate *)outstream;
+    return get_thread_settings(outstream->device->soundio, os->has_thread, &os->thread_settings, settings);
+}
+
+void soundio_outstream_get_stats(struct SoundIoOutStream *outstream, struct SoundIoStreamStats *stats) {
+    struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate *)outstream;
+    soundio_stream_stats_read(&os->stats, stats);
 }
 
 static void default_outstream_error_callback(struct SoundIoOutStream *os, int err) {
@@ -474,19 +705,27 @@ struct SoundIoOutStream *soundio_outstream_create(struct SoundIoDevice *device)
 
     outstream->device = device;
     soundio_device_ref(device);
+    os->async_call.os = os;
 
     outstream->error_callback = default_outstream_error_callback;
     outstream->underflow_callback = default_underflow_callback;
+    outstream->resample_quality = SoundIoResampleQualityMedium;
 
     return outstream;
 }
 
-int soundio_outstream_open(struct SoundIoOutStream *outstream) {
+// Checks the parameters and fills in the defaults.
+static int outstream_prepare(struct SoundIoOutStream *outstream) {
     struct SoundIoDevice *device = outstream->device;
 
     if (device->aim != SoundIoDeviceAimOutput)
         return SoundIoErrorInvalid;
 
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)device->soundio;
+    if (outstream->poll_mode && !si->outstream_process)
+        return SoundIoErrorIncompatibleBackend;
+
+    soundio_device_probe(device);
     if (device->probe_error)
         return device->probe_error;
 
@@ -509,13 +748,58 @@ int soundio_outstream_open(struct SoundIoOutStream *outstream) {
     if (!outstream->sample_rate)
         outstream->sample_rate = soundio_device_nearest_sample_rate(device, 48000);
 
+    if (outstream->write_sample_rate < 0)
+        return SoundIoErrorInvalid;
+    if (!outstream->write_sample_rate)
+        outstream->write_sample_rate = outstream->sample_rate;
+
+    if (outstream->write_layout.channel_count < 0 ||
+        outstream->write_layout.channel_count > SOUNDIO_MAX_CHANNELS)
+    {
+        return SoundIoErrorInvalid;
+    }
+    if (!outstream->write_layout.channel_count)
+        outstream->write_layout = outstream->layout;
+
+    const struct SoundIoXrunPolicy *policy = &outstream->xrun_policy;
+    if (policy->prefill < 0.0 || policy->latency_step < 0.0 || policy->latency_max < 0.0 ||
+        policy->grow_xrun_count < 0 || policy->grow_xrun_count > SOUNDIO_XRUN_POLICY_HISTORY ||
+        policy->grow_window < 0.0 || policy->shrink_after < 0.0)
+    {
+        return SoundIoErrorInvalid;
+    }
+
     struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate *)outstream;
     outstream->bytes_per_frame = soundio_get_bytes_per_frame(outstream->format, outstream->layout.channel_count);
     outstream->bytes_per_sample = soundio_get_bytes_per_sample(outstream->format);
+    outstream->buffer_access = SoundIoBufferAccessUnknown;
+    soundio_stream_stats_init(&os->stats);
+    soundio_timestamp_filter_init(&os->timestamps);
+    soundio_xrun_tracker_init(&os->xrun_tracker);
+    os->frames_committed = 0;
+    return 0;
+}
 
-    struct SoundIo *soundio = device->soundio;
-    struct SoundIoPrivate *si = (struct SoundIoPrivate *)soundio;
-    return si->outstream_open(si, os);
+int soundio_outstream_open(struct SoundIoOutStream *outstream) {
+    int err;
+    if ((err = outstream_prepare(outstream)))
+        return err;
+
+    struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate *)outstream;
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)outstream->device->soundio;
+    return outstream_open_backend(si, os);
+}
+
+int soundio_outstream_open_async(struct SoundIoOutStream *outstream) {
+    struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate *)outstream;
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)outstream->device->soundio;
+    if (os->async_call.op != SoundIoAsyncOpNone)
+        return SoundIoErrorInvalid;
+
+    int err;
+    if ((err = outstream_prepare(outstream)))
+        return err;
+    return async_call_begin(si, &os->async_call, SoundIoAsyncOpOpen);
 }
 
 void soundio_outstream_destroy(struct SoundIoOutStream *outstream) {
@@ -526,8 +810,13 @@ void soundio_outstream_destroy(struct SoundIoOutStream *outstream) {
     struct SoundIo *soundio = outstream->device->soundio;
     struct SoundIoPrivate *si = (struct SoundIoPrivate *)soundio;
 
+    async_call_cancel(si, &os->async_call);
+    if (os->group)
+        soundio_stream_group_remove_outstream(os->group, os);
+
     if (si->outstream_destroy)
         si->outstream_destroy(si, os);
+    soundio_outstream_resample_destroy(os);
 
     soundio_device_unref(outstream->device);
     free(os);
@@ -540,6 +829,50 @@ int soundio_outstream_start(struct SoundIoOutStream *outstream) {
     return si->outstream_start(si, os);
 }
 
+int soundio_outstream_start_async(struct SoundIoOutStream *outstream) {
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)outstream->device->soundio;
+    struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate *)outstream;
+    return async_call_begin(si, &os->async_call, SoundIoAsyncOpStart);
+}
+
+void soundio_outstream_xrun_policy_start(struct SoundIoOutStreamPrivate *os,
+        double latency, double latency_max, double now)
+{
+    soundio_xrun_tracker_start(&os->xrun_tracker, &os->pub.xrun_policy, latency, latency_max, now);
+}
+
+void soundio_outstream_xrun_policy_xrun(struct SoundIoOutStreamPrivate *os, double now) {
+    struct SoundIoOutStream *outstream = &os->pub;
+    if (soundio_xrun_tracker_xrun(&os->xrun_tracker, now) && outstream->latency_callback)
+        outstream->latency_callback(outstream, os->xrun_tracker.latency);
+}
+
+void soundio_outstream_xrun_policy_tick(struct SoundIoOutStreamPrivate *os, double now) {
+    struct SoundIoOutStream *outstream = &os->pub;
+    if (soundio_xrun_tracker_tick(&os->xrun_tracker, now) && outstream->latency_callback)
+        outstream->latency_callback(outstream, os->xrun_tracker.latency);
+}
+
+int soundio_outstream_get_poll_descriptors(struct SoundIoOutStream *outstream,
+        struct SoundIoPollDescriptor *descriptors, int *count)
+{
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)outstream->device->soundio;
+    struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate *)outstream;
+    if (!outstream->poll_mode || !si->outstream_get_poll_descriptors)
+        return SoundIoErrorInvalid;
+    return si->outstream_get_poll_descriptors(si, os, descriptors, count);
+}
+
+int soundio_outstream_process(struct SoundIoOutStream *outstream,
+        const struct SoundIoPollDescriptor *descriptors, int count)
+{
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)outstream->device->soundio;
+    struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate *)outstream;
+    if (!outstream->poll_mode || !si->outstream_process || count < 0)
+        return SoundIoErrorInvalid;
+    return si->outstream_process(si, os, descriptors, count);
+}
+
 int soundio_outstream_pause(struct SoundIoOutStream *outstream, bool pause) {
     struct SoundIo *soundio = outstream->device->soundio;
     struct SoundIoPrivate *si = (struct SoundIoPrivate *)soundio;
@@ -558,7 +891,55 @@ int soundio_outstream_get_latency(struct SoundIoOutStream *outstream, double *ou
     struct SoundIo *soundio = outstream->device->soundio;
     struct SoundIoPrivate *si = (struct SoundIoPrivate *)soundio;
     struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate *)outstream;
-    return si->outstream_get_latency(si, os, out_latency);
+    int err;
+    if ((err = si->outstream_get_latency(si, os, out_latency)))
+        return err;
+    if (os->resample)
+        *out_latency += soundio_outstream_resample_get_delay(os);
+    return 0;
+}
+
+// Copies the filtered timestamp, moved forward to frame 0 if it lies before
+// the start of the stream.
+static void get_filtered_position(const struct SoundIoTimestampFilter *filter,
+        struct SoundIoStreamPosition *position)
+{
+    position->frame = filter->frame;
+    position->time = filter->time;
+    position->rate = 1.0 / filter->frame_duration;
+    if (position->frame < 0) {
+        position->time -= position->frame * filter->frame_duration;
+        position->frame = 0;
+    }
+}
+
+void soundio_outstream_report_timestamp(struct SoundIoOutStreamPrivate *os,
+        double time, double delay)
+{
+    struct SoundIoOutStream *outstream = &os->pub;
+    if (os->resample)
+        delay += soundio_outstream_resample_get_delay(os);
+    int64_t frame = os->frames_committed - (int64_t)(delay * outstream->write_sample_rate + 0.5);
+    soundio_timestamp_filter_update(&os->timestamps, frame, time, outstream->write_sample_rate);
+}
+
+int soundio_outstream_get_position(struct SoundIoOutStream *outstream,
+        struct SoundIoStreamPosition *position)
+{
+    struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate *)outstream;
+    if (os->timestamps.valid) {
+        get_filtered_position(&os->timestamps, position);
+        return 0;
+    }
+    double latency;
+    int err;
+    if ((err = soundio_outstream_get_latency(outstream, &latency)))
+        return err;
+    position->time = soundio_os_get_time();
+    int64_t frame = os->frames_committed - (int64_t)(latency * outstream->write_sample_rate + 0.5);
+    position->frame = frame > 0 ? frame : 0;
+    position->rate = outstream->write_sample_rate;
+    return 0;
 }
 
 int soundio_outstream_set_volume(struct SoundIoOutStream *outstream, double volume) {
@@ -585,6 +966,7 @@ struct SoundIoInStream *soundio_instream_create(struct SoundIoDevice *device) {
 
     instream->device = device;
     soundio_device_ref(device);
+    is->async_call.is = is;
 
     instream->error_callback = default_instream_error_callback;
     instream->overflow_callback = default_overflow_callback;
@@ -592,17 +974,23 @@ struct SoundIoInStream *soundio_instream_create(struct SoundIoDevice *device) {
     return instream;
 }
 
-int soundio_instream_open(struct SoundIoInStream *instream) {
+// Checks the parameters and fills in the defaults.
+static int instream_prepare(struct SoundIoInStream *instream) {
     struct SoundIoDevice *device = instream->device;
     if (device->aim != SoundIoDeviceAimInput)
         return SoundIoErrorInvalid;
 
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)device->soundio;
+    if (instream->poll_mode && !si->instream_process)
+        return SoundIoErrorIncompatibleBackend;
+
     if (instream->format <= SoundIoFormatInvalid)
         return SoundIoErrorInvalid;
 
     if (instream->layout.channel_count > SOUNDIO_MAX_CHANNELS)
         return SoundIoErrorInvalid;
 
+    soundio_device_probe(device);
     if (device->probe_error)
         return device->probe_error;
 
@@ -622,12 +1010,36 @@ int soundio_instream_open(struct SoundIoInStream *instream) {
 
     instream->bytes_per_frame = soundio_get_bytes_per_frame(instream->format, instream->layout.channel_count);
     instream->bytes_per_sample = soundio_get_bytes_per_sample(instream->format);
-    struct SoundIo *soundio = device->soundio;
-    struct SoundIoPrivate *si = (struct SoundIoPrivate *)soundio;
+    instream->buffer_access = SoundIoBufferAccessUnknown;
     struct SoundIoInStreamPrivate *is = (struct SoundIoInStreamPrivate *)instream;
+    soundio_stream_stats_init(&is->stats);
+    soundio_timestamp_filter_init(&is->timestamps);
+    is->frames_committed = 0;
+    return 0;
+}
+
+int soundio_instream_open(struct SoundIoInStream *instream) {
+    int err;
+    if ((err = instream_prepare(instream)))
+        return err;
+
+    struct SoundIoInStreamPrivate *is = (struct SoundIoInStreamPrivate *)instream;
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)instream->device->soundio;
     return si->instream_open(si, is);
 }
 
+int soundio_instream_open_async(struct SoundIoInStream *instream) {
+    struct SoundIoInStreamPrivate *is = (struct SoundIoInStreamPrivate *)instream;
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)instream->device->soundio;
+    if (is->async_call.op != SoundIoAsyncOpNone)
+        return SoundIoErrorInvalid;
+
+    int err;
+    if ((err = instream_prepare(instream)))
+        return err;
+    return async_call_begin(si, &is->async_call, SoundIoAsyncOpOpen);
+}
+
 int soundio_instream_start(struct SoundIoInStream *instream) {
     struct SoundIo *soundio = instream->device->soundio;
     struct SoundIoPrivate *si = (struct SoundIoPrivate *)soundio;
@@ -635,6 +1047,12 @@ int soundio_instream_start(struct SoundIoInStream *instream) {
     return si->instream_start(si, is);
 }
 
+int soundio_instream_start_async(struct SoundIoInStream *instream) {
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)instream->device->soundio;
+    struct SoundIoInStreamPrivate *is = (struct SoundIoInStreamPrivate *)instream;
+    return async_call_begin(si, &is->async_call, SoundIoAsyncOpStart);
+}
+
 void soundio_instream_destroy(struct SoundIoInStream *instream) {
     if (!instream)
         return;
@@ -643,6 +1061,10 @@ void soundio_instream_destroy(struct SoundIoInStream *instream) {
     struct SoundIo *soundio = instream->device->soundio;
     struct SoundIoPrivate *si = (struct SoundIoPrivate *)soundio;
 
+    async_call_cancel(si, &is->async_call);
+    if (is->group)
+        soundio_stream_group_remove_instream(is->group, is);
+
     if (si->instream_destroy)
         si->instream_destroy(si, is);
 
@@ -663,14 +1085,71 @@ int soundio_instream_begin_read(struct SoundIoInStream *instream,
     struct SoundIo *soundio = instream->device->soundio;
     struct SoundIoPrivate *si = (struct SoundIoPrivate *)soundio;
     struct SoundIoInStreamPrivate *is = (struct SoundIoInStreamPrivate *)instream;
-    return si->instream_begin_read(si, is, areas, frame_count);
+    soundio_stream_stats_io_begin(&is->stats);
+    int err = si->instream_begin_read(si, is, areas, frame_count);
+    soundio_stream_stats_io_end(&is->stats);
+    is->read_frame_count = err ? 0 : *frame_count;
+    return err;
 }
 
 int soundio_instream_end_read(struct SoundIoInStream *instream) {
     struct SoundIo *soundio = instream->device->soundio;
     struct SoundIoPrivate *si = (struct SoundIoPrivate *)soundio;
     struct SoundIoInStreamPrivate *is = (struct SoundIoInStreamPrivate *)instream;
-    return si->instream_end_read(si, is);
+    soundio_stream_stats_io_begin(&is->stats);
+    int err = si->instream_end_read(si, is);
+    soundio_stream_stats_io_end(&is->stats);
+    if (!err)
+        is->frames_committed += is->read_frame_count;
+    is->read_frame_count = 0;
+    return err;
+}
+
+int soundio_instream_thread_create(struct SoundIoInStreamPrivate *is,
+        void (*run)(void *arg), double period, struct SoundIoOsThread **out_thread)
+{
+    struct SoundIo *soundio = is->pub.device->soundio;
+    struct SoundIoThreadSettings settings;
+    resolve_thread_settings(soundio, &is->pub.thread_settings, period, &settings);
+    int err;
+    if ((err = soundio_os_thread_create(run, is, &settings, soundio->lock_memory,
+                    soundio->emit_rtprio_warning, out_thread)))
+        return err;
+    soundio_os_thread_get_settings(*out_thread, &is->thread_settings);
+    is->has_thread = true;
+    return 0;
+}
+
+int soundio_instream_get_thread_settings(struct SoundIoInStream *instream,
+        struct SoundIoThreadSettings *settings)
+{
+    struct SoundIoInStreamPrivate *is = (struct SoundIoInStreamPrivate *)instream;
+    return get_thread_settings(instream->device->soundio, is->has_thread, &is->thread_settings, settings);
+}
+
+int soundio_instream_get_poll_descriptors(struct SoundIoInStream *instream,
+        struct SoundIoPollDescriptor *descriptors, int *count)
+{
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)instream->device->soundio;
+    struct SoundIoInStreamPrivate *is = (struct SoundIoInStreamPrivate *)instream;
+    if (!instream->poll_mode || !si->instream_get_poll_descriptors)
+        return SoundIoErrorInvalid;
+    return si->instream_get_poll_descriptors(si, is, descriptors, count);
+}
+
+int soundio_instream_process(struct SoundIoInStream *instream,
+        const struct SoundIoPollDescriptor *descriptors, int count)
+{
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)instream->device->soundio;
+    struct SoundIoInStreamPrivate *is = (struct SoundIoInStreamPrivate *)instream;
+    if (!instream->poll_mode || !si->instream_process || count < 0)
+        return SoundIoErrorInvalid;
+    return si->instream_process(si, is, descriptors, count);
+}
+
+void soundio_instream_get_stats(struct SoundIoInStream *instream, struct SoundIoStreamStats *stats) {
+    struct SoundIoInStreamPrivate *is = (struct SoundIoInStreamPrivate *)instream;
+    soundio_stream_stats_read(&is->stats, stats);
 }
 
 int soundio_instream_get_latency(struct SoundIoInStream *instream, double *out_latency) {
@@ -680,6 +1159,317 @@ int soundio_instream_get_latency(struct SoundIoInStream *instream, double *out_l
     return si->instream_get_latency(si, is, out_latency);
 }
 
+void soundio_instream_report_timestamp(struct SoundIoInStreamPrivate *is,
+        double time, double delay)
+{
+    struct SoundIoInStream *instream = &is->pub;
+    int64_t frame = is->frames_committed + (int64_t)(delay * instream->sample_rate + 0.5);
+    soundio_timestamp_filter_update(&is->timestamps, frame, time, instream->sample_rate);
+}
+
+int soundio_instream_get_position(struct SoundIoInStream *instream,
+        struct SoundIoStreamPosition *position)
+{
+    struct SoundIoInStreamPrivate *is = (struct SoundIoInStreamPrivate *)instream;
+    if (is->timestamps.valid) {
+        get_filtered_position(&is->timestamps, position);
+        return 0;
+    }
+    double latency;
+    int err;
+    if ((err = soundio_instream_get_latency(instream, &latency)))
+        return err;
+    position->time = soundio_os_get_time();
+    position->frame = is->frames_committed + (int64_t)(latency * instream->sample_rate + 0.5);
+    position->rate = instream->sample_rate;
+    return 0;
+}
+
+struct SoundIoDevicesInfo *soundio_devices_info_create(struct SoundIo *soundio) {
+    struct SoundIoDevicesInfo *devices_info = ALLOCATE(struct SoundIoDevicesInfo, 1);
+    if (!devices_info)
+        return NULL;
+    devices_info->arena = soundio_arena_create(&soundio->device_allocator);
+    if (!devices_info->arena) {
+        free(devices_info);
+        return NULL;
+    }
+    return devices_info;
+}
+
+struct SoundIoDevicePrivate *soundio_device_create(struct SoundIoDevicesInfo *devices_info) {
+    struct SoundIoDevicePrivate *dev;
+    if (devices_info) {
+        dev = (struct SoundIoDevicePrivate *)soundio_arena_alloc(devices_info->arena,
+                sizeof(struct SoundIoDevicePrivate));
+        if (!dev)
+            return NULL;
+        soundio_arena_ref(devices_info->arena);
+        dev->arena = devices_info->arena;
+    } else {
+        dev = ALLOCATE(struct SoundIoDevicePrivate, 1);
+        if (!dev)
+            return NULL;
+    }
+    dev->pub.ref_count = 1;
+    return dev;
+}
+
+void *soundio_device_alloc(struct SoundIoDevicePrivate *dev, size_t size) {
+    if (dev->arena)
+        return soundio_arena_alloc(dev->arena, size);
+    return calloc(1, size);
+}
+
+char *soundio_device_str_dupe(struct SoundIoDevicePrivate *dev, const char *str, int str_len) {
+    char *out = DEVICE_ALLOCATE(dev, char, str_len + 1);
+    if (!out)
+        return NULL;
+    memcpy(out, str, str_len);
+    return out;
+}
+
+char *soundio_device_strdup(struct SoundIoDevicePrivate *dev, const char *str) {
+    return soundio_device_str_dupe(dev, str, strlen(str));
+}
+
+char *soundio_device_sprintf(struct SoundIoDevicePrivate *dev, const char *format, ...) {
+    va_list ap, ap2;
+    va_start(ap, format);
+    va_copy(ap2, ap);
+
+    int len = vsnprintf(NULL, 0, format, ap);
+    assert(len >= 0);
+    char *out = DEVICE_ALLOCATE(dev, char, len + 1);
+    if (out)
+        vsnprintf(out, len + 1, format, ap2);
+
+    va_end(ap2);
+    va_end(ap);
+    return out;
+}
+
+// Whether everything an application can see of the two devices is the same.
+static bool device_properties_equal(const struct SoundIoDevice *a, const struct SoundIoDevice *b) {
+    if (a == b)
+        return true;
+    if (strcmp(a->name, b->name) != 0 ||
+        a->probe_error != b->probe_error ||
+        a->current_format != b->current_format ||
+        a->sample_rate_current != b->sample_rate_current ||
+        a->software_latency_min != b->software_latency_min ||
+        a->software_latency_max != b->software_latency_max ||
+        a->software_latency_current != b->software_latency_current ||
+        a->format_count != b->format_count ||
+        a->layout_count != b->layout_count ||
+        a->sample_rate_count != b->sample_rate_count ||
+        !soundio_channel_layout_equal(&a->current_layout, &b->current_layout))
+    {
+        return false;
+    }
+    if (a->format_count > 0 &&
+        memcmp(a->formats, b->formats, a->format_count * sizeof(enum SoundIoFormat)) != 0)
+    {
+        return false;
+    }
+    if (a->sample_rate_count > 0 &&
+        memcmp(a->sample_rates, b->sample_rates,
+            a->sample_rate_count * sizeof(struct SoundIoSampleRateRange)) != 0)
+    {
+        return false;
+    }
+    for (int i = 0; i < a->layout_count; i += 1) {
+        if (!soundio_channel_layout_equal(&a->layouts[i], &b->layouts[i]))
+            return false;
+    }
+    return true;
+}
+
+static int find_device(struct SoundIoListDevicePtr *devices, const struct SoundIoDevice *device) {
+    for (int i = 0; i < devices->length; i += 1) {
+        if (soundio_device_equal(SoundIoListDevicePtr_val_at(devices, i), device))
+            return i;
+    }
+    return -1;
+}
+
+static int add_device_change(struct SoundIoListDeviceChange *changes,
+        enum SoundIoDeviceChangeType type, enum SoundIoDeviceAim aim,
+        const struct SoundIoDevice *device, int index)
+{
+    int err;
+    if ((err = SoundIoListDeviceChange_add_one(changes)))
+        return err;
+    struct SoundIoDeviceChange *change = SoundIoListDeviceChange_last_ptr(changes);
+    change->type = type;
+    change->aim = aim;
+    change->id = device ? device->id : NULL;
+    change->is_raw = device ? device->is_raw : false;
+    change->index = index;
+    return 0;
+}
+
+static int diff_device_lists(struct SoundIoListDeviceChange *changes, enum SoundIoDeviceAim aim,
+        struct SoundIoListDevicePtr *old_devices, struct SoundIoListDevicePtr *new_devices)
+{
+    int err;
+    for (int i = 0; i < old_devices->length; i += 1) {
+        struct SoundIoDevice *device = SoundIoListDevicePtr_val_at(old_devices, i);
+        if (find_device(new_devices, device) < 0) {
+            if ((err = add_device_change(changes, SoundIoDeviceChangeRemoved, aim, device, i)))
+                return err;
+        }
+    }
+    for (int i = 0; i < new_devices->length; i += 1) {
+        struct SoundIoDevice *device = SoundIoListDevicePtr_val_at(new_devices, i);
+        int old_index = find_device(old_devices, device);
+        enum SoundIoDeviceChangeType type;
+        if (old_index < 0) {
+            type = SoundIoDeviceChangeAdded;
+        } else if (!device_properties_equal(SoundIoListDevicePtr_val_at(old_devices, old_index), device)) {
+            type = SoundIoDeviceChangeUpdated;
+        } else {
+            continue;
+        }
+        if ((err = add_device_change(changes, type, aim, device, i)))
+            return err;
+    }
+    return 0;
+}
+
+static struct SoundIoDevice *default_device(struct SoundIoListDevicePtr *devices, int index) {
+    return (index >= 0 && index < devices->length) ? SoundIoListDevicePtr_val_at(devices, index) : NULL;
+}
+
+static int diff_default_device(struct SoundIoListDeviceChange *changes, enum SoundIoDeviceAim aim,
+        struct SoundIoListDevicePtr *old_devices, int old_index,
+        struct SoundIoListDevicePtr *new_devices, int new_index)
+{
+    struct SoundIoDevice *old_device = default_device(old_devices, old_index);
+    struct SoundIoDevice *new_device = default_device(new_devices, new_index);
+    if (!old_device && !new_device)
+        return 0;
+    if (old_device && new_device && soundio_device_equal(old_device, new_device))
+        return 0;
+    return add_device_change(changes, SoundIoDeviceChangeDefault, aim, new_device,
+            new_device ? new_index : -1);
+}
+
+static int diff_devices_info(struct SoundIoListDeviceChange *changes,
+        struct SoundIoDevicesInfo *old_info, struct SoundIoDevicesInfo *new_info)
+{
+    static struct SoundIoDevicesInfo empty_info = { .default_input_index = -1, .default_output_index = -1 };
+    if (!old_info)
+        old_info = &empty_info;
+    if (!new_info)
+        new_info = &empty_info;
+
+    int err;
+    if ((err = diff_device_lists(changes, SoundIoDeviceAimInput,
+                    &old_info->input_devices, &new_info->input_devices)))
+    {
+        return err;
+    }
+    if ((err = diff_device_lists(changes, SoundIoDeviceAimOutput,
+                    &old_info->output_devices, &new_info->output_devices)))
+    {
+        return err;
+    }
+    if ((err = diff_default_device(changes, SoundIoDeviceAimInput,
+                    &old_info->input_devices, old_info->default_input_index,
+                    &new_info->input_devices, new_info->default_input_index)))
+    {
+        return err;
+    }
+    return diff_default_device(changes, SoundIoDeviceAimOutput,
+            &old_info->output_devices, old_info->default_output_index,
+            &new_info->output_devices, new_info->default_output_index);
+}
+
+void soundio_emit_devices_change(struct SoundIoPrivate *si,
+        struct SoundIoDevicesInfo *old_devices_info)
+{
+    struct SoundIo *soundio = &si->pub;
+    if (!si->devices_change_emitted) {
+        // the backend may have made a list before the first flush
+        old_devices_info = NULL;
+        si->devices_change_emitted = true;
+    }
+    if (soundio->on_device_changes) {
+        SoundIoListDeviceChange_clear(&si->device_changes);
+        if (!diff_devices_info(&si->device_changes, old_devices_info, si->safe_devices_info) &&
+            si->device_changes.length > 0)
+        {
+            soundio->on_device_changes(soundio, si->device_changes.items, si->device_changes.length);
+        }
+    }
+    soundio->on_devices_change(soundio);
+}
+
+static void events_signal(struct SoundIoPrivate *si) {
+    soundio_os_event_signal(si->events_event);
+    si->pub.on_events_signal(&si->pub);
+}
+
+void soundio_events_post_devices_info(struct SoundIoPrivate *si,
+        struct SoundIoDevicesInfo *devices_info)
+{
+    // the list it replaces was never seen by the application
+    soundio_destroy_devices_info((struct SoundIoDevicesInfo *)
+            SOUNDIO_ATOMIC_EXCHANGE(si->posted_devices_info, devices_info));
+    events_signal(si);
+}
+
+void soundio_events_post_error(struct SoundIoPrivate *si, int err) {
+    assert(err);
+    SOUNDIO_ATOMIC_STORE(si->posted_error, err);
+    events_signal(si);
+}
+
+// The signal has been taken, so whatever was posted before it is here now.
+static void events_dispatch(struct SoundIoPrivate *si) {
+    struct SoundIo *soundio = &si->pub;
+    struct SoundIoDevicesInfo *devices_info;
+    int err;
+    for (;;) {
+        devices_info = (struct SoundIoDevicesInfo *)SOUNDIO_ATOMIC_EXCHANGE(si->posted_devices_info, NULL);
+        if (devices_info)
+            si->have_devices = true;
+        err = SOUNDIO_ATOMIC_LOAD(si->posted_error);
+        if (si->have_devices || err)
+            break;
+        soundio_os_event_wait(si->events_event);
+    }
+
+    if (err) {
+        // nothing is reported after the disconnect
+        soundio_destroy_devices_info(devices_info);
+        if (!si->emitted_disconnect) {
+            si->emitted_disconnect = true;
+            soundio->on_backend_disconnect(soundio, err);
+        }
+    } else if (devices_info) {
+        struct SoundIoDevicesInfo *old_devices_info = si->safe_devices_info;
+        si->safe_devices_info = devices_info;
+        soundio_emit_devices_change(si, old_devices_info);
+        soundio_destroy_devices_info(old_devices_info);
+    }
+}
+
+void soundio_events_flush(struct SoundIoPrivate *si) {
+    soundio_os_event_reset(si->events_event);
+    events_dispatch(si);
+}
+
+void soundio_events_wait(struct SoundIoPrivate *si) {
+    soundio_os_event_wait(si->events_event);
+    events_dispatch(si);
+}
+
+void soundio_events_wakeup(struct SoundIoPrivate *si) {
+    soundio_os_event_signal(si->events_event);
+}
+
 void soundio_destroy_devices_info(struct SoundIoDevicesInfo *devices_info) {
     if (!devices_info)
         return;
@@ -691,6 +1481,7 @@ void soundio_destroy_devices_info(struct SoundIoDevicesInfo *devices_info) {
 
     SoundIoListDevicePtr_deinit(&devices_info->input_devices);
     SoundIoListDevicePtr_deinit(&devices_info->output_devices);
+    soundio_arena_unref(devices_info->arena);
 
     free(devices_info);
 }
@@ -750,11 +1541,38 @@ void soundio_sort_channel_layouts(struct SoundIoChannelLayout *layouts, int layo
     qsort(layouts, layouts_count, sizeof(struct SoundIoChannelLayout), compare_layouts);
 }
 
+bool soundio_device_is_probed(const struct SoundIoDevice *device) {
+    const struct SoundIoDevicePrivate *dev = (const struct SoundIoDevicePrivate *)device;
+    return !dev->needs_probe;
+}
+
+int soundio_device_probe(struct SoundIoDevice *device) {
+    struct SoundIoDevicePrivate *dev = (struct SoundIoDevicePrivate *)device;
+    if (!dev->needs_probe)
+        return device->probe_error;
+
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)device->soundio;
+    if (!si->device_probe)
+        return SoundIoErrorBackendDisconnected;
+
+    dev->needs_probe = false;
+    device->probe_error = si->device_probe(si, dev);
+    return device->probe_error;
+}
+
+// The convenience functions below probe lazily enumerated devices on first
+// use. Such devices have empty capability lists until then, so the lists
+// being non-empty means there is nothing to do.
+
 void soundio_device_sort_channel_layouts(struct SoundIoDevice *device) {
+    if (device->layout_count == 0)
+        soundio_device_probe(device);
     soundio_sort_channel_layouts(device->layouts, device->layout_count);
 }
 
 bool soundio_device_supports_format(struct SoundIoDevice *device, enum SoundIoFormat format) {
+    if (device->format_count == 0)
+        soundio_device_probe(device);
     for (int i = 0; i < device->format_count; i += 1) {
         if (device->formats[i] == format)
             return true;
@@ -765,6 +1583,8 @@ bool soundio_device_supports_format(struct SoundIoDevice *device, enum SoundIoFo
 bool soundio_device_supports_layout(struct SoundIoDevice *device,
         const struct SoundIoChannelLayout *layout)
 {
+    if (device->layout_count == 0)
+        soundio_device_probe(device);
     for (int i = 0; i < device->layout_count; i += 1) {
         if (soundio_channel_layout_equal(&device->layouts[i], layout))
             return true;
@@ -773,6 +1593,8 @@ bool soundio_device_supports_layout(struct SoundIoDevice *device,
 }
 
 bool soundio_device_supports_sample_rate(struct SoundIoDevice *device, int sample_rate) {
+    if (device->sample_rate_count == 0)
+        soundio_device_probe(device);
     for (int i = 0; i < device->sample_rate_count; i += 1) {
         struct SoundIoSampleRateRange *range = &device->sample_rates[i];
         if (sample_rate >= range->min && sample_rate <= range->max)
@@ -787,6 +1609,8 @@ static int abs_diff_int(int a, int b) {
 }
 
 int soundio_device_nearest_sample_rate(struct SoundIoDevice *device, int sample_rate) {
+    if (device->sample_rate_count == 0)
+        soundio_device_probe(device);
     int best_rate = -1;
     int best_delta = -1;
     for (int i = 0; i < device->sample_rate_count; i += 1) {
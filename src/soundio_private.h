@@ -11,6 +11,12 @@
 #include "soundio_internal.h"
 #include "config.h"
 #include "list.h"
+#include "arena.h"
+#include "util.h"
+#include "stream_stats.h"
+#include "timestamp_filter.h"
+#include "xrun_policy.h"
+#include "resample.h"
 
 #ifdef SOUNDIO_HAVE_JACK
 #include "jack.h"
@@ -119,29 +125,212 @@ struct SoundIoDevicesInfo {
     // can be -1 when default device is unknown
     int default_output_index;
     int default_input_index;
+    // The devices created with soundio_device_create come from here.
+    struct SoundIoArena *arena;
+};
+
+enum SoundIoAsyncOp {
+    SoundIoAsyncOpNone,
+    SoundIoAsyncOpOpen,
+    SoundIoAsyncOpStart,
+};
+
+// An open or start of a stream running on its own thread. Only `done` and
+// `err` are written by that thread; the rest belongs to the application
+// thread, which reports the result from soundio_flush_events.
+struct SoundIoAsyncCall {
+    enum SoundIoAsyncOp op;
+    // exactly one of them is set
+    struct SoundIoOutStreamPrivate *os;
+    struct SoundIoInStreamPrivate *is;
+    struct SoundIoOsThread *thread;
+    int err;
+    struct SoundIoAtomicBool done;
 };
 
 struct SoundIoOutStreamPrivate {
     struct SoundIoOutStream pub;
     union SoundIoOutStreamBackendData backend_data;
+    struct SoundIoStreamStatsRecorder stats;
+    bool has_thread;
+    struct SoundIoThreadSettings thread_settings;
+    struct SoundIoAsyncCall async_call;
+    // Frames passed to soundio_outstream_end_write so far, and the count
+    // from the soundio_outstream_begin_write before it.
+    int64_t frames_committed;
+    int write_frame_count;
+    // Filled by backends which can timestamp their callbacks; see
+    // soundio_outstream_report_timestamp.
+    struct SoundIoTimestampFilter timestamps;
+    // SoundIoOutStream::xrun_policy, for backends which start it with
+    // soundio_outstream_xrun_policy_start.
+    struct SoundIoXrunTracker xrun_tracker;
+    // Set by soundio_stream_group_start before the stream is started. The
+    // device must not start before this soundio_os_get_time; 0 means right
+    // away.
+    double start_deadline;
+    struct SoundIoStreamGroup *group;
+    // When SoundIoOutStream::write_sample_rate differs from sample_rate.
+    struct SoundIoOutStreamResample *resample;
+    // The duplex stream this stream belongs to, if any. When the backend
+    // drives it, duplex_input is its input, which the backend reads on this
+    // stream's thread right before each write callback.
+    struct SoundIoDuplexStreamPrivate *duplex;
+    struct SoundIoInStreamPrivate *duplex_input;
+    // The mixer this stream plays, if any.
+    struct SoundIoMixerPrivate *mixer;
 };
 
 struct SoundIoInStreamPrivate {
     struct SoundIoInStream pub;
     union SoundIoInStreamBackendData backend_data;
+    struct SoundIoStreamStatsRecorder stats;
+    bool has_thread;
+    struct SoundIoThreadSettings thread_settings;
+    struct SoundIoAsyncCall async_call;
+    // See SoundIoOutStreamPrivate.
+    int64_t frames_committed;
+    int read_frame_count;
+    struct SoundIoTimestampFilter timestamps;
+    double start_deadline;
+    struct SoundIoStreamGroup *group;
+    // See SoundIoOutStreamPrivate. When duplex_output is set the stream has
+    // no thread of its own; duplex_output's thread reads it.
+    struct SoundIoDuplexStreamPrivate *duplex;
+    struct SoundIoOutStreamPrivate *duplex_output;
 };
 
+// Backends create the thread which runs the callbacks of a stream with these,
+// so that it is scheduled the way the stream asks. `period` is the time
+// between wakeups in seconds, which SCHED_DEADLINE defaults are based on.
+int soundio_outstream_thread_create(struct SoundIoOutStreamPrivate *os,
+        void (*run)(void *arg), double period, struct SoundIoOsThread **out_thread);
+int soundio_instream_thread_create(struct SoundIoInStreamPrivate *is,
+        void (*run)(void *arg), double period, struct SoundIoOsThread **out_thread);
+
+// Backends which can tell when the device was where call this right before
+// each write callback, so that soundio_outstream_get_position needs no
+// backend call: at `time`, in soundio_os_get_time, the device still had
+// `delay` seconds to play of what was written before the callback.
+void soundio_outstream_report_timestamp(struct SoundIoOutStreamPrivate *os,
+        double time, double delay);
+// Likewise for input: at `time` the device had captured `delay` seconds
+// beyond what was read before the callback.
+void soundio_instream_report_timestamp(struct SoundIoInStreamPrivate *is,
+        double time, double delay);
+
+// Backends which can change how much they keep queued while the stream runs
+// call this when they open or start the stream: the latency starts at
+// `latency` seconds and may grow to `latency_max`. They then call the other
+// two with the time of the clock they run the stream by, after each underflow
+// and at each wakeup, and keep SoundIoOutStreamPrivate::xrun_tracker.latency
+// queued.
+// SoundIoOutStream::latency_callback is called when it changes.
+void soundio_outstream_xrun_policy_start(struct SoundIoOutStreamPrivate *os,
+        double latency, double latency_max, double now);
+void soundio_outstream_xrun_policy_xrun(struct SoundIoOutStreamPrivate *os, double now);
+void soundio_outstream_xrun_policy_tick(struct SoundIoOutStreamPrivate *os, double now);
+
+// Backends invoke the stream callbacks through these so that the stream
+// statistics see every call.
+static inline void soundio_outstream_run_write_callback(struct SoundIoOutStreamPrivate *os,
+        int frame_count_min, int frame_count_max)
+{
+    soundio_stream_stats_callback_begin(&os->stats, frame_count_max);
+    if (os->resample)
+        soundio_outstream_resample_write_callback(os, frame_count_min, frame_count_max);
+    else
+        os->pub.write_callback(&os->pub, frame_count_min, frame_count_max);
+    soundio_stream_stats_callback_end(&os->stats);
+}
+
+// For backends whose buffers are planar float32 already, which pass them to
+// SoundIoOutStream::write_planar_callback instead.
+static inline void soundio_outstream_run_write_planar_callback(struct SoundIoOutStreamPrivate *os,
+        float *const *buffers, int frame_count)
+{
+    soundio_stream_stats_callback_begin(&os->stats, frame_count);
+    os->pub.write_planar_callback(&os->pub, buffers, frame_count);
+    soundio_stream_stats_callback_end(&os->stats);
+    os->frames_committed += frame_count;
+}
+
+static inline void soundio_outstream_run_underflow_callback(struct SoundIoOutStreamPrivate *os) {
+    soundio_stream_stats_xrun(&os->stats);
+    os->pub.underflow_callback(&os->pub);
+}
+
+static inline void soundio_instream_run_read_callback(struct SoundIoInStreamPrivate *is,
+        int frame_count_min, int frame_count_max)
+{
+    soundio_stream_stats_callback_begin(&is->stats, frame_count_max);
+    is->pub.read_callback(&is->pub, frame_count_min, frame_count_max);
+    soundio_stream_stats_callback_end(&is->stats);
+}
+
+static inline void soundio_instream_run_read_planar_callback(struct SoundIoInStreamPrivate *is,
+        const float *const *buffers, int frame_count)
+{
+    soundio_stream_stats_callback_begin(&is->stats, frame_count);
+    is->pub.read_planar_callback(&is->pub, buffers, frame_count);
+    soundio_stream_stats_callback_end(&is->stats);
+    is->frames_committed += frame_count;
+}
+
+static inline void soundio_instream_run_overflow_callback(struct SoundIoInStreamPrivate *is) {
+    soundio_stream_stats_xrun(&is->stats);
+    is->pub.overflow_callback(&is->pub);
+}
+
+struct SoundIoDevicePrivate;
+
+SOUNDIO_MAKE_LIST_STRUCT(struct SoundIoDeviceChange, SoundIoListDeviceChange, SOUNDIO_LIST_STATIC)
+SOUNDIO_MAKE_LIST_STRUCT(struct SoundIoAsyncCall *, SoundIoListAsyncCallPtr, SOUNDIO_LIST_STATIC)
+
 struct SoundIoPrivate {
     struct SoundIo pub;
 
     // Safe to read from a single thread without a mutex.
     struct SoundIoDevicesInfo *safe_devices_info;
+    // Scratch space for soundio_emit_devices_change.
+    struct SoundIoListDeviceChange device_changes;
+    // Whether the application has been told about a device list since
+    // connecting. If not, every device is reported as added.
+    bool devices_change_emitted;
+    // Calls in progress, in the order they were made.
+    struct SoundIoListAsyncCallPtr async_calls;
+    // Whether the backend itself holds back starting the device until
+    // SoundIoOutStreamPrivate::start_deadline, so that the stream can be
+    // started early. Stream groups start the members of other backends
+    // when the deadline arrives instead.
+    bool waits_for_start_deadline;
+    // Whether the backend can read an input stream on the thread of an
+    // output stream, for synchronous duplex streams.
+    bool drives_duplex_input;
+    // For backends whose period can change while a stream runs, the
+    // largest it can become, in frames; otherwise 0. Buffers which another
+    // thread shares and which cannot be resized under it are sized for it.
+    int max_period_frame_count;
+
+    // What backend threads have posted for soundio_flush_events, for
+    // backends which use soundio_events_flush. See
+    // soundio_events_post_devices_info.
+    struct SoundIoAtomicPtr posted_devices_info;
+    struct SoundIoAtomicInt posted_error;
+    struct SoundIoOsEvent *events_event;
+    // Whether a device list has been posted since connecting; until then
+    // soundio_flush_events waits for the first one.
+    bool have_devices;
+    bool emitted_disconnect;
 
     void (*destroy)(struct SoundIoPrivate *);
     void (*flush_events)(struct SoundIoPrivate *);
     void (*wait_events)(struct SoundIoPrivate *);
     void (*wakeup)(struct SoundIoPrivate *);
     void (*force_device_scan)(struct SoundIoPrivate *);
+    // Fills in the capabilities of a device that was enumerated with
+    // SoundIo::lazy_device_probing. Called on the application thread.
+    int (*device_probe)(struct SoundIoPrivate *, struct SoundIoDevicePrivate *);
 
     int (*outstream_open)(struct SoundIoPrivate *, struct SoundIoOutStreamPrivate *);
     void (*outstream_destroy)(struct SoundIoPrivate *, struct SoundIoOutStreamPrivate *);
@@ -153,6 +342,12 @@ struct SoundIoPrivate {
     int (*outstream_pause)(struct SoundIoPrivate *, struct SoundIoOutStreamPrivate *, bool pause);
     int (*outstream_get_latency)(struct SoundIoPrivate *, struct SoundIoOutStreamPrivate *, double *out_latency);
     int (*outstream_set_volume)(struct SoundIoPrivate *, struct SoundIoOutStreamPrivate *, float volume);
+    // Poll mode. A backend without outstream_process cannot open streams
+    // with SoundIoOutStream::poll_mode set.
+    int (*outstream_get_poll_descriptors)(struct SoundIoPrivate *, struct SoundIoOutStreamPrivate *,
+            struct SoundIoPollDescriptor *descriptors, int *count);
+    int (*outstream_process)(struct SoundIoPrivate *, struct SoundIoOutStreamPrivate *,
+            const struct SoundIoPollDescriptor *descriptors, int count);
 
     int (*instream_open)(struct SoundIoPrivate *, struct SoundIoInStreamPrivate *);
     void (*instream_destroy)(struct SoundIoPrivate *, struct SoundIoInStreamPrivate *);
@@ -162,6 +357,10 @@ struct SoundIoPrivate {
     int (*instream_end_read)(struct SoundIoPrivate *, struct SoundIoInStreamPrivate *);
     int (*instream_pause)(struct SoundIoPrivate *, struct SoundIoInStreamPrivate *, bool pause);
     int (*instream_get_latency)(struct SoundIoPrivate *, struct SoundIoInStreamPrivate *, double *out_latency);
+    int (*instream_get_poll_descriptors)(struct SoundIoPrivate *, struct SoundIoInStreamPrivate *,
+            struct SoundIoPollDescriptor *descriptors, int *count);
+    int (*instream_process)(struct SoundIoPrivate *, struct SoundIoInStreamPrivate *,
+            const struct SoundIoPollDescriptor *descriptors, int count);
 
     union SoundIoBackendData backend_data;
 };
@@ -176,10 +375,55 @@ struct SoundIoDevicePrivate {
     struct SoundIoSampleRateRange prealloc_sample_rate_range;
     struct SoundIoListSampleRateRange sample_rates;
     enum SoundIoFormat prealloc_format;
+    // Set when the capability fields have not been filled in yet.
+    // See ::soundio_device_probe.
+    bool needs_probe;
+    // When set, the device and everything it points to, except the
+    // sample_rates list, live in this arena. Holds a reference.
+    struct SoundIoArena *arena;
 };
 
+// Returns NULL when out of memory.
+struct SoundIoDevicesInfo *soundio_devices_info_create(struct SoundIo *soundio);
 void soundio_destroy_devices_info(struct SoundIoDevicesInfo *devices_info);
 
+// Call on the application thread after replacing si->safe_devices_info with
+// a newer list, and before destroying `old_devices_info`, which may be NULL.
+// Calls SoundIo::on_device_changes and SoundIo::on_devices_change.
+void soundio_emit_devices_change(struct SoundIoPrivate *si,
+        struct SoundIoDevicesInfo *old_devices_info);
+
+// For backends which scan devices on threads of their own. The thread posts
+// each new list, which is handed to the application on the next
+// soundio_flush_events, replacing a list posted before it that was not handed
+// out yet. Posting is lock free and wakes the application thread once, no
+// matter how many events were posted since it last woke up. Takes ownership
+// of `devices_info`.
+void soundio_events_post_devices_info(struct SoundIoPrivate *si,
+        struct SoundIoDevicesInfo *devices_info);
+// Reported with SoundIo::on_backend_disconnect once.
+void soundio_events_post_error(struct SoundIoPrivate *si, int err);
+// Such backends use these for flush_events, wait_events and wakeup.
+void soundio_events_flush(struct SoundIoPrivate *si);
+void soundio_events_wait(struct SoundIoPrivate *si);
+void soundio_events_wakeup(struct SoundIoPrivate *si);
+
+// A device with a ref_count of 1, allocated from the arena of devices_info,
+// or from the heap if devices_info is NULL. It is not added to the lists.
+// Returns NULL when out of memory.
+struct SoundIoDevicePrivate *soundio_device_create(struct SoundIoDevicesInfo *devices_info);
+
+// Memory for the fields of a device, which soundio_device_unref releases.
+// Comes from the arena of the device if it has one. Zero initialized.
+void *soundio_device_alloc(struct SoundIoDevicePrivate *dev, size_t size);
+char *soundio_device_str_dupe(struct SoundIoDevicePrivate *dev, const char *str, int str_len);
+char *soundio_device_strdup(struct SoundIoDevicePrivate *dev, const char *str);
+char *soundio_device_sprintf(struct SoundIoDevicePrivate *dev, const char *format, ...)
+    SOUNDIO_ATTR_FORMAT(printf, 2, 3);
+
+#define DEVICE_ALLOCATE(dev, Type, count) \
+    ((Type*)soundio_device_alloc(dev, (count) * sizeof(Type)))
+
 static const int SOUNDIO_MIN_SAMPLE_RATE = 8000;
 static const int SOUNDIO_MAX_SAMPLE_RATE = 5644800;
 
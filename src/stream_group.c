@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "stream_group.h"
+#include "os.h"
+
+SOUNDIO_MAKE_LIST_DEF(struct SoundIoStreamGroupMember, SoundIoListStreamGroupMember, SOUNDIO_LIST_STATIC)
+
+double soundio_get_time(void) {
+    return soundio_os_get_time();
+}
+
+struct SoundIoStreamGroup *soundio_stream_group_create(void) {
+    return ALLOCATE(struct SoundIoStreamGroup, 1);
+}
+
+void soundio_stream_group_destroy(struct SoundIoStreamGroup *group) {
+    if (!group)
+        return;
+    for (int i = 0; i < group->members.length; i += 1) {
+        struct SoundIoStreamGroupMember *member = SoundIoListStreamGroupMember_ptr_at(&group->members, i);
+        if (member->os)
+            member->os->group = NULL;
+        else
+            member->is->group = NULL;
+    }
+    SoundIoListStreamGroupMember_deinit(&group->members);
+    free(group);
+}
+
+static int add_member(struct SoundIoStreamGroup *group, struct SoundIoOutStreamPrivate *os,
+        struct SoundIoInStreamPrivate *is)
+{
+    if (group->start_time != 0.0)
+        return SoundIoErrorInvalid;
+    if (SoundIoListStreamGroupMember_add_one(&group->members))
+        return SoundIoErrorNoMem;
+    struct SoundIoStreamGroupMember *member = SoundIoListStreamGroupMember_last_ptr(&group->members);
+    member->os = os;
+    member->is = is;
+    return 0;
+}
+
+int soundio_stream_group_add_outstream(struct SoundIoStreamGroup *group,
+        struct SoundIoOutStream *outstream)
+{
+    struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate *)outstream;
+    if (os->group)
+        return SoundIoErrorInvalid;
+    int err;
+    if ((err = add_member(group, os, NULL)))
+        return err;
+    os->group = group;
+    return 0;
+}
+
+int soundio_stream_group_add_instream(struct SoundIoStreamGroup *group,
+        struct SoundIoInStream *instream)
+{
+    struct SoundIoInStreamPrivate *is = (struct SoundIoInStreamPrivate *)instream;
+    if (is->group)
+        return SoundIoErrorInvalid;
+    int err;
+    if ((err = add_member(group, NULL, is)))
+        return err;
+    is->group = group;
+    return 0;
+}
+
+void soundio_stream_group_remove_outstream(struct SoundIoStreamGroup *group,
+        struct SoundIoOutStreamPrivate *os)
+{
+    for (int i = 0; i < group->members.length; i += 1) {
+        if (SoundIoListStreamGroupMember_ptr_at(&group->members, i)->os == os) {
+            SoundIoListStreamGroupMember_swap_remove(&group->members, i);
+            break;
+        }
+    }
+    os->group = NULL;
+}
+
+void soundio_stream_group_remove_instream(struct SoundIoStreamGroup *group,
+        struct SoundIoInStreamPrivate *is)
+{
+    for (int i = 0; i < group->members.length; i += 1) {
+        if (SoundIoListStreamGroupMember_ptr_at(&group->members, i)->is == is) {
+            SoundIoListStreamGroupMember_swap_remove(&group->members, i);
+            break;
+        }
+    }
+    is->group = NULL;
+}
+
+static bool member_waits_for_deadline(struct SoundIoStreamGroupMember *member) {
+    struct SoundIoDevice *device = member->os ? member->os->pub.device : member->is->pub.device;
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)device->soundio;
+    return si->waits_for_start_deadline;
+}
+
+static int start_member(struct SoundIoStreamGroupMember *member) {
+    if (member->os)
+        return soundio_outstream_start(&member->os->pub);
+    return soundio_instream_start(&member->is->pub);
+}
+
+int soundio_stream_group_start(struct SoundIoStreamGroup *group, double delay) {
+    if (group->start_time != 0.0 || delay < 0.0)
+        return SoundIoErrorInvalid;
+
+    double deadline = soundio_os_get_time() + delay;
+    group->start_time = deadline;
+    for (int i = 0; i < group->members.length; i += 1) {
+        struct SoundIoStreamGroupMember *member = SoundIoListStreamGroupMember_ptr_at(&group->members, i);
+        if (member->os)
+            member->os->start_deadline = deadline;
+        else
+            member->is->start_deadline = deadline;
+    }
+
+    // The backends which wait for the deadline themselves go first, so that
+    // preparing their devices and filling their buffers happens during the
+    // delay rather than after it.
+    int err;
+    bool any_late = false;
+    for (int i = 0; i < group->members.length; i += 1) {
+        struct SoundIoStreamGroupMember *member = SoundIoListStreamGroupMember_ptr_at(&group->members, i);
+        if (!member_waits_for_deadline(member)) {
+            any_late = true;
+            continue;
+        }
+        if ((err = start_member(member)))
+            return err;
+    }
+    if (!any_late)
+        return 0;
+
+    soundio_os_sleep_until(deadline);
+    for (int i = 0; i < group->members.length; i += 1) {
+        struct SoundIoStreamGroupMember *member = SoundIoListStreamGroupMember_ptr_at(&group->members, i);
+        if (member_waits_for_deadline(member))
+            continue;
+        if ((err = start_member(member)))
+            return err;
+    }
+    return 0;
+}
+
+double soundio_stream_group_get_start_time(struct SoundIoStreamGroup *group) {
+    return group->start_time;
+}
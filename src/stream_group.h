@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#ifndef SOUNDIO_STREAM_GROUP_H
+#define SOUNDIO_STREAM_GROUP_H
+
+#include "soundio_private.h"
+
+// exactly one of them is set
+struct SoundIoStreamGroupMember {
+    struct SoundIoOutStreamPrivate *os;
+    struct SoundIoInStreamPrivate *is;
+};
+
+SOUNDIO_MAKE_LIST_STRUCT(struct SoundIoStreamGroupMember, SoundIoListStreamGroupMember, SOUNDIO_LIST_STATIC)
+
+struct SoundIoStreamGroup {
+    struct SoundIoListStreamGroupMember members;
+    // 0 until the group is started.
+    double start_time;
+};
+
+// Called when a member stream is destroyed.
+void soundio_stream_group_remove_outstream(struct SoundIoStreamGroup *group,
+        struct SoundIoOutStreamPrivate *os);
+void soundio_stream_group_remove_instream(struct SoundIoStreamGroup *group,
+        struct SoundIoInStreamPrivate *is);
+
+#endif
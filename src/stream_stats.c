@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "stream_stats.h"
+#include "os.h"
+
+#include <string.h>
+
+void soundio_stream_stats_init(struct SoundIoStreamStatsRecorder *rec) {
+    memset(&rec->stats, 0, sizeof(rec->stats));
+    SOUNDIO_ATOMIC_STORE(rec->seq, 0);
+    SOUNDIO_ATOMIC_STORE(rec->xrun_count, 0);
+    for (int i = 0; i < SOUNDIO_STATS_XRUN_HISTORY; i += 1)
+        SOUNDIO_ATOMIC_STORE(rec->xrun_times_us[i], 0);
+    rec->start_time = soundio_os_get_time();
+    rec->last_wakeup_time = -1.0;
+    rec->last_wakeup_interval = -1.0;
+    rec->callback_start_time = 0.0;
+    rec->io_start_time = 0.0;
+}
+
+static void write_begin(struct SoundIoStreamStatsRecorder *rec) {
+    unsigned long seq = SOUNDIO_ATOMIC_LOAD_EXPLICIT(rec->seq, SOUNDIO_MEMORY_ORDER_RELAXED);
+    SOUNDIO_ATOMIC_STORE_EXPLICIT(rec->seq, seq + 1, SOUNDIO_MEMORY_ORDER_RELAXED);
+    SOUNDIO_ATOMIC_THREAD_FENCE(SOUNDIO_MEMORY_ORDER_RELEASE);
+}
+
+static void write_end(struct SoundIoStreamStatsRecorder *rec) {
+    unsigned long seq = SOUNDIO_ATOMIC_LOAD_EXPLICIT(rec->seq, SOUNDIO_MEMORY_ORDER_RELAXED);
+    SOUNDIO_ATOMIC_STORE_EXPLICIT(rec->seq, seq + 1, SOUNDIO_MEMORY_ORDER_RELEASE);
+}
+
+static int histogram_bucket(double seconds) {
+    uint64_t us = (uint64_t)(seconds * 1000000.0);
+    int bucket = 0;
+    while (us && bucket < SOUNDIO_STATS_HISTOGRAM_BUCKETS - 1) {
+        us >>= 1;
+        bucket += 1;
+    }
+    return bucket;
+}
+
+void soundio_stream_stats_callback_begin(struct SoundIoStreamStatsRecorder *rec, int frame_count_max) {
+    double now = soundio_os_get_time();
+    rec->callback_start_time = now;
+
+    write_begin(rec);
+    struct SoundIoStreamStats *stats = &rec->stats;
+    if (rec->last_wakeup_time >= 0.0) {
+        double interval = now - rec->last_wakeup_time;
+        if (rec->last_wakeup_interval >= 0.0) {
+            double jitter = interval - rec->last_wakeup_interval;
+            if (jitter < 0.0)
+                jitter = -jitter;
+            stats->wakeup_jitter_histogram[histogram_bucket(jitter)] += 1;
+            if (jitter > stats->wakeup_jitter_max)
+                stats->wakeup_jitter_max = jitter;
+        }
+        rec->last_wakeup_interval = interval;
+    }
+    rec->last_wakeup_time = now;
+
+    if (stats->callback_count == 0 || frame_count_max < stats->frame_count_max_min)
+        stats->frame_count_max_min = frame_count_max;
+    if (frame_count_max > stats->frame_count_max_max)
+        stats->frame_count_max_max = frame_count_max;
+    write_end(rec);
+}
+
+void soundio_stream_stats_callback_end(struct SoundIoStreamStatsRecorder *rec) {
+    double duration = soundio_os_get_time() - rec->callback_start_time;
+
+    write_begin(rec);
+    struct SoundIoStreamStats *stats = &rec->stats;
+    stats->callback_count += 1;
+    stats->callback_duration_histogram[histogram_bucket(duration)] += 1;
+    if (duration > stats->callback_duration_max)
+        stats->callback_duration_max = duration;
+    write_end(rec);
+}
+
+void soundio_stream_stats_io_begin(struct SoundIoStreamStatsRecorder *rec) {
+    rec->io_start_time = soundio_os_get_time();
+}
+
+void soundio_stream_stats_io_end(struct SoundIoStreamStatsRecorder *rec) {
+    double duration = soundio_os_get_time() - rec->io_start_time;
+    write_begin(rec);
+    rec->stats.io_time += duration;
+    write_end(rec);
+}
+
+void soundio_stream_stats_xrun(struct SoundIoStreamStatsRecorder *rec) {
+    double elapsed = soundio_os_get_time() - rec->start_time;
+    uint64_t index = SOUNDIO_ATOMIC_FETCH_ADD(rec->xrun_count, 1);
+    SOUNDIO_ATOMIC_STORE(rec->xrun_times_us[index % SOUNDIO_STATS_XRUN_HISTORY],
+            (uint64_t)(elapsed * 1000000.0));
+}
+
+void soundio_stream_stats_read(struct SoundIoStreamStatsRecorder *rec, struct SoundIoStreamStats *out) {
+    for (;;) {
+        unsigned long seq = SOUNDIO_ATOMIC_LOAD_EXPLICIT(rec->seq, SOUNDIO_MEMORY_ORDER_ACQUIRE);
+        if (seq & 1)
+            continue;
+        memcpy(out, &rec->stats, sizeof(struct SoundIoStreamStats));
+        SOUNDIO_ATOMIC_THREAD_FENCE(SOUNDIO_MEMORY_ORDER_ACQUIRE);
+        if (SOUNDIO_ATOMIC_LOAD_EXPLICIT(rec->seq, SOUNDIO_MEMORY_ORDER_RELAXED) == seq)
+            break;
+    }
+
+    uint64_t xrun_count = SOUNDIO_ATOMIC_LOAD(rec->xrun_count);
+    out->xrun_count = xrun_count;
+    for (int i = 0; i < SOUNDIO_STATS_XRUN_HISTORY; i += 1) {
+        if ((uint64_t)i >= xrun_count) {
+            out->xrun_times[i] = 0.0;
+            continue;
+        }
+        uint64_t index = (xrun_count - 1 - i) % SOUNDIO_STATS_XRUN_HISTORY;
+        out->xrun_times[i] = SOUNDIO_ATOMIC_LOAD(rec->xrun_times_us[index]) / 1000000.0;
+    }
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#ifndef SOUNDIO_STREAM_STATS_H
+#define SOUNDIO_STREAM_STATS_H
+
+#include "soundio_internal.h"
+#include "atomics.h"
+
+// Collects SoundIoStreamStats for one stream. Everything except the xrun
+// fields is written only from the thread which runs the stream callbacks,
+// under a sequence lock, so readers can take a consistent copy without
+// making that thread wait. Xruns are reported from other threads by some
+// backends, so they are kept in atomics of their own.
+struct SoundIoStreamStatsRecorder {
+    struct SoundIoAtomicULong seq;
+    struct SoundIoStreamStats stats;
+
+    struct SoundIoAtomicUInt64 xrun_count;
+    // Microseconds since start_time, indexed by xrun number.
+    struct SoundIoAtomicUInt64 xrun_times_us[SOUNDIO_STATS_XRUN_HISTORY];
+
+    // Only touched by the callback thread.
+    double start_time;
+    double last_wakeup_time;
+    double last_wakeup_interval;
+    double callback_start_time;
+    double io_start_time;
+};
+
+void soundio_stream_stats_init(struct SoundIoStreamStatsRecorder *rec);
+
+// Call right before and after invoking the write or read callback.
+void soundio_stream_stats_callback_begin(struct SoundIoStreamStatsRecorder *rec, int frame_count_max);
+void soundio_stream_stats_callback_end(struct SoundIoStreamStatsRecorder *rec);
+
+// Bracket the backend's begin_write/end_write or begin_read/end_read.
+void soundio_stream_stats_io_begin(struct SoundIoStreamStatsRecorder *rec);
+void soundio_stream_stats_io_end(struct SoundIoStreamStatsRecorder *rec);
+
+// Safe to call from any thread.
+void soundio_stream_stats_xrun(struct SoundIoStreamStatsRecorder *rec);
+
+void soundio_stream_stats_read(struct SoundIoStreamStatsRecorder *rec, struct SoundIoStreamStats *out);
+
+#endif
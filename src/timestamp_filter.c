@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "timestamp_filter.h"
+#include "util.h"
+
+#include <math.h>
+
+void soundio_timestamp_filter_init(struct SoundIoTimestampFilter *filter) {
+    filter->valid = false;
+    filter->frame = 0;
+    filter->time = 0.0;
+    filter->frame_duration = 0.0;
+    filter->nominal_frame_duration = 0.0;
+}
+
+static void restart(struct SoundIoTimestampFilter *filter, int64_t frame, double time,
+        int sample_rate)
+{
+    filter->valid = true;
+    filter->frame = frame;
+    filter->time = time;
+    filter->nominal_frame_duration = 1.0 / sample_rate;
+    filter->frame_duration = filter->nominal_frame_duration;
+}
+
+void soundio_timestamp_filter_update(struct SoundIoTimestampFilter *filter,
+        int64_t frame, double time, int sample_rate)
+{
+    if (!filter->valid || frame < filter->frame || 1.0 / sample_rate != filter->nominal_frame_duration) {
+        restart(filter, frame, time, sample_rate);
+        return;
+    }
+    int64_t frame_count = frame - filter->frame;
+    if (frame_count == 0)
+        return;
+
+    double predicted = filter->time + frame_count * filter->frame_duration;
+    double err = time - predicted;
+    if (fabs(err) > SOUNDIO_TIMESTAMP_FILTER_MAX_ERROR) {
+        restart(filter, frame, time, sample_rate);
+        return;
+    }
+
+    // The coefficients depend on how long the update is, so that callbacks
+    // of varying size see the same loop.
+    const double pi = 3.14159265358979323846;
+    double omega = 2.0 * pi * SOUNDIO_TIMESTAMP_FILTER_BANDWIDTH * frame_count * filter->frame_duration;
+    double b = sqrt(2.0) * omega;
+    double c = omega * omega;
+    filter->frame = frame;
+    filter->time = predicted + b * err;
+    filter->frame_duration = soundio_double_clamp(
+            filter->nominal_frame_duration * (1.0 - SOUNDIO_TIMESTAMP_FILTER_MAX_DRIFT),
+            filter->frame_duration + c * err / frame_count,
+            filter->nominal_frame_duration * (1.0 + SOUNDIO_TIMESTAMP_FILTER_MAX_DRIFT));
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#ifndef SOUNDIO_TIMESTAMP_FILTER_H
+#define SOUNDIO_TIMESTAMP_FILTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// The loop bandwidth, in Hz. Lower is smoother but follows a device whose
+// rate drifts more slowly.
+#define SOUNDIO_TIMESTAMP_FILTER_BANDWIDTH 0.5
+// An error larger than this, in seconds, is an xrun, a restart or a stall
+// rather than jitter, and the filter starts over from the timestamp.
+#define SOUNDIO_TIMESTAMP_FILTER_MAX_ERROR 0.01
+// How far the measured rate may stray from the nominal one.
+#define SOUNDIO_TIMESTAMP_FILTER_MAX_DRIFT 0.01
+
+// Smooths the (frame, time) pairs that a backend reads from the device with
+// the second order delay-locked loop of Fons Adriaensen's "Using a DLL to
+// filter time", generalized to updates of any number of frames. Only used
+// from the thread which runs the stream callbacks.
+struct SoundIoTimestampFilter {
+    bool valid;
+    // The filtered timestamp: the device was at `frame` at `time`.
+    int64_t frame;
+    double time;
+    // Seconds per frame, as measured, and as the sample rate says.
+    double frame_duration;
+    double nominal_frame_duration;
+};
+
+void soundio_timestamp_filter_init(struct SoundIoTimestampFilter *filter);
+
+// Feeds the timestamp of one callback: the device was at `frame` at `time`.
+// `sample_rate` is the nominal rate of the frames.
+void soundio_timestamp_filter_update(struct SoundIoTimestampFilter *filter,
+        int64_t frame, double time, int sample_rate);
+
+#endif
@@ -12,6 +12,7 @@
 #include <string.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #define ALLOCATE_NONZERO(Type, count) ((Type*)malloc((count) * sizeof(Type)))
 
@@ -36,6 +37,19 @@
 #endif
 
 
+#define SOUNDIO_FNV1A_INIT 0xcbf29ce484222325ULL
+
+// 64-bit FNV-1a. Start with SOUNDIO_FNV1A_INIT and feed the result back in
+// to hash more data.
+static inline uint64_t soundio_fnv1a(uint64_t hash, const void *data, size_t len) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < len; i += 1) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
 static inline int soundio_int_min(int a, int b) {
     return (a <= b) ? a : b;
 }
@@ -48,6 +62,14 @@ static inline int soundio_int_clamp(int min_value, int value, int max_value) {
     return soundio_int_max(soundio_int_min(value, max_value), min_value);
 }
 
+static inline int64_t soundio_int64_min(int64_t a, int64_t b) {
+    return (a <= b) ? a : b;
+}
+
+static inline int64_t soundio_int64_max(int64_t a, int64_t b) {
+    return (a >= b) ? a : b;
+}
+
 static inline double soundio_double_min(double a, double b) {
     return (a <= b) ? a : b;
 }
@@ -24,6 +24,7 @@
 #include "soundio_private.h"
 
 #include <stdio.h>
+#include <math.h>
 
 // Some HRESULT values are not defined by the windows headers
 #ifndef E_NOTFOUND
@@ -66,6 +67,10 @@ static const IID IID_IAudioClockAdjustment = {
     //MIDL_INTERFACE("f6e4c0a0-46d9-4fb8-be21-57a3ef2b626c")
     0xf6e4c0a0, 0x46d9, 0x4fb8, {0xbe, 0x21, 0x57, 0xa3, 0xef, 0x2b, 0x62, 0x6c}
 };
+static const IID IID_IAudioClock = {
+    //MIDL_INTERFACE("CD63314F-3FBA-4a1b-812C-EF96358728E7")
+    0xcd63314f, 0x3fba, 0x4a1b, {0x81, 0x2c, 0xef, 0x96, 0x35, 0x87, 0x28, 0xe7}
+};
 static const IID IID_IAudioCaptureClient = {
     //MIDL_INTERFACE("C8ADBD64-E71E-48a0-A4DE-185C395CD317")
     0xc8adbd64, 0xe71e, 0x48a0, {0xa4, 0xde, 0x18, 0x5c, 0x39, 0x5c, 0xd3, 0x17}
@@ -74,6 +79,28 @@ static const IID IID_ISimpleAudioVolume = {
     //MIDL_INTERFACE("87ce5498-68d6-44e5-9215-6da47ef883d8")
     0x87ce5498, 0x68d6, 0x44e5,{ 0x92, 0x15, 0x6d, 0xa4, 0x7e, 0xf8, 0x83, 0xd8 }
 };
+static const IID IID_IAudioClient3 = {
+    //MIDL_INTERFACE("7ED4EE07-8E67-4CD4-8C1A-2B7A5987AD42")
+    0x7ed4ee07, 0x8e67, 0x4cd4, {0x8c, 0x1a, 0x2b, 0x7a, 0x59, 0x87, 0xad, 0x42}
+};
+
+// IAudioClient3 is Windows 10 and later, and older SDKs do not declare it.
+// Only the methods it adds to IAudioClient2 are called.
+struct SoundIoAudioClient3;
+struct SoundIoAudioClient3Vtbl {
+    // IUnknown, then IAudioClient, then IAudioClient2
+    void *inherited[3 + 12 + 3];
+    HRESULT (STDMETHODCALLTYPE *GetSharedModeEnginePeriod)(struct SoundIoAudioClient3 *client,
+            const WAVEFORMATEX *format, UINT32 *default_period, UINT32 *fundamental_period,
+            UINT32 *min_period, UINT32 *max_period);
+    HRESULT (STDMETHODCALLTYPE *GetCurrentSharedModeEnginePeriod)(struct SoundIoAudioClient3 *client,
+            WAVEFORMATEX **format, UINT32 *current_period);
+    HRESULT (STDMETHODCALLTYPE *InitializeSharedAudioStream)(struct SoundIoAudioClient3 *client,
+            DWORD stream_flags, UINT32 period, const WAVEFORMATEX *format, LPCGUID session_guid);
+};
+struct SoundIoAudioClient3 {
+    const struct SoundIoAudioClient3Vtbl *lpVtbl;
+};
 
 #ifdef __cplusplus
 // In C++ mode, IsEqualGUID() takes its arguments by reference
@@ -82,8 +109,10 @@ static const IID IID_ISimpleAudioVolume = {
 
 // And some constants are passed by reference
 #define IID_IAUDIOCLIENT                      (IID_IAudioClient)
+#define IID_IAUDIOCLIENT3                     (IID_IAudioClient3)
 #define IID_IMMENDPOINT                       (IID_IMMEndpoint)
 #define IID_IAUDIOCLOCKADJUSTMENT             (IID_IAudioClockAdjustment)
+#define IID_IAUDIOCLOCK                       (IID_IAudioClock)
 #define IID_IAUDIOSESSIONCONTROL              (IID_IAudioSessionControl)
 #define IID_IAUDIORENDERCLIENT                (IID_IAudioRenderClient)
 #define IID_IMMDEVICEENUMERATOR               (IID_IMMDeviceEnumerator)
@@ -98,11 +127,13 @@ static const IID IID_ISimpleAudioVolume = {
 #define IS_EQUAL_IID(a, b) IsEqualIID((a), (b))
 
 #define IID_IAUDIOCLIENT (&IID_IAudioClient)
+#define IID_IAUDIOCLIENT3 (&IID_IAudioClient3)
 #define IID_IMMENDPOINT (&IID_IMMEndpoint)
 #define PKEY_DEVICE_FRIENDLYNAME (&PKEY_Device_FriendlyName)
 #define PKEY_AUDIOENGINE_DEVICEFORMAT (&PKEY_AudioEngine_DeviceFormat)
 #define CLSID_MMDEVICEENUMERATOR (&CLSID_MMDeviceEnumerator)
 #define IID_IAUDIOCLOCKADJUSTMENT (&IID_IAudioClockAdjustment)
+#define IID_IAUDIOCLOCK (&IID_IAudioClock)
 #define IID_IAUDIOSESSIONCONTROL (&IID_IAudioSessionControl)
 #define IID_IAUDIORENDERCLIENT (&IID_IAudioRenderClient)
 #define IID_IMMDEVICEENUMERATOR (&IID_IMMDeviceEnumerator)
@@ -235,6 +266,24 @@ static int from_lpwstr(LPWSTR lpwstr, char **out_str, int *out_str_len) {
     return 0;
 }
 
+// Like from_lpwstr but the string belongs to `dev`.
+static int device_from_lpwstr(struct SoundIoDevicePrivate *dev, LPWSTR lpwstr,
+        char **out_str, int *out_str_len)
+{
+    int err;
+    char *buf;
+    int buf_len;
+    if ((err = from_lpwstr(lpwstr, &buf, &buf_len)))
+        return err;
+
+    *out_str = soundio_device_str_dupe(dev, buf, buf_len);
+    free(buf);
+    if (!*out_str)
+        return SoundIoErrorNoMem;
+    *out_str_len = buf_len;
+    return 0;
+}
+
 static int to_lpwstr(const char *str, int str_len, LPWSTR *out_lpwstr) {
     DWORD flags = 0;
     int w_len = MultiByteToWideChar(CP_UTF8, flags, str, str_len, NULL, 0);
@@ -455,6 +504,45 @@ static REFERENCE_TIME to_reference_time(double seconds) {
     return (REFERENCE_TIME)(seconds * 10000000.0 + 0.5);
 }
 
+// Exclusive mode wants a period of a whole number of frames, as exactly as
+// 100 ns units can put it.
+static REFERENCE_TIME frames_to_reference_time(UINT32 frames, int sample_rate) {
+    return (REFERENCE_TIME)(10000000.0 * frames / sample_rate + 0.5);
+}
+
+static REFERENCE_TIME aligned_period(double seconds, int sample_rate) {
+    UINT32 frames = (UINT32)ceil(seconds * sample_rate - 1e-9);
+    return frames_to_reference_time(frames, sample_rate);
+}
+
+// Windows 10 runs shared streams at periods below the engine's default, in
+// steps of its fundamental period, for clients which ask through
+// IAudioClient3. Returns whether `client` is now initialized with the period
+// nearest `latency`.
+static bool initialize_low_latency_shared(IAudioClient *client, const WAVEFORMATEX *format,
+        double latency)
+{
+    struct SoundIoAudioClient3 *client3;
+    if (FAILED(IAudioClient_QueryInterface(client, IID_IAUDIOCLIENT3, (void **)&client3)))
+        return false;
+    bool ok = false;
+    UINT32 default_period, fundamental_period, min_period, max_period;
+    if (SUCCEEDED(client3->lpVtbl->GetSharedModeEnginePeriod(client3, format, &default_period,
+                    &fundamental_period, &min_period, &max_period)) && fundamental_period > 0)
+    {
+        UINT32 want = (UINT32)ceil(latency * format->nSamplesPerSec);
+        UINT32 period = (want + fundamental_period - 1) / fundamental_period * fundamental_period;
+        if (period < min_period)
+            period = min_period;
+        if (period > max_period)
+            period = max_period;
+        ok = SUCCEEDED(client3->lpVtbl->InitializeSharedAudioStream(client3,
+                    AUDCLNT_STREAMFLAGS_EVENTCALLBACK, period, format, NULL));
+    }
+    IUnknown_Release((IUnknown *)client3);
+    return ok;
+}
+
 static void destruct_device(struct SoundIoDevicePrivate *dev) {
     struct SoundIoDeviceWasapi *dw = &dev->backend_data.wasapi;
     if (dw->mm_device)
@@ -521,7 +609,7 @@ static int detect_valid_layouts(struct RefreshDevices *rd, WAVEFORMATEXTENSIBLE
     HRESULT hr;
 
     device->layout_count = 0;
-    device->layouts = ALLOCATE(struct SoundIoChannelLayout, ARRAY_LENGTH(test_layouts));
+    device->layouts = DEVICE_ALLOCATE(dev, struct SoundIoChannelLayout, ARRAY_LENGTH(test_layouts));
     if (!device->layouts)
         return SoundIoErrorNoMem;
 
@@ -561,7 +649,7 @@ static int detect_valid_formats(struct RefreshDevices *rd, WAVEFORMATEXTENSIBLE
     HRESULT hr;
 
     device->format_count = 0;
-    device->formats = ALLOCATE(enum SoundIoFormat, ARRAY_LENGTH(test_formats));
+    device->formats = DEVICE_ALLOCATE(dev, enum SoundIoFormat, ARRAY_LENGTH(test_formats));
     if (!device->formats)
         return SoundIoErrorNoMem;
 
@@ -766,7 +854,7 @@ static int refresh_devices(struct SoundIoPrivate *si) {
 
     int device_count = unsigned_count;
 
-    if (!(rd.devices_info = ALLOCATE(struct SoundIoDevicesInfo, 1))) {
+    if (!(rd.devices_info = soundio_devices_info_create(soundio))) {
         deinit_refresh_devices(&rd);
         return SoundIoErrorNoMem;
     }
@@ -791,7 +879,7 @@ static int refresh_devices(struct SoundIoPrivate *si) {
 
 
 
-        struct SoundIoDevicePrivate *dev_shared = ALLOCATE(struct SoundIoDevicePrivate, 1);
+        struct SoundIoDevicePrivate *dev_shared = soundio_device_create(rd.devices_info);
         if (!dev_shared) {
             deinit_refresh_devices(&rd);
             return SoundIoErrorNoMem;
@@ -800,12 +888,11 @@ static int refresh_devices(struct SoundIoPrivate *si) {
         dev_shared->destruct = destruct_device;
         assert(!rd.device_shared);
         rd.device_shared = &dev_shared->pub;
-        rd.device_shared->ref_count = 1;
         rd.device_shared->soundio = soundio;
         rd.device_shared->is_raw = false;
         rd.device_shared->software_latency_max = 2.0;
 
-        struct SoundIoDevicePrivate *dev_raw = ALLOCATE(struct SoundIoDevicePrivate, 1);
+        struct SoundIoDevicePrivate *dev_raw = soundio_device_create(rd.devices_info);
         if (!dev_raw) {
             deinit_refresh_devices(&rd);
             return SoundIoErrorNoMem;
@@ -814,18 +901,17 @@ static int refresh_devices(struct SoundIoPrivate *si) {
         dev_raw->destruct = destruct_device;
         assert(!rd.device_raw);
         rd.device_raw = &dev_raw->pub;
-        rd.device_raw->ref_count = 1;
         rd.device_raw->soundio = soundio;
         rd.device_raw->is_raw = true;
         rd.device_raw->software_latency_max = 0.5;
 
         int device_id_len;
-        if ((err = from_lpwstr(rd.lpwstr, &rd.device_shared->id, &device_id_len))) {
+        if ((err = device_from_lpwstr(dev_shared, rd.lpwstr, &rd.device_shared->id, &device_id_len))) {
             deinit_refresh_devices(&rd);
             return err;
         }
 
-        rd.device_raw->id = soundio_str_dupe(rd.device_shared->id, device_id_len);
+        rd.device_raw->id = soundio_device_str_dupe(dev_raw, rd.device_shared->id, device_id_len);
         if (!rd.device_raw->id) {
             deinit_refresh_devices(&rd);
             return SoundIoErrorNoMem;
@@ -948,7 +1034,8 @@ static int refresh_devices(struct SoundIoPrivate *si) {
             continue;
         }
         int device_name_len;
-        if ((err = from_lpwstr(rd.prop_variant_value.pwszVal, &rd.device_shared->name, &device_name_len))) {
+        if ((err = device_from_lpwstr(dev_shared, rd.prop_variant_value.pwszVal,
+                        &rd.device_shared->name, &device_name_len))) {
             rd.device_shared->probe_error = err;
             rd.device_raw->probe_error = err;
             rd.device_shared = NULL;
@@ -956,7 +1043,7 @@ static int refresh_devices(struct SoundIoPrivate *si) {
             continue;
         }
 
-        rd.device_raw->name = soundio_str_dupe(rd.device_shared->name, device_name_len);
+        rd.device_raw->name = soundio_device_str_dupe(dev_raw, rd.device_shared->name, device_name_len);
         if (!rd.device_raw->name) {
             deinit_refresh_devices(&rd);
             return SoundIoErrorNoMem;
@@ -1066,13 +1153,7 @@ static int refresh_devices(struct SoundIoPrivate *si) {
         rd.device_raw = NULL;
     }
 
-    soundio_os_mutex_lock(siw->mutex);
-    soundio_destroy_devices_info(siw->ready_devices_info);
-    siw->ready_devices_info = rd.devices_info;
-    siw->have_devices_flag = true;
-    soundio_os_cond_signal(siw->cond, siw->mutex);
-    soundio->on_events_signal(soundio);
-    soundio_os_mutex_unlock(siw->mutex);
+    soundio_events_post_devices_info(si, rd.devices_info);
 
     rd.devices_info = NULL;
     deinit_refresh_devices(&rd);
@@ -1082,13 +1163,7 @@ static int refresh_devices(struct SoundIoPrivate *si) {
 
 
 static void shutdown_backend(struct SoundIoPrivate *si, int err) {
-    struct SoundIo *soundio = &si->pub;
-    struct SoundIoWasapi *siw = &si->backend_data.wasapi;
-    soundio_os_mutex_lock(siw->mutex);
-    siw->shutdown_err = err;
-    soundio_os_cond_signal(siw->cond, siw->mutex);
-    soundio->on_events_signal(soundio);
-    soundio_os_mutex_unlock(siw->mutex);
+    soundio_events_post_error(si, err);
 }
 
 static void device_thread_run(void *arg) {
@@ -1134,56 +1209,6 @@ static void device_thread_run(void *arg) {
     siw->device_enumerator = NULL;
 }
 
-static void my_flush_events(struct SoundIoPrivate *si, bool wait) {
-    struct SoundIo *soundio = &si->pub;
-    struct SoundIoWasapi *siw = &si->backend_data.wasapi;
-
-    bool change = false;
-    bool cb_shutdown = false;
-    struct SoundIoDevicesInfo *old_devices_info = NULL;
-
-    soundio_os_mutex_lock(siw->mutex);
-
-    // block until have devices
-    while (wait || (!siw->have_devices_flag && !siw->shutdown_err)) {
-        soundio_os_cond_wait(siw->cond, siw->mutex);
-        wait = false;
-    }
-
-    if (siw->shutdown_err && !siw->emitted_shutdown_cb) {
-        siw->emitted_shutdown_cb = true;
-        cb_shutdown = true;
-    } else if (siw->ready_devices_info) {
-        old_devices_info = si->safe_devices_info;
-        si->safe_devices_info = siw->ready_devices_info;
-        siw->ready_devices_info = NULL;
-        change = true;
-    }
-
-    soundio_os_mutex_unlock(siw->mutex);
-
-    if (cb_shutdown)
-        soundio->on_backend_disconnect(soundio, siw->shutdown_err);
-    else if (change)
-        soundio->on_devices_change(soundio);
-
-    soundio_destroy_devices_info(old_devices_info);
-}
-
-static void flush_events_wasapi(struct SoundIoPrivate *si) {
-    my_flush_events(si, false);
-}
-
-static void wait_events_wasapi(struct SoundIoPrivate *si) {
-    my_flush_events(si, false);
-    my_flush_events(si, true);
-}
-
-static void wakeup_wasapi(struct SoundIoPrivate *si) {
-    struct SoundIoWasapi *siw = &si->backend_data.wasapi;
-    soundio_os_cond_signal(siw->cond, siw->mutex);
-}
-
 static void force_device_scan_wasapi(struct SoundIoPrivate *si) {
     struct SoundIoWasapi *siw = &si->backend_data.wasapi;
     soundio_os_mutex_lock(siw->scan_devices_mutex);
@@ -1203,6 +1228,8 @@ static void outstream_thread_deinit(struct SoundIoPrivate *si, struct SoundIoOut
         IUnknown_Release(osw->audio_session_control);
     if (osw->audio_clock_adjustment)
         IUnknown_Release(osw->audio_clock_adjustment);
+    if (osw->audio_clock)
+        IUnknown_Release(osw->audio_clock);
     if (osw->audio_client)
         IUnknown_Release(osw->audio_client);
 }
@@ -1243,6 +1270,36 @@ static void outstream_destroy_wasapi(struct SoundIoPrivate *si, struct SoundIoOu
     osw->mutex = NULL;
 }
 
+// The clock is optional; without it positions are worked out from the
+// padding.
+static void get_audio_clock(IAudioClient *audio_client, IAudioClock **out_clock, UINT64 *out_frequency) {
+    IAudioClock *audio_clock;
+    if (FAILED(IAudioClient_GetService(audio_client, IID_IAUDIOCLOCK, (void **)&audio_clock)))
+        return;
+    UINT64 frequency;
+    if (FAILED(IAudioClock_GetFrequency(audio_clock, &frequency)) || frequency == 0) {
+        IUnknown_Release(audio_clock);
+        return;
+    }
+    *out_clock = audio_clock;
+    *out_frequency = frequency;
+}
+
+// How many frames the device had played or captured, and when, in
+// soundio_os_get_time.
+static bool get_clock_position(IAudioClock *audio_clock, UINT64 frequency, int sample_rate,
+        double *out_frames, double *out_time)
+{
+    UINT64 position;
+    UINT64 qpc_position;
+    if (!audio_clock || FAILED(IAudioClock_GetPosition(audio_clock, &position, &qpc_position)))
+        return false;
+    *out_frames = position * (double)sample_rate / (double)frequency;
+    // the performance counter, in 100 ns units
+    *out_time = qpc_position / 10000000.0;
+    return true;
+}
+
 static int outstream_do_open(struct SoundIoPrivate *si, struct SoundIoOutStreamPrivate *os) {
     struct SoundIoOutStreamWasapi *osw = &os->backend_data.wasapi;
     struct SoundIoOutStream *outstream = &os->pub;
@@ -1269,7 +1326,7 @@ static int outstream_do_open(struct SoundIoPrivate *si, struct SoundIoOutStreamP
         wave_format.Format.nSamplesPerSec = outstream->sample_rate;
         flags = AUDCLNT_STREAMFLAGS_EVENTCALLBACK;
         share_mode = AUDCLNT_SHAREMODE_EXCLUSIVE;
-        periodicity = to_reference_time(dw->period_duration);
+        periodicity = aligned_period(dw->period_duration, outstream->sample_rate);
         buffer_duration = periodicity;
     } else {
         WAVEFORMATEXTENSIBLE *mix_format;
@@ -1290,7 +1347,14 @@ static int outstream_do_open(struct SoundIoPrivate *si, struct SoundIoOutStreamP
     to_wave_format_format(outstream->format, &wave_format);
     complete_wave_format_data(&wave_format);
 
-    if (FAILED(hr = IAudioClient_Initialize(osw->audio_client, share_mode, flags,
+    // only the engine's period below its default needs IAudioClient3, and
+    // it cannot convert rates
+    bool low_latency = !osw->is_raw && !osw->need_resample && outstream->software_latency > 0.0 &&
+        outstream->software_latency < dw->period_duration &&
+        initialize_low_latency_shared(osw->audio_client, (WAVEFORMATEX*)&wave_format,
+                outstream->software_latency);
+
+    if (!low_latency && FAILED(hr = IAudioClient_Initialize(osw->audio_client, share_mode, flags,
             buffer_duration, periodicity, (WAVEFORMATEX*)&wave_format, NULL)))
     {
         if (hr == AUDCLNT_E_BUFFER_SIZE_NOT_ALIGNED) {
@@ -1320,7 +1384,8 @@ static int outstream_do_open(struct SoundIoPrivate *si, struct SoundIoOutStreamP
                 complete_wave_format_data(&wave_format);
             }
 
-            buffer_duration = to_reference_time(osw->buffer_frame_count / (double)outstream->sample_rate);
+            // the size which the device asked to be aligned to
+            buffer_duration = frames_to_reference_time(osw->buffer_frame_count, outstream->sample_rate);
             if (osw->is_raw)
                 periodicity = buffer_duration;
             if (FAILED(hr = IAudioClient_Initialize(osw->audio_client, share_mode, flags,
@@ -1383,6 +1448,8 @@ static int outstream_do_open(struct SoundIoPrivate *si, struct SoundIoOutStreamP
         return SoundIoErrorOpeningDevice;
     }
 
+    get_audio_clock(osw->audio_client, &osw->audio_clock, &osw->clock_frequency);
+
     if (FAILED(hr = IAudioClient_GetService(osw->audio_client, IID_ISIMPLEAUDIOVOLUME,
                     (void **)&osw->audio_volume_control)))
     {
@@ -1397,6 +1464,28 @@ static int outstream_do_open(struct SoundIoPrivate *si, struct SoundIoOutStreamP
     return 0;
 }
 
+static void outstream_report_clock(struct SoundIoOutStreamPrivate *os) {
+    struct SoundIoOutStream *outstream = &os->pub;
+    struct SoundIoOutStreamWasapi *osw = &os->backend_data.wasapi;
+    double played;
+    double time;
+    if (!get_clock_position(osw->audio_clock, osw->clock_frequency, outstream->sample_rate, &played, &time))
+        return;
+    soundio_outstream_report_timestamp(os, time,
+            ((double)osw->frames_written - played) / outstream->sample_rate);
+}
+
+static void instream_report_clock(struct SoundIoInStreamPrivate *is) {
+    struct SoundIoInStream *instream = &is->pub;
+    struct SoundIoInStreamWasapi *isw = &is->backend_data.wasapi;
+    double captured;
+    double time;
+    if (!get_clock_position(isw->audio_clock, isw->clock_frequency, instream->sample_rate, &captured, &time))
+        return;
+    soundio_instream_report_timestamp(is, time,
+            (captured - (double)is->frames_committed) / instream->sample_rate);
+}
+
 static void outstream_shared_run(struct SoundIoOutStreamPrivate *os) {
     struct SoundIoOutStreamWasapi *osw = &os->backend_data.wasapi;
     struct SoundIoOutStream *outstream = &os->pub;
@@ -1414,14 +1503,18 @@ static void outstream_shared_run(struct SoundIoOutStreamPrivate *os) {
         return;
     }
     int frame_count_min = soundio_int_max(0, (int)osw->min_padding_frames - (int)frames_used);
-    outstream->write_callback(outstream, frame_count_min, writable_frame_count);
+    soundio_outstream_run_write_callback(os, frame_count_min, writable_frame_count);
 
+    soundio_os_sleep_until(os->start_deadline);
     if (FAILED(hr = IAudioClient_Start(osw->audio_client))) {
         outstream->error_callback(outstream, SoundIoErrorStreaming);
         return;
     }
 
     for (;;) {
+        // the engine signals once a period; pausing, clearing and
+        // destroying signal it too
+        WaitForSingleObject(osw->h_event, INFINITE);
         if (!SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(osw->thread_exit_flag))
             return;
         bool reset_buffer = false;
@@ -1438,6 +1531,7 @@ static void outstream_shared_run(struct SoundIoOutStreamPrivate *os) {
                 return;
             }
             SOUNDIO_ATOMIC_FLAG_CLEAR(osw->pause_resume_flag);
+            osw->frames_written = 0;
             reset_buffer = true;
         }
         if (!SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(osw->pause_resume_flag)) {
@@ -1464,9 +1558,10 @@ static void outstream_shared_run(struct SoundIoOutStreamPrivate *os) {
         int writable_frame_count = osw->buffer_frame_count - frames_used;
         if (writable_frame_count > 0) {
             if (frames_used == 0 && !reset_buffer)
-                outstream->underflow_callback(outstream);
+                soundio_outstream_run_underflow_callback(os);
             int frame_count_min = soundio_int_max(0, (int)osw->min_padding_frames - (int)frames_used);
-            outstream->write_callback(outstream, frame_count_min, writable_frame_count);
+            outstream_report_clock(os);
+            soundio_outstream_run_write_callback(os, frame_count_min, writable_frame_count);
         }
     }
 }
@@ -1477,8 +1572,9 @@ static void outstream_raw_run(struct SoundIoOutStreamPrivate *os) {
 
     HRESULT hr;
 
-    outstream->write_callback(outstream, osw->buffer_frame_count, osw->buffer_frame_count);
+    soundio_outstream_run_write_callback(os, osw->buffer_frame_count, osw->buffer_frame_count);
 
+    soundio_os_sleep_until(os->start_deadline);
     if (FAILED(hr = IAudioClient_Start(osw->audio_client))) {
         outstream->error_callback(outstream, SoundIoErrorStreaming);
         return;
@@ -1505,7 +1601,8 @@ static void outstream_raw_run(struct SoundIoOutStreamPrivate *os) {
             }
         }
 
-        outstream->write_callback(outstream, osw->buffer_frame_count, osw->buffer_frame_count);
+        outstream_report_clock(os);
+        soundio_outstream_run_write_callback(os, osw->buffer_frame_count, osw->buffer_frame_count);
     }
 }
 
@@ -1556,7 +1653,6 @@ static int outstream_open_wasapi(struct SoundIoPrivate *si, struct SoundIoOutStr
     struct SoundIoOutStreamWasapi *osw = &os->backend_data.wasapi;
     struct SoundIoOutStream *outstream = &os->pub;
     struct SoundIoDevice *device = outstream->device;
-    struct SoundIo *soundio = &si->pub;
 
     SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(osw->pause_resume_flag);
     SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(osw->clear_buffer_flag);
@@ -1594,8 +1690,8 @@ static int outstream_open_wasapi(struct SoundIoPrivate *si, struct SoundIoOutStr
 
     SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(osw->thread_exit_flag);
     int err;
-    if ((err = soundio_os_thread_create(outstream_thread_run, os,
-                    soundio->emit_rtprio_warning, &osw->thread)))
+    if ((err = soundio_outstream_thread_create(os, outstream_thread_run,
+                    outstream->software_latency, &osw->thread)))
     {
         outstream_destroy_wasapi(si, os);
         return err;
@@ -1668,6 +1764,7 @@ static int outstream_end_write_wasapi(struct SoundIoPrivate *si, struct SoundIoO
     if (FAILED(hr = IAudioRenderClient_ReleaseBuffer(osw->audio_render_client, osw->write_frame_count, 0))) {
         return SoundIoErrorStreaming;
     }
+    osw->frames_written += osw->write_frame_count;
     return 0;
 }
 
@@ -1720,6 +1817,8 @@ static void instream_thread_deinit(struct SoundIoPrivate *si, struct SoundIoInSt
 
     if (isw->audio_capture_client)
         IUnknown_Release(isw->audio_capture_client);
+    if (isw->audio_clock)
+        IUnknown_Release(isw->audio_clock);
     if (isw->audio_client)
         IUnknown_Release(isw->audio_client);
 }
@@ -1782,7 +1881,7 @@ static int instream_do_open(struct SoundIoPrivate *si, struct SoundIoInStreamPri
         wave_format.Format.nSamplesPerSec = instream->sample_rate;
         flags = AUDCLNT_STREAMFLAGS_EVENTCALLBACK;
         share_mode = AUDCLNT_SHAREMODE_EXCLUSIVE;
-        periodicity = to_reference_time(dw->period_duration);
+        periodicity = aligned_period(dw->period_duration, instream->sample_rate);
         buffer_duration = periodicity;
     } else {
         WAVEFORMATEXTENSIBLE *mix_format;
@@ -1832,7 +1931,7 @@ static int instream_do_open(struct SoundIoPrivate *si, struct SoundIoInStreamPri
                 complete_wave_format_data(&wave_format);
             }
 
-            buffer_duration = to_reference_time(isw->buffer_frame_count / (double)instream->sample_rate);
+            buffer_duration = frames_to_reference_time(isw->buffer_frame_count, instream->sample_rate);
             if (isw->is_raw)
                 periodicity = buffer_duration;
             if (FAILED(hr = IAudioClient_Initialize(isw->audio_client, share_mode, flags,
@@ -1894,6 +1993,8 @@ static int instream_do_open(struct SoundIoPrivate *si, struct SoundIoInStreamPri
         return SoundIoErrorOpeningDevice;
     }
 
+    get_audio_clock(isw->audio_client, &isw->audio_clock, &isw->clock_frequency);
+
     return 0;
 }
 
@@ -1903,6 +2004,7 @@ static void instream_raw_run(struct SoundIoInStreamPrivate *is) {
 
     HRESULT hr;
 
+    soundio_os_sleep_until(is->start_deadline);
     if (FAILED(hr = IAudioClient_Start(isw->audio_client))) {
         instream->error_callback(instream, SoundIoErrorStreaming);
         return;
@@ -1913,7 +2015,8 @@ static void instream_raw_run(struct SoundIoInStreamPrivate *is) {
         if (!SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(isw->thread_exit_flag))
             return;
 
-        instream->read_callback(instream, isw->buffer_frame_count, isw->buffer_frame_count);
+        instream_report_clock(is);
+        soundio_instream_run_read_callback(is, isw->buffer_frame_count, isw->buffer_frame_count);
     }
 }
 
@@ -1923,6 +2026,7 @@ static void instream_shared_run(struct SoundIoInStreamPrivate *is) {
 
     HRESULT hr;
 
+    soundio_os_sleep_until(is->start_deadline);
     if (FAILED(hr = IAudioClient_Start(isw->audio_client))) {
         instream->error_callback(instream, SoundIoErrorStreaming);
         return;
@@ -1944,8 +2048,10 @@ static void instream_shared_run(struct SoundIoInStreamPrivate *is) {
         }
 
         isw->readable_frame_count = frames_available;
-        if (isw->readable_frame_count > 0)
-            instream->read_callback(instream, 0, isw->readable_frame_count);
+        if (isw->readable_frame_count > 0) {
+            instream_report_clock(is);
+            soundio_instream_run_read_callback(is, 0, isw->readable_frame_count);
+        }
     }
 }
 
@@ -1996,7 +2102,6 @@ static int instream_open_wasapi(struct SoundIoPrivate *si, struct SoundIoInStrea
     struct SoundIoInStreamWasapi *isw = &is->backend_data.wasapi;
     struct SoundIoInStream *instream = &is->pub;
     struct SoundIoDevice *device = instream->device;
-    struct SoundIo *soundio = &si->pub;
 
     // All the COM functions are supposed to be called from the same thread. libsoundio API does not
     // restrict the calling thread context in this way. Furthermore, the user might have called
@@ -2032,8 +2137,8 @@ static int instream_open_wasapi(struct SoundIoPrivate *si, struct SoundIoInStrea
 
     SOUNDIO_ATOMIC_FLAG_TEST_AND_SET(isw->thread_exit_flag);
     int err;
-    if ((err = soundio_os_thread_create(instream_thread_run, is,
-                    soundio->emit_rtprio_warning, &isw->thread)))
+    if ((err = soundio_instream_thread_create(is, instream_thread_run,
+                    instream->software_latency, &isw->thread)))
     {
         instream_destroy_wasapi(si, is);
         return err;
@@ -2162,19 +2267,11 @@ static void destroy_wasapi(struct SoundIoPrivate *si) {
         soundio_os_thread_destroy(siw->thread);
     }
 
-    if (siw->cond)
-        soundio_os_cond_destroy(siw->cond);
-
     if (siw->scan_devices_cond)
         soundio_os_cond_destroy(siw->scan_devices_cond);
 
     if (siw->scan_devices_mutex)
         soundio_os_mutex_destroy(siw->scan_devices_mutex);
-
-    if (siw->mutex)
-        soundio_os_mutex_destroy(siw->mutex);
-
-    soundio_destroy_devices_info(siw->ready_devices_info);
 }
 
 static inline struct SoundIoPrivate *soundio_MMNotificationClient_si(IMMNotificationClient *client) {
@@ -2258,24 +2355,12 @@ int soundio_wasapi_init(struct SoundIoPrivate *si) {
 
     siw->device_scan_queued = true;
 
-    siw->mutex = soundio_os_mutex_create();
-    if (!siw->mutex) {
-        destroy_wasapi(si);
-        return SoundIoErrorNoMem;
-    }
-
     siw->scan_devices_mutex = soundio_os_mutex_create();
     if (!siw->scan_devices_mutex) {
         destroy_wasapi(si);
         return SoundIoErrorNoMem;
     }
 
-    siw->cond = soundio_os_cond_create();
-    if (!siw->cond) {
-        destroy_wasapi(si);
-        return SoundIoErrorNoMem;
-    }
-
     siw->scan_devices_cond = soundio_os_cond_create();
     if (!siw->scan_devices_cond) {
         destroy_wasapi(si);
@@ -2285,16 +2370,17 @@ int soundio_wasapi_init(struct SoundIoPrivate *si) {
     siw->device_events.lpVtbl = &soundio_MMNotificationClient;
     siw->device_events_refs = 1;
 
-    if ((err = soundio_os_thread_create(device_thread_run, si, NULL, &siw->thread))) {
+    if ((err = soundio_os_thread_create(device_thread_run, si, NULL, false, NULL, &siw->thread))) {
         destroy_wasapi(si);
         return err;
     }
 
     si->destroy = destroy_wasapi;
-    si->flush_events = flush_events_wasapi;
-    si->wait_events = wait_events_wasapi;
-    si->wakeup = wakeup_wasapi;
+    si->flush_events = soundio_events_flush;
+    si->wait_events = soundio_events_wait;
+    si->wakeup = soundio_events_wakeup;
     si->force_device_scan = force_device_scan_wasapi;
+    si->waits_for_start_deadline = true;
 
     si->outstream_open = outstream_open_wasapi;
     si->outstream_destroy = outstream_destroy_wasapi;
@@ -41,18 +41,11 @@ struct SoundIoDeviceWasapi {
 };
 
 struct SoundIoWasapi {
-    struct SoundIoOsMutex *mutex;
-    struct SoundIoOsCond *cond;
     struct SoundIoOsCond *scan_devices_cond;
     struct SoundIoOsMutex *scan_devices_mutex;
     struct SoundIoOsThread *thread;
     bool abort_flag;
-    // this one is ready to be read with flush_events. protected by mutex
-    struct SoundIoDevicesInfo *ready_devices_info;
-    bool have_devices_flag;
     bool device_scan_queued;
-    int shutdown_err;
-    bool emitted_shutdown_cb;
 
     IMMDeviceEnumerator* device_enumerator;
     IMMNotificationClient device_events;
@@ -62,6 +55,9 @@ struct SoundIoWasapi {
 struct SoundIoOutStreamWasapi {
     IAudioClient *audio_client;
     IAudioClockAdjustment *audio_clock_adjustment;
+    // Optional. clock_frequency is in position units per second.
+    IAudioClock *audio_clock;
+    UINT64 clock_frequency;
     IAudioRenderClient *audio_render_client;
     IAudioSessionControl *audio_session_control;
     ISimpleAudioVolume *audio_volume_control;
@@ -84,6 +80,9 @@ struct SoundIoOutStreamWasapi {
     int open_err;
     bool started;
     UINT32 min_padding_frames;
+    // Released to the device since it started or was last reset, which is
+    // where the clock counts from.
+    UINT64 frames_written;
     float volume;
     struct SoundIoChannelArea areas[SOUNDIO_MAX_CHANNELS];
 };
@@ -91,6 +90,8 @@ struct SoundIoOutStreamWasapi {
 struct SoundIoInStreamWasapi {
     IAudioClient *audio_client;
     IAudioCaptureClient *audio_capture_client;
+    IAudioClock *audio_clock;
+    UINT64 clock_frequency;
     IAudioSessionControl *audio_session_control;
     LPWSTR stream_name;
     struct SoundIoOsThread *thread;
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "xrun_policy.h"
+#include "util.h"
+
+#include <string.h>
+
+void soundio_xrun_tracker_init(struct SoundIoXrunTracker *tracker) {
+    memset(tracker, 0, sizeof(struct SoundIoXrunTracker));
+}
+
+void soundio_xrun_tracker_start(struct SoundIoXrunTracker *tracker,
+        const struct SoundIoXrunPolicy *policy, double latency, double latency_max, double now)
+{
+    soundio_xrun_tracker_init(tracker);
+    tracker->latency = latency;
+    tracker->latency_min = latency;
+    tracker->latency_max = latency;
+    if (policy->latency_step <= 0.0 || latency_max <= latency)
+        return;
+
+    tracker->adaptive = true;
+    tracker->step = policy->latency_step;
+    double requested_max = (policy->latency_max > 0.0) ? policy->latency_max : latency + policy->latency_step;
+    tracker->latency_max = soundio_double_clamp(latency, requested_max, latency_max);
+    tracker->grow_count = soundio_int_clamp(1, policy->grow_xrun_count, SOUNDIO_XRUN_POLICY_HISTORY);
+    tracker->grow_window = policy->grow_window;
+    tracker->shrink_after = policy->shrink_after;
+    tracker->quiet_since = now;
+}
+
+bool soundio_xrun_tracker_xrun(struct SoundIoXrunTracker *tracker, double now) {
+    if (!tracker->adaptive)
+        return false;
+    tracker->quiet_since = now;
+
+    if (tracker->xrun_count == tracker->grow_count) {
+        memmove(tracker->xrun_times, tracker->xrun_times + 1, (tracker->xrun_count - 1) * sizeof(double));
+        tracker->xrun_count -= 1;
+    }
+    tracker->xrun_times[tracker->xrun_count] = now;
+    tracker->xrun_count += 1;
+
+    if (tracker->xrun_count < tracker->grow_count)
+        return false;
+    if (tracker->grow_count > 1 && now - tracker->xrun_times[0] > tracker->grow_window)
+        return false;
+    if (tracker->latency >= tracker->latency_max)
+        return false;
+
+    tracker->latency = soundio_double_min(tracker->latency + tracker->step, tracker->latency_max);
+    tracker->xrun_count = 0;
+    return true;
+}
+
+bool soundio_xrun_tracker_tick(struct SoundIoXrunTracker *tracker, double now) {
+    if (!tracker->adaptive || tracker->shrink_after <= 0.0)
+        return false;
+    if (tracker->latency <= tracker->latency_min)
+        return false;
+    if (now - tracker->quiet_since < tracker->shrink_after)
+        return false;
+
+    tracker->latency = soundio_double_max(tracker->latency - tracker->step, tracker->latency_min);
+    tracker->quiet_since = now;
+    return true;
+}
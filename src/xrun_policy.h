@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#ifndef SOUNDIO_XRUN_POLICY_H
+#define SOUNDIO_XRUN_POLICY_H
+
+#include "soundio_internal.h"
+
+// The most SoundIoXrunPolicy::grow_xrun_count can be; soundio.h documents it.
+#define SOUNDIO_XRUN_POLICY_HISTORY 16
+
+// Decides the latency of an output stream from its underflows, the way
+// SoundIoXrunPolicy describes. Only used from the thread which runs the
+// stream callbacks, and with the clock the backend runs the stream by.
+struct SoundIoXrunTracker {
+    // Off unless the backend can change how much it keeps queued.
+    bool adaptive;
+    // In seconds, between latency_min and latency_max.
+    double latency;
+    double latency_min;
+    double latency_max;
+    double step;
+    int grow_count;
+    double grow_window;
+    double shrink_after;
+    // The times of the last grow_count underflows since the latency last
+    // grew, oldest first.
+    double xrun_times[SOUNDIO_XRUN_POLICY_HISTORY];
+    int xrun_count;
+    // When the stream last underflowed or last changed its latency.
+    double quiet_since;
+};
+
+// Leaves the tracker off.
+void soundio_xrun_tracker_init(struct SoundIoXrunTracker *tracker);
+
+// Turns adapting on when `policy` has a latency step. The latency starts at
+// `latency` and grows to at most `latency_max`, which is the most the
+// backend's buffer holds.
+void soundio_xrun_tracker_start(struct SoundIoXrunTracker *tracker,
+        const struct SoundIoXrunPolicy *policy, double latency, double latency_max, double now);
+
+// Call for each underflow, and for each wakeup without one. Both return
+// whether the latency changed.
+bool soundio_xrun_tracker_xrun(struct SoundIoXrunTracker *tracker, double now);
+bool soundio_xrun_tracker_tick(struct SoundIoXrunTracker *tracker, double now);
+
+#endif
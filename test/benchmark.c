@@ -0,0 +1,372 @@
+/*
+ * Copyright (c) 2015 Andrew Kelley
+ *
+ * This file is part of libsoundio, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "soundio_private.h"
+#include "os.h"
+#include "util.h"
+#include "atomics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Prints one result per line, as JSON objects in an array or as CSV, so
+// that results of different releases can be compared by a script.
+
+static int usage(char *exe) {
+    fprintf(stderr, "Usage: %s [options]\n"
+            "Options:\n"
+            "  [--format json|csv]\n"
+            "  [--backend dummy|alsa|pulseaudio|jack|coreaudio|wasapi]\n"
+            "  [--duration seconds]   how long to run each stream\n"
+            "  [--threads count]      most ring buffer pairs to run at once\n"
+            , exe);
+    return 1;
+}
+
+enum OutputFormat {
+    OutputFormatJson,
+    OutputFormatCsv,
+};
+
+static enum OutputFormat output_format = OutputFormatJson;
+static int result_count = 0;
+
+static void report(const char *benchmark, const char *variant, const char *metric,
+        double value, const char *unit)
+{
+    switch (output_format) {
+    case OutputFormatJson:
+        printf("%s  {\"benchmark\": \"%s\", \"variant\": \"%s\", \"metric\": \"%s\", "
+                "\"value\": %.9g, \"unit\": \"%s\"}",
+                result_count ? ",\n" : "", benchmark, variant, metric, value, unit);
+        break;
+    case OutputFormatCsv:
+        printf("%s,%s,%s,%.9g,%s\n", benchmark, variant, metric, value, unit);
+        break;
+    }
+    result_count += 1;
+}
+
+// Ring buffer throughput. Each pair is one writer and one reader thread
+// moving a fixed number of bytes through its own ring buffer.
+
+#define MAX_RING_BUFFER_PAIRS 64
+static const int ring_buffer_chunk_size = 256;
+static const long ring_buffer_total_bytes = 16L * 1024 * 1024;
+
+struct RingBufferPair {
+    struct SoundIoRingBuffer *ring_buffer;
+    long ops;
+};
+
+static void ring_buffer_writer_run(void *arg) {
+    struct RingBufferPair *pair = (struct RingBufferPair *)arg;
+    long written = 0;
+    while (written < ring_buffer_total_bytes) {
+        int byte_count = ring_buffer_chunk_size;
+        char *ptr = soundio_ring_buffer_begin_write(pair->ring_buffer, &byte_count);
+        if (byte_count < ring_buffer_chunk_size)
+            continue;
+        memset(ptr, (int)written, byte_count);
+        soundio_ring_buffer_end_write(pair->ring_buffer, byte_count);
+        written += byte_count;
+    }
+}
+
+static void ring_buffer_reader_run(void *arg) {
+    struct RingBufferPair *pair = (struct RingBufferPair *)arg;
+    long read = 0;
+    long ops = 0;
+    char chunk[256];
+    while (read < ring_buffer_total_bytes) {
+        int byte_count = ring_buffer_chunk_size;
+        char *ptr = soundio_ring_buffer_begin_read(pair->ring_buffer, &byte_count);
+        if (byte_count == 0)
+            continue;
+        memcpy(chunk, ptr, byte_count);
+        soundio_ring_buffer_end_read(pair->ring_buffer, byte_count);
+        read += byte_count;
+        ops += 1;
+    }
+    pair->ops = ops;
+}
+
+static void bench_ring_buffer(struct SoundIo *soundio, int pair_count) {
+    struct RingBufferPair pairs[MAX_RING_BUFFER_PAIRS];
+    struct SoundIoOsThread *threads[MAX_RING_BUFFER_PAIRS * 2];
+    int thread_count = 0;
+
+    for (int i = 0; i < pair_count; i += 1) {
+        pairs[i].ring_buffer = soundio_ring_buffer_create_ex(soundio, 64 * 1024,
+                SoundIoRingBufferFlagStrictRoles);
+        if (!pairs[i].ring_buffer)
+            soundio_panic("out of memory");
+        pairs[i].ops = 0;
+    }
+
+    double start = soundio_os_get_time();
+    int err;
+    for (int i = 0; i < pair_count; i += 1) {
+        if ((err = soundio_os_thread_create(ring_buffer_writer_run, &pairs[i], NULL, false, NULL, &threads[thread_count++])))
+            soundio_panic("unable to create thread: %s", soundio_strerror(err));
+        if ((err = soundio_os_thread_create(ring_buffer_reader_run, &pairs[i], NULL, false, NULL, &threads[thread_count++])))
+            soundio_panic("unable to create thread: %s", soundio_strerror(err));
+    }
+    for (int i = 0; i < thread_count; i += 1)
+        soundio_os_thread_destroy(threads[i]);
+    double elapsed = soundio_os_get_time() - start;
+
+    long total_ops = 0;
+    for (int i = 0; i < pair_count; i += 1) {
+        total_ops += pairs[i].ops;
+        soundio_ring_buffer_destroy(pairs[i].ring_buffer);
+    }
+
+    char variant[32];
+    snprintf(variant, sizeof(variant), "%d pairs", pair_count);
+    report("ring_buffer", variant, "throughput", pair_count * ring_buffer_total_bytes / elapsed, "bytes/s");
+    report("ring_buffer", variant, "operations", total_ops / elapsed, "reads/s");
+}
+
+// Conversion kernels, on interleaved stereo.
+
+static void bench_converter(enum SoundIoFormat src_format, enum SoundIoFormat dest_format, int flags) {
+    static const int frame_count = 4096;
+    static const int iterations = 256;
+    static const int channel_count = 2;
+
+    struct SoundIoConverter *converter = soundio_converter_create(src_format, dest_format, flags);
+    if (!converter)
+        soundio_panic("out of memory");
+
+    int src_bytes = soundio_get_bytes_per_sample(src_format);
+    int dest_bytes = soundio_get_bytes_per_sample(dest_format);
+    char *src = ALLOCATE(char, frame_count * channel_count * src_bytes);
+    char *dest = ALLOCATE(char, frame_count * channel_count * dest_bytes);
+    if (!src || !dest)
+        soundio_panic("out of memory");
+
+    struct SoundIoChannelArea src_areas[2];
+    struct SoundIoChannelArea dest_areas[2];
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        src_areas[ch].ptr = src + ch * src_bytes;
+        src_areas[ch].step = channel_count * src_bytes;
+        dest_areas[ch].ptr = dest + ch * dest_bytes;
+        dest_areas[ch].step = channel_count * dest_bytes;
+    }
+
+    double start = soundio_os_get_time();
+    for (int i = 0; i < iterations; i += 1)
+        soundio_converter_convert(converter, src_areas, dest_areas, channel_count, frame_count);
+    double elapsed = soundio_os_get_time() - start;
+
+    char variant[128];
+    snprintf(variant, sizeof(variant), "%s to %s%s (%s)", soundio_format_string(src_format),
+            soundio_format_string(dest_format), (flags & SoundIoConvertFlagDither) ? " dithered" : "",
+            soundio_converter_kernel_name(converter));
+    report("converter", variant, "throughput",
+            (double)iterations * frame_count * channel_count / elapsed, "samples/s");
+
+    free(src);
+    free(dest);
+    soundio_converter_destroy(converter);
+}
+
+// Streams. The write callback only writes silence, so what the statistics
+// show is mostly the cost of the library and the backend.
+
+static struct SoundIoAtomicBool got_first_callback;
+static double first_callback_time;
+
+static void write_callback(struct SoundIoOutStream *outstream, int frame_count_min, int frame_count_max) {
+    if (!SOUNDIO_ATOMIC_LOAD(got_first_callback)) {
+        first_callback_time = soundio_os_get_time();
+        SOUNDIO_ATOMIC_STORE(got_first_callback, true);
+    }
+
+    int frames_left = frame_count_max;
+    while (frames_left > 0) {
+        struct SoundIoChannelArea *areas;
+        int frame_count = frames_left;
+        int err;
+        if ((err = soundio_outstream_begin_write(outstream, &areas, &frame_count)))
+            soundio_panic("begin write: %s", soundio_strerror(err));
+        if (!frame_count)
+            break;
+        for (int frame = 0; frame < frame_count; frame += 1) {
+            for (int ch = 0; ch < outstream->layout.channel_count; ch += 1) {
+                memset(areas[ch].ptr, 0, outstream->bytes_per_sample);
+                areas[ch].ptr += areas[ch].step;
+            }
+        }
+        if ((err = soundio_outstream_end_write(outstream)))
+            soundio_panic("end write: %s", soundio_strerror(err));
+        frames_left -= frame_count;
+    }
+}
+
+static void underflow_callback(struct SoundIoOutStream *outstream) { }
+
+static void bench_backend(enum SoundIoBackend backend, double duration) {
+    const char *variant = soundio_backend_name(backend);
+    struct SoundIo *soundio = soundio_create();
+    if (!soundio)
+        soundio_panic("out of memory");
+
+    double start = soundio_os_get_time();
+    int err;
+    if ((err = soundio_connect_backend(soundio, backend))) {
+        fprintf(stderr, "%s: unable to connect: %s\n", variant, soundio_strerror(err));
+        soundio_destroy(soundio);
+        return;
+    }
+    soundio_flush_events(soundio);
+    report("device_enumeration", variant, "connect_and_scan", soundio_os_get_time() - start, "s");
+    report("device_enumeration", variant, "devices",
+            soundio_output_device_count(soundio) + soundio_input_device_count(soundio), "count");
+
+    int device_index = soundio_default_output_device_index(soundio);
+    if (device_index < 0) {
+        fprintf(stderr, "%s: no output device\n", variant);
+        soundio_destroy(soundio);
+        return;
+    }
+    struct SoundIoDevice *device = soundio_get_output_device(soundio, device_index);
+    struct SoundIoOutStream *outstream = soundio_outstream_create(device);
+    if (!device || !outstream)
+        soundio_panic("out of memory");
+    outstream->write_callback = write_callback;
+    outstream->underflow_callback = underflow_callback;
+    // small enough to make many callbacks in a short run
+    outstream->software_latency = 0.01;
+
+    start = soundio_os_get_time();
+    if ((err = soundio_outstream_open(outstream))) {
+        fprintf(stderr, "%s: unable to open stream: %s\n", variant, soundio_strerror(err));
+        goto done;
+    }
+    report("stream", variant, "open_time", soundio_os_get_time() - start, "s");
+
+    SOUNDIO_ATOMIC_STORE(got_first_callback, false);
+    start = soundio_os_get_time();
+    if ((err = soundio_outstream_start(outstream))) {
+        fprintf(stderr, "%s: unable to start stream: %s\n", variant, soundio_strerror(err));
+        goto done;
+    }
+    report("stream", variant, "start_time", soundio_os_get_time() - start, "s");
+
+    struct SoundIoOsCond *cond = soundio_os_cond_create();
+    if (!cond)
+        soundio_panic("out of memory");
+    double now;
+    while ((now = soundio_os_get_time()) - start < duration) {
+        soundio_os_cond_timed_wait(cond, NULL, duration - (now - start));
+        soundio_flush_events(soundio);
+    }
+    soundio_os_cond_destroy(cond);
+
+    if (SOUNDIO_ATOMIC_LOAD(got_first_callback))
+        report("stream", variant, "first_callback_latency", first_callback_time - start, "s");
+
+    struct SoundIoStreamStats stats;
+    soundio_outstream_get_stats(outstream, &stats);
+    report("stream", variant, "callbacks", stats.callback_count, "count");
+    if (stats.callback_count) {
+        report("stream", variant, "library_time_per_callback",
+                stats.io_time / stats.callback_count, "s");
+        report("stream", variant, "callback_duration_max", stats.callback_duration_max, "s");
+        report("stream", variant, "wakeup_jitter_max", stats.wakeup_jitter_max, "s");
+    }
+    report("stream", variant, "xruns", stats.xrun_count, "count");
+
+done:
+    soundio_outstream_destroy(outstream);
+    soundio_device_unref(device);
+    soundio_destroy(soundio);
+}
+
+int main(int argc, char **argv) {
+    char *exe = argv[0];
+    enum SoundIoBackend backend = SoundIoBackendNone;
+    double duration = 1.0;
+    int max_pairs = 4;
+    for (int i = 1; i < argc; i += 1) {
+        char *arg = argv[i];
+        if (arg[0] == '-' && arg[1] == '-') {
+            i += 1;
+            if (i >= argc) {
+                return usage(exe);
+            } else if (strcmp(arg, "--format") == 0) {
+                if (strcmp(argv[i], "json") == 0) {
+                    output_format = OutputFormatJson;
+                } else if (strcmp(argv[i], "csv") == 0) {
+                    output_format = OutputFormatCsv;
+                } else {
+                    return usage(exe);
+                }
+            } else if (strcmp(arg, "--backend") == 0) {
+                if (strcmp("dummy", argv[i]) == 0) {
+                    backend = SoundIoBackendDummy;
+                } else if (strcmp("alsa", argv[i]) == 0) {
+                    backend = SoundIoBackendAlsa;
+                } else if (strcmp("pulseaudio", argv[i]) == 0) {
+                    backend = SoundIoBackendPulseAudio;
+                } else if (strcmp("jack", argv[i]) == 0) {
+                    backend = SoundIoBackendJack;
+                } else if (strcmp("coreaudio", argv[i]) == 0) {
+                    backend = SoundIoBackendCoreAudio;
+                } else if (strcmp("wasapi", argv[i]) == 0) {
+                    backend = SoundIoBackendWasapi;
+                } else {
+                    fprintf(stderr, "Invalid backend: %s\n", argv[i]);
+                    return 1;
+                }
+            } else if (strcmp(arg, "--duration") == 0) {
+                duration = atof(argv[i]);
+            } else if (strcmp(arg, "--threads") == 0) {
+                max_pairs = soundio_int_clamp(1, atoi(argv[i]), MAX_RING_BUFFER_PAIRS);
+            } else {
+                return usage(exe);
+            }
+        } else {
+            return usage(exe);
+        }
+    }
+
+    struct SoundIo *soundio = soundio_create();
+    if (!soundio)
+        soundio_panic("out of memory");
+
+    if (output_format == OutputFormatJson)
+        printf("[\n");
+    else
+        printf("benchmark,variant,metric,value,unit\n");
+
+    for (int pair_count = 1; pair_count <= max_pairs; pair_count *= 2)
+        bench_ring_buffer(soundio, pair_count);
+
+    bench_converter(SoundIoFormatFloat32NE, SoundIoFormatS16NE, SoundIoConvertFlagNone);
+    bench_converter(SoundIoFormatFloat32NE, SoundIoFormatS16NE, SoundIoConvertFlagDither);
+    bench_converter(SoundIoFormatS16NE, SoundIoFormatFloat32NE, SoundIoConvertFlagNone);
+    bench_converter(SoundIoFormatFloat32NE, SoundIoFormatS24NE, SoundIoConvertFlagNone);
+    bench_converter(SoundIoFormatS32NE, SoundIoFormatFloat32NE, SoundIoConvertFlagNone);
+    bench_converter(SoundIoFormatFloat32NE, SoundIoFormatFloat32FE, SoundIoConvertFlagNone);
+
+    if (backend != SoundIoBackendNone) {
+        bench_backend(backend, duration);
+    } else {
+        for (int i = 0; i < soundio_backend_count(soundio); i += 1)
+            bench_backend(soundio_get_backend(soundio, i), duration);
+    }
+
+    if (output_format == OutputFormatJson)
+        printf("\n]\n");
+
+    soundio_destroy(soundio);
+    return 0;
+}
@@ -4,11 +4,23 @@
 #include "os.h"
 #include "util.h"
 #include "atomics.h"
+#include "device_cache.h"
+#include "duplex_bridge.h"
+#include "duplex_stream.h"
+#include "mixer.h"
+#include "recorder.h"
+#include "file_source.h"
 
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
 #include <limits.h>
+#include <stdint.h>
+#include <math.h>
+
+#if defined(__linux__)
+#include <poll.h>
+#endif
 
 static inline void ok_or_panic(int err) {
     if (err)
@@ -98,6 +110,93 @@ static void test_ring_buffer_basic(void) {
     soundio_destroy(soundio);
 }
 
+static void test_ring_buffer_regions(void) {
+    struct SoundIo *soundio = soundio_create();
+    assert(soundio);
+    struct SoundIoRingBuffer *rb = soundio_ring_buffer_create_ex(soundio, 10,
+            SoundIoRingBufferFlagStrictRoles);
+    assert(rb);
+
+    int capacity = soundio_ring_buffer_capacity(rb);
+
+    int byte_count = capacity * 2;
+    char *write_ptr = soundio_ring_buffer_begin_write(rb, &byte_count);
+    assert(byte_count == capacity);
+    int amt = sprintf(write_ptr, "hello") + 1;
+    soundio_ring_buffer_end_write(rb, amt);
+
+    byte_count = capacity;
+    char *read_ptr = soundio_ring_buffer_begin_read(rb, &byte_count);
+    assert(byte_count == amt);
+    assert(strcmp(read_ptr, "hello") == 0);
+    // partial commit leaves the rest in the buffer
+    soundio_ring_buffer_end_read(rb, 2);
+    assert(soundio_ring_buffer_fill_count(rb) == amt - 2);
+
+    byte_count = capacity;
+    read_ptr = soundio_ring_buffer_begin_read(rb, &byte_count);
+    assert(byte_count == amt - 2);
+    assert(strcmp(read_ptr, "llo") == 0);
+    soundio_ring_buffer_end_read(rb, byte_count);
+
+    // the region is contiguous across the end of the capacity
+    byte_count = capacity - amt - 3;
+    soundio_ring_buffer_begin_write(rb, &byte_count);
+    soundio_ring_buffer_end_write(rb, byte_count);
+    byte_count = capacity;
+    soundio_ring_buffer_begin_read(rb, &byte_count);
+    soundio_ring_buffer_end_read(rb, byte_count);
+
+    byte_count = capacity;
+    write_ptr = soundio_ring_buffer_begin_write(rb, &byte_count);
+    assert(byte_count == capacity);
+    amt = sprintf(write_ptr, "writing past the end") + 1;
+    soundio_ring_buffer_end_write(rb, amt);
+
+    byte_count = 1;
+    read_ptr = soundio_ring_buffer_begin_read(rb, &byte_count);
+    assert(byte_count == 1);
+    assert(strcmp(read_ptr, "writing past the end") == 0);
+    soundio_ring_buffer_end_read(rb, 0);
+    assert(soundio_ring_buffer_fill_count(rb) == amt);
+
+    // the counts stay exact at the ends, where the cached offsets are used
+    byte_count = capacity;
+    soundio_ring_buffer_begin_read(rb, &byte_count);
+    soundio_ring_buffer_end_read(rb, byte_count);
+    assert(soundio_ring_buffer_free_count(rb) == capacity);
+    assert(soundio_ring_buffer_free_count(rb) == capacity);
+    byte_count = capacity;
+    soundio_ring_buffer_begin_write(rb, &byte_count);
+    soundio_ring_buffer_end_write(rb, byte_count);
+    assert(soundio_ring_buffer_fill_count(rb) == capacity);
+    assert(soundio_ring_buffer_fill_count(rb) == capacity);
+    assert(soundio_ring_buffer_free_count(rb) == 0);
+
+    // a clear by the writer empties the buffer the reader last saw full
+    soundio_ring_buffer_clear(rb);
+    assert(soundio_ring_buffer_fill_count(rb) == 0);
+    assert(soundio_ring_buffer_free_count(rb) == capacity);
+
+    // and a region the reader last saw room for is not handed out either
+    byte_count = capacity;
+    soundio_ring_buffer_begin_write(rb, &byte_count);
+    soundio_ring_buffer_end_write(rb, byte_count);
+    byte_count = 1;
+    soundio_ring_buffer_begin_read(rb, &byte_count);
+    assert(byte_count == 1);
+    soundio_ring_buffer_end_read(rb, 0);
+    soundio_ring_buffer_clear(rb);
+    byte_count = 1;
+    soundio_ring_buffer_begin_read(rb, &byte_count);
+    assert(byte_count == 0);
+    soundio_ring_buffer_end_read(rb, 0);
+    assert(soundio_ring_buffer_free_count(rb) == capacity);
+
+    soundio_ring_buffer_destroy(rb);
+    soundio_destroy(soundio);
+}
+
 static struct SoundIoRingBuffer *rb = NULL;
 static const int rb_size = 3528;
 static long expected_write_head;
@@ -126,7 +225,8 @@ static void reader_thread_run(void *arg) {
 static void writer_thread_run(void *arg) {
     while (!SOUNDIO_ATOMIC_LOAD(rb_done)) {
         SOUNDIO_ATOMIC_FETCH_ADD(rb_write_it, 1);
-        int fill_count = soundio_ring_buffer_fill_count(rb);
+        // the writer may only ask for the free count in strict roles mode
+        int fill_count = soundio_ring_buffer_capacity(rb) - soundio_ring_buffer_free_count(rb);
         assert(fill_count >= 0);
         assert(fill_count <= rb_size);
         int free_count = rb_size - fill_count;
@@ -138,10 +238,11 @@ static void writer_thread_run(void *arg) {
     }
 }
 
-static void test_ring_buffer_threaded(void) {
+static void run_ring_buffer_threaded(int flags) {
     struct SoundIo *soundio = soundio_create();
     assert(soundio);
-    rb = soundio_ring_buffer_create(soundio, rb_size);
+    rb = soundio_ring_buffer_create_ex(soundio, rb_size, flags);
+    assert(rb);
     expected_write_head = 0;
     expected_read_head = 0;
     SOUNDIO_ATOMIC_STORE(rb_read_it, 0);
@@ -149,10 +250,10 @@ static void test_ring_buffer_threaded(void) {
     SOUNDIO_ATOMIC_STORE(rb_done, false);
 
     struct SoundIoOsThread *reader_thread;
-    ok_or_panic(soundio_os_thread_create(reader_thread_run, NULL, NULL, &reader_thread));
+    ok_or_panic(soundio_os_thread_create(reader_thread_run, NULL, NULL, false, NULL, &reader_thread));
 
     struct SoundIoOsThread *writer_thread;
-    ok_or_panic(soundio_os_thread_create(writer_thread_run, NULL, NULL, &writer_thread));
+    ok_or_panic(soundio_os_thread_create(writer_thread_run, NULL, NULL, false, NULL, &writer_thread));
 
     while (SOUNDIO_ATOMIC_LOAD(rb_read_it) < 100000 || SOUNDIO_ATOMIC_LOAD(rb_write_it) < 100000) {}
     SOUNDIO_ATOMIC_STORE(rb_done, true);
@@ -163,6 +264,1395 @@ static void test_ring_buffer_threaded(void) {
     int fill_count = soundio_ring_buffer_fill_count(rb);
     int expected_fill_count = expected_write_head - expected_read_head;
     assert(fill_count == expected_fill_count);
+    soundio_ring_buffer_destroy(rb);
+    rb = NULL;
+    soundio_destroy(soundio);
+}
+
+static void test_ring_buffer_threaded(void) {
+    run_ring_buffer_threaded(SoundIoRingBufferFlagNone);
+}
+
+static void test_ring_buffer_strict_roles_threaded(void) {
+    run_ring_buffer_threaded(SoundIoRingBufferFlagStrictRoles);
+}
+
+#define BQ_PRODUCER_COUNT 4
+static const int bq_blocks_per_producer = 2000;
+static struct SoundIoBlockQueue *bq = NULL;
+static struct SoundIoAtomicInt bq_producer_ids;
+
+static void block_queue_producer_run(void *arg) {
+    int id = SOUNDIO_ATOMIC_FETCH_ADD(bq_producer_ids, 1);
+    for (int i = 0; i < bq_blocks_per_producer;) {
+        char *block = soundio_block_queue_begin_write(bq);
+        if (!block)
+            continue;
+        int msg[2] = {id, i};
+        memcpy(block, msg, sizeof(msg));
+        soundio_block_queue_end_write(bq, block, sizeof(msg));
+        i += 1;
+    }
+}
+
+static void test_block_queue_threaded(void) {
+    struct SoundIo *soundio = soundio_create();
+    assert(soundio);
+    bq = soundio_block_queue_create(soundio, 2 * sizeof(int), 100);
+    assert(bq);
+    assert(soundio_block_queue_block_count(bq) == 128);
+
+    int byte_count;
+    assert(!soundio_block_queue_begin_read(bq, &byte_count));
+    assert(byte_count == 0);
+
+    SOUNDIO_ATOMIC_STORE(bq_producer_ids, 0);
+    struct SoundIoOsThread *threads[BQ_PRODUCER_COUNT];
+    for (int i = 0; i < BQ_PRODUCER_COUNT; i += 1)
+        ok_or_panic(soundio_os_thread_create(block_queue_producer_run, NULL, NULL, false, NULL, &threads[i]));
+
+    // blocks from any one producer must come out in order
+    int next_expected[BQ_PRODUCER_COUNT] = {0};
+    int total = 0;
+    while (total < BQ_PRODUCER_COUNT * bq_blocks_per_producer) {
+        char *block = soundio_block_queue_begin_read(bq, &byte_count);
+        if (!block)
+            continue;
+        assert(byte_count == 2 * sizeof(int));
+        int msg[2];
+        memcpy(msg, block, sizeof(msg));
+        soundio_block_queue_end_read(bq, block);
+        assert(msg[0] >= 0 && msg[0] < BQ_PRODUCER_COUNT);
+        assert(msg[1] == next_expected[msg[0]]);
+        next_expected[msg[0]] += 1;
+        total += 1;
+    }
+
+    for (int i = 0; i < BQ_PRODUCER_COUNT; i += 1)
+        soundio_os_thread_destroy(threads[i]);
+
+    assert(!soundio_block_queue_begin_read(bq, &byte_count));
+    soundio_block_queue_destroy(bq);
+    bq = NULL;
+    soundio_destroy(soundio);
+}
+
+static void test_converter_round_trip(void) {
+    static const enum SoundIoFormat formats[] = {
+        SoundIoFormatS8, SoundIoFormatU8,
+        SoundIoFormatS16LE, SoundIoFormatS16BE, SoundIoFormatU16LE, SoundIoFormatU16BE,
+        SoundIoFormatS24LE, SoundIoFormatS24BE, SoundIoFormatU24LE, SoundIoFormatU24BE,
+        SoundIoFormatS32LE, SoundIoFormatS32BE, SoundIoFormatU32LE, SoundIoFormatU32BE,
+        SoundIoFormatFloat32LE, SoundIoFormatFloat32BE,
+        SoundIoFormatFloat64LE, SoundIoFormatFloat64BE,
+    };
+    // more than one chunk, and not a multiple of any vector width
+    static const int frame_count = 1003;
+    float src[1003];
+    float dest[1003];
+    char tmp[1003 * 8];
+    for (int i = 0; i < frame_count; i += 1)
+        src[i] = -1.0f + 2.0f * i / (frame_count - 1);
+
+    for (int f = 0; f < (int)ARRAY_LENGTH(formats); f += 1) {
+        enum SoundIoFormat format = formats[f];
+        int bytes = soundio_get_bytes_per_sample(format);
+        struct SoundIoConverter *to = soundio_converter_create(SoundIoFormatFloat32NE, format, 0);
+        struct SoundIoConverter *from = soundio_converter_create(format, SoundIoFormatFloat32NE, 0);
+        assert(to && from);
+
+        struct SoundIoChannelArea src_area = {(char *)src, 4};
+        struct SoundIoChannelArea tmp_area = {tmp, bytes};
+        struct SoundIoChannelArea dest_area = {(char *)dest, 4};
+        soundio_converter_convert(to, &src_area, &tmp_area, 1, frame_count);
+        soundio_converter_convert(from, &tmp_area, &dest_area, 1, frame_count);
+
+        float tolerance = (bytes == 1) ? 1.0f / 64.0f : 1.0f / 16384.0f;
+        for (int i = 0; i < frame_count; i += 1) {
+            float diff = dest[i] - src[i];
+            assert(diff <= tolerance && diff >= -tolerance);
+        }
+
+        soundio_converter_destroy(to);
+        soundio_converter_destroy(from);
+    }
+}
+
+static void test_converter_s16(void) {
+    float src[6] = {1.0f, -1.0f, 0.0f, 2.0f, -2.0f, 0.5f};
+    int16_t expected[6] = {32767, -32768, 0, 32767, -32768, 16384};
+    // interleaved stereo destination with the samples in the right channel
+    int16_t dest[12];
+    memset(dest, 0, sizeof(dest));
+
+    struct SoundIoConverter *conv = soundio_converter_create(SoundIoFormatFloat32NE,
+            SoundIoFormatS16NE, SoundIoConvertFlagNone);
+    assert(conv);
+    assert(soundio_converter_kernel_name(conv));
+
+    struct SoundIoChannelArea src_area = {(char *)src, 4};
+    struct SoundIoChannelArea dest_area = {(char *)&dest[1], 4};
+    soundio_converter_convert(conv, &src_area, &dest_area, 1, 6);
+    for (int i = 0; i < 6; i += 1) {
+        assert(dest[i * 2] == 0);
+        assert(dest[i * 2 + 1] == expected[i]);
+    }
+    soundio_converter_destroy(conv);
+
+    conv = soundio_converter_create(SoundIoFormatS16NE, SoundIoFormatS32NE, SoundIoConvertFlagNone);
+    assert(conv);
+    int32_t wide[6];
+    struct SoundIoChannelArea wide_area = {(char *)wide, 4};
+    soundio_converter_convert(conv, &dest_area, &wide_area, 1, 6);
+    for (int i = 0; i < 6; i += 1)
+        assert(wide[i] == expected[i] * 65536);
+    soundio_converter_destroy(conv);
+
+    assert(!soundio_converter_create(SoundIoFormatInvalid, SoundIoFormatS16NE, 0));
+}
+
+static void test_converter_interleave(void) {
+    static const int frame_count = 300;
+    static const int channel_counts[] = {2, 3, 4, 6, 8};
+    float planar[8][300];
+    float planar_out[8][300];
+    int16_t interleaved_s16[8 * 300];
+    float interleaved_f32[8 * 300];
+
+    struct SoundIoConverter *to_s16 = soundio_converter_create(SoundIoFormatFloat32NE,
+            SoundIoFormatS16NE, 0);
+    struct SoundIoConverter *from_s16 = soundio_converter_create(SoundIoFormatS16NE,
+            SoundIoFormatFloat32NE, 0);
+    struct SoundIoConverter *copy = soundio_converter_create(SoundIoFormatFloat32NE,
+            SoundIoFormatFloat32NE, 0);
+    assert(to_s16 && from_s16 && copy);
+
+    for (int c = 0; c < (int)ARRAY_LENGTH(channel_counts); c += 1) {
+        int channel_count = channel_counts[c];
+        struct SoundIoChannelArea planar_areas[8];
+        struct SoundIoChannelArea planar_out_areas[8];
+        struct SoundIoChannelArea s16_areas[8];
+        struct SoundIoChannelArea f32_areas[8];
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            for (int i = 0; i < frame_count; i += 1)
+                planar[ch][i] = ((i * 7 + ch * 13) % 64) / 64.0f - 0.5f;
+            planar_areas[ch].ptr = (char *)planar[ch];
+            planar_areas[ch].step = 4;
+            planar_out_areas[ch].ptr = (char *)planar_out[ch];
+            planar_out_areas[ch].step = 4;
+            s16_areas[ch].ptr = (char *)&interleaved_s16[ch];
+            s16_areas[ch].step = 2 * channel_count;
+            f32_areas[ch].ptr = (char *)&interleaved_f32[ch];
+            f32_areas[ch].step = 4 * channel_count;
+        }
+
+        soundio_converter_convert(copy, planar_areas, f32_areas, channel_count, frame_count);
+        soundio_converter_convert(to_s16, planar_areas, s16_areas, channel_count, frame_count);
+        for (int i = 0; i < frame_count; i += 1) {
+            for (int ch = 0; ch < channel_count; ch += 1) {
+                float sample = planar[ch][i];
+                assert(interleaved_f32[i * channel_count + ch] == sample);
+                assert(interleaved_s16[i * channel_count + ch] == (int16_t)(sample * 32768.0f));
+            }
+        }
+
+        memset(planar_out, 0, sizeof(planar_out));
+        soundio_converter_convert(from_s16, s16_areas, planar_out_areas, channel_count, frame_count);
+        for (int ch = 0; ch < channel_count; ch += 1)
+            assert(memcmp(planar_out[ch], planar[ch], frame_count * 4) == 0);
+
+        memset(planar_out, 0, sizeof(planar_out));
+        soundio_converter_convert(copy, f32_areas, planar_out_areas, channel_count, frame_count);
+        for (int ch = 0; ch < channel_count; ch += 1)
+            assert(memcmp(planar_out[ch], planar[ch], frame_count * 4) == 0);
+    }
+
+    // two planar channels into channels 2 and 3 of 6-channel frames, and
+    // back out, leaving the other channels alone
+    struct SoundIoChannelArea planar_areas[2];
+    struct SoundIoChannelArea planar_out_areas[2];
+    struct SoundIoChannelArea s16_areas[2];
+    for (int ch = 0; ch < 2; ch += 1) {
+        planar_areas[ch].ptr = (char *)planar[ch];
+        planar_areas[ch].step = 4;
+        planar_out_areas[ch].ptr = (char *)planar_out[ch];
+        planar_out_areas[ch].step = 4;
+        s16_areas[ch].ptr = (char *)&interleaved_s16[2 + ch];
+        s16_areas[ch].step = 2 * 6;
+    }
+    for (int i = 0; i < 6 * frame_count; i += 1)
+        interleaved_s16[i] = 1234;
+    soundio_converter_convert(to_s16, planar_areas, s16_areas, 2, frame_count);
+    for (int i = 0; i < frame_count; i += 1) {
+        for (int ch = 0; ch < 6; ch += 1) {
+            int16_t expected = (ch == 2 || ch == 3) ?
+                (int16_t)(planar[ch - 2][i] * 32768.0f) : 1234;
+            assert(interleaved_s16[i * 6 + ch] == expected);
+        }
+    }
+    memset(planar_out, 0, sizeof(planar_out));
+    soundio_converter_convert(from_s16, s16_areas, planar_out_areas, 2, frame_count);
+    for (int ch = 0; ch < 2; ch += 1)
+        assert(memcmp(planar_out[ch], planar[ch], frame_count * 4) == 0);
+
+    soundio_converter_destroy(to_s16);
+    soundio_converter_destroy(from_s16);
+    soundio_converter_destroy(copy);
+}
+
+static void check_devices_equal(struct SoundIoListDevicePtr *a, struct SoundIoListDevicePtr *b) {
+    assert(a->length == b->length);
+    for (int i = 0; i < a->length; i += 1) {
+        struct SoundIoDevice *x = a->items[i];
+        struct SoundIoDevice *y = b->items[i];
+        assert(strcmp(x->id, y->id) == 0);
+        assert(strcmp(x->name, y->name) == 0);
+        assert(x->aim == y->aim);
+        assert(x->is_raw == y->is_raw);
+        assert(x->format_count == y->format_count);
+        assert(memcmp(x->formats, y->formats, x->format_count * sizeof(enum SoundIoFormat)) == 0);
+        assert(x->layout_count == y->layout_count);
+        for (int j = 0; j < x->layout_count; j += 1)
+            assert(soundio_channel_layout_equal(&x->layouts[j], &y->layouts[j]));
+        assert(x->sample_rate_count == y->sample_rate_count);
+        assert(x->sample_rate_current == y->sample_rate_current);
+        assert(x->software_latency_current == y->software_latency_current);
+    }
+}
+
+// Resamples a sine and compares it with the ideal one, skipping the start
+// where the filter is still filling. Returns the largest error.
+static double resample_sine_error(int src_rate, int dest_rate, enum SoundIoResampleQuality quality) {
+    static const double pi = 3.14159265358979323846;
+    static const double freq = 1000.0;
+    static const int src_frame_count = 9000;
+    static float src[9000];
+    static float dest[12000];
+    for (int i = 0; i < src_frame_count; i += 1)
+        src[i] = (float)(0.5 * sin(2.0 * pi * freq * i / src_rate));
+
+    struct SoundIoResampler *resampler = soundio_resampler_create(1, src_rate, dest_rate, quality);
+    assert(resampler);
+    int dest_frame_count = 0;
+    int offset = 0;
+    while (offset < src_frame_count) {
+        // uneven pieces, to cross chunk and history boundaries
+        int in_count = soundio_int_min(src_frame_count - offset, 1 + (offset * 7) % 300);
+        int expected = soundio_resampler_dest_frame_count(resampler, in_count);
+        struct SoundIoChannelArea src_area = {(char *)(src + offset), sizeof(float)};
+        struct SoundIoChannelArea dest_area = {(char *)(dest + dest_frame_count), sizeof(float)};
+        int out_count = ARRAY_LENGTH(dest) - dest_frame_count;
+        soundio_resampler_process(resampler, &src_area, &in_count, &dest_area, &out_count);
+        assert(out_count == expected);
+        offset += in_count;
+        dest_frame_count += out_count;
+    }
+    assert(abs(dest_frame_count - (int)((int64_t)src_frame_count * dest_rate / src_rate)) <= 64);
+
+    double max_error = 0.0;
+    for (int i = 256; i < dest_frame_count; i += 1) {
+        double ideal = 0.5 * sin(2.0 * pi * freq * i / dest_rate);
+        max_error = soundio_double_max(max_error, fabs(dest[i] - ideal));
+    }
+    soundio_resampler_destroy(resampler);
+    return max_error;
+}
+
+static void test_resampler(void) {
+    assert(!soundio_resampler_create(0, 44100, 48000, SoundIoResampleQualityLow));
+    assert(!soundio_resampler_create(2, 44100, 0, SoundIoResampleQualityLow));
+
+    // the first output frame lines up with the first input frame
+    assert(resample_sine_error(44100, 48000, SoundIoResampleQualityHigh) < 5e-5);
+    assert(resample_sine_error(48000, 44100, SoundIoResampleQualityHigh) < 5e-5);
+    assert(resample_sine_error(44100, 48000, SoundIoResampleQualityMedium) < 5e-4);
+    assert(resample_sine_error(44100, 48000, SoundIoResampleQualityLow) < 5e-3);
+    // no small ratio, so the phases are interpolated
+    assert(resample_sine_error(44100, 47999, SoundIoResampleQualityHigh) < 5e-5);
+
+    // src_frame_count is the least input which gives that much output
+    struct SoundIoResampler *resampler = soundio_resampler_create(2, 44100, 48000,
+            SoundIoResampleQualityMedium);
+    assert(resampler);
+    for (int i = 1; i < 2000; i += 37) {
+        int src_frame_count = soundio_resampler_src_frame_count(resampler, i);
+        assert(soundio_resampler_dest_frame_count(resampler, src_frame_count) >= i);
+        assert(soundio_resampler_dest_frame_count(resampler, src_frame_count - 1) < i);
+    }
+    assert(soundio_resampler_get_delay(resampler) == 0.0);
+    soundio_resampler_destroy(resampler);
+}
+
+static void test_remixer(void) {
+    const struct SoundIoChannelLayout *mono = soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdMono);
+    const struct SoundIoChannelLayout *stereo = soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdStereo);
+    const struct SoundIoChannelLayout *surround51 = soundio_channel_layout_get_builtin(SoundIoChannelLayoutId5Point1);
+    const struct SoundIoChannelLayout *surround71 = soundio_channel_layout_get_builtin(SoundIoChannelLayoutId7Point1);
+    struct SoundIoChannelLayout empty = {0};
+    assert(!soundio_remixer_create(&empty, stereo, 0));
+
+    struct SoundIoRemixer *remixer = soundio_remixer_create(stereo, stereo, 0);
+    assert(remixer);
+    assert(soundio_remixer_is_identity(remixer));
+    soundio_remixer_destroy(remixer);
+
+    // 5.1 to stereo: center and surrounds at -3 dB, no LFE
+    remixer = soundio_remixer_create(surround51, stereo, SoundIoRemixFlagNoNormalize);
+    assert(remixer);
+    int fl = soundio_channel_layout_find_channel(surround51, SoundIoChannelIdFrontLeft);
+    int fc = soundio_channel_layout_find_channel(surround51, SoundIoChannelIdFrontCenter);
+    int lfe = soundio_channel_layout_find_channel(surround51, SoundIoChannelIdLfe);
+    int sl = soundio_channel_layout_find_channel(surround51, SoundIoChannelIdSideLeft);
+    int sr = soundio_channel_layout_find_channel(surround51, SoundIoChannelIdSideRight);
+    assert(soundio_remixer_get_gain(remixer, 0, fl) == 1.0f);
+    assert(fabsf(soundio_remixer_get_gain(remixer, 0, fc) - 0.7071068f) < 1e-6f);
+    assert(fabsf(soundio_remixer_get_gain(remixer, 1, fc) - 0.7071068f) < 1e-6f);
+    assert(fabsf(soundio_remixer_get_gain(remixer, 0, sl) - 0.7071068f) < 1e-6f);
+    assert(soundio_remixer_get_gain(remixer, 1, sl) == 0.0f);
+    assert(soundio_remixer_get_gain(remixer, 0, lfe) == 0.0f);
+    assert(soundio_remixer_get_gain(remixer, 1, lfe) == 0.0f);
+    assert(soundio_remixer_set_gain(remixer, 2, 0, 1.0f) == SoundIoErrorInvalid);
+    soundio_remixer_destroy(remixer);
+
+    // normalized, no output channel can exceed full scale
+    remixer = soundio_remixer_create(surround51, stereo, 0);
+    assert(remixer);
+    for (int dest = 0; dest < 2; dest += 1) {
+        float sum = 0.0f;
+        for (int src = 0; src < surround51->channel_count; src += 1)
+            sum += fabsf(soundio_remixer_get_gain(remixer, dest, src));
+        assert(sum <= 1.0f + 1e-6f);
+    }
+
+    // the matrix applied to interleaved input and planar output, over more
+    // than a chunk and of an odd length so the kernels' tails run too
+    static const int frame_count = 601;
+    float src_buf[6 * 601];
+    float dest_buf[2 * 601];
+    for (int i = 0; i < ARRAY_LENGTH(src_buf); i += 1)
+        src_buf[i] = (float)((i * 7919) % 2001 - 1000) / 1000.0f;
+    struct SoundIoChannelArea src_areas[6];
+    struct SoundIoChannelArea dest_areas[2];
+    for (int ch = 0; ch < 6; ch += 1) {
+        src_areas[ch].ptr = (char *)(src_buf + ch);
+        src_areas[ch].step = 6 * sizeof(float);
+    }
+    for (int ch = 0; ch < 2; ch += 1) {
+        dest_areas[ch].ptr = (char *)(dest_buf + ch * frame_count);
+        dest_areas[ch].step = sizeof(float);
+    }
+    soundio_remixer_process(remixer, src_areas, dest_areas, frame_count);
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        for (int dest = 0; dest < 2; dest += 1) {
+            float expected = 0.0f;
+            for (int src = 0; src < 6; src += 1)
+                expected += src_buf[frame * 6 + src] * soundio_remixer_get_gain(remixer, dest, src);
+            assert(fabsf(dest_buf[dest * frame_count + frame] - expected) < 1e-5f);
+        }
+    }
+    soundio_remixer_destroy(remixer);
+
+    // mono goes to both sides of stereo at -3 dB
+    remixer = soundio_remixer_create(mono, stereo, 0);
+    assert(remixer);
+    assert(fabsf(soundio_remixer_get_gain(remixer, 0, 0) - 0.7071068f) < 1e-6f);
+    assert(fabsf(soundio_remixer_get_gain(remixer, 1, 0) - 0.7071068f) < 1e-6f);
+    soundio_remixer_destroy(remixer);
+
+    // 7.1 folds the back channels into the sides of 5.1
+    remixer = soundio_remixer_create(surround71, surround51, SoundIoRemixFlagNoNormalize);
+    assert(remixer);
+    int bl = soundio_channel_layout_find_channel(surround71, SoundIoChannelIdBackLeft);
+    int br = soundio_channel_layout_find_channel(surround71, SoundIoChannelIdBackRight);
+    assert(soundio_remixer_get_gain(remixer, sl, bl) == 1.0f);
+    assert(soundio_remixer_get_gain(remixer, sr, br) == 1.0f);
+    assert(soundio_remixer_get_gain(remixer, sl, br) == 0.0f);
+    soundio_remixer_destroy(remixer);
+
+    // a swap is copied, not mixed
+    struct SoundIoChannelLayout swapped = {"swapped", 2, {SoundIoChannelIdFrontRight, SoundIoChannelIdFrontLeft}};
+    remixer = soundio_remixer_create(stereo, &swapped, 0);
+    assert(remixer);
+    assert(!soundio_remixer_is_identity(remixer));
+    float frame_in[2] = {0.25f, -0.5f};
+    float frame_out[2];
+    for (int ch = 0; ch < 2; ch += 1) {
+        src_areas[ch].ptr = (char *)(frame_in + ch);
+        src_areas[ch].step = 2 * sizeof(float);
+        dest_areas[ch].ptr = (char *)(frame_out + ch);
+        dest_areas[ch].step = 2 * sizeof(float);
+    }
+    soundio_remixer_process(remixer, src_areas, dest_areas, 1);
+    assert(frame_out[0] == -0.5f && frame_out[1] == 0.25f);
+    soundio_remixer_destroy(remixer);
+}
+
+static void test_device_cache(void) {
+    static const char *path = "soundio_device_cache_test.bin";
+    struct SoundIo *soundio = soundio_create();
+    assert(soundio);
+    ok_or_panic(soundio_connect_backend(soundio, SoundIoBackendDummy));
+    soundio_flush_events(soundio);
+    struct SoundIoDevicesInfo *devices_info = ((struct SoundIoPrivate *)soundio)->safe_devices_info;
+    assert(devices_info);
+
+    ok_or_panic(soundio_device_cache_save(path, SoundIoBackendDummy, 1234, devices_info));
+
+    struct SoundIoDevicesInfo *loaded = soundio_device_cache_load(soundio, path,
+            SoundIoBackendDummy, 1234);
+    assert(loaded);
+    assert(loaded->default_output_index == devices_info->default_output_index);
+    assert(loaded->default_input_index == devices_info->default_input_index);
+    check_devices_equal(&devices_info->output_devices, &loaded->output_devices);
+    check_devices_equal(&devices_info->input_devices, &loaded->input_devices);
+    soundio_destroy_devices_info(loaded);
+
+    assert(!soundio_device_cache_load(soundio, path, SoundIoBackendDummy, 1235));
+    assert(!soundio_device_cache_load(soundio, path, SoundIoBackendAlsa, 1234));
+
+    // Damage the last byte of the payload.
+    FILE *f = fopen(path, "r+b");
+    assert(f);
+    assert(fseek(f, -1, SEEK_END) == 0);
+    int c = fgetc(f);
+    assert(c != EOF);
+    assert(fseek(f, -1, SEEK_END) == 0);
+    fputc(c ^ 0xff, f);
+    fclose(f);
+    assert(!soundio_device_cache_load(soundio, path, SoundIoBackendDummy, 1234));
+
+    remove(path);
+    soundio_destroy(soundio);
+}
+
+static void test_lazy_device_probing(void) {
+    struct SoundIo *soundio = soundio_create();
+    assert(soundio);
+    soundio->lazy_device_probing = true;
+    ok_or_panic(soundio_connect_backend(soundio, SoundIoBackendDummy));
+    soundio_flush_events(soundio);
+
+    struct SoundIoDevice *out_device = soundio_get_output_device(soundio,
+            soundio_default_output_device_index(soundio));
+    assert(out_device);
+    assert(!soundio_device_is_probed(out_device));
+    assert(out_device->format_count == 0);
+    assert(soundio_device_supports_format(out_device, SoundIoFormatFloat32NE));
+    assert(soundio_device_is_probed(out_device));
+    assert(out_device->layout_count > 0);
+
+    struct SoundIoDevice *in_device = soundio_get_input_device(soundio,
+            soundio_default_input_device_index(soundio));
+    assert(in_device);
+    assert(!soundio_device_is_probed(in_device));
+    struct SoundIoInStream *instream = soundio_instream_create(in_device);
+    assert(instream);
+    instream->format = SoundIoFormatFloat32NE;
+    ok_or_panic(soundio_instream_open(instream));
+    assert(soundio_device_is_probed(in_device));
+    ok_or_panic(soundio_device_probe(in_device));
+
+    soundio_instream_destroy(instream);
+    soundio_device_unref(in_device);
+    soundio_device_unref(out_device);
+    soundio_destroy(soundio);
+}
+
+static void test_stream_stats(void) {
+    ok_or_panic(soundio_os_init());
+    struct SoundIoStreamStatsRecorder rec;
+    soundio_stream_stats_init(&rec);
+
+    struct SoundIoStreamStats stats;
+    soundio_stream_stats_read(&rec, &stats);
+    assert(stats.callback_count == 0);
+    assert(stats.frame_count_max_min == 0);
+    assert(stats.xrun_count == 0);
+
+    static const int frame_counts[] = {512, 256, 1024, 512};
+    for (int i = 0; i < (int)ARRAY_LENGTH(frame_counts); i += 1) {
+        soundio_stream_stats_callback_begin(&rec, frame_counts[i]);
+        soundio_stream_stats_io_begin(&rec);
+        soundio_stream_stats_io_end(&rec);
+        soundio_stream_stats_callback_end(&rec);
+    }
+    for (int i = 0; i < SOUNDIO_STATS_XRUN_HISTORY + 2; i += 1)
+        soundio_stream_stats_xrun(&rec);
+
+    soundio_stream_stats_read(&rec, &stats);
+    assert(stats.callback_count == ARRAY_LENGTH(frame_counts));
+    assert(stats.frame_count_max_min == 256);
+    assert(stats.frame_count_max_max == 1024);
+    assert(stats.io_time >= 0.0);
+    assert(stats.callback_duration_max >= 0.0);
+
+    uint64_t duration_total = 0;
+    uint64_t jitter_total = 0;
+    for (int i = 0; i < SOUNDIO_STATS_HISTOGRAM_BUCKETS; i += 1) {
+        duration_total += stats.callback_duration_histogram[i];
+        jitter_total += stats.wakeup_jitter_histogram[i];
+    }
+    assert(duration_total == ARRAY_LENGTH(frame_counts));
+    // the first two wakeups only establish the interval
+    assert(jitter_total == ARRAY_LENGTH(frame_counts) - 2);
+
+    assert(stats.xrun_count == SOUNDIO_STATS_XRUN_HISTORY + 2);
+    for (int i = 1; i < SOUNDIO_STATS_XRUN_HISTORY; i += 1)
+        assert(stats.xrun_times[i] <= stats.xrun_times[i - 1]);
+}
+
+static struct SoundIoAtomicLong dummy_frames_written;
+static struct SoundIoAtomicInt dummy_underflow_count;
+static struct SoundIoAtomicBool dummy_stop_writing;
+
+static void dummy_clock_write_callback(struct SoundIoOutStream *outstream,
+        int frame_count_min, int frame_count_max)
+{
+    if (SOUNDIO_ATOMIC_LOAD(dummy_stop_writing))
+        return;
+    struct SoundIoChannelArea *areas;
+    int frame_count = frame_count_max;
+    ok_or_panic(soundio_outstream_begin_write(outstream, &areas, &frame_count));
+    ok_or_panic(soundio_outstream_end_write(outstream));
+    SOUNDIO_ATOMIC_FETCH_ADD(dummy_frames_written, frame_count);
+}
+
+static void dummy_clock_underflow_callback(struct SoundIoOutStream *outstream) {
+    SOUNDIO_ATOMIC_FETCH_ADD(dummy_underflow_count, 1);
+}
+
+static struct SoundIoOutStream *open_dummy_clock_stream(struct SoundIo *soundio,
+        int write_sample_rate, struct SoundIoDevice **out_device)
+{
+    SOUNDIO_ATOMIC_STORE(dummy_frames_written, 0);
+    SOUNDIO_ATOMIC_STORE(dummy_underflow_count, 0);
+    SOUNDIO_ATOMIC_STORE(dummy_stop_writing, false);
+    ok_or_panic(soundio_connect_backend(soundio, SoundIoBackendDummy));
+    soundio_flush_events(soundio);
+    struct SoundIoDevice *device = soundio_get_output_device(soundio,
+            soundio_default_output_device_index(soundio));
+    assert(device);
+    struct SoundIoOutStream *outstream = soundio_outstream_create(device);
+    assert(outstream);
+    outstream->sample_rate = 48000;
+    outstream->write_sample_rate = write_sample_rate;
+    outstream->software_latency = 0.1;
+    outstream->write_callback = dummy_clock_write_callback;
+    outstream->underflow_callback = dummy_clock_underflow_callback;
+    ok_or_panic(soundio_outstream_open(outstream));
+    *out_device = device;
+    return outstream;
+}
+
+static void test_timestamp_filter(void) {
+    struct SoundIoTimestampFilter filter;
+    soundio_timestamp_filter_init(&filter);
+    assert(!filter.valid);
+
+    // a device 100 ppm fast, timestamped with up to 0.2 ms of jitter after
+    // periods of varying size
+    static const double true_rate = 48000.0 * 1.0001;
+    static const int frame_counts[] = {480, 512, 256, 1024, 448};
+    uint32_t seed = 1;
+    int64_t frame = 0;
+    for (int i = 0; i < 6000; i += 1) {
+        seed = seed * 1103515245 + 12345;
+        double jitter = ((seed >> 16) % 1000) / 1000.0 * 0.0002;
+        soundio_timestamp_filter_update(&filter, frame, 10.0 + frame / true_rate + jitter, 48000);
+        assert(filter.valid);
+        assert(filter.frame == frame);
+        frame += frame_counts[i % ARRAY_LENGTH(frame_counts)];
+    }
+    // the nominal rate is 4.8 frames per second off
+    assert(fabs(1.0 / filter.frame_duration - true_rate) < 1.5);
+    assert(fabs(filter.time - (10.0 + filter.frame / true_rate)) < 0.0002);
+
+    // a jump, like after an xrun, starts over from the timestamp
+    frame += 48000;
+    soundio_timestamp_filter_update(&filter, frame, 100.0, 48000);
+    assert(filter.frame == frame);
+    assert(filter.time == 100.0);
+    assert(filter.frame_duration == 1.0 / 48000);
+}
+
+static void test_dummy_manual_clock(void) {
+    struct SoundIo *soundio = soundio_create();
+    assert(soundio);
+    soundio->dummy_clock = SoundIoDummyClockManual;
+    struct SoundIoDevice *device;
+    struct SoundIoOutStream *outstream = open_dummy_clock_stream(soundio, 0, &device);
+    assert(soundio_dummy_advance(soundio, -1.0) == SoundIoErrorInvalid);
+
+    ok_or_panic(soundio_outstream_start(outstream));
+    ok_or_panic(soundio_dummy_advance(soundio, 0.0));
+    long buffer_frames = SOUNDIO_ATOMIC_LOAD(dummy_frames_written);
+    assert(buffer_frames >= 4800);
+
+    // nothing is consumed until the clock moves
+    ok_or_panic(soundio_dummy_advance(soundio, 0.0));
+    assert(SOUNDIO_ATOMIC_LOAD(dummy_frames_written) == buffer_frames);
+
+    // refills trail consumption by one period, so measure from a steady state
+    ok_or_panic(soundio_dummy_advance(soundio, 0.1));
+    long steady_frames = SOUNDIO_ATOMIC_LOAD(dummy_frames_written);
+    for (int i = 0; i < 10; i += 1)
+        ok_or_panic(soundio_dummy_advance(soundio, 0.1));
+    long consumed = SOUNDIO_ATOMIC_LOAD(dummy_frames_written) - steady_frames;
+    assert(consumed > 48000 - 48 && consumed <= 48000);
+    assert(SOUNDIO_ATOMIC_LOAD(dummy_underflow_count) == 0);
+
+    // once the callback stops writing, the buffer runs dry in one buffer's time
+    SOUNDIO_ATOMIC_STORE(dummy_stop_writing, true);
+    ok_or_panic(soundio_dummy_advance(soundio, buffer_frames / 48000.0 * 0.5));
+    assert(SOUNDIO_ATOMIC_LOAD(dummy_underflow_count) == 0);
+    ok_or_panic(soundio_dummy_advance(soundio, buffer_frames / 48000.0));
+    assert(SOUNDIO_ATOMIC_LOAD(dummy_underflow_count) > 0);
+
+    soundio_outstream_destroy(outstream);
+    soundio_device_unref(device);
+    soundio_destroy(soundio);
+}
+
+static void test_dummy_free_run_clock(void) {
+    struct SoundIo *soundio = soundio_create();
+    assert(soundio);
+    soundio->dummy_clock = SoundIoDummyClockFreeRun;
+    struct SoundIoDevice *device;
+    struct SoundIoOutStream *outstream = open_dummy_clock_stream(soundio, 0, &device);
+
+    // a minute of audio should take far less than a minute
+    double start = soundio_os_get_time();
+    ok_or_panic(soundio_outstream_start(outstream));
+    while (SOUNDIO_ATOMIC_LOAD(dummy_frames_written) < 60 * 48000)
+        assert(soundio_os_get_time() - start < 30.0);
+    assert(SOUNDIO_ATOMIC_LOAD(dummy_underflow_count) == 0);
+
+    soundio_outstream_destroy(outstream);
+    soundio_device_unref(device);
+    soundio_destroy(soundio);
+}
+
+static void test_poll_mode(void) {
+    struct SoundIo *soundio = soundio_create();
+    assert(soundio);
+    soundio->dummy_clock = SoundIoDummyClockManual;
+    SOUNDIO_ATOMIC_STORE(dummy_frames_written, 0);
+    SOUNDIO_ATOMIC_STORE(dummy_underflow_count, 0);
+    SOUNDIO_ATOMIC_STORE(dummy_stop_writing, false);
+    ok_or_panic(soundio_connect_backend(soundio, SoundIoBackendDummy));
+    soundio_flush_events(soundio);
+    struct SoundIoDevice *device = soundio_get_output_device(soundio,
+            soundio_default_output_device_index(soundio));
+    assert(device);
+    struct SoundIoOutStream *outstream = soundio_outstream_create(device);
+    assert(outstream);
+    outstream->sample_rate = 48000;
+    outstream->software_latency = 0.1;
+    outstream->write_callback = dummy_clock_write_callback;
+    outstream->underflow_callback = dummy_clock_underflow_callback;
+    outstream->poll_mode = true;
+    ok_or_panic(soundio_outstream_open(outstream));
+
+    struct SoundIoPollDescriptor descriptor;
+    int count = 1;
+    ok_or_panic(soundio_outstream_get_poll_descriptors(outstream, &descriptor, &count));
+    assert(count == 0);
+    assert(soundio_outstream_process(outstream, NULL, 0) == SoundIoErrorInvalid);
+
+    // nothing runs without being processed, and advancing doesn't wait for it
+    ok_or_panic(soundio_outstream_start(outstream));
+    ok_or_panic(soundio_dummy_advance(soundio, 0.1));
+    assert(SOUNDIO_ATOMIC_LOAD(dummy_frames_written) == 0);
+    struct SoundIoThreadSettings settings;
+    assert(soundio_outstream_get_thread_settings(outstream, &settings) == SoundIoErrorInvalid);
+
+    ok_or_panic(soundio_outstream_process(outstream, NULL, 0));
+    long buffer_frames = SOUNDIO_ATOMIC_LOAD(dummy_frames_written);
+    assert(buffer_frames >= 4800);
+    ok_or_panic(soundio_outstream_process(outstream, NULL, 0));
+    assert(SOUNDIO_ATOMIC_LOAD(dummy_frames_written) == buffer_frames);
+
+    // refills trail consumption by one call, so measure from a steady state
+    ok_or_panic(soundio_dummy_advance(soundio, 0.05));
+    ok_or_panic(soundio_outstream_process(outstream, NULL, 0));
+    long steady_frames = SOUNDIO_ATOMIC_LOAD(dummy_frames_written);
+    for (int i = 0; i < 20; i += 1) {
+        ok_or_panic(soundio_dummy_advance(soundio, 0.05));
+        ok_or_panic(soundio_outstream_process(outstream, NULL, 0));
+    }
+    long consumed = SOUNDIO_ATOMIC_LOAD(dummy_frames_written) - steady_frames;
+    assert(consumed > 48000 - 48 && consumed <= 48000);
+    assert(SOUNDIO_ATOMIC_LOAD(dummy_underflow_count) == 0);
+    assert(soundio_outstream_process(outstream, NULL, 1) == SoundIoErrorInvalid);
+
+    soundio_outstream_destroy(outstream);
+    soundio_device_unref(device);
+    soundio_destroy(soundio);
+}
+
+static void test_xrun_tracker(void) {
+    struct SoundIoXrunPolicy policy;
+    memset(&policy, 0, sizeof(policy));
+    struct SoundIoXrunTracker tracker;
+
+    // without a step nothing adapts
+    soundio_xrun_tracker_start(&tracker, &policy, 0.01, 1.0, 0.0);
+    assert(!tracker.adaptive);
+    assert(!soundio_xrun_tracker_xrun(&tracker, 1.0));
+    assert(tracker.latency == 0.01);
+
+    policy.latency_step = 0.01;
+    policy.latency_max = 0.025;
+    policy.grow_xrun_count = 3;
+    policy.grow_window = 1.0;
+    policy.shrink_after = 5.0;
+    soundio_xrun_tracker_start(&tracker, &policy, 0.01, 1.0, 0.0);
+    assert(tracker.adaptive);
+
+    // underflows further apart than the window don't add up
+    assert(!soundio_xrun_tracker_xrun(&tracker, 1.0));
+    assert(!soundio_xrun_tracker_xrun(&tracker, 1.6));
+    assert(!soundio_xrun_tracker_xrun(&tracker, 2.2));
+    assert(soundio_xrun_tracker_xrun(&tracker, 2.4));
+    assert(fabs(tracker.latency - 0.02) < 1e-9);
+
+    // the count starts over after growing, and the latency stops at the max
+    assert(!soundio_xrun_tracker_xrun(&tracker, 2.5));
+    assert(!soundio_xrun_tracker_xrun(&tracker, 2.6));
+    assert(soundio_xrun_tracker_xrun(&tracker, 2.7));
+    assert(fabs(tracker.latency - 0.025) < 1e-9);
+    for (int i = 0; i < 6; i += 1)
+        assert(!soundio_xrun_tracker_xrun(&tracker, 2.8 + i * 0.01));
+
+    // quiet periods shrink it a step at a time, down to where it started
+    assert(!soundio_xrun_tracker_tick(&tracker, 7.0));
+    assert(soundio_xrun_tracker_tick(&tracker, 8.0));
+    assert(fabs(tracker.latency - 0.015) < 1e-9);
+    assert(!soundio_xrun_tracker_tick(&tracker, 12.0));
+    assert(soundio_xrun_tracker_tick(&tracker, 13.0));
+    assert(tracker.latency == 0.01);
+    assert(!soundio_xrun_tracker_tick(&tracker, 100.0));
+
+    // the backend's buffer caps the max
+    policy.latency_max = 0.0;
+    soundio_xrun_tracker_start(&tracker, &policy, 0.01, 0.015, 0.0);
+    assert(tracker.latency_max == 0.015);
+    soundio_xrun_tracker_start(&tracker, &policy, 0.01, 0.01, 0.0);
+    assert(!tracker.adaptive);
+}
+
+static struct SoundIoAtomicInt dummy_latency_changes;
+static struct SoundIoAtomicLong dummy_latency_us;
+
+static void dummy_latency_callback(struct SoundIoOutStream *outstream, double latency) {
+    SOUNDIO_ATOMIC_FETCH_ADD(dummy_latency_changes, 1);
+    SOUNDIO_ATOMIC_STORE(dummy_latency_us, (long)(latency * 1000000.0 + 0.5));
+}
+
+static void test_xrun_policy(void) {
+    struct SoundIo *soundio = soundio_create();
+    assert(soundio);
+    soundio->dummy_clock = SoundIoDummyClockManual;
+    SOUNDIO_ATOMIC_STORE(dummy_frames_written, 0);
+    SOUNDIO_ATOMIC_STORE(dummy_underflow_count, 0);
+    SOUNDIO_ATOMIC_STORE(dummy_stop_writing, false);
+    SOUNDIO_ATOMIC_STORE(dummy_latency_changes, 0);
+    ok_or_panic(soundio_connect_backend(soundio, SoundIoBackendDummy));
+    soundio_flush_events(soundio);
+    struct SoundIoDevice *device = soundio_get_output_device(soundio,
+            soundio_default_output_device_index(soundio));
+    assert(device);
+    struct SoundIoOutStream *outstream = soundio_outstream_create(device);
+    assert(outstream);
+    outstream->sample_rate = 48000;
+    outstream->software_latency = 0.02;
+    outstream->write_callback = dummy_clock_write_callback;
+    outstream->underflow_callback = dummy_clock_underflow_callback;
+    outstream->latency_callback = dummy_latency_callback;
+    outstream->xrun_policy.prefill = 0.015;
+    outstream->xrun_policy.latency_step = 0.02;
+    outstream->xrun_policy.latency_max = 0.1;
+    outstream->xrun_policy.grow_xrun_count = 17;
+    outstream->xrun_policy.grow_window = 0.5;
+    outstream->xrun_policy.shrink_after = 0.2;
+    assert(soundio_outstream_open(outstream) == SoundIoErrorInvalid);
+    outstream->xrun_policy.grow_xrun_count = 2;
+    ok_or_panic(soundio_outstream_open(outstream));
+    assert(outstream->software_latency == 0.02);
+
+    // only the latency is queued, not the whole buffer
+    ok_or_panic(soundio_outstream_start(outstream));
+    ok_or_panic(soundio_dummy_advance(soundio, 0.0));
+    assert(SOUNDIO_ATOMIC_LOAD(dummy_frames_written) == 960);
+
+    // two underflows in a row grow the latency by a step
+    SOUNDIO_ATOMIC_STORE(dummy_stop_writing, true);
+    while (SOUNDIO_ATOMIC_LOAD(dummy_underflow_count) < 2)
+        ok_or_panic(soundio_dummy_advance(soundio, 0.01));
+    assert(SOUNDIO_ATOMIC_LOAD(dummy_latency_changes) == 1);
+    assert(SOUNDIO_ATOMIC_LOAD(dummy_latency_us) == 40000);
+
+    // the refill after an underflow is only the prefill
+    SOUNDIO_ATOMIC_STORE(dummy_stop_writing, false);
+    ok_or_panic(soundio_dummy_advance(soundio, 0.01));
+    assert(SOUNDIO_ATOMIC_LOAD(dummy_underflow_count) == 3);
+    double latency;
+    ok_or_panic(soundio_outstream_get_latency(outstream, &latency));
+    assert(fabs(latency - 0.015) < 0.0001);
+
+    // then the stream fills up to the latency, and shrinks back after a quiet time
+    ok_or_panic(soundio_dummy_advance(soundio, 0.01));
+    ok_or_panic(soundio_outstream_get_latency(outstream, &latency));
+    assert(latency > 0.025 && latency <= 0.04);
+    for (int i = 0; i < 30; i += 1)
+        ok_or_panic(soundio_dummy_advance(soundio, 0.01));
+    assert(SOUNDIO_ATOMIC_LOAD(dummy_underflow_count) == 3);
+    assert(SOUNDIO_ATOMIC_LOAD(dummy_latency_changes) == 2);
+    assert(SOUNDIO_ATOMIC_LOAD(dummy_latency_us) == 20000);
+    ok_or_panic(soundio_outstream_get_latency(outstream, &latency));
+    assert(latency <= 0.02);
+
+    soundio_outstream_destroy(outstream);
+    soundio_device_unref(device);
+    soundio_destroy(soundio);
+}
+
+static void test_resampling_outstream(void) {
+    struct SoundIo *soundio = soundio_create();
+    assert(soundio);
+    soundio->dummy_clock = SoundIoDummyClockManual;
+    struct SoundIoDevice *device;
+    struct SoundIoOutStream *outstream = open_dummy_clock_stream(soundio, 44100, &device);
+    assert(outstream->buffer_access == SoundIoBufferAccessCopy);
+
+    ok_or_panic(soundio_outstream_start(outstream));
+    ok_or_panic(soundio_dummy_advance(soundio, 0.1));
+    long steady_frames = SOUNDIO_ATOMIC_LOAD(dummy_frames_written);
+    for (int i = 0; i < 10; i += 1)
+        ok_or_panic(soundio_dummy_advance(soundio, 0.1));
+    // a second of the device's 48000 Hz is a second of the callback's 44100 Hz
+    long consumed = SOUNDIO_ATOMIC_LOAD(dummy_frames_written) - steady_frames;
+    assert(consumed > 44100 - 64 && consumed < 44100 + 64);
+    assert(SOUNDIO_ATOMIC_LOAD(dummy_underflow_count) == 0);
+
+    // a backend which raises the latency grows the buffer the callback
+    // writes to, and the stream carries on
+    struct SoundIoOutStreamPrivate *os = (struct SoundIoOutStreamPrivate *)outstream;
+    int buf_frame_count = os->resample->buf_frame_count;
+    outstream->software_latency *= 2.0;
+    ok_or_panic(soundio_outstream_resample_resize(os));
+    assert(os->resample->buf_frame_count > buf_frame_count);
+    ok_or_panic(soundio_dummy_advance(soundio, 0.1));
+    assert(SOUNDIO_ATOMIC_LOAD(dummy_underflow_count) == 0);
+
+    soundio_outstream_destroy(outstream);
+    soundio_device_unref(device);
+    soundio_destroy(soundio);
+}
+
+static void test_remixing_outstream(void) {
+    SOUNDIO_ATOMIC_STORE(dummy_frames_written, 0);
+    SOUNDIO_ATOMIC_STORE(dummy_underflow_count, 0);
+    SOUNDIO_ATOMIC_STORE(dummy_stop_writing, false);
+    struct SoundIo *soundio = soundio_create();
+    assert(soundio);
+    soundio->dummy_clock = SoundIoDummyClockManual;
+    ok_or_panic(soundio_connect_backend(soundio, SoundIoBackendDummy));
+    soundio_flush_events(soundio);
+    struct SoundIoDevice *device = soundio_get_output_device(soundio,
+            soundio_default_output_device_index(soundio));
+    assert(device);
+    struct SoundIoOutStream *outstream = soundio_outstream_create(device);
+    assert(outstream);
+    outstream->sample_rate = 48000;
+    outstream->layout = *soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdStereo);
+    outstream->write_layout = *soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdMono);
+    outstream->software_latency = 0.1;
+    outstream->write_callback = dummy_clock_write_callback;
+    outstream->underflow_callback = dummy_clock_underflow_callback;
+    ok_or_panic(soundio_outstream_open(outstream));
+    assert(outstream->buffer_access == SoundIoBufferAccessCopy);
+
+    // the rates match, so frames go through one for one
+    ok_or_panic(soundio_outstream_start(outstream));
+    ok_or_panic(soundio_dummy_advance(soundio, 0.1));
+    long steady_frames = SOUNDIO_ATOMIC_LOAD(dummy_frames_written);
+    for (int i = 0; i < 10; i += 1)
+        ok_or_panic(soundio_dummy_advance(soundio, 0.1));
+    long consumed = SOUNDIO_ATOMIC_LOAD(dummy_frames_written) - steady_frames;
+    assert(consumed > 48000 - 48 && consumed <= 48000);
+    assert(SOUNDIO_ATOMIC_LOAD(dummy_underflow_count) == 0);
+
+    soundio_outstream_destroy(outstream);
+    soundio_device_unref(device);
+    soundio_destroy(soundio);
+}
+
+static void test_thread_settings(void) {
+    struct SoundIo *soundio = soundio_create();
+    assert(soundio);
+    soundio->thread_settings.policy = SoundIoThreadPolicyFifo;
+    soundio->thread_settings.cpu_mask[0] = 1;
+    struct SoundIoDevice *device;
+    struct SoundIoOutStream *outstream = open_dummy_clock_stream(soundio, 0, &device);
+
+    struct SoundIoThreadSettings settings;
+    assert(soundio_outstream_get_thread_settings(outstream, &settings) == SoundIoErrorInvalid);
+
+    // the stream's policy wins, and the CPUs come from SoundIo
+    outstream->thread_settings.policy = SoundIoThreadPolicyNormal;
+    ok_or_panic(soundio_outstream_start(outstream));
+    ok_or_panic(soundio_outstream_get_thread_settings(outstream, &settings));
+    assert(settings.policy == SoundIoThreadPolicyNormal);
+#if defined(__linux__)
+    assert(settings.cpu_mask[0] == 1);
+    for (int i = 1; i < (int)ARRAY_LENGTH(settings.cpu_mask); i += 1)
+        assert(settings.cpu_mask[i] == 0);
+#endif
+
+    soundio_outstream_destroy(outstream);
+    soundio_device_unref(device);
+    soundio_destroy(soundio);
+}
+
+static void test_lock_memory(void) {
+    struct SoundIo *soundio = soundio_create();
+    assert(soundio);
+    soundio->lock_memory = true;
+    SOUNDIO_ATOMIC_STORE(dummy_frames_written, 0);
+    SOUNDIO_ATOMIC_STORE(dummy_underflow_count, 0);
+    SOUNDIO_ATOMIC_STORE(dummy_stop_writing, false);
+    ok_or_panic(soundio_connect_backend(soundio, SoundIoBackendDummy));
+    soundio_flush_events(soundio);
+    struct SoundIoDevice *device = soundio_get_output_device(soundio,
+            soundio_default_output_device_index(soundio));
+    assert(device);
+    struct SoundIoOutStream *outstream = soundio_outstream_create(device);
+    assert(outstream);
+    outstream->sample_rate = 48000;
+    // resampled, so that the resampler's state is locked too
+    outstream->write_sample_rate = 44100;
+    outstream->software_latency = 0.1;
+    outstream->write_callback = dummy_clock_write_callback;
+    outstream->underflow_callback = dummy_clock_underflow_callback;
+    // unprivileged users may have too low a RLIMIT_MEMLOCK, and the dummy
+    // backend locks its buffer when it opens the stream
+    int err = soundio_outstream_open(outstream);
+    assert(!err || err == SoundIoErrorMemoryLock);
+    if (!err) {
+        err = soundio_outstream_start(outstream);
+        assert(!err || err == SoundIoErrorMemoryLock);
+    }
+    if (!err) {
+        while (SOUNDIO_ATOMIC_LOAD(dummy_frames_written) == 0) {}
+    }
+    assert(strcmp(soundio_strerror(SoundIoErrorMemoryLock), "unable to lock memory") == 0);
+
+    soundio_outstream_destroy(outstream);
+    soundio_device_unref(device);
+    soundio_destroy(soundio);
+}
+
+static struct SoundIoAtomicLong counting_alloc_bytes;
+static struct SoundIoAtomicInt counting_alloc_count;
+
+static void *counting_alloc(void *userdata, size_t size) {
+    assert(userdata == &counting_alloc_count);
+    SOUNDIO_ATOMIC_FETCH_ADD(counting_alloc_bytes, (long)size);
+    SOUNDIO_ATOMIC_FETCH_ADD(counting_alloc_count, 1);
+    return malloc(size);
+}
+
+static void counting_free(void *userdata, void *ptr, size_t size) {
+    SOUNDIO_ATOMIC_FETCH_ADD(counting_alloc_bytes, -(long)size);
+    SOUNDIO_ATOMIC_FETCH_ADD(counting_alloc_count, -1);
+    free(ptr);
+}
+
+static void test_device_allocator(void) {
+    SOUNDIO_ATOMIC_STORE(counting_alloc_bytes, 0);
+    SOUNDIO_ATOMIC_STORE(counting_alloc_count, 0);
+    struct SoundIoAllocator allocator = {counting_alloc, counting_free, &counting_alloc_count};
+
+    struct SoundIoArena *arena = soundio_arena_create(&allocator);
+    assert(arena);
+    char *small = soundio_arena_alloc(arena, 3);
+    char *big = soundio_arena_alloc(arena, 3 * SOUNDIO_ARENA_BLOCK_SIZE);
+    char *after = soundio_arena_alloc(arena, 16);
+    assert(small && big && after);
+    assert(((uintptr_t)after) % 16 == 0);
+    assert(small[0] == 0 && big[3 * SOUNDIO_ARENA_BLOCK_SIZE - 1] == 0 && after[15] == 0);
+    // the big block went behind the current one, so `after` shares a block
+    // with `small`
+    assert(after > small && after - small < SOUNDIO_ARENA_BLOCK_SIZE);
+    soundio_arena_ref(arena);
+    soundio_arena_unref(arena);
+    assert(SOUNDIO_ATOMIC_LOAD(counting_alloc_count) > 0);
+    soundio_arena_unref(arena);
+    assert(SOUNDIO_ATOMIC_LOAD(counting_alloc_count) == 0);
+    assert(SOUNDIO_ATOMIC_LOAD(counting_alloc_bytes) == 0);
+
+    struct SoundIo *soundio = soundio_create();
+    assert(soundio);
+    soundio->device_allocator = allocator;
+    ok_or_panic(soundio_connect_backend(soundio, SoundIoBackendDummy));
+    soundio_flush_events(soundio);
+    assert(SOUNDIO_ATOMIC_LOAD(counting_alloc_count) > 0);
+
+    int index = soundio_default_output_device_index(soundio);
+    assert(index >= 0);
+    struct SoundIoDevice *device = soundio_get_output_device(soundio, index);
+    assert(device);
+
+    // the device outlives its list and the context
+    soundio_destroy(soundio);
+    assert(SOUNDIO_ATOMIC_LOAD(counting_alloc_count) > 0);
+    assert(device->format_count > 0 && device->formats[0] != SoundIoFormatInvalid);
+    assert(device->layout_count > 0 && strlen(device->id) > 0);
+    soundio_device_unref(device);
+    assert(SOUNDIO_ATOMIC_LOAD(counting_alloc_count) == 0);
+    assert(SOUNDIO_ATOMIC_LOAD(counting_alloc_bytes) == 0);
+}
+
+static struct SoundIoDeviceChange recorded_changes[8];
+static int recorded_change_count;
+static int devices_change_count;
+
+static void record_device_changes(struct SoundIo *soundio,
+        const struct SoundIoDeviceChange *changes, int change_count)
+{
+    assert(change_count > 0 && change_count <= ARRAY_LENGTH(recorded_changes));
+    memcpy(recorded_changes, changes, change_count * sizeof(struct SoundIoDeviceChange));
+    recorded_change_count = change_count;
+    // ids are only valid during the callback
+    for (int i = 0; i < change_count; i += 1) {
+        if (changes[i].id && strcmp(changes[i].id, "dummy-out") == 0)
+            recorded_changes[i].id = "dummy-out";
+        else if (changes[i].id && strcmp(changes[i].id, "dummy-in") == 0)
+            recorded_changes[i].id = "dummy-in";
+        else if (changes[i].id)
+            recorded_changes[i].id = "other";
+    }
+}
+
+static void count_devices_change(struct SoundIo *soundio) {
+    devices_change_count += 1;
+}
+
+static void test_device_changes(void) {
+    struct SoundIo *soundio = soundio_create();
+    assert(soundio);
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)soundio;
+    soundio->on_device_changes = record_device_changes;
+    soundio->on_devices_change = count_devices_change;
+    recorded_change_count = 0;
+    devices_change_count = 0;
+    ok_or_panic(soundio_connect_backend(soundio, SoundIoBackendDummy));
+    soundio_flush_events(soundio);
+
+    // the first list is all additions
+    assert(devices_change_count == 1);
+    assert(recorded_change_count == 4);
+    assert(recorded_changes[0].type == SoundIoDeviceChangeAdded);
+    assert(recorded_changes[0].aim == SoundIoDeviceAimInput);
+    assert(strcmp(recorded_changes[0].id, "dummy-in") == 0);
+    assert(recorded_changes[1].type == SoundIoDeviceChangeAdded);
+    assert(recorded_changes[1].aim == SoundIoDeviceAimOutput);
+    assert(recorded_changes[2].type == SoundIoDeviceChangeDefault);
+    assert(recorded_changes[2].aim == SoundIoDeviceAimInput && recorded_changes[2].index == 0);
+    assert(recorded_changes[3].type == SoundIoDeviceChangeDefault);
+    assert(recorded_changes[3].aim == SoundIoDeviceAimOutput && recorded_changes[3].index == 0);
+
+    // a new list that keeps the output device, drops the input device and
+    // adds another output device which becomes the default
+    struct SoundIoDevicesInfo *old_devices_info = si->safe_devices_info;
+    struct SoundIoDevicesInfo *devices_info = soundio_devices_info_create(soundio);
+    assert(devices_info);
+    struct SoundIoDevice *kept = SoundIoListDevicePtr_val_at(&old_devices_info->output_devices, 0);
+    soundio_device_ref(kept);
+    ok_or_panic(SoundIoListDevicePtr_append(&devices_info->output_devices, kept));
+    struct SoundIoDevicePrivate *dev = soundio_device_create(devices_info);
+    assert(dev);
+    dev->pub.soundio = soundio;
+    dev->pub.aim = SoundIoDeviceAimOutput;
+    dev->pub.id = soundio_device_strdup(dev, "dummy-out-2");
+    dev->pub.name = soundio_device_strdup(dev, "Another Dummy");
+    assert(dev->pub.id && dev->pub.name);
+    ok_or_panic(SoundIoListDevicePtr_append(&devices_info->output_devices, &dev->pub));
+    devices_info->default_input_index = -1;
+    devices_info->default_output_index = 1;
+
+    si->safe_devices_info = devices_info;
+    recorded_change_count = 0;
+    soundio_emit_devices_change(si, old_devices_info);
+    soundio_destroy_devices_info(old_devices_info);
+    assert(devices_change_count == 2);
+    assert(recorded_change_count == 4);
+    assert(recorded_changes[0].type == SoundIoDeviceChangeRemoved);
+    assert(recorded_changes[0].aim == SoundIoDeviceAimInput);
+    assert(strcmp(recorded_changes[0].id, "dummy-in") == 0 && recorded_changes[0].index == 0);
+    assert(recorded_changes[1].type == SoundIoDeviceChangeAdded);
+    assert(strcmp(recorded_changes[1].id, "other") == 0 && recorded_changes[1].index == 1);
+    assert(recorded_changes[2].type == SoundIoDeviceChangeDefault);
+    assert(recorded_changes[2].aim == SoundIoDeviceAimInput);
+    assert(!recorded_changes[2].id && recorded_changes[2].index == -1);
+    assert(recorded_changes[3].type == SoundIoDeviceChangeDefault);
+    assert(recorded_changes[3].aim == SoundIoDeviceAimOutput && recorded_changes[3].index == 1);
+
+    // nothing different: only the coarse callback
+    recorded_change_count = 0;
+    soundio_emit_devices_change(si, si->safe_devices_info);
+    assert(devices_change_count == 3);
+    assert(recorded_change_count == 0);
+
+    soundio_destroy(soundio);
+}
+
+static struct SoundIoOsEvent *waited_event;
+
+static void event_signal_run(void *arg) {
+    for (int i = 0; i < 1000; i += 1)
+        soundio_os_event_signal(waited_event);
+}
+
+static int disconnect_count;
+static int disconnect_err;
+
+static void record_disconnect(struct SoundIo *soundio, int err) {
+    disconnect_count += 1;
+    disconnect_err = err;
+}
+
+static void test_events(void) {
+    // any number of signals wake one wait
+    waited_event = soundio_os_event_create();
+    assert(waited_event);
+    struct SoundIoOsThread *thread;
+    ok_or_panic(soundio_os_thread_create(event_signal_run, NULL, NULL, false, NULL, &thread));
+    soundio_os_event_wait(waited_event);
+    soundio_os_thread_destroy(thread);
+    // the storm may have outlasted the wait, so take whatever followed it
+    soundio_os_event_reset(waited_event);
+#if defined(__linux__)
+    struct pollfd pfd = {soundio_os_event_fd(waited_event), POLLIN, 0};
+    assert(poll(&pfd, 1, 0) == 0);
+    soundio_os_event_signal(waited_event);
+    soundio_os_event_signal(waited_event);
+    assert(poll(&pfd, 1, 0) == 1);
+    soundio_os_event_reset(waited_event);
+    assert(poll(&pfd, 1, 0) == 0);
+#endif
+    soundio_os_event_signal(waited_event);
+    soundio_os_event_wait(waited_event);
+    soundio_os_event_destroy(waited_event);
+
+    struct SoundIo *soundio = soundio_create();
+    assert(soundio);
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)soundio;
+    soundio->on_devices_change = count_devices_change;
+    soundio->on_backend_disconnect = record_disconnect;
+    devices_change_count = 0;
+    disconnect_count = 0;
+    ok_or_panic(soundio_connect_backend(soundio, SoundIoBackendDummy));
+    soundio_flush_events(soundio);
+    assert(devices_change_count == 1);
+
+    // wakeups coalesce, and waiting takes them all
+    for (int i = 0; i < 100; i += 1)
+        soundio_wakeup(soundio);
+    soundio_wait_events(soundio);
+    assert(devices_change_count == 1);
+
+    // lists posted between flushes replace each other, then one is reported
+    for (int i = 0; i < 3; i += 1) {
+        struct SoundIoDevicesInfo *devices_info = soundio_devices_info_create(soundio);
+        assert(devices_info);
+        for (int j = 0; j < i; j += 1) {
+            struct SoundIoDevicePrivate *dev = soundio_device_create(devices_info);
+            assert(dev);
+            dev->pub.soundio = soundio;
+            dev->pub.aim = SoundIoDeviceAimOutput;
+            dev->pub.id = soundio_device_sprintf(dev, "posted-%d", j);
+            dev->pub.name = soundio_device_strdup(dev, "Posted Dummy");
+            assert(dev->pub.id && dev->pub.name);
+            ok_or_panic(SoundIoListDevicePtr_append(&devices_info->output_devices, &dev->pub));
+        }
+        devices_info->default_input_index = -1;
+        devices_info->default_output_index = i - 1;
+        soundio_events_post_devices_info(si, devices_info);
+    }
+    soundio_flush_events(soundio);
+    assert(devices_change_count == 2);
+    assert(soundio_output_device_count(soundio) == 2);
+    assert(soundio_input_device_count(soundio) == 0);
+    soundio_flush_events(soundio);
+    assert(devices_change_count == 2);
+
+    // an error is reported once
+    soundio_events_post_error(si, SoundIoErrorBackendDisconnected);
+    soundio_wait_events(soundio);
+    assert(disconnect_count == 1);
+    assert(disconnect_err == SoundIoErrorBackendDisconnected);
+    soundio_flush_events(soundio);
+    assert(disconnect_count == 1);
+    // nor is a list posted after it
+    struct SoundIoDevicesInfo *late_devices_info = soundio_devices_info_create(soundio);
+    assert(late_devices_info);
+    soundio_events_post_devices_info(si, late_devices_info);
+    soundio_flush_events(soundio);
+    assert(devices_change_count == 2);
+    assert(disconnect_count == 1);
+
+    // reconnecting starts over
+    soundio_disconnect(soundio);
+    ok_or_panic(soundio_connect_backend(soundio, SoundIoBackendDummy));
+    soundio_flush_events(soundio);
+    assert(devices_change_count == 3);
+    assert(disconnect_count == 1);
+    assert(soundio_output_device_count(soundio) == 1);
+
+    soundio_destroy(soundio);
+}
+
+static int async_open_count;
+static int async_start_count;
+
+static void async_open_callback(struct SoundIoOutStream *outstream, int err) {
+    ok_or_panic(err);
+    async_open_count += 1;
+    // a call may be made from the callback
+    ok_or_panic(soundio_outstream_start_async(outstream));
+}
+
+static void async_start_callback(struct SoundIoOutStream *outstream, int err) {
+    ok_or_panic(err);
+    async_start_count += 1;
+}
+
+static void test_async_open_start(void) {
+    struct SoundIo *soundio = soundio_create();
+    assert(soundio);
+    SOUNDIO_ATOMIC_STORE(dummy_frames_written, 0);
+    SOUNDIO_ATOMIC_STORE(dummy_stop_writing, false);
+    ok_or_panic(soundio_connect_backend(soundio, SoundIoBackendDummy));
+    soundio_flush_events(soundio);
+    struct SoundIoDevice *device = soundio_get_output_device(soundio,
+            soundio_default_output_device_index(soundio));
+    assert(device);
+
+    async_open_count = 0;
+    async_start_count = 0;
+    struct SoundIoOutStream *outstreams[3];
+    for (int i = 0; i < ARRAY_LENGTH(outstreams); i += 1) {
+        struct SoundIoOutStream *outstream = soundio_outstream_create(device);
+        assert(outstream);
+        outstream->software_latency = 0.1;
+        outstream->write_callback = dummy_clock_write_callback;
+        outstream->open_callback = async_open_callback;
+        outstream->start_callback = async_start_callback;
+        ok_or_panic(soundio_outstream_open_async(outstream));
+        // one call at a time
+        assert(soundio_outstream_open_async(outstream) == SoundIoErrorInvalid);
+        outstreams[i] = outstream;
+    }
+    // the parameters are filled in before returning
+    assert(outstreams[0]->format != SoundIoFormatInvalid && outstreams[0]->sample_rate > 0);
+
+    while (async_start_count < ARRAY_LENGTH(outstreams))
+        soundio_wait_events(soundio);
+    assert(async_open_count == ARRAY_LENGTH(outstreams));
+    while (SOUNDIO_ATOMIC_LOAD(dummy_frames_written) == 0) {}
+
+    for (int i = 0; i < ARRAY_LENGTH(outstreams); i += 1)
+        soundio_outstream_destroy(outstreams[i]);
+
+    // destroying waits for a call in progress, which is then not reported
+    struct SoundIoOutStream *outstream = soundio_outstream_create(device);
+    assert(outstream);
+    outstream->write_callback = dummy_clock_write_callback;
+    outstream->open_callback = async_open_callback;
+    ok_or_panic(soundio_outstream_open_async(outstream));
+    soundio_outstream_destroy(outstream);
+    soundio_flush_events(soundio);
+    assert(async_open_count == ARRAY_LENGTH(outstreams));
+
+    soundio_device_unref(device);
+    soundio_destroy(soundio);
+}
+
+struct GroupMemberState {
+    double first_callback_time;
+    struct SoundIoStreamPosition position;
+};
+
+static void group_write_callback(struct SoundIoOutStream *outstream,
+        int frame_count_min, int frame_count_max)
+{
+    struct GroupMemberState *state = (struct GroupMemberState *)outstream->userdata;
+    if (state->first_callback_time == 0.0)
+        state->first_callback_time = soundio_get_time();
+    struct SoundIoChannelArea *areas;
+    int frame_count = frame_count_max;
+    ok_or_panic(soundio_outstream_begin_write(outstream, &areas, &frame_count));
+    ok_or_panic(soundio_outstream_end_write(outstream));
+    ok_or_panic(soundio_outstream_get_position(outstream, &state->position));
+}
+
+static void test_stream_group(void) {
+    struct SoundIo *soundio = soundio_create();
+    assert(soundio);
+    ok_or_panic(soundio_connect_backend(soundio, SoundIoBackendDummy));
+    soundio_flush_events(soundio);
+    struct SoundIoDevice *device = soundio_get_output_device(soundio,
+            soundio_default_output_device_index(soundio));
+    assert(device);
+
+    struct SoundIoStreamGroup *group = soundio_stream_group_create();
+    assert(group);
+    assert(soundio_stream_group_get_start_time(group) == 0.0);
+
+    struct GroupMemberState states[2];
+    struct SoundIoOutStream *outstreams[3];
+    memset(states, 0, sizeof(states));
+    for (int i = 0; i < ARRAY_LENGTH(outstreams); i += 1) {
+        struct SoundIoOutStream *outstream = soundio_outstream_create(device);
+        assert(outstream);
+        outstream->sample_rate = 48000;
+        outstream->software_latency = 0.02;
+        outstream->write_callback = group_write_callback;
+        outstream->userdata = &states[i % ARRAY_LENGTH(states)];
+        ok_or_panic(soundio_outstream_open(outstream));
+        ok_or_panic(soundio_stream_group_add_outstream(group, outstream));
+        assert(soundio_stream_group_add_outstream(group, outstream) == SoundIoErrorInvalid);
+        outstreams[i] = outstream;
+    }
+    // a destroyed stream leaves the group
+    soundio_outstream_destroy(outstreams[2]);
+
+    static const double delay = 0.1;
+    double before_start = soundio_get_time();
+    ok_or_panic(soundio_stream_group_start(group, delay));
+    double start_time = soundio_stream_group_get_start_time(group);
+    assert(start_time >= before_start + delay);
+    assert(soundio_stream_group_start(group, delay) == SoundIoErrorInvalid);
+    assert(soundio_stream_group_add_outstream(group, outstreams[0]) == SoundIoErrorInvalid);
+
+    soundio_os_sleep_until(start_time + 0.2);
+    for (int i = 0; i < ARRAY_LENGTH(states); i += 1)
+        soundio_outstream_destroy(outstreams[i]);
+    soundio_stream_group_destroy(group);
+
+    for (int i = 0; i < ARRAY_LENGTH(states); i += 1) {
+        struct GroupMemberState *state = &states[i];
+        // the buffer is filled before the deadline and playback begins at it
+        assert(state->first_callback_time > 0.0 && state->first_callback_time < start_time);
+        assert(state->position.time > start_time);
+        double played = state->position.frame / 48000.0;
+        double elapsed = state->position.time - start_time;
+        assert(played > elapsed - 0.03 && played < elapsed + 0.03);
+    }
+
+    soundio_device_unref(device);
     soundio_destroy(soundio);
 }
 
@@ -182,6 +1672,17 @@ static void test_mirrored_memory(void) {
     }
 
     soundio_os_deinit_mirrored_memory(&mem);
+
+    // falls back to normal pages when huge pages are not available
+    ok_or_panic(soundio_os_init_mirrored_memory_ex(&mem, requested_bytes,
+                SoundIoOsMirroredMemoryFlagHugePages));
+    assert(mem.capacity >= (size_t)requested_bytes);
+    assert(mem.capacity % soundio_os_page_size() == 0);
+    for (size_t i = 0; i < mem.capacity; i += 1)
+        mem.address[i] = rand() % CHAR_MAX;
+    for (size_t i = 0; i < mem.capacity; i += 1)
+        assert(mem.address[i] == mem.address[mem.capacity + i]);
+    soundio_os_deinit_mirrored_memory(&mem);
 }
 
 static void test_nearest_sample_rate(void) {
@@ -211,6 +1712,534 @@ static void test_nearest_sample_rate(void) {
     assert(soundio_device_nearest_sample_rate(&device, 9999999) == 96000);
 }
 
+static void test_duplex_bridge(void) {
+    struct SoundIo *soundio = soundio_create();
+    assert(soundio);
+    ok_or_panic(soundio_connect_backend(soundio, SoundIoBackendDummy));
+    soundio_flush_events(soundio);
+    struct SoundIoDevice *in_device = soundio_get_input_device(soundio,
+            soundio_default_input_device_index(soundio));
+    struct SoundIoDevice *out_device = soundio_get_output_device(soundio,
+            soundio_default_output_device_index(soundio));
+    assert(in_device && out_device);
+
+    struct SoundIoInStream *instream = soundio_instream_create(in_device);
+    assert(instream);
+    instream->format = SoundIoFormatFloat32NE;
+    instream->sample_rate = 48000;
+    instream->layout = *soundio_channel_layout_get_default(2);
+    ok_or_panic(soundio_instream_open(instream));
+    struct SoundIoOutStream *outstream = soundio_outstream_create(out_device);
+    assert(outstream);
+    outstream->format = SoundIoFormatS16NE;
+    outstream->sample_rate = 48000;
+    outstream->resample_quality = SoundIoResampleQualityLow;
+    ok_or_panic(soundio_outstream_open(outstream));
+
+    assert(!soundio_duplex_bridge_create(instream, outstream, 0.0));
+    struct SoundIoDuplexBridge *bridge = soundio_duplex_bridge_create(instream, outstream, 0.01);
+    assert(bridge);
+
+    // The input device runs 300 ppm fast. Uncorrected, a minute of 5 ms
+    // periods would pile up 18 ms on top of the 10 ms target.
+    static const double drift = 300e-6;
+    static const int period = 240;
+    float in_buf[2 * 256];
+    int16_t out_buf[2 * 240];
+    for (int i = 0; i < ARRAY_LENGTH(in_buf); i += 1)
+        in_buf[i] = 0.5f * sinf(i * 0.01f);
+    struct SoundIoChannelArea in_areas[2];
+    struct SoundIoChannelArea out_areas[2];
+    for (int ch = 0; ch < 2; ch += 1) {
+        in_areas[ch].ptr = (char *)(in_buf + ch);
+        in_areas[ch].step = 2 * sizeof(float);
+        out_areas[ch].ptr = (char *)(out_buf + ch);
+        out_areas[ch].step = 2 * sizeof(int16_t);
+    }
+
+    assert(soundio_duplex_bridge_push(bridge, in_areas, period / 2) == period / 2);
+    soundio_duplex_bridge_pull(bridge, out_areas, period);
+    // silent until the target is buffered
+    for (int i = 0; i < ARRAY_LENGTH(out_buf); i += 1)
+        assert(out_buf[i] == 0);
+
+    double pushed = period / 2;
+    long pushed_frames = period / 2;
+    for (int i = 0; i < 12000; i += 1) {
+        pushed += period * (1.0 + drift);
+        int count = (int)((long)pushed - pushed_frames);
+        assert(soundio_duplex_bridge_push(bridge, in_areas, count) == count);
+        pushed_frames += count;
+        soundio_duplex_bridge_pull(bridge, out_areas, period);
+    }
+    assert(fabs(soundio_duplex_bridge_get_latency(bridge) - 0.01) < 0.0005);
+    assert(fabs(soundio_duplex_bridge_get_ratio(bridge) - (1.0 + drift)) < 20e-6);
+    assert(soundio_duplex_bridge_get_underflow_count(bridge) == 0);
+    assert(soundio_duplex_bridge_get_overflow_count(bridge) == 0);
+
+    // starved, it plays silence and counts an underflow
+    soundio_duplex_bridge_pull(bridge, out_areas, period);
+    soundio_duplex_bridge_pull(bridge, out_areas, period);
+    assert(soundio_duplex_bridge_get_underflow_count(bridge) == 1);
+    assert(out_buf[ARRAY_LENGTH(out_buf) - 1] == 0);
+
+    soundio_duplex_bridge_destroy(bridge);
+    soundio_outstream_destroy(outstream);
+    soundio_instream_destroy(instream);
+    soundio_device_unref(in_device);
+    soundio_device_unref(out_device);
+    soundio_destroy(soundio);
+}
+
+static struct SoundIoAtomicLong duplex_frames;
+
+static void duplex_test_callback(struct SoundIoDuplexStream *duplex,
+        const struct SoundIoChannelArea *in_areas, struct SoundIoChannelArea *out_areas,
+        int frame_count)
+{
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        for (int ch = 0; ch < 2; ch += 1) {
+            float *in = (float *)(in_areas[ch].ptr + in_areas[ch].step * frame);
+            float *out = (float *)(out_areas[ch].ptr + out_areas[ch].step * frame);
+            *out = *in;
+        }
+    }
+    SOUNDIO_ATOMIC_FETCH_ADD(duplex_frames, frame_count);
+}
+
+static void test_duplex_stream(void) {
+    struct SoundIo *soundio = soundio_create();
+    assert(soundio);
+    soundio->dummy_clock = SoundIoDummyClockManual;
+    ok_or_panic(soundio_connect_backend(soundio, SoundIoBackendDummy));
+    soundio_flush_events(soundio);
+    struct SoundIoDevice *in_device = soundio_get_input_device(soundio,
+            soundio_default_input_device_index(soundio));
+    struct SoundIoDevice *out_device = soundio_get_output_device(soundio,
+            soundio_default_output_device_index(soundio));
+    assert(in_device && out_device);
+
+    struct SoundIoDuplexStream *duplex = soundio_duplex_stream_create(in_device, out_device);
+    assert(duplex);
+    assert(soundio_duplex_stream_open(duplex) == SoundIoErrorInvalid);
+    SOUNDIO_ATOMIC_STORE(duplex_frames, 0);
+    duplex->duplex_callback = duplex_test_callback;
+    duplex->instream->format = SoundIoFormatFloat32NE;
+    duplex->instream->layout = *soundio_channel_layout_get_default(2);
+    duplex->instream->software_latency = 0.1;
+    duplex->outstream->format = SoundIoFormatFloat32NE;
+    duplex->outstream->sample_rate = 48000;
+    duplex->outstream->software_latency = 0.1;
+    ok_or_panic(soundio_duplex_stream_open(duplex));
+    assert(duplex->synchronous);
+    assert(duplex->instream->sample_rate == 48000);
+
+    // the input has no thread of its own
+    ok_or_panic(soundio_duplex_stream_start(duplex));
+    struct SoundIoInStreamPrivate *is = (struct SoundIoInStreamPrivate *)duplex->instream;
+    assert(!is->backend_data.dummy.thread);
+
+    // the output is filled with silence once, then keeps pace with the input
+    ok_or_panic(soundio_dummy_advance(soundio, 0.0));
+    ok_or_panic(soundio_dummy_advance(soundio, 0.1));
+    long steady_frames = SOUNDIO_ATOMIC_LOAD(duplex_frames);
+    struct SoundIoDuplexStreamPrivate *dsp = (struct SoundIoDuplexStreamPrivate *)duplex;
+    for (int i = 0; i < 10; i += 1) {
+        ok_or_panic(soundio_dummy_advance(soundio, 0.1));
+        // the input never piles up behind the output
+        int backlog = soundio_ring_buffer_fill_count(&dsp->ring_buffer) / duplex->instream->bytes_per_frame;
+        assert(backlog <= 4800);
+    }
+    long frames = SOUNDIO_ATOMIC_LOAD(duplex_frames) - steady_frames;
+    assert(frames > 48000 - 48 && frames <= 48000);
+
+    // a backend which raises the latency grows the pad and the ring buffer
+    int pad_frame_count = dsp->pad_frame_count;
+    duplex->outstream->software_latency *= 2.0;
+    ok_or_panic(soundio_duplex_stream_resize(dsp));
+    assert(dsp->pad_frame_count > pad_frame_count);
+    assert(soundio_ring_buffer_capacity(&dsp->ring_buffer) >=
+            dsp->pad_frame_count * duplex->instream->bytes_per_frame);
+    ok_or_panic(soundio_dummy_advance(soundio, 0.1));
+
+    soundio_duplex_stream_destroy(duplex);
+    soundio_device_unref(in_device);
+    soundio_device_unref(out_device);
+    soundio_destroy(soundio);
+}
+
+static void test_buffered_duplex_stream(void) {
+    struct SoundIo *soundio = soundio_create();
+    assert(soundio);
+    soundio->dummy_clock = SoundIoDummyClockManual;
+    ok_or_panic(soundio_connect_backend(soundio, SoundIoBackendDummy));
+    soundio_flush_events(soundio);
+    // as though the period could grow the way JACK's can
+    struct SoundIoPrivate *si = (struct SoundIoPrivate *)soundio;
+    si->max_period_frame_count = 8192;
+    struct SoundIoDevice *in_device = soundio_get_input_device(soundio,
+            soundio_default_input_device_index(soundio));
+    struct SoundIoDevice *out_device = soundio_get_output_device(soundio,
+            soundio_default_output_device_index(soundio));
+    assert(in_device && out_device);
+
+    struct SoundIoDuplexStream *duplex = soundio_duplex_stream_create(in_device, out_device);
+    assert(duplex);
+    SOUNDIO_ATOMIC_STORE(duplex_frames, 0);
+    duplex->duplex_callback = duplex_test_callback;
+    duplex->instream->format = SoundIoFormatFloat32NE;
+    duplex->instream->layout = *soundio_channel_layout_get_default(2);
+    duplex->instream->software_latency = 0.1;
+    duplex->outstream->format = SoundIoFormatFloat32NE;
+    duplex->outstream->sample_rate = 48000;
+    duplex->outstream->write_sample_rate = 44100;
+    duplex->outstream->software_latency = 0.1;
+    ok_or_panic(soundio_duplex_stream_open(duplex));
+    // resampled, so each side runs on a thread of its own
+    assert(!duplex->synchronous);
+
+    // sized up front for the largest period of either side
+    struct SoundIoDuplexStreamPrivate *dsp = (struct SoundIoDuplexStreamPrivate *)duplex;
+    double most = 2.0 * (8192 / 44100.0 + 8192 / 48000.0);
+    assert(dsp->pad_frame_count >= (int)(most * 44100.0));
+
+    // and never resized under the thread of the other side
+    ok_or_panic(soundio_duplex_stream_start(duplex));
+    ok_or_panic(soundio_dummy_advance(soundio, 0.0));
+    ok_or_panic(soundio_dummy_advance(soundio, 0.1));
+    char *pad_buf = dsp->pad_buf;
+    char *ring_address = dsp->ring_buffer.mem.address;
+    duplex->outstream->software_latency = 8192 / 48000.0;
+    ok_or_panic(soundio_duplex_stream_resize(dsp));
+    assert(dsp->pad_buf == pad_buf && dsp->ring_buffer.mem.address == ring_address);
+    ok_or_panic(soundio_dummy_advance(soundio, 0.1));
+    assert(SOUNDIO_ATOMIC_LOAD(duplex_frames) > 0);
+
+    soundio_duplex_stream_destroy(duplex);
+    soundio_device_unref(in_device);
+    soundio_device_unref(out_device);
+    soundio_destroy(soundio);
+}
+
+struct MixerTestVoice {
+    float value;
+    long frames;
+    double latency;
+};
+
+static void mixer_test_write_callback(struct SoundIoMixerVoice *voice,
+        struct SoundIoChannelArea *areas, int frame_count)
+{
+    struct MixerTestVoice *tv = (struct MixerTestVoice *)voice->userdata;
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        for (int ch = 0; ch < 2; ch += 1)
+            *(float *)(areas[ch].ptr + areas[ch].step * frame) = tv->value;
+    }
+    tv->frames += frame_count;
+    tv->latency = soundio_mixer_voice_get_latency(voice);
+}
+
+static void test_mixer(void) {
+    struct SoundIo *soundio = soundio_create();
+    assert(soundio);
+    soundio->dummy_clock = SoundIoDummyClockManual;
+    ok_or_panic(soundio_connect_backend(soundio, SoundIoBackendDummy));
+    soundio_flush_events(soundio);
+    struct SoundIoDevice *device = soundio_get_output_device(soundio,
+            soundio_default_output_device_index(soundio));
+    assert(device);
+
+    struct SoundIoMixer *mixer = soundio_mixer_create(device);
+    assert(mixer);
+    mixer->outstream->format = SoundIoFormatFloat32NE;
+    mixer->outstream->layout = *soundio_channel_layout_get_default(2);
+    mixer->outstream->sample_rate = 48000;
+    mixer->outstream->software_latency = 0.1;
+    ok_or_panic(soundio_mixer_open(mixer));
+
+    struct MixerTestVoice tvs[3] = {{0.25f, 0, 0.0}, {0.5f, 0, 0.0}, {1.0f, 0, 0.0}};
+    struct SoundIoMixerVoice *voices[3];
+    for (int i = 0; i < 3; i += 1) {
+        voices[i] = soundio_mixer_voice_create(mixer);
+        assert(voices[i]);
+        voices[i]->userdata = &tvs[i];
+        if (i == 0)
+            assert(soundio_mixer_voice_start(voices[i]) == SoundIoErrorInvalid);
+        voices[i]->write_callback = mixer_test_write_callback;
+    }
+    soundio_mixer_voice_set_volume(voices[1], 0.5);
+    ok_or_panic(soundio_mixer_voice_start(voices[0]));
+    ok_or_panic(soundio_mixer_voice_start(voices[1]));
+
+    // an odd length, so the kernels' tails run too
+    static const int frame_count = 601;
+    float buf[2 * 601];
+    struct SoundIoChannelArea areas[2];
+    for (int ch = 0; ch < 2; ch += 1) {
+        areas[ch].ptr = (char *)(buf + ch);
+        areas[ch].step = 2 * sizeof(float);
+    }
+    struct SoundIoMixerPrivate *mp = (struct SoundIoMixerPrivate *)mixer;
+    mp->write_latency = 0.1;
+    soundio_mixer_mix(mp, areas, frame_count);
+    for (int i = 0; i < ARRAY_LENGTH(buf); i += 1)
+        assert(fabsf(buf[i] - 0.5f) < 1e-6f);
+    // the voice which was not started was never called
+    assert(tvs[0].frames == frame_count && tvs[1].frames == frame_count && tvs[2].frames == 0);
+    // the last call was for the third chunk
+    assert(fabs(tvs[1].latency - (0.1 + 2 * SOUNDIO_MIXER_CHUNK_SIZE / 48000.0)) < 1e-9);
+
+    // a volume change ramps over one chunk instead of jumping
+    soundio_mixer_voice_set_volume(voices[0], 0.0);
+    soundio_mixer_mix(mp, areas, frame_count);
+    assert(fabsf(buf[0] - 0.5f) < 1e-6f);
+    float half = buf[2 * (SOUNDIO_MIXER_CHUNK_SIZE / 2)];
+    assert(half > 0.36f && half < 0.39f);
+    for (int i = 2 * SOUNDIO_MIXER_CHUNK_SIZE; i < ARRAY_LENGTH(buf); i += 1)
+        assert(fabsf(buf[i] - 0.25f) < 1e-6f);
+
+    // mixing takes no lock, so adding or removing a voice cannot hold it up
+    soundio_mixer_voice_pause(voices[1], true);
+    soundio_os_mutex_lock(mp->mutex);
+    soundio_mixer_mix(mp, areas, frame_count);
+    soundio_os_mutex_unlock(mp->mutex);
+    for (int i = 0; i < ARRAY_LENGTH(buf); i += 1)
+        assert(buf[i] == 0.0f);
+    soundio_mixer_voice_pause(voices[1], false);
+
+    // running, the voices keep pace with the device
+    soundio_mixer_voice_destroy(voices[2]);
+    struct SoundIoMixerVoiceSet *set = (struct SoundIoMixerVoiceSet *)SOUNDIO_ATOMIC_LOAD(mp->voice_set);
+    assert(set->count == 2 && mp->voice_sets[0].capacity >= 3 && mp->voice_sets[1].capacity >= 3);
+    ok_or_panic(soundio_mixer_start(mixer));
+    ok_or_panic(soundio_dummy_advance(soundio, 0.0));
+    ok_or_panic(soundio_dummy_advance(soundio, 0.1));
+    long steady_frames = tvs[1].frames;
+    for (int i = 0; i < 10; i += 1)
+        ok_or_panic(soundio_dummy_advance(soundio, 0.1));
+    long frames = tvs[1].frames - steady_frames;
+    assert(frames > 48000 - 48 && frames <= 48000);
+    // voice 1 sat out the mix it was paused for
+    assert(tvs[0].frames == tvs[1].frames + frame_count);
+
+    soundio_mixer_destroy(mixer);
+    soundio_device_unref(device);
+    soundio_destroy(soundio);
+}
+
+static uint32_t read_u32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void test_recorder(void) {
+    struct SoundIo *soundio = soundio_create();
+    assert(soundio);
+    ok_or_panic(soundio_connect_backend(soundio, SoundIoBackendDummy));
+    soundio_flush_events(soundio);
+    struct SoundIoDevice *device = soundio_get_input_device(soundio,
+            soundio_default_input_device_index(soundio));
+    assert(device);
+    struct SoundIoInStream *instream = soundio_instream_create(device);
+    assert(instream);
+    instream->format = SoundIoFormatS24LE;
+    instream->sample_rate = 48000;
+    instream->layout = *soundio_channel_layout_get_default(2);
+    ok_or_panic(soundio_instream_open(instream));
+
+    static const char *path = "recorder_test.wav";
+    struct SoundIoRecorder *recorder;
+    assert(soundio_recorder_create(instream, path, 0.0, &recorder) == SoundIoErrorInvalid);
+    ok_or_panic(soundio_recorder_create(instream, path, 2.0, &recorder));
+
+    // a ramp, planar, so that the samples are interleaved and packed; more
+    // than a chunk in all, and not a whole number of chunks
+    static const int frame_count = 1000;
+    static const int rounds = 300;
+    int32_t left[1000];
+    int32_t right[1000];
+    struct SoundIoChannelArea areas[2] = {
+        {(char *)left, sizeof(int32_t)},
+        {(char *)right, sizeof(int32_t)},
+    };
+    for (int round = 0; round < rounds; round += 1) {
+        for (int i = 0; i < frame_count; i += 1) {
+            int32_t value = round * frame_count + i;
+            left[i] = value;
+            right[i] = -value;
+        }
+        // faster than real time, so wait for the writer rather than drop
+        while (soundio_ring_buffer_free_count(&recorder->ring_buffer) < frame_count * 8)
+            soundio_os_sleep_until(soundio_os_get_time() + 0.001);
+        assert(soundio_recorder_push(recorder, areas, frame_count) == frame_count);
+    }
+    ok_or_panic(soundio_recorder_finish(recorder));
+    assert(soundio_recorder_finish(recorder) == 0);
+    struct SoundIoRecorderStats stats;
+    soundio_recorder_get_stats(recorder, &stats);
+    assert(stats.frames_captured == rounds * frame_count);
+    assert(stats.frames_written == rounds * frame_count);
+    assert(stats.frames_dropped == 0);
+    assert(stats.buffer_fill == 0.0);
+    assert(stats.buffer_duration >= 2.0);
+    assert(stats.buffer_fill_max > 0.0 && stats.buffer_fill_max <= stats.buffer_duration);
+    assert(stats.write_error == 0);
+
+    FILE *f = fopen(path, "rb");
+    assert(f);
+    unsigned char header[SOUNDIO_RECORDER_HEADER_SIZE];
+    assert(fread(header, 1, sizeof(header), f) == sizeof(header));
+    const uint32_t data_bytes = rounds * frame_count * 6;
+    assert(memcmp(header, "RIFF", 4) == 0 && memcmp(header + 8, "WAVE", 4) == 0);
+    assert(read_u32(header + 4) == SOUNDIO_RECORDER_HEADER_SIZE - 8 + data_bytes);
+    assert(memcmp(header + 48, "fmt ", 4) == 0);
+    // 2 channels, 6 bytes a frame, 24 bits, front left and right
+    assert(header[58] == 2 && read_u32(header + 60) == 48000 && header[68] == 6 && header[74] == 24);
+    assert(read_u32(header + 76) == 3);
+    assert(memcmp(header + SOUNDIO_RECORDER_HEADER_SIZE - 8, "data", 4) == 0);
+    assert(read_u32(header + SOUNDIO_RECORDER_HEADER_SIZE - 4) == data_bytes);
+    for (int32_t value = 0; value < rounds * frame_count; value += 1) {
+        unsigned char frame[6];
+        assert(fread(frame, 1, sizeof(frame), f) == sizeof(frame));
+        int32_t l = frame[0] | (frame[1] << 8) | ((int32_t)(int8_t)frame[2] << 16);
+        int32_t r = frame[3] | (frame[4] << 8) | ((int32_t)(int8_t)frame[5] << 16);
+        assert(l == value && r == -value);
+    }
+    assert(fgetc(f) == EOF);
+    fclose(f);
+    remove(path);
+
+    // past 4 GiB of samples the header turns into RF64
+    char big[SOUNDIO_RECORDER_HEADER_SIZE];
+    soundio_recorder_write_header(recorder, big, 6 * 1000000000LL);
+    assert(memcmp(big, "RF64", 4) == 0 && read_u32((unsigned char *)big + 4) == UINT32_MAX);
+    assert(memcmp(big + 12, "ds64", 4) == 0);
+    assert(read_u32((unsigned char *)big + 28) == (uint32_t)(6 * 1000000000LL) &&
+            read_u32((unsigned char *)big + 32) == 1);
+    assert(read_u32((unsigned char *)big + 36) == 1000000000);
+
+    soundio_recorder_destroy(recorder);
+    soundio_instream_destroy(instream);
+    soundio_device_unref(device);
+    soundio_destroy(soundio);
+}
+
+static void put_test_u32(unsigned char *p, uint32_t x) {
+    for (int i = 0; i < 4; i += 1)
+        p[i] = (unsigned char)(x >> (8 * i));
+}
+
+static void test_file_source(void) {
+    // 16-bit stereo at 44100 Hz, with an odd sized chunk ahead of the
+    // samples, which is padded
+    static const char *path = "file_source_test.wav";
+    static const int frame_count = 1000;
+    unsigned char header[56];
+    memset(header, 0, sizeof(header));
+    memcpy(header, "RIFF", 4);
+    put_test_u32(header + 4, sizeof(header) - 8 + frame_count * 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put_test_u32(header + 16, 16);
+    header[20] = 1;
+    header[22] = 2;
+    put_test_u32(header + 24, 44100);
+    put_test_u32(header + 28, 44100 * 4);
+    header[32] = 4;
+    header[34] = 16;
+    memcpy(header + 36, "LIST", 4);
+    put_test_u32(header + 40, 3);
+    memcpy(header + 48, "data", 4);
+    put_test_u32(header + 52, frame_count * 4);
+    FILE *f = fopen(path, "wb");
+    assert(f);
+    assert(fwrite(header, 1, sizeof(header), f) == sizeof(header));
+    for (int i = 0; i < frame_count; i += 1) {
+        int16_t frame[2] = {(int16_t)(i * 10), (int16_t)(-i * 10)};
+        assert(fwrite(frame, 1, sizeof(frame), f) == sizeof(frame));
+    }
+    fclose(f);
+
+    struct SoundIoFileSource *source;
+    ok_or_panic(soundio_file_source_open(path, &source));
+    struct SoundIoFileSourcePrivate *fsp = (struct SoundIoFileSourcePrivate *)source;
+    assert(source->format == SoundIoFormatS16LE);
+    assert(source->channel_count == 2 && source->sample_rate == 44100);
+    assert(source->frame_count == frame_count);
+
+    // the areas are the mapping itself
+    struct SoundIoChannelArea *areas;
+    int count = 600;
+    ok_or_panic(soundio_file_source_begin_read(source, &areas, &count));
+    assert(count == 600);
+    assert(areas[0].ptr == (char *)fsp->mapping.address + sizeof(header));
+    assert(areas[1].ptr == areas[0].ptr + 2 && areas[0].step == 4);
+    int16_t sample;
+    memcpy(&sample, areas[1].ptr + 5 * areas[1].step, 2);
+    assert(sample == -50);
+    soundio_file_source_end_read(source);
+    count = 600;
+    ok_or_panic(soundio_file_source_begin_read(source, &areas, &count));
+    assert(count == 400);
+    soundio_file_source_end_read(source);
+    assert(soundio_file_source_get_position(source) == frame_count);
+    count = 600;
+    ok_or_panic(soundio_file_source_begin_read(source, &areas, &count));
+    assert(count == 0 && areas == NULL);
+
+    struct SoundIo *soundio = soundio_create();
+    assert(soundio);
+    soundio->dummy_clock = SoundIoDummyClockManual;
+    struct SoundIoDevice *device;
+    struct SoundIoOutStream *outstream = open_dummy_clock_stream(soundio, 44100, &device);
+    assert(outstream->format == SoundIoFormatFloat32NE);
+    ok_or_panic(soundio_file_source_attach(source, outstream));
+    assert(soundio_file_source_attach(source, outstream) == SoundIoErrorInvalid);
+
+    // converted in one pass, then silence past the end
+    float out[40];
+    struct SoundIoChannelArea out_areas[2] = {
+        {(char *)&out[0], 2 * sizeof(float)},
+        {(char *)&out[1], 2 * sizeof(float)},
+    };
+    soundio_file_source_seek(source, 990);
+    assert(soundio_file_source_get_position(source) == 990);
+    soundio_file_source_pull(fsp, out_areas, 20);
+    for (int i = 0; i < 20; i += 1) {
+        float expected = (i < 10) ? (990 + i) * 10 / 32768.0f : 0.0f;
+        assert(fabsf(out[2 * i] - expected) < 1e-6f && fabsf(out[2 * i + 1] + expected) < 1e-6f);
+    }
+    // or the start again
+    source->loop = true;
+    soundio_file_source_seek(source, 990);
+    soundio_file_source_pull(fsp, out_areas, 20);
+    for (int i = 0; i < 20; i += 1) {
+        int frame = (990 + i) % frame_count;
+        assert(fabsf(out[2 * i] - frame * 10 / 32768.0f) < 1e-6f);
+    }
+    assert(soundio_file_source_get_position(source) == 10);
+    soundio_file_source_destroy(source);
+
+    // the same file as raw samples includes the header
+    ok_or_panic(soundio_file_source_open_raw(path, SoundIoFormatS16LE, 2, 44100, &source));
+    assert(source->frame_count == frame_count + (int)sizeof(header) / 4);
+    soundio_file_source_destroy(source);
+    assert(soundio_file_source_open_raw(path, SoundIoFormatInvalid, 2, 44100, &source) ==
+            SoundIoErrorInvalid);
+    assert(soundio_file_source_open("no_such_file.wav", &source) == SoundIoErrorFileIo);
+    // packed 24-bit samples are not supported
+    header[34] = 24;
+    header[32] = 6;
+    f = fopen(path, "r+b");
+    assert(f);
+    assert(fwrite(header, 1, sizeof(header), f) == sizeof(header));
+    fclose(f);
+    assert(soundio_file_source_open(path, &source) == SoundIoErrorInvalid);
+    remove(path);
+
+    soundio_outstream_destroy(outstream);
+    soundio_device_unref(device);
+    soundio_destroy(soundio);
+}
+
 struct Test {
     const char *name;
     void (*fn)(void);
@@ -222,7 +2251,39 @@ static struct Test tests[] = {
     {"mirrored memory", test_mirrored_memory},
     {"soundio_device_nearest_sample_rate", test_nearest_sample_rate},
     {"ring buffer basic", test_ring_buffer_basic},
+    {"ring buffer regions", test_ring_buffer_regions},
     {"ring buffer threaded", test_ring_buffer_threaded},
+    {"ring buffer strict roles threaded", test_ring_buffer_strict_roles_threaded},
+    {"block queue threaded", test_block_queue_threaded},
+    {"converter round trip", test_converter_round_trip},
+    {"converter s16", test_converter_s16},
+    {"converter interleave", test_converter_interleave},
+    {"resampler", test_resampler},
+    {"remixer", test_remixer},
+    {"device cache", test_device_cache},
+    {"lazy device probing", test_lazy_device_probing},
+    {"stream stats", test_stream_stats},
+    {"timestamp filter", test_timestamp_filter},
+    {"dummy manual clock", test_dummy_manual_clock},
+    {"dummy free running clock", test_dummy_free_run_clock},
+    {"poll mode", test_poll_mode},
+    {"xrun tracker", test_xrun_tracker},
+    {"xrun policy", test_xrun_policy},
+    {"resampling output stream", test_resampling_outstream},
+    {"remixing output stream", test_remixing_outstream},
+    {"thread settings", test_thread_settings},
+    {"lock memory", test_lock_memory},
+    {"device allocator", test_device_allocator},
+    {"device changes", test_device_changes},
+    {"events", test_events},
+    {"async open and start", test_async_open_start},
+    {"stream group", test_stream_group},
+    {"duplex bridge", test_duplex_bridge},
+    {"duplex stream", test_duplex_stream},
+    {"buffered duplex stream", test_buffered_duplex_stream},
+    {"mixer", test_mixer},
+    {"recorder", test_recorder},
+    {"file source", test_file_source},
     {NULL, NULL},
 };
 